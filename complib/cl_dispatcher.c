@@ -32,7 +32,6 @@
  * SOFTWARE.
  *
  */
-
 /*
  * Abstract:
  *    Implementation of Dispatcher abstraction.
@@ -56,15 +55,99 @@
 #define CL_DISP_INITIAL_REG_COUNT   16
 #define CL_DISP_REG_GROW_SIZE       16
 
+/********************************************************************
+   __cl_disp_account
+
+   Description:
+   This function updates the worker statistics for a message taken
+   off a FIFO.  The worker shard lock must be held.
+
+   Inputs:
+   p_shard - Pointer to the shard of the worker
+   p_msg - Pointer to the message
+   stolen - TRUE if the message was taken from another worker
+
+   Outputs:
+   None
+
+   Returns:
+   None
+********************************************************************/
+static void __cl_disp_account(IN cl_disp_shard_t * const p_shard,
+			      IN const cl_disp_msg_t * const p_msg,
+			      IN const boolean_t stolen)
+{
+	uint64_t now = cl_get_time_stamp();
+	uint64_t queue_time_us = now - p_msg->in_time;
+
+	/* we track the time the last message spent in the queue */
+	p_shard->last_msg_queue_time_us = queue_time_us;
+	p_shard->last_msg_out_time = now;
+	p_shard->total_queue_time_us += queue_time_us;
+	if (queue_time_us > p_shard->max_queue_time_us)
+		p_shard->max_queue_time_us = queue_time_us;
+	p_shard->num_processed++;
+	if (stolen)
+		p_shard->num_stolen++;
+}
+
+/********************************************************************
+   __cl_disp_steal
+
+   Description:
+   This function takes the oldest message that is not bound to its
+   worker off the FIFO of another worker.
+
+   Inputs:
+   p_shard - Pointer to the shard of the idle worker
+
+   Outputs:
+   None
+
+   Returns:
+   The message, or NULL if there is nothing to steal
+********************************************************************/
+static cl_disp_msg_t *__cl_disp_steal(IN cl_disp_shard_t * const p_shard)
+{
+	cl_dispatcher_t *p_disp = p_shard->p_disp;
+	cl_disp_shard_t *p_victim;
+	cl_list_item_t *p_item;
+	uint32_t i, first = p_shard - p_disp->shards;
+
+	for (i = 1; i < p_disp->num_shards; i++) {
+		p_victim = &p_disp->shards[(first + i) % p_disp->num_shards];
+		/* unlocked peek, it is rechecked below */
+		if (!p_victim->num_queued)
+			continue;
+
+		cl_spinlock_acquire(&p_victim->lock);
+		for (p_item = cl_qlist_head(&p_victim->msg_fifo);
+		     p_item != cl_qlist_end(&p_victim->msg_fifo);
+		     p_item = cl_qlist_next(p_item)) {
+			if (((cl_disp_msg_t *) p_item)->p_dest_reg->affinity)
+				continue;
+			cl_qlist_remove_item(&p_victim->msg_fifo, p_item);
+			p_victim->num_queued--;
+			cl_spinlock_release(&p_victim->lock);
+			return (cl_disp_msg_t *) p_item;
+		}
+		cl_spinlock_release(&p_victim->lock);
+	}
+
+	return NULL;
+}
+
 /********************************************************************
    __cl_disp_worker
 
    Description:
-   This function takes messages off the FIFO and calls Processmsg()
+   This function takes messages off the FIFO of a worker and calls
+   Processmsg().  Once the FIFO is empty, it helps the other workers
+   with the messages they are not bound to.
    This function executes as passive level.
 
    Inputs:
-   p_disp - Pointer to Dispatcher object
+   p_shard - Pointer to the shard of the worker
 
    Outputs:
    None
@@ -75,26 +158,36 @@
 void __cl_disp_worker(IN void *context)
 {
 	cl_disp_msg_t *p_msg;
-	cl_dispatcher_t *p_disp = (cl_dispatcher_t *) context;
+	cl_disp_shard_t *p_shard = (cl_disp_shard_t *) context;
+	cl_disp_shard_t *p_home;
 
-	cl_spinlock_acquire(&p_disp->lock);
+	cl_spinlock_acquire(&p_shard->lock);
+	p_shard->busy = TRUE;
 
 	/* Process the FIFO until we drain it dry. */
-	while (cl_qlist_count(&p_disp->msg_fifo)) {
-		/* Pop the message at the head from the FIFO. */
-		p_msg =
-		    (cl_disp_msg_t *) cl_qlist_remove_head(&p_disp->msg_fifo);
-
-		/* we track the time the last message spent in the queue */
-		p_disp->last_msg_queue_time_us =
-		    cl_get_time_stamp() - p_msg->in_time;
+	while (1) {
+		if (cl_qlist_count(&p_shard->msg_fifo)) {
+			/* Pop the message at the head from the FIFO. */
+			p_msg = (cl_disp_msg_t *)
+			    cl_qlist_remove_head(&p_shard->msg_fifo);
+			p_shard->num_queued--;
+			__cl_disp_account(p_shard, p_msg, FALSE);
+			cl_spinlock_release(&p_shard->lock);
+		} else {
+			cl_spinlock_release(&p_shard->lock);
+			p_msg = __cl_disp_steal(p_shard);
+			if (!p_msg)
+				break;
+			cl_spinlock_acquire(&p_shard->lock);
+			__cl_disp_account(p_shard, p_msg, TRUE);
+			cl_spinlock_release(&p_shard->lock);
+		}
 
 		/*
-		 * Release the spinlock while the message is processed.
+		 * The spinlock is not held while the message is processed.
 		 * The user's callback may reenter the dispatcher
 		 * and cause the lock to be reaquired.
 		 */
-		cl_spinlock_release(&p_disp->lock);
 		p_msg->p_dest_reg->pfn_rcv_callback((void *)p_msg->p_dest_reg->
 						    context,
 						    (void *)p_msg->p_data);
@@ -108,14 +201,76 @@ void __cl_disp_worker(IN void *context)
 			cl_atomic_dec(&p_msg->p_src_reg->ref_cnt);
 		}
 
+		/* Return this message to the pool it was taken from. */
+		p_home = p_msg->p_shard;
+		if (p_home != p_shard) {
+			cl_spinlock_acquire(&p_home->lock);
+			cl_qpool_put(&p_home->msg_pool,
+				     (cl_pool_item_t *) p_msg);
+			cl_spinlock_release(&p_home->lock);
+		}
+
 		/* Grab the lock for the next iteration through the list. */
-		cl_spinlock_acquire(&p_disp->lock);
+		cl_spinlock_acquire(&p_shard->lock);
 
-		/* Return this message to the pool. */
-		cl_qpool_put(&p_disp->msg_pool, (cl_pool_item_t *) p_msg);
+		if (p_home == p_shard)
+			cl_qpool_put(&p_shard->msg_pool,
+				     (cl_pool_item_t *) p_msg);
 	}
 
-	cl_spinlock_release(&p_disp->lock);
+	cl_spinlock_acquire(&p_shard->lock);
+	p_shard->busy = FALSE;
+	cl_spinlock_release(&p_shard->lock);
+}
+
+/********************************************************************
+   __cl_disp_select_shard
+
+   Description:
+   This function selects the worker a message is posted to: the
+   worker a registrant with affinity is bound to, or else the least
+   loaded worker.
+
+   Inputs:
+   p_disp - Pointer to Dispatcher object
+   p_dest_reg - Pointer to the registration info of the recipient
+   seed - Value to spread the search start over the workers
+
+   Outputs:
+   None
+
+   Returns:
+   Pointer to the shard of the worker
+********************************************************************/
+static cl_disp_shard_t *__cl_disp_select_shard(IN cl_dispatcher_t *
+					       const p_disp,
+					       IN const cl_disp_reg_info_t *
+					       const p_dest_reg,
+					       IN const uint64_t seed)
+{
+	cl_disp_shard_t *p_shard, *p_best = NULL;
+	uint32_t i, first, load, best_load = 0;
+
+	if (p_disp->num_shards == 1)
+		return p_disp->shards;
+
+	if (p_dest_reg->affinity)
+		return &p_disp->shards[p_dest_reg->msg_id % p_disp->num_shards];
+
+	/* unlocked peeks, the load is only a hint */
+	first = (uint32_t) (seed % p_disp->num_shards);
+	for (i = 0; i < p_disp->num_shards; i++) {
+		p_shard = &p_disp->shards[(first + i) % p_disp->num_shards];
+		load = p_shard->num_queued + (p_shard->busy ? 1 : 0);
+		if (!load)
+			return p_shard;
+		if (!p_best || load < best_load) {
+			p_best = p_shard;
+			best_load = load;
+		}
+	}
+
+	return p_best;
 }
 
 void cl_disp_construct(IN cl_dispatcher_t * const p_disp)
@@ -124,20 +279,24 @@ void cl_disp_construct(IN cl_dispatcher_t * const p_disp)
 
 	cl_qlist_init(&p_disp->reg_list);
 	cl_ptr_vector_construct(&p_disp->reg_vec);
-	cl_qlist_init(&p_disp->msg_fifo);
-	cl_spinlock_construct(&p_disp->lock);
-	cl_qpool_construct(&p_disp->msg_pool);
+	cl_plock_construct(&p_disp->reg_lock);
+	p_disp->shards = NULL;
+	p_disp->num_shards = 0;
 }
 
 void cl_disp_shutdown(IN cl_dispatcher_t * const p_disp)
 {
+	uint32_t i;
+
 	CL_ASSERT(p_disp);
 
-	/* Stop the thread pool. */
-	cl_thread_pool_destroy(&p_disp->worker_threads);
+	/* Stop the worker threads. */
+	for (i = 0; i < p_disp->num_shards; i++)
+		cl_thread_pool_destroy(&p_disp->shards[i].worker_thread);
 
 	/* Process all outstanding callbacks. */
-	__cl_disp_worker(p_disp);
+	for (i = 0; i < p_disp->num_shards; i++)
+		__cl_disp_worker(&p_disp->shards[i]);
 
 	/* Free all registration info. */
 	while (!cl_is_qlist_empty(&p_disp->reg_list))
@@ -146,11 +305,20 @@ void cl_disp_shutdown(IN cl_dispatcher_t * const p_disp)
 
 void cl_disp_destroy(IN cl_dispatcher_t * const p_disp)
 {
+	uint32_t i;
+
 	CL_ASSERT(p_disp);
 
-	cl_spinlock_destroy(&p_disp->lock);
-	/* Destroy the message pool */
-	cl_qpool_destroy(&p_disp->msg_pool);
+	for (i = 0; i < p_disp->num_shards; i++) {
+		cl_spinlock_destroy(&p_disp->shards[i].lock);
+		/* Destroy the message pool */
+		cl_qpool_destroy(&p_disp->shards[i].msg_pool);
+	}
+	free(p_disp->shards);
+	p_disp->shards = NULL;
+	p_disp->num_shards = 0;
+
+	cl_plock_destroy(&p_disp->reg_lock);
 	/* Destroy the pointer vector of registrants. */
 	cl_ptr_vector_destroy(&p_disp->reg_vec);
 }
@@ -159,22 +327,15 @@ cl_status_t cl_disp_init(IN cl_dispatcher_t * const p_disp,
 			 IN const uint32_t thread_count,
 			 IN const char *const name)
 {
+	cl_disp_shard_t *p_shard;
 	cl_status_t status;
+	uint32_t i, count, msg_count;
 
 	CL_ASSERT(p_disp);
 
 	cl_disp_construct(p_disp);
 
-	status = cl_spinlock_init(&p_disp->lock);
-	if (status != CL_SUCCESS) {
-		cl_disp_destroy(p_disp);
-		return (status);
-	}
-
-	/* Specify no upper limit to the number of messages in the pool */
-	status = cl_qpool_init(&p_disp->msg_pool, CL_DISP_INITIAL_MSG_COUNT,
-			       0, CL_DISP_MSG_GROW_SIZE, sizeof(cl_disp_msg_t),
-			       NULL, NULL, NULL);
+	status = cl_plock_init(&p_disp->reg_lock);
 	if (status != CL_SUCCESS) {
 		cl_disp_destroy(p_disp);
 		return (status);
@@ -187,10 +348,61 @@ cl_status_t cl_disp_init(IN cl_dispatcher_t * const p_disp,
 		return (status);
 	}
 
-	status = cl_thread_pool_init(&p_disp->worker_threads, thread_count,
-				     __cl_disp_worker, p_disp, name);
-	if (status != CL_SUCCESS)
+	/* One FIFO per worker thread, one thread per CPU by default */
+	count = thread_count ? thread_count : cl_proc_count();
+	if (!count)
+		count = 1;
+
+	p_disp->shards = calloc(count, sizeof(*p_disp->shards));
+	if (!p_disp->shards) {
 		cl_disp_destroy(p_disp);
+		return (CL_INSUFFICIENT_MEMORY);
+	}
+	p_disp->num_shards = count;
+
+	for (i = 0; i < count; i++) {
+		p_shard = &p_disp->shards[i];
+		cl_spinlock_construct(&p_shard->lock);
+		cl_qlist_init(&p_shard->msg_fifo);
+		cl_qpool_construct(&p_shard->msg_pool);
+		p_shard->p_disp = p_disp;
+	}
+
+	msg_count = CL_DISP_INITIAL_MSG_COUNT / count;
+	if (msg_count < CL_DISP_MSG_GROW_SIZE)
+		msg_count = CL_DISP_MSG_GROW_SIZE;
+
+	for (i = 0; i < count; i++) {
+		p_shard = &p_disp->shards[i];
+
+		status = cl_spinlock_init(&p_shard->lock);
+		if (status != CL_SUCCESS) {
+			cl_disp_destroy(p_disp);
+			return (status);
+		}
+
+		/* Specify no upper limit to the number of messages in the pool */
+		status = cl_qpool_init(&p_shard->msg_pool, msg_count, 0,
+				       CL_DISP_MSG_GROW_SIZE,
+				       sizeof(cl_disp_msg_t), NULL, NULL, NULL);
+		if (status != CL_SUCCESS) {
+			cl_disp_destroy(p_disp);
+			return (status);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		status = cl_thread_pool_init(&p_disp->shards[i].worker_thread,
+					     1, __cl_disp_worker,
+					     &p_disp->shards[i], name);
+		if (status != CL_SUCCESS) {
+			while (i--)
+				cl_thread_pool_destroy(&p_disp->shards[i].
+						       worker_thread);
+			cl_disp_destroy(p_disp);
+			return (status);
+		}
+	}
 
 	return (status);
 }
@@ -207,18 +419,18 @@ cl_disp_reg_handle_t cl_disp_register(IN cl_dispatcher_t * const p_disp,
 	CL_ASSERT(p_disp);
 
 	/* Check that the requested registrant ID is available. */
-	cl_spinlock_acquire(&p_disp->lock);
+	cl_plock_excl_acquire(&p_disp->reg_lock);
 	if ((msg_id != CL_DISP_MSGID_NONE) &&
 	    (msg_id < cl_ptr_vector_get_size(&p_disp->reg_vec)) &&
 	    (cl_ptr_vector_get(&p_disp->reg_vec, msg_id))) {
-		cl_spinlock_release(&p_disp->lock);
+		cl_plock_release(&p_disp->reg_lock);
 		return (NULL);
 	}
 
 	/* Get a registration info from the pool. */
 	p_reg = (cl_disp_reg_info_t *) malloc(sizeof(cl_disp_reg_info_t));
 	if (!p_reg) {
-		cl_spinlock_release(&p_disp->lock);
+		cl_plock_release(&p_disp->reg_lock);
 		return (NULL);
 	} else {
 		memset(p_reg, 0, sizeof(cl_disp_reg_info_t));
@@ -229,6 +441,7 @@ cl_disp_reg_handle_t cl_disp_register(IN cl_dispatcher_t * const p_disp,
 	p_reg->pfn_rcv_callback = pfn_callback;
 	p_reg->context = context;
 	p_reg->msg_id = msg_id;
+	p_reg->affinity = FALSE;
 
 	/* Insert the registration in the list. */
 	cl_qlist_insert_tail(&p_disp->reg_list, (cl_list_item_t *) p_reg);
@@ -238,13 +451,15 @@ cl_disp_reg_handle_t cl_disp_register(IN cl_dispatcher_t * const p_disp,
 	if (msg_id != CL_DISP_MSGID_NONE) {
 		status = cl_ptr_vector_set(&p_disp->reg_vec, msg_id, p_reg);
 		if (status != CL_SUCCESS) {
+			cl_qlist_remove_item(&p_disp->reg_list,
+					     (cl_list_item_t *) p_reg);
 			free(p_reg);
-			cl_spinlock_release(&p_disp->lock);
+			cl_plock_release(&p_disp->reg_lock);
 			return (NULL);
 		}
 	}
 
-	cl_spinlock_release(&p_disp->lock);
+	cl_plock_release(&p_disp->reg_lock);
 
 	return (p_reg);
 }
@@ -261,7 +476,7 @@ void cl_disp_unregister(IN const cl_disp_reg_handle_t handle)
 	p_disp = p_reg->p_disp;
 	CL_ASSERT(p_disp);
 
-	cl_spinlock_acquire(&p_disp->lock);
+	cl_plock_excl_acquire(&p_disp->reg_lock);
 	/*
 	 * Clear the registrant vector entry.  This will cause any further
 	 * post calls to fail.
@@ -271,17 +486,30 @@ void cl_disp_unregister(IN const cl_disp_reg_handle_t handle)
 			  cl_ptr_vector_get_size(&p_disp->reg_vec));
 		cl_ptr_vector_set(&p_disp->reg_vec, p_reg->msg_id, NULL);
 	}
-	cl_spinlock_release(&p_disp->lock);
+	cl_plock_release(&p_disp->reg_lock);
 
 	while (p_reg->ref_cnt > 0)
 		cl_thread_suspend(1);
 
-	cl_spinlock_acquire(&p_disp->lock);
+	cl_plock_excl_acquire(&p_disp->reg_lock);
 	/* Remove the registrant from the list. */
 	cl_qlist_remove_item(&p_disp->reg_list, (cl_list_item_t *) p_reg);
 	free(p_reg);
 
-	cl_spinlock_release(&p_disp->lock);
+	cl_plock_release(&p_disp->reg_lock);
+}
+
+void cl_disp_set_affinity(IN const cl_disp_reg_handle_t handle,
+			  IN const boolean_t affinity)
+{
+	cl_disp_reg_info_t *p_reg = (cl_disp_reg_info_t *) handle;
+
+	CL_ASSERT(handle != CL_DISP_INVALID_HANDLE);
+	CL_ASSERT(p_reg->msg_id != CL_DISP_MSGID_NONE);
+
+	cl_plock_excl_acquire(&p_reg->p_disp->reg_lock);
+	p_reg->affinity = affinity;
+	cl_plock_release(&p_reg->p_disp->reg_lock);
 }
 
 cl_status_t cl_disp_post(IN const cl_disp_reg_handle_t handle,
@@ -293,29 +521,37 @@ cl_status_t cl_disp_post(IN const cl_disp_reg_handle_t handle,
 	cl_disp_reg_info_t *p_src_reg = (cl_disp_reg_info_t *) handle;
 	cl_disp_reg_info_t *p_dest_reg;
 	cl_dispatcher_t *p_disp;
+	cl_disp_shard_t *p_shard;
 	cl_disp_msg_t *p_msg;
+	uint64_t in_time;
 
 	p_disp = handle->p_disp;
 	CL_ASSERT(p_disp);
 	CL_ASSERT(msg_id != CL_DISP_MSGID_NONE);
 
-	cl_spinlock_acquire(&p_disp->lock);
+	cl_plock_acquire(&p_disp->reg_lock);
 	/* Check that the recipient exists. */
 	if (cl_ptr_vector_get_size(&p_disp->reg_vec) <= msg_id) {
-		cl_spinlock_release(&p_disp->lock);
+		cl_plock_release(&p_disp->reg_lock);
 		return (CL_NOT_FOUND);
 	}
 
 	p_dest_reg = cl_ptr_vector_get(&p_disp->reg_vec, msg_id);
 	if (!p_dest_reg) {
-		cl_spinlock_release(&p_disp->lock);
+		cl_plock_release(&p_disp->reg_lock);
 		return (CL_NOT_FOUND);
 	}
 
+	in_time = cl_get_time_stamp();
+	p_shard = __cl_disp_select_shard(p_disp, p_dest_reg, in_time);
+
+	cl_spinlock_acquire(&p_shard->lock);
+
 	/* Get a free message from the pool. */
-	p_msg = (cl_disp_msg_t *) cl_qpool_get(&p_disp->msg_pool);
+	p_msg = (cl_disp_msg_t *) cl_qpool_get(&p_shard->msg_pool);
 	if (!p_msg) {
-		cl_spinlock_release(&p_disp->lock);
+		cl_spinlock_release(&p_shard->lock);
+		cl_plock_release(&p_disp->reg_lock);
 		return (CL_INSUFFICIENT_MEMORY);
 	}
 
@@ -325,7 +561,8 @@ cl_status_t cl_disp_post(IN const cl_disp_reg_handle_t handle,
 	p_msg->p_data = p_data;
 	p_msg->pfn_xmt_callback = pfn_callback;
 	p_msg->context = context;
-	p_msg->in_time = cl_get_time_stamp();
+	p_msg->in_time = in_time;
+	p_msg->p_shard = p_shard;
 
 	/*
 	 * Increment the sender's reference count if they request a completion
@@ -338,11 +575,15 @@ cl_status_t cl_disp_post(IN const cl_disp_reg_handle_t handle,
 	cl_atomic_inc(&p_dest_reg->ref_cnt);
 
 	/* Queue the message in the FIFO. */
-	cl_qlist_insert_tail(&p_disp->msg_fifo, (cl_list_item_t *) p_msg);
-	cl_spinlock_release(&p_disp->lock);
-
-	/* Signal the thread pool that there is work to be done. */
-	cl_thread_pool_signal(&p_disp->worker_threads);
+	cl_qlist_insert_tail(&p_shard->msg_fifo, (cl_list_item_t *) p_msg);
+	p_shard->num_queued++;
+	if (p_shard->num_queued > p_shard->max_queued)
+		p_shard->max_queued = p_shard->num_queued;
+	cl_spinlock_release(&p_shard->lock);
+	cl_plock_release(&p_disp->reg_lock);
+
+	/* Signal the worker that there is work to be done. */
+	cl_thread_pool_signal(&p_shard->worker_thread);
 	return (CL_SUCCESS);
 }
 
@@ -351,15 +592,50 @@ void cl_disp_get_queue_status(IN const cl_disp_reg_handle_t handle,
 			      OUT uint64_t * p_last_msg_queue_time_ms)
 {
 	cl_dispatcher_t *p_disp = ((cl_disp_reg_info_t *) handle)->p_disp;
-
-	cl_spinlock_acquire(&p_disp->lock);
+	cl_disp_shard_t *p_shard;
+	uint64_t last_out_time = 0, last_msg_queue_time_us = 0;
+	uint32_t i, num_queued = 0;
+
+	for (i = 0; i < p_disp->num_shards; i++) {
+		p_shard = &p_disp->shards[i];
+		cl_spinlock_acquire(&p_shard->lock);
+		num_queued += p_shard->num_queued;
+		/* the message taken off a FIFO last, by any worker */
+		if (p_shard->last_msg_out_time >= last_out_time) {
+			last_out_time = p_shard->last_msg_out_time;
+			last_msg_queue_time_us =
+			    p_shard->last_msg_queue_time_us;
+		}
+		cl_spinlock_release(&p_shard->lock);
+	}
 
 	if (p_last_msg_queue_time_ms)
-		*p_last_msg_queue_time_ms =
-		    p_disp->last_msg_queue_time_us / 1000;
+		*p_last_msg_queue_time_ms = last_msg_queue_time_us / 1000;
 
 	if (p_num_queued_msgs)
-		*p_num_queued_msgs = cl_qlist_count(&p_disp->msg_fifo);
+		*p_num_queued_msgs = num_queued;
+}
 
-	cl_spinlock_release(&p_disp->lock);
+void cl_disp_get_stats(IN cl_dispatcher_t * const p_disp,
+		       IN const uint32_t worker,
+		       OUT cl_disp_stats_t * const p_stats)
+{
+	cl_disp_shard_t *p_shard;
+
+	CL_ASSERT(p_disp);
+	CL_ASSERT(worker < p_disp->num_shards);
+	CL_ASSERT(p_stats);
+
+	p_shard = &p_disp->shards[worker];
+
+	cl_spinlock_acquire(&p_shard->lock);
+	p_stats->num_queued = p_shard->num_queued;
+	p_stats->max_queued = p_shard->max_queued;
+	p_stats->num_processed = p_shard->num_processed;
+	p_stats->num_stolen = p_shard->num_stolen;
+	p_stats->avg_queue_time_us = p_shard->num_processed ?
+	    p_shard->total_queue_time_us / p_shard->num_processed : 0;
+	p_stats->max_queue_time_us = p_shard->max_queue_time_us;
+	p_stats->last_msg_queue_time_us = p_shard->last_msg_queue_time_us;
+	cl_spinlock_release(&p_shard->lock);
 }
@@ -46,6 +46,7 @@
 #include <complib/cl_qlist.h>
 #include <complib/cl_qpool.h>
 #include <complib/cl_spinlock.h>
+#include <complib/cl_passivelock.h>
 #include <complib/cl_ptr_vector.h>
 
 #ifdef __cplusplus
@@ -77,7 +78,12 @@ BEGIN_C_DECLS
 *		cl_disp_construct, cl_disp_init, cl_disp_shutdown, cl_disp_destroy
 *
 *	Manipulation:
-*		cl_disp_post, cl_disp_register, cl_disp_unregister
+*		cl_disp_post, cl_disp_register, cl_disp_unregister,
+*		cl_disp_set_affinity
+*
+*	Attributes:
+*		cl_disp_get_queue_status, cl_disp_get_num_workers,
+*		cl_disp_get_stats
 *********/
 /****s* Component Library: Dispatcher/cl_disp_msgid_t
 * NAME
@@ -195,6 +201,87 @@ typedef void
 *	Dispatcher, cl_disp_post
 *********/
 
+/****s* Component Library: Dispatcher/cl_disp_shard_t
+* NAME
+*	cl_disp_shard_t
+*
+* DESCRIPTION
+*	Defines the queue of a single Dispatcher worker thread.
+*
+*	The cl_disp_shard_t structure is for internal use by the
+*	Dispatcher only.
+*
+* SYNOPSIS
+*/
+typedef struct _cl_disp_shard {
+	cl_spinlock_t lock;
+	cl_qlist_t msg_fifo;
+	cl_qpool_t msg_pool;
+	cl_thread_pool_t worker_thread;
+	struct _cl_dispatcher *p_disp;
+	boolean_t busy;
+	uint32_t num_queued;
+	uint32_t max_queued;
+	uint64_t num_processed;
+	uint64_t num_stolen;
+	uint64_t total_queue_time_us;
+	uint64_t max_queue_time_us;
+	uint64_t last_msg_queue_time_us;
+	uint64_t last_msg_out_time;
+} cl_disp_shard_t;
+/*
+* FIELDS
+*	lock
+*		Spinlock to guard the FIFO, the pool and the statistics.
+*
+*	msg_fifo
+*		FIFO of messages posted to this worker.  New messages are
+*		posted to the tail of the FIFO.  The worker pulls messages
+*		from the front, idle workers steal them from the front.
+*
+*	msg_pool
+*		Pool of message objects posted to this worker.  Messages
+*		are returned to the pool of the worker they were posted to,
+*		even when another worker processed them.
+*
+*	worker_thread
+*		Thread pool of the single worker thread of this queue.
+*
+*	p_disp
+*		Pointer to parent Dispatcher.
+*
+*	busy
+*		TRUE while the worker processes messages.
+*
+*	num_queued
+*		Number of messages in the FIFO.
+*
+*	max_queued
+*		Maximum number of messages ever found in the FIFO.
+*
+*	num_processed
+*		Number of messages processed by the worker.
+*
+*	num_stolen
+*		Number of those messages the worker took from the FIFO of
+*		another worker.
+*
+*	total_queue_time_us
+*		The time all processed messages spent in the Q in usec
+*
+*	max_queue_time_us
+*		The longest time a processed message spent in the Q in usec
+*
+*	last_msg_queue_time_us
+*		The time that the last message spent in the Q in usec
+*
+*	last_msg_out_time
+*		The absolute time the last message was taken off a Q
+*
+* SEE ALSO
+*	Dispatcher
+*********/
+
 /****s* Component Library: Dispatcher/cl_dispatcher_t
 * NAME
 *	cl_dispatcher_t
@@ -210,18 +297,17 @@ typedef void
 * SYNOPSIS
 */
 typedef struct _cl_dispatcher {
-	cl_spinlock_t lock;
+	cl_plock_t reg_lock;
 	cl_ptr_vector_t reg_vec;
 	cl_qlist_t reg_list;
-	cl_thread_pool_t worker_threads;
-	cl_qlist_t msg_fifo;
-	cl_qpool_t msg_pool;
-	uint64_t last_msg_queue_time_us;
+	cl_disp_shard_t *shards;
+	uint32_t num_shards;
 } cl_dispatcher_t;
 /*
 * FIELDS
-*	lock
-*		Spinlock to guard internal structures.
+*	reg_lock
+*		Lock to guard the registrations.  Posting a message takes
+*		it shared, registering and unregistering takes it exclusive.
 *
 *	reg_vec
 *		Vector of registration info objects.  Indexed by message msg_id.
@@ -229,19 +315,11 @@ typedef struct _cl_dispatcher {
 *	reg_list
 *		List of registration info objects.
 *
-*	worker_threads
-*		Thread pool of worker threads to dispose of posted messages.
-*
-*	msg_fifo
-*		FIFO of messages being processed by the Dispatcher.  New
-*		messages are posted to the tail of the FIFO.  Worker threads
-*		pull messages from the front.
-*
-*	msg_pool
-*		Pool of message objects to be processed through the FIFO.
+*	shards
+*		Array of per worker thread queues.
 *
-*	last_msg_queue_time_us
-*		The time that the last message spent in the Q in usec
+*	num_shards
+*		Number of worker threads and queues.
 *
 * SEE ALSO
 *	Dispatcher
@@ -266,6 +344,7 @@ typedef struct _cl_disp_reg_info {
 	atomic32_t ref_cnt;
 	cl_disp_msgid_t msg_id;
 	cl_dispatcher_t *p_disp;
+	boolean_t affinity;
 } cl_disp_reg_info_t;
 /*
 * FIELDS
@@ -287,6 +366,10 @@ typedef struct _cl_disp_reg_info {
 *	p_disp
 *		Pointer to parent Dispatcher.
 *
+*	affinity
+*		TRUE if all messages to this registrant are processed by
+*		the same worker, see cl_disp_set_affinity.
+*
 * SEE ALSO
 *********/
 
@@ -310,6 +393,7 @@ typedef struct _cl_disp_msg {
 	cl_pfn_msgdone_cb_t pfn_xmt_callback;
 	uint64_t in_time;
 	const void *context;
+	cl_disp_shard_t *p_shard;
 } cl_disp_msg_t;
 /*
 * FIELDS
@@ -335,9 +419,58 @@ typedef struct _cl_disp_msg {
 *	context
 *		Client's message done callback context.
 *
+*	p_shard
+*		Pointer to the worker queue the message was posted to.
+*
 * SEE ALSO
 *********/
 
+/****s* Component Library: Dispatcher/cl_disp_stats_t
+* NAME
+*	cl_disp_stats_t
+*
+* DESCRIPTION
+*	Defines the statistics of a Dispatcher worker.
+*
+* SYNOPSIS
+*/
+typedef struct _cl_disp_stats {
+	uint32_t num_queued;
+	uint32_t max_queued;
+	uint64_t num_processed;
+	uint64_t num_stolen;
+	uint64_t avg_queue_time_us;
+	uint64_t max_queue_time_us;
+	uint64_t last_msg_queue_time_us;
+} cl_disp_stats_t;
+/*
+* FIELDS
+*	num_queued
+*		Number of messages waiting in the queue of the worker.
+*
+*	max_queued
+*		Maximum number of messages ever waiting in that queue.
+*
+*	num_processed
+*		Number of messages processed by the worker.
+*
+*	num_stolen
+*		Number of those messages taken from the queue of another
+*		worker.
+*
+*	avg_queue_time_us
+*		Average time the processed messages spent in a queue, in usec
+*
+*	max_queue_time_us
+*		Longest time a processed message spent in a queue, in usec
+*
+*	last_msg_queue_time_us
+*		Time the last processed message spent in a queue, in usec
+*
+* SEE ALSO
+*	Dispatcher, cl_disp_get_stats
+*********/
+
 /****s* Component Library: Dispatcher/cl_disp_reg_info_t
 * NAME
 *	cl_disp_reg_info_t
@@ -399,7 +532,8 @@ cl_disp_init(IN cl_dispatcher_t * const p_disp,
 *		per CPU in the system.  When the Dispatcher is created with
 *		only one thread, the Dispatcher guarantees to deliver posted
 *		messages in order.  When the Dispatcher is created with more
-*		than one thread, messages may be delivered out of order.
+*		than one thread, messages may be delivered out of order,
+*		unless they are sent to a registrant with affinity.
 *
 *	name
 *		[in] Name to associate with the threads.  The name may be up to 16
@@ -535,6 +669,42 @@ void cl_disp_unregister(IN const cl_disp_reg_handle_t handle);
 *	Dispatcher, cl_disp_register
 *********/
 
+/****f* Component Library: Dispatcher/cl_disp_set_affinity
+* NAME
+*	cl_disp_set_affinity
+*
+* DESCRIPTION
+*	This function sets whether all messages to a client are processed
+*	by the same worker thread.
+*
+* SYNOPSIS
+*/
+void cl_disp_set_affinity(IN const cl_disp_reg_handle_t handle,
+			  IN const boolean_t affinity);
+/*
+* PARAMETERS
+*	handle
+*		[in] cl_disp_reg_handle_t value return by cl_disp_register.
+*
+*	affinity
+*		[in] TRUE to process the messages to this client by a single
+*		worker thread.
+*
+* RETURN VALUE
+*	This function does not return a value.
+*
+* NOTES
+*	Messages to a client with affinity are processed one at a time,
+*	in the order they were posted, even when the Dispatcher has more
+*	than one worker thread.  Messages to other clients are spread
+*	over the worker threads.
+*
+*	Call this function before messages are posted to the client.
+*
+* SEE ALSO
+*	Dispatcher, cl_disp_register, cl_disp_post
+*********/
+
 /****f* Component Library: Dispatcher/cl_disp_post
 * NAME
 *	cl_disp_post
@@ -614,8 +784,70 @@ cl_disp_get_queue_status(IN const cl_disp_reg_handle_t handle,
 * NOTES
 *	Extarnel Locking is not required.
 *
+*	The number of messages is the sum over all worker queues.
+*
 * SEE ALSO
-*	Dispatcher
+*	Dispatcher, cl_disp_get_stats
+*********/
+
+/****f* Component Library: Dispatcher/cl_disp_get_num_workers
+* NAME
+*	cl_disp_get_num_workers
+*
+* DESCRIPTION
+*	This function returns the number of worker threads of a Dispatcher.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+cl_disp_get_num_workers(IN const cl_dispatcher_t * const p_disp)
+{
+	return p_disp->num_shards;
+}
+/*
+* PARAMETERS
+*	p_disp
+*		[in] Pointer to a Dispatcher.
+*
+* RETURN VALUE
+*	Number of worker threads, each with its own queue.
+*
+* SEE ALSO
+*	Dispatcher, cl_disp_get_stats
+*********/
+
+/****f* Component Library: Dispatcher/cl_disp_get_stats
+* NAME
+*	cl_disp_get_stats
+*
+* DESCRIPTION
+*	This function gets the statistics of a Dispatcher worker thread.
+*
+* SYNOPSIS
+*/
+void
+cl_disp_get_stats(IN cl_dispatcher_t * const p_disp, IN const uint32_t worker,
+		  OUT cl_disp_stats_t * const p_stats);
+/*
+* PARAMETERS
+*	p_disp
+*		[in] Pointer to a Dispatcher.
+*
+*	worker
+*		[in] Index of the worker thread, less than the value returned
+*		by cl_disp_get_num_workers.
+*
+*	p_stats
+*		[out] Pointer to the statistics of the worker.
+*
+* RETURN VALUE
+*	This function does not return a value.
+*
+* NOTES
+*	Extarnel Locking is not required.
+*
+* SEE ALSO
+*	Dispatcher, cl_disp_stats_t, cl_disp_get_num_workers
 *********/
 
 END_C_DECLS
@@ -41,6 +41,7 @@
 #include <complib/cl_qlist.h>
 #include <opensm/osm_config.h>
 #include <opensm/osm_switch.h>
+#include <opensm/osm_sweep_prof.h>
 
 #ifdef __cplusplus
 #  define BEGIN_C_DECLS extern "C" {
@@ -80,6 +81,7 @@ typedef enum {
 	OSM_EVENT_ID_STATE_CHANGE,
 	OSM_EVENT_ID_SA_DB_DUMPED,
 	OSM_EVENT_ID_LFT_CHANGE,
+	OSM_EVENT_ID_SWEEP_PROFILE,
 	OSM_EVENT_ID_MAX
 } osm_epi_event_id_t;
 
@@ -107,6 +109,14 @@ typedef struct osm_epi_lft_change_event {
 	uint32_t block_num;
 } osm_epi_lft_change_event_t;
 
+/** =========================================================================
+ * Sweep profile event
+ * OSM_EVENT_ID_SWEEP_PROFILE
+ * Reported at the end of each sweep when the sweep profiler is enabled
+ * (sweep_profile_history); the event data is the osm_sweep_prof_rec_t
+ * of the sweep.
+ */
+
 /** =========================================================================
  * Port error event
  * OSM_EVENT_ID_PORT_COUNTER
@@ -153,6 +153,10 @@ typedef enum _osm_file_ids_enum {
 	OSM_FILE_CONGESTION_CONTROL_C,
 	OSM_FILE_UCAST_NUE_C,
     OSM_FILE_UCAST_LNMP_C,
+    OSM_FILE_ROUTING_BENCH_C,
+    OSM_FILE_SA_SNAPSHOT_C,
+    OSM_FILE_SWEEP_PROF_C,
+    OSM_FILE_UCAST_BACKUP_C,
 } osm_file_ids_enum;
 /***********/
 
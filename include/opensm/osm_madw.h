@@ -183,6 +183,7 @@ typedef struct osm_pi_context {
 	boolean_t light_sweep;
 	boolean_t active_transition;
 	boolean_t client_rereg;
+	boolean_t backup_lft;
 } osm_pi_context_t;
 /*********/
 
@@ -456,6 +457,11 @@ typedef struct osm_madw {
 	cl_disp_msgid_t fail_msg;
 	boolean_t resp_expected;
 	uint32_t timeout;
+	uint64_t vl15_key;
+	uint64_t send_time;
+	boolean_t dr_fallback;
+	uint8_t dr_hop_count;
+	uint8_t dr_path[IB_SUBNET_PATH_HOPS_MAX];
 	const ib_mad_t *p_mad;
 } osm_madw_t;
 /*
@@ -499,6 +505,24 @@ typedef struct osm_madw {
 *	timeout
 *		Transaction timeout in msec.
 *
+*	vl15_key
+*		Destination of a request MAD queued on the VL15 interface.
+*		0 if the MAD is not accounted per destination.
+*
+*	send_time
+*		Time stamp in usec at which the VL15 interface passed the
+*		request MAD to the transport.
+*
+*	dr_fallback
+*		TRUE if this LID routed SMP is resent with the directed
+*		route in dr_hop_count and dr_path when it fails.
+*
+*	dr_hop_count
+*		Hop count of the directed route to fall back to.
+*
+*	dr_path
+*		Initial path of the directed route to fall back to.
+*
 *	p_mad
 *		Pointer to the wire MAD.  The MAD itself cannot be part of the
 *		wrapper, since wire MADs typically reside in special memory
@@ -46,6 +46,7 @@
 #include <complib/cl_passivelock.h>
 #include <complib/cl_event.h>
 #include <complib/cl_timer.h>
+#include <complib/cl_thread.h>
 #include <opensm/osm_subnet.h>
 #include <opensm/osm_log.h>
 #include <opensm/osm_perfmgr_db.h>
@@ -158,12 +159,44 @@ typedef struct osm_perfmgr {
 	boolean_t query_cpi;
 	boolean_t xmit_wait_log;
 	uint32_t xmit_wait_threshold;
+	boolean_t stream;
+	cl_thread_t stream_thread;
+	cl_event_t stream_event;
+	osm_thread_state_t stream_state;
+	double tokens;
+	double token_rate;
+	uint64_t token_time;
+	uint32_t window;
+	uint32_t window_acked;
+	uint32_t window_epoch;
+	uint64_t srtt;
+	uint64_t base_rtt;
+	atomic32_t samples;
+	double samples_per_s;
 } osm_perfmgr_t;
 /*
 * FIELDS
 *	subn
 *	      Subnet object for this subnet.
 *
+*	stream
+*	      perfmgr_stream is set: the sweeps are run by stream_thread,
+*	      paced so that each takes perfmgr_sweep_time_s, with at most
+*	      window queries outstanding.
+*
+*	tokens
+*	      Ports which may be queried now; grows by token_rate per
+*	      usec since token_time.
+*
+*	window
+*	      Queries allowed on the wire in stream mode, adapted to the
+*	      smoothed response latency srtt and the lowest one seen,
+*	      base_rtt (usec).
+*
+*	samples
+*	      PortCounters responses received; samples_per_s is their
+*	      rate during the last sweep.
+*
 *	log
 *	      Pointer to the log object.
 *
@@ -276,6 +309,8 @@ void osm_perfmgr_dump_counters(osm_perfmgr_t * p_perfmgr,
 			       perfmgr_db_dump_t dump_type);
 void osm_perfmgr_print_counters(osm_perfmgr_t *pm, char *nodename, FILE *fp,
 				char *port, int err_only);
+void osm_perfmgr_print_top(osm_perfmgr_t *pm, FILE *fp, unsigned count,
+			   perfmgr_db_hist_col_t cntr);
 void osm_perfmgr_update_nodename(osm_perfmgr_t *pm, uint64_t node_guid,
 				char *nodename);
 
@@ -128,6 +128,7 @@ typedef struct db_port {
 	perfmgr_db_data_cnt_reading_t dc_previous;
 	time_t last_reset;
 	boolean_t valid;
+	uint64_t hist_xmit_wait;	/* since the last history sample */
 } db_port_t;
 
 /** =========================================================================
@@ -141,9 +142,62 @@ typedef struct db_node {
 	boolean_t esp0;
 	db_port_t *ports;
 	uint8_t num_ports;
+	uint32_t hist_slot;	/* of port 0, PERFMGR_HIST_NO_SLOT if none */
 	char node_name[NODE_NAME_SIZE];
 } db_node_t;
 
+/** =========================================================================
+ * Port counter history.
+ * Each port has a slot with a ring of num_samples samples.  A sample
+ * holds the changes of the counters since the previous data counter
+ * reading and the seconds between the two; the interval is 0 for the
+ * first reading of a port, whose changes are not known.  The samples
+ * are stored by column, one array of max_slots * num_samples values
+ * per column, so the same counter of all ports is contiguous.  The
+ * header, slots and columns follow each other in one block, which is
+ * mapped from perfmgr_history_file if one is given.
+ */
+typedef enum {
+	PERFMGR_HIST_XMIT_DATA = 0,	/* 4 octet units */
+	PERFMGR_HIST_RCV_DATA,
+	PERFMGR_HIST_XMIT_PKTS,
+	PERFMGR_HIST_RCV_PKTS,
+	PERFMGR_HIST_XMIT_WAIT,
+	PERFMGR_HIST_NUM_CNTRS,
+	PERFMGR_HIST_TIME = PERFMGR_HIST_NUM_CNTRS,
+	PERFMGR_HIST_INTERVAL,
+	PERFMGR_HIST_NUM_COLS
+} perfmgr_db_hist_col_t;
+
+#define PERFMGR_HIST_NO_SLOT	0xffffffff
+
+typedef struct perfmgr_db_hist_hdr {
+	char magic[8];
+	uint32_t num_samples;
+	uint32_t max_slots;
+	uint32_t num_slots;	/* slots ever used */
+	uint32_t reserved;
+} perfmgr_db_hist_hdr_t;
+
+typedef struct perfmgr_db_hist_slot {
+	uint64_t node_guid;	/* 0 if the slot is free */
+	uint32_t head;		/* next sample written */
+	uint32_t count;
+	uint8_t port;
+	uint8_t num_ports;	/* of the node */
+	uint8_t reserved[6];
+} perfmgr_db_hist_slot_t;
+
+typedef struct perfmgr_db_hist {
+	perfmgr_db_hist_hdr_t *hdr;	/* NULL without history */
+	perfmgr_db_hist_slot_t *slots;
+	uint64_t *cols[PERFMGR_HIST_NUM_COLS];
+	size_t size;
+	int fd;			/* -1 if not mapped from a file */
+	uint8_t *claimed;	/* slots in use by the nodes of this run */
+	uint32_t num_unclaimed;	/* used slots read from the file */
+} perfmgr_db_hist_t;
+
 /** =========================================================================
  * all nodes in the subnet.
  */
@@ -151,6 +205,7 @@ typedef struct perfmgr_db {
 	cl_qmap_t pc_data;	/* stores type (db_node_t *) */
 	cl_plock_t lock;
 	struct osm_perfmgr *perfmgr;
+	perfmgr_db_hist_t hist;
 } perfmgr_db_t;
 
 /**
@@ -201,6 +256,13 @@ void perfmgr_db_print_by_name(perfmgr_db_t * db, char *nodename, FILE *fp,
 void perfmgr_db_print_by_guid(perfmgr_db_t * db, uint64_t guid, FILE *fp,
 			      char *port, int err_only);
 
+const char *perfmgr_db_hist_cntr_str(perfmgr_db_hist_col_t cntr);
+perfmgr_db_err_t perfmgr_db_get_rates(perfmgr_db_t * db, uint64_t guid,
+				      uint8_t port,
+				      double rates[PERFMGR_HIST_NUM_CNTRS]);
+void perfmgr_db_print_top(perfmgr_db_t * db, FILE *fp, unsigned count,
+			  perfmgr_db_hist_col_t cntr);
+
 /** =========================================================================
  * helper functions to fill in the various db objects from wire objects
  */
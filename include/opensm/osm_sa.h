@@ -49,6 +49,7 @@
 #include <complib/cl_thread.h>
 #include <complib/cl_timer.h>
 #include <complib/cl_dispatcher.h>
+#include <complib/cl_spinlock.h>
 #include <opensm/osm_stats.h>
 #include <opensm/osm_subnet.h>
 #include <vendor/osm_vendor_api.h>
@@ -166,6 +167,268 @@ typedef struct osm_sa_item {
 #define SA_ITEM_RESP_SIZE(_m) offsetof(osm_sa_item_t, resp._m) + \
 			      sizeof(((osm_sa_item_t *)NULL)->resp._m)
 
+/****s* OpenSM: SA/osm_sa_resp_t
+* NAME
+*	osm_sa_resp_t
+*
+* DESCRIPTION
+*	SA response records under construction.  The records are kept
+*	back to back, as they are sent in the response payload, in a
+*	buffer that grows as records are added.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sa_resp {
+	uint8_t *recs;
+	size_t attr_size;
+	unsigned num_rec;
+	unsigned max_rec;
+} osm_sa_resp_t;
+/*
+* FIELDS
+*	recs
+*		Buffer of max_rec records, allocated on first use.
+*
+*	attr_size
+*		Size of the SA attribute of the records.
+*
+*	num_rec
+*		Number of records added.
+*
+*	max_rec
+*		Number of records the buffer can hold.
+*
+* NOTES
+*	Adding a record may move the buffer, so a pointer to a record
+*	is only valid until the next record is added.
+*
+* SEE ALSO
+*	osm_sa_resp_init, osm_sa_resp_add, osm_sa_resp_send
+*********/
+
+/****s* OpenSM: SA/osm_sa_pr_cache_t
+* NAME
+*	osm_sa_pr_cache_t
+*
+* DESCRIPTION
+*	PathRecord path parameter cache.  Holds, per ingress switch and
+*	destination LID, the path parameters of the route from the egress
+*	port of that switch to the destination, as computed by the
+*	PathRecord receiver.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sa_pr_cache {
+	cl_spinlock_t lock;
+	uint32_t **rows;
+	uint16_t num_rows;
+	uint16_t row_len;
+} osm_sa_pr_cache_t;
+/*
+* FIELDS
+*	lock
+*		Serializes the accesses of the SA threads.
+*
+*	rows
+*		Array of num_rows rows indexed by the base LID of the
+*		ingress switch.  Each row is allocated on first use and
+*		holds row_len entries indexed by destination LID; zero
+*		entries are not cached.
+*
+*	num_rows
+*		Number of entries in rows.
+*
+*	row_len
+*		Number of entries in each row.
+*
+* SEE ALSO
+*	osm_sa_pr_cache_flush, osm_sa_pr_cache_invalidate
+*********/
+
+/****s* OpenSM: SA/osm_sa_cache_t
+* NAME
+*	osm_sa_cache_t
+*
+* DESCRIPTION
+*	SA response cache.  Holds the records of recent GetTable
+*	responses, so identical queries are answered by copying them.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sa_cache {
+	cl_spinlock_t lock;
+	cl_qmap_t map;
+	cl_qlist_t lru;
+	uint32_t generation;
+	uint64_t hits;
+	uint64_t misses;
+} osm_sa_cache_t;
+/*
+* FIELDS
+*	lock
+*		Serializes the accesses of the SA threads.
+*
+*	map
+*		The cached responses, keyed by the hash of their query.
+*
+*	lru
+*		The cached responses, least recently used first.
+*
+*	generation
+*		Incremented whenever the subnet data the responses are
+*		built from changes.  Odd while a sweep is running, when
+*		nothing is cached.
+*
+*	hits
+*		Number of queries answered from the cache.
+*
+*	misses
+*		Number of cacheable queries not found in the cache.
+*
+* SEE ALSO
+*	osm_sa_cache_req_t, osm_sa_cache_get, osm_sa_cache_put
+*********/
+
+#define OSM_SA_CACHE_KEY_MAX 512
+
+/****s* OpenSM: SA/osm_sa_cache_req_t
+* NAME
+*	osm_sa_cache_req_t
+*
+* DESCRIPTION
+*	Key of a query in the SA response cache: the attribute, method,
+*	attribute modifier, component mask, SM_Key being non zero and
+*	request record, and the PKeys of the requester port, which decide
+*	which records the requester may see.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sa_cache_req {
+	boolean_t cacheable;
+	boolean_t full_member;
+	unsigned num_pkeys;
+	uint32_t generation;
+	uint64_t hash;
+	size_t key_len;
+	uint8_t key[OSM_SA_CACHE_KEY_MAX];
+} osm_sa_cache_req_t;
+/*
+* FIELDS
+*	cacheable
+*		FALSE if the response to this query is not cached.
+*
+*	full_member
+*		TRUE if one of the requester PKeys is a full membership
+*		PKey.
+*
+*	num_pkeys
+*		Number of requester PKeys in the key.
+*
+*	generation
+*		Cache generation the query was looked up in.
+*
+*	hash
+*		Hash of the key.
+*
+*	key_len
+*		Number of bytes used in key.
+*
+*	key
+*		The key.
+*
+* SEE ALSO
+*	osm_sa_cache_req_init, osm_sa_cache_req_add_pkey
+*********/
+
+/****s* OpenSM: SA/osm_sa_snap_port_t
+* NAME
+*	osm_sa_snap_port_t
+*
+* DESCRIPTION
+*	A physical port in an SA snapshot.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sa_snap_port {
+	ib_node_record_t node_rec;
+	uint32_t pkeys;
+	uint16_t num_pkeys;
+	uint8_t lmc;
+} osm_sa_snap_port_t;
+/*
+* FIELDS
+*	node_rec
+*		The NodeRecord of the port, with the base LID of the port.
+*
+*	pkeys
+*		Index of the first PKey of the port in the snapshot pkeys.
+*
+*	num_pkeys
+*		Number of PKeys of the port.
+*
+*	lmc
+*		LMC of the port.
+*
+* SEE ALSO
+*	osm_sa_snapshot_t
+*********/
+
+/****s* OpenSM: SA/osm_sa_snapshot_t
+* NAME
+*	osm_sa_snapshot_t
+*
+* DESCRIPTION
+*	Read-only copy of the subnet data the SA queries read, published
+*	at the end of the sweeps.  Queries take a reference to the current
+*	snapshot and read it without the subnet lock, so they are not
+*	blocked by the sweeps and always see a consistent subnet.  A new
+*	snapshot replaces the current one; the old one is freed when its
+*	last reader releases it.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sa_snapshot {
+	atomic32_t ref_cnt;
+	uint32_t version;
+	uint32_t num_ports;
+	osm_sa_snap_port_t *ports;
+	uint16_t *pkeys;
+	uint16_t max_lid_ho;
+	uint32_t *lid_tbl;
+} osm_sa_snapshot_t;
+/*
+* FIELDS
+*	ref_cnt
+*		Number of references: one for the SA while the snapshot is
+*		the current one, plus one per query reading it.
+*
+*	version
+*		Sequence number of the snapshot.
+*
+*	num_ports
+*		Number of ports; for switches only port 0 is included.
+*
+*	ports
+*		The ports, in the order of the node GUID table.
+*
+*	pkeys
+*		The PKeys of all ports in host order, sorted per port by
+*		base PKey.  A base appears once per port and has the full
+*		membership bit set if the port is a full member.
+*
+*	max_lid_ho
+*		Highest LID in lid_tbl.
+*
+*	lid_tbl
+*		Index in ports of the port owning each LID,
+*		OSM_SA_SNAP_NO_PORT if none.
+*
+* SEE ALSO
+*	osm_sa_snapshot_publish, osm_sa_snapshot_get
+*********/
+
+#define OSM_SA_SNAP_NO_PORT 0xFFFFFFFF
+
 /****s* OpenSM: SM/osm_sa_t
 * NAME
 *	osm_sa_t
@@ -216,6 +479,11 @@ typedef struct osm_sa {
 	cl_disp_reg_handle_t gir_set_disp_h;
 	cl_disp_reg_handle_t mcmr_set_disp_h;
 	cl_disp_reg_handle_t sr_set_disp_h;
+	osm_sa_pr_cache_t pr_cache;
+	osm_sa_cache_t cache;
+	cl_spinlock_t snapshot_lock;
+	osm_sa_snapshot_t *p_snapshot;
+	uint32_t snapshot_version;
 } osm_sa_t;
 /*
 * FIELDS
@@ -256,6 +524,21 @@ typedef struct osm_sa {
 *		A flag that denotes that SA DB is dirty and needs
 *		to be written to the dump file (if dumping is enabled)
 *
+*	pr_cache
+*		PathRecord path parameter cache (if sa_pr_cache is enabled)
+*
+*	cache
+*		SA response cache (if sa_cache_size is not zero)
+*
+*	snapshot_lock
+*		Protects p_snapshot while taking a reference.
+*
+*	p_snapshot
+*		The current subnet snapshot (if sa_snapshot is enabled).
+*
+*	snapshot_version
+*		Version of the last published snapshot.
+*
 * SEE ALSO
 *	SM object
 *********/
@@ -493,7 +776,140 @@ void osm_sa_respond(osm_sa_t *sa, osm_madw_t *madw, size_t attr_size,
 *	None.
 *
 * SEE ALSO
-*	SA object
+*	SA object, osm_sa_resp_send
+*********/
+
+/****f* OpenSM: SA/osm_sa_resp_init
+* NAME
+*	osm_sa_resp_init
+*
+* DESCRIPTION
+*	Initializes an empty set of SA response records
+*
+* SYNOPSIS
+*/
+static inline void osm_sa_resp_init(OUT osm_sa_resp_t * resp,
+				    IN size_t attr_size)
+{
+	memset(resp, 0, sizeof(*resp));
+	resp->attr_size = attr_size;
+}
+/*
+* PARAMETERS
+*	resp
+*		[out] Pointer to the response records.
+*
+*	attr_size
+*		[in] Size of this SA attribute.
+*
+* RETURN VALUES
+*	None.
+*
+* SEE ALSO
+*	SA object, osm_sa_resp_add, osm_sa_resp_send
+*********/
+
+/****f* OpenSM: SA/osm_sa_resp_add
+* NAME
+*	osm_sa_resp_add
+*
+* DESCRIPTION
+*	Appends a record to SA response records
+*
+* SYNOPSIS
+*/
+void *osm_sa_resp_add(IN osm_sa_resp_t * resp);
+/*
+* PARAMETERS
+*	resp
+*		[in] Pointer to the response records.
+*
+* RETURN VALUES
+*	Pointer to the new record, cleared, or NULL if the buffer
+*	could not grow.
+*
+* SEE ALSO
+*	SA object, osm_sa_resp_remove_last, osm_sa_resp_send
+*********/
+
+/****f* OpenSM: SA/osm_sa_resp_remove_last
+* NAME
+*	osm_sa_resp_remove_last
+*
+* DESCRIPTION
+*	Removes the last record added to SA response records
+*
+* SYNOPSIS
+*/
+static inline void osm_sa_resp_remove_last(IN osm_sa_resp_t * resp)
+{
+	CL_ASSERT(resp->num_rec);
+	resp->num_rec--;
+}
+/*
+* PARAMETERS
+*	resp
+*		[in] Pointer to the response records.
+*
+* RETURN VALUES
+*	None.
+*
+* SEE ALSO
+*	SA object, osm_sa_resp_add
+*********/
+
+/****f* OpenSM: SA/osm_sa_resp_destroy
+* NAME
+*	osm_sa_resp_destroy
+*
+* DESCRIPTION
+*	Frees SA response records
+*
+* SYNOPSIS
+*/
+void osm_sa_resp_destroy(IN osm_sa_resp_t * resp);
+/*
+* PARAMETERS
+*	resp
+*		[in] Pointer to the response records.
+*
+* RETURN VALUES
+*	None.
+*
+* SEE ALSO
+*	SA object, osm_sa_resp_init
+*********/
+
+/****f* OpenSM: SA/osm_sa_resp_send
+* NAME
+*	osm_sa_resp_send
+*
+* DESCRIPTION
+*	Sends SA MAD response with the given records
+*
+* SYNOPSIS
+*/
+void osm_sa_resp_send(IN osm_sa_t * sa, IN osm_madw_t * madw,
+		      IN osm_sa_resp_t * resp);
+/*
+* PARAMETERS
+*	sa
+*		[in] Pointer to an osm_sa_t object.
+*
+*	p_madw
+*		[in] Original MAD to which the response must be sent.
+*
+*	resp
+*		[in] Response records - they are freed after sending.
+*
+* RETURN VALUES
+*	None.
+*
+* NOTES
+*	Same as osm_sa_respond, without a memory allocation per record.
+*
+* SEE ALSO
+*	SA object, osm_sa_respond
 *********/
 
 struct osm_opensm;
@@ -539,6 +955,298 @@ int osm_sa_db_file_load(struct osm_opensm *p_osm);
 *
 *********/
 
+/****f* OpenSM: SA/osm_sa_pr_cache_get
+* NAME
+*	osm_sa_pr_cache_get
+*
+* DESCRIPTION
+*	Returns the cached path parameters from the switch with the
+*	given base LID to the given destination LID, zero if none.
+*
+* SYNOPSIS
+*/
+uint32_t osm_sa_pr_cache_get(IN osm_sa_t * sa, IN uint16_t sw_lid_ho,
+			     IN uint16_t dlid_ho);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_pr_cache_set
+* NAME
+*	osm_sa_pr_cache_set
+*
+* DESCRIPTION
+*	Caches the path parameters from the switch with the given base
+*	LID to the given destination LID.  The entry is silently dropped
+*	if the memory cannot be allocated or the LIDs are out of range.
+*
+* SYNOPSIS
+*/
+void osm_sa_pr_cache_set(IN osm_sa_t * sa, IN uint16_t sw_lid_ho,
+			 IN uint16_t dlid_ho, IN uint32_t entry);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_pr_cache_invalidate
+* NAME
+*	osm_sa_pr_cache_invalidate
+*
+* DESCRIPTION
+*	Drops the cached path parameters towards the destination LIDs
+*	lid_lo_ho to lid_hi_ho of all switches.  Called when the
+*	forwarding entries of these LIDs change on some switch.
+*
+* SYNOPSIS
+*/
+void osm_sa_pr_cache_invalidate(IN osm_sa_t * sa, IN uint16_t lid_lo_ho,
+				IN uint16_t lid_hi_ho);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_pr_cache_flush
+* NAME
+*	osm_sa_pr_cache_flush
+*
+* DESCRIPTION
+*	Drops all cached path parameters and frees the cache memory.
+*	Called when a port attribute a path depends on changes.
+*
+* SYNOPSIS
+*/
+void osm_sa_pr_cache_flush(IN osm_sa_t * sa);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_req_init
+* NAME
+*	osm_sa_cache_req_init
+*
+* DESCRIPTION
+*	Starts the cache key of a request from its SA MAD header and
+*	record of attr_size bytes.  Only GetTable requests are cached.
+*
+* SYNOPSIS
+*/
+void osm_sa_cache_req_init(IN osm_sa_t * sa, OUT osm_sa_cache_req_t * req,
+			   IN const ib_sa_mad_t * sa_mad, IN size_t attr_size);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_req_add_pkey
+* NAME
+*	osm_sa_cache_req_add_pkey
+*
+* DESCRIPTION
+*	Adds a PKey of the requester port, in host order and with the
+*	membership bit, to the cache key of a request.  The same PKeys
+*	added in another order give another key.
+*
+* SYNOPSIS
+*/
+static inline void osm_sa_cache_req_add_pkey(IN OUT osm_sa_cache_req_t * req,
+					     IN uint16_t pkey)
+{
+	if (!req->cacheable)
+		return;
+	if (req->key_len + sizeof(pkey) > sizeof(req->key)) {
+		req->cacheable = FALSE;
+		return;
+	}
+	memcpy(req->key + req->key_len, &pkey, sizeof(pkey));
+	req->key_len += sizeof(pkey);
+	req->num_pkeys++;
+	if (pkey & 0x8000)
+		req->full_member = TRUE;
+}
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_req_add_physp
+* NAME
+*	osm_sa_cache_req_add_physp
+*
+* DESCRIPTION
+*	Adds the PKeys of the requester physical port to the cache key
+*	of a request.
+*
+* SYNOPSIS
+*/
+void osm_sa_cache_req_add_physp(IN OUT osm_sa_cache_req_t * req,
+				IN const osm_physp_t * p_physp);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_get
+* NAME
+*	osm_sa_cache_get
+*
+* DESCRIPTION
+*	Looks up the response to a request in the SA response cache.
+*	On a hit, copies the cached records to resp, which must be
+*	initialized with the record size of the request and empty.
+*
+* SYNOPSIS
+*/
+boolean_t osm_sa_cache_get(IN osm_sa_t * sa, IN osm_sa_cache_req_t * req,
+			   IN OUT osm_sa_resp_t * resp);
+/*
+* RETURN VALUES
+*	TRUE if the response was found in the cache.
+*
+* NOTES
+*	A request that misses must be followed by osm_sa_cache_put
+*	with the records of its response.
+*********/
+
+/****f* OpenSM: SA/osm_sa_cache_put
+* NAME
+*	osm_sa_cache_put
+*
+* DESCRIPTION
+*	Caches the response records of a request that missed in
+*	osm_sa_cache_get.  The response is not cached if the subnet
+*	changed since the lookup.
+*
+* SYNOPSIS
+*/
+void osm_sa_cache_put(IN osm_sa_t * sa, IN const osm_sa_cache_req_t * req,
+		      IN const osm_sa_resp_t * resp);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_invalidate
+* NAME
+*	osm_sa_cache_invalidate
+*
+* DESCRIPTION
+*	Invalidates all cached responses.  Called when the subnet data
+*	of the cached attributes changes outside of a sweep.
+*
+* SYNOPSIS
+*/
+void osm_sa_cache_invalidate(IN osm_sa_t * sa);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_sweep_start
+* NAME
+*	osm_sa_cache_sweep_start
+*
+* DESCRIPTION
+*	Drops all cached responses and stops caching until the sweep
+*	is done.
+*
+* SYNOPSIS
+*/
+void osm_sa_cache_sweep_start(IN osm_sa_t * sa);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_sweep_done
+* NAME
+*	osm_sa_cache_sweep_done
+*
+* DESCRIPTION
+*	Resumes caching after a sweep.
+*
+* SYNOPSIS
+*/
+void osm_sa_cache_sweep_done(IN osm_sa_t * sa);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_cache_get_stats
+* NAME
+*	osm_sa_cache_get_stats
+*
+* DESCRIPTION
+*	Returns the number of cached responses and the hit and miss
+*	counters of the SA response cache.
+*
+* SYNOPSIS
+*/
+void osm_sa_cache_get_stats(IN osm_sa_t * sa, OUT unsigned *p_num_entries,
+			    OUT uint64_t * p_hits, OUT uint64_t * p_misses);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_snapshot_publish
+* NAME
+*	osm_sa_snapshot_publish
+*
+* DESCRIPTION
+*	Builds a snapshot of the subnet and makes it the current one.
+*	Takes the subnet lock for reading while building.  If sa_snapshot
+*	is disabled, drops the current snapshot instead.
+*
+* SYNOPSIS
+*/
+void osm_sa_snapshot_publish(IN osm_sa_t * sa);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_snapshot_invalidate
+* NAME
+*	osm_sa_snapshot_invalidate
+*
+* DESCRIPTION
+*	Drops the current snapshot, so queries take the subnet lock until
+*	the next one is published.  Called when the subnet changes outside
+*	of a sweep; does not take the subnet lock.
+*
+* SYNOPSIS
+*/
+void osm_sa_snapshot_invalidate(IN osm_sa_t * sa);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_snapshot_get
+* NAME
+*	osm_sa_snapshot_get
+*
+* DESCRIPTION
+*	Returns a reference to the current snapshot, NULL if there is
+*	none.  The reference must be released by osm_sa_snapshot_put.
+*
+* SYNOPSIS
+*/
+osm_sa_snapshot_t *osm_sa_snapshot_get(IN osm_sa_t * sa);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_snapshot_put
+* NAME
+*	osm_sa_snapshot_put
+*
+* DESCRIPTION
+*	Releases a reference to a snapshot, freeing it with the last one.
+*
+* SYNOPSIS
+*/
+void osm_sa_snapshot_put(IN osm_sa_snapshot_t * p_snap);
+/*********/
+
+/****f* OpenSM: SA/osm_sa_snapshot_get_port_by_lid
+* NAME
+*	osm_sa_snapshot_get_port_by_lid
+*
+* DESCRIPTION
+*	Returns the index of the port owning the given LID in a snapshot,
+*	OSM_SA_SNAP_NO_PORT if none.
+*
+* SYNOPSIS
+*/
+static inline uint32_t
+osm_sa_snapshot_get_port_by_lid(IN const osm_sa_snapshot_t * p_snap,
+				IN ib_net16_t lid)
+{
+	uint16_t lid_ho = cl_ntoh16(lid);
+
+	if (!lid_ho || lid_ho > p_snap->max_lid_ho)
+		return OSM_SA_SNAP_NO_PORT;
+	return p_snap->lid_tbl[lid_ho];
+}
+/*********/
+
+/****f* OpenSM: SA/osm_sa_snapshot_share_pkey
+* NAME
+*	osm_sa_snapshot_share_pkey
+*
+* DESCRIPTION
+*	Snapshot counterpart of osm_physp_share_pkey: returns TRUE if the
+*	two ports of a snapshot share a PKey with at least one of them
+*	being a full member, or if either has no PKey table.
+*
+* SYNOPSIS
+*/
+boolean_t osm_sa_snapshot_share_pkey(IN const osm_sa_snapshot_t * p_snap,
+				     IN uint32_t port_1, IN uint32_t port_2);
+/*********/
+
 /****f* OpenSM: MC Member Record Receiver/osm_mcmr_rcv_find_or_create_new_mgrp
 * NAME
 *	osm_mcmr_rcv_find_or_create_new_mgrp
@@ -603,7 +1311,7 @@ void osm_pr_process_pair(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad,
 				IN const osm_alias_guid_t * p_dest_alias_guid,
 				IN const ib_gid_t * p_sgid,
 				IN const ib_gid_t * p_dgid,
-				IN cl_qlist_t * p_list);
+				IN osm_sa_resp_t * p_resp);
 
 void osm_pr_process_half(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad,
 				IN const osm_port_t * requester_port,
@@ -611,7 +1319,7 @@ void osm_pr_process_half(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad,
 				IN const osm_alias_guid_t * p_dest_alias_guid,
 				IN const ib_gid_t * p_sgid,
 				IN const ib_gid_t * p_dgid,
-				IN cl_qlist_t * p_list);
+				IN osm_sa_resp_t * p_resp);
 
 END_C_DECLS
 #endif				/* _OSM_SA_H_ */
@@ -58,6 +58,7 @@
 #include <opensm/osm_sm_mad_ctrl.h>
 #include <opensm/osm_lid_mgr.h>
 #include <opensm/osm_ucast_mgr.h>
+#include <opensm/osm_sweep_prof.h>
 #include <opensm/osm_port.h>
 #include <opensm/osm_db.h>
 #include <opensm/osm_remote_sm.h>
@@ -131,6 +132,7 @@ typedef struct osm_sm {
 	osm_sm_mad_ctrl_t mad_ctrl;
 	osm_lid_mgr_t lid_mgr;
 	osm_ucast_mgr_t ucast_mgr;
+	osm_sweep_prof_t sweep_prof;
 	cl_disp_reg_handle_t sweep_fail_disp_h;
 	cl_disp_reg_handle_t ni_disp_h;
 	cl_disp_reg_handle_t pi_disp_h;
@@ -169,6 +171,9 @@ typedef struct osm_sm {
 *	mad_ctrl
 *		MAD Controller.
 *
+*	sweep_prof
+*		Profile of the last sweeps.
+*
 *	p_disp
 *		Pointer to the Dispatcher.
 *
@@ -585,6 +590,43 @@ ib_api_status_t osm_req_set(IN osm_sm_t * sm, IN const osm_dr_path_t * p_path,
 *	The response from the node will be routed through the Dispatcher
 *	to the appropriate receive controller object.
 *********/
+
+/****f* OpenSM: SM/osm_req_route_by_lid
+* NAME
+*	osm_req_route_by_lid
+*
+* DESCRIPTION
+*	Turns a directed route SMP prepared by osm_prepare_req_set into
+*	a LID routed one, when the LIDs and forwarding tables of the
+*	subnet are known to be good.
+*
+* SYNOPSIS
+*/
+boolean_t osm_req_route_by_lid(IN osm_sm_t * sm, IN osm_madw_t * p_madw,
+			       IN const osm_physp_t * p_physp);
+/*
+* PARAMETERS
+*	sm
+*		[in] Pointer to an osm_sm_t object.
+*
+*	p_madw
+*		[in] Pointer to the prepared MAD wrapper.
+*
+*	p_physp
+*		[in] Pointer to the physical port the SMP is sent to.
+*		     SMPs for switch ports are sent to the LID of port 0.
+*
+* RETURN VALUES
+*	TRUE if the SMP is now LID routed, FALSE if it is left unchanged.
+*
+* NOTES
+*	Only done with the lid_routed_smps option, after a sweep which
+*	brought the subnet up without errors, and for ports which were
+*	known before the current sweep.  If the LID routed SMP fails, it
+*	is resent once with its directed route.
+*	The plock must be held before calling this function.
+*********/
+
 /****f* OpenSM: SM/osm_resp_send
 * NAME
 *	osm_resp_send
@@ -88,6 +88,8 @@ typedef struct osm_stats {
 	atomic32_t qp0_mads_sent;
 	atomic32_t qp0_unicasts_sent;
 	atomic32_t qp0_mads_rcvd_unknown;
+	atomic32_t qp0_mads_failed;
+	atomic32_t qp0_mads_resent;
 	atomic32_t sa_mads_outstanding;
 	atomic32_t sa_mads_rcvd;
 	atomic32_t sa_mads_sent;
@@ -126,6 +128,13 @@ typedef struct osm_stats {
 *		Total number of unknown QP0 MADs received. This includes
 *		unrecognized attribute IDs and methods.
 *
+*	qp0_mads_failed
+*		Total number of QP0 MADs completed in error, i.e. which
+*		got no response within the transaction retries.
+*
+*	qp0_mads_resent
+*		Total number of failed QP0 MADs resent by the SM.
+*
 *	sa_mads_outstanding
 *		Contains the number of SA MADs outstanding on QP1.
 *
@@ -259,6 +259,9 @@ typedef struct osm_subn_opt {
 	uint32_t max_wire_smps;
 	uint32_t max_wire_smps2;
 	uint32_t max_smps_timeout;
+	uint32_t max_wire_smps_per_dest;
+	boolean_t adaptive_wire_smps;
+	boolean_t lid_routed_smps;
 	uint32_t transaction_timeout;
 	uint32_t transaction_retries;
 	uint32_t long_transaction_timeout;
@@ -292,6 +295,7 @@ typedef struct osm_subn_opt {
 	char *dump_files_dir;
 	char *log_file;
 	uint32_t log_max_size;
+	uint32_t sweep_profile_history;
 	char *partition_config_file;
 	boolean_t no_partition_enforcement;
 	char *part_enforce;
@@ -321,12 +325,17 @@ typedef struct osm_subn_opt {
 	char *io_guid_file;
 	boolean_t port_shifting;
 	uint32_t scatter_ports;
+	uint8_t lft_num_threads;
+	boolean_t backup_lfts;
 	uint16_t max_reverse_hops;
 	char *ids_guid_file;
 	char *guid_routing_order_file;
 	boolean_t guid_routing_order_no_scatter;
 	char *sa_db_file;
 	boolean_t sa_db_dump;
+	boolean_t sa_pr_cache;
+	boolean_t sa_snapshot;
+	uint32_t sa_cache_size;
 	char *torus_conf_file;
     char *lnmp_conf_file;
 	boolean_t do_mesh_analysis;
@@ -375,6 +384,9 @@ typedef struct osm_subn_opt {
 	boolean_t perfmgr_query_cpi;
 	boolean_t perfmgr_xmit_wait_log;
 	uint32_t perfmgr_xmit_wait_threshold;
+	uint32_t perfmgr_history_samples;
+	char *perfmgr_history_file;
+	boolean_t perfmgr_stream;
 #endif				/* ENABLE_OSM_PERF_MGR */
 	char *event_plugin_name;
 	char *event_plugin_options;
@@ -387,14 +399,21 @@ typedef struct osm_subn_opt {
 	uint8_t sm_sl;			/* which SL to use for SM/SA communication */
 	uint8_t nue_max_num_vls;	/* maximum #VLs to use in nue */
 	boolean_t nue_include_switches;	/* control how nue treats switches */
+	uint8_t nue_num_threads;	/* #threads routing the VLs in nue */
 	char *per_module_logging_file;
 	boolean_t quasi_ftree_indexing;
 	uint64_t lnmp_max_num_paths;
 	uint8_t lnmp_min_path_len;
 	uint8_t lnmp_max_path_len;
+	uint8_t lnmp_num_threads;
         uint8_t dfsssp_max_vls;
     boolean_t layers_remove_deadlocks;
     boolean_t dfsssp_best_effort;
+	boolean_t dfsssp_vltable_per_switch;
+	uint8_t dfsssp_num_threads;
+	uint32_t dfsssp_batch_size;
+	boolean_t dfsssp_incremental_cdg;
+	boolean_t dfsssp_incremental_reroute;
 } osm_subn_opt_t;
 /*
 * FIELDS
@@ -436,6 +455,20 @@ typedef struct osm_subn_opt {
 *		The wait time in usec for timeout based SMPs.  Default is
 *		timeout * retries.
 *
+*	max_wire_smps_per_dest
+*		The maximum number of SMPs sent in parallel to the same
+*		destination LID or directed route.  Default is 0 (no limit).
+*
+*	adaptive_wire_smps
+*		Adapt the number of SMPs sent in parallel to the response
+*		latency, between 1 and max_wire_smps2, starting from
+*		max_wire_smps.  max_smps_timeout is then not used.
+*
+*	lid_routed_smps
+*		Send LFT, MFT, SL2VL and VLArb updates as LID routed SMPs
+*		once the subnet came up without errors, falling back to
+*		directed route SMPs when they fail.
+*
 *	transaction_timeout
 *		The maximum time in milliseconds allowed for a transaction
 *		to complete.  Default is 200.
@@ -528,6 +561,10 @@ typedef struct osm_subn_opt {
 *		specified the log file will be truncated upon reaching
 *		this limit.
 *
+*	sweep_profile_history
+*		Number of sweeps whose per phase profile is kept for the
+*		console and the event plugins.  0 disables the profiler.
+*
 *	qos
 *		Boolean that specifies whether the OpenSM QoS functionality
 *		should be off or on.
@@ -605,6 +642,19 @@ typedef struct osm_subn_opt {
 *		When TRUE causes OpenSM to dump SA DB at the end of every
 *		light sweep regardless the current verbosity level.
 *
+*	sa_pr_cache
+*		When TRUE the SA caches the path parameters per ingress
+*		switch and destination LID for the PathRecord queries.
+*
+*	sa_snapshot
+*		When TRUE the SA answers the queries it supports from
+*		a read-only snapshot of the subnet published at the end of
+*		each sweep, instead of locking the subnet.
+*
+*	sa_cache_size
+*		Maximum number of GetTable responses kept by the SA
+*		response cache.  0 disables the cache.
+*
 *	torus_conf_file
 *		Name of the file with extra configuration info for torus-2QoS
 *		routing engine.
@@ -672,6 +722,19 @@ typedef struct osm_subn_opt {
 *       event_db_dump_file
 *               File to dump the event database to
 *
+*	perfmgr_history_samples
+*		Number of samples of the data counters and XmitWait kept
+*		per port by PerfMgr, 0 to keep no history
+*
+*	perfmgr_history_file
+*		File the PerfMgr history is mapped from, so it is kept
+*		across restarts; NULL to keep it in memory only
+*
+*	perfmgr_stream
+*		Run the PerfMgr sweeps in their own thread, spreading the
+*		queries over perfmgr_sweep_time_s and adapting the number
+*		of outstanding queries to the response latency
+*
 *       event_plugin_name
 *               Specify the name(s) of the event plugin(s)
 *
@@ -758,6 +821,18 @@ typedef struct osm_subn_opt {
 *		When not zero, randomize best possible ports chosen
 *		for a route. The value is used as a random key seed.
 *
+*	lft_num_threads
+*		Number of threads used to build the LFTs of the switches
+*		concurrently (minhop, updn, dnup and the file fallback).
+*		0 uses one thread per processor. scatter_ports forces a
+*		single thread.
+*
+*	backup_lfts
+*		When TRUE, backup LFT blocks are computed after the routing
+*		for the switches at both ends of each link between switches,
+*		and sent when a trap 128 leads to a PortInfo showing the
+*		link down.
+*
 *	per_module_logging_file
 *		File name of per module logging configuration.
 *
@@ -815,6 +890,7 @@ typedef struct osm_subn {
 	boolean_t first_time_master_sweep;
 	boolean_t coming_out_of_standby;
 	boolean_t sweeping_enabled;
+	boolean_t lid_routed_smps_ok;
 	unsigned need_update;
 	cl_fmap_t mgrp_mgid_tbl;
 	osm_db_domain_t *p_g2m;
@@ -955,6 +1031,10 @@ typedef struct osm_subn {
 *		sweeping is inhibited, TRUE - sweeping is done
 *		normally
 *
+*	lid_routed_smps_ok
+*		TRUE once a sweep brought the subnet up without errors, so
+*		the LIDs and forwarding tables may carry LID routed SMPs.
+*
 *	need_update
 *		This flag should be on during first non-master heavy
 *		(including pre-master discovery stage)
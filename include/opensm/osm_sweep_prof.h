@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2020-2024 ETH Zurich. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ * 	Declaration of osm_sweep_prof_t.
+ *	This object records the time and the SMPs spent in each phase
+ *	of the last sweeps.
+ *
+ * Environment:
+ * 	Linux User Mode
+ */
+
+#ifndef _OSM_SWEEP_PROF_H_
+#define _OSM_SWEEP_PROF_H_
+
+#include <time.h>
+#include <iba/ib_types.h>
+#include <complib/cl_spinlock.h>
+#include <opensm/osm_stats.h>
+
+#ifdef __cplusplus
+#  define BEGIN_C_DECLS extern "C" {
+#  define END_C_DECLS   }
+#else				/* !__cplusplus */
+#  define BEGIN_C_DECLS
+#  define END_C_DECLS
+#endif				/* __cplusplus */
+
+BEGIN_C_DECLS
+/****h* OpenSM/Sweep Profiler
+* NAME
+*	Sweep Profiler
+*
+* DESCRIPTION
+*	The Sweep Profiler records, for each phase of a sweep, the wall
+*	clock and CPU time spent and the SMPs sent, received, failed and
+*	resent.  The profiles of the last sweeps are kept in a ring
+*	buffer, shown by the console and reported to the event plugins
+*	(OSM_EVENT_ID_SWEEP_PROFILE).
+*
+*	A phase lasts from its start to the start of the next phase or
+*	the end of the sweep, so the time between the phases is counted
+*	in the previous one.  The CPU time is the one of the whole
+*	process, which includes the threads processing the responses.
+*
+*	The phases are started by the SM thread only.
+*
+* AUTHOR
+*	ETH Zurich
+*
+*********/
+/****d* OpenSM: Sweep Profiler/osm_sweep_phase_t
+* NAME
+*	osm_sweep_phase_t
+*
+* DESCRIPTION
+*	Phases of a sweep.  The routing engine callbacks are phases of
+*	their own within the unicast manager.
+*
+* SYNOPSIS
+*/
+typedef enum osm_sweep_phase {
+	OSM_SWEEP_PHASE_SETUP = 0,
+	OSM_SWEEP_PHASE_LIGHT_SWEEP,
+	OSM_SWEEP_PHASE_DISCOVERY_HOP_0,
+	OSM_SWEEP_PHASE_DISCOVERY,
+	OSM_SWEEP_PHASE_DROP_MGR,
+	OSM_SWEEP_PHASE_PKEY_MGR,
+	OSM_SWEEP_PHASE_SM_LID,
+	OSM_SWEEP_PHASE_SUBNET_LID,
+	OSM_SWEEP_PHASE_UCAST_MGR,
+	OSM_SWEEP_PHASE_BUILD_LID_MATRICES,
+	OSM_SWEEP_PHASE_BUILD_FWD_TABLES,
+	OSM_SWEEP_PHASE_SET_FWD_TABLES,
+	OSM_SWEEP_PHASE_BACKUP_LFTS,
+	OSM_SWEEP_PHASE_QOS,
+	OSM_SWEEP_PHASE_MCAST_MGR,
+	OSM_SWEEP_PHASE_GUID_MGR,
+	OSM_SWEEP_PHASE_LINK_INIT,
+	OSM_SWEEP_PHASE_LINK_ARMED,
+	OSM_SWEEP_PHASE_LINK_ACTIVE,
+	OSM_SWEEP_PHASE_CONGESTION_CONTROL,
+	OSM_SWEEP_PHASE_SUBNET_UP,
+	OSM_SWEEP_PHASE_MAX
+} osm_sweep_phase_t;
+/***********/
+
+/****s* OpenSM: Sweep Profiler/osm_sweep_prof_stats_t
+* NAME
+*	osm_sweep_prof_stats_t
+*
+* DESCRIPTION
+*	Cost of a phase, or of a whole sweep.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sweep_prof_stats {
+	uint32_t count;
+	uint64_t wall_usec;
+	uint64_t cpu_usec;
+	uint32_t mads_sent;
+	uint32_t mads_rcvd;
+	uint32_t mads_failed;
+	uint32_t mads_resent;
+} osm_sweep_prof_stats_t;
+/*
+* FIELDS
+*	count
+*		Number of times the phase was run during the sweep, e.g.
+*		once per routing engine tried for the routing callbacks.
+*
+*	wall_usec
+*		Wall clock time in usec.
+*
+*	cpu_usec
+*		User and system CPU time of the process in usec.
+*
+*	mads_sent
+*		QP0 MADs sent.
+*
+*	mads_rcvd
+*		QP0 MADs received.
+*
+*	mads_failed
+*		QP0 MADs which completed in error (usually timed out after
+*		the transaction retries).
+*
+*	mads_resent
+*		Failed QP0 MADs resent by the SM.
+*
+*********/
+
+/****s* OpenSM: Sweep Profiler/osm_sweep_prof_rec_t
+* NAME
+*	osm_sweep_prof_rec_t
+*
+* DESCRIPTION
+*	Profile of one sweep.  This is the data of the
+*	OSM_EVENT_ID_SWEEP_PROFILE event.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sweep_prof_rec {
+	uint32_t sweep_num;
+	time_t start_time;
+	osm_sweep_prof_stats_t total;
+	osm_sweep_prof_stats_t phase[OSM_SWEEP_PHASE_MAX];
+	uint32_t path_sl_calls;
+	uint64_t path_sl_usec;
+} osm_sweep_prof_rec_t;
+/*
+* FIELDS
+*	sweep_num
+*		Sequence number of the sweep, starting from 1.
+*
+*	start_time
+*		Time the sweep started.
+*
+*	total
+*		Cost of the whole sweep.
+*
+*	phase
+*		Cost of each phase; phases which did not run have a zero
+*		count.
+*
+*	path_sl_calls
+*		Number of calls to the path_sl callback of the routing
+*		engine during the sweep, by the SM and by the SA.
+*
+*	path_sl_usec
+*		Wall clock time spent in these calls in usec.
+*
+*********/
+
+/****s* OpenSM: Sweep Profiler/osm_sweep_prof_t
+* NAME
+*	osm_sweep_prof_t
+*
+* DESCRIPTION
+*	Sweep Profiler structure.
+*
+*	This object should be treated as opaque and should
+*	be manipulated only through the provided functions.
+*
+* SYNOPSIS
+*/
+typedef struct osm_sweep_prof {
+	cl_spinlock_t lock;
+	osm_stats_t *p_stats;
+	osm_sweep_prof_rec_t *ring;
+	uint32_t size;
+	uint32_t num_sweeps;
+	boolean_t active;
+	osm_sweep_phase_t phase;
+	osm_sweep_prof_stats_t sweep_start;
+	osm_sweep_prof_stats_t phase_start;
+	osm_sweep_prof_rec_t cur;
+} osm_sweep_prof_t;
+/*
+* FIELDS
+*	lock
+*		Protects the ring and the path_sl counters of cur.
+*
+*	p_stats
+*		Pointer to the OpenSM statistics block.
+*
+*	ring
+*		Profiles of the last sweeps, indexed by sweep number
+*		modulo size.
+*
+*	size
+*		Number of entries of ring; 0 if the profiler is disabled.
+*
+*	num_sweeps
+*		Number of sweeps profiled so far.
+*
+*	active
+*		TRUE while a sweep is profiled.
+*
+*	phase
+*		The current phase.
+*
+*	sweep_start
+*		Clocks and counters at the start of the sweep.
+*
+*	phase_start
+*		Clocks and counters at the start of the current phase.
+*
+*	cur
+*		Profile of the current sweep.
+*
+* SEE ALSO
+*	Sweep Profiler
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_construct
+* NAME
+*	osm_sweep_prof_construct
+*
+* DESCRIPTION
+*	This function constructs a Sweep Profiler object.
+*
+* SYNOPSIS
+*/
+void osm_sweep_prof_construct(IN osm_sweep_prof_t * p_prof);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a Sweep Profiler object to construct.
+*
+* RETURN VALUE
+*	This function does not return a value.
+*
+* NOTES
+*	A constructed profiler is disabled; all the functions below
+*	may be called on it.
+*
+* SEE ALSO
+*	osm_sweep_prof_init, osm_sweep_prof_destroy
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_init
+* NAME
+*	osm_sweep_prof_init
+*
+* DESCRIPTION
+*	The osm_sweep_prof_init function initializes a Sweep Profiler
+*	object for use.
+*
+* SYNOPSIS
+*/
+ib_api_status_t osm_sweep_prof_init(IN osm_sweep_prof_t * p_prof,
+				    IN osm_stats_t * p_stats,
+				    IN uint32_t size);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a constructed Sweep Profiler object.
+*
+*	p_stats
+*		[in] Pointer to the OpenSM statistics block.
+*
+*	size
+*		[in] Number of sweeps to keep.  0 disables the profiler.
+*
+* RETURN VALUES
+*	IB_SUCCESS if the Sweep Profiler object was initialized
+*	successfully.
+*
+* SEE ALSO
+*	osm_sweep_prof_construct, osm_sweep_prof_destroy
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_destroy
+* NAME
+*	osm_sweep_prof_destroy
+*
+* DESCRIPTION
+*	The osm_sweep_prof_destroy function destroys the object,
+*	releasing all resources.
+*
+* SYNOPSIS
+*/
+void osm_sweep_prof_destroy(IN osm_sweep_prof_t * p_prof);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to the object to destroy.
+*
+* RETURN VALUE
+*	This function does not return a value.
+*
+* SEE ALSO
+*	osm_sweep_prof_construct, osm_sweep_prof_init
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_start
+* NAME
+*	osm_sweep_prof_start
+*
+* DESCRIPTION
+*	Starts profiling a sweep, in the OSM_SWEEP_PHASE_SETUP phase.
+*
+* SYNOPSIS
+*/
+void osm_sweep_prof_start(IN osm_sweep_prof_t * p_prof);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a Sweep Profiler object.
+*
+* RETURN VALUE
+*	This function does not return a value.
+*
+* SEE ALSO
+*	osm_sweep_prof_phase, osm_sweep_prof_done
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_phase
+* NAME
+*	osm_sweep_prof_phase
+*
+* DESCRIPTION
+*	Ends the current phase of the profiled sweep and starts the
+*	given one.  Does nothing if no sweep is profiled.
+*
+* SYNOPSIS
+*/
+void osm_sweep_prof_phase(IN osm_sweep_prof_t * p_prof,
+			  IN osm_sweep_phase_t phase);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a Sweep Profiler object.
+*
+*	phase
+*		[in] The phase to start.
+*
+* RETURN VALUE
+*	This function does not return a value.
+*
+* SEE ALSO
+*	osm_sweep_prof_start, osm_sweep_prof_done
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_done
+* NAME
+*	osm_sweep_prof_done
+*
+* DESCRIPTION
+*	Ends the profiled sweep and stores its profile in the ring.
+*
+* SYNOPSIS
+*/
+const osm_sweep_prof_rec_t *osm_sweep_prof_done(IN osm_sweep_prof_t * p_prof);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a Sweep Profiler object.
+*
+* RETURN VALUE
+*	Pointer to the profile of the sweep, valid until the next sweep
+*	is done, or NULL if no sweep was profiled.
+*
+* SEE ALSO
+*	osm_sweep_prof_start
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_get
+* NAME
+*	osm_sweep_prof_get
+*
+* DESCRIPTION
+*	Copies the profile of one of the last sweeps.
+*
+* SYNOPSIS
+*/
+boolean_t osm_sweep_prof_get(IN osm_sweep_prof_t * p_prof, IN uint32_t age,
+			     OUT osm_sweep_prof_rec_t * p_rec);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a Sweep Profiler object.
+*
+*	age
+*		[in] 0 for the last sweep done, 1 for the one before, etc.
+*
+*	p_rec
+*		[out] The profile.
+*
+* RETURN VALUE
+*	FALSE if the ring does not hold this sweep.
+*
+* NOTES
+*	May be called from any thread.
+*
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_path_sl_start
+* NAME
+*	osm_sweep_prof_path_sl_start
+*
+* DESCRIPTION
+*	To be called before a call to the path_sl callback of the
+*	routing engine.
+*
+* SYNOPSIS
+*/
+uint64_t osm_sweep_prof_path_sl_start(IN osm_sweep_prof_t * p_prof);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a Sweep Profiler object.
+*
+* RETURN VALUE
+*	The value to pass to osm_sweep_prof_path_sl_done, 0 if no sweep
+*	is profiled.
+*
+* NOTES
+*	May be called from any thread.
+*
+* SEE ALSO
+*	osm_sweep_prof_path_sl_done
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_path_sl_done
+* NAME
+*	osm_sweep_prof_path_sl_done
+*
+* DESCRIPTION
+*	To be called after a call to the path_sl callback of the
+*	routing engine; counts the call in the profiled sweep.
+*
+* SYNOPSIS
+*/
+void osm_sweep_prof_path_sl_done(IN osm_sweep_prof_t * p_prof,
+				 IN uint64_t start);
+/*
+* PARAMETERS
+*	p_prof
+*		[in] Pointer to a Sweep Profiler object.
+*
+*	start
+*		[in] Value returned by osm_sweep_prof_path_sl_start.
+*
+* RETURN VALUE
+*	This function does not return a value.
+*
+* NOTES
+*	May be called from any thread.
+*
+* SEE ALSO
+*	osm_sweep_prof_path_sl_start
+*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_phase_str
+* NAME
+*	osm_sweep_phase_str
+*
+* DESCRIPTION
+*	Returns the name of a sweep phase.
+*
+* SYNOPSIS
+*/
+const char *osm_sweep_phase_str(IN osm_sweep_phase_t phase);
+/*********/
+
+/****f* OpenSM: Sweep Profiler/osm_sweep_prof_type_str
+* NAME
+*	osm_sweep_prof_type_str
+*
+* DESCRIPTION
+*	Returns the kind of a profiled sweep ("heavy", "reroute",
+*	"light" or "none"), from the phases it ran.
+*
+* SYNOPSIS
+*/
+const char *osm_sweep_prof_type_str(IN const osm_sweep_prof_rec_t * p_rec);
+/*********/
+
+END_C_DECLS
+#endif				/* _OSM_SWEEP_PROF_H_ */
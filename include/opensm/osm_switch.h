@@ -79,6 +79,140 @@ BEGIN_C_DECLS
 *	Steve King, Intel
 *
 *********/
+/****d* OpenSM: Switch/OSM_SW_LFT_MAX_BLOCKS
+* NAME
+*	OSM_SW_LFT_MAX_BLOCKS
+*
+* DESCRIPTION
+*	Maximum number of unicast LFT blocks of a switch.
+*
+* SYNOPSIS
+*/
+#define OSM_SW_LFT_MAX_BLOCKS ((IB_LID_UCAST_END_HO + 1) / IB_SMP_DATA_SIZE)
+/***********/
+
+/****s* OpenSM: Switch/osm_lid_matrix_t
+* NAME
+*	osm_lid_matrix_t
+*
+* DESCRIPTION
+*	LID matrix of a switch: the hop count to every LID from every port.
+*
+*	Each LID refers to a row of num_ports hop counts, the first entry
+*	of which is the least hop count over all ports.  LIDs with the
+*	same hop counts, such as all LIDs of a switch or all LIDs behind
+*	the same leaf switch, share the same row.  Row 0 is all OSM_NO_PATH
+*	and is used by the LIDs without hop counts.
+*
+* SYNOPSIS
+*/
+typedef struct osm_lid_matrix {
+	uint16_t num_lids;
+	uint16_t *lid_row;
+	uint8_t width;
+	uint32_t num_rows;
+	uint32_t max_rows;
+	uint16_t free_row;
+	uint8_t *rows;
+	uint16_t *row_ref;
+	uint16_t *row_next;
+	uint32_t *row_hash;
+	uint32_t num_buckets;
+	uint16_t *buckets;
+} osm_lid_matrix_t;
+/*
+* FIELDS
+*	num_lids
+*		Size of lid_row.
+*
+*	lid_row
+*		Row of each LID.
+*
+*	width
+*		Number of hop counts in a row (the number of switch ports).
+*
+*	num_rows
+*		Number of rows allocated from rows, including the free ones.
+*
+*	max_rows
+*		Number of rows rows has room for.
+*
+*	free_row
+*		First row of the list of free rows, linked by row_next.
+*
+*	rows
+*		The hop counts, width entries per row.
+*
+*	row_ref
+*		Number of LIDs referring to each row.
+*
+*	row_next
+*		Next row in the same hash bucket, or next free row.
+*
+*	row_hash
+*		Hash of the hop counts of each row.
+*
+*	num_buckets
+*		Number of hash buckets, a power of two.
+*
+*	buckets
+*		First row of each hash bucket.
+*
+* SEE ALSO
+*	Switch object, osm_lid_matrix_destroy
+*********/
+
+/****f* OpenSM: Switch/osm_lid_matrix_destroy
+* NAME
+*	osm_lid_matrix_destroy
+*
+* DESCRIPTION
+*	Frees the memory of a LID matrix and leaves it empty.
+*
+* SYNOPSIS
+*/
+void osm_lid_matrix_destroy(IN osm_lid_matrix_t * p_lm);
+/*
+* PARAMETERS
+*	p_lm
+*		[in] Pointer to the LID matrix.
+*
+* SEE ALSO
+*	osm_lid_matrix_t
+*********/
+
+/****s* OpenSM: Switch/osm_lft_backup_t
+* NAME
+*	osm_lft_backup_t
+*
+* DESCRIPTION
+*	LFT blocks which replace the ones of the last routing on a switch
+*	when the link of one of its ports fails.
+*
+* SYNOPSIS
+*/
+typedef struct osm_lft_backup {
+	unsigned num_blocks;
+	struct osm_lft_backup_block {
+		uint16_t block_num;
+		uint8_t lft[IB_SMP_DATA_SIZE];
+	} blocks[0];
+} osm_lft_backup_t;
+/*
+* FIELDS
+*	num_blocks
+*		Number of blocks.
+*
+*	block_num
+*		Number of the LFT block.
+*
+*	lft
+*		Port of each LID of the block.
+*
+* SEE ALSO
+*	Switch object, osm_switch_clear_lft_backup
+*********/
+
 /****s* OpenSM: Switch/osm_switch_t
 * NAME
 *	osm_switch_t
@@ -97,13 +231,14 @@ typedef struct osm_switch {
 	ib_switch_info_t switch_info;
 	uint16_t max_lid_ho;
 	uint8_t num_ports;
-	uint16_t num_hops;
-	uint8_t **hops;
+	osm_lid_matrix_t lid_matrix;
 	osm_port_profile_t *p_prof;
 	uint8_t *search_ordering_ports;
 	uint8_t *lft;
 	uint8_t *new_lft;
 	uint16_t lft_size;
+	uint8_t lft_dirty[OSM_SW_LFT_MAX_BLOCKS / 8];
+	osm_lft_backup_t **lft_backup;
 	osm_mcast_tbl_t mcast_tbl;
 	int32_t mft_block_num;
 	uint32_t mft_position;
@@ -131,10 +266,7 @@ typedef struct osm_switch {
 *	num_ports
 *		Number of ports for this switch.
 *
-*	num_hops
-*		Size of hops table for this switch.
-*
-*	hops
+*	lid_matrix
 *		LID Matrix for this switch containing the hop count
 *		to every LID from every port.
 *
@@ -148,6 +280,14 @@ typedef struct osm_switch {
 *		This switch's linear forwarding table, as was
 *		calculated by the last routing engine execution.
 *
+*	lft_dirty
+*		Bitmap of the LFT blocks where new_lft differs from lft,
+*		i.e. the blocks which still have to be sent to the switch.
+*
+*	lft_backup
+*		Backup LFT blocks of each port, to send when its link fails,
+*		or NULL if none were computed.
+*
 *	mcast_tbl
 *		Multicast forwarding table for this switch.
 *
@@ -225,6 +365,28 @@ void osm_switch_delete(IN OUT osm_switch_t ** pp_sw);
 *	Switch object, osm_switch_new
 *********/
 
+/****f* OpenSM: Switch/osm_switch_clear_lft_backup
+* NAME
+*	osm_switch_clear_lft_backup
+*
+* DESCRIPTION
+*	Frees the backup LFT blocks of all ports of a switch.
+*
+* SYNOPSIS
+*/
+void osm_switch_clear_lft_backup(IN osm_switch_t * p_sw);
+/*
+* PARAMETERS
+*	p_sw
+*		[in] Pointer to the switch object.
+*
+* RETURN VALUE
+*	None.
+*
+* SEE ALSO
+*	Switch object, osm_lft_backup_t
+*********/
+
 /****f* OpenSM: Switch/osm_switch_new
 * NAME
 *	osm_switch_new
@@ -267,8 +429,11 @@ static inline uint8_t osm_switch_get_hop_count(IN const osm_switch_t * p_sw,
 					       IN uint16_t lid_ho,
 					       IN uint8_t port_num)
 {
-	return (lid_ho > p_sw->max_lid_ho || !p_sw->hops[lid_ho]) ?
-	    OSM_NO_PATH : p_sw->hops[lid_ho][port_num];
+	const osm_lid_matrix_t *p_lm = &p_sw->lid_matrix;
+
+	return (lid_ho > p_sw->max_lid_ho || lid_ho >= p_lm->num_lids) ?
+	    OSM_NO_PATH :
+	    p_lm->rows[p_lm->lid_row[lid_ho] * p_lm->width + port_num];
 }
 /*
 * PARAMETERS
@@ -342,6 +507,30 @@ void osm_switch_clear_hops(IN osm_switch_t * p_sw);
 * SEE ALSO
 *********/
 
+/****f* OpenSM: Switch/osm_switch_clear_lid_hops
+* NAME
+*	osm_switch_clear_lid_hops
+*
+* DESCRIPTION
+*	Sets the hop counts of a LID from all ports to OSM_NO_PATH.
+*
+* SYNOPSIS
+*/
+void osm_switch_clear_lid_hops(IN osm_switch_t * p_sw, IN uint16_t lid_ho);
+/*
+* PARAMETERS
+*	p_sw
+*		[in] Pointer to a Switch object.
+*
+*	lid_ho
+*		[in] LID value (host order) for which to clear the counts.
+*
+* NOTES
+*
+* SEE ALSO
+*	osm_switch_clear_hops
+*********/
+
 /****f* OpenSM: Switch/osm_switch_get_least_hops
 * NAME
 *	osm_switch_get_least_hops
@@ -355,8 +544,10 @@ void osm_switch_clear_hops(IN osm_switch_t * p_sw);
 static inline uint8_t osm_switch_get_least_hops(IN const osm_switch_t * p_sw,
 						IN uint16_t lid_ho)
 {
-	return (lid_ho > p_sw->max_lid_ho || !p_sw->hops[lid_ho]) ?
-	    OSM_NO_PATH : p_sw->hops[lid_ho][0];
+	const osm_lid_matrix_t *p_lm = &p_sw->lid_matrix;
+
+	return (lid_ho > p_sw->max_lid_ho || lid_ho >= p_lm->num_lids) ?
+	    OSM_NO_PATH : p_lm->rows[p_lm->lid_row[lid_ho] * p_lm->width];
 }
 /*
 * PARAMETERS
@@ -740,6 +931,77 @@ osm_switch_set_lft_block(IN osm_switch_t * p_sw, IN const uint8_t * p_block,
 * SEE ALSO
 *********/
 
+/****f* OpenSM: Switch/osm_switch_set_lft_block_dirty
+* NAME
+*	osm_switch_set_lft_block_dirty
+*
+* DESCRIPTION
+*	Marks or unmarks a block of the new LFT as pending distribution.
+*
+* SYNOPSIS
+*/
+static inline void
+osm_switch_set_lft_block_dirty(IN osm_switch_t * p_sw, IN uint16_t block_num,
+			       IN boolean_t dirty)
+{
+	CL_ASSERT(block_num < OSM_SW_LFT_MAX_BLOCKS);
+
+	if (dirty)
+		p_sw->lft_dirty[block_num / 8] |= (uint8_t) (1 << (block_num % 8));
+	else
+		p_sw->lft_dirty[block_num / 8] &=
+		    (uint8_t) ~(1 << (block_num % 8));
+}
+/*
+* PARAMETERS
+*	p_sw
+*		[in] Pointer to the switch object.
+*
+*	block_num
+*		[in] Block number of the LFT block
+*
+*	dirty
+*		[in] TRUE if the block has to be sent to the switch
+*
+* RETURN VALUE
+*	None.
+*
+* SEE ALSO
+*	osm_switch_is_lft_block_dirty
+*********/
+
+/****f* OpenSM: Switch/osm_switch_is_lft_block_dirty
+* NAME
+*	osm_switch_is_lft_block_dirty
+*
+* DESCRIPTION
+*	Returns TRUE if a block of the new LFT is pending distribution.
+*
+* SYNOPSIS
+*/
+static inline boolean_t
+osm_switch_is_lft_block_dirty(IN const osm_switch_t * p_sw,
+			      IN uint16_t block_num)
+{
+	CL_ASSERT(block_num < OSM_SW_LFT_MAX_BLOCKS);
+
+	return (p_sw->lft_dirty[block_num / 8] >> (block_num % 8)) & 1;
+}
+/*
+* PARAMETERS
+*	p_sw
+*		[in] Pointer to the switch object.
+*
+*	block_num
+*		[in] Block number of the LFT block
+*
+* RETURN VALUE
+*	TRUE if the block has to be sent to the switch, FALSE otherwise.
+*
+* SEE ALSO
+*	osm_switch_set_lft_block_dirty
+*********/
+
 /****f* OpenSM: Switch/osm_switch_set_mft_block
 * NAME
 *	osm_switch_set_mft_block
@@ -936,7 +1198,9 @@ static inline uint8_t osm_switch_get_dimn_port(IN const osm_switch_t * p_sw,
 * SYNOPSIS
 */
 uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
-				  IN osm_port_t * p_port, IN uint16_t lid_ho,
+				  IN osm_port_t * p_port,
+				  IN struct osm_remote_guids_count *p_remote_guids,
+				  IN uint16_t lid_ho,
 				  IN unsigned start_from,
 				  IN boolean_t ignore_existing,
 				  IN boolean_t routing_for_lmc,
@@ -953,6 +1217,11 @@ uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
 *		[in] Pointer to the port object for which to get a path
 *		advisory.
 *
+*	p_remote_guids
+*		[in] Remote systems and nodes already used by the switch
+*		for the other LIDs of p_port.  Only used, and then
+*		required, if routing_for_lmc is TRUE.
+*
 *	lid_ho
 *		[in] LID value (host order) for which to get a path advisory.
 *
@@ -974,7 +1243,7 @@ uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
 *
 *		Assume if routing_for_lmc is TRUE that this procedure
 *		was provided with the tracking array and counter via
-*		p_port->priv, and we can conduct this algorithm.
+*		p_remote_guids, and we can conduct this algorithm.
 *
 *	dor
 *		[in] If TRUE, Dimension Order Routing will be done.
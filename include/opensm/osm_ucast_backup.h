@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2020-2024 ETH Zurich. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ * 	Header file that describes the backup LFT functions.
+ *
+ * Environment:
+ * 	Linux User Mode
+ */
+
+#ifndef _OSM_UCAST_BACKUP_H_
+#define _OSM_UCAST_BACKUP_H_
+
+#include <iba/ib_types.h>
+#include <opensm/osm_port.h>
+#include <opensm/osm_switch.h>
+
+#ifdef __cplusplus
+#  define BEGIN_C_DECLS extern "C" {
+#  define END_C_DECLS   }
+#else				/* !__cplusplus */
+#  define BEGIN_C_DECLS
+#  define END_C_DECLS
+#endif				/* __cplusplus */
+
+BEGIN_C_DECLS
+
+struct osm_ucast_mgr;
+
+/****h* OpenSM/Unicast Manager/Backup LFTs
+* NAME
+*	Backup LFTs
+*
+* DESCRIPTION
+*	For each link between two switches, the backup LFTs give the
+*	switches at both of its ends another port for the LIDs they
+*	forward thru the link. They are computed after the routing, and
+*	sent when a trap 128 leads to a PortInfo showing the link down,
+*	so the traffic is moved off the link before the next sweep has
+*	routed the subnet again.
+*
+*	An alternative port is only used if the path it leads to reaches
+*	the LID, with the LFTs of the other switches, without a loop, and
+*	if it adds no cycle to the channel dependencies of all VLs taken
+*	together. The paths keep their SL, so their VLs may change but
+*	the channel dependency graph of each VL stays acyclic.
+*
+*	The LFTs and links are copied with the subnet lock held after the
+*	routing, and the backup LFTs are computed from the copy without
+*	it once the sweep is done, as checking the channel dependencies
+*	of every LID moved takes a while on large subnets.
+*
+*********/
+
+/****f* OpenSM: Backup LFTs/osm_ucast_backup_prepare
+* NAME
+*	osm_ucast_backup_prepare
+*
+* DESCRIPTION
+*	Drops the backup LFTs of all switches and, if backup_lfts is
+*	set, copies the LFTs of the last routing and the links between
+*	the switches for osm_ucast_backup_build.
+*
+* SYNOPSIS
+*/
+int osm_ucast_backup_prepare(IN struct osm_ucast_mgr *p_mgr);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to the ucast mgr object.
+*
+* RETURN VALUE
+*	0 on success, -1 if the copy could not be made.
+*
+* NOTES
+*	Must be called with the subnet lock held for writing.
+*
+* SEE ALSO
+*	osm_ucast_backup_build
+*********/
+
+/****f* OpenSM: Backup LFTs/osm_ucast_backup_build
+* NAME
+*	osm_ucast_backup_build
+*
+* DESCRIPTION
+*	Computes the backup LFTs from the copy made by
+*	osm_ucast_backup_prepare, if any, sets them on the switches and
+*	frees the copy.
+*
+* SYNOPSIS
+*/
+int osm_ucast_backup_build(IN struct osm_ucast_mgr *p_mgr);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to the ucast mgr object.
+*
+* RETURN VALUE
+*	0 on success, -1 if the backup LFTs could not be computed.
+*
+* NOTES
+*	Must be called without the subnet lock, which it takes for
+*	writing to set the backup LFTs.
+*
+* SEE ALSO
+*	osm_ucast_backup_prepare
+*********/
+
+/****f* OpenSM: Backup LFTs/osm_ucast_backup_destroy
+* NAME
+*	osm_ucast_backup_destroy
+*
+* DESCRIPTION
+*	Frees the copy made by osm_ucast_backup_prepare, if any.
+*
+* SYNOPSIS
+*/
+void osm_ucast_backup_destroy(IN struct osm_ucast_mgr *p_mgr);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to the ucast mgr object.
+*
+* RETURN VALUE
+*	This function does not return any value.
+*
+* SEE ALSO
+*	osm_ucast_backup_prepare
+*********/
+
+/****f* OpenSM: Backup LFTs/osm_ucast_backup_clear
+* NAME
+*	osm_ucast_backup_clear
+*
+* DESCRIPTION
+*	Drops the backup LFTs of all switches.
+*
+*	Must be called with the subnet lock held for writing.
+*
+* SYNOPSIS
+*/
+void osm_ucast_backup_clear(IN struct osm_ucast_mgr *p_mgr);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to the ucast mgr object.
+*
+* RETURN VALUE
+*	This function does not return any value.
+*
+* SEE ALSO
+*	osm_ucast_backup_build
+*********/
+
+/****f* OpenSM: Backup LFTs/osm_ucast_backup_push
+* NAME
+*	osm_ucast_backup_push
+*
+* DESCRIPTION
+*	Sends the backup LFT blocks of a switch port whose link went down
+*	and of the port at the other end of the link. The backup LFTs of
+*	all switches are dropped then, as they were only checked against
+*	the LFTs of the last routing.
+*
+* SYNOPSIS
+*/
+unsigned osm_ucast_backup_push(IN struct osm_ucast_mgr *p_mgr,
+			       IN osm_physp_t * p_physp);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to the ucast mgr object.
+*
+*	p_physp
+*		[in] Pointer to the switch port.
+*
+* RETURN VALUE
+*	The number of LFT blocks sent.
+*
+* SEE ALSO
+*	osm_ucast_backup_build
+*********/
+
+END_C_DECLS
+#endif				/* _OSM_UCAST_BACKUP_H_ */
@@ -82,18 +82,55 @@ typedef struct vertex {
 typedef struct vltable {
 	uint64_t num_lids;	/* size of the lids array */
 	uint16_t *lids;		/* sorted array of all lids in the subnet */
-	uint8_t *vls;		/* matrix form assignment lid X lid -> virtual lane */
+	uint8_t *vls;		/* matrix form assignment src X lid -> virtual lane */
+	boolean_t per_switch;	/* rows are source switches instead of src lids */
+	uint32_t num_srcs;	/* number of rows of the vls matrix */
+	uint16_t max_lid;	/* highest (host order) lid in the lids array */
+	int32_t *src_index;	/* host order lid -> row in vls, or -1 */
+	int32_t *dst_index;	/* host order lid -> column in vls, or -1 */
+	uint32_t *src_weight;	/* number of src lids sharing a row */
+	uint16_t *src_lids;	/* lid of the source switch (or port) of a row */
 } vltable_t;
 
+/* the src->dest pairs of a cdg link are stored as zigzag encoded deltas
+   (LEB128 varints) in a chain of fixed size blocks taken from an arena
+*/
+#define CDG_PAIR_BLOCK_SIZE 56
+#define CDG_ARENA_SLAB_BLOCKS 1024
+
+typedef struct cdg_pair_block {
+	struct cdg_pair_block *next;
+	uint8_t data[CDG_PAIR_BLOCK_SIZE];
+} cdg_pair_block_t;
+
+typedef struct cdg_arena_slab {
+	struct cdg_arena_slab *next;
+	cdg_pair_block_t blocks[CDG_ARENA_SLAB_BLOCKS];
+} cdg_arena_slab_t;
+
+typedef struct cdg_arena {
+	cdg_arena_slab_t *slabs;
+	cdg_pair_block_t *free_blocks;
+	uint32_t unused;	/* blocks of the newest slab never handed out */
+} cdg_arena_t;
+
 typedef struct cdg_link {
 	struct cdg_node *node;
 	uint32_t num_pairs;	/* number of src->dest pairs incremented in path adding step */
-	uint32_t max_len;	/* length of the srcdest array */
 	uint32_t removed;	/* number of pairs removed in path deletion step */
-	uint32_t *srcdest_pairs;
+	cdg_pair_block_t *head, *tail;	/* encoded src->dest pairs */
+	uint32_t tail_len;	/* bytes used in the tail block */
+	uint32_t last_pair;	/* base for the delta of the next pair */
 	struct cdg_link *next;
 } cdg_link_t;
 
+/* sequential access to the src->dest pairs of a cdg link */
+typedef struct cdg_pair_iter {
+	cdg_pair_block_t *block;
+	uint32_t pos;
+	uint32_t value;
+} cdg_pair_iter_t;
+
 /* struct for a node of a binary tree with additional parent pointer */
 typedef struct cdg_node {
 	uint64_t channelID;	/* unique key consist of src lid + port + dest lid + port */
@@ -104,6 +141,23 @@ typedef struct cdg_node {
 	struct cdg_node *left, *right, *parent;
 } cdg_node_t;
 
+/* a switch-to-switch link which was added or removed since the last
+   routing (one entry per direction)
+*/
+typedef struct link_change {
+	uint32_t from;		/* index of the switch in the adjazenz list */
+	uint8_t from_port;	/* port of the switch */
+	uint32_t to;		/* index of the neighbor in the adjazenz list */
+	boolean_t added;	/* TRUE if the link is new, FALSE if it failed */
+} link_change_t;
+
+/* what a destination lid was attached to in the last routing */
+typedef struct routed_lid {
+	uint64_t port_guid;	/* 0 if the lid wasn't assigned */
+	uint64_t sw_guid;	/* switch of the port, or the one behind a CA */
+	uint8_t sw_port;	/* port of that switch (0 for switch lids) */
+} routed_lid_t;
+
 typedef struct dfsssp_context {
 	osm_routing_engine_type_t routing_type;
 	osm_ucast_mgr_t *p_mgr;
@@ -113,6 +167,23 @@ typedef struct dfsssp_context {
 	uint8_t *vl_split_count;
         uint8_t max_vls;
     boolean_t only_best_effort;
+	boolean_t vltable_per_switch;
+	uint32_t num_threads;	/* threads for the parallel dijkstra */
+	uint32_t batch_size;	/* destinations routed per weight update */
+	boolean_t incremental_cdg;	/* keep the cdgs acyclic while adding paths */
+	boolean_t incremental_reroute;	/* only reroute lids affected by link changes */
+	boolean_t vls_deadlock_free;	/* every VL of srcdest2vl_table is acyclic */
+	uint8_t vl_split_size;	/* entries of vl_split_count */
+	/* the last routing, kept with incremental_reroute */
+	uint16_t routed_max_lid;
+	uint32_t routed_num_sw;
+	uint8_t **routed_lft;	/* new_lft of each switch (adj_list index - 1) */
+	routed_lid_t *routed_lids;	/* what each lid was attached to */
+	uint32_t *peer_offset;	/* first entry of a switch in peer */
+	uint32_t *peer;		/* switch behind (switch, port) in the last routing */
+	link_change_t *changes;	/* links changed since the last routing */
+	uint32_t num_changes;
+	boolean_t reroute;	/* route only the lids affected by changes */
 } dfsssp_context_t;
 
 /**************** set initial values for structs **********************
@@ -143,6 +214,18 @@ static inline void set_default_vertex(vertex_t * vertex)
 	vertex->dropped = FALSE;
 }
 
+static inline void set_default_cdg_link(cdg_link_t * link)
+{
+	link->node = NULL;
+	link->num_pairs = 0;
+	link->removed = 0;
+	link->head = NULL;
+	link->tail = NULL;
+	link->tail_len = 0;
+	link->last_pair = 0;
+	link->next = NULL;
+}
+
 static inline void set_default_cdg_node(cdg_node_t * node)
 {
 	node->channelID = 0;
@@ -101,6 +101,7 @@ typedef struct osm_ucast_mgr {
 	boolean_t some_hop_count_set;
 	cl_qmap_t cache_sw_tbl;
 	boolean_t cache_valid;
+	struct backup_ctx *p_backup;
 } osm_ucast_mgr_t;
 /*
 * FIELDS
@@ -136,6 +137,11 @@ typedef struct osm_ucast_mgr {
 *	cache_valid
 *		TRUE if the unicast cache is valid.
 *
+*	p_backup
+*		Copy of the LFTs of the last routing, from which the
+*		backup LFTs are computed after the sweep. Only used by
+*		the SM thread.
+*
 * SEE ALSO
 *	Unicast Manager object
 *********/
@@ -251,6 +257,41 @@ void osm_ucast_mgr_set_fwd_tables(IN osm_ucast_mgr_t * p_mgr);
 *	Unicast Manager
 *********/
 
+/****f* OpenSM: Unicast Manager/osm_ucast_mgr_send_lft_block
+* NAME
+*	osm_ucast_mgr_send_lft_block
+*
+* DESCRIPTION
+*	Sends one LFT block to a switch. The block stored as the switch's
+*	LFT is zeroed until the response arrives, so it is sent again by
+*	the next sweep if the MAD fails.
+*
+* SYNOPSIS
+*/
+int osm_ucast_mgr_send_lft_block(IN osm_ucast_mgr_t * p_mgr,
+				 IN osm_switch_t * p_sw, IN uint16_t block_id_ho,
+				 IN const uint8_t * p_block);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to an osm_ucast_mgr_t object.
+*
+*	p_sw
+*		[in] Pointer to the switch.
+*
+*	block_id_ho
+*		[in] Number of the LFT block.
+*
+*	p_block
+*		[in] The IB_SMP_DATA_SIZE ports of the block.
+*
+* RETURN VALUES
+*	0 if the MAD was sent, -1 otherwise.
+*
+* SEE ALSO
+*	Unicast Manager
+*********/
+
 /****f* OpenSM: Unicast Manager/osm_ucast_mgr_build_lid_matrices
 * NAME
 *	osm_ucast_mgr_build_lid_matrices
@@ -274,6 +315,30 @@ int osm_ucast_mgr_build_lid_matrices(IN osm_ucast_mgr_t * p_mgr);
 *	Unicast Manager
 *********/
 
+/****f* OpenSM: Unicast Manager/osm_ucast_mgr_build_lfts
+* NAME
+*	osm_ucast_mgr_build_lfts
+*
+* DESCRIPTION
+*	Build switches's new forwarding tables from the lid matrices.
+*
+* SYNOPSIS
+*/
+int osm_ucast_mgr_build_lfts(IN osm_ucast_mgr_t * p_mgr);
+/*
+* PARAMETERS
+*	p_mgr
+*		[in] Pointer to an osm_ucast_mgr_t object.
+*
+* NOTES
+*	This is the fallback of routing engines without an
+*	ucast_build_fwd_tables callback.  The tables are only computed,
+*	they are not sent to the switches.
+*
+* SEE ALSO
+*	Unicast Manager
+*********/
+
 /****f* OpenSM: Unicast Manager/osm_ucast_mgr_process
 * NAME
 *	osm_ucast_mgr_process
@@ -48,6 +48,7 @@
 #include <complib/cl_event.h>
 #include <complib/cl_thread.h>
 #include <complib/cl_qlist.h>
+#include <complib/cl_qmap.h>
 #include <opensm/osm_stats.h>
 #include <opensm/osm_log.h>
 #include <opensm/osm_madw.h>
@@ -78,6 +79,11 @@ BEGIN_C_DECLS
 *	OpenSM modules may post VL15 MADs to the VL15 interface as fast
 *	as possible.
 *
+*	Request MADs are queued per destination (LID or directed route)
+*	and the destinations are served round robin, each with a limited
+*	number of MADs on the wire.  The number of request MADs on the
+*	wire may also follow the measured response latency.
+*
 *	The VL15 object is thread safe.
 *
 *	This object should be treated as opaque and should
@@ -102,6 +108,53 @@ typedef enum _osm_vl15_state {
 } osm_vl15_state_t;
 /***********/
 
+/****s* OpenSM: VL15/osm_vl15_dest_t
+* NAME
+*	osm_vl15_dest_t
+*
+* DESCRIPTION
+*	Request MADs queued by the VL15 interface for one destination.
+*
+* SYNOPSIS
+*/
+typedef struct osm_vl15_dest {
+	cl_map_item_t map_item;
+	cl_list_item_t list_item;
+	cl_qlist_t fifo;
+	uint32_t on_wire;
+	boolean_t ready;
+	uint64_t srtt;
+	uint64_t base_rtt;
+} osm_vl15_dest_t;
+/*
+* FIELDS
+*	map_item
+*		Linkage structure for cl_qmap.  MUST BE FIRST MEMBER!
+*		The key identifies the destination.
+*
+*	list_item
+*		Linkage in the list of destinations ready to send.
+*
+*	fifo
+*		First-in First-out queue of the request MADs to send.
+*
+*	on_wire
+*		Number of request MADs sent and not yet completed.
+*
+*	ready
+*		TRUE if the destination is in the list of destinations
+*		ready to send.
+*
+*	srtt
+*		Smoothed response latency of the destination in usec.
+*
+*	base_rtt
+*		Lowest smoothed response latency of the destination in usec.
+*
+* SEE ALSO
+*	VL15 object
+*********/
+
 /****s* OpenSM: VL15/osm_vl15_t
 * NAME
 *	osm_vl15_t
@@ -120,9 +173,16 @@ typedef struct osm_vl15 {
 	uint32_t max_wire_smps;
 	uint32_t max_wire_smps2;
 	uint32_t max_smps_timeout;
+	uint32_t max_wire_smps_per_dest;
+	boolean_t adaptive_window;
+	uint32_t window;
+	uint32_t window_acked;
+	uint32_t window_epoch;
+	uint64_t srtt;
 	cl_event_t signal;
 	cl_thread_t poller;
-	cl_qlist_t rfifo;
+	cl_qmap_t dests;
+	cl_qlist_t ready;
 	cl_qlist_t ufifo;
 	cl_spinlock_t lock;
 	osm_vendor_t *p_vend;
@@ -147,15 +207,40 @@ typedef struct osm_vl15 {
 *	max_smps_timeout
 *		Wait time in usec for timeout based SMPs.
 *
+*	max_wire_smps_per_dest
+*		Maximum number of VL15 MADs allowed on the wire at one time
+*		to a single destination.  0 means no limit.
+*
+*	adaptive_window
+*		TRUE if the number of VL15 MADs allowed on the wire follows
+*		the response latency instead of max_wire_smps.
+*
+*	window
+*		Number of VL15 MADs currently allowed on the wire when
+*		adaptive_window is set.
+*
+*	window_acked
+*		Number of timely responses since the window was last grown.
+*
+*	window_epoch
+*		Number of completed requests since the window was last shrunk.
+*
+*	srtt
+*		Smoothed response latency over all destinations in usec.
+*
 *	signal
 *		Event on which the poller sleeps.
 *
 *	poller
 *		Worker thread pool that services the fifo to transmit VL15 MADs
 *
-*	rfifo
-*		First-in First-out queue for outbound VL15 MADs for which
-*		a response is expected, aka the "response fifo"
+*	dests
+*		Map of the destinations with outbound VL15 MADs for which
+*		a response is expected, or with such MADs on the wire.
+*
+*	ready
+*		Destinations with queued MADs that may send, served round
+*		robin.
 *
 *	ufifo
 *		First-in First-out queue for outbound VL15 MADs for which
@@ -254,7 +339,9 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl15, IN osm_vendor_t * p_vend,
 			      IN osm_subn_t * p_subn,
 			      IN int32_t max_wire_smps,
 			      IN int32_t max_wire_smps2,
-			      IN uint32_t max_smps_timeout);
+			      IN uint32_t max_smps_timeout,
+			      IN uint32_t max_wire_smps_per_dest,
+			      IN boolean_t adaptive_window);
 /*
 * PARAMETERS
 *	p_vl15
@@ -282,6 +369,13 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl15, IN osm_vendor_t * p_vend,
 *	max_smps_timeout
 *		[in] Wait time in usec for timeout based SMPs.
 *
+*	max_wire_smps_per_dest
+*		[in] Maximum number of SMPs allowed on the wire at one time
+*		     to a single destination.  0 means no limit.
+*
+*	adaptive_window
+*		[in] Adapt the number of SMPs allowed on the wire to the
+*		     response latency, between 1 and max_wire_smps2.
 *
 * RETURN VALUES
 *	IB_SUCCESS if the VL15 object was initialized successfully.
@@ -351,6 +445,45 @@ void osm_vl15_poll(IN osm_vl15_t * p_vl);
 *	VL15 object, osm_vl15_construct, osm_vl15_init
 *********/
 
+/****f* OpenSM: VL15/osm_vl15_complete
+* NAME
+*	osm_vl15_complete
+*
+* DESCRIPTION
+*	Accounts for the completion of a request MAD sent by the VL15
+*	interface.
+*
+* SYNOPSIS
+*/
+void osm_vl15_complete(IN osm_vl15_t * p_vl, IN const osm_madw_t * p_madw,
+		       IN ib_api_status_t status);
+/*
+* PARAMETERS
+*	p_vl15
+*		[in] Pointer to an osm_vl15_t object.
+*
+*	p_madw
+*		[in] Pointer to the request MAD wrapper that was answered or
+*		     that failed.
+*
+*	status
+*		[in] IB_SUCCESS if a response was received for the request,
+*		     IB_TIMEOUT if the request timed out, or the error with
+*		     which the send failed.
+*
+* RETURN VALUES
+*	None.
+*
+* NOTES
+*	Releases the slot of the request MAD on the wire for its
+*	destination and, with adaptive_window, updates the window.
+*	Must be called before the request MAD wrapper is returned
+*	to the pool.  osm_vl15_poll should be called afterwards.
+*
+* SEE ALSO
+*	VL15 object, osm_vl15_post, osm_vl15_poll
+*********/
+
 /****f* OpenSM: VL15/osm_vl15_shutdown
 * NAME
 *	osm_vl15_shutdown
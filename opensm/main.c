@@ -202,6 +202,11 @@ static void show_usage(void)
 	       "          Defaults to 1 to enforce deadlock-freedom even if QoS is not\n"
 	       "          enabled. Set to 0 if Nue should automatically determine and\n"
 	       "          choose maximum supported by the fabric, or any integer >= 1.\n\n");
+	printf("--nue_num_threads <number threads>\n"
+	       "          Sets the number of threads used by Nue routing to route the\n"
+	       "          virtual layers concurrently. With more than one thread the\n"
+	       "          paths are only balanced within each virtual layer.\n"
+	       "          Defaults to 1; 0 uses one thread per processor.\n\n");
 	printf("--lnmp_max_num_paths <number paths>\n"
 	       "          Sets the maximum number of paths to be used by LNMP routing for each routing layer.\n"
 	       "          Defaults to 0, which results in a maximum number of 100000 paths per layer.\n\n");
@@ -212,6 +217,26 @@ static void show_usage(void)
            "          If set, deadlocks will be removed using dfsssp if possible.\n\n");
     printf("--dfsssp_best_effort\n"
            "          If set, dfsssp will attemt to remove deadlocks, but if unsuccessful leave all extra paths in the last VL.\n\n");
+	printf("--dfsssp_vltable_per_switch\n"
+	       "          Store the VL assigned by dfsssp deadlock removal per source switch and\n"
+	       "          destination LID instead of per LID pair, which reduces the memory\n"
+	       "          used by the VL table. Defaults to FALSE.\n\n");
+	printf("--dfsssp_num_threads <number threads>\n"
+	       "          Sets the number of threads used by (DF)SSSP routing to compute\n"
+	       "          the paths towards several destinations concurrently.\n"
+	       "          Defaults to 1. Set to 0 to use one thread per processor.\n\n");
+	printf("--dfsssp_batch_size <number destinations>\n"
+	       "          Sets the number of destinations (DF)SSSP routes before updating\n"
+	       "          the link weights. Larger batches balance the paths less evenly.\n"
+	       "          Defaults to 0, which uses the number of threads.\n\n");
+	printf("--dfsssp_incremental_cdg\n"
+	       "          If set, dfsssp deadlock removal assigns each path the first VL whose\n"
+	       "          channel dependency graph stays acyclic, instead of searching and\n"
+	       "          breaking cycles after all paths are added.\n\n");
+	printf("--dfsssp_incremental_reroute\n"
+	       "          If set, (DF)SSSP keeps the routing of the last sweep and, when only\n"
+	       "          links between switches changed, routes again just the LIDs whose\n"
+	       "          paths used a failed link or get shorter thru a new link.\n\n");
 	printf("--lnmp_min_path_len <min length>\n"
 	       "          Sets the minimum length each path that is a added to a layer needs to have.\n"
 	       "          This constraint is not applied to the first layer, which is always routed minimally.\n"
@@ -219,6 +244,10 @@ static void show_usage(void)
 	printf("--lnmp_max_path_len <max length>\n"
 	       "          Sets the maximum length each path that is a added to a layer is allowed to have.\n"
 	       "          Defaults to 3, one hop longer than the diameter of SF MMS topologies.\n\n");
+	printf("--lnmp_num_threads <number threads>\n"
+	       "          Sets the number of threads used by LNMP routing to search the paths of each layer.\n"
+	       "          The routing result is identical for any number of threads.\n"
+	       "          Defaults to 1. Set to 0 to use one thread per processor.\n\n");
 	printf("--connect_roots, -z\n"
 	       "          This option enforces routing engines (up/down and \n"
 	       "          fat-tree) to make connectivity between root switches\n"
@@ -245,6 +274,19 @@ static void show_usage(void)
 	printf("--sadb_file, -S <file name>\n"
 	       "          This option specifies the name of the SA DB dump file\n"
 	       "          from where SA database will be loaded.\n\n");
+	printf("--sa_pr_cache\n"
+	       "          Cache the path parameters per ingress switch and destination\n"
+	       "          LID for the SA PathRecord queries. The cached parameters are\n"
+	       "          dropped when the forwarding tables or port attributes change.\n\n");
+	printf("--sa_snapshot\n"
+	       "          Answer SA NodeRecord queries from a read-only snapshot of\n"
+	       "          the subnet published after each sweep, so the queries are\n"
+	       "          not blocked by the sweeps.\n\n");
+	printf("--sa_cache_size <number of responses>\n"
+	       "          Cache up to this number of SA NodeRecord, PortInfoRecord\n"
+	       "          and LinkRecord GetTable responses, so identical queries\n"
+	       "          are answered from the cache until the next sweep.\n"
+	       "          0 (the default) disables the cache.\n\n");
 	printf("--root_guid_file, -a <path to file>\n"
 	       "          Set the root nodes for the Up/Down or Fat-Tree routing\n"
 	       "          algorithm to the guids provided in the given file (one\n"
@@ -262,6 +304,15 @@ static void show_usage(void)
 	       "          Randomize best port chosen for a route\n"
 	       "          Assign ports in a random order instead of round-robin\n"
 	       "          If zero disable (default), otherwise use the value as a random seed\n\n");
+	printf("--lft_num_threads <number threads>\n"
+	       "          Sets the number of threads used to build the LFTs of the\n"
+	       "          switches concurrently (minhop, updn, dnup and the file fallback).\n"
+	       "          Defaults to 1. Set to 0 to use one thread per processor.\n"
+	       "          --scatter-ports forces a single thread.\n\n");
+	printf("--backup_lfts\n"
+	       "          Compute backup LFT blocks for the switches at both ends of\n"
+	       "          each link between switches after the routing, and send them\n"
+	       "          when a trap 128 leads to a PortInfo showing the link down.\n\n");
 	printf("--max_reverse_hops, -H <hop_count>\n"
 	       "          Set the max number of hops the wrong way around\n"
 	       "          an I/O node is allowed to do (connectivity for I/O nodes on top switches)\n\n");
@@ -307,6 +358,10 @@ static void show_usage(void)
 	       "          SMPs.\n"
 	       "          Without --maxsmps, OpenSM defaults to a maximum of\n"
 	       "          4 outstanding SMPs.\n\n");
+	printf("--lid_routed_smps\n"
+	       "          Once the subnet is up, send LFT, MFT, SL2VL and VLArb\n"
+	       "          updates as LID routed SMPs instead of directed route\n"
+	       "          ones.  SMPs which fail are resent with directed route.\n\n");
 	printf("--console, -q [off|local"
 #ifdef ENABLE_OSM_CONSOLE_LOOPBACK
 	       "|loopback"
@@ -733,9 +788,22 @@ int main(int argc, char *argv[])
 		{"lnmp_max_num_paths", 1, NULL, 19},
 		{"lnmp_min_path_len", 1, NULL, 20},
 		{"lnmp_max_path_len", 1, NULL, 21},
+		{"lnmp_num_threads", 1, NULL, 22},
 		{"dfsssp_max_vls", 1, NULL, 27},
         {"layers_remove_deadlocks", 0, NULL, 25},
         {"dfsssp_best_effort", 0, NULL, 26},
+		{"dfsssp_vltable_per_switch", 0, NULL, 23},
+		{"dfsssp_num_threads", 1, NULL, 24},
+		{"dfsssp_batch_size", 1, NULL, 28},
+		{"dfsssp_incremental_cdg", 0, NULL, 29},
+		{"dfsssp_incremental_reroute", 0, NULL, 36},
+		{"sa_pr_cache", 0, NULL, 30},
+		{"sa_snapshot", 0, NULL, 31},
+		{"sa_cache_size", 1, NULL, 32},
+		{"lid_routed_smps", 0, NULL, 33},
+		{"lft_num_threads", 1, NULL, 34},
+		{"backup_lfts", 0, NULL, 37},
+		{"nue_num_threads", 1, NULL, 35},
 		{"dump_files_dir", 1, NULL, 17},
 		{NULL, 0, NULL, 0}	/* Required at the end of the array */
 	};
@@ -1107,6 +1175,14 @@ int main(int argc, char *argv[])
 			opt.scatter_ports = strtol(optarg, NULL, 0);
 			printf(" Scatter Ports is on\n");
 			break;
+		case 34:
+			opt.lft_num_threads = (uint8_t) strtoul(optarg, NULL, 0);
+			printf(" LFT #threads = %d\n", opt.lft_num_threads);
+			break;
+		case 37:
+			opt.backup_lfts = TRUE;
+			printf(" Backup LFTs enabled\n");
+			break;
 		case 'H':
 			opt.max_reverse_hops = atoi(optarg);
 			printf(" Max Reverse Hops: %d\n", opt.max_reverse_hops);
@@ -1206,6 +1282,10 @@ int main(int argc, char *argv[])
 			opt.nue_max_num_vls = (uint8_t) temp;
 			printf(" Nue maximum #VLs = %d\n", opt.nue_max_num_vls);
 			break;
+		case 35:
+			opt.nue_num_threads = (uint8_t) strtoul(optarg, NULL, 0);
+			printf(" Nue #threads = %d\n", opt.nue_num_threads);
+			break;
 		case 19:
 			opt.lnmp_max_num_paths = (uint32_t) strtoul(optarg, NULL, 0);
 			printf(" LNMP maximum #paths per layer = %d\n", opt.lnmp_max_num_paths);
@@ -1218,6 +1298,10 @@ int main(int argc, char *argv[])
 			opt.lnmp_max_path_len = (uint8_t) strtoul(optarg, NULL, 0);
 			printf(" LNMP maximum path length = %d\n", opt.lnmp_max_path_len);
 			break;
+		case 22:
+			opt.lnmp_num_threads = (uint8_t) strtoul(optarg, NULL, 0);
+			printf(" LNMP #threads = %d\n", opt.lnmp_num_threads);
+			break;
 		case 27:
 			opt.dfsssp_max_vls = (uint8_t) strtoul(optarg, NULL, 0);
 			printf(" DFSSSP max num vls = %d\n", opt.dfsssp_max_vls);
@@ -1228,6 +1312,42 @@ int main(int argc, char *argv[])
         case 26:
             opt.dfsssp_best_effort = FALSE;
             break;
+		case 23:
+			opt.dfsssp_vltable_per_switch = TRUE;
+			printf(" DFSSSP VL table per switch\n");
+			break;
+		case 24:
+			opt.dfsssp_num_threads = (uint8_t) strtoul(optarg, NULL, 0);
+			printf(" DFSSSP #threads = %d\n", opt.dfsssp_num_threads);
+			break;
+		case 28:
+			opt.dfsssp_batch_size = strtoul(optarg, NULL, 0);
+			printf(" DFSSSP batch size = %u\n", opt.dfsssp_batch_size);
+			break;
+		case 29:
+			opt.dfsssp_incremental_cdg = TRUE;
+			printf(" DFSSSP incremental CDG\n");
+			break;
+		case 36:
+			opt.dfsssp_incremental_reroute = TRUE;
+			printf(" DFSSSP incremental rerouting\n");
+			break;
+		case 30:
+			opt.sa_pr_cache = TRUE;
+			printf(" SA PathRecord cache enabled\n");
+			break;
+		case 31:
+			opt.sa_snapshot = TRUE;
+			printf(" SA snapshot enabled\n");
+			break;
+		case 32:
+			opt.sa_cache_size = strtoul(optarg, NULL, 0);
+			printf(" SA cache size = %u\n", opt.sa_cache_size);
+			break;
+		case 33:
+			opt.lid_routed_smps = TRUE;
+			printf(" LID routed SMPs enabled\n");
+			break;
 		case 17:
 			SET_STR_OPT(opt.dump_files_dir, optarg);
 			break;
@@ -175,6 +175,17 @@ static void help_status(FILE * out, int detail)
 	}
 }
 
+static void help_sweepprof(FILE * out, int detail)
+{
+	fprintf(out, "sweepprof [<count>]\n");
+	if (detail) {
+		fprintf(out, "   print the time and the SMPs spent in each phase "
+			"of the last <count> sweeps\n");
+		fprintf(out, "   (all kept, see sweep_profile_history, "
+			"by default)\n");
+	}
+}
+
 static void help_logflush(FILE * out, int detail)
 {
 	fprintf(out, "logflush [on|off] -- toggle opensm.log file flushing\n");
@@ -242,7 +253,7 @@ static void help_perfmgr(FILE * out, int detail)
 		"             |clear_counters|dump_counters|print_counters(pc)|print_errors(pe)\n"
 		"             |set_rm_nodes|clear_rm_nodes|clear_inactive\n"
 		"             |set_query_cpi|clear_query_cpi\n"
-		"             |dump_redir|clear_redir\n"
+		"             |dump_redir|clear_redir|top\n"
 		"             |sweep|sweep_time[seconds]]\n");
 	if (detail) {
 		fprintf(out,
@@ -267,6 +278,10 @@ static void help_perfmgr(FILE * out, int detail)
 			"                                           Optionally limit output by name or guid\n");
 		fprintf(out,
 			"   [pe [<nodename|nodeguid>]] -- same as print_errors\n");
+		fprintf(out,
+			"   [top [<count>] [xmit_wait|xmit_data|rcv_data|xmit_pkts|rcv_pkts]]\n"
+			"        -- print the ports with the highest rate of the counter (default 10, xmit_wait)\n"
+			"           over the PerfMgr history (perfmgr_history_samples)\n");
 		fprintf(out,
 			"   [dump_redir [<nodename|nodeguid>]] -- dump the redirection table\n");
 		fprintf(out,
@@ -441,6 +456,27 @@ static void dump_sms(osm_opensm_t * p_osm, FILE * out)
 	CL_PLOCK_RELEASE(p_osm->sm.p_lock);
 }
 
+static void print_disp_stats(cl_dispatcher_t * p_disp, const char *name,
+			     FILE * out)
+{
+	cl_disp_stats_t stats;
+	uint32_t i;
+
+	fprintf(out, "\n   %s dispatcher\n"
+		"   ------------------\n"
+		"   Worker  Queued  Max queued     Processed        Stolen"
+		"  Queue time avg/max/last (usec)\n", name);
+	for (i = 0; i < cl_disp_get_num_workers(p_disp); i++) {
+		cl_disp_get_stats(p_disp, i, &stats);
+		fprintf(out, "   %6u  %6u  %10u  %12" PRIu64 "  %12" PRIu64
+			"  %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n", i,
+			stats.num_queued, stats.max_queued,
+			stats.num_processed, stats.num_stolen,
+			stats.avg_queue_time_us, stats.max_queue_time_us,
+			stats.last_msg_queue_time_us);
+	}
+}
+
 static void print_status(osm_opensm_t * p_osm, FILE * out)
 {
 	cl_list_item_t *item;
@@ -503,6 +539,27 @@ static void print_status(osm_opensm_t * p_osm, FILE * out)
 			(uint32_t)p_osm->stats.sa_mads_sent,
 			(uint32_t)p_osm->stats.sa_mads_rcvd_unknown,
 			(uint32_t)p_osm->stats.sa_mads_ignored);
+		if (p_osm->subn.opt.adaptive_wire_smps)
+			fprintf(out, "   QP0 MADs window                : %u\n"
+				"   QP0 response latency (usec)    : %" PRIu64 "\n",
+				p_osm->vl15.window, p_osm->vl15.srtt);
+		if (p_osm->subn.opt.sa_cache_size) {
+			unsigned num_entries;
+			uint64_t hits, misses;
+
+			osm_sa_cache_get_stats(&p_osm->sa, &num_entries,
+					       &hits, &misses);
+			fprintf(out, "\n   SA response cache\n"
+				"   -----------------\n"
+				"   Entries                        : %u/%u\n"
+				"   Hits                           : %" PRIu64 "\n"
+				"   Misses                         : %" PRIu64 "\n",
+				num_entries, p_osm->subn.opt.sa_cache_size,
+				hits, misses);
+		}
+		print_disp_stats(&p_osm->disp, "Main", out);
+		if (p_osm->sa_set_disp_initialized)
+			print_disp_stats(&p_osm->sa_set_disp, "SA Set", out);
 		fprintf(out, "\n   Subnet flags\n"
 			"   ------------\n"
 			"   Sweeping enabled               : %d\n"
@@ -1591,6 +1648,27 @@ static void perfmgr_parse(char **p_last, osm_opensm_t * p_osm, FILE * out)
 			p_cmd = name_token(p_last);
 			osm_perfmgr_print_counters(&p_osm->perfmgr, p_cmd,
 						   out, NULL, 1);
+		} else if (strcmp(p_cmd, "top") == 0) {
+			unsigned count = 10;
+			perfmgr_db_hist_col_t cntr = PERFMGR_HIST_XMIT_WAIT;
+			while ((p_cmd = next_token(p_last))) {
+				if (isdigit(p_cmd[0])) {
+					count = strtoul(p_cmd, NULL, 0);
+					continue;
+				}
+				for (cntr = 0; cntr < PERFMGR_HIST_NUM_CNTRS;
+				     cntr++)
+					if (!strcmp(p_cmd,
+						    perfmgr_db_hist_cntr_str(cntr)))
+						break;
+				if (cntr == PERFMGR_HIST_NUM_CNTRS) {
+					fprintf(out, "\"%s\" counter not found\n",
+						p_cmd);
+					return;
+				}
+			}
+			osm_perfmgr_print_top(&p_osm->perfmgr, out, count,
+					      cntr);
 		} else if (strcmp(p_cmd, "dump_redir") == 0) {
 			p_cmd = name_token(p_last);
 			dump_redir(p_osm, p_cmd, out);
@@ -1629,7 +1707,8 @@ static void perfmgr_parse(char **p_last, osm_opensm_t * p_osm, FILE * out)
 			"sweep time                   : %us\n"
 			"outstanding queries/max      : %d/%u\n"
 			"remove missing nodes from DB : %s\n"
-			"query ClassPortInfo          : %s\n",
+			"query ClassPortInfo          : %s\n"
+			"history samples per port     : %u\n",
 			osm_perfmgr_get_state_str(&p_osm->perfmgr),
 			osm_perfmgr_get_sweep_state_str(&p_osm->perfmgr),
 			osm_perfmgr_get_sweep_time_s(&p_osm->perfmgr),
@@ -1638,7 +1717,17 @@ static void perfmgr_parse(char **p_last, osm_opensm_t * p_osm, FILE * out)
 			osm_perfmgr_get_rm_nodes(&p_osm->perfmgr)
 						 ? "TRUE" : "FALSE",
 			osm_perfmgr_get_query_cpi(&p_osm->perfmgr)
-						 ? "TRUE" : "FALSE");
+						 ? "TRUE" : "FALSE",
+			p_osm->perfmgr.db && p_osm->perfmgr.db->hist.hdr ?
+			p_osm->perfmgr.db->hist.hdr->num_samples : 0);
+		if (p_osm->perfmgr.stream)
+			fprintf(out, "stream window                : %u\n"
+				"response latency/lowest      : %" PRIu64
+				"/%" PRIu64 " us\n"
+				"samples/s (last sweep)       : %.0f\n",
+				p_osm->perfmgr.window, p_osm->perfmgr.srtt,
+				p_osm->perfmgr.base_rtt,
+				p_osm->perfmgr.samples_per_s);
 	}
 }
 #endif				/* ENABLE_OSM_PERF_MGR */
@@ -1658,6 +1747,58 @@ static void version_parse(char **p_last, osm_opensm_t * p_osm, FILE * out)
 	fprintf(out, "%s build %s %s\n", p_osm->osm_version, __DATE__, __TIME__);
 }
 
+static void print_sweep_prof_stats(FILE * out, const char *name,
+				   const osm_sweep_prof_stats_t * p_stats)
+{
+	fprintf(out, "   %-24s %5u %11.3f %11.3f %8u %8u %8u %8u\n",
+		name, p_stats->count, p_stats->wall_usec / 1000.0,
+		p_stats->cpu_usec / 1000.0, p_stats->mads_sent,
+		p_stats->mads_rcvd, p_stats->mads_failed,
+		p_stats->mads_resent);
+}
+
+static void sweepprof_parse(char **p_last, osm_opensm_t * p_osm, FILE * out)
+{
+	osm_sweep_prof_rec_t rec;
+	struct tm tm;
+	uint32_t count = UINT32_MAX, age;
+	char *p_cmd;
+	char buf[32];
+	int i;
+
+	if (!p_osm->sm.sweep_prof.size) {
+		fprintf(out, "Sweep profiler disabled (sweep_profile_history "
+			"is 0)\n");
+		return;
+	}
+
+	p_cmd = next_token(p_last);
+	if (p_cmd)
+		count = strtoul(p_cmd, NULL, 0);
+
+	for (age = 0; age < count &&
+	     osm_sweep_prof_get(&p_osm->sm.sweep_prof, age, &rec); age++) {
+		strftime(buf, sizeof(buf), "%F %T",
+			 localtime_r(&rec.start_time, &tm));
+		fprintf(out, "Sweep %u (%s), started %s\n", rec.sweep_num,
+			osm_sweep_prof_type_str(&rec), buf);
+		fprintf(out, "   %-24s %5s %11s %11s %8s %8s %8s %8s\n",
+			"Phase", "Runs", "Wall (ms)", "CPU (ms)", "Sent",
+			"Rcvd", "Failed", "Resent");
+		for (i = 0; i < OSM_SWEEP_PHASE_MAX; i++)
+			if (rec.phase[i].count)
+				print_sweep_prof_stats(out,
+						       osm_sweep_phase_str(i),
+						       &rec.phase[i]);
+		print_sweep_prof_stats(out, "total", &rec.total);
+		fprintf(out, "   path_sl: %u calls, %.3f ms\n\n",
+			rec.path_sl_calls, rec.path_sl_usec / 1000.0);
+	}
+
+	if (!age)
+		fprintf(out, "No sweep profiled yet\n");
+}
+
 /* more parse routines go here */
 typedef struct _regexp_list {
 	regex_t exp;
@@ -1775,6 +1916,7 @@ static const struct command console_cmds[] = {
 	{"reroute", &help_reroute, &reroute_parse},
 	{"sweep", &help_sweep, &sweep_parse},
 	{"status", &help_status, &status_parse},
+	{"sweepprof", &help_sweepprof, &sweepprof_parse},
 	{"logflush", &help_logflush, &logflush_parse},
 	{"querylid", &help_querylid, &querylid_parse},
 	{"portstatus", &help_portstatus, &portstatus_parse},
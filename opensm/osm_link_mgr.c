@@ -64,6 +64,7 @@ static uint8_t link_mgr_get_smsl(IN osm_sm_t * sm, IN osm_physp_t * p_physp)
 	struct osm_routing_engine *re = p_osm->routing_engine_used;
 	ib_net16_t slid;
 	ib_net16_t smlid;
+	uint64_t prof_start;
 	uint8_t sl;
 
 	OSM_LOG_ENTER(sm->p_log);
@@ -81,8 +82,10 @@ static uint8_t link_mgr_get_smsl(IN osm_sm_t * sm, IN osm_physp_t * p_physp)
 	smlid = sm->p_subn->sm_base_lid;
 
 	/* Call into routing engine to find proper SL */
+	prof_start = osm_sweep_prof_path_sl_start(&sm->sweep_prof);
 	sl = re->path_sl(re->context, sm->p_subn->opt.sm_sl,
 			 slid, smlid);
+	osm_sweep_prof_path_sl_done(&sm->sweep_prof, prof_start);
 
 	OSM_LOG_EXIT(sm->p_log);
 	return sl;
@@ -456,6 +459,7 @@ Send:
 	context.pi_context.port_guid = osm_physp_get_port_guid(p_physp);
 	context.pi_context.set_method = TRUE;
 	context.pi_context.light_sweep = FALSE;
+	context.pi_context.backup_lft = FALSE;
 	context.pi_context.client_rereg = FALSE;
 
 	/* We need to send the PortInfoSet request with the new sm_lid
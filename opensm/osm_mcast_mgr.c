@@ -335,7 +335,7 @@ static int mcast_mgr_set_mft_block(osm_sm_t * sm, IN osm_switch_t * p_sw,
 	osm_physp_t *p_physp;
 	osm_dr_path_t *p_path;
 	osm_madw_context_t context;
-	ib_api_status_t status;
+	osm_madw_t *p_madw;
 	uint32_t block_id_ho;
 	osm_mcast_tbl_t *p_tbl;
 	ib_net16_t block[IB_MCAST_BLOCK_SIZE];
@@ -374,17 +374,21 @@ static int mcast_mgr_set_mft_block(osm_sm_t * sm, IN osm_switch_t * p_sw,
 			"\n", block_num, position,
 			cl_ntoh64(context.mft_context.node_guid));
 
-		status = osm_req_set(sm, p_path, (void *)block, sizeof(block),
-				     IB_MAD_ATTR_MCAST_FWD_TBL,
-				     cl_hton32(block_id_ho), FALSE,
-				     ib_port_info_get_m_key(&p_physp->port_info),
-				     0, CL_DISP_MSGID_NONE, &context);
-		if (status != IB_SUCCESS) {
+		p_madw = osm_prepare_req_set(sm, p_path, (void *)block,
+					     sizeof(block),
+					     IB_MAD_ATTR_MCAST_FWD_TBL,
+					     cl_hton32(block_id_ho), FALSE,
+					     ib_port_info_get_m_key(&p_physp->port_info),
+					     0, CL_DISP_MSGID_NONE, &context);
+		if (p_madw == NULL) {
 			OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 0A02: "
 				"Sending multicast fwd. tbl. block 0x%X to %s "
-				"failed (%s)\n", block_id_ho,
-				p_node->print_desc, ib_get_err_str(status));
+				"failed (%s)\n", block_id_ho, p_node->print_desc,
+				ib_get_err_str(IB_INSUFFICIENT_RESOURCES));
 			ret = -1;
+		} else {
+			osm_req_route_by_lid(sm, p_madw, p_physp);
+			osm_send_req_mad(sm, p_madw);
 		}
 	}
 
@@ -66,6 +66,12 @@ static void nd_rcv_process_nd(IN osm_sm_t * sm, IN osm_node_t * p_node,
 
 	OSM_LOG_ENTER(sm->p_log);
 
+	/* may come from a trap outside of a sweep */
+	if (memcmp(&p_node->node_desc.description, p_nd, sizeof(*p_nd))) {
+		osm_sa_cache_invalidate(&sm->p_subn->p_osm->sa);
+		osm_sa_snapshot_invalidate(&sm->p_subn->p_osm->sa);
+	}
+
 	memcpy(&p_node->node_desc.description, p_nd, sizeof(*p_nd));
 
 	/* also set up a printable version */
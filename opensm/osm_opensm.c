@@ -827,7 +827,9 @@ ib_api_status_t osm_opensm_init_finish(IN osm_opensm_t * p_osm,
 	status = osm_vl15_init(&p_osm->vl15, p_osm->p_vendor,
 			       &p_osm->log, &p_osm->stats, &p_osm->subn,
 			       p_opt->max_wire_smps, p_opt->max_wire_smps2,
-			       p_opt->max_smps_timeout);
+			       p_opt->max_smps_timeout,
+			       p_opt->max_wire_smps_per_dest,
+			       p_opt->adaptive_wire_smps);
 	if (status != IB_SUCCESS)
 		goto Exit;
 
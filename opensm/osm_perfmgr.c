@@ -72,6 +72,14 @@
 
 #define PERFMGR_INITIAL_TID_VALUE 0xcafe
 
+/*
+   In stream mode the window is shrunk when the smoothed response
+   latency grows to this many times the lowest one seen, and the token
+   bucket holds at most this many ports besides the node being queried.
+ */
+#define PERFMGR_SLOW_FACTOR	2
+#define PERFMGR_STREAM_BURST	64
+
 #ifdef ENABLE_OSM_PERF_MGR_PROFILE
 struct {
 	double fastest_us;
@@ -186,6 +194,48 @@ static inline void decrement_outstanding_queries(osm_perfmgr_t * pm)
 	cl_event_signal(&pm->sig_query);
 }
 
+/**********************************************************************
+ * Stream mode AIMD window: grows by one query per window of timely
+ * responses, and is halved at most once per window when a query times
+ * out or the responses slow down.
+ **********************************************************************/
+static void perfmgr_update_window(osm_perfmgr_t * pm, uint64_t latency,
+				  boolean_t timed_out)
+{
+	boolean_t slow = timed_out;
+
+	cl_spinlock_acquire(&pm->lock);
+
+	if (!timed_out) {
+		if (!latency)
+			latency = 1;
+		if (pm->srtt)
+			pm->srtt += ((int64_t) latency - (int64_t) pm->srtt) / 8;
+		else
+			pm->srtt = latency;
+		if (!pm->base_rtt || pm->srtt < pm->base_rtt)
+			pm->base_rtt = pm->srtt;
+		slow = pm->srtt > PERFMGR_SLOW_FACTOR * pm->base_rtt;
+	}
+
+	pm->window_epoch++;
+
+	if (slow) {
+		if (pm->window_epoch >= pm->window) {
+			pm->window_epoch = 0;
+			pm->window_acked = 0;
+			if (pm->window > 1)
+				pm->window /= 2;
+		}
+	} else if (++pm->window_acked >= pm->window) {
+		pm->window_acked = 0;
+		if (pm->window < pm->max_outstanding_queries)
+			pm->window++;
+	}
+
+	cl_spinlock_release(&pm->lock);
+}
+
 /**********************************************************************
  * Receive the MAD from the vendor layer and post it for processing by
  * the dispatcher
@@ -200,6 +250,10 @@ static void perfmgr_mad_recv_callback(osm_madw_t * p_madw, void *bind_context,
 	CL_ASSERT(p_madw);
 	CL_ASSERT(p_req_madw != NULL);
 
+	if (pm->stream)
+		perfmgr_update_window(pm, cl_get_time_stamp() -
+				      p_req_madw->send_time, FALSE);
+
 	osm_madw_copy_context(p_madw, p_req_madw);
 	osm_mad_pool_put(pm->mad_pool, p_req_madw);
 
@@ -271,6 +325,9 @@ static void perfmgr_mad_send_err_callback(void *bind_context,
 	}
 
 Exit:
+	if (pm->stream && p_madw->status == IB_TIMEOUT)
+		perfmgr_update_window(pm, 0, TRUE);
+
 	osm_mad_pool_put(pm->mad_pool, p_madw);
 
 	decrement_outstanding_queries(pm);
@@ -451,13 +508,18 @@ static ib_api_status_t perfmgr_send_mad(osm_perfmgr_t *perfmgr,
 					osm_madw_t * const p_madw)
 {
 	cl_status_t sts;
-	ib_api_status_t status = osm_vendor_send(perfmgr->bind_handle, p_madw,
-						 TRUE);
+	ib_api_status_t status;
+
+	p_madw->send_time = cl_get_time_stamp();
+	status = osm_vendor_send(perfmgr->bind_handle, p_madw, TRUE);
 	if (status == IB_SUCCESS) {
 		/* pause thread if there are too many outstanding requests */
 		cl_atomic_inc(&(perfmgr->outstanding_queries));
 		while (perfmgr->outstanding_queries >
-		       (int32_t)perfmgr->max_outstanding_queries) {
+		       (int32_t)(perfmgr->stream ? perfmgr->window :
+				 perfmgr->max_outstanding_queries)) {
+			if (perfmgr->stream_state == OSM_THREAD_STATE_EXIT)
+				break;
 			cl_spinlock_acquire(&perfmgr->lock);
 			if (perfmgr->sweep_state == PERFMGR_SWEEP_SLEEP) {
 				perfmgr->sweep_state = PERFMGR_SWEEP_POST_PROCESSING;
@@ -689,6 +751,38 @@ static ib_api_status_t perfmgr_send_pce_mad(osm_perfmgr_t * perfmgr,
 	return status;
 }
 
+/**********************************************************************
+ * Stream mode token bucket: wait until n ports may be queried.
+ * Returns FALSE if the PerfMgr is stopped meanwhile.
+ **********************************************************************/
+static boolean_t perfmgr_stream_take(osm_perfmgr_t * pm, uint32_t n)
+{
+	uint64_t now, wait_us;
+	double burst = n > PERFMGR_STREAM_BURST ? n : PERFMGR_STREAM_BURST;
+
+	for (;;) {
+		if (pm->state != PERFMGR_STATE_ENABLED ||
+		    pm->stream_state != OSM_THREAD_STATE_RUN || osm_exit_flag)
+			return FALSE;
+
+		now = cl_get_time_stamp();
+		pm->tokens += (now - pm->token_time) * pm->token_rate;
+		if (pm->tokens > burst)
+			pm->tokens = burst;
+		pm->token_time = now;
+
+		if (pm->tokens >= n || pm->token_rate <= 0) {
+			pm->tokens -= n;
+			return TRUE;
+		}
+
+		wait_us = (uint64_t) ((n - pm->tokens) / pm->token_rate) + 1;
+		/* sleep in short steps to notice a shutdown */
+		cl_thread_suspend(wait_us > 100000 ? 100 :
+				  (uint32_t) ((wait_us + 999) / 1000));
+	}
+}
+
 /**********************************************************************
  * query the Port Counters of all the nodes in the subnet
  **********************************************************************/
@@ -705,6 +799,13 @@ static void perfmgr_query_counters(cl_map_item_t * p_map_item, void *context)
 
 	OSM_LOG_ENTER(pm->log);
 
+	/* take the tokens for the whole node before the lock, so its
+	   queries go out back to back without holding up the SM */
+	if (pm->stream && !perfmgr_stream_take(pm, mon_node->num_ports)) {
+		OSM_LOG_EXIT(pm->log);
+		return;
+	}
+
 	cl_plock_acquire(&pm->osm->lock);
 	node = osm_get_node_by_guid(pm->subn, cl_hton64(mon_node->guid));
 	if (!node) {
@@ -1042,17 +1143,21 @@ _exit:
 	return ret;
 }
 
+static void count_ports(cl_map_item_t * p_map_item, void *context)
+{
+	*(uint32_t *) context += ((monitored_node_t *) p_map_item)->num_ports;
+}
+
 /**********************************************************************
- * Main PerfMgr processor - query the performance counters
+ * Query the performance counters of all the monitored nodes
  **********************************************************************/
-void osm_perfmgr_process(osm_perfmgr_t * pm)
+static void perfmgr_run_sweep(osm_perfmgr_t * pm)
 {
 #ifdef ENABLE_OSM_PERF_MGR_PROFILE
 	struct timeval before, after;
 #endif
-
-	if (pm->state != PERFMGR_STATE_ENABLED)
-		return;
+	uint64_t start = 0, elapsed;
+	uint32_t num_ports = 0, samples = 0;
 
 	cl_spinlock_acquire(&pm->lock);
 	if (pm->sweep_state == PERFMGR_SWEEP_ACTIVE ||
@@ -1068,8 +1173,9 @@ void osm_perfmgr_process(osm_perfmgr_t * pm)
 	pm->sweep_state = PERFMGR_SWEEP_ACTIVE;
 	cl_spinlock_release(&pm->lock);
 
-	if (pm->subn->sm_state == IB_SMINFO_STATE_STANDBY ||
-	    pm->subn->sm_state == IB_SMINFO_STATE_NOTACTIVE)
+	if (!pm->stream &&
+	    (pm->subn->sm_state == IB_SMINFO_STATE_STANDBY ||
+	     pm->subn->sm_state == IB_SMINFO_STATE_NOTACTIVE))
 		perfmgr_discovery(pm->subn->p_osm);
 
 	/* if redirection enabled, determine local port */
@@ -1104,12 +1210,34 @@ void osm_perfmgr_process(osm_perfmgr_t * pm)
 	cl_qmap_apply_func(&pm->subn->node_guid_tbl, collect_guids, pm);
 	cl_plock_release(&pm->osm->lock);
 
+	if (pm->stream) {
+		/* spread the queries over most of the sweep time, leaving
+		   some slack for the last responses */
+		cl_qmap_apply_func(&pm->monitored_map, count_ports, &num_ports);
+		pm->token_rate = pm->sweep_time_s ?
+		    num_ports / (pm->sweep_time_s * 900000.0) : 0;
+		pm->token_time = cl_get_time_stamp();
+		pm->tokens = 0;
+		start = pm->token_time;
+		samples = pm->samples;
+	}
+
 	/* then for each node query their counters */
 	cl_qmap_apply_func(&pm->monitored_map, perfmgr_query_counters, pm);
 
 	/* clean out any nodes found to be removed during the sweep */
 	remove_marked_nodes(pm);
 
+	if (pm->stream) {
+		elapsed = cl_get_time_stamp() - start;
+		samples = pm->samples - samples;
+		pm->samples_per_s = elapsed ? samples * 1e6 / elapsed : 0;
+		OSM_LOG(pm->log, OSM_LOG_INFO,
+			"PerfMgr sweep of %u ports took %.1f s: "
+			"%.0f samples/s, window %u\n", num_ports,
+			elapsed / 1e6, pm->samples_per_s, pm->window);
+	}
+
 #ifdef ENABLE_OSM_PERF_MGR_PROFILE
 	gettimeofday(&after, NULL);
 	diff_time(&before, &after, &after);
@@ -1128,6 +1256,45 @@ void osm_perfmgr_process(osm_perfmgr_t * pm)
 	cl_spinlock_release(&pm->lock);
 }
 
+/**********************************************************************
+ * Stream mode: the sweeps are paced over the sweep time, so they run
+ * in their own thread instead of holding up the SM thread
+ **********************************************************************/
+static void perfmgr_stream_thread(void *context)
+{
+	osm_perfmgr_t *pm = context;
+
+	while (pm->stream_state == OSM_THREAD_STATE_RUN && !osm_exit_flag) {
+		cl_event_wait_on(&pm->stream_event, EVENT_NO_TIMEOUT, TRUE);
+		if (pm->stream_state != OSM_THREAD_STATE_RUN || osm_exit_flag)
+			break;
+		if (pm->state == PERFMGR_STATE_ENABLED)
+			perfmgr_run_sweep(pm);
+	}
+}
+
+/**********************************************************************
+ * Main PerfMgr processor - query the performance counters
+ **********************************************************************/
+void osm_perfmgr_process(osm_perfmgr_t * pm)
+{
+	if (pm->state != PERFMGR_STATE_ENABLED)
+		return;
+
+	if (!pm->stream) {
+		perfmgr_run_sweep(pm);
+		return;
+	}
+
+	/* the discovery of a standby SM runs in the SM thread */
+	if (pm->sweep_state == PERFMGR_SWEEP_SLEEP &&
+	    (pm->subn->sm_state == IB_SMINFO_STATE_STANDBY ||
+	     pm->subn->sm_state == IB_SMINFO_STATE_NOTACTIVE))
+		perfmgr_discovery(pm->subn->p_osm);
+
+	cl_event_signal(&pm->stream_event);
+}
+
 /**********************************************************************
  * PerfMgr timer - loop continuously and signal SM to run PerfMgr
  * processor if enabled
@@ -1144,6 +1311,12 @@ void osm_perfmgr_shutdown(osm_perfmgr_t * pm)
 {
 	OSM_LOG_ENTER(pm->log);
 	cl_timer_stop(&pm->sweep_timer);
+	if (pm->stream_state == OSM_THREAD_STATE_RUN) {
+		pm->stream_state = OSM_THREAD_STATE_EXIT;
+		cl_event_signal(&pm->stream_event);
+		cl_event_signal(&pm->sig_query);
+		cl_thread_destroy(&pm->stream_thread);
+	}
 	cl_disp_unregister(pm->pc_disp_h);
 	perfmgr_mad_unbind(pm);
 	OSM_LOG_EXIT(pm->log);
@@ -1154,6 +1327,8 @@ void osm_perfmgr_destroy(osm_perfmgr_t * pm)
 	OSM_LOG_ENTER(pm->log);
 	perfmgr_db_destroy(pm->db);
 	cl_timer_destroy(&pm->sweep_timer);
+	if (pm->stream)
+		cl_event_destroy(&pm->stream_event);
 	OSM_LOG_EXIT(pm->log);
 }
 
@@ -1869,6 +2044,8 @@ static void pc_recv_process(void *context, void *data)
 			perfmgr_db_fill_data_cnt_read_pc(wire_read, &data_reading);
 
 		if (mad_context->perfmgr_context.mad_method == IB_MAD_METHOD_GET) {
+			cl_atomic_inc(&pm->samples);
+
 			/* detect an out of band clear on the port */
 			perfmgr_check_oob_clear(pm, p_mon_node, port, &err_reading);
 			if (!pce_sup)
@@ -1968,6 +2145,30 @@ ib_api_status_t osm_perfmgr_init(osm_perfmgr_t * pm, osm_opensm_t * osm,
 	pm->query_cpi = p_opt->perfmgr_query_cpi;
 	pm->xmit_wait_log = p_opt->perfmgr_xmit_wait_log;
 	pm->xmit_wait_threshold = p_opt->perfmgr_xmit_wait_threshold;
+
+	pm->stream = p_opt->perfmgr_stream;
+	pm->window = pm->max_outstanding_queries;
+	if (pm->stream) {
+		cl_event_construct(&pm->stream_event);
+		if (cl_event_init(&pm->stream_event, FALSE) != CL_SUCCESS) {
+			pm->stream = FALSE;
+			OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 5424: "
+				"Failed to init the stream event, "
+				"sweeping from the SM thread\n");
+		} else {
+			pm->stream_state = OSM_THREAD_STATE_RUN;
+			if (cl_thread_init(&pm->stream_thread,
+					   perfmgr_stream_thread, pm,
+					   "perfmgr stream") != CL_SUCCESS) {
+				pm->stream_state = OSM_THREAD_STATE_NONE;
+				cl_event_destroy(&pm->stream_event);
+				pm->stream = FALSE;
+				OSM_LOG(pm->log, OSM_LOG_ERROR, "ERR 5425: "
+					"Failed to start the stream thread, "
+					"sweeping from the SM thread\n");
+			}
+		}
+	}
 	status = IB_SUCCESS;
 Exit:
 	OSM_LOG_EXIT(pm->log);
@@ -2025,6 +2226,15 @@ void osm_perfmgr_print_counters(osm_perfmgr_t * pm, char *nodename, FILE * fp,
 		perfmgr_db_print_all(pm->db, fp, err_only);
 }
 
+/*******************************************************************
+ * Print the ports with the highest rates to the fp specified
+ *******************************************************************/
+void osm_perfmgr_print_top(osm_perfmgr_t * pm, FILE * fp, unsigned count,
+			   perfmgr_db_hist_col_t cntr)
+{
+	perfmgr_db_print_top(pm->db, fp, count, cntr);
+}
+
 void osm_perfmgr_update_nodename(osm_perfmgr_t *pm, uint64_t node_guid,
 				char *nodename)
 {
@@ -43,6 +43,9 @@
 #include <errno.h>
 #include <limits.h>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <opensm/osm_file_ids.h>
@@ -53,6 +56,353 @@
 
 static void free_node(db_node_t * node);
 
+#define PERFMGR_HIST_MAGIC "OSMPMH1"
+#define PERFMGR_HIST_MIN_SLOTS 256
+
+static const char *hist_cntr_str[] = {
+	"xmit_data",		/* PERFMGR_HIST_XMIT_DATA */
+	"rcv_data",		/* PERFMGR_HIST_RCV_DATA */
+	"xmit_pkts",		/* PERFMGR_HIST_XMIT_PKTS */
+	"rcv_pkts",		/* PERFMGR_HIST_RCV_PKTS */
+	"xmit_wait"		/* PERFMGR_HIST_XMIT_WAIT */
+};
+
+const char *perfmgr_db_hist_cntr_str(perfmgr_db_hist_col_t cntr)
+{
+	if (cntr >= PERFMGR_HIST_NUM_CNTRS)
+		return "UNKNOWN";
+	return hist_cntr_str[cntr];
+}
+
+/**********************************************************************
+ * Port counter history
+ **********************************************************************/
+static size_t hist_size(uint32_t num_samples, uint32_t max_slots)
+{
+	return sizeof(perfmgr_db_hist_hdr_t) +
+	    (size_t) max_slots * sizeof(perfmgr_db_hist_slot_t) +
+	    (size_t) PERFMGR_HIST_NUM_COLS * max_slots * num_samples *
+	    sizeof(uint64_t);
+}
+
+static void hist_set_ptrs(perfmgr_db_hist_t * hist)
+{
+	uint64_t *col;
+	int c;
+
+	hist->slots = (perfmgr_db_hist_slot_t *) (hist->hdr + 1);
+	col = (uint64_t *) (hist->slots + hist->hdr->max_slots);
+	for (c = 0; c < PERFMGR_HIST_NUM_COLS; c++) {
+		hist->cols[c] = col;
+		col += (size_t) hist->hdr->max_slots * hist->hdr->num_samples;
+	}
+}
+
+/* resizes the block of the history, which is lost on failure */
+static void *hist_map(perfmgr_db_hist_t * hist, size_t size)
+{
+	void *p;
+
+	if (hist->fd < 0)
+		return realloc(hist->hdr, size);
+
+	if (hist->hdr) {
+		munmap(hist->hdr, hist->size);
+		hist->hdr = NULL;
+	}
+	if (ftruncate(hist->fd, size))
+		return NULL;
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, hist->fd, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+static void hist_close(perfmgr_db_hist_t * hist)
+{
+	if (hist->hdr) {
+		if (hist->fd < 0)
+			free(hist->hdr);
+		else
+			munmap(hist->hdr, hist->size);
+		hist->hdr = NULL;
+	}
+	if (hist->fd >= 0) {
+		close(hist->fd);
+		hist->fd = -1;
+	}
+	free(hist->claimed);
+	hist->claimed = NULL;
+}
+
+/* maps the history left by the last run, if it has the same layout */
+static boolean_t hist_load(perfmgr_db_hist_t * hist, uint32_t num_samples)
+{
+	perfmgr_db_hist_hdr_t *hdr;
+	perfmgr_db_hist_slot_t *slot;
+	struct stat st;
+	uint32_t i;
+
+	if (fstat(hist->fd, &st) || st.st_size < (off_t) sizeof(*hdr))
+		return FALSE;
+	hdr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   hist->fd, 0);
+	if (hdr == MAP_FAILED)
+		return FALSE;
+	if (memcmp(hdr->magic, PERFMGR_HIST_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->num_samples != num_samples ||
+	    hdr->num_slots > hdr->max_slots ||
+	    (size_t) st.st_size != hist_size(num_samples, hdr->max_slots) ||
+	    !(hist->claimed = calloc(hdr->max_slots, 1))) {
+		munmap(hdr, st.st_size);
+		return FALSE;
+	}
+
+	hist->hdr = hdr;
+	hist->size = st.st_size;
+	hist_set_ptrs(hist);
+	for (i = 0; i < hdr->num_slots; i++) {
+		slot = &hist->slots[i];
+		if (!slot->node_guid)
+			continue;
+		/* the slots of a damaged file could lead past the mapping */
+		if (slot->port > i || slot->port >= slot->num_ports ||
+		    i - slot->port + slot->num_ports > hdr->max_slots ||
+		    slot->head >= num_samples || slot->count > num_samples) {
+			munmap(hdr, st.st_size);
+			hist->hdr = NULL;
+			free(hist->claimed);
+			hist->claimed = NULL;
+			hist->num_unclaimed = 0;
+			return FALSE;
+		}
+		hist->num_unclaimed++;
+	}
+	return TRUE;
+}
+
+static void hist_init(perfmgr_db_t * db, uint32_t num_samples,
+		      const char *file)
+{
+	perfmgr_db_hist_t *hist = &db->hist;
+	osm_log_t *log = db->perfmgr->log;
+	size_t size;
+
+	memset(hist, 0, sizeof(*hist));
+	hist->fd = -1;
+	if (!num_samples)
+		return;
+
+	if (file) {
+		hist->fd = open(file, O_RDWR | O_CREAT, 0644);
+		if (hist->fd < 0)
+			OSM_LOG(log, OSM_LOG_ERROR, "ERR 5421: "
+				"Failed to open PerfMgr history file %s: %s; "
+				"keeping the history in memory only\n",
+				file, strerror(errno));
+		else if (hist_load(hist, num_samples)) {
+			OSM_LOG(log, OSM_LOG_INFO,
+				"Loaded the history of %u ports from %s\n",
+				hist->num_unclaimed, file);
+			return;
+		} else if (ftruncate(hist->fd, 0)) {
+			close(hist->fd);
+			hist->fd = -1;
+		}
+	}
+
+	size = hist_size(num_samples, PERFMGR_HIST_MIN_SLOTS);
+	hist->hdr = hist_map(hist, size);
+	hist->claimed = calloc(PERFMGR_HIST_MIN_SLOTS, 1);
+	if (!hist->hdr || !hist->claimed) {
+		OSM_LOG(log, OSM_LOG_ERROR, "ERR 5422: "
+			"Failed to allocate the PerfMgr history\n");
+		hist_close(hist);
+		return;
+	}
+	hist->size = size;
+	memset(hist->hdr, 0, sizeof(*hist->hdr) +
+	       PERFMGR_HIST_MIN_SLOTS * sizeof(perfmgr_db_hist_slot_t));
+	memcpy(hist->hdr->magic, PERFMGR_HIST_MAGIC, sizeof(hist->hdr->magic));
+	hist->hdr->num_samples = num_samples;
+	hist->hdr->max_slots = PERFMGR_HIST_MIN_SLOTS;
+	hist_set_ptrs(hist);
+}
+
+/* doubles the slots until there are min_slots, moving the columns up */
+static int hist_grow(perfmgr_db_hist_t * hist, uint32_t min_slots)
+{
+	uint32_t old_max = hist->hdr->max_slots, new_max = old_max;
+	size_t col_len = (size_t) old_max * hist->hdr->num_samples *
+	    sizeof(uint64_t);
+	size_t new_col_len, size;
+	uint8_t *old_cols, *new_cols, *claimed;
+	perfmgr_db_hist_hdr_t *hdr;
+	int c;
+
+	while (new_max < min_slots)
+		new_max *= 2;
+	new_col_len = col_len / old_max * new_max;
+	size = hist_size(hist->hdr->num_samples, new_max);
+
+	claimed = realloc(hist->claimed, new_max);
+	if (!claimed)
+		return -1;
+	memset(claimed + old_max, 0, new_max - old_max);
+	hist->claimed = claimed;
+
+	hdr = hist_map(hist, size);
+	if (!hdr)
+		return -1;
+	hist->hdr = hdr;
+	hist->size = size;
+
+	old_cols = (uint8_t *) (hdr + 1) +
+	    (size_t) old_max * sizeof(perfmgr_db_hist_slot_t);
+	new_cols = (uint8_t *) (hdr + 1) +
+	    (size_t) new_max * sizeof(perfmgr_db_hist_slot_t);
+	for (c = PERFMGR_HIST_NUM_COLS - 1; c >= 0; c--)
+		memmove(new_cols + c * new_col_len, old_cols + c * col_len,
+			col_len);
+	memset(old_cols, 0, (new_max - old_max) *
+	       sizeof(perfmgr_db_hist_slot_t));
+	hdr->max_slots = new_max;
+	hist_set_ptrs(hist);
+	return 0;
+}
+
+static void hist_free(perfmgr_db_hist_t * hist, uint32_t first)
+{
+	uint32_t i, num = hist->slots[first].num_ports;
+
+	for (i = first; i < first + num; i++) {
+		if (!hist->claimed[i] && hist->slots[i].node_guid)
+			hist->num_unclaimed--;
+		memset(&hist->slots[i], 0, sizeof(hist->slots[i]));
+		hist->claimed[i] = 0;
+	}
+	while (hist->hdr->num_slots &&
+	       !hist->slots[hist->hdr->num_slots - 1].node_guid)
+		hist->hdr->num_slots--;
+}
+
+/*
+ * Returns the slots of the node, the ones it had in the last run if
+ * the history was loaded from the file, or num_ports free slots in a
+ * row.
+ */
+static uint32_t hist_claim(perfmgr_db_t * db, uint64_t guid,
+			   uint8_t num_ports)
+{
+	perfmgr_db_hist_t *hist = &db->hist;
+	perfmgr_db_hist_slot_t *slot;
+	uint32_t i, first, run = 0;
+
+	if (!hist->hdr || !num_ports)
+		return PERFMGR_HIST_NO_SLOT;
+
+	for (i = 0; hist->num_unclaimed && i < hist->hdr->num_slots; i++) {
+		slot = &hist->slots[i];
+		if (slot->node_guid != guid || slot->port || hist->claimed[i])
+			continue;
+		if (slot->num_ports != num_ports) {
+			hist_free(hist, i);
+			break;
+		}
+		memset(&hist->claimed[i], 1, num_ports);
+		hist->num_unclaimed -= num_ports;
+		return i;
+	}
+
+	for (i = 0; i < hist->hdr->num_slots; i++) {
+		if (hist->slots[i].node_guid)
+			run = 0;
+		else if (++run == num_ports)
+			break;
+	}
+	if (run == num_ports)
+		first = i + 1 - num_ports;
+	else {
+		/* extend the free slots at the end */
+		first = hist->hdr->num_slots - run;
+		if (first + num_ports > hist->hdr->max_slots &&
+		    hist_grow(hist, first + num_ports)) {
+			OSM_LOG(db->perfmgr->log, OSM_LOG_ERROR, "ERR 5423: "
+				"Failed to grow the PerfMgr history; "
+				"dropping it\n");
+			hist_close(hist);
+			return PERFMGR_HIST_NO_SLOT;
+		}
+		hist->hdr->num_slots = first + num_ports;
+	}
+
+	for (i = 0; i < num_ports; i++) {
+		slot = &hist->slots[first + i];
+		memset(slot, 0, sizeof(*slot));
+		slot->node_guid = guid;
+		slot->port = i;
+		slot->num_ports = num_ports;
+		hist->claimed[first + i] = 1;
+	}
+	return first;
+}
+
+static void hist_add(perfmgr_db_hist_t * hist, db_node_t * node,
+		     uint8_t port, uint64_t time, uint64_t interval,
+		     const uint64_t cntrs[PERFMGR_HIST_NUM_CNTRS])
+{
+	perfmgr_db_hist_slot_t *slot;
+	size_t k;
+	int c;
+
+	if (!hist->hdr || node->hist_slot == PERFMGR_HIST_NO_SLOT)
+		return;
+
+	slot = &hist->slots[node->hist_slot + port];
+	k = (size_t) (node->hist_slot + port) * hist->hdr->num_samples +
+	    slot->head;
+	for (c = 0; c < PERFMGR_HIST_NUM_CNTRS; c++)
+		hist->cols[c][k] = cntrs[c];
+	hist->cols[PERFMGR_HIST_TIME][k] = time;
+	hist->cols[PERFMGR_HIST_INTERVAL][k] = interval;
+
+	slot->head = (slot->head + 1) % hist->hdr->num_samples;
+	if (slot->count < hist->hdr->num_samples)
+		slot->count++;
+}
+
+/*
+ * The rates over all samples of the port, in bytes/s for the data
+ * counters; FALSE if no sample has a known interval.
+ */
+static boolean_t hist_rates(perfmgr_db_hist_t * hist, db_node_t * node,
+			    uint8_t port, double rates[PERFMGR_HIST_NUM_CNTRS])
+{
+	uint64_t sum[PERFMGR_HIST_NUM_CNTRS] = { 0 };
+	uint64_t interval = 0;
+	uint32_t i;
+	size_t k;
+	int c;
+
+	if (!hist->hdr || node->hist_slot == PERFMGR_HIST_NO_SLOT)
+		return FALSE;
+
+	k = (size_t) (node->hist_slot + port) * hist->hdr->num_samples;
+	for (i = 0; i < hist->slots[node->hist_slot + port].count; i++, k++) {
+		if (!hist->cols[PERFMGR_HIST_INTERVAL][k])
+			continue;
+		interval += hist->cols[PERFMGR_HIST_INTERVAL][k];
+		for (c = 0; c < PERFMGR_HIST_NUM_CNTRS; c++)
+			sum[c] += hist->cols[c][k];
+	}
+	if (!interval)
+		return FALSE;
+
+	for (c = 0; c < PERFMGR_HIST_NUM_CNTRS; c++)
+		rates[c] = (double)sum[c] / interval;
+	rates[PERFMGR_HIST_XMIT_DATA] *= 4;
+	rates[PERFMGR_HIST_RCV_DATA] *= 4;
+	return TRUE;
+}
+
 /** =========================================================================
  */
 perfmgr_db_t *perfmgr_db_construct(osm_perfmgr_t *perfmgr)
@@ -65,6 +415,8 @@ perfmgr_db_t *perfmgr_db_construct(osm_perfmgr_t *perfmgr)
 	cl_plock_construct(&db->lock);
 	cl_plock_init(&db->lock);
 	db->perfmgr = perfmgr;
+	hist_init(db, perfmgr->subn->opt.perfmgr_history_samples,
+		  perfmgr->subn->opt.perfmgr_history_file);
 	return db;
 }
 
@@ -81,6 +433,8 @@ void perfmgr_db_destroy(perfmgr_db_t * db)
 			free_node((db_node_t *)item);
 			item = next_item;
 		}
+		/* the slots are kept in the file for the next run */
+		hist_close(&db->hist);
 		cl_plock_destroy(&db->lock);
 		free(db);
 	}
@@ -131,6 +485,7 @@ static db_node_t *malloc_node(uint64_t guid, boolean_t esp0,
 	rc->num_ports = num_ports;
 	rc->node_guid = guid;
 	rc->esp0 = esp0;
+	rc->hist_slot = PERFMGR_HIST_NO_SLOT;
 
 	cur_time = time(NULL);
 	for (i = 0; i < num_ports; i++) {
@@ -190,6 +545,7 @@ perfmgr_db_create_entry(perfmgr_db_t * db, uint64_t guid, boolean_t esp0,
 			rc = PERFMGR_EVENT_DB_FAIL;
 			goto Exit;
 		}
+		pc_node->hist_slot = hist_claim(db, guid, num_ports);
 	}
 Exit:
 	cl_plock_release(&db->lock);
@@ -218,6 +574,8 @@ perfmgr_db_delete_entry(perfmgr_db_t * db, uint64_t guid)
 		return(PERFMGR_EVENT_DB_GUIDNOTFOUND);
 
 	db_node_t *pc_node = (db_node_t *)rc;
+	if (db->hist.hdr && pc_node->hist_slot != PERFMGR_HIST_NO_SLOT)
+		hist_free(&db->hist, pc_node->hist_slot);
 	free_node(pc_node);
 	return(PERFMGR_EVENT_DB_SUCCESS);
 }
@@ -230,6 +588,14 @@ perfmgr_db_delete_inactive(perfmgr_db_t * db, unsigned *cnt)
 	int num = 0;
 	uint64_t * guid_list = NULL;
 	cl_map_item_t * p_map_item = cl_qmap_head(&db->pc_data);
+	uint32_t slot;
+
+	/* the history of nodes of the last run which were not seen */
+	for (slot = 0; db->hist.hdr && db->hist.num_unclaimed &&
+	     slot < db->hist.hdr->num_slots; slot++)
+		if (db->hist.slots[slot].node_guid &&
+		    !db->hist.slots[slot].port && !db->hist.claimed[slot])
+			hist_free(&db->hist, slot);
 
 	if (p_map_item == cl_qmap_end(&db->pc_data)) {
 		rc = PERFMGR_EVENT_DB_SUCCESS;
@@ -417,6 +783,9 @@ perfmgr_db_add_err_reading(perfmgr_db_t * db, uint64_t guid, uint8_t port,
 	epi_pe_data.xmit_wait =
 	    (reading->xmit_wait - previous->xmit_wait);
 	p_port->err_total.xmit_wait += epi_pe_data.xmit_wait;
+	/* the first reading counts from an unknown time */
+	if (p_port->err_total.time)
+		p_port->hist_xmit_wait += epi_pe_data.xmit_wait;
 
 	p_port->err_previous = *reading;
 
@@ -510,6 +879,7 @@ perfmgr_db_add_dc_reading(perfmgr_db_t * db, uint64_t guid, uint8_t port,
 	perfmgr_db_data_cnt_reading_t *previous = NULL;
 	perfmgr_db_err_t rc = PERFMGR_EVENT_DB_SUCCESS;
 	osm_epi_dc_event_t epi_dc_data;
+	uint64_t hist_cntrs[PERFMGR_HIST_NUM_CNTRS];
 
 	cl_plock_excl_acquire(&db->lock);
 	node = get(db, guid);
@@ -553,6 +923,17 @@ perfmgr_db_add_dc_reading(perfmgr_db_t * db, uint64_t guid, uint8_t port,
 		p_port->dc_total.multicast_rcv_pkts += epi_dc_data.multicast_rcv_pkts;
 	}
 
+	hist_cntrs[PERFMGR_HIST_XMIT_DATA] = epi_dc_data.xmit_data;
+	hist_cntrs[PERFMGR_HIST_RCV_DATA] = epi_dc_data.rcv_data;
+	hist_cntrs[PERFMGR_HIST_XMIT_PKTS] = epi_dc_data.xmit_pkts;
+	hist_cntrs[PERFMGR_HIST_RCV_PKTS] = epi_dc_data.rcv_pkts;
+	hist_cntrs[PERFMGR_HIST_XMIT_WAIT] = p_port->hist_xmit_wait;
+	p_port->hist_xmit_wait = 0;
+	/* the first reading counts from an unknown time */
+	hist_add(&db->hist, node, port, reading->time,
+		 p_port->dc_total.time ? epi_dc_data.time_diff_s : 0,
+		 hist_cntrs);
+
 	p_port->dc_previous = *reading;
 
 	/* mark the time this total was updated */
@@ -1011,6 +1392,100 @@ perfmgr_db_print_by_guid(perfmgr_db_t * db, uint64_t nodeguid, FILE *fp,
 	cl_plock_release(&db->lock);
 }
 
+/**********************************************************************
+ * rates of a port over its history
+ **********************************************************************/
+perfmgr_db_err_t
+perfmgr_db_get_rates(perfmgr_db_t * db, uint64_t guid, uint8_t port,
+		     double rates[PERFMGR_HIST_NUM_CNTRS])
+{
+	db_node_t *node = NULL;
+	perfmgr_db_err_t rc = PERFMGR_EVENT_DB_SUCCESS;
+
+	cl_plock_acquire(&db->lock);
+
+	node = get(db, guid);
+	if ((rc = bad_node_port(node, port)) != PERFMGR_EVENT_DB_SUCCESS)
+		goto Exit;
+
+	if (!hist_rates(&db->hist, node, port, rates))
+		rc = PERFMGR_EVENT_DB_FAIL;
+
+Exit:
+	cl_plock_release(&db->lock);
+	return rc;
+}
+
+/**********************************************************************
+ * print the count ports with the highest rate of cntr to fp
+ **********************************************************************/
+void
+perfmgr_db_print_top(perfmgr_db_t * db, FILE *fp, unsigned count,
+		     perfmgr_db_hist_col_t cntr)
+{
+	struct top_port {
+		db_node_t *node;
+		uint8_t port;
+		double rate;
+	} *top;
+	double rates[PERFMGR_HIST_NUM_CNTRS];
+	cl_map_item_t *item;
+	db_node_t *node;
+	unsigned i, num = 0;
+	int port;
+
+	if (!count || !(top = calloc(count, sizeof(*top))))
+		return;
+
+	cl_plock_acquire(&db->lock);
+
+	if (!db->hist.hdr) {
+		fprintf(fp, "PerfMgr history is disabled\n");
+		goto Exit;
+	}
+
+	for (item = cl_qmap_head(&db->pc_data);
+	     item != cl_qmap_end(&db->pc_data); item = cl_qmap_next(item)) {
+		node = (db_node_t *)item;
+		for (port = node->esp0 ? 0 : 1; port < node->num_ports;
+		     port++) {
+			/* also the history of the last run, if loaded */
+			if (!hist_rates(&db->hist, node, port, rates) ||
+			    rates[cntr] <= 0)
+				continue;
+			if (num == count && rates[cntr] <= top[num - 1].rate)
+				continue;
+			i = num < count ? num++ : num - 1;
+			for (; i > 0 && top[i - 1].rate < rates[cntr]; i--)
+				top[i] = top[i - 1];
+			top[i].node = node;
+			top[i].port = port;
+			top[i].rate = rates[cntr];
+		}
+	}
+
+	fprintf(fp, "Top %u ports by %s/s over the last %u samples\n",
+		num, hist_cntr_str[cntr], db->hist.hdr->num_samples);
+	fprintf(fp, "%-24s %-18s %4s %12s %12s %12s %12s %12s\n",
+		"Name", "GUID", "Port", "xmit_B/s", "rcv_B/s",
+		"xmit_pkts/s", "rcv_pkts/s", "xmit_wait/s");
+	for (i = 0; i < num; i++) {
+		hist_rates(&db->hist, top[i].node, top[i].port, rates);
+		fprintf(fp, "%-24.24s 0x%016" PRIx64 " %4u %12.1f %12.1f "
+			"%12.1f %12.1f %12.1f\n", top[i].node->node_name,
+			top[i].node->node_guid, top[i].port,
+			rates[PERFMGR_HIST_XMIT_DATA],
+			rates[PERFMGR_HIST_RCV_DATA],
+			rates[PERFMGR_HIST_XMIT_PKTS],
+			rates[PERFMGR_HIST_RCV_PKTS],
+			rates[PERFMGR_HIST_XMIT_WAIT]);
+	}
+
+Exit:
+	cl_plock_release(&db->lock);
+	free(top);
+}
+
 /**********************************************************************
  * dump the data to the file "file"
  **********************************************************************/
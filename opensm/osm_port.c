@@ -57,6 +57,7 @@
 #include <opensm/osm_switch.h>
 #include <opensm/osm_db_pack.h>
 #include <opensm/osm_sm.h>
+#include <opensm/osm_opensm.h>
 
 void osm_physp_construct(IN osm_physp_t * p_physp)
 {
@@ -766,9 +767,33 @@ void osm_physp_set_port_info(IN osm_physp_t * p_physp,
 					   IN const ib_port_info_t * p_pi,
 					   IN const struct osm_sm * p_sm)
 {
+	const ib_port_info_t *p_old_pi = &p_physp->port_info;
+
 	CL_ASSERT(p_pi);
 	CL_ASSERT(osm_physp_is_valid(p_physp));
 
+	/* the cached PathRecord parameters may depend on this port */
+	if (ib_port_info_get_port_state(p_pi) !=
+	    ib_port_info_get_port_state(p_old_pi) ||
+	    ib_port_info_get_mtu_cap(p_pi) !=
+	    ib_port_info_get_mtu_cap(p_old_pi) ||
+	    ((p_pi->capability_mask ^ p_old_pi->capability_mask) &
+	     IB_PORT_CAP_HAS_EXT_SPEEDS) ||
+	    ib_port_info_compute_rate(p_pi, 0) !=
+	    ib_port_info_compute_rate(p_old_pi, 0) ||
+	    ib_port_info_compute_rate(p_pi, 1) !=
+	    ib_port_info_compute_rate(p_old_pi, 1))
+		osm_sa_pr_cache_flush(&p_sm->p_subn->p_osm->sa);
+
+	/* and the cached PortInfoRecord responses on any of it */
+	if (memcmp(p_pi, p_old_pi, sizeof(*p_pi)))
+		osm_sa_cache_invalidate(&p_sm->p_subn->p_osm->sa);
+
+	/* the SA snapshot has the LIDs of the port */
+	if (p_pi->base_lid != p_old_pi->base_lid ||
+	    ib_port_info_get_lmc(p_pi) != ib_port_info_get_lmc(p_old_pi))
+		osm_sa_snapshot_invalidate(&p_sm->p_subn->p_osm->sa);
+
 	if (ib_port_info_get_port_state(p_pi) == IB_LINK_DOWN) {
 		/* If PortState is down, only copy PortState */
 		/* and PortPhysicalState per C14-24-2.1 */
@@ -66,6 +66,7 @@
 #include <opensm/osm_remote_sm.h>
 #include <opensm/osm_opensm.h>
 #include <opensm/osm_ucast_mgr.h>
+#include <opensm/osm_ucast_backup.h>
 
 static void pi_rcv_check_and_fix_lid(osm_log_t * log, ib_port_info_t * pi,
 				     osm_physp_t * p)
@@ -234,6 +235,7 @@ static void pi_rcv_process_switch_port0(IN osm_sm_t * sm,
 	context.pi_context.port_guid = osm_physp_get_port_guid(p_physp);
 	context.pi_context.set_method = FALSE;
 	context.pi_context.light_sweep = FALSE;
+	context.pi_context.backup_lft = FALSE;
 	context.pi_context.active_transition = FALSE;
 	context.pi_context.client_rereg = FALSE;
 
@@ -332,6 +334,7 @@ static void pi_rcv_process_switch_ext_port(IN osm_sm_t * sm,
 			context.pi_context.port_guid = osm_physp_get_port_guid(p_physp);
 			context.pi_context.set_method = FALSE;
 			context.pi_context.light_sweep = FALSE;
+			context.pi_context.backup_lft = FALSE;
 			context.pi_context.active_transition = FALSE;
 			context.pi_context.client_rereg = FALSE;
 			status = osm_req_get(sm,
@@ -639,6 +642,34 @@ static int osm_pi_rcv_update_neighbor(IN osm_physp_t *p_physp)
 	return (ib_switch_info_get_state_change(&p_node->sw->switch_info) ? 1 : p_physp->need_update);
 }
 
+static void pi_rcv_process_backup_lft(IN osm_sm_t * sm,
+				      IN const osm_pi_context_t * p_context,
+				      IN uint8_t port_num,
+				      IN const ib_port_info_t * p_pi)
+{
+	osm_node_t *p_node;
+	osm_physp_t *p_physp;
+	unsigned num_blocks;
+
+	if (ib_port_info_get_port_state(p_pi) != IB_LINK_DOWN)
+		return;
+
+	CL_PLOCK_EXCL_ACQUIRE(sm->p_lock);
+	p_node = osm_get_node_by_guid(sm->p_subn, p_context->node_guid);
+	if (!p_node || !p_node->sw ||
+	    !(p_physp = osm_node_get_physp_ptr(p_node, port_num)))
+		goto Exit;
+
+	num_blocks = osm_ucast_backup_push(&sm->ucast_mgr, p_physp);
+	if (num_blocks)
+		OSM_LOG(sm->p_log, OSM_LOG_INFO,
+			"Link of port %u of switch 0x%016" PRIx64 " is down, "
+			"sent %u backup LFT blocks\n", port_num,
+			cl_ntoh64(p_context->node_guid), num_blocks);
+Exit:
+	CL_PLOCK_RELEASE(sm->p_lock);
+}
+
 void osm_pi_rcv_process(IN void *context, IN void *data)
 {
 	osm_sm_t *sm = context;
@@ -705,6 +736,15 @@ void osm_pi_rcv_process(IN void *context, IN void *data)
 		goto Exit;
 	}
 
+	/*
+	   The trap receiver looks for the port whose link went down to send
+	   its backup LFT blocks; the port is updated by the heavy sweep.
+	 */
+	if (p_context->backup_lft == TRUE) {
+		pi_rcv_process_backup_lft(sm, p_context, port_num, p_pi);
+		goto Exit;
+	}
+
 	CL_PLOCK_EXCL_ACQUIRE(sm->p_lock);
 	p_port = osm_get_port_by_guid(sm->p_subn, port_guid);
 	if (PF(!p_port)) {
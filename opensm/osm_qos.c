@@ -137,6 +137,7 @@ static qos_mad_item_t *osm_qos_mad_create(IN osm_sm_t * sm,
 		free(p_mad);
 		return NULL;
 	}
+	osm_req_route_by_lid(sm, p_madw, p);
 	p_mad->p_madw = p_madw;
 	return p_mad;
 }
@@ -350,6 +350,70 @@ ib_api_status_t osm_req_set(IN osm_sm_t * sm, IN const osm_dr_path_t * p_path,
 	return status;
 }
 
+/**********************************************************************
+  The plock must be held before calling this function.
+**********************************************************************/
+boolean_t osm_req_route_by_lid(IN osm_sm_t * sm, IN osm_madw_t * p_madw,
+			       IN const osm_physp_t * p_physp)
+{
+	const osm_physp_t *p_dest = p_physp;
+	osm_node_t *p_node;
+	osm_port_t *p_port, *p_sm_port;
+	ib_smp_t *p_smp;
+	ib_net16_t dlid, slid;
+
+	if (!sm->p_subn->opt.lid_routed_smps ||
+	    !sm->p_subn->lid_routed_smps_ok)
+		return FALSE;
+
+	/* switches are managed through port 0 */
+	p_node = osm_physp_get_node_ptr(p_physp);
+	if (osm_node_get_type(p_node) == IB_NODE_TYPE_SWITCH)
+		p_dest = osm_node_get_physp_ptr(p_node, 0);
+	if (!p_dest)
+		return FALSE;
+
+	/*
+	   Ports found in this sweep might not have their LID yet,
+	   nor be routed by the forwarding tables.
+	 */
+	p_port = osm_get_port_by_guid(sm->p_subn,
+				      osm_physp_get_port_guid(p_dest));
+	p_sm_port = osm_get_port_by_guid(sm->p_subn, sm->p_subn->sm_port_guid);
+	if (!p_port || p_port->is_new || !p_sm_port || p_port == p_sm_port)
+		return FALSE;
+
+	dlid = osm_physp_get_base_lid(p_dest);
+	slid = osm_physp_get_base_lid(p_sm_port->p_physp);
+	if (!dlid || cl_ntoh16(dlid) > IB_LID_UCAST_END_HO ||
+	    !slid || cl_ntoh16(slid) > IB_LID_UCAST_END_HO)
+		return FALSE;
+
+	p_smp = osm_madw_get_smp_ptr(p_madw);
+	CL_ASSERT(p_smp->mgmt_class == IB_MCLASS_SUBN_DIR);
+
+	p_madw->dr_fallback = TRUE;
+	p_madw->dr_hop_count = p_smp->hop_count;
+	memcpy(p_madw->dr_path, p_smp->initial_path, sizeof(p_madw->dr_path));
+
+	/* the directed route fields are reserved in LID routed SMPs */
+	p_smp->mgmt_class = IB_MCLASS_SUBN_LID;
+	p_smp->hop_ptr = 0;
+	p_smp->hop_count = 0;
+	p_smp->dr_slid = 0;
+	p_smp->dr_dlid = 0;
+	memset(p_smp->initial_path, 0, sizeof(p_smp->initial_path));
+
+	p_madw->mad_addr.dest_lid = dlid;
+	p_madw->mad_addr.addr_type.smi.source_lid = slid;
+
+	OSM_LOG(sm->p_log, OSM_LOG_DEBUG,
+		"Sending %s to LID %u instead of directed route\n",
+		ib_get_sm_attr_str(p_smp->attr_id), cl_ntoh16(dlid));
+
+	return TRUE;
+}
+
 int osm_send_trap144(osm_sm_t * sm, ib_net16_t local)
 {
 	osm_madw_t *madw;
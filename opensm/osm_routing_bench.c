@@ -0,0 +1,1745 @@
+/*
+ * Copyright (C) 2020-2024 ETH Zurich. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ *    Offline benchmark of the unicast routing engines.  A subnet is
+ *    built from a generated topology (or an ibnetdiscover dump) without
+ *    any fabric access, each requested routing engine computes its
+ *    tables, and the resulting LFTs are analyzed for link load, VL
+ *    usage and deadlock freedom.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <complib/cl_types.h>
+#include <complib/cl_timer.h>
+#include <complib/cl_qmap.h>
+#include <opensm/osm_file_ids.h>
+#define FILE_ID OSM_FILE_ROUTING_BENCH_C
+#include <opensm/osm_opensm.h>
+#include <opensm/osm_node.h>
+#include <opensm/osm_port.h>
+#include <opensm/osm_switch.h>
+#include <opensm/osm_ucast_mgr.h>
+
+/* normally defined by main.c, which is not part of the benchmark */
+volatile unsigned int osm_exit_flag = 0;
+
+extern int osm_ucast_minhop_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_updn_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_dnup_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_ftree_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_lash_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_dor_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_torus2QoS_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_nue_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_sssp_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_dfsssp_setup(struct osm_routing_engine *, osm_opensm_t *);
+extern int osm_ucast_lnmp_setup(struct osm_routing_engine *, osm_opensm_t *);
+
+typedef struct bench_engine_module {
+	const char *name;
+	int (*setup) (struct osm_routing_engine *, osm_opensm_t *);
+} bench_engine_module_t;
+
+static const bench_engine_module_t bench_engines[] = {
+	{"minhop", osm_ucast_minhop_setup},
+	{"updn", osm_ucast_updn_setup},
+	{"dnup", osm_ucast_dnup_setup},
+	{"ftree", osm_ucast_ftree_setup},
+	{"lash", osm_ucast_lash_setup},
+	{"dor", osm_ucast_dor_setup},
+	{"torus-2QoS", osm_ucast_torus2QoS_setup},
+	{"nue", osm_ucast_nue_setup},
+	{"sssp", osm_ucast_sssp_setup},
+	{"dfsssp", osm_ucast_dfsssp_setup},
+	{"lnmp", osm_ucast_lnmp_setup},
+	{NULL, NULL}
+};
+
+#define BENCH_DEFAULT_ENGINES	"minhop,updn,dfsssp,nue,lnmp"
+#define BENCH_NO_PEER		0xFFFFFFFF
+#define BENCH_MAX_PORTS		254
+#define BENCH_SW_GUID_BASE	0x0002c90200000000ULL
+#define BENCH_CA_GUID_BASE	0x0002c90300000000ULL
+#define BENCH_LIN_CAP		0xC000
+#define BENCH_NUM_VLS		16
+/* CDG vertices are (channel, VL) pairs, edges pack two of them */
+#define BENCH_CDG_EDGE(ch1, vl1, ch2, vl2) \
+	((((ch1) * BENCH_NUM_VLS + (vl1)) << 32) | ((ch2) * BENCH_NUM_VLS + (vl2)))
+
+/* one switch or channel adapter of the topology */
+typedef struct bench_node {
+	uint64_t guid;
+	uint8_t type;
+	uint8_t num_ports;
+	uint8_t cap;
+	uint32_t *peer;		/* remote node per port; index 0 unused */
+	uint8_t *peer_port;
+	uint16_t *lid;		/* base lid per port (port 0 for switches) */
+	uint32_t sw_rank;	/* position among the switches */
+	osm_node_t *p_node;
+} bench_node_t;
+
+typedef struct bench_topo {
+	bench_node_t *nodes;
+	uint32_t num_nodes;
+	uint32_t max_nodes;
+	uint32_t num_switches;
+	uint32_t num_cas;
+	uint32_t num_links;
+	uint8_t max_sw_ports;
+	int torus_dims[3];	/* only set by the 3D torus generator */
+	uint16_t max_lid;
+	uint32_t *lid_node;	/* node owning a lid */
+	uint8_t *lid_port;
+} bench_topo_t;
+
+typedef struct bench_opts {
+	const char *topology;
+	const char *engines;
+	const char *config_file;
+	const char *log_file;
+	uint8_t log_flags;
+	int terminals;
+	int lmc;
+	int op_vls;
+	unsigned seed;
+	uint32_t max_sources;
+	boolean_t fork_engines;
+} bench_opts_t;
+
+/* open addressing set of 64 bit keys; 0 marks an empty slot */
+typedef struct bench_edge_set {
+	uint64_t *slots;
+	uint64_t size;
+	uint64_t count;
+} bench_edge_set_t;
+
+typedef struct bench_result {
+	double lid_matrices_ms;
+	double fwd_tables_ms;
+	long peak_rss_kb;
+	uint64_t pairs;
+	uint64_t broken;
+	uint64_t max_load;
+	uint64_t sum_load;
+	uint64_t num_channels;
+	uint64_t sum_hops;
+	uint16_t vl_mask;
+	int deadlock_free;
+} bench_result_t;
+
+/************ topology construction ***********************************
+ **********************************************************************/
+static int bench_node_reserve(bench_node_t * n, unsigned port)
+{
+	unsigned cap = n->cap ? n->cap : 4, i;
+	uint32_t *peer;
+	uint8_t *peer_port;
+	uint16_t *lid;
+
+	if (n->peer && port <= n->cap)
+		return 0;
+	if (port > BENCH_MAX_PORTS)
+		return -1;
+	while (cap < port)
+		cap *= 2;
+	if (cap > BENCH_MAX_PORTS)
+		cap = BENCH_MAX_PORTS;
+
+	peer = realloc(n->peer, (cap + 1) * sizeof(*peer));
+	if (!peer)
+		return -1;
+	n->peer = peer;
+	peer_port = realloc(n->peer_port, (cap + 1) * sizeof(*peer_port));
+	if (!peer_port)
+		return -1;
+	n->peer_port = peer_port;
+	lid = realloc(n->lid, (cap + 1) * sizeof(*lid));
+	if (!lid)
+		return -1;
+	n->lid = lid;
+
+	for (i = n->cap ? n->cap + 1 : 0; i <= cap; i++) {
+		n->peer[i] = BENCH_NO_PEER;
+		n->peer_port[i] = 0;
+		n->lid[i] = 0;
+	}
+	n->cap = (uint8_t) cap;
+	return 0;
+}
+
+static uint32_t bench_topo_add_node(bench_topo_t * t, uint8_t type,
+				    uint64_t guid)
+{
+	bench_node_t *nodes;
+	bench_node_t *n;
+
+	if (t->num_nodes == t->max_nodes) {
+		t->max_nodes = t->max_nodes ? 2 * t->max_nodes : 256;
+		nodes = realloc(t->nodes, t->max_nodes * sizeof(*nodes));
+		if (!nodes)
+			return BENCH_NO_PEER;
+		t->nodes = nodes;
+	}
+	n = &t->nodes[t->num_nodes];
+	memset(n, 0, sizeof(*n));
+	n->type = type;
+	if (type == IB_NODE_TYPE_SWITCH) {
+		n->guid = guid ? guid : BENCH_SW_GUID_BASE + t->num_nodes;
+		n->sw_rank = t->num_switches++;
+	} else {
+		n->guid = guid ? guid :
+		    BENCH_CA_GUID_BASE + ((uint64_t) t->num_nodes << 8);
+		n->sw_rank = BENCH_NO_PEER;
+		t->num_cas++;
+	}
+	if (bench_node_reserve(n, 1))
+		return BENCH_NO_PEER;
+
+	return t->num_nodes++;
+}
+
+/* connect two nodes; a port number of 0 picks the next unused port */
+static int bench_topo_link(bench_topo_t * t, uint32_t a, unsigned pa,
+			   uint32_t b, unsigned pb)
+{
+	bench_node_t *na = &t->nodes[a], *nb = &t->nodes[b];
+
+	if (!pa)
+		pa = na->num_ports + 1;
+	if (!pb)
+		pb = nb->num_ports + 1;
+	if (a == b && pa == pb)
+		return -1;
+	if (bench_node_reserve(na, pa) || bench_node_reserve(nb, pb)) {
+		fprintf(stderr, "node 0x%016" PRIx64 " or 0x%016" PRIx64
+			" exceeds %u ports\n", na->guid, nb->guid,
+			BENCH_MAX_PORTS);
+		return -1;
+	}
+	if (na->peer[pa] != BENCH_NO_PEER || nb->peer[pb] != BENCH_NO_PEER)
+		return -1;
+
+	na->peer[pa] = b;
+	na->peer_port[pa] = (uint8_t) pb;
+	nb->peer[pb] = a;
+	nb->peer_port[pb] = (uint8_t) pa;
+	if (pa > na->num_ports)
+		na->num_ports = (uint8_t) pa;
+	if (pb > nb->num_ports)
+		nb->num_ports = (uint8_t) pb;
+	t->num_links++;
+	return 0;
+}
+
+static int bench_topo_add_terminals(bench_topo_t * t, uint32_t sw, int num)
+{
+	uint32_t ca;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		ca = bench_topo_add_node(t, IB_NODE_TYPE_CA, 0);
+		if (ca == BENCH_NO_PEER || bench_topo_link(t, ca, 1, sw, 0))
+			return -1;
+	}
+	return 0;
+}
+
+static void bench_topo_destroy(bench_topo_t * t)
+{
+	uint32_t i;
+
+	for (i = 0; i < t->num_nodes; i++) {
+		free(t->nodes[i].peer);
+		free(t->nodes[i].peer_port);
+		free(t->nodes[i].lid);
+	}
+	free(t->nodes);
+	free(t->lid_node);
+	free(t->lid_port);
+	memset(t, 0, sizeof(*t));
+}
+
+/* parse "AxBxC" or "A,B,C" into at most max values */
+static int bench_parse_list(const char *args, unsigned *val, int max)
+{
+	char *str, *tok, *p;
+	int num = 0;
+
+	if (!args)
+		return 0;
+	str = strdup(args);
+	if (!str)
+		return -1;
+	for (tok = strtok_r(str, "x,", &p); tok;
+	     tok = strtok_r(NULL, "x,", &p)) {
+		if (num == max) {
+			num = -1;
+			break;
+		}
+		val[num++] = strtoul(tok, NULL, 0);
+	}
+	free(str);
+	return num;
+}
+
+static int bench_is_prime(unsigned q)
+{
+	unsigned d;
+
+	if (q < 2)
+		return 0;
+	for (d = 2; d * d <= q; d++)
+		if (q % d == 0)
+			return 0;
+	return 1;
+}
+
+/* Slim Fly MMS graph for a prime q = 4w + delta, delta = +-1 */
+static int bench_gen_slimfly(bench_topo_t * t, const char *args, int p)
+{
+	unsigned q = 0, xi, x, y, m, c, e, w, i, order, val;
+	uint8_t *in_x = NULL, *in_xp = NULL;
+	int delta, rc = -1;
+	uint32_t base;
+
+	if (bench_parse_list(args, &q, 1) != 1 || !bench_is_prime(q) ||
+	    (q % 4 != 1 && q % 4 != 3)) {
+		fprintf(stderr, "slimfly needs a prime q = 4w +- 1\n");
+		return -1;
+	}
+	delta = (q % 4 == 1) ? 1 : -1;
+	w = (q - delta) / 4;
+
+	/* find a primitive element of GF(q) */
+	for (xi = 2; xi < q; xi++) {
+		for (order = 1, val = xi; val != 1; order++)
+			val = (val * xi) % q;
+		if (order == q - 1)
+			break;
+	}
+
+	in_x = calloc(q, 1);
+	in_xp = calloc(q, 1);
+	if (!in_x || !in_xp)
+		goto Exit;
+
+	/* generator sets X and X' of the MMS construction */
+	for (e = 0, val = 1; e < q - 1; e++, val = (val * xi) % q) {
+		if (delta == 1) {
+			if (e % 2 == 0)
+				in_x[val] = 1;
+			else
+				in_xp[val] = 1;
+		} else {
+			if ((e <= 2 * w - 2 && e % 2 == 0) ||
+			    (e >= 2 * w - 1 && e % 2 == 1))
+				in_x[val] = 1;
+			if ((e <= 2 * w - 1 && e % 2 == 1) ||
+			    (e >= 2 * w && e % 2 == 0))
+				in_xp[val] = 1;
+		}
+	}
+
+	if (p < 0)
+		p = ((3 * q - delta) / 2 + 1) / 2;
+
+	base = t->num_nodes;
+	for (i = 0; i < 2 * q * q; i++)
+		if (bench_topo_add_node(t, IB_NODE_TYPE_SWITCH, 0) ==
+		    BENCH_NO_PEER)
+			goto Exit;
+
+	/* router (s, x, y) is node base + s*q*q + x*q + y */
+	for (x = 0; x < q; x++)
+		for (y = 0; y < q; y++)
+			for (c = y + 1; c < q; c++) {
+				if (in_x[(c - y) % q] &&
+				    bench_topo_link(t, base + x * q + y, 0,
+						    base + x * q + c, 0))
+					goto Exit;
+				if (in_xp[(c - y) % q] &&
+				    bench_topo_link(t, base + q * q + x * q + y,
+						    0, base + q * q + x * q + c,
+						    0))
+					goto Exit;
+			}
+	for (x = 0; x < q; x++)
+		for (y = 0; y < q; y++)
+			for (m = 0; m < q; m++) {
+				c = (y + q * q - (m * x) % q) % q;
+				if (bench_topo_link(t, base + x * q + y, 0,
+						    base + q * q + m * q + c,
+						    0))
+					goto Exit;
+			}
+
+	for (i = 0; i < 2 * q * q; i++)
+		if (bench_topo_add_terminals(t, base + i, p))
+			goto Exit;
+	rc = 0;
+Exit:
+	free(in_x);
+	free(in_xp);
+	return rc;
+}
+
+/* Dragonfly with a routers per group and h global links per router */
+static int bench_gen_dragonfly(bench_topo_t * t, const char *args, int p)
+{
+	unsigned val[2] = { 0, 0 }, a, h, g, grp, r, r2, j, k, dst;
+	uint32_t base;
+
+	if (bench_parse_list(args, val, 2) != 2 || !val[0] || !val[1]) {
+		fprintf(stderr, "dragonfly needs a,h\n");
+		return -1;
+	}
+	a = val[0];
+	h = val[1];
+	g = a * h + 1;
+	if (p < 0)
+		p = h;
+
+	base = t->num_nodes;
+	for (k = 0; k < g * a; k++)
+		if (bench_topo_add_node(t, IB_NODE_TYPE_SWITCH, 0) ==
+		    BENCH_NO_PEER)
+			return -1;
+
+	for (grp = 0; grp < g; grp++)
+		for (r = 0; r < a; r++)
+			for (r2 = r + 1; r2 < a; r2++)
+				if (bench_topo_link(t, base + grp * a + r, 0,
+						    base + grp * a + r2, 0))
+					return -1;
+
+	/* global link k of a group leads to group k (skipping itself) */
+	for (grp = 0; grp < g; grp++)
+		for (r = 0; r < a; r++)
+			for (j = 0; j < h; j++) {
+				k = r * h + j;
+				dst = k < grp ? k : k + 1;
+				if (dst < grp)
+					continue;
+				if (bench_topo_link(t, base + grp * a + r, 0,
+						    base + dst * a + grp / h,
+						    0))
+					return -1;
+			}
+
+	for (k = 0; k < g * a; k++)
+		if (bench_topo_add_terminals(t, base + k, p))
+			return -1;
+	return 0;
+}
+
+/* k-ary n-tree; terminals only hang off the leaf switches */
+static int bench_gen_fattree(bench_topo_t * t, const char *args, int p)
+{
+	unsigned val[2] = { 0, 0 }, k, n, per_level, l, w, i, div, w2;
+	uint32_t base;
+
+	if (bench_parse_list(args, val, 2) != 2 || val[0] < 2 || !val[1]) {
+		fprintf(stderr, "fattree needs k,n\n");
+		return -1;
+	}
+	k = val[0];
+	n = val[1];
+	for (per_level = 1, l = 1; l < n; l++)
+		per_level *= k;
+	if (p < 0)
+		p = k;
+
+	base = t->num_nodes;
+	for (i = 0; i < n * per_level; i++)
+		if (bench_topo_add_node(t, IB_NODE_TYPE_SWITCH, 0) ==
+		    BENCH_NO_PEER)
+			return -1;
+
+	/* switch (l, w) and (l + 1, w2) are connected if their words
+	   differ in digit l only */
+	for (l = 0, div = 1; l + 1 < n; l++, div *= k)
+		for (w = 0; w < per_level; w++)
+			for (i = 0; i < k; i++) {
+				w2 = w - ((w / div) % k) * div + i * div;
+				if (bench_topo_link(t, base + l * per_level + w,
+						    0,
+						    base + (l + 1) * per_level +
+						    w2, 0))
+					return -1;
+			}
+
+	for (w = 0; w < per_level; w++)
+		if (bench_topo_add_terminals(t, base + w, p))
+			return -1;
+	return 0;
+}
+
+static int bench_gen_torus(bench_topo_t * t, const char *args, int p)
+{
+	unsigned d[3] = { 0, 0, 0 }, x, y, z, i;
+	uint32_t base, self;
+
+	if (bench_parse_list(args, d, 3) != 3 || !d[0] || !d[1] || !d[2]) {
+		fprintf(stderr, "torus needs XxYxZ\n");
+		return -1;
+	}
+	if (p < 0)
+		p = 1;
+
+	base = t->num_nodes;
+	for (i = 0; i < d[0] * d[1] * d[2]; i++)
+		if (bench_topo_add_node(t, IB_NODE_TYPE_SWITCH, 0) ==
+		    BENCH_NO_PEER)
+			return -1;
+
+#define TORUS_IDX(x, y, z) (base + ((z) * d[1] + (y)) * d[0] + (x))
+	for (z = 0; z < d[2]; z++)
+		for (y = 0; y < d[1]; y++)
+			for (x = 0; x < d[0]; x++) {
+				self = TORUS_IDX(x, y, z);
+				if (d[0] > 1 &&
+				    bench_topo_link(t, self, 0,
+						    TORUS_IDX((x + 1) % d[0], y,
+							      z), 0))
+					return -1;
+				if (d[1] > 1 &&
+				    bench_topo_link(t, self, 0,
+						    TORUS_IDX(x, (y + 1) % d[1],
+							      z), 0))
+					return -1;
+				if (d[2] > 1 &&
+				    bench_topo_link(t, self, 0,
+						    TORUS_IDX(x, y,
+							      (z + 1) % d[2]),
+						    0))
+					return -1;
+			}
+#undef TORUS_IDX
+
+	for (i = 0; i < d[0] * d[1] * d[2]; i++)
+		if (bench_topo_add_terminals(t, base + i, p))
+			return -1;
+
+	t->torus_dims[0] = d[0];
+	t->torus_dims[1] = d[1];
+	t->torus_dims[2] = d[2];
+	return 0;
+}
+
+/* HyperX: all switches which differ in exactly one coordinate are
+   connected */
+static int bench_gen_hyperx(bench_topo_t * t, const char *args, int p)
+{
+	unsigned d[8], num, dims, i, j, k, stride, coord;
+	int rc;
+	uint32_t base;
+
+	rc = bench_parse_list(args, d, 8);
+	if (rc < 1) {
+		fprintf(stderr, "hyperx needs S1xS2x...\n");
+		return -1;
+	}
+	dims = (unsigned)rc;
+	for (num = 1, i = 0; i < dims; i++)
+		num *= d[i];
+	if (p < 0)
+		p = 1;
+
+	base = t->num_nodes;
+	for (i = 0; i < num; i++)
+		if (bench_topo_add_node(t, IB_NODE_TYPE_SWITCH, 0) ==
+		    BENCH_NO_PEER)
+			return -1;
+
+	for (i = 0; i < num; i++)
+		for (k = 0, stride = 1; k < dims; stride *= d[k], k++) {
+			coord = (i / stride) % d[k];
+			for (j = coord + 1; j < d[k]; j++)
+				if (bench_topo_link(t, base + i, 0,
+						    base + i + (j - coord) *
+						    stride, 0))
+					return -1;
+		}
+
+	for (i = 0; i < num; i++)
+		if (bench_topo_add_terminals(t, base + i, p))
+			return -1;
+	return 0;
+}
+
+static int bench_is_adjacent(bench_topo_t * t, uint32_t a, uint32_t b)
+{
+	bench_node_t *n = &t->nodes[a];
+	unsigned port;
+
+	for (port = 1; port <= n->num_ports; port++)
+		if (n->peer[port] == b)
+			return 1;
+	return 0;
+}
+
+/* random d-regular graph; stubs are paired at random and the pairing
+   is restarted when it gets stuck */
+static int bench_gen_random(bench_topo_t * t, const char *args, int p,
+			    unsigned seed)
+{
+	unsigned val[2] = { 0, 0 }, n, d, attempt, tries, num_stubs, i, j;
+	uint32_t *stubs = NULL, base, a, b, links;
+	int rc = -1;
+
+	if (bench_parse_list(args, val, 2) != 2 || val[1] >= val[0] ||
+	    (val[0] * val[1]) % 2) {
+		fprintf(stderr, "random needs n,d with d < n and n*d even\n");
+		return -1;
+	}
+	n = val[0];
+	d = val[1];
+	if (p < 0)
+		p = 1;
+
+	base = t->num_nodes;
+	for (i = 0; i < n; i++)
+		if (bench_topo_add_node(t, IB_NODE_TYPE_SWITCH, 0) ==
+		    BENCH_NO_PEER)
+			return -1;
+
+	stubs = malloc(n * d * sizeof(*stubs));
+	if (!stubs)
+		return -1;
+	srandom(seed);
+	links = t->num_links;
+
+	for (attempt = 0; attempt < 100; attempt++) {
+		for (i = 0; i < n; i++) {
+			t->nodes[base + i].num_ports = 0;
+			for (j = 0; j <= t->nodes[base + i].cap; j++)
+				t->nodes[base + i].peer[j] = BENCH_NO_PEER;
+			for (j = 0; j < d; j++)
+				stubs[i * d + j] = base + i;
+		}
+		t->num_links = links;
+		num_stubs = n * d;
+		while (num_stubs) {
+			for (tries = 0; tries < 100; tries++) {
+				i = random() % num_stubs;
+				j = random() % num_stubs;
+				a = stubs[i];
+				b = stubs[j];
+				if (a != b && !bench_is_adjacent(t, a, b))
+					break;
+			}
+			if (tries == 100)
+				break;
+			if (bench_topo_link(t, a, 0, b, 0))
+				goto Exit;
+			/* remove the higher index first */
+			if (i < j) {
+				stubs[j] = stubs[--num_stubs];
+				stubs[i] = stubs[--num_stubs];
+			} else {
+				stubs[i] = stubs[--num_stubs];
+				stubs[j] = stubs[--num_stubs];
+			}
+		}
+		if (!num_stubs)
+			break;
+	}
+	if (attempt == 100) {
+		fprintf(stderr, "cannot generate a random %u-regular graph\n",
+			d);
+		goto Exit;
+	}
+
+	for (i = 0; i < n; i++)
+		if (bench_topo_add_terminals(t, base + i, p))
+			goto Exit;
+	rc = 0;
+Exit:
+	free(stubs);
+	return rc;
+}
+
+typedef struct bench_guid_item {
+	cl_map_item_t map_item;
+	uint32_t idx;
+} bench_guid_item_t;
+
+static uint32_t bench_guid_lookup(cl_qmap_t * map, uint64_t guid)
+{
+	cl_map_item_t *item = cl_qmap_get(map, guid);
+
+	if (item == cl_qmap_end(map))
+		return BENCH_NO_PEER;
+	return ((bench_guid_item_t *) item)->idx;
+}
+
+/* parse the node header of an ibnetdiscover dump, e.g.
+   Switch	36 "S-0002c90200412180"		# ...
+*/
+static int bench_parse_node_line(const char *line, uint8_t * type,
+				  unsigned *num_ports, uint64_t * guid)
+{
+	char kind[8], tag;
+
+	if (sscanf(line, "%7s %u \"%c-%" SCNx64 "\"", kind, num_ports, &tag,
+		   guid) != 4)
+		return -1;
+	if (!strcmp(kind, "Switch"))
+		*type = IB_NODE_TYPE_SWITCH;
+	else if (!strcmp(kind, "Ca"))
+		*type = IB_NODE_TYPE_CA;
+	else
+		return -1;
+	return 0;
+}
+
+/* parse a port line of an ibnetdiscover dump, e.g.
+   [1](2c903000a1b2d)	"S-0002c90200412180"[3]		# ...
+*/
+static int bench_parse_port_line(const char *line, unsigned *port,
+				 uint64_t * remote_guid, unsigned *rport)
+{
+	const char *p;
+	char tag;
+
+	if (sscanf(line, " [%u]", port) != 1)
+		return -1;
+	p = strchr(line, '"');
+	if (!p || sscanf(p, "\"%c-%" SCNx64 "\"[%u]", &tag, remote_guid,
+			 rport) != 3)
+		return -1;
+	return 0;
+}
+
+static int bench_load_file(bench_topo_t * t, const char *file_name)
+{
+	cl_qmap_t guid_map;
+	bench_guid_item_t *item, *next;
+	FILE *f;
+	char line[1024];
+	uint8_t type;
+	unsigned num_ports, port, rport, lineno;
+	uint64_t guid, rguid;
+	uint32_t cur = BENCH_NO_PEER, idx, ridx;
+	int pass, rc = -1;
+
+	f = fopen(file_name, "r");
+	if (!f) {
+		fprintf(stderr, "cannot open topology file \'%s\'\n",
+			file_name);
+		return -1;
+	}
+	cl_qmap_init(&guid_map);
+
+	/* first pass creates the nodes, second pass the links */
+	for (pass = 0; pass < 2; pass++) {
+		rewind(f);
+		lineno = 0;
+		while (fgets(line, sizeof(line), f)) {
+			lineno++;
+			if (!bench_parse_node_line(line, &type, &num_ports,
+						   &guid)) {
+				if (pass) {
+					cur = bench_guid_lookup(&guid_map,
+								guid);
+					continue;
+				}
+				if (bench_guid_lookup(&guid_map, guid) !=
+				    BENCH_NO_PEER)
+					continue;
+				idx = bench_topo_add_node(t, type, guid);
+				item = malloc(sizeof(*item));
+				if (idx == BENCH_NO_PEER || !item) {
+					free(item);
+					goto Exit;
+				}
+				item->idx = idx;
+				cl_qmap_insert(&guid_map, guid,
+					       &item->map_item);
+				continue;
+			}
+			if (!pass || cur == BENCH_NO_PEER ||
+			    bench_parse_port_line(line, &port, &rguid,
+						  &rport))
+				continue;
+			ridx = bench_guid_lookup(&guid_map, rguid);
+			if (ridx == BENCH_NO_PEER || !port || !rport) {
+				fprintf(stderr, "%s:%u: unknown or invalid "
+					"link\n", file_name, lineno);
+				goto Exit;
+			}
+			/* every link is listed from both ends */
+			if (port <= t->nodes[cur].num_ports &&
+			    t->nodes[cur].peer[port] == ridx &&
+			    t->nodes[cur].peer_port[port] == rport)
+				continue;
+			if (bench_topo_link(t, cur, port, ridx, rport)) {
+				fprintf(stderr, "%s:%u: inconsistent link\n",
+					file_name, lineno);
+				goto Exit;
+			}
+		}
+	}
+	rc = t->num_switches ? 0 : -1;
+	if (rc)
+		fprintf(stderr, "no switches found in \'%s\'\n", file_name);
+Exit:
+	next = (bench_guid_item_t *) cl_qmap_head(&guid_map);
+	while (next != (bench_guid_item_t *) cl_qmap_end(&guid_map)) {
+		item = next;
+		next = (bench_guid_item_t *) cl_qmap_next(&item->map_item);
+		free(item);
+	}
+	fclose(f);
+	return rc;
+}
+
+static int bench_create_topology(bench_topo_t * t, const bench_opts_t * o)
+{
+	const char *args = strchr(o->topology, ':');
+	size_t len = args ? (size_t) (args - o->topology) :
+	    strlen(o->topology);
+	uint32_t i;
+	int rc;
+
+	memset(t, 0, sizeof(*t));
+	if (args)
+		args++;
+
+	if (!strncmp(o->topology, "slimfly", len))
+		rc = bench_gen_slimfly(t, args, o->terminals);
+	else if (!strncmp(o->topology, "dragonfly", len))
+		rc = bench_gen_dragonfly(t, args, o->terminals);
+	else if (!strncmp(o->topology, "fattree", len))
+		rc = bench_gen_fattree(t, args, o->terminals);
+	else if (!strncmp(o->topology, "torus", len))
+		rc = bench_gen_torus(t, args, o->terminals);
+	else if (!strncmp(o->topology, "hyperx", len))
+		rc = bench_gen_hyperx(t, args, o->terminals);
+	else if (!strncmp(o->topology, "random", len))
+		rc = bench_gen_random(t, args, o->terminals, o->seed);
+	else if (!strncmp(o->topology, "file", len) && args)
+		rc = bench_load_file(t, args);
+	else {
+		fprintf(stderr, "unknown topology \'%s\'\n", o->topology);
+		rc = -1;
+	}
+	if (rc)
+		return rc;
+
+	for (i = 0; i < t->num_nodes; i++)
+		if (t->nodes[i].type == IB_NODE_TYPE_SWITCH &&
+		    t->nodes[i].num_ports > t->max_sw_ports)
+			t->max_sw_ports = t->nodes[i].num_ports;
+	return 0;
+}
+
+/************ subnet construction *************************************
+ **********************************************************************/
+static void bench_init_port_info(osm_physp_t * p_physp, uint8_t op_vls,
+				 boolean_t active)
+{
+	ib_port_info_t *pi = &p_physp->port_info;
+
+	pi->capability_mask = IB_PORT_CAP_HAS_SL_MAP;
+	pi->vl_cap = (uint8_t) (op_vls << 4);
+	ib_port_info_set_op_vls(pi, op_vls);
+	pi->mtu_cap = IB_MTU_LEN_2048;
+	pi->link_width_active = IB_LINK_WIDTH_ACTIVE_4X;
+	ib_port_info_set_port_state(pi, active ? IB_LINK_ACTIVE : IB_LINK_DOWN);
+}
+
+/* create the node, switch and port objects like the discovery would */
+static int bench_create_node(osm_opensm_t * osm, bench_node_t * n)
+{
+	osm_subn_t *p_subn = &osm->subn;
+	uint8_t mad_buf[MAD_BLOCK_SIZE];
+	ib_smp_t *p_smp = (ib_smp_t *) mad_buf;
+	ib_node_info_t *p_ni = ib_smp_get_payload_ptr(p_smp);
+	ib_switch_info_t *p_si;
+	osm_madw_t madw;
+	osm_node_t *p_node;
+	osm_switch_t *p_sw;
+	osm_port_t *p_port;
+	unsigned port;
+
+	memset(mad_buf, 0, sizeof(mad_buf));
+	osm_madw_init(&madw, OSM_BIND_INVALID_HANDLE, MAD_BLOCK_SIZE, NULL);
+	osm_madw_set_mad(&madw, (ib_mad_t *) p_smp);
+
+	p_smp->attr_id = IB_MAD_ATTR_NODE_INFO;
+	p_ni->base_version = 1;
+	p_ni->class_version = 1;
+	p_ni->node_type = n->type;
+	p_ni->num_ports = n->num_ports ? n->num_ports : 1;
+	p_ni->sys_guid = cl_hton64(n->guid);
+	p_ni->node_guid = cl_hton64(n->guid);
+	p_ni->partition_cap = cl_hton16(1);
+	if (n->type == IB_NODE_TYPE_SWITCH)
+		p_ni->port_guid = p_ni->node_guid;
+	else {
+		p_ni->port_guid = cl_hton64(n->guid + 1);
+		p_ni->port_num_vendor_id = 1 << IB_NODE_INFO_PORT_NUM_SHIFT;
+	}
+
+	p_node = osm_node_new(&madw);
+	if (!p_node)
+		return -1;
+	n->p_node = p_node;
+	cl_qmap_insert(&p_subn->node_guid_tbl, p_ni->node_guid,
+		       &p_node->map_item);
+
+	if (n->type == IB_NODE_TYPE_SWITCH) {
+		p_port = osm_port_new(p_ni, p_node);
+		if (!p_port)
+			return -1;
+		cl_qmap_insert(&p_subn->port_guid_tbl, p_ni->port_guid,
+			       &p_port->map_item);
+
+		memset(p_ni, 0, sizeof(*p_ni));
+		p_smp->attr_id = IB_MAD_ATTR_SWITCH_INFO;
+		p_si = ib_smp_get_payload_ptr(p_smp);
+		p_si->lin_cap = cl_hton16(BENCH_LIN_CAP);
+		p_sw = osm_switch_new(p_node, &madw);
+		if (!p_sw)
+			return -1;
+		p_node->sw = p_sw;
+		cl_qmap_insert(&p_subn->sw_guid_tbl, cl_hton64(n->guid),
+			       &p_sw->map_item);
+		return 0;
+	}
+
+	for (port = 1; port <= n->num_ports; port++) {
+		p_ni->port_guid = cl_hton64(n->guid + port);
+		p_ni->port_num_vendor_id = port << IB_NODE_INFO_PORT_NUM_SHIFT;
+		if (port > 1)
+			osm_node_init_physp(p_node, (uint8_t) port, &madw);
+		if (n->peer[port] == BENCH_NO_PEER)
+			continue;
+		p_port = osm_port_new(p_ni, p_node);
+		if (!p_port)
+			return -1;
+		cl_qmap_insert(&p_subn->port_guid_tbl, p_ni->port_guid,
+			       &p_port->map_item);
+	}
+	return 0;
+}
+
+static int bench_assign_lid(osm_opensm_t * osm, bench_topo_t * t,
+			    uint32_t idx, uint8_t port, uint8_t lmc,
+			    uint16_t * next_lid)
+{
+	bench_node_t *n = &t->nodes[idx];
+	osm_physp_t *p_physp = osm_node_get_physp_ptr(n->p_node, port);
+	osm_port_t *p_port;
+	uint16_t lid, num = (uint16_t) (1 << lmc);
+	uint64_t guid = n->type == IB_NODE_TYPE_SWITCH ? n->guid :
+	    n->guid + port;
+
+	lid = (uint16_t) ((*next_lid + num - 1) & ~(num - 1));
+	if ((uint32_t) lid + num - 1 > IB_LID_UCAST_END_HO) {
+		fprintf(stderr, "topology needs more than %u LIDs\n",
+			IB_LID_UCAST_END_HO);
+		return -1;
+	}
+	p_port = osm_get_port_by_guid(&osm->subn, cl_hton64(guid));
+	if (!p_port || !p_physp)
+		return -1;
+
+	p_physp->port_info.base_lid = cl_hton16(lid);
+	ib_port_info_set_lmc(&p_physp->port_info, lmc);
+	n->lid[port] = lid;
+	for (*next_lid = lid; *next_lid < lid + num; (*next_lid)++) {
+		cl_ptr_vector_set(&osm->subn.port_lid_tbl, *next_lid, p_port);
+		t->lid_node[*next_lid] = idx;
+		t->lid_port[*next_lid] = port;
+	}
+	t->max_lid = *next_lid - 1;
+	return 0;
+}
+
+static int bench_build_subnet(osm_opensm_t * osm, bench_topo_t * t)
+{
+	osm_subn_t *p_subn = &osm->subn;
+	bench_node_t *n, *r;
+	osm_physp_t *p_physp;
+	uint8_t lmc = p_subn->opt.lmc;
+	uint8_t op_vls = p_subn->opt.max_op_vls;
+	uint16_t next_lid = 1;
+	uint32_t i;
+	unsigned port;
+
+	for (i = 0; i < t->num_nodes; i++)
+		if (bench_create_node(osm, &t->nodes[i])) {
+			fprintf(stderr, "cannot create node 0x%016" PRIx64
+				"\n", t->nodes[i].guid);
+			return -1;
+		}
+
+	/* max_op_vls uses the OpVLs encoding: 1 = VL0, ..., 5 = VL0-14 */
+	if (op_vls > 5)
+		op_vls = 5;
+	else if (!op_vls)
+		op_vls = 1;
+
+	for (i = 0; i < t->num_nodes; i++) {
+		n = &t->nodes[i];
+		if (n->type == IB_NODE_TYPE_SWITCH)
+			bench_init_port_info(osm_node_get_physp_ptr(n->p_node,
+								    0),
+					     op_vls, TRUE);
+		for (port = 1; port <= n->num_ports; port++) {
+			p_physp = osm_node_get_physp_ptr(n->p_node, port);
+			bench_init_port_info(p_physp, op_vls,
+					     n->peer[port] != BENCH_NO_PEER);
+			if (n->peer[port] == BENCH_NO_PEER ||
+			    n->peer[port] < i || (n->peer[port] == i &&
+						  n->peer_port[port] < port))
+				continue;
+			r = &t->nodes[n->peer[port]];
+			osm_node_link(n->p_node, (uint8_t) port, r->p_node,
+				      n->peer_port[port]);
+		}
+	}
+
+	t->lid_node = malloc((IB_LID_UCAST_END_HO + 1) * sizeof(uint32_t));
+	t->lid_port = calloc(IB_LID_UCAST_END_HO + 1, 1);
+	if (!t->lid_node || !t->lid_port)
+		return -1;
+	for (i = 0; i <= IB_LID_UCAST_END_HO; i++)
+		t->lid_node[i] = BENCH_NO_PEER;
+
+	/* switches first, like the LID manager would do on a fresh subnet */
+	for (i = 0; i < t->num_nodes; i++)
+		if (t->nodes[i].type == IB_NODE_TYPE_SWITCH &&
+		    bench_assign_lid(osm, t, i, 0,
+				     p_subn->opt.lmc_esp0 ? lmc : 0,
+				     &next_lid))
+			return -1;
+	for (i = 0; i < t->num_nodes; i++) {
+		n = &t->nodes[i];
+		if (n->type == IB_NODE_TYPE_SWITCH)
+			continue;
+		for (port = 1; port <= n->num_ports; port++)
+			if (n->peer[port] != BENCH_NO_PEER &&
+			    bench_assign_lid(osm, t, i, (uint8_t) port, lmc,
+					     &next_lid))
+				return -1;
+	}
+
+	for (i = 0; i < t->num_nodes; i++)
+		if (t->nodes[i].type != IB_NODE_TYPE_SWITCH &&
+		    t->nodes[i].num_ports) {
+			p_subn->sm_port_guid =
+			    cl_hton64(t->nodes[i].guid + 1);
+			p_subn->sm_base_lid = cl_hton16(t->nodes[i].lid[1]);
+			p_subn->master_sm_base_lid = p_subn->sm_base_lid;
+			break;
+		}
+	return 0;
+}
+
+/* the parts of osm_opensm_init the routing engines depend on; there is
+   no vendor layer, no SA and no persistent database */
+static int bench_init_osm(osm_opensm_t * osm, const osm_subn_opt_t * p_opt,
+			  const bench_opts_t * o)
+{
+	osm_subn_t *p_subn = &osm->subn;
+
+	osm_opensm_construct(osm);
+	osm_opensm_construct_finish(osm);
+
+	if (osm_log_init_v2(&osm->log, TRUE, o->log_flags, o->log_file, 0,
+			    FALSE) != IB_SUCCESS)
+		return -1;
+	if (cl_plock_init(&osm->lock) != CL_SUCCESS)
+		return -1;
+
+	if (cl_ptr_vector_init(&p_subn->port_lid_tbl,
+			       OSM_SUBNET_VECTOR_MIN_SIZE,
+			       OSM_SUBNET_VECTOR_GROW_SIZE) != CL_SUCCESS)
+		return -1;
+	cl_ptr_vector_set(&p_subn->port_lid_tbl, 0, NULL);
+	p_subn->p_osm = osm;
+	p_subn->opt = *p_opt;
+	p_subn->max_ucast_lid_ho = IB_LID_UCAST_END_HO;
+	p_subn->max_mcast_lid_ho = IB_LID_MCAST_END_HO;
+	p_subn->min_ca_mtu = IB_MAX_MTU;
+	p_subn->min_ca_rate = IB_PATH_RECORD_RATE_300_GBS;
+	p_subn->min_data_vls = IB_MAX_NUM_VLS - 1;
+	p_subn->min_sw_data_vls = IB_MAX_NUM_VLS - 1;
+	p_subn->ignore_existing_lfts = TRUE;
+
+	osm->sm.p_subn = p_subn;
+	osm->sm.p_log = &osm->log;
+	osm->sm.p_lock = &osm->lock;
+	if (osm_ucast_mgr_init(&osm->sm.ucast_mgr, &osm->sm) != IB_SUCCESS)
+		return -1;
+	return 0;
+}
+
+/* torus-2QoS needs the dimensions and a seed switch */
+static char *bench_write_torus_conf(bench_topo_t * t)
+{
+	char tmpl[] = "/tmp/osm_routing_bench_torus.XXXXXX";
+	int fd, i, stride, *d = t->torus_dims;
+	FILE *f;
+
+	fd = mkstemp(tmpl);
+	if (fd < 0)
+		return NULL;
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(tmpl);
+		return NULL;
+	}
+	fprintf(f, "torus %d %d %d\n", d[0], d[1], d[2]);
+	/* radix 4 rings also need the negative direction, see
+	   torus-2QoS.conf(5) */
+	for (i = 0, stride = 1; i < 3; stride *= d[i], i++) {
+		if (d[i] < 2)
+			continue;
+		fprintf(f, "%cp_link 0x%016" PRIx64 " 0x%016" PRIx64 "\n",
+			'x' + i, t->nodes[0].guid, t->nodes[stride].guid);
+		if (d[i] == 4)
+			fprintf(f, "%cm_link 0x%016" PRIx64 " 0x%016" PRIx64
+				"\n", 'x' + i, t->nodes[0].guid,
+				t->nodes[(d[i] - 1) * stride].guid);
+	}
+	fclose(f);
+	return strdup(tmpl);
+}
+
+/************ analysis of the forwarding tables ***********************
+ **********************************************************************/
+static int bench_edge_set_insert(bench_edge_set_t * s, uint64_t key)
+{
+	uint64_t *slots, i, j, size;
+
+	key++;
+	if (2 * (s->count + 1) > s->size) {
+		size = s->size ? 2 * s->size : 1024;
+		slots = calloc(size, sizeof(*slots));
+		if (!slots)
+			return -1;
+		for (i = 0; i < s->size; i++) {
+			if (!s->slots[i])
+				continue;
+			for (j = (s->slots[i] * 0x9E3779B97F4A7C15ULL) &
+			     (size - 1); slots[j]; j = (j + 1) & (size - 1)) ;
+			slots[j] = s->slots[i];
+		}
+		free(s->slots);
+		s->slots = slots;
+		s->size = size;
+	}
+	for (i = (key * 0x9E3779B97F4A7C15ULL) & (s->size - 1); s->slots[i];
+	     i = (i + 1) & (s->size - 1))
+		if (s->slots[i] == key)
+			return 0;
+	s->slots[i] = key;
+	s->count++;
+	return 0;
+}
+
+/* Kahn's algorithm on the channel dependency graph (channel x VL) */
+static int bench_cdg_is_acyclic(bench_edge_set_t * s, uint64_t num_nodes)
+{
+	uint32_t *indeg = NULL, *first = NULL, *adj = NULL, *queue = NULL;
+	uint64_t i, from, to, head = 0, tail = 0, visited = 0, used = 0;
+	int rc = -1;
+
+	indeg = calloc(num_nodes, sizeof(*indeg));
+	first = calloc(num_nodes + 1, sizeof(*first));
+	adj = malloc((s->count + 1) * sizeof(*adj));
+	queue = malloc(num_nodes * sizeof(*queue));
+	if (!indeg || !first || !adj || !queue)
+		goto Exit;
+
+	for (i = 0; i < s->size; i++) {
+		if (!s->slots[i])
+			continue;
+		from = (s->slots[i] - 1) >> 32;
+		to = (s->slots[i] - 1) & 0xFFFFFFFF;
+		first[from + 1]++;
+		indeg[to]++;
+	}
+	for (i = 0; i < num_nodes; i++)
+		first[i + 1] += first[i];
+	/* queue serves as insertion cursor while filling the adjacency */
+	for (i = 0; i < num_nodes; i++)
+		queue[i] = first[i];
+	for (i = 0; i < s->size; i++) {
+		if (!s->slots[i])
+			continue;
+		from = (s->slots[i] - 1) >> 32;
+		to = (s->slots[i] - 1) & 0xFFFFFFFF;
+		adj[queue[from]++] = (uint32_t) to;
+	}
+
+	for (i = 0; i < num_nodes; i++) {
+		if (first[i + 1] == first[i] && !indeg[i])
+			continue;
+		used++;
+		if (!indeg[i])
+			queue[tail++] = (uint32_t) i;
+	}
+	while (head < tail) {
+		from = queue[head++];
+		visited++;
+		for (i = first[from]; i < first[from + 1]; i++)
+			if (!--indeg[adj[i]])
+				queue[tail++] = adj[i];
+	}
+	rc = (visited == used);
+Exit:
+	free(indeg);
+	free(first);
+	free(adj);
+	free(queue);
+	return rc;
+}
+
+/* VL of a hop; the SL2VL table of every (switch, in port, out port) is
+   requested from the engine once, like the QoS manager does */
+static uint8_t bench_hop_vl(struct osm_routing_engine *re, bench_node_t * n,
+			    uint64_t stride, uint64_t * sl2vl_tbl,
+			    uint8_t * sl2vl_valid, uint8_t in_port,
+			    uint8_t out_port, uint8_t sl)
+{
+	uint64_t idx = (n->sw_rank * stride + in_port) * stride + out_port;
+	ib_slvl_table_t sl2vl;
+	uint8_t i;
+
+	if (!re->update_sl2vl)
+		return sl < 15 ? sl : 0;
+
+	if (!sl2vl_valid[idx]) {
+		for (i = 0; i < IB_MAX_NUM_VLS; i++)
+			ib_slvl_table_set(&sl2vl, i, i < 15 ? i : 0);
+		re->update_sl2vl(re->context,
+				 osm_node_get_physp_ptr(n->p_node, out_port),
+				 in_port, out_port, &sl2vl);
+		sl2vl_tbl[idx] = 0;
+		for (i = 0; i < IB_MAX_NUM_VLS; i++)
+			sl2vl_tbl[idx] |= (uint64_t) (ib_slvl_table_get(&sl2vl, i)
+						      & 0x0F) << (4 * i);
+		sl2vl_valid[idx] = 1;
+	}
+	return (uint8_t) ((sl2vl_tbl[idx] >> (4 * sl)) & 0x0F);
+}
+
+/* follow the LFTs from every source port to every destination lid */
+static int bench_analyze(osm_opensm_t * osm, bench_topo_t * t,
+			 struct osm_routing_engine *re,
+			 const bench_opts_t * o, bench_result_t * res)
+{
+	uint64_t *load = NULL, *sl2vl_tbl = NULL, ch, prev_ch, stride;
+	uint64_t num_channels;
+	uint8_t *sl2vl_valid = NULL;
+	bench_edge_set_t edges = { NULL, 0, 0 };
+	uint32_t src, cur, next, num_src, step, hops, src_cnt = 0;
+	uint16_t slid, dlid;
+	uint8_t sl, vl, prev_vl = 0, in_port, out_port, src_port;
+	boolean_t end_to_end = t->num_cas > 0;
+	bench_node_t *n;
+	osm_switch_t *p_sw;
+	int rc = -1;
+
+	stride = (uint64_t) t->max_sw_ports + 1;
+	num_channels = t->num_switches * stride;
+	load = calloc(num_channels, sizeof(*load));
+	sl2vl_tbl = malloc(num_channels * stride * sizeof(*sl2vl_tbl));
+	sl2vl_valid = calloc(num_channels * stride, 1);
+	if (!load || !sl2vl_tbl || !sl2vl_valid)
+		goto Exit;
+
+	num_src = end_to_end ? t->num_cas : t->num_switches;
+	step = (o->max_sources && o->max_sources < num_src) ?
+	    num_src / o->max_sources : 1;
+
+	for (src = 0; src < t->num_nodes; src++) {
+		n = &t->nodes[src];
+		if ((n->type == IB_NODE_TYPE_SWITCH) == end_to_end)
+			continue;
+		if (src_cnt++ % step)
+			continue;
+		for (src_port = n->type == IB_NODE_TYPE_SWITCH ? 0 : 1;
+		     src_port <= (n->type == IB_NODE_TYPE_SWITCH ? 0 :
+				  n->num_ports); src_port++) {
+			if (n->type != IB_NODE_TYPE_SWITCH &&
+			    n->peer[src_port] == BENCH_NO_PEER)
+				continue;
+			slid = n->lid[src_port];
+			for (dlid = 1; dlid <= t->max_lid; dlid++) {
+				next = t->lid_node[dlid];
+				if (next == BENCH_NO_PEER || next == src ||
+				    (t->nodes[next].type ==
+				     IB_NODE_TYPE_SWITCH) == end_to_end)
+					continue;
+
+				res->pairs++;
+				sl = re->path_sl ?
+				    re->path_sl(re->context, 0,
+						cl_hton16(slid),
+						cl_hton16(dlid)) : 0;
+				sl &= 0x0F;
+				if (n->type == IB_NODE_TYPE_SWITCH) {
+					cur = src;
+					in_port = 0;
+				} else {
+					cur = n->peer[src_port];
+					in_port = n->peer_port[src_port];
+				}
+				prev_ch = num_channels;
+				for (hops = 0; hops <= t->num_switches;
+				     hops++) {
+					if (t->nodes[cur].type !=
+					    IB_NODE_TYPE_SWITCH)
+						break;
+					if (t->lid_node[dlid] == cur)
+						break;
+					p_sw = t->nodes[cur].p_node->sw;
+					out_port = dlid < p_sw->lft_size ?
+					    p_sw->new_lft[dlid] : OSM_NO_PATH;
+					if (out_port == OSM_NO_PATH ||
+					    out_port > t->nodes[cur].num_ports ||
+					    t->nodes[cur].peer[out_port] ==
+					    BENCH_NO_PEER)
+						break;
+					vl = bench_hop_vl(re, &t->nodes[cur],
+							  stride, sl2vl_tbl,
+							  sl2vl_valid, in_port,
+							  out_port, sl);
+					res->vl_mask |= (uint16_t) (1 << vl);
+					ch = t->nodes[cur].sw_rank * stride +
+					    out_port;
+					load[ch]++;
+					if (prev_ch != num_channels &&
+					    bench_edge_set_insert(&edges,
+						BENCH_CDG_EDGE(prev_ch, prev_vl,
+							       ch, vl)))
+						goto Exit;
+					prev_ch = ch;
+					prev_vl = vl;
+					next = t->nodes[cur].peer[out_port];
+					in_port =
+					    t->nodes[cur].peer_port[out_port];
+					cur = next;
+				}
+				if (cur != t->lid_node[dlid] ||
+				    (t->nodes[cur].type != IB_NODE_TYPE_SWITCH
+				     && in_port != t->lid_port[dlid]))
+					res->broken++;
+				else
+					res->sum_hops += hops;
+			}
+		}
+	}
+
+	for (cur = 0; cur < t->num_nodes; cur++) {
+		n = &t->nodes[cur];
+		if (n->type != IB_NODE_TYPE_SWITCH)
+			continue;
+		for (out_port = 1; out_port <= n->num_ports; out_port++) {
+			if (n->peer[out_port] == BENCH_NO_PEER)
+				continue;
+			ch = n->sw_rank * stride + out_port;
+			res->num_channels++;
+			res->sum_load += load[ch];
+			if (load[ch] > res->max_load)
+				res->max_load = load[ch];
+		}
+	}
+
+	res->deadlock_free = bench_cdg_is_acyclic(&edges,
+						  num_channels * BENCH_NUM_VLS);
+	if (res->deadlock_free < 0)
+		goto Exit;
+	rc = 0;
+Exit:
+	free(load);
+	free(sl2vl_tbl);
+	free(sl2vl_valid);
+	free(edges.slots);
+	return rc;
+}
+
+static const bench_engine_module_t *bench_find_engine(const char *name)
+{
+	const bench_engine_module_t *m;
+
+	for (m = bench_engines; m->name; m++)
+		if (!strcasecmp(m->name, name))
+			return m;
+	return NULL;
+}
+
+static void bench_print_header(void)
+{
+	printf("%-12s %-6s %11s %11s %10s %10s %10s %8s %3s %-8s %8s\n",
+	       "engine", "status", "lid_mat_ms", "fwd_tbl_ms", "rss_kb",
+	       "max_load", "avg_load", "avg_hops", "vls", "dl_free",
+	       "broken");
+}
+
+static void bench_print_result(const char *name, const char *status,
+			       const bench_result_t * res)
+{
+	unsigned vls = 0, i;
+	uint64_t ok = res->pairs - res->broken;
+
+	for (i = 0; i < BENCH_NUM_VLS; i++)
+		if (res->vl_mask & (1 << i))
+			vls++;
+	printf("%-12s %-6s %11.1f %11.1f %10ld %10" PRIu64
+	       " %10.1f %8.2f %3u %-8s %8" PRIu64 "\n", name, status,
+	       res->lid_matrices_ms, res->fwd_tables_ms, res->peak_rss_kb,
+	       res->max_load,
+	       res->num_channels ?
+	       (double)res->sum_load / res->num_channels : 0.0,
+	       ok ? (double)res->sum_hops / ok : 0.0, vls,
+	       res->deadlock_free ? "yes" : "no", res->broken);
+}
+
+static int bench_run_engine(osm_opensm_t * osm, bench_topo_t * t,
+			    const bench_opts_t * o, const char *name)
+{
+	const bench_engine_module_t *m = bench_find_engine(name);
+	osm_ucast_mgr_t *p_mgr = &osm->sm.ucast_mgr;
+	struct osm_routing_engine re;
+	bench_result_t res;
+	osm_switch_t *p_sw;
+	struct rusage usage;
+	uint64_t start;
+	uint16_t lids;
+	boolean_t qos;
+	int ret;
+
+	memset(&res, 0, sizeof(res));
+	if (!m) {
+		fprintf(stderr, "unknown routing engine \'%s\'\n", name);
+		bench_print_result(name, "FAIL", &res);
+		return -1;
+	}
+
+	memset(&re, 0, sizeof(re));
+	re.name = m->name;
+	re.type = osm_routing_engine_type(m->name);
+	if (m->setup(&re, osm)) {
+		bench_print_result(name, "FAIL", &res);
+		return -1;
+	}
+
+	/* same preparation as osm_ucast_mgr_process */
+	lids = (uint16_t) cl_ptr_vector_get_size(&osm->subn.port_lid_tbl);
+	lids = lids ? lids - 1 : 0;
+	for (p_sw = (osm_switch_t *) cl_qmap_head(&osm->subn.sw_guid_tbl);
+	     p_sw != (osm_switch_t *) cl_qmap_end(&osm->subn.sw_guid_tbl);
+	     p_sw = (osm_switch_t *) cl_qmap_next(&p_sw->map_item))
+		if (osm_switch_prepare_path_rebuild(p_sw, lids)) {
+			bench_print_result(name, "FAIL", &res);
+			return -1;
+		}
+	if (osm->subn.opt.scatter_ports)
+		srandom(osm->subn.opt.scatter_ports);
+	/* torus-2QoS refuses to route without QoS, and the SL lookup of
+	   some engines checks which engine is in use */
+	qos = osm->subn.opt.qos;
+	if (re.type == OSM_ROUTING_ENGINE_TYPE_TORUS_2QOS)
+		osm->subn.opt.qos = TRUE;
+	osm->routing_engine_used = &re;
+
+	start = cl_get_time_stamp();
+	if (!re.build_lid_matrices ||
+	    (ret = re.build_lid_matrices(re.context)) > 0)
+		ret = osm_ucast_mgr_build_lid_matrices(p_mgr);
+	res.lid_matrices_ms = (cl_get_time_stamp() - start) / 1000.0;
+	if (ret < 0)
+		goto Fail;
+
+	start = cl_get_time_stamp();
+	if (!re.ucast_build_fwd_tables ||
+	    (ret = re.ucast_build_fwd_tables(re.context)) > 0)
+		ret = osm_ucast_mgr_build_lfts(p_mgr);
+	res.fwd_tables_ms = (cl_get_time_stamp() - start) / 1000.0;
+	if (ret < 0)
+		goto Fail;
+
+	getrusage(RUSAGE_SELF, &usage);
+	res.peak_rss_kb = usage.ru_maxrss;
+
+	if (bench_analyze(osm, t, &re, o, &res))
+		goto Fail;
+	ret = res.broken ? -1 : 0;
+	bench_print_result(name, ret ? "BROKEN" : "OK", &res);
+	goto Exit;
+
+Fail:
+	ret = -1;
+	bench_print_result(name, "FAIL", &res);
+Exit:
+	osm->routing_engine_used = NULL;
+	osm->subn.opt.qos = qos;
+	if (re.destroy)
+		re.destroy(re.context);
+	return ret;
+}
+
+static void show_usage(void)
+{
+	printf("\n------- osm_routing_bench - Usage and options ----------------------\n");
+	printf("Usage:   osm_routing_bench [options]\n");
+	printf("Options:\n");
+	printf("--topology, -t <type>:<args>\n"
+	       "          Topology to route. Supported types:\n"
+	       "             slimfly:<q>          Slim Fly MMS graph, q prime\n"
+	       "             dragonfly:<a>,<h>    a routers per group, h global\n"
+	       "                                  links per router\n"
+	       "             fattree:<k>,<n>      k-ary n-tree\n"
+	       "             torus:<X>x<Y>x<Z>    3D torus\n"
+	       "             hyperx:<S1>x<S2>...  HyperX\n"
+	       "             random:<n>,<d>       random d-regular graph\n"
+	       "             file:<path>          ibnetdiscover output\n\n");
+	printf("--routing_engine, -R <engine list>\n"
+	       "          Comma separated list of routing engines to run\n"
+	       "          one after the other (default: "
+	       BENCH_DEFAULT_ENGINES ").\n\n");
+	printf("--terminals, -p <num>\n"
+	       "          Number of end ports per switch of the generated\n"
+	       "          topologies. Defaults to a topology specific value.\n\n");
+	printf("--config, -F <file>\n"
+	       "          OpenSM config file with the routing options\n\n");
+	printf("--lmc, -l <lmc>\n"
+	       "          LMC of the end ports (overrides the config file)\n\n");
+	printf("--max_op_vls <num>\n"
+	       "          OpVLs of all ports, encoded like the max_op_vls\n"
+	       "          option of OpenSM (default: from the config file)\n\n");
+	printf("--sources, -s <num>\n"
+	       "          Only trace the paths of about <num> evenly\n"
+	       "          spread source ports (default: all)\n\n");
+	printf("--seed <num>\n"
+	       "          Seed of the random topology generator\n\n");
+	printf("--no_fork\n"
+	       "          Run all engines in this process; by default each\n"
+	       "          engine runs in its own process to get a separate\n"
+	       "          peak RSS\n\n");
+	printf("--log_file, -f <file>\n"
+	       "          Log file of the routing engines (default: stderr)\n\n");
+	printf("--debug, -D <flags>\n"
+	       "          Log flags of the routing engines (default: 0x1)\n\n");
+	printf("--help, -h, -?\n" "          Display this usage info.\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *const short_option = "t:R:p:F:l:s:f:D:h?";
+	const struct option long_option[] = {
+		{"topology", 1, NULL, 't'},
+		{"routing_engine", 1, NULL, 'R'},
+		{"terminals", 1, NULL, 'p'},
+		{"config", 1, NULL, 'F'},
+		{"lmc", 1, NULL, 'l'},
+		{"max_op_vls", 1, NULL, 1},
+		{"sources", 1, NULL, 's'},
+		{"seed", 1, NULL, 2},
+		{"no_fork", 0, NULL, 3},
+		{"log_file", 1, NULL, 'f'},
+		{"debug", 1, NULL, 'D'},
+		{"help", 0, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	osm_opensm_t *osm;
+	osm_subn_opt_t opt;
+	bench_opts_t o;
+	bench_topo_t topo;
+	char *engines, *name, *p, *torus_conf = NULL;
+	int next_option, failed = 0, status;
+	struct rusage usage;
+	uint64_t start;
+	pid_t pid;
+
+	memset(&o, 0, sizeof(o));
+	o.engines = BENCH_DEFAULT_ENGINES;
+	o.terminals = -1;
+	o.lmc = -1;
+	o.op_vls = -1;
+	o.seed = 1;
+	o.log_file = "stderr";
+	o.log_flags = OSM_LOG_ERROR;
+	o.fork_engines = TRUE;
+
+	do {
+		next_option = getopt_long_only(argc, argv, short_option,
+					       long_option, NULL);
+		switch (next_option) {
+		case 't':
+			o.topology = optarg;
+			break;
+		case 'R':
+			o.engines = optarg;
+			break;
+		case 'p':
+			o.terminals = atoi(optarg);
+			break;
+		case 'F':
+			o.config_file = optarg;
+			break;
+		case 'l':
+			o.lmc = atoi(optarg);
+			if (o.lmc < 0 || o.lmc > 7) {
+				fprintf(stderr, "LMC must be 7 or less\n");
+				return -1;
+			}
+			break;
+		case 1:
+			o.op_vls = atoi(optarg);
+			break;
+		case 's':
+			o.max_sources = strtoul(optarg, NULL, 0);
+			break;
+		case 2:
+			o.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 3:
+			o.fork_engines = FALSE;
+			break;
+		case 'f':
+			o.log_file = optarg;
+			break;
+		case 'D':
+			o.log_flags = (uint8_t) strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+		case '?':
+			show_usage();
+			break;
+		case -1:
+			break;
+		default:
+			show_usage();
+		}
+	} while (next_option != -1);
+
+	if (!o.topology)
+		show_usage();
+
+	osm_subn_set_default_opt(&opt);
+	if (o.config_file && osm_subn_parse_conf_file(o.config_file, &opt)) {
+		fprintf(stderr, "cannot parse config file \'%s\'\n",
+			o.config_file);
+		return -1;
+	}
+	if (o.lmc >= 0)
+		opt.lmc = (uint8_t) o.lmc;
+	if (o.op_vls > 0)
+		opt.max_op_vls = (uint8_t) o.op_vls;
+
+	start = cl_get_time_stamp();
+	if (bench_create_topology(&topo, &o))
+		return -1;
+	if (topo.torus_dims[0] &&
+	    (!opt.torus_conf_file || access(opt.torus_conf_file, R_OK))) {
+		torus_conf = bench_write_torus_conf(&topo);
+		if (torus_conf) {
+			free(opt.torus_conf_file);
+			opt.torus_conf_file = strdup(torus_conf);
+		}
+	}
+
+	osm = malloc(sizeof(*osm));
+	if (!osm || bench_init_osm(osm, &opt, &o) ||
+	    bench_build_subnet(osm, &topo)) {
+		fprintf(stderr, "cannot build the subnet\n");
+		return -1;
+	}
+
+	getrusage(RUSAGE_SELF, &usage);
+	printf("topology %s: %u switches, %u end nodes, %u links, "
+	       "max lid %u, built in %.1f ms, rss %ld kb\n", o.topology,
+	       topo.num_switches, topo.num_cas, topo.num_links,
+	       topo.max_lid, (cl_get_time_stamp() - start) / 1000.0,
+	       usage.ru_maxrss);
+	bench_print_header();
+
+	engines = strdup(o.engines);
+	for (name = strtok_r(engines, ", \t\n", &p); name;
+	     name = strtok_r(NULL, ", \t\n", &p)) {
+		fflush(stdout);
+		pid = o.fork_engines ? fork() : -1;
+		if (pid == 0) {
+			status = bench_run_engine(osm, &topo, &o, name);
+			fflush(stdout);
+			_exit(status ? 1 : 0);
+		} else if (pid > 0) {
+			if (waitpid(pid, &status, 0) < 0 ||
+			    !WIFEXITED(status) || WEXITSTATUS(status)) {
+				if (!WIFEXITED(status))
+					printf("%-12s %-6s\n", name, "CRASH");
+				failed++;
+			}
+		} else if (bench_run_engine(osm, &topo, &o, name))
+			failed++;
+	}
+	free(engines);
+
+	if (torus_conf) {
+		unlink(torus_conf);
+		free(torus_conf);
+	}
+	osm_ucast_mgr_destroy(&osm->sm.ucast_mgr);
+	osm_subn_destroy(&osm->subn);
+	cl_plock_destroy(&osm->lock);
+	osm_log_destroy(&osm->log);
+	free(osm);
+	bench_topo_destroy(&topo);
+
+	return failed ? 1 : 0;
+}
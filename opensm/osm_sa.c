@@ -101,6 +101,11 @@ void osm_sa_construct(IN osm_sa_t * p_sa)
 	p_sa->sa_trans_id = OSM_SA_INITIAL_TID_VALUE;
 
 	cl_timer_construct(&p_sa->sr_timer);
+	cl_spinlock_construct(&p_sa->pr_cache.lock);
+	cl_spinlock_construct(&p_sa->cache.lock);
+	cl_qmap_init(&p_sa->cache.map);
+	cl_qlist_init(&p_sa->cache.lru);
+	cl_spinlock_construct(&p_sa->snapshot_lock);
 }
 
 void osm_sa_shutdown(IN osm_sa_t * p_sa)
@@ -153,6 +158,18 @@ void osm_sa_destroy(IN osm_sa_t * p_sa)
 
 	cl_timer_destroy(&p_sa->sr_timer);
 
+	osm_sa_pr_cache_flush(p_sa);
+	cl_spinlock_destroy(&p_sa->pr_cache.lock);
+
+	osm_sa_cache_invalidate(p_sa);
+	cl_spinlock_destroy(&p_sa->cache.lock);
+
+	if (p_sa->p_snapshot) {
+		osm_sa_snapshot_put(p_sa->p_snapshot);
+		p_sa->p_snapshot = NULL;
+	}
+	cl_spinlock_destroy(&p_sa->snapshot_lock);
+
 	OSM_LOG_EXIT(p_sa->p_log);
 }
 
@@ -189,6 +206,18 @@ ib_api_status_t osm_sa_init(IN osm_sm_t * p_sm, IN osm_sa_t * p_sa,
 	if (status != IB_SUCCESS)
 		goto Exit;
 
+	status = cl_spinlock_init(&p_sa->pr_cache.lock);
+	if (status != IB_SUCCESS)
+		goto Exit;
+
+	status = cl_spinlock_init(&p_sa->cache.lock);
+	if (status != IB_SUCCESS)
+		goto Exit;
+
+	status = cl_spinlock_init(&p_sa->snapshot_lock);
+	if (status != IB_SUCCESS)
+		goto Exit;
+
 	status = IB_INSUFFICIENT_RESOURCES;
 	p_sa->cpi_disp_h = cl_disp_register(p_disp, OSM_MSG_MAD_CLASS_PORT_INFO,
 					    osm_cpi_rcv_process, p_sa);
@@ -419,20 +448,23 @@ Exit:
 	OSM_LOG_EXIT(sa->p_log);
 }
 
-void osm_sa_respond(osm_sa_t *sa, osm_madw_t *madw, size_t attr_size,
-		    cl_qlist_t *list)
+/*
+ * Sends the SA response with num_rec records, taken either from the
+ * list of items or from the back to back records in recs
+ */
+static void sa_respond(osm_sa_t *sa, osm_madw_t *madw, size_t attr_size,
+		       unsigned num_rec, cl_qlist_t *list, const uint8_t *recs)
 {
 	cl_list_item_t *item;
 	osm_madw_t *resp_madw;
 	ib_sa_mad_t *sa_mad, *resp_sa_mad;
-	unsigned num_rec, i;
+	unsigned i;
 #ifndef VENDOR_RMPP_SUPPORT
 	unsigned trim_num_rec;
 #endif
 	unsigned char *p;
 
 	sa_mad = osm_madw_get_sa_mad_ptr(madw);
-	num_rec = cl_qlist_count(list);
 
 	/*
 	 * C15-0.1.30:
@@ -514,17 +546,23 @@ void osm_sa_respond(osm_sa_t *sa, osm_madw_t *madw, size_t attr_size,
 		resp_sa_mad->rmpp_flags = IB_RMPP_FLAG_ACTIVE;
 #endif
 
-	for (i = 0; i < num_rec; i++) {
-		item = cl_qlist_remove_head(list);
-		memcpy(p, ((osm_sa_item_t *)item)->resp.data, attr_size);
-		p += attr_size;
-		free(item);
-	}
+	if (recs)
+		memcpy(p, recs, num_rec * attr_size);
+	else
+		for (i = 0; i < num_rec; i++) {
+			item = cl_qlist_remove_head(list);
+			memcpy(p, ((osm_sa_item_t *)item)->resp.data,
+			       attr_size);
+			p += attr_size;
+			free(item);
+		}
 
 	osm_dump_sa_mad_v2(sa->p_log, resp_sa_mad, FILE_ID, OSM_LOG_FRAMES);
 	osm_sa_send(sa, resp_madw, FALSE);
 
 Exit:
+	if (!list)
+		return;
 	/* need to set the mem free ... */
 	item = cl_qlist_remove_head(list);
 	while (item != cl_qlist_end(list)) {
@@ -533,6 +571,366 @@ Exit:
 	}
 }
 
+void osm_sa_respond(osm_sa_t *sa, osm_madw_t *madw, size_t attr_size,
+		    cl_qlist_t *list)
+{
+	sa_respond(sa, madw, attr_size, cl_qlist_count(list), list, NULL);
+}
+
+void *osm_sa_resp_add(IN osm_sa_resp_t * resp)
+{
+	uint8_t *recs, *rec;
+	unsigned max_rec;
+
+	if (resp->num_rec == resp->max_rec) {
+		/* start with what fits in a single MAD */
+		max_rec = resp->max_rec ? 2 * resp->max_rec :
+		    (MAD_BLOCK_SIZE - IB_SA_MAD_HDR_SIZE) / resp->attr_size;
+		if (!max_rec)
+			max_rec = 1;
+		recs = realloc(resp->recs, max_rec * resp->attr_size);
+		if (!recs)
+			return NULL;
+		resp->recs = recs;
+		resp->max_rec = max_rec;
+	}
+
+	rec = resp->recs + resp->num_rec++ * resp->attr_size;
+	memset(rec, 0, resp->attr_size);
+	return rec;
+}
+
+void osm_sa_resp_destroy(IN osm_sa_resp_t * resp)
+{
+	free(resp->recs);
+	resp->recs = NULL;
+	resp->num_rec = resp->max_rec = 0;
+}
+
+void osm_sa_resp_send(IN osm_sa_t * sa, IN osm_madw_t * madw,
+		      IN osm_sa_resp_t * resp)
+{
+	sa_respond(sa, madw, resp->attr_size, resp->num_rec, NULL,
+		   resp->recs);
+	osm_sa_resp_destroy(resp);
+}
+
+/*
+ *  PathRecord path parameter cache
+ */
+
+uint32_t osm_sa_pr_cache_get(IN osm_sa_t * sa, IN uint16_t sw_lid_ho,
+			     IN uint16_t dlid_ho)
+{
+	osm_sa_pr_cache_t *c = &sa->pr_cache;
+	uint32_t entry = 0;
+
+	cl_spinlock_acquire(&c->lock);
+	if (sw_lid_ho < c->num_rows && dlid_ho < c->row_len &&
+	    c->rows[sw_lid_ho])
+		entry = c->rows[sw_lid_ho][dlid_ho];
+	cl_spinlock_release(&c->lock);
+
+	return entry;
+}
+
+void osm_sa_pr_cache_set(IN osm_sa_t * sa, IN uint16_t sw_lid_ho,
+			 IN uint16_t dlid_ho, IN uint32_t entry)
+{
+	osm_sa_pr_cache_t *c = &sa->pr_cache;
+
+	cl_spinlock_acquire(&c->lock);
+	if (!c->rows) {
+		c->num_rows = c->row_len = sa->p_subn->max_ucast_lid_ho + 1;
+		c->rows = calloc(c->num_rows, sizeof(*c->rows));
+		if (!c->rows) {
+			c->num_rows = c->row_len = 0;
+			goto Exit;
+		}
+	}
+	if (sw_lid_ho >= c->num_rows || dlid_ho >= c->row_len)
+		goto Exit;
+	if (!c->rows[sw_lid_ho]) {
+		c->rows[sw_lid_ho] = calloc(c->row_len, sizeof(**c->rows));
+		if (!c->rows[sw_lid_ho])
+			goto Exit;
+	}
+	c->rows[sw_lid_ho][dlid_ho] = entry;
+Exit:
+	cl_spinlock_release(&c->lock);
+}
+
+void osm_sa_pr_cache_invalidate(IN osm_sa_t * sa, IN uint16_t lid_lo_ho,
+				IN uint16_t lid_hi_ho)
+{
+	osm_sa_pr_cache_t *c = &sa->pr_cache;
+	unsigned i;
+
+	/* not initialized, e.g. in the offline routing benchmark */
+	if (c->lock.state != CL_INITIALIZED)
+		return;
+
+	cl_spinlock_acquire(&c->lock);
+	if (!c->rows || lid_lo_ho >= c->row_len)
+		goto Exit;
+	if (lid_hi_ho >= c->row_len)
+		lid_hi_ho = c->row_len - 1;
+	for (i = 0; i < c->num_rows; i++)
+		if (c->rows[i] && lid_lo_ho <= lid_hi_ho)
+			memset(&c->rows[i][lid_lo_ho], 0,
+			       (lid_hi_ho - lid_lo_ho + 1) * sizeof(**c->rows));
+Exit:
+	cl_spinlock_release(&c->lock);
+}
+
+void osm_sa_pr_cache_flush(IN osm_sa_t * sa)
+{
+	osm_sa_pr_cache_t *c = &sa->pr_cache;
+	unsigned i;
+
+	if (c->lock.state != CL_INITIALIZED)
+		return;
+
+	cl_spinlock_acquire(&c->lock);
+	if (c->rows) {
+		for (i = 0; i < c->num_rows; i++)
+			free(c->rows[i]);
+		free(c->rows);
+		c->rows = NULL;
+		c->num_rows = c->row_len = 0;
+	}
+	cl_spinlock_release(&c->lock);
+}
+
+/*
+ *  SA response cache
+ */
+
+typedef struct sa_cache_entry {
+	cl_map_item_t map_item;
+	cl_list_item_t lru_item;
+	size_t key_len;
+	uint8_t *key;
+	unsigned num_rec;
+	uint8_t *recs;
+} sa_cache_entry_t;
+
+static void sa_cache_remove(IN osm_sa_cache_t * c, IN sa_cache_entry_t * e)
+{
+	cl_qmap_remove_item(&c->map, &e->map_item);
+	cl_qlist_remove_item(&c->lru, &e->lru_item);
+	free(e);
+}
+
+static void sa_cache_flush(IN osm_sa_cache_t * c)
+{
+	while (cl_qlist_count(&c->lru))
+		sa_cache_remove(c, PARENT_STRUCT(cl_qlist_head(&c->lru),
+						 sa_cache_entry_t, lru_item));
+}
+
+void osm_sa_cache_req_init(IN osm_sa_t * sa, OUT osm_sa_cache_req_t * req,
+			   IN const ib_sa_mad_t * sa_mad, IN size_t attr_size)
+{
+	req->cacheable = sa->p_subn->opt.sa_cache_size &&
+	    sa_mad->method == IB_MAD_METHOD_GETTABLE &&
+	    attr_size <= MAD_BLOCK_SIZE - IB_SA_MAD_HDR_SIZE;
+	req->full_member = FALSE;
+	req->num_pkeys = 0;
+	req->generation = 0;
+	req->hash = 0;
+	req->key_len = 0;
+	if (!req->cacheable)
+		return;
+
+	memcpy(req->key, &sa_mad->attr_id, sizeof(sa_mad->attr_id));
+	req->key_len += sizeof(sa_mad->attr_id);
+	req->key[req->key_len++] = sa_mad->method;
+	req->key[req->key_len++] = sa_mad->sm_key != 0;
+	memcpy(req->key + req->key_len, &sa_mad->attr_mod,
+	       sizeof(sa_mad->attr_mod));
+	req->key_len += sizeof(sa_mad->attr_mod);
+	memcpy(req->key + req->key_len, &sa_mad->comp_mask,
+	       sizeof(sa_mad->comp_mask));
+	req->key_len += sizeof(sa_mad->comp_mask);
+	memcpy(req->key + req->key_len, ib_sa_mad_get_payload_ptr(sa_mad),
+	       attr_size);
+	req->key_len += attr_size;
+}
+
+void osm_sa_cache_req_add_physp(IN OUT osm_sa_cache_req_t * req,
+				IN const osm_physp_t * p_physp)
+{
+	const osm_pkey_tbl_t *p_tbl = osm_physp_get_pkey_tbl(p_physp);
+	cl_map_iterator_t i;
+
+	if (!req->cacheable)
+		return;
+
+	for (i = cl_map_head(&p_tbl->keys); i != cl_map_end(&p_tbl->keys);
+	     i = cl_map_next(i))
+		osm_sa_cache_req_add_pkey(req,
+					  cl_ntoh16(*(ib_net16_t *)
+						    cl_map_obj(i)));
+}
+
+boolean_t osm_sa_cache_get(IN osm_sa_t * sa, IN osm_sa_cache_req_t * req,
+			   IN OUT osm_sa_resp_t * resp)
+{
+	osm_sa_cache_t *c = &sa->cache;
+	sa_cache_entry_t *e;
+	uint8_t *recs;
+	size_t i;
+	boolean_t hit = FALSE;
+
+	/*
+	 * A port sees itself even if it has no full membership PKey, so
+	 * then the response depends on the requester, not only its PKeys
+	 */
+	if (req->num_pkeys && !req->full_member)
+		req->cacheable = FALSE;
+	if (!req->cacheable)
+		return FALSE;
+
+	/* FNV-1a */
+	req->hash = 0xcbf29ce484222325ULL;
+	for (i = 0; i < req->key_len; i++) {
+		req->hash ^= req->key[i];
+		req->hash *= 0x100000001b3ULL;
+	}
+
+	cl_spinlock_acquire(&c->lock);
+	req->generation = c->generation;
+	if (c->generation & 1) {
+		/* a sweep is running */
+		req->cacheable = FALSE;
+		goto Exit;
+	}
+
+	e = (sa_cache_entry_t *) cl_qmap_get(&c->map, req->hash);
+	if (e == (sa_cache_entry_t *) cl_qmap_end(&c->map) ||
+	    e->key_len != req->key_len ||
+	    memcmp(e->key, req->key, req->key_len)) {
+		c->misses++;
+		goto Exit;
+	}
+
+	if (e->num_rec) {
+		recs = malloc(e->num_rec * resp->attr_size);
+		if (!recs) {
+			c->misses++;
+			goto Exit;
+		}
+		memcpy(recs, e->recs, e->num_rec * resp->attr_size);
+		resp->recs = recs;
+		resp->num_rec = resp->max_rec = e->num_rec;
+	}
+
+	cl_qlist_remove_item(&c->lru, &e->lru_item);
+	cl_qlist_insert_tail(&c->lru, &e->lru_item);
+	c->hits++;
+	hit = TRUE;
+Exit:
+	cl_spinlock_release(&c->lock);
+	return hit;
+}
+
+void osm_sa_cache_put(IN osm_sa_t * sa, IN const osm_sa_cache_req_t * req,
+		      IN const osm_sa_resp_t * resp)
+{
+	osm_sa_cache_t *c = &sa->cache;
+	sa_cache_entry_t *e, *old;
+	size_t recs_size;
+
+	if (!req->cacheable)
+		return;
+
+	recs_size = resp->num_rec * resp->attr_size;
+	e = malloc(sizeof(*e) + req->key_len + recs_size);
+	if (!e)
+		return;
+	e->key_len = req->key_len;
+	e->key = (uint8_t *) (e + 1);
+	memcpy(e->key, req->key, req->key_len);
+	e->num_rec = resp->num_rec;
+	e->recs = e->key + req->key_len;
+	if (recs_size)
+		memcpy(e->recs, resp->recs, recs_size);
+
+	cl_spinlock_acquire(&c->lock);
+	/* the subnet changed while the response was built */
+	if (c->generation != req->generation) {
+		free(e);
+		goto Exit;
+	}
+
+	old = (sa_cache_entry_t *) cl_qmap_get(&c->map, req->hash);
+	if (old != (sa_cache_entry_t *) cl_qmap_end(&c->map))
+		sa_cache_remove(c, old);
+
+	while (cl_qlist_count(&c->lru) &&
+	       cl_qlist_count(&c->lru) >= sa->p_subn->opt.sa_cache_size)
+		sa_cache_remove(c, PARENT_STRUCT(cl_qlist_head(&c->lru),
+						 sa_cache_entry_t, lru_item));
+
+	cl_qmap_insert(&c->map, req->hash, &e->map_item);
+	cl_qlist_insert_tail(&c->lru, &e->lru_item);
+Exit:
+	cl_spinlock_release(&c->lock);
+}
+
+void osm_sa_cache_invalidate(IN osm_sa_t * sa)
+{
+	osm_sa_cache_t *c = &sa->cache;
+
+	/* not initialized, e.g. in the offline routing benchmark */
+	if (c->lock.state != CL_INITIALIZED)
+		return;
+
+	cl_spinlock_acquire(&c->lock);
+	sa_cache_flush(c);
+	c->generation += 2;
+	cl_spinlock_release(&c->lock);
+}
+
+void osm_sa_cache_sweep_start(IN osm_sa_t * sa)
+{
+	osm_sa_cache_t *c = &sa->cache;
+
+	if (c->lock.state != CL_INITIALIZED)
+		return;
+
+	cl_spinlock_acquire(&c->lock);
+	sa_cache_flush(c);
+	c->generation += (c->generation & 1) ? 2 : 1;
+	cl_spinlock_release(&c->lock);
+}
+
+void osm_sa_cache_sweep_done(IN osm_sa_t * sa)
+{
+	osm_sa_cache_t *c = &sa->cache;
+
+	if (c->lock.state != CL_INITIALIZED)
+		return;
+
+	cl_spinlock_acquire(&c->lock);
+	if (c->generation & 1)
+		c->generation++;
+	cl_spinlock_release(&c->lock);
+}
+
+void osm_sa_cache_get_stats(IN osm_sa_t * sa, OUT unsigned *p_num_entries,
+			    OUT uint64_t * p_hits, OUT uint64_t * p_misses)
+{
+	osm_sa_cache_t *c = &sa->cache;
+
+	cl_spinlock_acquire(&c->lock);
+	*p_num_entries = cl_qlist_count(&c->lru);
+	*p_hits = c->hits;
+	*p_misses = c->misses;
+	cl_spinlock_release(&c->lock);
+}
+
 /*
  *  SA DB Dumper
  *
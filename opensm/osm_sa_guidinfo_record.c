@@ -61,8 +61,6 @@
 #include <opensm/osm_pkey.h>
 #include <opensm/osm_sa.h>
 
-#define SA_GIR_RESP_SIZE SA_ITEM_RESP_SIZE(guid_rec)
-
 #define MOD_GIR_COMP_MASK (IB_GIR_COMPMASK_LID | IB_GIR_COMPMASK_BLOCKNUM)
 
 typedef struct osm_gir_item {
@@ -73,26 +71,26 @@ typedef struct osm_gir_item {
 typedef struct osm_gir_search_ctxt {
 	const ib_guidinfo_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	osm_sa_t *sa;
 	const osm_physp_t *p_req_physp;
 } osm_gir_search_ctxt_t;
 
 static ib_api_status_t gir_rcv_new_gir(IN osm_sa_t * sa,
 				       IN const osm_node_t * p_node,
-				       IN cl_qlist_t * p_list,
+				       IN osm_sa_resp_t * p_resp,
 				       IN ib_net64_t const match_port_guid,
 				       IN ib_net16_t const match_lid,
 				       IN const osm_physp_t * p_physp,
 				       IN uint8_t const block_num)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_guidinfo_record_t *p_rec;
 	ib_api_status_t status = IB_SUCCESS;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_GIR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 5102: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
@@ -103,18 +101,14 @@ static ib_api_status_t gir_rcv_new_gir(IN osm_sa_t * sa,
 		"New GUIDInfoRecord: lid %u, block num %d\n",
 		cl_ntoh16(match_lid), block_num);
 
-	memset(p_rec_item, 0, SA_GIR_RESP_SIZE);
-
-	p_rec_item->resp.guid_rec.lid = match_lid;
-	p_rec_item->resp.guid_rec.block_num = block_num;
+	p_rec->lid = match_lid;
+	p_rec->block_num = block_num;
 	if (p_physp->p_guids)
-		memcpy(&p_rec_item->resp.guid_rec.guid_info,
+		memcpy(&p_rec->guid_info,
 		       *p_physp->p_guids + block_num * GUID_TABLE_MAX_ENTRIES,
 		       sizeof(ib_guid_info_t));
 	else if (!block_num)
-		p_rec_item->resp.guid_rec.guid_info.guid[0] = osm_physp_get_port_guid(p_physp);
-
-	cl_qlist_insert_tail(p_list, &p_rec_item->list_item);
+		p_rec->guid_info.guid[0] = osm_physp_get_port_guid(p_physp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -122,7 +116,7 @@ Exit:
 }
 
 static void sa_gir_create_gir(IN osm_sa_t * sa, IN osm_node_t * p_node,
-			      IN cl_qlist_t * p_list,
+			      IN osm_sa_resp_t * p_resp,
 			      IN ib_net64_t const match_port_guid,
 			      IN ib_net16_t const match_lid,
 			      IN const osm_physp_t * p_req_physp,
@@ -211,7 +205,7 @@ static void sa_gir_create_gir(IN osm_sa_t * sa, IN osm_node_t * p_node,
 
 		for (block_num = start_block_num; block_num <= end_block_num;
 		     block_num++)
-			gir_rcv_new_gir(sa, p_node, p_list, port_guid,
+			gir_rcv_new_gir(sa, p_node, p_resp, port_guid,
 					cl_ntoh16(base_lid_ho), p_physp,
 					block_num);
 	}
@@ -284,7 +278,7 @@ static void sa_gir_by_comp_mask_cb(IN cl_map_item_t * p_map_item, IN void *cxt)
 			goto Exit;
 	}
 
-	sa_gir_create_gir(sa, p_node, p_ctxt->p_list, match_port_guid,
+	sa_gir_create_gir(sa, p_node, p_ctxt->p_resp, match_port_guid,
 			  match_lid, p_req_physp, match_block_num);
 
 Exit:
@@ -324,24 +318,23 @@ static uint8_t coalesce_comp_mask(IN osm_madw_t *p_madw)
 static void guidinfo_respond(IN osm_sa_t *sa, IN osm_madw_t *p_madw,
 			     IN ib_guidinfo_record_t * p_guidinfo_rec)
 {
-	cl_qlist_t rec_list;
-	osm_sa_item_t *item;
+	osm_sa_resp_t resp;
+	ib_guidinfo_record_t *p_rec;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	item = malloc(SA_GIR_RESP_SIZE);
-	if (!item) {
+	osm_sa_resp_init(&resp, sizeof(ib_guidinfo_record_t));
+
+	p_rec = osm_sa_resp_add(&resp);
+	if (!p_rec) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 5101: "
 			"rec_item alloc failed\n");
 		goto Exit;
 	}
 
-	item->resp.guid_rec = *p_guidinfo_rec;
-
-	cl_qlist_init(&rec_list);
-	cl_qlist_insert_tail(&rec_list, &item->list_item);
+	*p_rec = *p_guidinfo_rec;
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_guidinfo_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -721,17 +714,17 @@ static void get_guidinfo(IN osm_sa_t *sa, IN osm_madw_t *p_madw,
 {
 	const ib_sa_mad_t *p_rcvd_mad;
 	const ib_guidinfo_record_t *p_rcvd_rec;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
 	osm_gir_search_ctxt_t context;
 
 	p_rcvd_mad = osm_madw_get_sa_mad_ptr(p_madw);
 	p_rcvd_rec =
 	    (ib_guidinfo_record_t *) ib_sa_mad_get_payload_ptr(p_rcvd_mad);
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_guidinfo_record_t));
 
 	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
+	context.p_resp = &resp;
 	context.comp_mask = p_rcvd_mad->comp_mask;
 	context.sa = sa;
 	context.p_req_physp = p_req_physp;
@@ -742,7 +735,7 @@ static void get_guidinfo(IN osm_sa_t *sa, IN osm_madw_t *p_madw,
 
 	CL_PLOCK_RELEASE(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_guidinfo_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 }
 
 void osm_gir_rcv_process(IN void *ctx, IN void *data)
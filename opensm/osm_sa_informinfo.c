@@ -64,13 +64,10 @@
 #include <opensm/osm_inform.h>
 #include <opensm/osm_pkey.h>
 
-#define SA_IIR_RESP_SIZE SA_ITEM_RESP_SIZE(inform_rec)
-#define SA_II_RESP_SIZE SA_ITEM_RESP_SIZE(inform)
-
 typedef struct osm_iir_search_ctxt {
 	const ib_inform_info_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	ib_gid_t subscriber_gid;
 	ib_net16_t subscriber_enum;
 	osm_sa_t *sa;
@@ -207,29 +204,28 @@ Set(InformInfo) request.
 **********************************************************************/
 static void infr_rcv_respond(IN osm_sa_t * sa, IN osm_madw_t * p_madw)
 {
-	cl_qlist_t rec_list;
-	osm_sa_item_t *item;
+	osm_sa_resp_t resp;
+	ib_inform_info_t *p_rec;
 
 	OSM_LOG_ENTER(sa->p_log);
 
 	OSM_LOG(sa->p_log, OSM_LOG_DEBUG,
 		"Generating successful InformInfo response\n");
 
-	item = malloc(SA_II_RESP_SIZE);
-	if (!item) {
+	osm_sa_resp_init(&resp, sizeof(ib_inform_info_t));
+
+	p_rec = osm_sa_resp_add(&resp);
+	if (!p_rec) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 4303: "
 			"rec_item alloc failed\n");
 		goto Exit;
 	}
 
-	memcpy(&item->resp.inform,
+	memcpy(p_rec,
 	       ib_sa_mad_get_payload_ptr(osm_madw_get_sa_mad_ptr(p_madw)),
 	       sizeof(ib_inform_info_t));
 
-	cl_qlist_init(&rec_list);
-	cl_qlist_insert_tail(&rec_list, &item->list_item);
-
-	osm_sa_respond(sa, p_madw, sizeof(ib_inform_info_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -244,7 +240,7 @@ static void sa_inform_info_rec_by_comp_mask(IN osm_sa_t * sa,
 	osm_port_t *p_subscriber_port;
 	osm_physp_t *p_subscriber_physp;
 	const osm_physp_t *p_req_physp;
-	osm_sa_item_t *p_rec_item;
+	ib_inform_info_record_t *p_rec;
 
 	OSM_LOG_ENTER(sa->p_log);
 
@@ -284,15 +280,14 @@ static void sa_inform_info_rec_by_comp_mask(IN osm_sa_t * sa,
 		goto Exit;
 	}
 
-	p_rec_item = malloc(SA_IIR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_ctxt->p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 430E: "
 			"rec_item alloc failed\n");
 		goto Exit;
 	}
 
-	memcpy(&p_rec_item->resp.inform_rec, &p_infr->inform_record,
-	       sizeof(ib_inform_info_record_t));
+	memcpy(p_rec, &p_infr->inform_record, sizeof(ib_inform_info_record_t));
 
 	/*
 	 * Per C15-0.2-1.16, InformInfoRecords shall always be
@@ -301,9 +296,7 @@ static void sa_inform_info_rec_by_comp_mask(IN osm_sa_t * sa,
 	 * subscriber QPN shall be returned.
 	 */
 	if (p_ctxt->sm_key == 0)
-		ib_inform_info_set_qpn(&p_rec_item->resp.inform_rec.inform_info, 0);
-
-	cl_qlist_insert_tail(p_ctxt->p_list, &p_rec_item->list_item);
+		ib_inform_info_set_qpn(&p_rec->inform_info, 0);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -326,10 +319,11 @@ static void infr_rcv_process_get_method(osm_sa_t * sa, IN osm_madw_t * p_madw)
 	char gid_str[INET6_ADDRSTRLEN];
 	ib_sa_mad_t *p_rcvd_mad;
 	const ib_inform_info_record_t *p_rcvd_rec;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
 	osm_iir_search_ctxt_t context;
 	osm_physp_t *p_req_physp;
-	osm_sa_item_t *item;
+	ib_inform_info_record_t *p_rec;
+	unsigned i;
 
 	OSM_LOG_ENTER(sa->p_log);
 
@@ -359,10 +353,10 @@ static void infr_rcv_process_get_method(osm_sa_t * sa, IN osm_madw_t * p_madw)
 					       FILE_ID, OSM_LOG_DEBUG);
 	}
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_inform_info_record_t));
 
 	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
+	context.p_resp = &resp;
 	context.comp_mask = p_rcvd_mad->comp_mask;
 	context.subscriber_gid = p_rcvd_rec->subscriber_gid;
 	context.subscriber_enum = p_rcvd_rec->subscriber_enum;
@@ -382,16 +376,15 @@ static void infr_rcv_process_get_method(osm_sa_t * sa, IN osm_madw_t * p_madw)
 			    sa_inform_info_rec_by_comp_mask_cb, &context);
 
 	/* clear reserved and pad fields in InformInfoRecord */
-	for (item = (osm_sa_item_t *) cl_qlist_head(&rec_list);
-	     item != (osm_sa_item_t *) cl_qlist_end(&rec_list);
-	     item = (osm_sa_item_t *) cl_qlist_next(&item->list_item)) {
-		memset(item->resp.inform_rec.reserved, 0, sizeof(item->resp.inform_rec.reserved));
-		memset(item->resp.inform_rec.pad, 0, sizeof(item->resp.inform_rec.pad));
+	p_rec = (ib_inform_info_record_t *) resp.recs;
+	for (i = 0; i < resp.num_rec; i++) {
+		memset(p_rec[i].reserved, 0, sizeof(p_rec[i].reserved));
+		memset(p_rec[i].pad, 0, sizeof(p_rec[i].pad));
 	}
 
 	cl_plock_release(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_inform_info_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
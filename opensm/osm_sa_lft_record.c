@@ -57,28 +57,26 @@
 #include <opensm/osm_pkey.h>
 #include <opensm/osm_sa.h>
 
-#define SA_LFTR_RESP_SIZE SA_ITEM_RESP_SIZE(lft_rec)
-
 typedef struct osm_lftr_search_ctxt {
 	const ib_lft_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	osm_sa_t *sa;
 	const osm_physp_t *p_req_physp;
 } osm_lftr_search_ctxt_t;
 
 static ib_api_status_t lftr_rcv_new_lftr(IN osm_sa_t * sa,
 					 IN const osm_switch_t * p_sw,
-					 IN cl_qlist_t * p_list,
+					 IN osm_sa_resp_t * p_resp,
 					 IN ib_net16_t lid, IN uint16_t block)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_lft_record_t *p_rec;
 	ib_api_status_t status = IB_SUCCESS;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_LFTR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 4402: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
@@ -91,15 +89,11 @@ static ib_api_status_t lftr_rcv_new_lftr(IN osm_sa_t * sa,
 		cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)),
 		block, cl_ntoh16(lid));
 
-	memset(p_rec_item, 0, SA_LFTR_RESP_SIZE);
-
-	p_rec_item->resp.lft_rec.lid = lid;
-	p_rec_item->resp.lft_rec.block_num = cl_hton16(block);
+	p_rec->lid = lid;
+	p_rec->block_num = cl_hton16(block);
 
 	/* copy the lft block */
-	osm_switch_get_lft_block(p_sw, block, p_rec_item->resp.lft_rec.lft);
-
-	cl_qlist_insert_tail(p_list, &p_rec_item->list_item);
+	osm_switch_get_lft_block(p_sw, block, p_rec->lft);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -169,7 +163,7 @@ static void lftr_rcv_by_comp_mask(IN cl_map_item_t * p_map_item, IN void *cxt)
 
 	/* so we can add these blocks one by one ... */
 	for (block = min_block; block <= max_block; block++)
-		lftr_rcv_new_lftr(sa, p_sw, p_ctxt->p_list,
+		lftr_rcv_new_lftr(sa, p_sw, p_ctxt->p_resp,
 				  osm_port_get_base_lid(p_port), block);
 }
 
@@ -179,7 +173,7 @@ void osm_lftr_rcv_process(IN void *ctx, IN void *data)
 	osm_madw_t *p_madw = data;
 	const ib_sa_mad_t *p_rcvd_mad;
 	const ib_lft_record_t *p_rcvd_rec;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
 	osm_lftr_search_ctxt_t context;
 	osm_physp_t *p_req_physp;
 
@@ -221,10 +215,10 @@ void osm_lftr_rcv_process(IN void *ctx, IN void *data)
 		"Requester port GUID 0x%" PRIx64 "\n",
 		cl_ntoh64(osm_physp_get_port_guid(p_req_physp)));
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_lft_record_t));
 
 	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
+	context.p_resp = &resp;
 	context.comp_mask = p_rcvd_mad->comp_mask;
 	context.sa = sa;
 	context.p_req_physp = p_req_physp;
@@ -235,7 +229,7 @@ void osm_lftr_rcv_process(IN void *ctx, IN void *data)
 
 	cl_plock_release(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_lft_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -58,16 +58,14 @@
 #include <opensm/osm_pkey.h>
 #include <opensm/osm_sa.h>
 
-#define SA_LR_RESP_SIZE SA_ITEM_RESP_SIZE(link_rec)
-
 static void lr_rcv_build_physp_link(IN osm_sa_t * sa, IN ib_net16_t from_lid,
 				    IN ib_net16_t to_lid, IN uint8_t from_port,
-				    IN uint8_t to_port, IN cl_qlist_t * p_list)
+				    IN uint8_t to_port, IN osm_sa_resp_t * p_resp)
 {
-	osm_sa_item_t *p_lr_item;
+	ib_link_record_t *p_rec;
 
-	p_lr_item = malloc(SA_LR_RESP_SIZE);
-	if (p_lr_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1801: "
 			"Unable to acquire link record\n"
 			"\t\t\t\tFrom port %u\n" "\t\t\t\tTo port   %u\n"
@@ -76,14 +74,11 @@ static void lr_rcv_build_physp_link(IN osm_sa_t * sa, IN ib_net16_t from_lid,
 			cl_ntoh16(from_lid), cl_ntoh16(to_lid));
 		return;
 	}
-	memset(p_lr_item, 0, SA_LR_RESP_SIZE);
-
-	p_lr_item->resp.link_rec.from_port_num = from_port;
-	p_lr_item->resp.link_rec.to_port_num = to_port;
-	p_lr_item->resp.link_rec.to_lid = to_lid;
-	p_lr_item->resp.link_rec.from_lid = from_lid;
 
-	cl_qlist_insert_tail(p_list, &p_lr_item->list_item);
+	p_rec->from_port_num = from_port;
+	p_rec->to_port_num = to_port;
+	p_rec->to_lid = to_lid;
+	p_rec->from_lid = from_lid;
 }
 
 static ib_net16_t get_base_lid(IN const osm_physp_t * p_physp)
@@ -98,7 +93,7 @@ static void lr_rcv_get_physp_link(IN osm_sa_t * sa,
 				  IN const osm_physp_t * p_src_physp,
 				  IN const osm_physp_t * p_dest_physp,
 				  IN const ib_net64_t comp_mask,
-				  IN cl_qlist_t * p_list,
+				  IN osm_sa_resp_t * p_resp,
 				  IN const osm_physp_t * p_req_physp)
 {
 	uint8_t src_port_num;
@@ -189,7 +184,7 @@ static void lr_rcv_get_physp_link(IN osm_sa_t * sa,
 		dest_port_num);
 
 	lr_rcv_build_physp_link(sa, from_base_lid, to_base_lid, src_port_num,
-				dest_port_num, p_list);
+				dest_port_num, p_resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -200,7 +195,7 @@ static void lr_rcv_get_port_links(IN osm_sa_t * sa,
 				  IN const osm_port_t * p_src_port,
 				  IN const osm_port_t * p_dest_port,
 				  IN const ib_net64_t comp_mask,
-				  IN cl_qlist_t * p_list,
+				  IN osm_sa_resp_t * p_resp,
 				  IN const osm_physp_t * p_req_physp)
 {
 	const osm_physp_t *p_src_physp;
@@ -241,7 +236,7 @@ static void lr_rcv_get_port_links(IN osm_sa_t * sa,
 						lr_rcv_get_physp_link
 						    (sa, p_lr, p_src_physp,
 						     p_dest_physp, comp_mask,
-						     p_list, p_req_physp);
+						     p_resp, p_req_physp);
 				}
 			}
 		} else {
@@ -261,7 +256,7 @@ static void lr_rcv_get_port_links(IN osm_sa_t * sa,
 					if (p_src_physp)
 						lr_rcv_get_physp_link
 						    (sa, p_lr, p_src_physp,
-						     NULL, comp_mask, p_list,
+						     NULL, comp_mask, p_resp,
 						     p_req_physp);
 				}
 			} else {
@@ -276,7 +271,7 @@ static void lr_rcv_get_port_links(IN osm_sa_t * sa,
 					if (p_src_physp)
 						lr_rcv_get_physp_link
 						    (sa, p_lr, p_src_physp,
-						     NULL, comp_mask, p_list,
+						     NULL, comp_mask, p_resp,
 						     p_req_physp);
 				}
 			}
@@ -300,7 +295,7 @@ static void lr_rcv_get_port_links(IN osm_sa_t * sa,
 						lr_rcv_get_physp_link
 						    (sa, p_lr, NULL,
 						     p_dest_physp, comp_mask,
-						     p_list, p_req_physp);
+						     p_resp, p_req_physp);
 				}
 			} else {
 				num_ports =
@@ -315,7 +310,7 @@ static void lr_rcv_get_port_links(IN osm_sa_t * sa,
 						lr_rcv_get_physp_link
 						    (sa, p_lr, NULL,
 						     p_dest_physp, comp_mask,
-						     p_list, p_req_physp);
+						     p_resp, p_req_physp);
 				}
 			}
 		} else {
@@ -335,7 +330,7 @@ static void lr_rcv_get_port_links(IN osm_sa_t * sa,
 					if (p_src_physp)
 						lr_rcv_get_physp_link
 						    (sa, p_lr, p_src_physp,
-						     NULL, comp_mask, p_list,
+						     NULL, comp_mask, p_resp,
 						     p_req_physp);
 				}
 				p_node = (osm_node_t *) cl_qmap_next(&p_node->
@@ -420,7 +415,8 @@ void osm_lr_rcv_process(IN void *context, IN void *data)
 	const ib_sa_mad_t *p_sa_mad;
 	const osm_port_t *p_src_port;
 	const osm_port_t *p_dest_port;
-	cl_qlist_t lr_list;
+	osm_sa_resp_t resp;
+	osm_sa_cache_req_t cache_req;
 	ib_net16_t status;
 	osm_physp_t *p_req_physp;
 
@@ -463,22 +459,30 @@ void osm_lr_rcv_process(IN void *context, IN void *data)
 		osm_dump_link_record_v2(sa->p_log, p_lr, FILE_ID, OSM_LOG_DEBUG);
 	}
 
-	cl_qlist_init(&lr_list);
-
-	/*
-	   Most SA functions (including this one) are read-only on the
-	   subnet object, so we grab the lock non-exclusively.
-	 */
-	status = lr_rcv_get_end_points(sa, p_madw, &p_src_port, &p_dest_port);
-
-	if (status == IB_SA_MAD_STATUS_SUCCESS)
-		lr_rcv_get_port_links(sa, p_lr, p_src_port, p_dest_port,
-				      p_sa_mad->comp_mask, &lr_list,
-				      p_req_physp);
+	osm_sa_resp_init(&resp, sizeof(ib_link_record_t));
+	osm_sa_cache_req_init(sa, &cache_req, p_sa_mad,
+			      sizeof(ib_link_record_t));
+	osm_sa_cache_req_add_physp(&cache_req, p_req_physp);
+	if (!osm_sa_cache_get(sa, &cache_req, &resp)) {
+		/*
+		   Most SA functions (including this one) are read-only on the
+		   subnet object, so we grab the lock non-exclusively.
+		 */
+		status = lr_rcv_get_end_points(sa, p_madw, &p_src_port,
+					       &p_dest_port);
+
+		if (status == IB_SA_MAD_STATUS_SUCCESS)
+			lr_rcv_get_port_links(sa, p_lr, p_src_port,
+					      p_dest_port,
+					      p_sa_mad->comp_mask, &resp,
+					      p_req_physp);
+
+		osm_sa_cache_put(sa, &cache_req, &resp);
+	}
 
 	cl_plock_release(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_link_record_t), &lr_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -67,7 +67,6 @@
 #include <opensm/osm_inform.h>
 #include <opensm/osm_sa.h>
 
-#define SA_MCM_RESP_SIZE SA_ITEM_RESP_SIZE(mc_rec)
 
 #define JOIN_MC_COMP_MASK (IB_MCR_COMPMASK_MGID | \
 				IB_MCR_COMPMASK_PORT_GID | \
@@ -200,32 +199,31 @@ static boolean_t check_create_comp_mask(ib_net64_t comp_mask,
 static void mcmr_rcv_respond(IN osm_sa_t * sa, IN osm_madw_t * p_madw,
 			     IN ib_member_rec_t * p_mcmember_rec)
 {
-	cl_qlist_t rec_list;
-	osm_sa_item_t *item;
+	osm_sa_resp_t resp;
+	ib_member_rec_t *p_rec;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	item = malloc(SA_MCM_RESP_SIZE);
-	if (!item) {
+	osm_sa_resp_init(&resp, sizeof(ib_member_rec_t));
+
+	p_rec = osm_sa_resp_add(&resp);
+	if (!p_rec) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1B16: "
 			"rec_item alloc failed\n");
 		goto Exit;
 	}
 
-	item->resp.mc_rec = *p_mcmember_rec;
+	*p_rec = *p_mcmember_rec;
 
 	/* Fill in the mtu, rate, and packet lifetime selectors */
-	item->resp.mc_rec.mtu &= 0x3f;
-	item->resp.mc_rec.mtu |= IB_PATH_SELECTOR_EXACTLY << 6;
-	item->resp.mc_rec.rate &= 0x3f;
-	item->resp.mc_rec.rate |= IB_PATH_SELECTOR_EXACTLY << 6;
-	item->resp.mc_rec.pkt_life &= 0x3f;
-	item->resp.mc_rec.pkt_life |= IB_PATH_SELECTOR_EXACTLY << 6;
-
-	cl_qlist_init(&rec_list);
-	cl_qlist_insert_tail(&rec_list, &item->list_item);
+	p_rec->mtu &= 0x3f;
+	p_rec->mtu |= IB_PATH_SELECTOR_EXACTLY << 6;
+	p_rec->rate &= 0x3f;
+	p_rec->rate |= IB_PATH_SELECTOR_EXACTLY << 6;
+	p_rec->pkt_life &= 0x3f;
+	p_rec->pkt_life |= IB_PATH_SELECTOR_EXACTLY << 6;
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_member_rec_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -1436,27 +1434,24 @@ Exit:
 **********************************************************************/
 static ib_api_status_t mcmr_rcv_new_mcmr(IN osm_sa_t * sa,
 					 IN const ib_member_rec_t * p_rcvd_rec,
-					 IN cl_qlist_t * p_list)
+					 IN osm_sa_resp_t * p_resp)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_member_rec_t *p_rec;
 	ib_api_status_t status = IB_SUCCESS;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_MCM_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1B15: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
 		goto Exit;
 	}
 
-	memset(p_rec_item, 0, sizeof(cl_list_item_t));
-
 	/* HACK: Untrusted requesters should result with 0 Join
 	   State, Port Guid, and Proxy */
-	p_rec_item->resp.mc_rec = *p_rcvd_rec;
-	cl_qlist_insert_tail(p_list, &p_rec_item->list_item);
+	*p_rec = *p_rcvd_rec;
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -1469,7 +1464,7 @@ Exit:
 static void mcmr_by_comp_mask(osm_sa_t * sa, const ib_member_rec_t * p_rcvd_rec,
 			      ib_net64_t comp_mask, osm_mgrp_t * p_mgrp,
 			      const osm_physp_t * p_req_physp,
-			      boolean_t trusted_req, cl_qlist_t * list)
+			      boolean_t trusted_req, osm_sa_resp_t * p_resp)
 {
 	/* since we might change scope_state */
 	ib_member_rec_t match_rec;
@@ -1570,7 +1565,7 @@ static void mcmr_by_comp_mask(osm_sa_t * sa, const ib_member_rec_t * p_rcvd_rec,
 				match_rec.proxy_join =
 				    (uint8_t) (p_mcm_alias_guid->proxy_join);
 
-				mcmr_rcv_new_mcmr(sa, &match_rec, list);
+				mcmr_rcv_new_mcmr(sa, &match_rec, p_resp);
 			}
 			p_item = cl_qmap_next(p_item);
 		}
@@ -1585,7 +1580,7 @@ static void mcmr_by_comp_mask(osm_sa_t * sa, const ib_member_rec_t * p_rcvd_rec,
 		memcpy(&(match_rec.port_gid), &port_gid, sizeof(ib_gid_t));
 		match_rec.proxy_join = (uint8_t) proxy_join;
 
-		mcmr_rcv_new_mcmr(sa, &match_rec, list);
+		mcmr_rcv_new_mcmr(sa, &match_rec, p_resp);
 	}
 
 Exit:
@@ -1599,7 +1594,7 @@ static void mcmr_query_mgrp(IN osm_sa_t * sa, IN osm_madw_t * p_madw)
 {
 	const ib_sa_mad_t *p_rcvd_mad;
 	const ib_member_rec_t *p_rcvd_rec;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
 	ib_net64_t comp_mask;
 	osm_physp_t *p_req_physp;
 	boolean_t trusted_req;
@@ -1638,14 +1633,14 @@ static void mcmr_query_mgrp(IN osm_sa_t * sa, IN osm_madw_t * p_madw)
 		osm_dump_mc_record(sa->p_log, p_rcvd_rec, OSM_LOG_DEBUG);
 	}
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_member_rec_t));
 
 	/* simply go over all MCGs and match */
 	for (p_mgrp = (osm_mgrp_t *) cl_fmap_head(&sa->p_subn->mgrp_mgid_tbl);
 	     p_mgrp != (osm_mgrp_t *) cl_fmap_end(&sa->p_subn->mgrp_mgid_tbl);
 	     p_mgrp = (osm_mgrp_t *) cl_fmap_next(&p_mgrp->map_item))
 		mcmr_by_comp_mask(sa, p_rcvd_rec, comp_mask, p_mgrp,
-				  p_req_physp, trusted_req, &rec_list);
+				  p_req_physp, trusted_req, &resp);
 
 	CL_PLOCK_RELEASE(sa->p_lock);
 
@@ -1658,18 +1653,16 @@ static void mcmr_query_mgrp(IN osm_sa_t * sa, IN osm_madw_t * p_madw)
 	 */
 
 	if (!p_rcvd_mad->sm_key) {
-		osm_sa_item_t *item;
-		for (item = (osm_sa_item_t *) cl_qlist_head(&rec_list);
-		     item != (osm_sa_item_t *) cl_qlist_end(&rec_list);
-		     item =
-		     (osm_sa_item_t *) cl_qlist_next(&item->list_item)) {
-			memset(&item->resp.mc_rec.port_gid, 0, sizeof(ib_gid_t));
-			ib_member_set_join_state(&item->resp.mc_rec, 0);
-			item->resp.mc_rec.proxy_join = 0;
+		ib_member_rec_t *p_rec = (ib_member_rec_t *) resp.recs;
+		unsigned i;
+		for (i = 0; i < resp.num_rec; i++) {
+			memset(&p_rec[i].port_gid, 0, sizeof(ib_gid_t));
+			ib_member_set_join_state(&p_rec[i], 0);
+			p_rec[i].proxy_join = 0;
 		}
 	}
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_member_rec_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
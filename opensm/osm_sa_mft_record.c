@@ -57,30 +57,28 @@
 #include <opensm/osm_pkey.h>
 #include <opensm/osm_sa.h>
 
-#define SA_MFTR_RESP_SIZE SA_ITEM_RESP_SIZE(mft_rec)
-
 typedef struct osm_mftr_search_ctxt {
 	const ib_mft_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	osm_sa_t *sa;
 	const osm_physp_t *p_req_physp;
 } osm_mftr_search_ctxt_t;
 
 static ib_api_status_t mftr_rcv_new_mftr(IN osm_sa_t * sa,
 					 IN osm_switch_t * p_sw,
-					 IN cl_qlist_t * p_list,
+					 IN osm_sa_resp_t * p_resp,
 					 IN ib_net16_t lid, IN uint16_t block,
 					 IN uint8_t position)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_mft_record_t *p_rec;
 	ib_api_status_t status = IB_SUCCESS;
 	uint16_t position_block_num;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_MFTR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 4A02: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
@@ -96,15 +94,11 @@ static ib_api_status_t mftr_rcv_new_mftr(IN osm_sa_t * sa,
 	position_block_num = ((uint16_t) position << 12) |
 	    (block & IB_MCAST_BLOCK_ID_MASK_HO);
 
-	memset(p_rec_item, 0, SA_MFTR_RESP_SIZE);
-
-	p_rec_item->resp.mft_rec.lid = lid;
-	p_rec_item->resp.mft_rec.position_block_num = cl_hton16(position_block_num);
+	p_rec->lid = lid;
+	p_rec->position_block_num = cl_hton16(position_block_num);
 
 	/* copy the mft block */
-	osm_switch_get_mft_block(p_sw, block, position, p_rec_item->resp.mft_rec.mft);
-
-	cl_qlist_insert_tail(p_list, &p_rec_item->list_item);
+	osm_switch_get_mft_block(p_sw, block, position, p_rec->mft);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -201,7 +195,7 @@ static void mftr_rcv_by_comp_mask(IN cl_map_item_t * p_map_item, IN void *cxt)
 	for (block = min_block; block <= max_block; block++)
 		for (position = min_position; position <= max_position;
 		     position++)
-			mftr_rcv_new_mftr(sa, p_sw, p_ctxt->p_list,
+			mftr_rcv_new_mftr(sa, p_sw, p_ctxt->p_resp,
 					  osm_port_get_base_lid(p_port), block,
 					  position);
 }
@@ -212,7 +206,7 @@ void osm_mftr_rcv_process(IN void *ctx, IN void *data)
 	osm_madw_t *p_madw = data;
 	const ib_sa_mad_t *p_rcvd_mad;
 	const ib_mft_record_t *p_rcvd_rec;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
 	osm_mftr_search_ctxt_t context;
 	osm_physp_t *p_req_physp;
 
@@ -253,10 +247,10 @@ void osm_mftr_rcv_process(IN void *ctx, IN void *data)
 		"Requester port GUID 0x%" PRIx64 "\n",
 		cl_ntoh64(osm_physp_get_port_guid(p_req_physp)));
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_mft_record_t));
 
 	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
+	context.p_resp = &resp;
 	context.comp_mask = p_rcvd_mad->comp_mask;
 	context.sa = sa;
 	context.p_req_physp = p_req_physp;
@@ -267,7 +261,7 @@ void osm_mftr_rcv_process(IN void *ctx, IN void *data)
 
 	cl_plock_release(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_mft_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
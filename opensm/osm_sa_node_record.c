@@ -57,29 +57,27 @@
 #include <opensm/osm_pkey.h>
 #include <opensm/osm_sa.h>
 
-#define SA_NR_RESP_SIZE SA_ITEM_RESP_SIZE(node_rec)
-
 typedef struct osm_nr_search_ctxt {
 	const ib_node_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	osm_sa_t *sa;
 	const osm_physp_t *p_req_physp;
 } osm_nr_search_ctxt_t;
 
 static ib_api_status_t nr_rcv_new_nr(osm_sa_t * sa,
 				     IN const osm_node_t * p_node,
-				     IN cl_qlist_t * p_list,
+				     IN osm_sa_resp_t * p_resp,
 				     IN ib_net64_t port_guid, IN ib_net16_t lid,
 	                             IN unsigned int port_num)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_node_record_t *p_rec;
 	ib_api_status_t status = IB_SUCCESS;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_NR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1D02: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
@@ -92,18 +90,15 @@ static ib_api_status_t nr_rcv_new_nr(osm_sa_t * sa,
 		cl_ntoh64(osm_node_get_node_guid(p_node)),
 		cl_ntoh64(port_guid), cl_ntoh16(lid));
 
-	memset(p_rec_item, 0, SA_NR_RESP_SIZE);
-
-	p_rec_item->resp.node_rec.lid = lid;
+	p_rec->lid = lid;
 
-	p_rec_item->resp.node_rec.node_info = p_node->node_info;
-	p_rec_item->resp.node_rec.node_info.port_guid = port_guid;
-	p_rec_item->resp.node_rec.node_info.port_num_vendor_id =
-		(p_rec_item->resp.node_rec.node_info.port_num_vendor_id & IB_NODE_INFO_VEND_ID_MASK) |
+	p_rec->node_info = p_node->node_info;
+	p_rec->node_info.port_guid = port_guid;
+	p_rec->node_info.port_num_vendor_id =
+		(p_rec->node_info.port_num_vendor_id & IB_NODE_INFO_VEND_ID_MASK) |
 		((port_num << IB_NODE_INFO_PORT_NUM_SHIFT) & IB_NODE_INFO_PORT_NUM_MASK);
-	memcpy(&(p_rec_item->resp.node_rec.node_desc), &(p_node->node_desc),
+	memcpy(&(p_rec->node_desc), &(p_node->node_desc),
 	       IB_NODE_DESCRIPTION_SIZE);
-	cl_qlist_insert_tail(p_list, &p_rec_item->list_item);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -111,7 +106,7 @@ Exit:
 }
 
 static void nr_rcv_create_nr(IN osm_sa_t * sa, IN osm_node_t * p_node,
-			     IN cl_qlist_t * p_list,
+			     IN osm_sa_resp_t * p_resp,
 			     IN ib_net64_t const match_port_guid,
 			     IN ib_net16_t const match_lid,
 			     IN unsigned int const match_port_num,
@@ -184,112 +179,187 @@ static void nr_rcv_create_nr(IN osm_sa_t * sa, IN osm_node_t * p_node,
 		    (port_num != match_port_num))
 			continue;
 
-		nr_rcv_new_nr(sa, p_node, p_list, port_guid, base_lid, port_num);
+		nr_rcv_new_nr(sa, p_node, p_resp, port_guid, base_lid, port_num);
 	}
 
 	OSM_LOG_EXIT(sa->p_log);
 }
 
-static void nr_rcv_by_comp_mask(IN cl_map_item_t * p_map_item, IN void *context)
+/*
+ * Checks the node attributes of a NodeRecord query, all but the port
+ * GUID, port number and LID
+ */
+static boolean_t nr_rcv_match_node(IN osm_sa_t * sa,
+				   IN const ib_node_info_t * p_ni,
+				   IN const ib_node_desc_t * p_nd,
+				   IN const ib_node_record_t * p_rcvd_rec,
+				   IN ib_net64_t comp_mask)
 {
-	const osm_nr_search_ctxt_t *p_ctxt = context;
-	osm_node_t *p_node = (osm_node_t *) p_map_item;
-	const ib_node_record_t *const p_rcvd_rec = p_ctxt->p_rcvd_rec;
-	const osm_physp_t *const p_req_physp = p_ctxt->p_req_physp;
-	osm_sa_t *sa = p_ctxt->sa;
-	ib_net64_t comp_mask = p_ctxt->comp_mask;
-	ib_net64_t match_port_guid = 0;
-	ib_net16_t match_lid = 0;
-	unsigned int match_port_num = 0;
-
-	OSM_LOG_ENTER(p_ctxt->sa->p_log);
-
-	osm_dump_node_info_v2(p_ctxt->sa->p_log, &p_node->node_info,
-			      FILE_ID, OSM_LOG_DEBUG);
-
-	if (comp_mask & IB_NR_COMPMASK_LID)
-		match_lid = p_rcvd_rec->lid;
-
 	if (comp_mask & IB_NR_COMPMASK_NODEGUID) {
 		OSM_LOG(sa->p_log, OSM_LOG_DEBUG,
 			"Looking for node 0x%016" PRIx64
 			", found 0x%016" PRIx64 "\n",
 			cl_ntoh64(p_rcvd_rec->node_info.node_guid),
-			cl_ntoh64(osm_node_get_node_guid(p_node)));
+			cl_ntoh64(p_ni->node_guid));
 
-		if (p_node->node_info.node_guid !=
-		    p_rcvd_rec->node_info.node_guid)
-			goto Exit;
+		if (p_ni->node_guid != p_rcvd_rec->node_info.node_guid)
+			return FALSE;
 	}
 
-	if (comp_mask & IB_NR_COMPMASK_PORTGUID)
-		match_port_guid = p_rcvd_rec->node_info.port_guid;
-
 	if ((comp_mask & IB_NR_COMPMASK_SYSIMAGEGUID) &&
-	    p_node->node_info.sys_guid != p_rcvd_rec->node_info.sys_guid)
-			goto Exit;
+	    p_ni->sys_guid != p_rcvd_rec->node_info.sys_guid)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_BASEVERSION) &&
-	    p_node->node_info.base_version !=
-	    p_rcvd_rec->node_info.base_version)
-			goto Exit;
+	    p_ni->base_version != p_rcvd_rec->node_info.base_version)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_CLASSVERSION) &&
-	    p_node->node_info.class_version !=
-	    p_rcvd_rec->node_info.class_version)
-		goto Exit;
+	    p_ni->class_version != p_rcvd_rec->node_info.class_version)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_NODETYPE) &&
-	    p_node->node_info.node_type != p_rcvd_rec->node_info.node_type)
-		goto Exit;
+	    p_ni->node_type != p_rcvd_rec->node_info.node_type)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_NUMPORTS) &&
-	    p_node->node_info.num_ports != p_rcvd_rec->node_info.num_ports)
-		goto Exit;
+	    p_ni->num_ports != p_rcvd_rec->node_info.num_ports)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_PARTCAP) &&
-	    p_node->node_info.partition_cap !=
-	    p_rcvd_rec->node_info.partition_cap)
-		goto Exit;
+	    p_ni->partition_cap != p_rcvd_rec->node_info.partition_cap)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_DEVID) &&
-	    p_node->node_info.device_id != p_rcvd_rec->node_info.device_id)
-		goto Exit;
+	    p_ni->device_id != p_rcvd_rec->node_info.device_id)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_REV) &&
-	    p_node->node_info.revision !=
-	    p_rcvd_rec->node_info.revision)
-		goto Exit;
-
-	if (comp_mask & IB_NR_COMPMASK_PORTNUM)
-		match_port_num = ib_node_info_get_local_port_num(&p_rcvd_rec->node_info);
+	    p_ni->revision != p_rcvd_rec->node_info.revision)
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_VENDID) &&
-	    ib_node_info_get_vendor_id(&p_node->node_info) !=
+	    ib_node_info_get_vendor_id(p_ni) !=
 	    ib_node_info_get_vendor_id(&p_rcvd_rec->node_info))
-		goto Exit;
+		return FALSE;
 
 	if ((comp_mask & IB_NR_COMPMASK_NODEDESC) &&
-	    strncmp((char *)&p_node->node_desc, (char *)&p_rcvd_rec->node_desc,
+	    strncmp((char *)p_nd, (char *)&p_rcvd_rec->node_desc,
 		    sizeof(ib_node_desc_t)))
+		return FALSE;
+
+	return TRUE;
+}
+
+static void nr_rcv_by_comp_mask(IN cl_map_item_t * p_map_item, IN void *context)
+{
+	const osm_nr_search_ctxt_t *p_ctxt = context;
+	osm_node_t *p_node = (osm_node_t *) p_map_item;
+	const ib_node_record_t *const p_rcvd_rec = p_ctxt->p_rcvd_rec;
+	const osm_physp_t *const p_req_physp = p_ctxt->p_req_physp;
+	osm_sa_t *sa = p_ctxt->sa;
+	ib_net64_t comp_mask = p_ctxt->comp_mask;
+	ib_net64_t match_port_guid = 0;
+	ib_net16_t match_lid = 0;
+	unsigned int match_port_num = 0;
+
+	OSM_LOG_ENTER(p_ctxt->sa->p_log);
+
+	osm_dump_node_info_v2(p_ctxt->sa->p_log, &p_node->node_info,
+			      FILE_ID, OSM_LOG_DEBUG);
+
+	if (!nr_rcv_match_node(sa, &p_node->node_info, &p_node->node_desc,
+			       p_rcvd_rec, comp_mask))
 		goto Exit;
 
-	nr_rcv_create_nr(sa, p_node, p_ctxt->p_list, match_port_guid,
+	if (comp_mask & IB_NR_COMPMASK_LID)
+		match_lid = p_rcvd_rec->lid;
+
+	if (comp_mask & IB_NR_COMPMASK_PORTGUID)
+		match_port_guid = p_rcvd_rec->node_info.port_guid;
+
+	if (comp_mask & IB_NR_COMPMASK_PORTNUM)
+		match_port_num = ib_node_info_get_local_port_num(&p_rcvd_rec->node_info);
+
+	nr_rcv_create_nr(sa, p_node, p_ctxt->p_resp, match_port_guid,
 			 match_lid, match_port_num, p_req_physp, comp_mask);
 
 Exit:
 	OSM_LOG_EXIT(p_ctxt->sa->p_log);
 }
 
+/*
+ * Same as applying nr_rcv_by_comp_mask to all nodes, on a snapshot of
+ * the subnet
+ */
+static void nr_rcv_snapshot_by_comp_mask(IN osm_sa_t * sa,
+					 IN const osm_sa_snapshot_t * p_snap,
+					 IN uint32_t req_port,
+					 IN const ib_node_record_t * p_rcvd_rec,
+					 IN ib_net64_t comp_mask,
+					 IN osm_sa_resp_t * p_resp)
+{
+	const osm_sa_snap_port_t *p_port;
+	const ib_node_info_t *p_ni;
+	ib_node_record_t *p_rec;
+	uint16_t base_lid_ho, match_lid_ho;
+	uint32_t i;
+
+	OSM_LOG_ENTER(sa->p_log);
+
+	for (i = 0; i < p_snap->num_ports; i++) {
+		p_port = &p_snap->ports[i];
+		p_ni = &p_port->node_rec.node_info;
+
+		if (!nr_rcv_match_node(sa, p_ni, &p_port->node_rec.node_desc,
+				       p_rcvd_rec, comp_mask))
+			continue;
+
+		if (!osm_sa_snapshot_share_pkey(p_snap, i, req_port))
+			continue;
+
+		if ((comp_mask & IB_NR_COMPMASK_PORTGUID) &&
+		    p_ni->port_guid != p_rcvd_rec->node_info.port_guid)
+			continue;
+
+		if (comp_mask & IB_NR_COMPMASK_LID) {
+			base_lid_ho = cl_ntoh16(p_port->node_rec.lid);
+			match_lid_ho = cl_ntoh16(p_rcvd_rec->lid);
+			if (match_lid_ho < base_lid_ho ||
+			    match_lid_ho > base_lid_ho + (1 << p_port->lmc) - 1)
+				continue;
+		}
+
+		if ((comp_mask & IB_NR_COMPMASK_PORTNUM) &&
+		    ib_node_info_get_local_port_num(p_ni) !=
+		    ib_node_info_get_local_port_num(&p_rcvd_rec->node_info))
+			continue;
+
+		p_rec = osm_sa_resp_add(p_resp);
+		if (p_rec == NULL) {
+			OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1D02: "
+				"rec_item alloc failed\n");
+			break;
+		}
+		*p_rec = p_port->node_rec;
+	}
+
+	OSM_LOG_EXIT(sa->p_log);
+}
+
 void osm_nr_rcv_process(IN void *ctx, IN void *data)
 {
 	osm_sa_t *sa = ctx;
 	osm_madw_t *p_madw = data;
 	const ib_sa_mad_t *p_rcvd_mad;
 	const ib_node_record_t *p_rcvd_rec;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
+	osm_sa_cache_req_t cache_req;
 	osm_nr_search_ctxt_t context;
 	osm_physp_t *p_req_physp;
+	osm_sa_snapshot_t *p_snap;
+	const osm_sa_snap_port_t *p_req_port;
+	uint32_t req_port, i;
 
 	CL_ASSERT(sa);
 
@@ -312,6 +382,52 @@ void osm_nr_rcv_process(IN void *ctx, IN void *data)
 		goto Exit;
 	}
 
+	/* without the subnet lock, from the current snapshot */
+	if (sa->p_subn->opt.sa_snapshot && (p_snap = osm_sa_snapshot_get(sa))) {
+		req_port = osm_sa_snapshot_get_port_by_lid(p_snap,
+							   osm_madw_get_mad_addr_ptr
+							   (p_madw)->dest_lid);
+		if (req_port == OSM_SA_SNAP_NO_PORT) {
+			osm_sa_snapshot_put(p_snap);
+			OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1D04: "
+				"Cannot find requester physical port\n");
+			goto Exit;
+		}
+
+		if (OSM_LOG_IS_ACTIVE_V2(sa->p_log, OSM_LOG_DEBUG)) {
+			OSM_LOG(sa->p_log, OSM_LOG_DEBUG,
+				"Requester port GUID 0x%" PRIx64
+				", snapshot %u\n",
+				cl_ntoh64(p_snap->ports[req_port].node_rec.
+					  node_info.port_guid),
+				p_snap->version);
+			osm_dump_node_record_v2(sa->p_log, p_rcvd_rec,
+						FILE_ID, OSM_LOG_DEBUG);
+		}
+
+		osm_sa_resp_init(&resp, sizeof(ib_node_record_t));
+		osm_sa_cache_req_init(sa, &cache_req, p_rcvd_mad,
+				      sizeof(ib_node_record_t));
+		p_req_port = &p_snap->ports[req_port];
+		for (i = 0; i < p_req_port->num_pkeys; i++)
+			osm_sa_cache_req_add_pkey(&cache_req,
+						  p_snap->pkeys[p_req_port->pkeys + i]);
+		if (!osm_sa_cache_get(sa, &cache_req, &resp)) {
+			/* a sweep published a newer snapshot meanwhile */
+			if (p_snap->version != sa->snapshot_version)
+				cache_req.cacheable = FALSE;
+			nr_rcv_snapshot_by_comp_mask(sa, p_snap, req_port,
+						     p_rcvd_rec,
+						     p_rcvd_mad->comp_mask,
+						     &resp);
+			osm_sa_cache_put(sa, &cache_req, &resp);
+		}
+		osm_sa_snapshot_put(p_snap);
+
+		osm_sa_resp_send(sa, p_madw, &resp);
+		goto Exit;
+	}
+
 	cl_plock_acquire(sa->p_lock);
 
 	/* update the requester physical port */
@@ -332,20 +448,26 @@ void osm_nr_rcv_process(IN void *ctx, IN void *data)
 		osm_dump_node_record_v2(sa->p_log, p_rcvd_rec, FILE_ID, OSM_LOG_DEBUG);
 	}
 
-	cl_qlist_init(&rec_list);
-
-	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
-	context.comp_mask = p_rcvd_mad->comp_mask;
-	context.sa = sa;
-	context.p_req_physp = p_req_physp;
-
-	cl_qmap_apply_func(&sa->p_subn->node_guid_tbl, nr_rcv_by_comp_mask,
-			   &context);
+	osm_sa_resp_init(&resp, sizeof(ib_node_record_t));
+	osm_sa_cache_req_init(sa, &cache_req, p_rcvd_mad,
+			      sizeof(ib_node_record_t));
+	osm_sa_cache_req_add_physp(&cache_req, p_req_physp);
+	if (!osm_sa_cache_get(sa, &cache_req, &resp)) {
+		context.p_rcvd_rec = p_rcvd_rec;
+		context.p_resp = &resp;
+		context.comp_mask = p_rcvd_mad->comp_mask;
+		context.sa = sa;
+		context.p_req_physp = p_req_physp;
+
+		cl_qmap_apply_func(&sa->p_subn->node_guid_tbl,
+				   nr_rcv_by_comp_mask, &context);
+
+		osm_sa_cache_put(sa, &cache_req, &resp);
+	}
 
 	cl_plock_release(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_node_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -74,7 +74,6 @@
 #include <opensm/osm_prefix_route.h>
 #include <opensm/osm_ucast_lash.h>
 
-#define SA_PR_RESP_SIZE SA_ITEM_RESP_SIZE(path_rec)
 
 #define MAX_HOPS 64
 
@@ -142,6 +141,103 @@ sa_path_rec_apply_tavor_mtu_limit(IN const ib_path_rec_t * p_pr,
 	return TRUE;
 }
 
+/*
+ * PathRecord cache entries, see osm_sa_pr_cache_t; zero MTU means
+ * not cached
+ */
+#define PR_CACHE_SL_MASK	0x0000ffff
+#define PR_CACHE_HOPS_SHIFT	16
+#define PR_CACHE_HOPS_MASK	0x7f
+#define PR_CACHE_RATE_SHIFT	23
+#define PR_CACHE_RATE_MASK	0x1f
+#define PR_CACHE_MTU_SHIFT	28
+#define PR_CACHE_MTU_MASK	0x7
+#define PR_CACHE_QOS		0x80000000
+
+/*
+ * Walks from the egress port of the switch p_node towards dest_lid,
+ * like pr_rcv_get_path_parms does, and returns the resulting cache
+ * entry.  The SL2VL table of the egress port of p_node depends on the
+ * ingress port and is left to the caller.  Returns zero if the path
+ * can't be cached; the regular walk reports the reason.
+ */
+static uint32_t pr_rcv_cache_walk(IN osm_sa_t * sa,
+				  IN const osm_node_t * p_node,
+				  IN const osm_physp_t * p_dest_physp,
+				  IN ib_net16_t dest_lid)
+{
+	const osm_physp_t *p_physp, *p_physp0;
+	const ib_port_info_t *p_pi;
+	ib_slvl_table_t *p_slvl_tbl;
+	boolean_t qos = sa->p_subn->opt.qos;
+	uint16_t valid_sl_mask = 0xffff;
+	uint8_t mtu, rate, p0_extended_rate, in_port_num, i;
+	int hops = 1, p0_extended;
+
+	p_physp = osm_switch_get_route_by_lid(p_node->sw, dest_lid);
+	if (!p_physp)
+		return 0;
+
+	p_physp0 = osm_node_get_physp_ptr((osm_node_t *)p_node, 0);
+	p0_extended = p_physp0->port_info.capability_mask &
+	    IB_PORT_CAP_HAS_EXT_SPEEDS;
+	p_pi = &p_physp->port_info;
+	mtu = ib_port_info_get_mtu_cap(p_pi);
+	rate = ib_port_info_compute_rate(p_pi, p0_extended);
+
+	while (p_physp != p_dest_physp) {
+		p_physp = osm_physp_get_remote(p_physp);
+		if (!p_physp)
+			return 0;
+		if (p_physp == p_dest_physp)
+			break;
+
+		in_port_num = osm_physp_get_port_num(p_physp);
+		p_node = osm_physp_get_node_ptr(p_physp);
+		if (!p_node->sw || ++hops > MAX_HOPS)
+			return 0;
+
+		p_physp0 = osm_node_get_physp_ptr((osm_node_t *)p_node, 0);
+		p0_extended = p_physp0->port_info.capability_mask &
+		    IB_PORT_CAP_HAS_EXT_SPEEDS;
+
+		p_pi = &p_physp->port_info;
+		if (mtu > ib_port_info_get_mtu_cap(p_pi))
+			mtu = ib_port_info_get_mtu_cap(p_pi);
+		p0_extended_rate = ib_port_info_compute_rate(p_pi, p0_extended);
+		if (ib_path_compare_rates(rate, p0_extended_rate) > 0)
+			rate = p0_extended_rate;
+
+		p_physp = osm_switch_get_route_by_lid(p_node->sw, dest_lid);
+		if (!p_physp)
+			return 0;
+
+		p_pi = &p_physp->port_info;
+		if (mtu > ib_port_info_get_mtu_cap(p_pi))
+			mtu = ib_port_info_get_mtu_cap(p_pi);
+		p0_extended_rate = ib_port_info_compute_rate(p_pi, p0_extended);
+		if (ib_path_compare_rates(rate, p0_extended_rate) > 0)
+			rate = p0_extended_rate;
+
+		if (qos) {
+			p_slvl_tbl =
+			    osm_physp_get_slvl_tbl(p_physp, in_port_num);
+			for (i = 0; i < IB_MAX_NUM_VLS; i++)
+				if (ib_slvl_table_get(p_slvl_tbl, i) ==
+				    IB_DROP_VL)
+					valid_sl_mask &= ~(1 << i);
+		}
+	}
+
+	if (!mtu || mtu > PR_CACHE_MTU_MASK || rate > PR_CACHE_RATE_MASK)
+		return 0;
+
+	return (qos ? PR_CACHE_QOS : 0) |
+	    ((uint32_t) mtu << PR_CACHE_MTU_SHIFT) |
+	    ((uint32_t) rate << PR_CACHE_RATE_SHIFT) |
+	    ((uint32_t) hops << PR_CACHE_HOPS_SHIFT) | valid_sl_mask;
+}
+
 static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 					     IN const ib_path_rec_t * p_pr,
 					     IN const osm_alias_guid_t * p_src_alias_guid,
@@ -155,6 +251,7 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 	const osm_physp_t *p_physp, *p_physp0;
 	const osm_physp_t *p_src_physp;
 	const osm_physp_t *p_dest_physp;
+	const osm_physp_t *p_rem_physp;
 	const osm_prtn_t *p_prtn = NULL;
 	osm_opensm_t *p_osm;
 	struct osm_routing_engine *p_re;
@@ -176,6 +273,8 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 	uint16_t valid_sl_mask = 0xffff;
 	int hops = 0;
 	int extended, p0_extended;
+	uint32_t entry;
+	uint16_t sw_lid_ho;
 
 	OSM_LOG_ENTER(sa->p_log);
 
@@ -282,6 +381,75 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 
 	}
 
+	/*
+	 * From a CA through its switch: take what follows the egress
+	 * port of the switch from the PathRecord cache
+	 */
+	p_rem_physp = osm_physp_get_remote(p_physp);
+	if (sa->p_subn->opt.sa_pr_cache && p_physp != p_dest_physp &&
+	    !osm_physp_get_node_ptr(p_physp)->sw && p_rem_physp &&
+	    p_rem_physp != p_dest_physp &&
+	    osm_physp_get_node_ptr(p_rem_physp)->sw) {
+		p_node = osm_physp_get_node_ptr(p_rem_physp);
+		sw_lid_ho = cl_ntoh16(osm_node_get_base_lid(p_node, 0));
+		entry = osm_sa_pr_cache_get(sa, sw_lid_ho, dest_lid_ho);
+		if (!entry || !(entry & PR_CACHE_QOS) != !sa->p_subn->opt.qos) {
+			entry = pr_rcv_cache_walk(sa, p_node, p_dest_physp,
+						  dest_lid);
+			if (entry)
+				osm_sa_pr_cache_set(sa, sw_lid_ho, dest_lid_ho,
+						    entry);
+		}
+		p_physp0 = osm_node_get_physp_ptr((osm_node_t *)p_node, 0);
+		p_physp = osm_switch_get_route_by_lid(p_node->sw, dest_lid);
+		if (entry && p_physp) {
+			in_port_num = osm_physp_get_port_num(p_rem_physp);
+
+			/* ingress port of the switch */
+			p_pi = &p_rem_physp->port_info;
+			if (mtu > ib_port_info_get_mtu_cap(p_pi))
+				mtu = ib_port_info_get_mtu_cap(p_pi);
+			p0_extended = p_physp0->port_info.capability_mask &
+			    IB_PORT_CAP_HAS_EXT_SPEEDS;
+			p0_extended_rate =
+			    ib_port_info_compute_rate(p_pi, p0_extended);
+			if (ib_path_compare_rates(rate, p0_extended_rate) > 0)
+				rate = p0_extended_rate;
+
+			if (sa->p_subn->opt.qos) {
+				p_slvl_tbl =
+				    osm_physp_get_slvl_tbl(p_physp,
+							   in_port_num);
+				for (i = 0; i < IB_MAX_NUM_VLS; i++)
+					if (ib_slvl_table_get(p_slvl_tbl, i) ==
+					    IB_DROP_VL)
+						valid_sl_mask &= ~(1 << i);
+			}
+
+			/* the rest of the path */
+			if (mtu > ((entry >> PR_CACHE_MTU_SHIFT) &
+				   PR_CACHE_MTU_MASK))
+				mtu = (entry >> PR_CACHE_MTU_SHIFT) &
+				    PR_CACHE_MTU_MASK;
+			p0_extended_rate = (entry >> PR_CACHE_RATE_SHIFT) &
+			    PR_CACHE_RATE_MASK;
+			if (ib_path_compare_rates(rate, p0_extended_rate) > 0)
+				rate = p0_extended_rate;
+			valid_sl_mask &= entry & PR_CACHE_SL_MASK;
+			hops = (entry >> PR_CACHE_HOPS_SHIFT) &
+			    PR_CACHE_HOPS_MASK;
+
+			if (sa->p_subn->opt.qos && !valid_sl_mask) {
+				OSM_LOG(sa->p_log, OSM_LOG_DEBUG, "All the SLs "
+					"lead to VL15 on this path\n");
+				status = IB_NOT_FOUND;
+				goto Exit;
+			}
+			p_physp = p_dest_physp;
+		} else
+			p_physp = p_src_physp;
+	}
+
 	/*
 	 * Now go through the path step by step
 	 */
@@ -808,11 +976,14 @@ static ib_api_status_t pr_rcv_get_path_parms(IN osm_sa_t * sa,
 	 * engine override it.
 	 */
 	if (p_re && p_re->path_sl) {
+		uint64_t prof_start;
 		uint8_t pr_sl;
 		pr_sl = sl;
 
+		prof_start = osm_sweep_prof_path_sl_start(&sa->sm->sweep_prof);
 		sl = p_re->path_sl(p_re->context, sl,
 				   cl_hton16(src_lid_ho), cl_hton16(dest_lid_ho));
+		osm_sweep_prof_path_sl_done(&sa->sm->sweep_prof, prof_start);
 
 		if ((comp_mask & IB_PR_COMPMASK_SL) && (sl != pr_sl)) {
 			OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1F2A: "
@@ -971,7 +1142,7 @@ static void pr_rcv_build_pr(IN osm_sa_t * sa,
 	OSM_LOG_EXIT(sa->p_log);
 }
 
-static osm_sa_item_t *pr_rcv_get_lid_pair_path(IN osm_sa_t * sa,
+static ib_path_rec_t *pr_rcv_get_lid_pair_path(IN osm_sa_t * sa,
 					       IN const ib_path_rec_t * p_pr,
 					       IN const osm_alias_guid_t * p_src_alias_guid,
 					       IN const osm_alias_guid_t * p_dest_alias_guid,
@@ -980,11 +1151,12 @@ static osm_sa_item_t *pr_rcv_get_lid_pair_path(IN osm_sa_t * sa,
 					       IN const uint16_t src_lid_ho,
 					       IN const uint16_t dest_lid_ho,
 					       IN const ib_net64_t comp_mask,
-					       IN const uint8_t preference)
+					       IN const uint8_t preference,
+					       IN osm_sa_resp_t * p_resp)
 {
 	osm_path_parms_t path_parms;
 	osm_path_parms_t rev_path_parms;
-	osm_sa_item_t *p_pr_item;
+	ib_path_rec_t *p_pr_rec;
 	ib_api_status_t status, rev_path_status;
 
 	OSM_LOG_ENTER(sa->p_log);
@@ -992,21 +1164,20 @@ static osm_sa_item_t *pr_rcv_get_lid_pair_path(IN osm_sa_t * sa,
 	OSM_LOG(sa->p_log, OSM_LOG_DEBUG, "Src LID %u, Dest LID %u\n",
 		src_lid_ho, dest_lid_ho);
 
-	p_pr_item = malloc(SA_PR_RESP_SIZE);
-	if (p_pr_item == NULL) {
+	p_pr_rec = osm_sa_resp_add(p_resp);
+	if (p_pr_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1F01: "
 			"Unable to allocate path record\n");
 		goto Exit;
 	}
-	memset(p_pr_item, 0, SA_PR_RESP_SIZE);
 
 	status = pr_rcv_get_path_parms(sa, p_pr, p_src_alias_guid, src_lid_ho,
 				       p_dest_alias_guid, dest_lid_ho,
 				       comp_mask, &path_parms);
 
 	if (status != IB_SUCCESS) {
-		free(p_pr_item);
-		p_pr_item = NULL;
+		osm_sa_resp_remove_last(p_resp);
+		p_pr_rec = NULL;
 		goto Exit;
 	}
 
@@ -1028,18 +1199,18 @@ static osm_sa_item_t *pr_rcv_get_lid_pair_path(IN osm_sa_t * sa,
 	    !path_parms.reversible && (p_pr->num_path & 0x80)) {
 		OSM_LOG(sa->p_log, OSM_LOG_DEBUG,
 			"Requested reversible path but failed to get one\n");
-		free(p_pr_item);
-		p_pr_item = NULL;
+		osm_sa_resp_remove_last(p_resp);
+		p_pr_rec = NULL;
 		goto Exit;
 	}
 
 	pr_rcv_build_pr(sa, p_src_alias_guid, p_dest_alias_guid, p_sgid, p_dgid,
 			src_lid_ho, dest_lid_ho, preference, &path_parms,
-			&p_pr_item->resp.path_rec);
+			p_pr_rec);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
-	return p_pr_item;
+	return p_pr_rec;
 }
 
 static void pr_rcv_get_port_pair_paths(IN osm_sa_t * sa,
@@ -1049,11 +1220,10 @@ static void pr_rcv_get_port_pair_paths(IN osm_sa_t * sa,
 				       IN const osm_alias_guid_t * p_dest_alias_guid,
 				       IN const ib_gid_t * p_sgid,
 				       IN const ib_gid_t * p_dgid,
-				       IN cl_qlist_t * p_list)
+				       IN osm_sa_resp_t * p_resp)
 {
 	const ib_path_rec_t *p_pr = ib_sa_mad_get_payload_ptr(sa_mad);
 	ib_net64_t comp_mask = sa_mad->comp_mask;
-	osm_sa_item_t *p_pr_item;
 	uint16_t src_lid_min_ho;
 	uint16_t src_lid_max_ho;
 	uint16_t dest_lid_min_ho;
@@ -1190,16 +1360,12 @@ static void pr_rcv_get_port_pair_paths(IN osm_sa_t * sa,
 		   These paths are "fully redundant"
 		 */
 
-		p_pr_item = pr_rcv_get_lid_pair_path(sa, p_pr, p_src_alias_guid,
-						     p_dest_alias_guid,
-						     p_sgid, p_dgid,
-						     src_lid_ho, dest_lid_ho,
-						     comp_mask, preference);
-
-		if (p_pr_item) {
-			cl_qlist_insert_tail(p_list, &p_pr_item->list_item);
+		if (pr_rcv_get_lid_pair_path(sa, p_pr, p_src_alias_guid,
+					     p_dest_alias_guid,
+					     p_sgid, p_dgid,
+					     src_lid_ho, dest_lid_ho,
+					     comp_mask, preference, p_resp))
 			++path_num;
-		}
 
 		if (++src_lid_ho > src_lid_max_ho)
 			break;
@@ -1254,16 +1420,12 @@ static void pr_rcv_get_port_pair_paths(IN osm_sa_t * sa,
 		if (src_offset == dest_offset)
 			continue;	/* already reported */
 
-		p_pr_item = pr_rcv_get_lid_pair_path(sa, p_pr, p_src_alias_guid,
-						     p_dest_alias_guid, p_sgid,
-						     p_dgid, src_lid_ho,
-						     dest_lid_ho, comp_mask,
-						     preference);
-
-		if (p_pr_item) {
-			cl_qlist_insert_tail(p_list, &p_pr_item->list_item);
+		if (pr_rcv_get_lid_pair_path(sa, p_pr, p_src_alias_guid,
+					     p_dest_alias_guid, p_sgid,
+					     p_dgid, src_lid_ho,
+					     dest_lid_ho, comp_mask,
+					     preference, p_resp))
 			++path_num;
-		}
 	}
 
 Exit:
@@ -1445,7 +1607,7 @@ static void pr_rcv_process_world(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad
 				 IN const osm_port_t * requester_port,
 				 IN const ib_gid_t * p_sgid,
 				 IN const ib_gid_t * p_dgid,
-				 IN cl_qlist_t * p_list)
+				 IN osm_sa_resp_t * p_resp)
 {
 	const cl_qmap_t *p_tbl;
 	const osm_alias_guid_t *p_dest_alias_guid, *p_src_alias_guid;
@@ -1469,9 +1631,9 @@ static void pr_rcv_process_world(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad
 			pr_rcv_get_port_pair_paths(sa, sa_mad, requester_port,
 						   p_src_alias_guid,
 						   p_dest_alias_guid,
-						   p_sgid, p_dgid, p_list);
+						   p_sgid, p_dgid, p_resp);
 			if (sa_mad->method == IB_MAD_METHOD_GET &&
-			    cl_qlist_count(p_list) > 0)
+			    p_resp->num_rec > 0)
 				goto Exit;
 
 			p_src_alias_guid =
@@ -1492,7 +1654,7 @@ void osm_pr_process_half(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad,
 				IN const osm_alias_guid_t * p_dest_alias_guid,
 				IN const ib_gid_t * p_sgid,
 				IN const ib_gid_t * p_dgid,
-				IN cl_qlist_t * p_list)
+				IN osm_sa_resp_t * p_resp)
 {
 	const cl_qmap_t *p_tbl;
 	const osm_alias_guid_t *p_alias_guid;
@@ -1515,9 +1677,9 @@ void osm_pr_process_half(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad,
 			pr_rcv_get_port_pair_paths(sa, sa_mad, requester_port,
 						   p_src_alias_guid,
 						   p_alias_guid,
-						   p_sgid, p_dgid, p_list);
+						   p_sgid, p_dgid, p_resp);
 			if (sa_mad->method == IB_MAD_METHOD_GET &&
-			    cl_qlist_count(p_list) > 0)
+			    p_resp->num_rec > 0)
 				break;
 			p_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_alias_guid->map_item);
 		}
@@ -1530,9 +1692,9 @@ void osm_pr_process_half(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad,
 			pr_rcv_get_port_pair_paths(sa, sa_mad, requester_port,
 						   p_alias_guid,
 						   p_dest_alias_guid, p_sgid,
-						   p_dgid, p_list);
+						   p_dgid, p_resp);
 			if (sa_mad->method == IB_MAD_METHOD_GET &&
-			    cl_qlist_count(p_list) > 0)
+			    p_resp->num_rec > 0)
 				break;
 			p_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_alias_guid->map_item);
 		}
@@ -1547,12 +1709,12 @@ void osm_pr_process_pair(IN osm_sa_t * sa, IN const ib_sa_mad_t * sa_mad,
 				IN const osm_alias_guid_t * p_dest_alias_guid,
 				IN const ib_gid_t * p_sgid,
 				IN const ib_gid_t * p_dgid,
-				IN cl_qlist_t * p_list)
+				IN osm_sa_resp_t * p_resp)
 {
 	OSM_LOG_ENTER(sa->p_log);
 
 	pr_rcv_get_port_pair_paths(sa, sa_mad, requester_port, p_src_alias_guid,
-				   p_dest_alias_guid, p_sgid, p_dgid, p_list);
+				   p_dest_alias_guid, p_sgid, p_dgid, p_resp);
 
 	OSM_LOG_EXIT(sa->p_log);
 }
@@ -1665,12 +1827,12 @@ Exit:
 }
 
 static void pr_process_multicast(osm_sa_t * sa, const ib_sa_mad_t *sa_mad,
-				 cl_qlist_t *list)
+				 osm_sa_resp_t *resp)
 {
 	ib_path_rec_t *pr = ib_sa_mad_get_payload_ptr(sa_mad);
 	osm_mgrp_t *mgrp;
 	ib_api_status_t status;
-	osm_sa_item_t *pr_item;
+	ib_path_rec_t *pr_rec;
 	uint32_t flow_label;
 	uint8_t sl, hop_limit;
 
@@ -1694,34 +1856,32 @@ static void pr_process_multicast(osm_sa_t * sa, const ib_sa_mad_t *sa_mad,
 		return;
 	}
 
-	pr_item = malloc(SA_PR_RESP_SIZE);
-	if (pr_item == NULL) {
+	pr_rec = osm_sa_resp_add(resp);
+	if (pr_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 1F18: "
 			"Unable to allocate path record for MC group\n");
 		return;
 	}
-	memset(pr_item, 0, sizeof(cl_list_item_t));
-
 	/* Copy PathRecord request into response */
-	pr_item->resp.path_rec = *pr;
+	*pr_rec = *pr;
 
 	/* Now, use the MC info to cruft up the PathRecord response */
-	pr_item->resp.path_rec.dgid = mgrp->mcmember_rec.mgid;
-	pr_item->resp.path_rec.dlid = mgrp->mcmember_rec.mlid;
-	pr_item->resp.path_rec.tclass = mgrp->mcmember_rec.tclass;
-	pr_item->resp.path_rec.num_path = 1;
-	pr_item->resp.path_rec.pkey = mgrp->mcmember_rec.pkey;
+	pr_rec->dgid = mgrp->mcmember_rec.mgid;
+	pr_rec->dlid = mgrp->mcmember_rec.mlid;
+	pr_rec->tclass = mgrp->mcmember_rec.tclass;
+	pr_rec->num_path = 1;
+	pr_rec->pkey = mgrp->mcmember_rec.pkey;
 
 	/* MTU, rate, and packet lifetime should be exactly */
-	pr_item->resp.path_rec.mtu = (IB_PATH_SELECTOR_EXACTLY << 6) | mgrp->mcmember_rec.mtu;
-	pr_item->resp.path_rec.rate = (IB_PATH_SELECTOR_EXACTLY << 6) | mgrp->mcmember_rec.rate;
-	pr_item->resp.path_rec.pkt_life = (IB_PATH_SELECTOR_EXACTLY << 6) | mgrp->mcmember_rec.pkt_life;
+	pr_rec->mtu = (IB_PATH_SELECTOR_EXACTLY << 6) | mgrp->mcmember_rec.mtu;
+	pr_rec->rate = (IB_PATH_SELECTOR_EXACTLY << 6) | mgrp->mcmember_rec.rate;
+	pr_rec->pkt_life = (IB_PATH_SELECTOR_EXACTLY << 6) | mgrp->mcmember_rec.pkt_life;
 
 	/* SL, Hop Limit, and Flow Label */
 	ib_member_get_sl_flow_hop(mgrp->mcmember_rec.sl_flow_hop,
 				  &sl, &flow_label, &hop_limit);
-	ib_path_rec_set_sl(&pr_item->resp.path_rec, sl);
-	ib_path_rec_set_qos_class(&pr_item->resp.path_rec, 0);
+	ib_path_rec_set_sl(pr_rec, sl);
+	ib_path_rec_set_qos_class(pr_rec, 0);
 
 	/* HopLimit is not yet set in non link local MC groups */
 	/* If it were, this would not be needed */
@@ -1729,10 +1889,8 @@ static void pr_process_multicast(osm_sa_t * sa, const ib_sa_mad_t *sa_mad,
 	    IB_MC_SCOPE_LINK_LOCAL)
 		hop_limit = IB_HOPLIMIT_MAX;
 
-	pr_item->resp.path_rec.hop_flow_raw =
+	pr_rec->hop_flow_raw =
 	    cl_hton32(hop_limit) | (flow_label << 8);
-
-	cl_qlist_insert_tail(list, &pr_item->list_item);
 }
 
 void osm_pr_rcv_process(IN void *context, IN void *data)
@@ -1741,7 +1899,7 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 	osm_madw_t *p_madw = data;
 	const ib_sa_mad_t *p_sa_mad = osm_madw_get_sa_mad_ptr(p_madw);
 	ib_path_rec_t *p_pr = ib_sa_mad_get_payload_ptr(p_sa_mad);
-	cl_qlist_t pr_list;
+	osm_sa_resp_t pr_resp;
 	const ib_gid_t *p_sgid = NULL, *p_dgid = NULL;
 	const osm_alias_guid_t *p_src_alias_guid, *p_dest_alias_guid;
 	const osm_port_t *p_src_port, *p_dest_port;
@@ -1793,7 +1951,7 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 		goto Exit;
 	}
 
-	cl_qlist_init(&pr_list);
+	osm_sa_resp_init(&pr_resp, sizeof(ib_path_rec_t));
 
 	/*
 	   Most SA functions (including this one) are read-only on the
@@ -1822,7 +1980,7 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 	/* Handle multicast destinations separately */
 	if ((p_sa_mad->comp_mask & IB_PR_COMPMASK_DGID) &&
 	    ib_gid_is_multicast(&p_pr->dgid)) {
-		pr_process_multicast(sa, p_sa_mad, &pr_list);
+		pr_process_multicast(sa, p_sa_mad, &pr_resp);
 		goto Unlock;
 	}
 
@@ -1868,11 +2026,11 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 		if (p_dest_alias_guid)
 			osm_pr_process_pair(sa, p_sa_mad, requester_port,
 					    p_src_alias_guid, p_dest_alias_guid,
-					    p_sgid, p_dgid, &pr_list);
+					    p_sgid, p_dgid, &pr_resp);
 		else if (!p_dest_port)
 			osm_pr_process_half(sa, p_sa_mad, requester_port,
 					    p_src_alias_guid, NULL, p_sgid,
-					    p_dgid, &pr_list);
+					    p_dgid, &pr_resp);
 		else {
 			/* Get all alias GUIDs for the dest port */
 			p_dest_alias_guid = (osm_alias_guid_t *) cl_qmap_head(&sa->p_subn->alias_port_guid_tbl);
@@ -1885,9 +2043,9 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 							    p_src_alias_guid,
 							    p_dest_alias_guid,
 							    p_sgid, p_dgid,
-							    &pr_list);
+							    &pr_resp);
 				if (p_sa_mad->method == IB_MAD_METHOD_GET &&
-				    cl_qlist_count(&pr_list) > 0)
+				    pr_resp.num_rec > 0)
 					break;
 
 				p_dest_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_dest_alias_guid->map_item);
@@ -1897,13 +2055,13 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 		if (p_dest_alias_guid && !p_src_port)
 			osm_pr_process_half(sa, p_sa_mad, requester_port,
 					    NULL, p_dest_alias_guid, p_sgid,
-					    p_dgid, &pr_list);
+					    p_dgid, &pr_resp);
 		else if (!p_src_port && !p_dest_port)
 			/*
 			   Katie, bar the door!
 			 */
 			pr_rcv_process_world(sa, p_sa_mad, requester_port,
-					     p_sgid, p_dgid, &pr_list);
+					     p_sgid, p_dgid, &pr_resp);
 		else if (p_dest_alias_guid && p_src_port) {
 			/* Get all alias GUIDs for the src port */
 			p_src_alias_guid = (osm_alias_guid_t *) cl_qmap_head(&sa->p_subn->alias_port_guid_tbl);
@@ -1917,9 +2075,9 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 							    p_src_alias_guid,
 							    p_dest_alias_guid,
 							    p_sgid, p_dgid,
-							    &pr_list);
+							    &pr_resp);
 				if (p_sa_mad->method == IB_MAD_METHOD_GET &&
-				    cl_qlist_count(&pr_list) > 0)
+				    pr_resp.num_rec > 0)
 					break;
 				p_src_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_src_alias_guid->map_item);
 			}
@@ -1935,7 +2093,7 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 							    requester_port,
 							    p_src_alias_guid,
 							    NULL, p_sgid,
-							    p_dgid, &pr_list);
+							    p_dgid, &pr_resp);
 				p_src_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_src_alias_guid->map_item);
 			}
 		} else if (p_dest_port && !p_src_port) {
@@ -1951,7 +2109,7 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 							    NULL,
 							    p_dest_alias_guid,
 							    p_sgid, p_dgid,
-							    &pr_list);
+							    &pr_resp);
 				p_dest_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_dest_alias_guid->map_item);
 			}
 		} else {
@@ -1976,15 +2134,15 @@ void osm_pr_rcv_process(IN void *context, IN void *data)
 								    p_dest_alias_guid,
 								    p_sgid,
 								    p_dgid,
-								    &pr_list);
+								    &pr_resp);
 						if (p_sa_mad->method == IB_MAD_METHOD_GET &&
-						    cl_qlist_count(&pr_list) > 0)
+						    pr_resp.num_rec > 0)
 							break;
 						p_dest_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_dest_alias_guid->map_item);
 					}
 				}
 				if (p_sa_mad->method == IB_MAD_METHOD_GET &&
-				    cl_qlist_count(&pr_list) > 0)
+				    pr_resp.num_rec > 0)
 					break;
 				p_src_alias_guid = (osm_alias_guid_t *) cl_qmap_next(&p_src_alias_guid->map_item);
 			}
@@ -1995,7 +2153,7 @@ Unlock:
 	cl_plock_release(sa->p_lock);
 
 	/* Now, (finally) respond to the PathRecord request */
-	osm_sa_respond(sa, p_madw, sizeof(ib_path_rec_t), &pr_list);
+	osm_sa_resp_send(sa, p_madw, &pr_resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -61,12 +61,10 @@
 #include <opensm/osm_pkey.h>
 #include <opensm/osm_sa.h>
 
-#define SA_PIR_RESP_SIZE SA_ITEM_RESP_SIZE(port_rec)
-
 typedef struct osm_pir_search_ctxt {
 	const ib_portinfo_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	osm_sa_t *sa;
 	const osm_physp_t *p_req_physp;
 	boolean_t is_enhanced_comp_mask;
@@ -77,15 +75,15 @@ static ib_api_status_t pir_rcv_new_pir(IN osm_sa_t * sa,
 				       IN osm_pir_search_ctxt_t * p_ctxt,
 				       IN ib_net16_t const lid)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_portinfo_record_t *p_rec;
 	ib_port_info_t *p_pi;
 	osm_physp_t *p_physp0;
 	ib_api_status_t status = IB_SUCCESS;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_PIR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_ctxt->p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 2102: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
@@ -98,12 +96,10 @@ static ib_api_status_t pir_rcv_new_pir(IN osm_sa_t * sa,
 		cl_ntoh64(osm_physp_get_port_guid(p_physp)),
 		cl_ntoh16(lid), osm_physp_get_port_num(p_physp));
 
-	memset(p_rec_item, 0, SA_PIR_RESP_SIZE);
-
-	p_rec_item->resp.port_rec.lid = lid;
-	p_rec_item->resp.port_rec.port_info = p_physp->port_info;
+	p_rec->lid = lid;
+	p_rec->port_info = p_physp->port_info;
 	if (p_ctxt->comp_mask & IB_PIR_COMPMASK_OPTIONS)
-		p_rec_item->resp.port_rec.options = p_ctxt->p_rcvd_rec->options;
+		p_rec->options = p_ctxt->p_rcvd_rec->options;
 	if ((p_ctxt->comp_mask & IB_PIR_COMPMASK_OPTIONS) == 0 ||
 	    (p_ctxt->p_rcvd_rec->options & 0x80) == 0) {
 		/* Does requested port have an extended link speed active ? */
@@ -116,7 +112,7 @@ static ib_api_status_t pir_rcv_new_pir(IN osm_sa_t * sa,
 		if ((p_pi->capability_mask & IB_PORT_CAP_HAS_EXT_SPEEDS) > 0) {
 			if (ib_port_info_get_link_speed_ext_active(&p_physp->port_info)) {
 				/* Add QDR bits to original link speed components */
-				p_pi = &p_rec_item->resp.port_rec.port_info;
+				p_pi = &p_rec->port_info;
 				ib_port_info_set_link_speed_enabled(p_pi,
 								    ib_port_info_get_link_speed_enabled(p_pi) | IB_LINK_SPEED_ACTIVE_10);
 				p_pi->state_info1 =
@@ -128,9 +124,7 @@ static ib_api_status_t pir_rcv_new_pir(IN osm_sa_t * sa,
 			}
 		}
 	}
-	p_rec_item->resp.port_rec.port_num = osm_physp_get_port_num(p_physp);
-
-	cl_qlist_insert_tail(p_ctxt->p_list, &p_rec_item->list_item);
+	p_rec->port_num = osm_physp_get_port_num(p_physp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -510,7 +504,8 @@ void osm_pir_rcv_process(IN void *ctx, IN void *data)
 	const ib_sa_mad_t *p_rcvd_mad;
 	const ib_portinfo_record_t *p_rcvd_rec;
 	const osm_port_t *p_port = NULL;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
+	osm_sa_cache_req_t cache_req;
 	osm_pir_search_ctxt_t context;
 	ib_net64_t comp_mask;
 	osm_physp_t *p_req_physp;
@@ -558,10 +553,17 @@ void osm_pir_rcv_process(IN void *ctx, IN void *data)
 		osm_dump_portinfo_record_v2(sa->p_log, p_rcvd_rec, FILE_ID, OSM_LOG_DEBUG);
 	}
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_portinfo_record_t));
+	osm_sa_cache_req_init(sa, &cache_req, p_rcvd_mad,
+			      sizeof(ib_portinfo_record_t));
+	osm_sa_cache_req_add_physp(&cache_req, p_req_physp);
+	if (osm_sa_cache_get(sa, &cache_req, &resp)) {
+		cl_plock_release(sa->p_lock);
+		goto Send;
+	}
 
 	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
+	context.p_resp = &resp;
 	context.comp_mask = p_rcvd_mad->comp_mask;
 	context.sa = sa;
 	context.p_req_physp = p_req_physp;
@@ -594,14 +596,17 @@ void osm_pir_rcv_process(IN void *ctx, IN void *data)
 	   sm_key.
 	 */
 	if (!p_rcvd_mad->sm_key) {
-		osm_sa_item_t *item;
-		for (item = (osm_sa_item_t *) cl_qlist_head(&rec_list);
-		     item != (osm_sa_item_t *) cl_qlist_end(&rec_list);
-		     item = (osm_sa_item_t *) cl_qlist_next(&item->list_item))
-			item->resp.port_rec.port_info.m_key = 0;
+		ib_portinfo_record_t *p_rec =
+		    (ib_portinfo_record_t *) resp.recs;
+		unsigned i;
+		for (i = 0; i < resp.num_rec; i++)
+			p_rec[i].port_info.m_key = 0;
 	}
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_portinfo_record_t), &rec_list);
+	osm_sa_cache_put(sa, &cache_req, &resp);
+
+Send:
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
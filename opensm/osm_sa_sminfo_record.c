@@ -66,31 +66,29 @@
 #include <opensm/osm_sa.h>
 #include <opensm/osm_opensm.h>
 
-#define SA_SMIR_RESP_SIZE SA_ITEM_RESP_SIZE(sminfo_rec)
-
 typedef struct osm_smir_search_ctxt {
 	const ib_sminfo_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	osm_sa_t *sa;
 	const osm_physp_t *p_req_physp;
 } osm_smir_search_ctxt_t;
 
 static ib_api_status_t smir_rcv_new_smir(IN osm_sa_t * sa,
 					 IN const osm_port_t * p_port,
-					 IN cl_qlist_t * p_list,
+					 IN osm_sa_resp_t * p_resp,
 					 IN ib_net64_t const guid,
 					 IN ib_net32_t const act_count,
 					 IN uint8_t const pri_state,
 					 IN const osm_physp_t * p_req_physp)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_sminfo_record_t *p_rec;
 	ib_api_status_t status = IB_SUCCESS;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_SMIR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 2801: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
@@ -100,14 +98,10 @@ static ib_api_status_t smir_rcv_new_smir(IN osm_sa_t * sa,
 	OSM_LOG(sa->p_log, OSM_LOG_DEBUG,
 		"New SMInfo: GUID 0x%016" PRIx64 "\n", cl_ntoh64(guid));
 
-	memset(p_rec_item, 0, SA_SMIR_RESP_SIZE);
-
-	p_rec_item->resp.sminfo_rec.lid = osm_port_get_base_lid(p_port);
-	p_rec_item->resp.sminfo_rec.sm_info.guid = guid;
-	p_rec_item->resp.sminfo_rec.sm_info.act_count = act_count;
-	p_rec_item->resp.sminfo_rec.sm_info.pri_state = pri_state;
-
-	cl_qlist_insert_tail(p_list, &p_rec_item->list_item);
+	p_rec->lid = osm_port_get_base_lid(p_port);
+	p_rec->sm_info.guid = guid;
+	p_rec->sm_info.act_count = act_count;
+	p_rec->sm_info.pri_state = pri_state;
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -151,7 +145,7 @@ static void sa_smir_by_comp_mask(IN osm_sa_t * sa,
                 goto Exit;
         }
 
-	smir_rcv_new_smir(sa, p_port, p_ctxt->p_list,
+	smir_rcv_new_smir(sa, p_port, p_ctxt->p_resp,
 			  p_rem_sm->smi.guid, p_rem_sm->smi.act_count,
 			  p_rem_sm->smi.pri_state, p_req_physp);
 
@@ -175,7 +169,7 @@ void osm_smir_rcv_process(IN void *ctx, IN void *data)
 	const ib_sminfo_record_t *p_rcvd_rec;
 	const osm_port_t *p_port = NULL;
 	const ib_sm_info_t *p_smi;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
 	osm_smir_search_ctxt_t context;
 	ib_api_status_t status = IB_SUCCESS;
 	ib_net64_t comp_mask;
@@ -230,10 +224,10 @@ void osm_smir_rcv_process(IN void *ctx, IN void *data)
 
 	p_smi = &p_rcvd_rec->sm_info;
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_sminfo_record_t));
 
 	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
+	context.p_resp = &resp;
 	context.comp_mask = sad_mad->comp_mask;
 	context.sa = sa;
 	context.p_req_physp = p_req_physp;
@@ -290,7 +284,7 @@ void osm_smir_rcv_process(IN void *ctx, IN void *data)
 			/* Now, add local SMInfo to list */
 			pri_state = sa->p_subn->sm_state & 0x0F;
 			pri_state |= (sa->p_subn->opt.sm_priority & 0x0F) << 4;
-			smir_rcv_new_smir(sa, local_port, context.p_list,
+			smir_rcv_new_smir(sa, local_port, context.p_resp,
 					  sa->p_subn->sm_port_guid,
 					  cl_ntoh32(sa->p_subn->p_osm->stats.
 						    qp0_mads_sent), pri_state,
@@ -321,7 +315,7 @@ void osm_smir_rcv_process(IN void *ctx, IN void *data)
 
 	cl_plock_release(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_sminfo_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2020-2024 ETH Zurich. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ *    Implementation of osm_sa_snapshot_t.
+ * Read-only snapshots of the subnet, published at the end of the
+ * sweeps, from which the SA answers queries without the subnet lock.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <iba/ib_types.h>
+#include <complib/cl_debug.h>
+#include <complib/cl_passivelock.h>
+#include <opensm/osm_file_ids.h>
+#define FILE_ID OSM_FILE_SA_SNAPSHOT_C
+#include <opensm/osm_node.h>
+#include <opensm/osm_port.h>
+#include <opensm/osm_pkey.h>
+#include <opensm/osm_subnet.h>
+#include <opensm/osm_sa.h>
+
+/* snapshot PKeys are in host order */
+#define SNAP_PKEY_BASE(pkey) ((pkey) & 0x7FFF)
+#define SNAP_PKEY_FULL 0x8000
+
+static void snapshot_free(IN osm_sa_snapshot_t * p_snap)
+{
+	free(p_snap->ports);
+	free(p_snap->pkeys);
+	free(p_snap->lid_tbl);
+	free(p_snap);
+}
+
+static int compar_pkey(const void *p1, const void *p2)
+{
+	uint16_t pkey1 = SNAP_PKEY_BASE(*(const uint16_t *)p1);
+	uint16_t pkey2 = SNAP_PKEY_BASE(*(const uint16_t *)p2);
+
+	return (int)pkey1 - (int)pkey2;
+}
+
+/*
+ * Copies the PKeys of a port, one per base PKey with the membership
+ * bit set if any of the entries with that base is a full member.
+ */
+static uint16_t snapshot_copy_pkeys(IN const osm_physp_t * p_physp,
+				    OUT uint16_t * pkeys)
+{
+	const osm_pkey_tbl_t *p_pkey_tbl = osm_physp_get_pkey_tbl(p_physp);
+	cl_map_iterator_t map_iter;
+	uint16_t i, num = 0;
+
+	for (map_iter = cl_map_head(&p_pkey_tbl->keys);
+	     map_iter != cl_map_end(&p_pkey_tbl->keys);
+	     map_iter = cl_map_next(map_iter))
+		pkeys[num++] = cl_ntoh16(*(ib_net16_t *) cl_map_obj(map_iter));
+
+	qsort(pkeys, num, sizeof(*pkeys), compar_pkey);
+
+	for (i = 1; i < num;) {
+		if (SNAP_PKEY_BASE(pkeys[i]) != SNAP_PKEY_BASE(pkeys[i - 1])) {
+			i++;
+			continue;
+		}
+		pkeys[i - 1] |= pkeys[i] & SNAP_PKEY_FULL;
+		memmove(&pkeys[i], &pkeys[i + 1],
+			(num - i - 1) * sizeof(*pkeys));
+		num--;
+	}
+
+	return num;
+}
+
+static osm_sa_snapshot_t *snapshot_build(IN osm_sa_t * sa)
+{
+	osm_subn_t *p_subn = sa->p_subn;
+	osm_sa_snapshot_t *p_snap;
+	osm_sa_snap_port_t *p_snap_port;
+	cl_map_item_t *p_item;
+	osm_node_t *p_node;
+	osm_physp_t *p_physp;
+	osm_port_t *p_port;
+	uint32_t num_ports = 0, num_pkeys = 0, i, lid_ho;
+	uint16_t min_lid_ho, max_lid_ho;
+	uint8_t port_num, num_physp;
+
+	p_snap = calloc(1, sizeof(*p_snap));
+	if (!p_snap)
+		return NULL;
+
+	/* same ports as the NodeRecord receiver reports */
+	for (p_item = cl_qmap_head(&p_subn->node_guid_tbl);
+	     p_item != cl_qmap_end(&p_subn->node_guid_tbl);
+	     p_item = cl_qmap_next(p_item)) {
+		p_node = (osm_node_t *) p_item;
+		num_physp = osm_node_get_type(p_node) == IB_NODE_TYPE_SWITCH ?
+		    1 : osm_node_get_num_physp(p_node);
+		for (port_num = 0; port_num < num_physp; port_num++) {
+			p_physp = osm_node_get_physp_ptr(p_node, port_num);
+			if (!p_physp)
+				continue;
+			num_ports++;
+			num_pkeys += cl_map_count(&p_physp->pkeys.keys);
+		}
+	}
+
+	if (cl_ptr_vector_get_size(&p_subn->port_lid_tbl))
+		p_snap->max_lid_ho = (uint16_t)
+		    (cl_ptr_vector_get_size(&p_subn->port_lid_tbl) - 1);
+	p_snap->ports = malloc((num_ports + 1) * sizeof(*p_snap->ports));
+	p_snap->pkeys = malloc((num_pkeys + 1) * sizeof(*p_snap->pkeys));
+	p_snap->lid_tbl = malloc((p_snap->max_lid_ho + 1) *
+				 sizeof(*p_snap->lid_tbl));
+	if (!p_snap->ports || !p_snap->pkeys || !p_snap->lid_tbl) {
+		snapshot_free(p_snap);
+		return NULL;
+	}
+	for (lid_ho = 0; lid_ho <= p_snap->max_lid_ho; lid_ho++)
+		p_snap->lid_tbl[lid_ho] = OSM_SA_SNAP_NO_PORT;
+
+	num_pkeys = 0;
+	for (p_item = cl_qmap_head(&p_subn->node_guid_tbl);
+	     p_item != cl_qmap_end(&p_subn->node_guid_tbl);
+	     p_item = cl_qmap_next(p_item)) {
+		p_node = (osm_node_t *) p_item;
+		num_physp = osm_node_get_type(p_node) == IB_NODE_TYPE_SWITCH ?
+		    1 : osm_node_get_num_physp(p_node);
+		for (port_num = 0; port_num < num_physp; port_num++) {
+			p_physp = osm_node_get_physp_ptr(p_node, port_num);
+			if (!p_physp)
+				continue;
+
+			i = p_snap->num_ports++;
+			p_snap_port = &p_snap->ports[i];
+			memset(p_snap_port, 0, sizeof(*p_snap_port));
+			p_snap_port->node_rec.lid =
+			    osm_physp_get_base_lid(p_physp);
+			p_snap_port->node_rec.node_info = p_node->node_info;
+			p_snap_port->node_rec.node_info.port_guid =
+			    osm_physp_get_port_guid(p_physp);
+			p_snap_port->node_rec.node_info.port_num_vendor_id =
+			    (p_node->node_info.port_num_vendor_id &
+			     IB_NODE_INFO_VEND_ID_MASK) |
+			    ((port_num << IB_NODE_INFO_PORT_NUM_SHIFT) &
+			     IB_NODE_INFO_PORT_NUM_MASK);
+			memcpy(&p_snap_port->node_rec.node_desc,
+			       &p_node->node_desc, IB_NODE_DESCRIPTION_SIZE);
+			p_snap_port->lmc = osm_physp_get_lmc(p_physp);
+			p_snap_port->pkeys = num_pkeys;
+			p_snap_port->num_pkeys =
+			    snapshot_copy_pkeys(p_physp,
+						&p_snap->pkeys[num_pkeys]);
+			num_pkeys += p_snap_port->num_pkeys;
+
+			/* the LIDs osm_get_port_by_lid maps to this port */
+			p_port = osm_get_port_by_guid(p_subn,
+						      osm_physp_get_port_guid
+						      (p_physp));
+			if (!p_port || p_port->p_physp != p_physp)
+				continue;
+			osm_port_get_lid_range_ho(p_port, &min_lid_ho,
+						  &max_lid_ho);
+			for (lid_ho = min_lid_ho;
+			     min_lid_ho && lid_ho <= max_lid_ho &&
+			     lid_ho <= p_snap->max_lid_ho; lid_ho++)
+				if (cl_ptr_vector_get(&p_subn->port_lid_tbl,
+						      lid_ho) == p_port)
+					p_snap->lid_tbl[lid_ho] = i;
+		}
+	}
+
+	return p_snap;
+}
+
+/* makes p_snap (may be NULL) the current snapshot */
+static void snapshot_swap(IN osm_sa_t * sa, IN osm_sa_snapshot_t * p_snap)
+{
+	osm_sa_snapshot_t *p_old;
+
+	cl_spinlock_acquire(&sa->snapshot_lock);
+	p_old = sa->p_snapshot;
+	sa->p_snapshot = p_snap;
+	sa->snapshot_version++;
+	if (p_snap)
+		p_snap->version = sa->snapshot_version;
+	cl_spinlock_release(&sa->snapshot_lock);
+
+	if (p_old)
+		osm_sa_snapshot_put(p_old);
+}
+
+void osm_sa_snapshot_publish(IN osm_sa_t * sa)
+{
+	osm_sa_snapshot_t *p_snap;
+
+	OSM_LOG_ENTER(sa->p_log);
+
+	if (!sa->p_subn->opt.sa_snapshot) {
+		osm_sa_snapshot_invalidate(sa);
+		goto Exit;
+	}
+
+	/* swapped in under the subnet lock, so an invalidation by a
+	   change made after the build cannot be overwritten by it */
+	cl_plock_acquire(sa->p_lock);
+	p_snap = snapshot_build(sa);
+	if (!p_snap) {
+		cl_plock_release(sa->p_lock);
+		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 4F01: "
+			"cannot allocate memory for the SA snapshot, "
+			"dropping the previous one\n");
+		osm_sa_snapshot_invalidate(sa);
+		goto Exit;
+	}
+	p_snap->ref_cnt = 1;
+	snapshot_swap(sa, p_snap);
+	OSM_LOG(sa->p_log, OSM_LOG_VERBOSE,
+		"Published SA snapshot %u with %u ports\n",
+		p_snap->version, p_snap->num_ports);
+	cl_plock_release(sa->p_lock);
+
+Exit:
+	OSM_LOG_EXIT(sa->p_log);
+}
+
+void osm_sa_snapshot_invalidate(IN osm_sa_t * sa)
+{
+	if (sa->p_snapshot)
+		snapshot_swap(sa, NULL);
+}
+
+osm_sa_snapshot_t *osm_sa_snapshot_get(IN osm_sa_t * sa)
+{
+	osm_sa_snapshot_t *p_snap;
+
+	cl_spinlock_acquire(&sa->snapshot_lock);
+	p_snap = sa->p_snapshot;
+	if (p_snap)
+		cl_atomic_inc(&p_snap->ref_cnt);
+	cl_spinlock_release(&sa->snapshot_lock);
+
+	return p_snap;
+}
+
+void osm_sa_snapshot_put(IN osm_sa_snapshot_t * p_snap)
+{
+	if (!cl_atomic_dec(&p_snap->ref_cnt))
+		snapshot_free(p_snap);
+}
+
+boolean_t osm_sa_snapshot_share_pkey(IN const osm_sa_snapshot_t * p_snap,
+				     IN uint32_t port_1, IN uint32_t port_2)
+{
+	const osm_sa_snap_port_t *p_port_1 = &p_snap->ports[port_1];
+	const osm_sa_snap_port_t *p_port_2 = &p_snap->ports[port_2];
+	const uint16_t *pkey_1 = &p_snap->pkeys[p_port_1->pkeys];
+	const uint16_t *pkey_2 = &p_snap->pkeys[p_port_2->pkeys];
+	const uint16_t *end_1 = pkey_1 + p_port_1->num_pkeys;
+	const uint16_t *end_2 = pkey_2 + p_port_2->num_pkeys;
+	uint16_t base_1, base_2;
+
+	if (port_1 == port_2 || pkey_1 == end_1 || pkey_2 == end_2)
+		return TRUE;
+
+	/* both are sorted by base PKey */
+	while (pkey_1 < end_1 && pkey_2 < end_2) {
+		base_1 = SNAP_PKEY_BASE(*pkey_1);
+		base_2 = SNAP_PKEY_BASE(*pkey_2);
+		if (base_1 == base_2) {
+			if ((*pkey_1 | *pkey_2) & SNAP_PKEY_FULL)
+				return TRUE;
+			pkey_1++;
+			pkey_2++;
+		} else if (base_1 < base_2)
+			pkey_1++;
+		else
+			pkey_2++;
+	}
+
+	return FALSE;
+}
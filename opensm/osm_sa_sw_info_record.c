@@ -57,28 +57,26 @@
 #include <opensm/osm_pkey.h>
 #include <opensm/osm_sa.h>
 
-#define SA_SIR_RESP_SIZE SA_ITEM_RESP_SIZE(swinfo_rec)
-
 typedef struct osm_sir_search_ctxt {
 	const ib_switch_info_record_t *p_rcvd_rec;
 	ib_net64_t comp_mask;
-	cl_qlist_t *p_list;
+	osm_sa_resp_t *p_resp;
 	osm_sa_t *sa;
 	const osm_physp_t *p_req_physp;
 } osm_sir_search_ctxt_t;
 
 static ib_api_status_t sir_rcv_new_sir(IN osm_sa_t * sa,
 				       IN const osm_switch_t * p_sw,
-				       IN cl_qlist_t * p_list,
+				       IN osm_sa_resp_t * p_resp,
 				       IN ib_net16_t lid)
 {
-	osm_sa_item_t *p_rec_item;
+	ib_switch_info_record_t *p_rec;
 	ib_api_status_t status = IB_SUCCESS;
 
 	OSM_LOG_ENTER(sa->p_log);
 
-	p_rec_item = malloc(SA_SIR_RESP_SIZE);
-	if (p_rec_item == NULL) {
+	p_rec = osm_sa_resp_add(p_resp);
+	if (p_rec == NULL) {
 		OSM_LOG(sa->p_log, OSM_LOG_ERROR, "ERR 5308: "
 			"rec_item alloc failed\n");
 		status = IB_INSUFFICIENT_RESOURCES;
@@ -88,12 +86,8 @@ static ib_api_status_t sir_rcv_new_sir(IN osm_sa_t * sa,
 	OSM_LOG(sa->p_log, OSM_LOG_DEBUG,
 		"New SwitchInfoRecord: lid %u\n", cl_ntoh16(lid));
 
-	memset(p_rec_item, 0, SA_SIR_RESP_SIZE);
-
-	p_rec_item->resp.swinfo_rec.lid = lid;
-	p_rec_item->resp.swinfo_rec.switch_info = p_sw->switch_info;
-
-	cl_qlist_insert_tail(p_list, &p_rec_item->list_item);
+	p_rec->lid = lid;
+	p_rec->switch_info = p_sw->switch_info;
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -101,7 +95,7 @@ Exit:
 }
 
 static void sir_rcv_create_sir(IN osm_sa_t * sa, IN const osm_switch_t * p_sw,
-			       IN cl_qlist_t * p_list, IN ib_net16_t match_lid,
+			       IN osm_sa_resp_t * p_resp, IN ib_net16_t match_lid,
 			       IN const osm_physp_t * p_req_physp)
 {
 	osm_port_t *p_port;
@@ -157,7 +151,7 @@ static void sir_rcv_create_sir(IN osm_sa_t * sa, IN const osm_switch_t * p_sw,
 
 	}
 
-	sir_rcv_new_sir(sa, p_sw, p_list, osm_port_get_base_lid(p_port));
+	sir_rcv_new_sir(sa, p_sw, p_resp, osm_port_get_base_lid(p_port));
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
@@ -184,7 +178,7 @@ static void sir_rcv_by_comp_mask(IN cl_map_item_t * p_map_item, IN void *cxt)
 			goto Exit;
 	}
 
-	sir_rcv_create_sir(sa, p_sw, p_ctxt->p_list, match_lid, p_req_physp);
+	sir_rcv_create_sir(sa, p_sw, p_ctxt->p_resp, match_lid, p_req_physp);
 
 Exit:
 	OSM_LOG_EXIT(p_ctxt->sa->p_log);
@@ -196,7 +190,7 @@ void osm_sir_rcv_process(IN void *ctx, IN void *data)
 	osm_madw_t *p_madw = data;
 	const ib_sa_mad_t *sad_mad;
 	const ib_switch_info_record_t *p_rcvd_rec;
-	cl_qlist_t rec_list;
+	osm_sa_resp_t resp;
 	osm_sir_search_ctxt_t context;
 	osm_physp_t *p_req_physp;
 
@@ -243,10 +237,10 @@ void osm_sir_rcv_process(IN void *ctx, IN void *data)
 					       FILE_ID, OSM_LOG_DEBUG);
 	}
 
-	cl_qlist_init(&rec_list);
+	osm_sa_resp_init(&resp, sizeof(ib_switch_info_record_t));
 
 	context.p_rcvd_rec = p_rcvd_rec;
-	context.p_list = &rec_list;
+	context.p_resp = &resp;
 	context.comp_mask = sad_mad->comp_mask;
 	context.sa = sa;
 	context.p_req_physp = p_req_physp;
@@ -257,7 +251,7 @@ void osm_sir_rcv_process(IN void *ctx, IN void *data)
 
 	cl_plock_release(sa->p_lock);
 
-	osm_sa_respond(sa, p_madw, sizeof(ib_switch_info_record_t), &rec_list);
+	osm_sa_resp_send(sa, p_madw, &resp);
 
 Exit:
 	OSM_LOG_EXIT(sa->p_log);
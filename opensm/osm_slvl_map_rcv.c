@@ -57,6 +57,7 @@
 #include <opensm/osm_subnet.h>
 #include <opensm/osm_helper.h>
 #include <opensm/osm_sm.h>
+#include <opensm/osm_opensm.h>
 
 /*
  * WE ONLY RECEIVE GET or SET responses
@@ -76,6 +77,7 @@ void osm_slvl_rcv_process(IN void *context, IN void *p_data)
 	uint32_t attr_mod;
 	uint8_t startinport, endinport, startoutport, endoutport;
 	uint8_t in_port, out_port;
+	boolean_t changed = FALSE;
 
 	CL_ASSERT(sm);
 
@@ -160,10 +162,18 @@ void osm_slvl_rcv_process(IN void *context, IN void *p_data)
 
 	for (out_port = startoutport; out_port <= endoutport; out_port++) {
 		p_physp = osm_node_get_physp_ptr(p_node, out_port);
-		for (in_port = startinport; in_port <= endinport; in_port++)
+		for (in_port = startinport; in_port <= endinport; in_port++) {
+			if (memcmp(osm_physp_get_slvl_tbl(p_physp, in_port),
+				   p_slvl_tbl, sizeof(*p_slvl_tbl)))
+				changed = TRUE;
 			osm_physp_set_slvl_tbl(p_physp, p_slvl_tbl, in_port);
+		}
 	}
 
+	/* the valid SLs of the cached paths may have changed */
+	if (changed)
+		osm_sa_pr_cache_flush(&sm->p_subn->p_osm->sa);
+
 Exit:
 	cl_plock_release(sm->p_lock);
 
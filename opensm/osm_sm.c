@@ -168,6 +168,7 @@ void osm_sm_construct(IN osm_sm_t * p_sm)
 	osm_sm_mad_ctrl_construct(&p_sm->mad_ctrl);
 	osm_lid_mgr_construct(&p_sm->lid_mgr);
 	osm_ucast_mgr_construct(&p_sm->ucast_mgr);
+	osm_sweep_prof_construct(&p_sm->sweep_prof);
 }
 
 void osm_sm_shutdown(IN osm_sm_t * p_sm)
@@ -224,6 +225,7 @@ void osm_sm_destroy(IN osm_sm_t * p_sm)
 	OSM_LOG_ENTER(p_sm->p_log);
 	osm_lid_mgr_destroy(&p_sm->lid_mgr);
 	osm_ucast_mgr_destroy(&p_sm->ucast_mgr);
+	osm_sweep_prof_destroy(&p_sm->sweep_prof);
 	cl_event_wheel_destroy(&p_sm->trap_aging_tracker);
 	cl_timer_destroy(&p_sm->sweep_timer);
 	cl_timer_destroy(&p_sm->polling_timer);
@@ -310,6 +312,11 @@ ib_api_status_t osm_sm_init(IN osm_sm_t * p_sm, IN osm_subn_t * p_subn,
 	if (status != IB_SUCCESS)
 		goto Exit;
 
+	status = osm_sweep_prof_init(&p_sm->sweep_prof, p_stats,
+				     p_subn->opt.sweep_profile_history);
+	if (status != IB_SUCCESS)
+		goto Exit;
+
 	status = IB_INSUFFICIENT_RESOURCES;
 	p_sm->sweep_fail_disp_h = cl_disp_register(p_disp,
 						   OSM_MSG_LIGHT_SWEEP_FAIL,
@@ -362,6 +369,10 @@ ib_api_status_t osm_sm_init(IN osm_sm_t * p_sm, IN osm_subn_t * p_subn,
 	if (p_sm->trap_disp_h == CL_DISP_INVALID_HANDLE)
 		goto Exit;
 
+	/* SMInfo and traps are processed one at a time, in order */
+	cl_disp_set_affinity(p_sm->sm_info_disp_h, TRUE);
+	cl_disp_set_affinity(p_sm->trap_disp_h, TRUE);
+
 	p_sm->slvl_disp_h = cl_disp_register(p_disp, OSM_MSG_MAD_SLVL,
 					     osm_slvl_rcv_process, p_sm);
 	if (p_sm->slvl_disp_h == CL_DISP_INVALID_HANDLE)
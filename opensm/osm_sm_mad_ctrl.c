@@ -144,11 +144,14 @@ static void sm_mad_ctrl_disp_done_callback(IN void *context, IN void *p_data)
  * sm_mad_ctrl_update_wire_stats
  *
  * DESCRIPTION
- * Updates wire stats for outstanding MADs and calls the VL15 poller.
+ * Updates wire stats for outstanding MADs, accounts for the completed
+ * request MAD in the VL15 interface and calls the VL15 poller.
  *
  * SYNOPSIS
  */
-static void sm_mad_ctrl_update_wire_stats(IN osm_sm_mad_ctrl_t * p_ctrl)
+static void sm_mad_ctrl_update_wire_stats(IN osm_sm_mad_ctrl_t * p_ctrl,
+					  IN const osm_madw_t * p_req_madw,
+					  IN ib_api_status_t status)
 {
 	uint32_t mads_on_wire;
 
@@ -161,6 +164,8 @@ static void sm_mad_ctrl_update_wire_stats(IN osm_sm_mad_ctrl_t * p_ctrl)
 		"%u SMPs on the wire, %u outstanding\n", mads_on_wire,
 		p_ctrl->p_stats->qp0_mads_outstanding);
 
+	osm_vl15_complete(p_ctrl->p_vl15, p_req_madw, status);
+
 	/*
 	   We can signal the VL15 controller to send another MAD
 	   if any are waiting for transmission.
@@ -203,7 +208,7 @@ static void sm_mad_ctrl_process_get_resp(IN osm_sm_mad_ctrl_t * p_ctrl,
 
 	p_old_madw = transaction_context;
 
-	sm_mad_ctrl_update_wire_stats(p_ctrl);
+	sm_mad_ctrl_update_wire_stats(p_ctrl, p_old_madw, IB_SUCCESS);
 
 	/*
 	   Copy the MAD Wrapper context from the requesting MAD
@@ -523,7 +528,8 @@ Exit:
  * SYNOPSIS
  */
 static void sm_mad_ctrl_process_trap_repress(IN osm_sm_mad_ctrl_t * p_ctrl,
-					     IN osm_madw_t * p_madw)
+					     IN osm_madw_t * p_madw,
+					     IN osm_madw_t * p_req_madw)
 {
 	ib_smp_t *p_smp;
 
@@ -537,7 +543,7 @@ static void sm_mad_ctrl_process_trap_repress(IN osm_sm_mad_ctrl_t * p_ctrl,
 	 */
 	switch (p_smp->attr_id) {
 	case IB_MAD_ATTR_NOTICE:
-		sm_mad_ctrl_update_wire_stats(p_ctrl);
+		sm_mad_ctrl_update_wire_stats(p_ctrl, p_req_madw, IB_SUCCESS);
 		sm_mad_ctrl_retire_trans_mad(p_ctrl, p_madw);
 		break;
 	default:
@@ -674,7 +680,7 @@ static void sm_mad_ctrl_rcv_callback(IN osm_madw_t * p_madw,
 		break;
 	case IB_MAD_METHOD_TRAP_REPRESS:
 		CL_ASSERT(p_req_madw != NULL);
-		sm_mad_ctrl_process_trap_repress(p_ctrl, p_madw);
+		sm_mad_ctrl_process_trap_repress(p_ctrl, p_madw, p_req_madw);
 		break;
 	case IB_MAD_METHOD_SEND:
 	case IB_MAD_METHOD_REPORT:
@@ -702,6 +708,62 @@ Exit:
  * SEE ALSO
  *********/
 
+/****f* opensm: SM/sm_mad_ctrl_retry_dr
+ * NAME
+ * sm_mad_ctrl_retry_dr
+ *
+ * DESCRIPTION
+ * Resends a failed LID routed SMP with its directed route.
+ * Returns TRUE if the SMP was resent.
+ *
+ * SYNOPSIS
+ */
+static boolean_t sm_mad_ctrl_retry_dr(IN osm_sm_mad_ctrl_t * p_ctrl,
+				      IN osm_madw_t * p_madw)
+{
+	ib_smp_t *p_smp = osm_madw_get_smp_ptr(p_madw);
+
+	if (p_smp->mgmt_class != IB_MCLASS_SUBN_LID || !p_madw->dr_fallback ||
+	    osm_exit_flag)
+		return FALSE;
+
+	OSM_LOG(p_ctrl->p_log, OSM_LOG_VERBOSE,
+		"LID routed %s(%s) to LID %u completed in error (%s), "
+		"resending with directed route\n",
+		ib_get_sm_method_str(p_smp->method),
+		ib_get_sm_attr_str(p_smp->attr_id),
+		cl_ntoh16(p_madw->mad_addr.dest_lid),
+		ib_get_err_str(p_madw->status));
+
+	sm_mad_ctrl_update_wire_stats(p_ctrl, p_madw, p_madw->status);
+
+	p_smp->mgmt_class = IB_MCLASS_SUBN_DIR;
+	p_smp->status = 0;
+	p_smp->hop_ptr = 0;
+	p_smp->hop_count = p_madw->dr_hop_count;
+	p_smp->dr_slid = IB_LID_PERMISSIVE;
+	p_smp->dr_dlid = IB_LID_PERMISSIVE;
+	memcpy(p_smp->initial_path, p_madw->dr_path,
+	       sizeof(p_smp->initial_path));
+	memset(p_smp->return_path, 0, sizeof(p_smp->return_path));
+
+	p_madw->mad_addr.dest_lid = IB_LID_PERMISSIVE;
+	p_madw->mad_addr.addr_type.smi.source_lid = IB_LID_PERMISSIVE;
+	p_madw->dr_fallback = FALSE;
+	p_madw->status = IB_SUCCESS;
+	p_madw->send_time = 0;
+
+	/*
+	   Post before retiring the failed transaction, so the count
+	   of outstanding MADs does not drop to zero in between.
+	 */
+	cl_atomic_inc(&p_ctrl->p_stats->qp0_mads_resent);
+	osm_vl15_post(p_ctrl->p_vl15, p_madw);
+	osm_stats_dec_qp0_outstanding(p_ctrl->p_stats);
+
+	return TRUE;
+}
+
 /****f* opensm: SM/sm_mad_ctrl_send_err_cb
  * NAME
  * sm_mad_ctrl_send_err_cb
@@ -722,6 +784,11 @@ static void sm_mad_ctrl_send_err_cb(IN void *context, IN osm_madw_t * p_madw)
 
 	CL_ASSERT(p_madw);
 
+	cl_atomic_inc(&p_ctrl->p_stats->qp0_mads_failed);
+
+	if (sm_mad_ctrl_retry_dr(p_ctrl, p_madw))
+		goto Exit;
+
 	p_smp = osm_madw_get_smp_ptr(p_madw);
 	OSM_LOG(p_ctrl->p_log, OSM_LOG_ERROR, "ERR 3113: "
 		"MAD completed in error (%s): "
@@ -790,7 +857,7 @@ static void sm_mad_ctrl_send_err_cb(IN void *context, IN osm_madw_t * p_madw)
 	   An error occurred.  No response was received to a request MAD.
 	   Retire the original request MAD.
 	 */
-	sm_mad_ctrl_update_wire_stats(p_ctrl);
+	sm_mad_ctrl_update_wire_stats(p_ctrl, p_madw, p_madw->status);
 
 	if (osm_madw_get_err_msg(p_madw) != CL_DISP_MSGID_NONE) {
 		OSM_LOG(p_ctrl->p_log, OSM_LOG_DEBUG,
@@ -810,6 +877,7 @@ static void sm_mad_ctrl_send_err_cb(IN void *context, IN osm_madw_t * p_madw)
 		 */
 		sm_mad_ctrl_retire_trans_mad(p_ctrl, p_madw);
 
+Exit:
 	OSM_LOG_EXIT(p_ctrl->p_log);
 }
 
@@ -71,6 +71,7 @@
 #include <opensm/osm_db.h>
 #include <opensm/osm_service.h>
 #include <opensm/osm_guid.h>
+#include <opensm/osm_ucast_backup.h>
 
 extern void osm_drop_mgr_process(IN osm_sm_t * sm);
 extern int osm_qos_setup(IN osm_opensm_t * p_osm);
@@ -187,6 +188,7 @@ static void state_mgr_get_remote_port_info(IN osm_sm_t * sm,
 	mad_context.pi_context.port_guid = p_physp->port_guid;
 	mad_context.pi_context.set_method = FALSE;
 	mad_context.pi_context.light_sweep = TRUE;
+	mad_context.pi_context.backup_lft = FALSE;
 	mad_context.pi_context.active_transition = FALSE;
 	mad_context.pi_context.client_rereg = FALSE;
 
@@ -813,6 +815,7 @@ static ib_api_status_t state_mgr_light_sweep_start(IN osm_sm_t * sm)
 	}
 
 	OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE, "INITIATING LIGHT SWEEP");
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_LIGHT_SWEEP);
 	CL_PLOCK_ACQUIRE(sm->p_lock);
 	cl_qmap_apply_func(p_sw_tbl, state_mgr_get_sw_info, sm);
 	CL_PLOCK_RELEASE(sm->p_lock);
@@ -1287,7 +1290,12 @@ static void do_sweep(osm_sm_t * sm)
 	    sm->p_subn->sm_state != IB_SMINFO_STATE_DISCOVERING)
 		return;
 
+	osm_sweep_prof_start(&sm->sweep_prof);
+
 	if (sm->p_subn->coming_out_of_standby) {
+		/* another SM may have changed the LIDs and LFTs */
+		sm->p_subn->lid_routed_smps_ok = FALSE;
+
 		/*
 		 * Need to force re-write of sm_base_lid to all ports
 		 * to do that we want all the ports to be considered
@@ -1366,11 +1374,13 @@ static void do_sweep(osm_sm_t * sm)
 		/* Re-program the switches fully */
 		sm->p_subn->ignore_existing_lfts = TRUE;
 
+		osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_UCAST_MGR);
 		if (osm_ucast_mgr_process(&sm->ucast_mgr)) {
 			OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE,
 					"REROUTE FAILED");
 			return;
 		}
+		osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_QOS);
 		osm_qos_setup(sm->p_subn->p_osm);
 
 		/* Reset flag */
@@ -1379,6 +1389,7 @@ static void do_sweep(osm_sm_t * sm)
 		if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 			return;
 
+		osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_CONGESTION_CONTROL);
 		osm_congestion_control_setup(sm->p_subn->p_osm);
 
 		if (osm_congestion_control_wait_pending_transactions(sm->p_subn->p_osm))
@@ -1420,6 +1431,7 @@ repeat_discovery:
 	if (sm->p_subn->sm_state != IB_SMINFO_STATE_MASTER)
 		sm->p_subn->need_update = 1;
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_DISCOVERY_HOP_0);
 	status = state_mgr_sweep_hop_0(sm);
 	if (status != IB_SUCCESS ||
 	    wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
@@ -1436,6 +1448,7 @@ repeat_discovery:
 		}
 
 		/* Run the drop manager - we want to clear all records */
+		osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_DROP_MGR);
 		osm_drop_mgr_process(sm);
 
 		/* Move to DISCOVERING state */
@@ -1454,6 +1467,7 @@ repeat_discovery:
 		}
 	}
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_DISCOVERY);
 	status = state_mgr_sweep_hop_1(sm);
 	if (status != IB_SUCCESS ||
 	    wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
@@ -1487,6 +1501,7 @@ repeat_discovery:
 
 	OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE, "HEAVY SWEEP COMPLETE");
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_DROP_MGR);
 	osm_drop_mgr_process(sm);
 
 	/* If we are MASTER - get the highest remote_sm, and
@@ -1540,6 +1555,7 @@ repeat_discovery:
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 		return;
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_PKEY_MGR);
 	osm_pkey_mgr_process(sm->p_subn->p_osm);
 
 	/* try to restore SA DB (this should be before lid_mgr
@@ -1553,6 +1569,7 @@ repeat_discovery:
 	OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE,
 			"PKEY setup completed - STARTING SM LID CONFIG");
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_SM_LID);
 	osm_lid_mgr_process_sm(&sm->lid_mgr);
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 		return;
@@ -1561,6 +1578,7 @@ repeat_discovery:
 			"SM LID ASSIGNMENT COMPLETE - STARTING SUBNET LID CONFIG");
 	state_mgr_notify_lid_change(sm);
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_SUBNET_LID);
 	osm_lid_mgr_process_subnet(&sm->lid_mgr);
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 		return;
@@ -1579,14 +1597,21 @@ repeat_discovery:
 	 * return early to wait for a trap or the next sweep interval.
 	 */
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_UCAST_MGR);
 	if (!sm->ucast_mgr.cache_valid ||
 	    osm_ucast_cache_process(&sm->ucast_mgr)) {
 		if (osm_ucast_mgr_process(&sm->ucast_mgr)) {
 			osm_ucast_cache_invalidate(&sm->ucast_mgr);
 			return;
 		}
+	} else {
+		/* computed from the LFTs which the cache just changed */
+		CL_PLOCK_EXCL_ACQUIRE(sm->p_lock);
+		osm_ucast_backup_clear(&sm->ucast_mgr);
+		CL_PLOCK_RELEASE(sm->p_lock);
 	}
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_QOS);
 	osm_qos_setup(sm->p_subn->p_osm);
 
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
@@ -1604,6 +1629,7 @@ repeat_discovery:
 				(void *) UCAST_ROUTING_HEAVY_SWEEP);
 
 	if (!sm->p_subn->opt.disable_multicast) {
+		osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_MCAST_MGR);
 		osm_mcast_mgr_process(sm, TRUE);
 		if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 			return;
@@ -1611,6 +1637,7 @@ repeat_discovery:
 				"SWITCHES CONFIGURED FOR MULTICAST");
 	}
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_GUID_MGR);
 	osm_guid_mgr_process(sm);
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 		return;
@@ -1624,6 +1651,7 @@ repeat_discovery:
 	 * other parameters provided by the Set(PortInfo) Packet.
 	 */
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_LINK_INIT);
 	osm_link_mgr_process(sm, IB_LINK_NO_CHANGE);
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 		return;
@@ -1631,6 +1659,7 @@ repeat_discovery:
 	OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE,
 			"LINKS PORTS CONFIGURED - SET LINKS TO ARMED STATE");
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_LINK_ARMED);
 	osm_link_mgr_process(sm, IB_LINK_ARMED);
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 		return;
@@ -1638,6 +1667,7 @@ repeat_discovery:
 	OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_VERBOSE,
 			"LINKS ARMED - SET LINKS TO ACTIVE STATE");
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_LINK_ACTIVE);
 	osm_link_mgr_process(sm, IB_LINK_ACTIVE);
 	if (wait_for_pending_transactions(&sm->p_subn->p_osm->stats))
 		return;
@@ -1648,6 +1678,7 @@ repeat_discovery:
 
 	/* Now do GSI configuration */
 
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_CONGESTION_CONTROL);
 	osm_congestion_control_setup(sm->p_subn->p_osm);
 
 	if (osm_congestion_control_wait_pending_transactions(sm->p_subn->p_osm))
@@ -1656,6 +1687,7 @@ repeat_discovery:
 	/*
 	 * Send trap 64 on newly discovered endports
 	 */
+	osm_sweep_prof_phase(&sm->sweep_prof, OSM_SWEEP_PHASE_SUBNET_UP);
 	state_mgr_report_new_ports(sm);
 
 	/* check switch lft buffers assignments */
@@ -1672,8 +1704,10 @@ repeat_discovery:
 			   "Errors during initialization\n");
 		OSM_LOG_MSG_BOX(sm->p_log, OSM_LOG_ERROR,
 				"ERRORS DURING INITIALIZATION");
+		sm->p_subn->lid_routed_smps_ok = FALSE;
 	} else {
 		sm->p_subn->need_update = 0;
+		sm->p_subn->lid_routed_smps_ok = TRUE;
 		osm_dump_all(sm->p_subn->p_osm);
 		state_mgr_up_msg(sm);
 
@@ -1722,6 +1756,8 @@ static void do_process_guid_queue(osm_sm_t *sm)
 
 void osm_state_mgr_process(IN osm_sm_t * sm, IN osm_signal_t signal)
 {
+	const osm_sweep_prof_rec_t *p_prof_rec;
+
 	CL_ASSERT(sm);
 
 	OSM_LOG_ENTER(sm->p_log);
@@ -1737,8 +1773,25 @@ void osm_state_mgr_process(IN osm_sm_t * sm, IN osm_signal_t signal)
 				"ignoring signal %s in state %s\n",
 				osm_get_sm_signal_str(signal),
 				osm_get_sm_mgr_state_str(sm->p_subn->sm_state));
-		} else
+		} else {
+			osm_sa_cache_sweep_start(&sm->p_subn->p_osm->sa);
 			do_sweep(sm);
+			if (sm->ucast_mgr.p_backup) {
+				osm_sweep_prof_phase(&sm->sweep_prof,
+						     OSM_SWEEP_PHASE_BACKUP_LFTS);
+				osm_ucast_backup_build(&sm->ucast_mgr);
+			}
+			/* also after a sweep with errors or cut short, so the
+			   snapshot does not keep nodes which are gone */
+			if (sm->p_subn->sm_state == IB_SMINFO_STATE_MASTER)
+				osm_sa_snapshot_publish(&sm->p_subn->p_osm->sa);
+			osm_sa_cache_sweep_done(&sm->p_subn->p_osm->sa);
+			p_prof_rec = osm_sweep_prof_done(&sm->sweep_prof);
+			if (p_prof_rec)
+				osm_opensm_report_event(sm->p_subn->p_osm,
+							OSM_EVENT_ID_SWEEP_PROFILE,
+							(void *)p_prof_rec);
+		}
 		break;
 	case OSM_SIGNAL_IDLE_TIME_PROCESS_REQUEST:
 		do_process_mgrp_queue(sm);
@@ -773,6 +773,9 @@ static const opt_rec_t opt_tbl[] = {
 	{ "max_wire_smps", OPT_OFFSET(max_wire_smps), opts_parse_uint32, NULL, 1 },
 	{ "max_wire_smps2", OPT_OFFSET(max_wire_smps2), opts_parse_uint32, NULL, 1 },
 	{ "max_smps_timeout", OPT_OFFSET(max_smps_timeout), opts_parse_uint32, NULL, 1 },
+	{ "max_wire_smps_per_dest", OPT_OFFSET(max_wire_smps_per_dest), opts_parse_uint32, NULL, 1 },
+	{ "adaptive_wire_smps", OPT_OFFSET(adaptive_wire_smps), opts_parse_boolean, NULL, 1 },
+	{ "lid_routed_smps", OPT_OFFSET(lid_routed_smps), opts_parse_boolean, NULL, 1 },
 	{ "console", OPT_OFFSET(console), opts_parse_charp, NULL, 0 },
 	{ "console_port", OPT_OFFSET(console_port), opts_parse_uint16, NULL, 0 },
 	{ "transaction_timeout", OPT_OFFSET(transaction_timeout), opts_parse_uint32, NULL, 0 },
@@ -815,6 +818,7 @@ static const opt_rec_t opt_tbl[] = {
 	{ "use_ucast_cache", OPT_OFFSET(use_ucast_cache), opts_parse_boolean, NULL, 0 },
 	{ "log_file", OPT_OFFSET(log_file), opts_parse_charp, NULL, 0 },
 	{ "log_max_size", OPT_OFFSET(log_max_size), opts_parse_uint32, opts_setup_log_max_size, 1 },
+	{ "sweep_profile_history", OPT_OFFSET(sweep_profile_history), opts_parse_uint32, NULL, 0 },
 	{ "log_flags", OPT_OFFSET(log_flags), opts_parse_uint8, opts_setup_log_flags, 1 },
 	{ "force_log_flush", OPT_OFFSET(force_log_flush), opts_parse_boolean, opts_setup_force_log_flush, 1 },
 	{ "accum_log_file", OPT_OFFSET(accum_log_file), opts_parse_boolean, opts_setup_accum_log_file, 1 },
@@ -835,12 +839,17 @@ static const opt_rec_t opt_tbl[] = {
 	{ "io_guid_file", OPT_OFFSET(io_guid_file), opts_parse_charp, NULL, 0 },
 	{ "port_shifting", OPT_OFFSET(port_shifting), opts_parse_boolean, NULL, 1 },
 	{ "scatter_ports", OPT_OFFSET(scatter_ports), opts_parse_uint32, NULL, 1 },
+	{ "lft_num_threads", OPT_OFFSET(lft_num_threads), opts_parse_uint8, NULL, 1 },
+	{ "backup_lfts", OPT_OFFSET(backup_lfts), opts_parse_boolean, NULL, 1 },
 	{ "max_reverse_hops", OPT_OFFSET(max_reverse_hops), opts_parse_uint16, NULL, 0 },
 	{ "ids_guid_file", OPT_OFFSET(ids_guid_file), opts_parse_charp, NULL, 0 },
 	{ "guid_routing_order_file", OPT_OFFSET(guid_routing_order_file), opts_parse_charp, NULL, 0 },
 	{ "guid_routing_order_no_scatter", OPT_OFFSET(guid_routing_order_no_scatter), opts_parse_boolean, NULL, 0 },
 	{ "sa_db_file", OPT_OFFSET(sa_db_file), opts_parse_charp, NULL, 0 },
 	{ "sa_db_dump", OPT_OFFSET(sa_db_dump), opts_parse_boolean, NULL, 1 },
+	{ "sa_pr_cache", OPT_OFFSET(sa_pr_cache), opts_parse_boolean, NULL, 1 },
+	{ "sa_snapshot", OPT_OFFSET(sa_snapshot), opts_parse_boolean, NULL, 1 },
+	{ "sa_cache_size", OPT_OFFSET(sa_cache_size), opts_parse_uint32, NULL, 1 },
 	{ "torus_config", OPT_OFFSET(torus_conf_file), opts_parse_charp, NULL, 1 },
 	{ "lnmp_config", OPT_OFFSET(lnmp_conf_file), opts_parse_charp, NULL, 1 },
 	{ "do_mesh_analysis", OPT_OFFSET(do_mesh_analysis), opts_parse_boolean, NULL, 1 },
@@ -867,6 +876,9 @@ static const opt_rec_t opt_tbl[] = {
 	{ "perfmgr_query_cpi", OPT_OFFSET(perfmgr_query_cpi), opts_parse_boolean, NULL, 0 },
 	{ "perfmgr_xmit_wait_log", OPT_OFFSET(perfmgr_xmit_wait_log), opts_parse_boolean, NULL, 0 },
 	{ "perfmgr_xmit_wait_threshold", OPT_OFFSET(perfmgr_xmit_wait_threshold), opts_parse_uint32, NULL, 0 },
+	{ "perfmgr_history_samples", OPT_OFFSET(perfmgr_history_samples), opts_parse_uint32, NULL, 0 },
+	{ "perfmgr_history_file", OPT_OFFSET(perfmgr_history_file), opts_parse_charp, NULL, 0 },
+	{ "perfmgr_stream", OPT_OFFSET(perfmgr_stream), opts_parse_boolean, NULL, 0 },
 #endif				/* ENABLE_OSM_PERF_MGR */
 	{ "event_plugin_name", OPT_OFFSET(event_plugin_name), opts_parse_charp, NULL, 0 },
 	{ "event_plugin_options", OPT_OFFSET(event_plugin_options), opts_parse_charp, NULL, 0 },
@@ -922,12 +934,19 @@ static const opt_rec_t opt_tbl[] = {
 	{ "sm_sl", OPT_OFFSET(sm_sl), opts_parse_uint8, NULL, 1 },
 	{ "nue_max_num_vls", OPT_OFFSET(nue_max_num_vls), opts_parse_uint8, NULL, 1 },
 	{ "nue_include_switches", OPT_OFFSET(nue_include_switches), opts_parse_boolean, NULL, 0 },
+	{ "nue_num_threads", OPT_OFFSET(nue_num_threads), opts_parse_uint8, NULL, 1 },
 	{ "lnmp_max_num_paths", OPT_OFFSET(lnmp_max_num_paths), opts_parse_uint32, NULL, 1 },
 	{ "lnmp_min_path_len", OPT_OFFSET(lnmp_min_path_len), opts_parse_uint8, NULL, 1 },
 	{ "lnmp_max_path_len", OPT_OFFSET(lnmp_max_path_len), opts_parse_uint8, NULL, 1 },
+	{ "lnmp_num_threads", OPT_OFFSET(lnmp_num_threads), opts_parse_uint8, NULL, 1 },
 	{ "dfsssp_max_vls", OPT_OFFSET(dfsssp_max_vls), opts_parse_uint8, NULL, 1 },
     { "layers_remove_deadlocks", OPT_OFFSET(layers_remove_deadlocks), opts_parse_boolean, NULL, 0 },
     { "dfsssp_best_effort", OPT_OFFSET(dfsssp_best_effort), opts_parse_boolean, NULL, 0 },
+	{ "dfsssp_vltable_per_switch", OPT_OFFSET(dfsssp_vltable_per_switch), opts_parse_boolean, NULL, 1 },
+	{ "dfsssp_num_threads", OPT_OFFSET(dfsssp_num_threads), opts_parse_uint8, NULL, 1 },
+	{ "dfsssp_batch_size", OPT_OFFSET(dfsssp_batch_size), opts_parse_uint32, NULL, 1 },
+	{ "dfsssp_incremental_cdg", OPT_OFFSET(dfsssp_incremental_cdg), opts_parse_boolean, NULL, 1 },
+	{ "dfsssp_incremental_reroute", OPT_OFFSET(dfsssp_incremental_reroute), opts_parse_boolean, NULL, 1 },
 	{ "log_prefix", OPT_OFFSET(log_prefix), opts_parse_charp, NULL, 1 },
 	{ "per_module_logging_file", OPT_OFFSET(per_module_logging_file), opts_parse_charp, NULL, 0 },
 	{ "quasi_ftree_indexing", OPT_OFFSET(quasi_ftree_indexing), opts_parse_boolean, NULL, 1 },
@@ -1121,6 +1140,7 @@ static void subn_opt_destroy(IN osm_subn_opt_t * p_opt)
     free(p_opt->lnmp_conf_file);
 #ifdef ENABLE_OSM_PERF_MGR
 	free(p_opt->event_db_dump_file);
+	free(p_opt->perfmgr_history_file);
 #endif /* ENABLE_OSM_PERF_MGR */
 	free(p_opt->event_plugin_name);
 	free(p_opt->event_plugin_options);
@@ -1573,6 +1593,9 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->long_transaction_timeout = OSM_DEFAULT_LONG_TRANS_TIMEOUT_MILLISEC;
 	p_opt->max_smps_timeout = 1000 * p_opt->transaction_timeout *
 				  p_opt->transaction_retries;
+	p_opt->max_wire_smps_per_dest = 0;
+	p_opt->adaptive_wire_smps = FALSE;
+	p_opt->lid_routed_smps = FALSE;
 	/* by default we will consider waiting for 50x transaction timeout normal */
 	p_opt->max_msg_fifo_timeout = 50 * OSM_DEFAULT_TRANS_TIMEOUT_MILLISEC;
 	p_opt->sm_priority = OSM_DEFAULT_SM_PRIORITY;
@@ -1626,6 +1649,9 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->perfmgr_query_cpi = TRUE;
 	p_opt->perfmgr_xmit_wait_log = FALSE;
 	p_opt->perfmgr_xmit_wait_threshold = OSM_PERFMGR_DEFAULT_XMIT_WAIT_THRESHOLD;
+	p_opt->perfmgr_history_samples = 0;
+	p_opt->perfmgr_history_file = NULL;
+	p_opt->perfmgr_stream = FALSE;
 #endif				/* ENABLE_OSM_PERF_MGR */
 
 	p_opt->event_plugin_name = NULL;
@@ -1639,6 +1665,7 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 		p_opt->dump_files_dir = strdup(p_opt->dump_files_dir);
 	p_opt->log_file = strdup(OSM_DEFAULT_LOG_FILE);
 	p_opt->log_max_size = 0;
+	p_opt->sweep_profile_history = 0;
 	p_opt->partition_config_file = strdup(OSM_DEFAULT_PARTITION_CONFIG_FILE);
 	p_opt->no_partition_enforcement = FALSE;
 	p_opt->part_enforce = strdup(OSM_PARTITION_ENFORCE_BOTH);
@@ -1665,12 +1692,17 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->io_guid_file = NULL;
 	p_opt->port_shifting = FALSE;
 	p_opt->scatter_ports = OSM_DEFAULT_SCATTER_PORTS;
+	p_opt->lft_num_threads = 1;
+	p_opt->backup_lfts = FALSE;
 	p_opt->max_reverse_hops = 0;
 	p_opt->ids_guid_file = NULL;
 	p_opt->guid_routing_order_file = NULL;
 	p_opt->guid_routing_order_no_scatter = FALSE;
 	p_opt->sa_db_file = NULL;
 	p_opt->sa_db_dump = FALSE;
+	p_opt->sa_pr_cache = FALSE;
+	p_opt->sa_snapshot = FALSE;
+	p_opt->sa_cache_size = 0;
 	p_opt->torus_conf_file = strdup(OSM_DEFAULT_TORUS_CONF_FILE);
 	p_opt->lnmp_conf_file = strdup(OSM_DEFAULT_LNMP_CONF_FILE);
 	p_opt->do_mesh_analysis = FALSE;
@@ -1686,12 +1718,19 @@ void osm_subn_set_default_opt(IN osm_subn_opt_t * p_opt)
 	p_opt->sm_sl = OSM_DEFAULT_SL;
 	p_opt->nue_max_num_vls = 1;
 	p_opt->nue_include_switches = FALSE;
+	p_opt->nue_num_threads = 1;
 	p_opt->lnmp_max_num_paths = 100000;
 	p_opt->lnmp_min_path_len = 2;
 	p_opt->lnmp_max_path_len = 3;
+	p_opt->lnmp_num_threads = 1;
 	p_opt->dfsssp_max_vls = 0;
     p_opt->layers_remove_deadlocks = TRUE;
     p_opt->dfsssp_best_effort = FALSE;
+	p_opt->dfsssp_vltable_per_switch = FALSE;
+	p_opt->dfsssp_num_threads = 1;
+	p_opt->dfsssp_batch_size = 0;
+	p_opt->dfsssp_incremental_cdg = FALSE;
+	p_opt->dfsssp_incremental_reroute = FALSE;
 	p_opt->log_prefix = NULL;
 	p_opt->per_module_logging_file = strdup(OSM_DEFAULT_PER_MOD_LOGGING_CONF_FILE);
 	subn_init_qos_options(&p_opt->qos_options, NULL);
@@ -2698,6 +2737,13 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"nue_include_switches %s\n\n",
 		p_opts->nue_include_switches ? "TRUE" : "FALSE");
 
+	fprintf(out,
+		"# Number of threads used by Nue routing to route the virtual\n"
+		"# layers concurrently (0 = one per processor). With more than\n"
+		"# one thread the paths are only balanced within each layer\n"
+		"nue_num_threads %u\n\n",
+		p_opts->nue_num_threads);
+
 	fprintf(out,
 		"# Maximum number of paths added per layer for LNMP routing.\n"
 		"# Default is 100000.\n"
@@ -2718,6 +2764,13 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"lnmp_max_path_len %u\n\n",
 		p_opts->lnmp_max_path_len);
 
+	fprintf(out,
+		"# Number of threads used to search the paths of each layer for\n"
+		"# LNMP routing. Set to 0 to use one thread per processor.\n"
+		"# The resulting LFTs do not depend on this value. Default is 1.\n"
+		"lnmp_num_threads %u\n\n",
+		p_opts->lnmp_num_threads);
+
 	fprintf(out,
 		"# Maximum number of Virtual Lanes used for deadlock removal by DFSSSP.\n"
 		"# Default is 0.\n"
@@ -2734,6 +2787,47 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
         "dfsssp_best_effort %s\n\n",
         p_opts->dfsssp_best_effort ? "TRUE" : "FALSE");
 
+	fprintf(out,
+		"# Store the VL of DFSSSP/LNMP paths per (source switch, dest LID)\n"
+		"# instead of per (source LID, dest LID). Needs far less memory on\n"
+		"# large fabrics. Default is FALSE.\n"
+		"dfsssp_vltable_per_switch %s\n\n",
+		p_opts->dfsssp_vltable_per_switch ? "TRUE" : "FALSE");
+
+	fprintf(out,
+		"# Number of threads used by (DF)SSSP routing to compute the shortest\n"
+		"# paths towards several destinations at once. Set to 0 to use one\n"
+		"# thread per processor. Default is 1.\n"
+		"dfsssp_num_threads %u\n\n",
+		p_opts->dfsssp_num_threads);
+
+	fprintf(out,
+		"# Number of destinations (DF)SSSP routes with the same link weights\n"
+		"# before the weights are updated. Larger batches scale better with\n"
+		"# dfsssp_num_threads but balance the paths less evenly. The result\n"
+		"# only depends on this value, not on the number of threads.\n"
+		"# 0 uses dfsssp_num_threads. Default is 0.\n"
+		"dfsssp_batch_size %u\n\n",
+		p_opts->dfsssp_batch_size);
+
+	fprintf(out,
+		"# Assign each path the first VL whose channel dependency graph\n"
+		"# stays acyclic (kept in topological order while paths are added)\n"
+		"# instead of searching and breaking cycles afterwards. Used by\n"
+		"# dfsssp and layers_remove_deadlocks. Default is FALSE.\n"
+		"dfsssp_incremental_cdg %s\n\n",
+		p_opts->dfsssp_incremental_cdg ? "TRUE" : "FALSE");
+
+	fprintf(out,
+		"# Keep the forwarding tables of the last (df)sssp routing, and when\n"
+		"# only links between switches changed, route again just the LIDs\n"
+		"# whose paths used a failed link or get shorter thru a new one.\n"
+		"# The other paths keep their link weights and VLs; the VLs are only\n"
+		"# reassigned for the rerouted paths if they stay acyclic.\n"
+		"# Default is FALSE.\n"
+		"dfsssp_incremental_reroute %s\n\n",
+		p_opts->dfsssp_incremental_reroute ? "TRUE" : "FALSE");
+
 	fprintf(out,
 		"# Port Shifting (use FALSE if unsure)\n"
 		"port_shifting %s\n\n",
@@ -2745,6 +2839,24 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"scatter_ports %d\n\n",
 		p_opts->scatter_ports);
 
+	fprintf(out,
+		"# Number of threads building the LFTs of the switches\n"
+		"# concurrently (minhop, updn, dnup and the file fallback).\n"
+		"# 0 uses one thread per processor. scatter_ports forces\n"
+		"# a single thread. Default is 1.\n"
+		"lft_num_threads %u\n\n",
+		p_opts->lft_num_threads);
+
+	fprintf(out,
+		"# Compute backup LFT blocks after the routing for the\n"
+		"# switches at both ends of each link between switches, and\n"
+		"# send them when a trap 128 leads to a PortInfo showing the\n"
+		"# link down, before the subnet is routed again. A backup port\n"
+		"# is only used if it adds no cycle to the channel dependencies\n"
+		"# of all VLs taken together. Default is FALSE.\n"
+		"backup_lfts %s\n\n",
+		p_opts->backup_lfts ? "TRUE" : "FALSE");
+
 	fprintf(out,
 		"# Don't use scatter for ports defined in\n"
 		"# guid_routing_order file\n"
@@ -2761,6 +2873,26 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"sa_db_dump %s\n\n",
 		p_opts->sa_db_dump ? "TRUE" : "FALSE");
 
+	fprintf(out,
+		"# If TRUE the SA caches the path parameters per ingress switch\n"
+		"# and destination LID for the PathRecord queries\n"
+		"sa_pr_cache %s\n\n",
+		p_opts->sa_pr_cache ? "TRUE" : "FALSE");
+
+	fprintf(out,
+		"# If TRUE the SA answers NodeRecord queries from a snapshot\n"
+		"# of the subnet published after each sweep, without locking\n"
+		"# the subnet\n"
+		"sa_snapshot %s\n\n",
+		p_opts->sa_snapshot ? "TRUE" : "FALSE");
+
+	fprintf(out,
+		"# Maximum number of NodeRecord, PortInfoRecord and LinkRecord\n"
+		"# GetTable responses cached by the SA until the next sweep\n"
+		"# (0 disables the cache)\n"
+		"sa_cache_size %u\n\n",
+		p_opts->sa_cache_size);
+
 	fprintf(out,
 		"# Torus-2QoS configuration file name\ntorus_config %s\n\n",
 		p_opts->torus_conf_file ? p_opts->torus_conf_file : null_str);
@@ -2799,6 +2931,15 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"# The timeout in [usec] used for sending SMPs above max_wire_smps limit\n"
 		"# and below max_wire_smps2 limit\n"
 		"max_smps_timeout %u\n\n"
+		"# Maximum number of SMPs sent in parallel to the same destination\n"
+		"# LID or directed route (0 means no limit)\n"
+		"max_wire_smps_per_dest %u\n\n"
+		"# Adapt the number of SMPs sent in parallel to the response latency,\n"
+		"# between 1 and max_wire_smps2 (max_smps_timeout is then not used)\n"
+		"adaptive_wire_smps %s\n\n"
+		"# Send LFT, MFT, SL2VL and VLArb updates as LID routed SMPs once\n"
+		"# the subnet is up (directed route is used when they fail)\n"
+		"lid_routed_smps %s\n\n"
 		"# The maximum time in [msec] allowed for a transaction to complete\n"
 		"transaction_timeout %u\n\n"
 		"# The maximum number of retries allowed for a transaction to complete\n"
@@ -2816,6 +2957,9 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		p_opts->max_wire_smps,
 		p_opts->max_wire_smps2,
 		p_opts->max_smps_timeout,
+		p_opts->max_wire_smps_per_dest,
+		p_opts->adaptive_wire_smps ? "TRUE" : "FALSE",
+		p_opts->lid_routed_smps ? "TRUE" : "FALSE",
 		p_opts->transaction_timeout,
 		p_opts->transaction_retries,
 		p_opts->long_transaction_timeout,
@@ -2885,6 +3029,18 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"perfmgr_xmit_wait_log %s\n\n"
 		"# If logging xmit_wait's; set threshold (default %u)\n"
 		"perfmgr_xmit_wait_threshold %u\n\n"
+		"# Samples of the data counters and xmit_wait kept per port\n"
+		"# for the rates and the console \"perfmgr top\" command\n"
+		"# (default 0, no history)\n"
+		"perfmgr_history_samples %u\n\n"
+		"# File to keep the history in across restarts\n"
+		"# (default (null), in memory only)\n"
+		"perfmgr_history_file %s\n\n"
+		"# Query the ports as a steady stream spread over the sweep\n"
+		"# time, from a thread of its own, with the number of\n"
+		"# outstanding queries (up to perfmgr_max_outstanding_queries)\n"
+		"# following the response latency (default FALSE)\n"
+		"perfmgr_stream %s\n\n"
 		,
 		p_opts->perfmgr ? "TRUE" : "FALSE",
 		p_opts->perfmgr_redir ? "TRUE" : "FALSE",
@@ -2898,7 +3054,11 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		p_opts->perfmgr_query_cpi ? "TRUE" : "FALSE",
 		p_opts->perfmgr_xmit_wait_log ? "TRUE" : "FALSE",
 		OSM_PERFMGR_DEFAULT_XMIT_WAIT_THRESHOLD,
-		p_opts->perfmgr_xmit_wait_threshold);
+		p_opts->perfmgr_xmit_wait_threshold,
+		p_opts->perfmgr_history_samples,
+		p_opts->perfmgr_history_file ?
+		p_opts->perfmgr_history_file : null_str,
+		p_opts->perfmgr_stream ? "TRUE" : "FALSE");
 
 	fprintf(out,
 		"#\n# Event DB Options\n#\n"
@@ -2944,6 +3104,9 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		"per_module_logging_file %s\n\n"
 		"# The directory to hold the file OpenSM dumps\n"
 		"dump_files_dir %s\n\n"
+		"# Number of sweeps whose per phase profile is kept\n"
+		"# (0 disables the sweep profiler)\n"
+		"sweep_profile_history %u\n\n"
 		"# If TRUE enables new high risk options and hardware specific quirks\n"
 		"enable_quirks %s\n\n"
 		"# If TRUE disables client reregistration\n"
@@ -2972,6 +3135,7 @@ void osm_subn_output_conf(FILE *out, IN osm_subn_opt_t * p_opts)
 		p_opts->per_module_logging_file ?
 			p_opts->per_module_logging_file : null_str,
 		p_opts->dump_files_dir,
+		p_opts->sweep_profile_history,
 		p_opts->enable_quirks ? "TRUE" : "FALSE",
 		p_opts->no_clients_rereg ? "TRUE" : "FALSE",
 		p_opts->disable_multicast ? "TRUE" : "FALSE",
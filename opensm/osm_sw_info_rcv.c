@@ -347,6 +347,7 @@ static void si_rcv_get_sp0_info(IN osm_sm_t * sm, IN osm_node_t * node)
 	context.pi_context.port_guid = osm_physp_get_port_guid(physp);
 	context.pi_context.set_method = FALSE;
 	context.pi_context.light_sweep = FALSE;
+	context.pi_context.backup_lft = FALSE;
 	context.pi_context.active_transition = FALSE;
 	context.pi_context.client_rereg = FALSE;
 
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2020-2024 ETH Zurich. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ *    Implementation of osm_sweep_prof_t.
+ * Per phase profile of the last sweeps.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <iba/ib_types.h>
+#include <complib/cl_timer.h>
+#include <opensm/osm_file_ids.h>
+#define FILE_ID OSM_FILE_SWEEP_PROF_C
+#include <opensm/osm_sweep_prof.h>
+
+static const char *sweep_phase_str[] = {
+	"setup",		/* OSM_SWEEP_PHASE_SETUP */
+	"light sweep",		/* OSM_SWEEP_PHASE_LIGHT_SWEEP */
+	"discovery (hop 0)",	/* OSM_SWEEP_PHASE_DISCOVERY_HOP_0 */
+	"discovery",		/* OSM_SWEEP_PHASE_DISCOVERY */
+	"drop manager",		/* OSM_SWEEP_PHASE_DROP_MGR */
+	"pkey manager",		/* OSM_SWEEP_PHASE_PKEY_MGR */
+	"SM LID",		/* OSM_SWEEP_PHASE_SM_LID */
+	"subnet LIDs",		/* OSM_SWEEP_PHASE_SUBNET_LID */
+	"unicast manager",	/* OSM_SWEEP_PHASE_UCAST_MGR */
+	"build_lid_matrices",	/* OSM_SWEEP_PHASE_BUILD_LID_MATRICES */
+	"ucast_build_fwd_tables",	/* OSM_SWEEP_PHASE_BUILD_FWD_TABLES */
+	"set LFTs",		/* OSM_SWEEP_PHASE_SET_FWD_TABLES */
+	"backup LFTs",		/* OSM_SWEEP_PHASE_BACKUP_LFTS */
+	"QoS",			/* OSM_SWEEP_PHASE_QOS */
+	"multicast manager",	/* OSM_SWEEP_PHASE_MCAST_MGR */
+	"GUID manager",		/* OSM_SWEEP_PHASE_GUID_MGR */
+	"link init",		/* OSM_SWEEP_PHASE_LINK_INIT */
+	"link armed",		/* OSM_SWEEP_PHASE_LINK_ARMED */
+	"link active",		/* OSM_SWEEP_PHASE_LINK_ACTIVE */
+	"congestion control",	/* OSM_SWEEP_PHASE_CONGESTION_CONTROL */
+	"subnet up",		/* OSM_SWEEP_PHASE_SUBNET_UP */
+	"UNKNOWN"		/* OSM_SWEEP_PHASE_MAX */
+};
+
+const char *osm_sweep_phase_str(IN osm_sweep_phase_t phase)
+{
+	if (phase > OSM_SWEEP_PHASE_MAX)
+		phase = OSM_SWEEP_PHASE_MAX;
+	return sweep_phase_str[phase];
+}
+
+const char *osm_sweep_prof_type_str(IN const osm_sweep_prof_rec_t * p_rec)
+{
+	if (p_rec->phase[OSM_SWEEP_PHASE_DISCOVERY_HOP_0].count)
+		return "heavy";
+	if (p_rec->phase[OSM_SWEEP_PHASE_UCAST_MGR].count)
+		return "reroute";
+	if (p_rec->phase[OSM_SWEEP_PHASE_LIGHT_SWEEP].count)
+		return "light";
+	return "none";
+}
+
+/* snapshot of the clocks and counters; count is not used */
+static void sweep_prof_sample(IN osm_sweep_prof_t * p_prof,
+			      OUT osm_sweep_prof_stats_t * p_sample)
+{
+	struct rusage usage;
+
+	p_sample->wall_usec = cl_get_time_stamp();
+	if (getrusage(RUSAGE_SELF, &usage))
+		p_sample->cpu_usec = 0;
+	else
+		p_sample->cpu_usec =
+		    (uint64_t) (usage.ru_utime.tv_sec +
+				usage.ru_stime.tv_sec) * 1000000 +
+		    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	p_sample->mads_sent = p_prof->p_stats->qp0_mads_sent;
+	p_sample->mads_rcvd = p_prof->p_stats->qp0_mads_rcvd;
+	p_sample->mads_failed = p_prof->p_stats->qp0_mads_failed;
+	p_sample->mads_resent = p_prof->p_stats->qp0_mads_resent;
+}
+
+static void sweep_prof_add(OUT osm_sweep_prof_stats_t * p_stats,
+			   IN const osm_sweep_prof_stats_t * p_start,
+			   IN const osm_sweep_prof_stats_t * p_end)
+{
+	p_stats->count++;
+	p_stats->wall_usec += p_end->wall_usec - p_start->wall_usec;
+	if (p_end->cpu_usec > p_start->cpu_usec)
+		p_stats->cpu_usec += p_end->cpu_usec - p_start->cpu_usec;
+	p_stats->mads_sent += p_end->mads_sent - p_start->mads_sent;
+	p_stats->mads_rcvd += p_end->mads_rcvd - p_start->mads_rcvd;
+	p_stats->mads_failed += p_end->mads_failed - p_start->mads_failed;
+	p_stats->mads_resent += p_end->mads_resent - p_start->mads_resent;
+}
+
+void osm_sweep_prof_construct(IN osm_sweep_prof_t * p_prof)
+{
+	memset(p_prof, 0, sizeof(*p_prof));
+	cl_spinlock_construct(&p_prof->lock);
+}
+
+ib_api_status_t osm_sweep_prof_init(IN osm_sweep_prof_t * p_prof,
+				    IN osm_stats_t * p_stats,
+				    IN uint32_t size)
+{
+	p_prof->p_stats = p_stats;
+
+	if (cl_spinlock_init(&p_prof->lock) != CL_SUCCESS)
+		return IB_ERROR;
+
+	if (!size)
+		return IB_SUCCESS;
+
+	p_prof->ring = calloc(size, sizeof(*p_prof->ring));
+	if (!p_prof->ring)
+		return IB_INSUFFICIENT_MEMORY;
+	p_prof->size = size;
+
+	return IB_SUCCESS;
+}
+
+void osm_sweep_prof_destroy(IN osm_sweep_prof_t * p_prof)
+{
+	cl_spinlock_destroy(&p_prof->lock);
+	free(p_prof->ring);
+	p_prof->ring = NULL;
+	p_prof->size = 0;
+}
+
+void osm_sweep_prof_start(IN osm_sweep_prof_t * p_prof)
+{
+	if (!p_prof->size)
+		return;
+
+	cl_spinlock_acquire(&p_prof->lock);
+	memset(&p_prof->cur, 0, sizeof(p_prof->cur));
+	p_prof->cur.sweep_num = p_prof->num_sweeps + 1;
+	p_prof->cur.start_time = time(NULL);
+	p_prof->phase = OSM_SWEEP_PHASE_SETUP;
+	p_prof->active = TRUE;
+	cl_spinlock_release(&p_prof->lock);
+
+	sweep_prof_sample(p_prof, &p_prof->sweep_start);
+	p_prof->phase_start = p_prof->sweep_start;
+}
+
+void osm_sweep_prof_phase(IN osm_sweep_prof_t * p_prof,
+			  IN osm_sweep_phase_t phase)
+{
+	osm_sweep_prof_stats_t now;
+
+	if (!p_prof->active)
+		return;
+
+	sweep_prof_sample(p_prof, &now);
+	sweep_prof_add(&p_prof->cur.phase[p_prof->phase],
+		       &p_prof->phase_start, &now);
+	p_prof->phase = phase;
+	p_prof->phase_start = now;
+}
+
+const osm_sweep_prof_rec_t *osm_sweep_prof_done(IN osm_sweep_prof_t * p_prof)
+{
+	osm_sweep_prof_rec_t *p_rec;
+	osm_sweep_prof_stats_t now;
+
+	if (!p_prof->active)
+		return NULL;
+
+	sweep_prof_sample(p_prof, &now);
+	sweep_prof_add(&p_prof->cur.phase[p_prof->phase],
+		       &p_prof->phase_start, &now);
+	sweep_prof_add(&p_prof->cur.total, &p_prof->sweep_start, &now);
+
+	cl_spinlock_acquire(&p_prof->lock);
+	p_prof->active = FALSE;
+	p_rec = &p_prof->ring[p_prof->num_sweeps % p_prof->size];
+	*p_rec = p_prof->cur;
+	p_prof->num_sweeps++;
+	cl_spinlock_release(&p_prof->lock);
+
+	return p_rec;
+}
+
+boolean_t osm_sweep_prof_get(IN osm_sweep_prof_t * p_prof, IN uint32_t age,
+			     OUT osm_sweep_prof_rec_t * p_rec)
+{
+	boolean_t found = FALSE;
+
+	cl_spinlock_acquire(&p_prof->lock);
+	if (age < p_prof->size && age < p_prof->num_sweeps) {
+		*p_rec = p_prof->ring[(p_prof->num_sweeps - 1 - age) %
+				      p_prof->size];
+		found = TRUE;
+	}
+	cl_spinlock_release(&p_prof->lock);
+
+	return found;
+}
+
+uint64_t osm_sweep_prof_path_sl_start(IN osm_sweep_prof_t * p_prof)
+{
+	/* unlocked: a call racing with the start or the end of a sweep
+	   may be counted or not */
+	if (!p_prof->active)
+		return 0;
+	return cl_get_time_stamp();
+}
+
+void osm_sweep_prof_path_sl_done(IN osm_sweep_prof_t * p_prof,
+				 IN uint64_t start)
+{
+	uint64_t end;
+
+	if (!start)
+		return;
+
+	end = cl_get_time_stamp();
+	cl_spinlock_acquire(&p_prof->lock);
+	if (p_prof->active) {
+		p_prof->cur.path_sl_calls++;
+		p_prof->cur.path_sl_usec += end - start;
+	}
+	cl_spinlock_release(&p_prof->lock);
+}
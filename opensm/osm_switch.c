@@ -61,23 +61,198 @@ struct switch_port_path {
 	uint32_t forwarded_to;
 };
 
+/* the rows of a LID matrix are limited by the 16 bit row numbers */
+#define LID_MATRIX_MIN_ROWS 64
+#define LID_MATRIX_MAX_ROWS 0x10000
+
+static uint32_t lid_matrix_hash(IN const uint8_t * row, IN uint8_t width)
+{
+	uint32_t hash = 2166136261U;
+	unsigned i;
+
+	for (i = 0; i < width; i++)
+		hash = (hash ^ row[i]) * 16777619U;
+	return hash;
+}
+
+static void lid_matrix_rehash(IN osm_lid_matrix_t * p_lm)
+{
+	uint32_t i, bucket;
+
+	memset(p_lm->buckets, 0, p_lm->num_buckets * sizeof(p_lm->buckets[0]));
+	for (i = 1; i < p_lm->num_rows; i++) {
+		if (!p_lm->row_ref[i])
+			continue;
+		bucket = p_lm->row_hash[i] & (p_lm->num_buckets - 1);
+		p_lm->row_next[i] = p_lm->buckets[bucket];
+		p_lm->buckets[bucket] = i;
+	}
+}
+
+static int lid_matrix_grow_rows(IN osm_lid_matrix_t * p_lm)
+{
+	uint32_t max_rows;
+	void *p;
+
+	if (p_lm->max_rows >= LID_MATRIX_MAX_ROWS)
+		return -1;
+	max_rows = p_lm->max_rows ? p_lm->max_rows * 2 : LID_MATRIX_MIN_ROWS;
+
+	if (!(p = realloc(p_lm->rows, max_rows * p_lm->width)))
+		return -1;
+	p_lm->rows = p;
+	if (!(p = realloc(p_lm->row_ref, max_rows * sizeof(p_lm->row_ref[0]))))
+		return -1;
+	p_lm->row_ref = p;
+	if (!(p = realloc(p_lm->row_next, max_rows * sizeof(p_lm->row_next[0]))))
+		return -1;
+	p_lm->row_next = p;
+	if (!(p = realloc(p_lm->row_hash, max_rows * sizeof(p_lm->row_hash[0]))))
+		return -1;
+	p_lm->row_hash = p;
+	if (!(p = realloc(p_lm->buckets, max_rows * sizeof(p_lm->buckets[0]))))
+		return -1;
+	p_lm->buckets = p;
+	p_lm->num_buckets = max_rows;
+
+	if (!p_lm->max_rows) {
+		memset(p_lm->rows, OSM_NO_PATH, p_lm->width);
+		p_lm->row_ref[0] = 0;
+		p_lm->num_rows = 1;
+	}
+	p_lm->max_rows = max_rows;
+	lid_matrix_rehash(p_lm);
+
+	return 0;
+}
+
+/* returns the row with the given hop counts and takes a reference on it,
+   or -1 if a new row is needed and cannot be allocated */
+static int lid_matrix_get_row(IN osm_lid_matrix_t * p_lm, IN const uint8_t * row)
+{
+	uint32_t hash, bucket;
+	uint16_t i;
+
+	if (!memcmp(row, p_lm->rows, p_lm->width))
+		return 0;
+
+	hash = lid_matrix_hash(row, p_lm->width);
+	bucket = hash & (p_lm->num_buckets - 1);
+	for (i = p_lm->buckets[bucket]; i; i = p_lm->row_next[i])
+		if (p_lm->row_hash[i] == hash &&
+		    !memcmp(row, p_lm->rows + i * p_lm->width, p_lm->width)) {
+			p_lm->row_ref[i]++;
+			return i;
+		}
+
+	if (p_lm->free_row) {
+		i = p_lm->free_row;
+		p_lm->free_row = p_lm->row_next[i];
+	} else {
+		if (p_lm->num_rows == p_lm->max_rows) {
+			if (lid_matrix_grow_rows(p_lm))
+				return -1;
+			bucket = hash & (p_lm->num_buckets - 1);
+		}
+		i = p_lm->num_rows++;
+	}
+
+	memcpy(p_lm->rows + i * p_lm->width, row, p_lm->width);
+	p_lm->row_hash[i] = hash;
+	p_lm->row_ref[i] = 1;
+	p_lm->row_next[i] = p_lm->buckets[bucket];
+	p_lm->buckets[bucket] = i;
+	return i;
+}
+
+static void lid_matrix_put_row(IN osm_lid_matrix_t * p_lm, IN uint16_t row)
+{
+	uint16_t *p_next;
+
+	if (!row || --p_lm->row_ref[row])
+		return;
+
+	p_next = &p_lm->buckets[p_lm->row_hash[row] & (p_lm->num_buckets - 1)];
+	while (*p_next != row)
+		p_next = &p_lm->row_next[*p_next];
+	*p_next = p_lm->row_next[row];
+
+	p_lm->row_next[row] = p_lm->free_row;
+	p_lm->free_row = row;
+}
+
+static void lid_matrix_clear(IN osm_lid_matrix_t * p_lm)
+{
+	if (!p_lm->num_lids)
+		return;
+
+	memset(p_lm->lid_row, 0, p_lm->num_lids * sizeof(p_lm->lid_row[0]));
+	memset(p_lm->buckets, 0, p_lm->num_buckets * sizeof(p_lm->buckets[0]));
+	p_lm->num_rows = 1;
+	p_lm->free_row = 0;
+}
+
+static int lid_matrix_resize(IN osm_lid_matrix_t * p_lm, IN uint8_t width,
+			     IN uint32_t num_lids)
+{
+	uint16_t *lid_row;
+
+	if (!p_lm->max_rows) {
+		p_lm->width = width;
+		if (lid_matrix_grow_rows(p_lm))
+			return -1;
+	}
+
+	if (num_lids > p_lm->num_lids) {
+		lid_row = realloc(p_lm->lid_row, num_lids * sizeof(lid_row[0]));
+		if (!lid_row)
+			return -1;
+		memset(lid_row + p_lm->num_lids, 0,
+		       (num_lids - p_lm->num_lids) * sizeof(lid_row[0]));
+		p_lm->lid_row = lid_row;
+		p_lm->num_lids = num_lids;
+	}
+
+	return 0;
+}
+
+void osm_lid_matrix_destroy(IN osm_lid_matrix_t * p_lm)
+{
+	free(p_lm->lid_row);
+	free(p_lm->rows);
+	free(p_lm->row_ref);
+	free(p_lm->row_next);
+	free(p_lm->row_hash);
+	free(p_lm->buckets);
+	memset(p_lm, 0, sizeof(*p_lm));
+}
+
 cl_status_t osm_switch_set_hops(IN osm_switch_t * p_sw, IN uint16_t lid_ho,
 				IN uint8_t port_num, IN uint8_t num_hops)
 {
-	if (!lid_ho || lid_ho > p_sw->max_lid_ho)
+	osm_lid_matrix_t *p_lm = &p_sw->lid_matrix;
+	uint8_t row[IB_NODE_NUM_PORTS_MAX + 1];
+	uint16_t old_row;
+	int new_row;
+
+	if (!lid_ho || lid_ho > p_sw->max_lid_ho || lid_ho >= p_lm->num_lids)
 		return -1;
 	if (port_num >= p_sw->num_ports)
 		return -1;
-	if (!p_sw->hops[lid_ho]) {
-		p_sw->hops[lid_ho] = malloc(p_sw->num_ports);
-		if (!p_sw->hops[lid_ho])
-			return -1;
-		memset(p_sw->hops[lid_ho], OSM_NO_PATH, p_sw->num_ports);
-	}
 
-	p_sw->hops[lid_ho][port_num] = num_hops;
-	if (p_sw->hops[lid_ho][0] > num_hops)
-		p_sw->hops[lid_ho][0] = num_hops;
+	old_row = p_lm->lid_row[lid_ho];
+	memcpy(row, p_lm->rows + old_row * p_lm->width, p_lm->width);
+	row[port_num] = num_hops;
+	if (row[0] > num_hops)
+		row[0] = num_hops;
+	if (!memcmp(row, p_lm->rows + old_row * p_lm->width, p_lm->width))
+		return 0;
+
+	new_row = lid_matrix_get_row(p_lm, row);
+	if (new_row < 0)
+		return -1;
+	p_lm->lid_row[lid_ho] = new_row;
+	lid_matrix_put_row(p_lm, old_row);
 
 	return 0;
 }
@@ -85,7 +260,6 @@ cl_status_t osm_switch_set_hops(IN osm_switch_t * p_sw, IN uint16_t lid_ho,
 void osm_switch_delete(IN OUT osm_switch_t ** pp_sw)
 {
 	osm_switch_t *p_sw = *pp_sw;
-	unsigned i;
 
 	osm_mcast_tbl_destroy(&p_sw->mcast_tbl);
 	if (p_sw->p_prof)
@@ -96,16 +270,24 @@ void osm_switch_delete(IN OUT osm_switch_t ** pp_sw)
 		free(p_sw->lft);
 	if (p_sw->new_lft)
 		free(p_sw->new_lft);
-	if (p_sw->hops) {
-		for (i = 0; i < p_sw->num_hops; i++)
-			if (p_sw->hops[i])
-				free(p_sw->hops[i]);
-		free(p_sw->hops);
-	}
+	osm_switch_clear_lft_backup(p_sw);
+	osm_lid_matrix_destroy(&p_sw->lid_matrix);
 	free(*pp_sw);
 	*pp_sw = NULL;
 }
 
+void osm_switch_clear_lft_backup(IN osm_switch_t * p_sw)
+{
+	uint8_t port;
+
+	if (!p_sw->lft_backup)
+		return;
+	for (port = 0; port < p_sw->num_ports; port++)
+		free(p_sw->lft_backup[port]);
+	free(p_sw->lft_backup);
+	p_sw->lft_backup = NULL;
+}
+
 osm_switch_t *osm_switch_new(IN osm_node_t * p_node,
 			     IN const osm_madw_t * p_madw)
 {
@@ -232,7 +414,9 @@ switch_find_node_guid_count(IN const osm_switch_t * p_sw,
 }
 
 uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
-				  IN osm_port_t * p_port, IN uint16_t lid_ho,
+				  IN osm_port_t * p_port,
+				  IN struct osm_remote_guids_count *p_remote_guids,
+				  IN uint16_t lid_ho,
 				  IN unsigned start_from,
 				  IN boolean_t ignore_existing,
 				  IN boolean_t routing_for_lmc,
@@ -249,7 +433,7 @@ uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
 	   system / node.
 
 	   Assume if routing_for_lmc is true that this procedure was
-	   provided the tracking array and counter via p_port->priv,
+	   provided the tracking array and counter via p_remote_guids,
 	   and we can conduct this algorithm.
 	 */
 	uint16_t base_lid;
@@ -411,7 +595,7 @@ uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
 			else if (p_rem_node != p_rem_node_first)
 				continue;
 			if (routing_for_lmc) {
-				struct osm_remote_guids_count *r = p_port->priv;
+				struct osm_remote_guids_count *r = p_remote_guids;
 				uint8_t rem_port = osm_physp_get_port_num(p_rem_physp);
 				unsigned int j;
 
@@ -432,7 +616,7 @@ uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
 		} else if (routing_for_lmc) {
 			/* Is the sys guid already used ? */
 			p_remote_guid = switch_find_sys_guid_count(p_sw,
-								   p_port->priv,
+								   p_remote_guids,
 								   port_num);
 
 			/* If not update the least hops for this case */
@@ -448,7 +632,7 @@ uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
 
 				/* Else is the node guid already used ? */
 				p_remote_guid = switch_find_node_guid_count(p_sw,
-									    p_port->priv,
+									    p_remote_guids,
 									    port_num);
 
 				/* If not update the least hops for this case */
@@ -594,11 +778,18 @@ uint8_t osm_switch_recommend_path(IN const osm_switch_t * p_sw,
 
 void osm_switch_clear_hops(IN osm_switch_t * p_sw)
 {
-	unsigned i;
+	lid_matrix_clear(&p_sw->lid_matrix);
+}
+
+void osm_switch_clear_lid_hops(IN osm_switch_t * p_sw, IN uint16_t lid_ho)
+{
+	osm_lid_matrix_t *p_lm = &p_sw->lid_matrix;
+
+	if (lid_ho >= p_lm->num_lids)
+		return;
 
-	for (i = 0; i < p_sw->num_hops; i++)
-		if (p_sw->hops[i])
-			memset(p_sw->hops[i], OSM_NO_PATH, p_sw->num_ports);
+	lid_matrix_put_row(p_lm, p_lm->lid_row[lid_ho]);
+	p_lm->lid_row[lid_ho] = 0;
 }
 
 static int alloc_lft(IN osm_switch_t * p_sw, uint16_t lids)
@@ -622,7 +813,6 @@ static int alloc_lft(IN osm_switch_t * p_sw, uint16_t lids)
 
 int osm_switch_prepare_path_rebuild(IN osm_switch_t * p_sw, IN uint16_t max_lids)
 {
-	uint8_t **hops;
 	uint8_t *new_lft;
 	unsigned i;
 
@@ -641,22 +831,8 @@ int osm_switch_prepare_path_rebuild(IN osm_switch_t * p_sw, IN uint16_t max_lids
 
 	memset(p_sw->new_lft, OSM_NO_PATH, p_sw->lft_size);
 
-	if (!p_sw->hops) {
-		hops = malloc((max_lids + 1) * sizeof(hops[0]));
-		if (!hops)
-			return -1;
-		memset(hops, 0, (max_lids + 1) * sizeof(hops[0]));
-		p_sw->hops = hops;
-		p_sw->num_hops = max_lids + 1;
-	} else if (max_lids + 1 > p_sw->num_hops) {
-		hops = realloc(p_sw->hops, (max_lids + 1) * sizeof(hops[0]));
-		if (!hops)
-			return -1;
-		memset(hops + p_sw->num_hops, 0,
-		       (max_lids + 1 - p_sw->num_hops) * sizeof(hops[0]));
-		p_sw->hops = hops;
-		p_sw->num_hops = max_lids + 1;
-	}
+	if (lid_matrix_resize(&p_sw->lid_matrix, p_sw->num_ports, max_lids + 1))
+		return -1;
 	p_sw->max_lid_ho = max_lids;
 
 	return 0;
@@ -240,6 +240,7 @@ static int disable_port(osm_sm_t *sm, osm_physp_t *p)
 	context.pi_context.port_guid = osm_physp_get_port_guid(p);
 	context.pi_context.set_method = TRUE;
 	context.pi_context.light_sweep = FALSE;
+	context.pi_context.backup_lft = FALSE;
 	context.pi_context.active_transition = FALSE;
 	context.pi_context.client_rereg = FALSE;
 	if (osm_node_get_type(p->p_node) == IB_NODE_TYPE_SWITCH &&
@@ -369,6 +370,48 @@ static int shutup_noisy_port(osm_sm_t *sm, ib_net16_t lid, uint8_t port,
 	return 0;
 }
 
+/*
+ * A trap 128 does not tell which port changed: get the PortInfo of the
+ * ports of the switch which have backup LFT blocks, the PortInfo
+ * receiver sends them if the link is down.
+ */
+static void query_backup_lft_ports(osm_sm_t *sm, ib_net16_t sw_lid)
+{
+	osm_madw_context_t context;
+	osm_port_t *p_port;
+	osm_physp_t *p_physp;
+	osm_switch_t *p_sw;
+	ib_api_status_t status;
+	uint8_t port;
+
+	p_port = osm_get_port_by_lid(sm->p_subn, sw_lid);
+	if (!p_port || !(p_sw = p_port->p_node->sw) || !p_sw->lft_backup)
+		return;
+	p_physp = osm_node_get_physp_ptr(p_port->p_node, 0);
+
+	context.pi_context.node_guid = osm_node_get_node_guid(p_port->p_node);
+	context.pi_context.port_guid = osm_physp_get_port_guid(p_physp);
+	context.pi_context.set_method = FALSE;
+	context.pi_context.light_sweep = FALSE;
+	context.pi_context.backup_lft = TRUE;
+	context.pi_context.active_transition = FALSE;
+	context.pi_context.client_rereg = FALSE;
+
+	for (port = 1; port < p_sw->num_ports; port++) {
+		if (!p_sw->lft_backup[port])
+			continue;
+		status = osm_req_get(sm, osm_physp_get_dr_path_ptr(p_physp),
+				     IB_MAD_ATTR_PORT_INFO, cl_hton32(port),
+				     FALSE,
+				     ib_port_info_get_m_key(&p_physp->port_info),
+				     0, CL_DISP_MSGID_NONE, &context);
+		if (status != IB_SUCCESS)
+			OSM_LOG(sm->p_log, OSM_LOG_ERROR, "ERR 3814: "
+				"Failure initiating PortInfo request (%s)\n",
+				ib_get_err_str(status));
+	}
+}
+
 static void trap_rcv_process_request(IN osm_sm_t * sm,
 				     IN const osm_madw_t * p_madw)
 {
@@ -609,6 +652,10 @@ check_sweep:
 		}
 	}
 
+	if (sm->p_subn->opt.backup_lfts && ib_notice_is_generic(p_ntci) &&
+	    cl_ntoh16(p_ntci->g_or_v.generic.trap_num) == SM_LINK_STATE_CHANGED_TRAP)
+		query_backup_lft_ports(sm, p_ntci->data_details.ntc_128.sw_lid);
+
 	/* do a sweep if we received a trap */
 	if (sm->p_subn->opt.sweep_on_trap) {
 		/* if this is trap number 128 or run_heavy_sweep is TRUE -
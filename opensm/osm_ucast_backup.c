@@ -0,0 +1,776 @@
+/*
+ * Copyright (C) 2020-2024 ETH Zurich. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Abstract:
+ *    Implementation of the backup LFTs, sent to the switches at both ends
+ *    of a failed link before the subnet is routed again.
+ *
+ * Environment:
+ *    Linux User Mode
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <iba/ib_types.h>
+#include <complib/cl_qmap.h>
+#include <complib/cl_debug.h>
+#include <opensm/osm_file_ids.h>
+#define FILE_ID OSM_FILE_UCAST_BACKUP_C
+#include <opensm/osm_opensm.h>
+#include <opensm/osm_ucast_mgr.h>
+#include <opensm/osm_ucast_backup.h>
+#include <opensm/osm_switch.h>
+#include <opensm/osm_node.h>
+#include <opensm/osm_port.h>
+
+/* peer of a port which is not linked to one of the switches */
+#define BACKUP_PEER_ENDPORT	-1
+#define BACKUP_PEER_NONE	-2
+
+typedef struct backup_sw {
+	ib_net64_t guid;
+	uint8_t *base_lft;
+	uint8_t *lft;
+	unsigned chan;
+	uint8_t num_ports;
+	int *peer;
+	uint8_t *peer_port;
+	uint8_t *dep;
+	uint32_t *dep_ok;
+	uint32_t *dep_cycle;
+	osm_lft_backup_t **backup;
+} backup_sw_t;
+
+typedef struct backup_dep {
+	backup_sw_t *sw;
+	unsigned idx;
+} backup_dep_t;
+
+typedef struct backup_ctx {
+	osm_ucast_mgr_t *p_mgr;
+	backup_sw_t *sws;
+	unsigned num_sws;
+	unsigned num_chans;
+	uint16_t max_lid;
+	uint16_t num_lids;
+	unsigned lft_len;
+	int *lid_sw;
+	unsigned *chan_sw;
+	uint32_t *mark;
+	uint32_t gen;
+	unsigned *stack;
+	unsigned *path;
+	unsigned *cand_len;
+	unsigned *load;
+	backup_dep_t *added;
+	unsigned num_added;
+	unsigned max_added;
+	uint32_t link_gen;
+	uint32_t undo_gen;
+	unsigned fail_sw[2];
+	uint8_t fail_port[2];
+	uint8_t *fail_lft[2];
+} backup_ctx_t;
+/*
+ * The context is a copy of what the backup LFTs are computed from,
+ * made with the subnet lock held, so they can be computed without it.
+ * base_lft is the new_lft of a switch, up to the end of the block of
+ * max_lid.  A channel is a port of a switch, numbered from chan of the
+ * switch on; chan_sw gives the switch of each channel.  lid_sw gives
+ * the switch of each switch LID.  dep has a byte per pair of ports of
+ * a switch, set if some LID of a channel adapter or router is
+ * forwarded thru the first one into the switch and leaves it thru the
+ * second one.  The paths to the switch LIDs carry management traffic
+ * only, and are left out of the dependencies like the engines do.  The
+ * dependencies added for the failed link are listed in added, to be
+ * removed when it is done.  During the failed link, the lft of its two
+ * switches point to fail_lft, their copy with the backup ports.
+ *
+ * A dependency which passed the cycle check during a failed link stays
+ * off the cycles while it is there, as each one added later is checked
+ * too: dep_ok holds the link_gen of the check.  One which failed it
+ * stays on a cycle until dependencies are removed: dep_cycle holds the
+ * undo_gen of the check.
+ */
+
+void osm_ucast_backup_clear(IN osm_ucast_mgr_t * p_mgr)
+{
+	cl_qmap_t *p_sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
+	cl_map_item_t *item;
+
+	for (item = cl_qmap_head(p_sw_tbl); item != cl_qmap_end(p_sw_tbl);
+	     item = cl_qmap_next(item))
+		osm_switch_clear_lft_backup((osm_switch_t *) item);
+}
+
+static void backup_ctx_destroy(IN backup_ctx_t * ctx)
+{
+	unsigned i;
+	uint8_t port;
+
+	if (ctx->sws) {
+		for (i = 0; i < ctx->num_sws; i++) {
+			free(ctx->sws[i].base_lft);
+			free(ctx->sws[i].peer);
+			free(ctx->sws[i].peer_port);
+			free(ctx->sws[i].dep);
+			free(ctx->sws[i].dep_ok);
+			free(ctx->sws[i].dep_cycle);
+			if (!ctx->sws[i].backup)
+				continue;
+			for (port = 0; port < ctx->sws[i].num_ports; port++)
+				free(ctx->sws[i].backup[port]);
+			free(ctx->sws[i].backup);
+		}
+		free(ctx->sws);
+	}
+	free(ctx->lid_sw);
+	free(ctx->chan_sw);
+	free(ctx->mark);
+	free(ctx->stack);
+	free(ctx->path);
+	free(ctx->cand_len);
+	free(ctx->load);
+	free(ctx->added);
+	free(ctx->fail_lft[0]);
+	free(ctx->fail_lft[1]);
+	free(ctx);
+}
+
+void osm_ucast_backup_destroy(IN osm_ucast_mgr_t * p_mgr)
+{
+	if (p_mgr->p_backup) {
+		backup_ctx_destroy(p_mgr->p_backup);
+		p_mgr->p_backup = NULL;
+	}
+}
+
+/*
+ * Indexes the switches by their LIDs to find the switch behind each
+ * port, numbers the channels and copies the LFTs of the last routing.
+ */
+static int backup_ctx_init(IN backup_ctx_t * ctx, IN osm_ucast_mgr_t * p_mgr)
+{
+	cl_qmap_t *p_sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
+	cl_ptr_vector_t *p_lid_tbl = &p_mgr->p_subn->port_lid_tbl;
+	osm_switch_t *p_sw;
+	osm_physp_t *p_physp, *p_remote;
+	osm_port_t *p_port;
+	backup_sw_t *sw;
+	int *lid_sw;
+	unsigned i, n, max_ports = 0;
+	uint16_t lid, base_lid, num_lids;
+	uint8_t port;
+
+	ctx->p_mgr = p_mgr;
+	ctx->num_sws = cl_qmap_count(p_sw_tbl);
+	ctx->max_lid = p_mgr->max_lid;
+	ctx->num_lids = num_lids = (uint16_t) cl_ptr_vector_get_size(p_lid_tbl);
+
+	ctx->sws = calloc(ctx->num_sws, sizeof(*ctx->sws));
+	ctx->lid_sw = lid_sw = malloc(num_lids * sizeof(*lid_sw));
+	if (!ctx->sws || !lid_sw)
+		return -1;
+	for (lid = 0; lid < num_lids; lid++)
+		lid_sw[lid] = BACKUP_PEER_NONE;
+
+	i = 0;
+	for (p_sw = (osm_switch_t *) cl_qmap_head(p_sw_tbl);
+	     p_sw != (osm_switch_t *) cl_qmap_end(p_sw_tbl);
+	     p_sw = (osm_switch_t *) cl_qmap_next(&p_sw->map_item), i++) {
+		/* no LFTs were computed, e.g. with the unicast cache */
+		if (!p_sw->new_lft)
+			return -1;
+		if (ctx->max_lid >= p_sw->lft_size)
+			ctx->max_lid = p_sw->lft_size - 1;
+		lid = cl_ntoh16(osm_node_get_base_lid(p_sw->p_node, 0));
+		if (lid < num_lids)
+			lid_sw[lid] = i;
+
+		sw = &ctx->sws[i];
+		sw->guid = osm_node_get_node_guid(p_sw->p_node);
+		sw->num_ports = p_sw->num_ports;
+		sw->chan = ctx->num_chans;
+		ctx->num_chans += sw->num_ports;
+		if (sw->num_ports > max_ports)
+			max_ports = sw->num_ports;
+		n = sw->num_ports * sw->num_ports;
+		sw->peer = malloc(sw->num_ports * sizeof(*sw->peer));
+		sw->peer_port = calloc(sw->num_ports, sizeof(*sw->peer_port));
+		sw->dep = calloc(n, sizeof(*sw->dep));
+		sw->dep_ok = calloc(n, sizeof(*sw->dep_ok));
+		sw->dep_cycle = calloc(n, sizeof(*sw->dep_cycle));
+		if (!sw->peer || !sw->peer_port || !sw->dep || !sw->dep_ok ||
+		    !sw->dep_cycle)
+			return -1;
+	}
+	/* the lft_size of all switches is a number of blocks */
+	ctx->lft_len = (ctx->max_lid / IB_SMP_DATA_SIZE + 1) * IB_SMP_DATA_SIZE;
+
+	/* the other LIDs of the switches, with LMC on enhanced port 0 */
+	for (lid = 1; lid < num_lids; lid++) {
+		p_port = cl_ptr_vector_get(p_lid_tbl, lid);
+		if (!p_port || !p_port->p_node->sw)
+			continue;
+		base_lid = cl_ntoh16(osm_node_get_base_lid(p_port->p_node, 0));
+		if (base_lid < num_lids)
+			lid_sw[lid] = lid_sw[base_lid];
+	}
+
+	i = 0;
+	for (p_sw = (osm_switch_t *) cl_qmap_head(p_sw_tbl);
+	     p_sw != (osm_switch_t *) cl_qmap_end(p_sw_tbl);
+	     p_sw = (osm_switch_t *) cl_qmap_next(&p_sw->map_item), i++) {
+		sw = &ctx->sws[i];
+		sw->base_lft = malloc(ctx->lft_len);
+		if (!sw->base_lft)
+			return -1;
+		memcpy(sw->base_lft, p_sw->new_lft, ctx->lft_len);
+		sw->lft = sw->base_lft;
+		sw->peer[0] = BACKUP_PEER_NONE;
+		for (port = 1; port < sw->num_ports; port++) {
+			sw->peer[port] = BACKUP_PEER_NONE;
+			p_physp = osm_node_get_physp_ptr(p_sw->p_node, port);
+			if (!p_physp || !(p_remote = osm_physp_get_remote(p_physp)))
+				continue;
+			sw->peer_port[port] = osm_physp_get_port_num(p_remote);
+			if (!p_remote->p_node->sw) {
+				sw->peer[port] = BACKUP_PEER_ENDPORT;
+				continue;
+			}
+			lid = cl_ntoh16(osm_node_get_base_lid(p_remote->p_node,
+							      0));
+			if (lid < num_lids)
+				sw->peer[port] = lid_sw[lid];
+		}
+	}
+
+	ctx->chan_sw = malloc(ctx->num_chans * sizeof(*ctx->chan_sw));
+	ctx->mark = calloc(ctx->num_chans, sizeof(*ctx->mark));
+	ctx->stack = malloc(ctx->num_chans * sizeof(*ctx->stack));
+	ctx->path = malloc((ctx->num_sws + 1) * sizeof(*ctx->path));
+	ctx->cand_len = malloc(max_ports * sizeof(*ctx->cand_len));
+	ctx->load = malloc(max_ports * sizeof(*ctx->load));
+	ctx->fail_lft[0] = malloc(ctx->lft_len);
+	ctx->fail_lft[1] = malloc(ctx->lft_len);
+	if (!ctx->chan_sw || !ctx->mark || !ctx->stack || !ctx->path ||
+	    !ctx->cand_len || !ctx->load || !ctx->fail_lft[0] ||
+	    !ctx->fail_lft[1])
+		return -1;
+	for (i = 0; i < ctx->num_sws; i++)
+		for (port = 0; port < ctx->sws[i].num_ports; port++)
+			ctx->chan_sw[ctx->sws[i].chan + port] = i;
+	return 0;
+}
+
+static inline boolean_t backup_is_sw_lid(IN const backup_ctx_t * ctx,
+					 IN uint16_t lid)
+{
+	return lid < ctx->num_lids && ctx->lid_sw[lid] >= 0;
+}
+
+/*
+ * Sets the dependencies of the LFTs of the last routing: a LID of a
+ * channel adapter or router which one switch forwards to another one
+ * and which that one forwards to a third switch.
+ */
+static void backup_build_deps(IN backup_ctx_t * ctx)
+{
+	backup_sw_t *sw, *next;
+	uint16_t lid;
+	uint8_t port, next_port;
+	int j;
+	unsigned i;
+
+	for (i = 0; i < ctx->num_sws; i++) {
+		sw = &ctx->sws[i];
+		for (lid = 1; lid <= ctx->max_lid; lid++) {
+			port = sw->lft[lid];
+			if (port >= sw->num_ports || (j = sw->peer[port]) < 0 ||
+			    backup_is_sw_lid(ctx, lid))
+				continue;
+			next = &ctx->sws[j];
+			next_port = next->lft[lid];
+			if (next_port >= next->num_ports ||
+			    next->peer[next_port] < 0)
+				continue;
+			next->dep[sw->peer_port[port] * next->num_ports +
+				  next_port] = 1;
+		}
+	}
+}
+
+static inline boolean_t backup_is_failed(IN const backup_ctx_t * ctx,
+					 IN unsigned i, IN uint8_t port)
+{
+	return (i == ctx->fail_sw[0] && port == ctx->fail_port[0]) ||
+	    (i == ctx->fail_sw[1] && port == ctx->fail_port[1]);
+}
+
+/*
+ * Follows the LFTs from switch i towards lid, stores the channels
+ * between switches in path and returns their number.  Returns -1 if the
+ * path breaks, uses the failed link, loops or passes thru switch avoid.
+ */
+static int backup_walk(IN backup_ctx_t * ctx, IN unsigned i, IN uint16_t lid,
+		       IN unsigned avoid, OUT unsigned *path)
+{
+	backup_sw_t *sw;
+	unsigned hops = 0;
+	uint8_t port;
+
+	for (;;) {
+		sw = &ctx->sws[i];
+		port = sw->lft[lid];
+		if (port == 0)
+			return hops;
+		if (port >= sw->num_ports || backup_is_failed(ctx, i, port))
+			return -1;
+		if (sw->peer[port] == BACKUP_PEER_ENDPORT)
+			return hops;
+		if (sw->peer[port] < 0 || (unsigned)sw->peer[port] == avoid ||
+		    hops == ctx->num_sws)
+			return -1;
+		path[hops++] = sw->chan + port;
+		i = sw->peer[port];
+	}
+}
+
+/*
+ * Returns TRUE if channel to can be reached from channel from over the
+ * dependencies, without the failed link.
+ */
+static boolean_t backup_reaches(IN backup_ctx_t * ctx, IN unsigned from,
+				IN unsigned to)
+{
+	backup_sw_t *sw, *next;
+	unsigned num = 0, c, i;
+	uint8_t port, in;
+	int j;
+
+	if (++ctx->gen == 0) {
+		memset(ctx->mark, 0, ctx->num_chans * sizeof(*ctx->mark));
+		ctx->gen = 1;
+	}
+
+	ctx->mark[from] = ctx->gen;
+	ctx->stack[num++] = from;
+	while (num) {
+		c = ctx->stack[--num];
+		i = ctx->chan_sw[c];
+		sw = &ctx->sws[i];
+		j = sw->peer[c - sw->chan];
+		next = &ctx->sws[j];
+		in = sw->peer_port[c - sw->chan];
+		for (port = 1; port < next->num_ports; port++) {
+			if (!next->dep[in * next->num_ports + port] ||
+			    backup_is_failed(ctx, j, port))
+				continue;
+			c = next->chan + port;
+			if (c == to)
+				return TRUE;
+			if (ctx->mark[c] == ctx->gen)
+				continue;
+			ctx->mark[c] = ctx->gen;
+			ctx->stack[num++] = c;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Adds the dependency from port in to port out of switch i, unless it
+ * is on a cycle.  This is checked even if the dependency exists: the
+ * paths moved to it may use another VL than the ones using it so far.
+ */
+static int backup_add_dep(IN backup_ctx_t * ctx, IN unsigned i, IN uint8_t in,
+			  IN uint8_t out)
+{
+	backup_sw_t *sw = &ctx->sws[i];
+	unsigned idx = in * sw->num_ports + out;
+	backup_dep_t *added;
+
+	if (sw->dep_ok[idx] == ctx->link_gen)
+		return 0;
+	if (sw->dep_cycle[idx] == ctx->undo_gen ||
+	    backup_reaches(ctx, sw->chan + out,
+			   ctx->sws[sw->peer[in]].chan + sw->peer_port[in])) {
+		sw->dep_cycle[idx] = ctx->undo_gen;
+		return -1;
+	}
+
+	if (!sw->dep[idx]) {
+		if (ctx->num_added == ctx->max_added) {
+			added = realloc(ctx->added, (ctx->max_added + 1024) *
+					sizeof(*added));
+			if (!added)
+				return -1;
+			ctx->added = added;
+			ctx->max_added += 1024;
+		}
+		ctx->added[ctx->num_added].sw = sw;
+		ctx->added[ctx->num_added++].idx = idx;
+		sw->dep[idx] = 1;
+	}
+	sw->dep_ok[idx] = ctx->link_gen;
+	return 0;
+}
+
+/* removed dependencies may have been on the cycles found */
+static void backup_undo_deps(IN backup_ctx_t * ctx, IN unsigned num)
+{
+	backup_dep_t *dep;
+
+	if (ctx->num_added > num)
+		ctx->undo_gen++;
+	while (ctx->num_added > num) {
+		dep = &ctx->added[--ctx->num_added];
+		dep->sw->dep[dep->idx] = 0;
+		dep->sw->dep_ok[dep->idx] = 0;
+	}
+}
+
+/*
+ * Adds the dependencies of moving lid from the failed port of switch i
+ * to port out: from each port where another switch forwards lid into
+ * switch i to port out, and along the path which follows.
+ */
+static int backup_add_path_deps(IN backup_ctx_t * ctx, IN unsigned i,
+				IN uint16_t lid, IN uint8_t out, IN int hops)
+{
+	backup_sw_t *sw = &ctx->sws[i], *prev;
+	uint8_t in;
+	int j, k;
+
+	for (in = 1; in < sw->num_ports; in++) {
+		if ((j = sw->peer[in]) < 0 || backup_is_failed(ctx, i, in))
+			continue;
+		prev = &ctx->sws[j];
+		if (prev->lft[lid] == sw->peer_port[in] &&
+		    backup_add_dep(ctx, i, in, out))
+			return -1;
+	}
+
+	ctx->path[0] = sw->chan + out;
+	for (k = 1; k <= hops; k++) {
+		prev = &ctx->sws[ctx->chan_sw[ctx->path[k - 1]]];
+		in = prev->peer_port[ctx->path[k - 1] - prev->chan];
+		j = ctx->chan_sw[ctx->path[k]];
+		if (backup_add_dep(ctx, j, in,
+				   ctx->path[k] - ctx->sws[j].chan))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Moves lid from the failed port of switch i to the port with the
+ * shortest path, the least loaded one if several are as short, whose
+ * dependencies are on no cycle.
+ */
+static boolean_t backup_reroute_lid(IN backup_ctx_t * ctx, IN unsigned i,
+				    IN uint16_t lid)
+{
+	backup_sw_t *sw = &ctx->sws[i];
+	unsigned num_added = ctx->num_added;
+	uint8_t port, best;
+	int len;
+
+	for (port = 1; port < sw->num_ports; port++) {
+		ctx->cand_len[port] = UINT32_MAX;
+		if (sw->peer[port] < 0 || backup_is_failed(ctx, i, port))
+			continue;
+		len = backup_walk(ctx, sw->peer[port], lid, i, ctx->path + 1);
+		if (len >= 0)
+			ctx->cand_len[port] = len;
+	}
+
+	for (;;) {
+		best = 0;
+		for (port = 1; port < sw->num_ports; port++)
+			if (ctx->cand_len[port] != UINT32_MAX &&
+			    (!best ||
+			     ctx->cand_len[port] < ctx->cand_len[best] ||
+			     (ctx->cand_len[port] == ctx->cand_len[best] &&
+			      ctx->load[port] < ctx->load[best])))
+				best = port;
+		if (!best)
+			return FALSE;
+
+		len = backup_walk(ctx, sw->peer[best], lid, i, ctx->path + 1);
+		if (backup_is_sw_lid(ctx, lid) ||
+		    !backup_add_path_deps(ctx, i, lid, best, len)) {
+			sw->lft[lid] = best;
+			ctx->load[best]++;
+			return TRUE;
+		}
+		backup_undo_deps(ctx, num_added);
+		ctx->cand_len[best] = UINT32_MAX;
+	}
+}
+
+/* stores the blocks of fail_lft[end] which differ from the base_lft */
+static int backup_save(IN backup_ctx_t * ctx, IN unsigned end)
+{
+	backup_sw_t *sw = &ctx->sws[ctx->fail_sw[end]];
+	uint8_t *lft = ctx->fail_lft[end];
+	osm_lft_backup_t *p_backup;
+	uint16_t block, num_blocks = ctx->lft_len / IB_SMP_DATA_SIZE;
+	unsigned num = 0;
+
+	/* the LIDs over max_lid keep what the routing set */
+	for (block = 0; block < num_blocks; block++)
+		if (memcmp(lft + block * IB_SMP_DATA_SIZE,
+			   sw->base_lft + block * IB_SMP_DATA_SIZE,
+			   IB_SMP_DATA_SIZE))
+			num++;
+	if (!num)
+		return 0;
+
+	if (!sw->backup) {
+		sw->backup = calloc(sw->num_ports, sizeof(*sw->backup));
+		if (!sw->backup)
+			return -1;
+	}
+	p_backup = malloc(sizeof(*p_backup) + num * sizeof(p_backup->blocks[0]));
+	if (!p_backup)
+		return -1;
+	p_backup->num_blocks = 0;
+	for (block = 0; block < num_blocks; block++) {
+		if (!memcmp(lft + block * IB_SMP_DATA_SIZE,
+			    sw->base_lft + block * IB_SMP_DATA_SIZE,
+			    IB_SMP_DATA_SIZE))
+			continue;
+		p_backup->blocks[p_backup->num_blocks].block_num = block;
+		memcpy(p_backup->blocks[p_backup->num_blocks].lft,
+		       lft + block * IB_SMP_DATA_SIZE, IB_SMP_DATA_SIZE);
+		p_backup->num_blocks++;
+	}
+	sw->backup[ctx->fail_port[end]] = p_backup;
+
+	return 0;
+}
+
+/*
+ * Computes the backup ports of the LIDs forwarded thru the link from
+ * port port of switch i, at both ends.  The ports of one end may only
+ * be found once the other end no longer uses the link, so the LIDs left
+ * are tried a second time.
+ */
+static int backup_link(IN backup_ctx_t * ctx, IN unsigned i, IN uint8_t port,
+		       OUT unsigned *num_lids, OUT unsigned *num_moved)
+{
+	backup_sw_t *sw;
+	unsigned end, pass;
+	uint16_t lid;
+	int ret = 0;
+
+	ctx->link_gen++;
+	ctx->undo_gen++;
+	ctx->fail_sw[0] = i;
+	ctx->fail_port[0] = port;
+	ctx->fail_sw[1] = ctx->sws[i].peer[port];
+	ctx->fail_port[1] = ctx->sws[i].peer_port[port];
+	for (end = 0; end < 2; end++) {
+		sw = &ctx->sws[ctx->fail_sw[end]];
+		memcpy(ctx->fail_lft[end], sw->lft, ctx->lft_len);
+		sw->lft = ctx->fail_lft[end];
+		for (lid = 1; lid <= ctx->max_lid; lid++)
+			if (sw->lft[lid] == ctx->fail_port[end])
+				(*num_lids)++;
+	}
+
+	for (pass = 0; pass < 2; pass++)
+		for (end = 0; end < 2; end++) {
+			sw = &ctx->sws[ctx->fail_sw[end]];
+			memset(ctx->load, 0, sw->num_ports * sizeof(*ctx->load));
+			for (lid = 1; lid <= ctx->max_lid; lid++)
+				if (sw->lft[lid] == ctx->fail_port[end] &&
+				    backup_reroute_lid(ctx, ctx->fail_sw[end],
+						       lid))
+					(*num_moved)++;
+		}
+
+	for (end = 0; end < 2; end++) {
+		sw = &ctx->sws[ctx->fail_sw[end]];
+		sw->lft = sw->base_lft;
+		if (backup_save(ctx, end))
+			ret = -1;
+	}
+	backup_undo_deps(ctx, 0);
+
+	return ret;
+}
+
+int osm_ucast_backup_prepare(IN osm_ucast_mgr_t * p_mgr)
+{
+	backup_ctx_t *ctx;
+	int ret = 0;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+
+	osm_ucast_backup_clear(p_mgr);
+	osm_ucast_backup_destroy(p_mgr);
+	if (!p_mgr->p_subn->opt.backup_lfts ||
+	    !cl_qmap_count(&p_mgr->p_subn->sw_guid_tbl))
+		goto Exit;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx || backup_ctx_init(ctx, p_mgr)) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR, "ERR 3A13: "
+			"cannot compute backup LFTs\n");
+		if (ctx)
+			backup_ctx_destroy(ctx);
+		ret = -1;
+		goto Exit;
+	}
+	p_mgr->p_backup = ctx;
+Exit:
+	OSM_LOG_EXIT(p_mgr->p_log);
+	return ret;
+}
+
+/* looked up again, as the subnet lock was released since the copy */
+static void backup_attach(IN backup_ctx_t * ctx)
+{
+	osm_switch_t *p_sw;
+	backup_sw_t *sw;
+	unsigned i;
+
+	for (i = 0; i < ctx->num_sws; i++) {
+		sw = &ctx->sws[i];
+		if (!sw->backup)
+			continue;
+		p_sw = osm_get_switch_by_guid(ctx->p_mgr->p_subn, sw->guid);
+		if (!p_sw || p_sw->num_ports != sw->num_ports)
+			continue;
+		osm_switch_clear_lft_backup(p_sw);
+		p_sw->lft_backup = sw->backup;
+		sw->backup = NULL;
+	}
+}
+
+int osm_ucast_backup_build(IN osm_ucast_mgr_t * p_mgr)
+{
+	backup_ctx_t *ctx = p_mgr->p_backup;
+	backup_sw_t *sw;
+	unsigned i, num_links = 0, num_lids = 0, num_moved = 0;
+	uint8_t port;
+	int j, ret = 0;
+
+	if (!ctx)
+		return 0;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+
+	backup_build_deps(ctx);
+
+	for (i = 0; i < ctx->num_sws; i++) {
+		sw = &ctx->sws[i];
+		for (port = 1; port < sw->num_ports; port++) {
+			/* each link once, none looping back to the switch */
+			if ((j = sw->peer[port]) < 0 || (unsigned)j <= i)
+				continue;
+			if (osm_exit_flag)
+				goto Done;
+			num_links++;
+			if (backup_link(ctx, i, port, &num_lids, &num_moved)) {
+				OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+					"ERR 3A14: cannot allocate memory "
+					"for backup LFTs\n");
+				ret = -1;
+				goto Done;
+			}
+		}
+	}
+
+	CL_PLOCK_EXCL_ACQUIRE(p_mgr->p_lock);
+	backup_attach(ctx);
+	CL_PLOCK_RELEASE(p_mgr->p_lock);
+
+	OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+		"Backup LFTs of %u links move %u of the %u LFT entries "
+		"thru them\n", num_links, num_moved, num_lids);
+Done:
+	osm_ucast_backup_destroy(p_mgr);
+	OSM_LOG_EXIT(p_mgr->p_log);
+	return ret;
+}
+
+static unsigned backup_push_port(IN osm_ucast_mgr_t * p_mgr,
+				 IN osm_physp_t * p_physp)
+{
+	osm_switch_t *p_sw = p_physp->p_node->sw;
+	uint8_t port = osm_physp_get_port_num(p_physp);
+	osm_lft_backup_t *p_backup;
+	unsigned i, num = 0;
+
+	if (!p_sw || !p_sw->lft_backup || port >= p_sw->num_ports ||
+	    !(p_backup = p_sw->lft_backup[port]))
+		return 0;
+
+	for (i = 0; i < p_backup->num_blocks; i++)
+		if (!osm_ucast_mgr_send_lft_block(p_mgr, p_sw,
+						  p_backup->blocks[i].block_num,
+						  p_backup->blocks[i].lft))
+			num++;
+
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Sent %u backup LFT blocks for port %u of switch 0x%016"
+		PRIx64 "\n", num, port,
+		cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)));
+	return num;
+}
+
+unsigned osm_ucast_backup_push(IN osm_ucast_mgr_t * p_mgr,
+			       IN osm_physp_t * p_physp)
+{
+	osm_physp_t *p_remote = osm_physp_get_remote(p_physp);
+	unsigned num;
+
+	num = backup_push_port(p_mgr, p_physp);
+	if (p_remote)
+		num += backup_push_port(p_mgr, p_remote);
+	if (num)
+		osm_ucast_backup_clear(p_mgr);
+
+	return num;
+}
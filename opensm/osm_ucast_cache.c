@@ -71,8 +71,7 @@ typedef struct cache_switch {
 	cl_map_item_t map_item;
 	boolean_t dropped;
 	uint16_t max_lid_ho;
-	uint16_t num_hops;
-	uint8_t **hops;
+	osm_lid_matrix_t lid_matrix;
 	uint8_t *lft;
 	uint8_t num_ports;
 	cache_port_t ports[0];
@@ -114,19 +113,12 @@ static cache_switch_t *cache_sw_new(uint16_t lid_ho, unsigned num_ports)
 
 static void cache_sw_destroy(cache_switch_t * p_sw)
 {
-	unsigned i;
-
 	if (!p_sw)
 		return;
 
 	if (p_sw->lft)
 		free(p_sw->lft);
-	if (p_sw->hops) {
-		for (i = 0; i < p_sw->num_hops; i++)
-			if (p_sw->hops[i])
-				free(p_sw->hops[i]);
-		free(p_sw->hops);
-	}
+	osm_lid_matrix_destroy(&p_sw->lid_matrix);
 	free(p_sw);
 }
 
@@ -316,7 +308,7 @@ cache_restore_ucast_info(osm_ucast_mgr_t * p_mgr,
 	/* when seting unicast info, the cached port
 	   should have all the required info */
 	CL_ASSERT(p_cache_sw->max_lid_ho && p_cache_sw->lft &&
-		  p_cache_sw->num_hops && p_cache_sw->hops);
+		  p_cache_sw->lid_matrix.num_lids);
 
 	p_sw->max_lid_ho = p_cache_sw->max_lid_ho;
 
@@ -325,12 +317,9 @@ cache_restore_ucast_info(osm_ucast_mgr_t * p_mgr,
 	p_sw->new_lft = p_cache_sw->lft;
 	p_cache_sw->lft = NULL;
 
-	p_sw->num_hops = p_cache_sw->num_hops;
-	p_cache_sw->num_hops = 0;
-	if (p_sw->hops)
-		free(p_sw->hops);
-	p_sw->hops = p_cache_sw->hops;
-	p_cache_sw->hops = NULL;
+	osm_lid_matrix_destroy(&p_sw->lid_matrix);
+	p_sw->lid_matrix = p_cache_sw->lid_matrix;
+	memset(&p_cache_sw->lid_matrix, 0, sizeof(p_cache_sw->lid_matrix));
 
 	p_sw->need_update = 2;
 }
@@ -970,7 +959,7 @@ void osm_ucast_cache_add_node(osm_ucast_mgr_t * p_mgr, osm_node_t * p_node)
 
 		p_cache_sw->dropped = TRUE;
 
-		if (!p_node->sw->num_hops || !p_node->sw->hops) {
+		if (!p_node->sw->lid_matrix.num_lids) {
 			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
 				"No LID matrices for switch lid %u\n", lid_ho);
 			osm_ucast_cache_invalidate(p_mgr);
@@ -979,10 +968,9 @@ void osm_ucast_cache_add_node(osm_ucast_mgr_t * p_mgr, osm_node_t * p_node)
 
 		/* lid matrices */
 
-		p_cache_sw->num_hops = p_node->sw->num_hops;
-		p_node->sw->num_hops = 0;
-		p_cache_sw->hops = p_node->sw->hops;
-		p_node->sw->hops = NULL;
+		p_cache_sw->lid_matrix = p_node->sw->lid_matrix;
+		memset(&p_node->sw->lid_matrix, 0,
+		       sizeof(p_node->sw->lid_matrix));
 
 		/* linear forwarding table */
 
@@ -49,6 +49,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <complib/cl_heap.h>
+#include <complib/cl_thread.h>
 #include <opensm/osm_file_ids.h>
 #define FILE_ID OSM_FILE_UCAST_DFSSSP_C
 #include <opensm/osm_ucast_mgr.h>
@@ -79,20 +80,24 @@ static inline void vltable_sort_lids(vltable_t * vltable)
 	qsort(vltable->lids, vltable->num_lids, sizeof(ib_net16_t), cmp_lids);
 }
 
-/* use stdlib to get index of key in lid array;
-   return -1 if lid isn't found in lids array
+/* the switch which injects the traffic of a port into the fabric;
+   return NULL if the port isn't attached to a switch
 */
-static inline int64_t vltable_get_lidindex(ib_net16_t * key, vltable_t * vltable)
+static osm_switch_t *vltable_get_src_switch(osm_port_t * port)
 {
-	ib_net16_t *found_lid = NULL;
+	osm_node_t *remote_node = NULL;
+	uint8_t remote_port = 0;
 
-	found_lid =
-	    (ib_net16_t *) bsearch(key, vltable->lids, vltable->num_lids,
-				   sizeof(ib_net16_t), cmp_lids);
-	if (found_lid)
-		return found_lid - vltable->lids;
+	if (port->p_node->sw)
+		return port->p_node->sw;
+
+	remote_node = osm_node_get_remote_node(port->p_node,
+					       port->p_physp->port_num,
+					       &remote_port);
+	if (remote_node && remote_node->sw)
+		return remote_node->sw;
 	else
-		return -1;
+		return NULL;
 }
 
 /* get virtual lane from src lid X dest lid combination;
@@ -100,12 +105,17 @@ static inline int64_t vltable_get_lidindex(ib_net16_t * key, vltable_t * vltable
 */
 int32_t vltable_get_vl(vltable_t * vltable, ib_net16_t slid, ib_net16_t dlid)
 {
-	int64_t ind1 = vltable_get_lidindex(&slid, vltable);
-	int64_t ind2 = vltable_get_lidindex(&dlid, vltable);
+	uint16_t slid_ho = cl_ntoh16(slid), dlid_ho = cl_ntoh16(dlid);
+	int32_t ind1 = -1, ind2 = -1;
+
+	if (slid_ho > vltable->max_lid || dlid_ho > vltable->max_lid)
+		return -1;
 
+	ind1 = vltable->src_index[slid_ho];
+	ind2 = vltable->dst_index[dlid_ho];
 	if (ind1 > -1 && ind2 > -1)
 		return (int32_t) (vltable->
-				  vls[ind1 + ind2 * vltable->num_lids]);
+				  vls[ind1 + (uint64_t) ind2 * vltable->num_srcs]);
 	else
 		return -1;
 }
@@ -114,58 +124,62 @@ int32_t vltable_get_vl(vltable_t * vltable, ib_net16_t slid, ib_net16_t dlid)
 static inline void vltable_insert(vltable_t * vltable, ib_net16_t slid,
 				  ib_net16_t dlid, uint8_t vl)
 {
-	int64_t ind1 = vltable_get_lidindex(&slid, vltable);
-	int64_t ind2 = vltable_get_lidindex(&dlid, vltable);
+	uint16_t slid_ho = cl_ntoh16(slid), dlid_ho = cl_ntoh16(dlid);
+	int32_t ind1 = -1, ind2 = -1;
+
+	if (slid_ho > vltable->max_lid || dlid_ho > vltable->max_lid)
+		return;
 
+	ind1 = vltable->src_index[slid_ho];
+	ind2 = vltable->dst_index[dlid_ho];
 	if (ind1 > -1 && ind2 > -1)
-		vltable->vls[ind1 + ind2 * vltable->num_lids] = vl;
+		vltable->vls[ind1 + (uint64_t) ind2 * vltable->num_srcs] = vl;
 }
 
-/* change a number of lanes from lane xy to lane yz */
-static int vltable_change_vl(vltable_t * vltable, uint8_t from, uint8_t to,
-			      uint64_t count)
+/* change a number of lanes from lane xy to lane yz;
+   return the number of src/dest pairs which have been moved (with a
+   per switch table one entry moves all src lids of the switch at once)
+*/
+static uint64_t vltable_change_vl(vltable_t * vltable, uint8_t from,
+				  uint8_t to, uint64_t count)
 {
-	uint64_t set = 0, stop = 0;
+	uint64_t set = 0;
 	uint64_t ind1 = 0, ind2 = 0;
+	uint8_t *vl = NULL;
 
-	for (ind1 = 0; ind1 < vltable->num_lids; ind1++) {
+	for (ind1 = 0; ind1 < vltable->num_srcs; ind1++) {
 		for (ind2 = 0; ind2 < vltable->num_lids; ind2++) {
-			if (set == count) {
-				stop = 1;
-				break;
-			}
-			if (ind1 != ind2) {
-				if (vltable->
-				    vls[ind1 + ind2 * vltable->num_lids] ==
-				    from) {
-					vltable->vls[ind1 +
-						     ind2 * vltable->num_lids] =
-					    to;
-					set++;
-				}
+			if (set >= count)
+				return set;
+			if (!vltable->per_switch && ind1 == ind2)
+				continue;
+			vl = &(vltable->vls[ind1 + ind2 * vltable->num_srcs]);
+			if (*vl == from) {
+				*vl = to;
+				set += vltable->src_weight[ind1];
 			}
 		}
-		if (stop)
-			return 0;
 	}
-	return 1;
+	return set;
 }
 
 static void vltable_print(osm_ucast_mgr_t * p_mgr, vltable_t * vltable)
 {
 	uint64_t ind1 = 0, ind2 = 0;
 
-	for (ind1 = 0; ind1 < vltable->num_lids; ind1++) {
+	for (ind1 = 0; ind1 < vltable->num_srcs; ind1++) {
 		for (ind2 = 0; ind2 < vltable->num_lids; ind2++) {
-			if (ind1 != ind2) {
-				OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-					"   route from src_lid=%" PRIu16
-					" to dest_lid=%" PRIu16 " on vl=%" PRIu8
-					"\n", cl_ntoh16(vltable->lids[ind1]),
-					cl_ntoh16(vltable->lids[ind2]),
-					vltable->vls[ind1 +
-						     ind2 * vltable->num_lids]);
-			}
+			if (!vltable->per_switch && ind1 == ind2)
+				continue;
+			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+				"   route from %s=%" PRIu16
+				" to dest_lid=%" PRIu16 " on vl=%" PRIu8
+				"\n",
+				vltable->per_switch ? "src_switch" : "src_lid",
+				vltable->src_lids[ind1],
+				cl_ntoh16(vltable->lids[ind2]),
+				vltable->vls[ind1 +
+					     ind2 * vltable->num_srcs]);
 		}
 	}
 }
@@ -177,25 +191,33 @@ void vltable_dealloc(vltable_t ** vltable)
 			free((*vltable)->lids);
 		if ((*vltable)->vls)
 			free((*vltable)->vls);
+		if ((*vltable)->src_index)
+			free((*vltable)->src_index);
+		if ((*vltable)->dst_index)
+			free((*vltable)->dst_index);
+		if ((*vltable)->src_weight)
+			free((*vltable)->src_weight);
+		if ((*vltable)->src_lids)
+			free((*vltable)->src_lids);
 		free(*vltable);
 		*vltable = NULL;
 	}
 }
 
-static int vltable_alloc(vltable_t ** vltable, uint64_t size)
+/* allocate the VL table and the lids array; the matrix itself is
+   allocated by vltable_build_index after the lids array is filled
+*/
+static int vltable_alloc(vltable_t ** vltable, uint64_t size,
+			 boolean_t per_switch)
 {
-	/* allocate VL table and indexing array */
-	*vltable = (vltable_t *) malloc(sizeof(vltable_t));
+	*vltable = (vltable_t *) calloc(1, sizeof(vltable_t));
 	if (!(*vltable))
 		goto ERROR;
 	(*vltable)->num_lids = size;
+	(*vltable)->per_switch = per_switch;
 	(*vltable)->lids = (ib_net16_t *) malloc(size * sizeof(ib_net16_t));
 	if (!((*vltable)->lids))
 		goto ERROR;
-	(*vltable)->vls = (uint8_t *) malloc(size * size * sizeof(uint8_t));
-	if (!((*vltable)->vls))
-		goto ERROR;
-	memset((*vltable)->vls, OSM_DEFAULT_SL, size * size);
 
 	return 0;
 
@@ -205,45 +227,216 @@ ERROR:
 	return 1;
 }
 
+/* map each lid directly to its row (src lid or src switch) and column
+   (dest lid) of the matrix, so that lookups don't need a search;
+   the lids array has to be sorted before
+*/
+static int vltable_build_index(osm_ucast_mgr_t * p_mgr, vltable_t * vltable)
+{
+	osm_port_t *port = NULL;
+	osm_switch_t *sw = NULL;
+	int32_t *sw_row = NULL;
+	uint16_t lid = 0, sw_lid = 0;
+	uint64_t i = 0, size = vltable->num_lids;
+
+	/* lids are sorted in network byte order, so search the maximum */
+	vltable->max_lid = 0;
+	for (i = 0; i < size; i++)
+		if (cl_ntoh16(vltable->lids[i]) > vltable->max_lid)
+			vltable->max_lid = cl_ntoh16(vltable->lids[i]);
+	vltable->src_index =
+	    (int32_t *) malloc((vltable->max_lid + 1) * sizeof(int32_t));
+	vltable->dst_index =
+	    (int32_t *) malloc((vltable->max_lid + 1) * sizeof(int32_t));
+	vltable->src_weight = (uint32_t *) calloc(size + 1, sizeof(uint32_t));
+	vltable->src_lids = (uint16_t *) calloc(size + 1, sizeof(uint16_t));
+	if (!vltable->src_index || !vltable->dst_index
+	    || !vltable->src_weight || !vltable->src_lids)
+		goto ERROR;
+	memset(vltable->src_index, 0xff,
+	       (vltable->max_lid + 1) * sizeof(int32_t));
+	memset(vltable->dst_index, 0xff,
+	       (vltable->max_lid + 1) * sizeof(int32_t));
+
+	for (i = 0; i < size; i++)
+		vltable->dst_index[cl_ntoh16(vltable->lids[i])] = (int32_t) i;
+
+	if (!vltable->per_switch) {
+		for (i = 0; i < size; i++) {
+			lid = cl_ntoh16(vltable->lids[i]);
+			vltable->src_index[lid] = (int32_t) i;
+			vltable->src_weight[i] = 1;
+			vltable->src_lids[i] = lid;
+		}
+		vltable->num_srcs = (uint32_t) size;
+	} else {
+		/* all lids behind the same switch share one row, because
+		   their paths only differ in the (cycle free) first channel
+		 */
+		sw_row = (int32_t *) malloc((IB_LID_UCAST_END_HO + 1) *
+					    sizeof(int32_t));
+		if (!sw_row)
+			goto ERROR;
+		memset(sw_row, 0xff, (IB_LID_UCAST_END_HO + 1) *
+		       sizeof(int32_t));
+
+		vltable->num_srcs = 0;
+		for (i = 0; i < size; i++) {
+			lid = cl_ntoh16(vltable->lids[i]);
+			port = osm_get_port_by_lid_ho(p_mgr->p_subn, lid);
+			if (!port)
+				continue;
+			sw = vltable_get_src_switch(port);
+			if (!sw)
+				continue;
+			sw_lid = cl_ntoh16(osm_node_get_base_lid(sw->p_node, 0));
+			if (sw_row[sw_lid] < 0) {
+				sw_row[sw_lid] = (int32_t) vltable->num_srcs;
+				vltable->src_lids[vltable->num_srcs] = sw_lid;
+				vltable->num_srcs++;
+			}
+			vltable->src_index[lid] = sw_row[sw_lid];
+			vltable->src_weight[sw_row[sw_lid]]++;
+		}
+		free(sw_row);
+	}
+
+	vltable->vls =
+	    (uint8_t *) malloc((uint64_t) vltable->num_srcs * size *
+			       sizeof(uint8_t) + 1);
+	if (!vltable->vls)
+		goto ERROR;
+	memset(vltable->vls, OSM_DEFAULT_SL,
+	       (uint64_t) vltable->num_srcs * size);
+
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"VL table with %" PRIu32 " %s x %" PRIu64 " dest lids\n",
+		vltable->num_srcs, vltable->per_switch ? "src switches" :
+		"src lids", size);
+
+	return 0;
+
+ERROR:
+	return 1;
+}
+
 /**********************************************************************
  **********************************************************************/
 
 /************ helper functions to save/manage the channel dep. graph **
  **********************************************************************/
-/* update the srcdest array;
-   realloc array (double the size) if size is not large enough
-*/
-static void set_next_srcdest_pair(cdg_link_t * link, uint32_t srcdest)
+static void cdg_arena_destroy(cdg_arena_t * arena)
 {
-	uint32_t new_size = 0, start_size = 2;
-	uint32_t *tmp = NULL, *tmp2 = NULL;
+	cdg_arena_slab_t *slab = NULL;
 
-	if (link->num_pairs == 0) {
-		link->srcdest_pairs =
-		    (uint32_t *) malloc(start_size * sizeof(uint32_t));
-		link->srcdest_pairs[link->num_pairs] = srcdest;
-		link->max_len = start_size;
-		link->removed = 0;
-	} else if (link->num_pairs == link->max_len) {
-		new_size = link->max_len << 1;
-		tmp = (uint32_t *) malloc(new_size * sizeof(uint32_t));
-		tmp =
-		    memcpy(tmp, link->srcdest_pairs,
-			   link->max_len * sizeof(uint32_t));
-		tmp2 = link->srcdest_pairs;
-		link->srcdest_pairs = tmp;
-		link->srcdest_pairs[link->num_pairs] = srcdest;
-		free(tmp2);
-		link->max_len = new_size;
+	while (arena->slabs) {
+		slab = arena->slabs;
+		arena->slabs = slab->next;
+		free(slab);
+	}
+	arena->free_blocks = NULL;
+	arena->unused = 0;
+}
+
+static cdg_pair_block_t *cdg_arena_get_block(cdg_arena_t * arena)
+{
+	cdg_arena_slab_t *slab = NULL;
+	cdg_pair_block_t *block = NULL;
+
+	if (arena->free_blocks) {
+		block = arena->free_blocks;
+		arena->free_blocks = block->next;
 	} else {
-		link->srcdest_pairs[link->num_pairs] = srcdest;
+		if (!arena->unused) {
+			slab = (cdg_arena_slab_t *)
+			    malloc(sizeof(cdg_arena_slab_t));
+			if (!slab)
+				return NULL;
+			slab->next = arena->slabs;
+			arena->slabs = slab;
+			arena->unused = CDG_ARENA_SLAB_BLOCKS;
+		}
+		block = &arena->slabs->blocks[--arena->unused];
+	}
+	block->next = NULL;
+	return block;
+}
+
+/* give the blocks of the srcdest pairs of a link back to the arena */
+static void cdg_link_free_pairs(cdg_arena_t * arena, cdg_link_t * link)
+{
+	if (link->head) {
+		link->tail->next = arena->free_blocks;
+		arena->free_blocks = link->head;
 	}
+	link->head = NULL;
+	link->tail = NULL;
+	link->tail_len = 0;
+	link->last_pair = 0;
+	link->num_pairs = 0;
+	link->removed = 0;
+}
+
+/* append a srcdest pair to the link as varint of the zigzag encoded
+   difference to the previous pair; return 1 if out of memory
+*/
+static int set_next_srcdest_pair(cdg_arena_t * arena, cdg_link_t * link,
+				 uint32_t srcdest)
+{
+	int32_t delta = (int32_t) (srcdest - link->last_pair);
+	uint32_t zigzag = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+	cdg_pair_block_t *block = NULL;
+
+	if (link->num_pairs == 0)
+		link->removed = 0;
+	do {
+		if (!link->tail || link->tail_len == CDG_PAIR_BLOCK_SIZE) {
+			block = cdg_arena_get_block(arena);
+			if (!block)
+				return 1;
+			if (link->tail)
+				link->tail->next = block;
+			else
+				link->head = block;
+			link->tail = block;
+			link->tail_len = 0;
+		}
+		link->tail->data[link->tail_len++] =
+		    (uint8_t) ((zigzag & 0x7f) | ((zigzag > 0x7f) << 7));
+		zigzag >>= 7;
+	} while (zigzag);
+
+	link->last_pair = srcdest;
 	link->num_pairs++;
+	return 0;
+}
+
+static inline void cdg_pair_iter_init(cdg_pair_iter_t * iter,
+				      cdg_link_t * link)
+{
+	iter->block = link->head;
+	iter->pos = 0;
+	iter->value = 0;
 }
 
-static inline uint32_t get_next_srcdest_pair(cdg_link_t * link, uint32_t index)
+/* decode the next srcdest pair; the caller iterates at most num_pairs times */
+static inline uint32_t get_next_srcdest_pair(cdg_pair_iter_t * iter)
 {
-	return link->srcdest_pairs[index];
+	uint32_t zigzag = 0, shift = 0;
+	uint8_t byte = 0;
+
+	do {
+		if (iter->pos == CDG_PAIR_BLOCK_SIZE) {
+			iter->block = iter->block->next;
+			iter->pos = 0;
+		}
+		byte = iter->block->data[iter->pos++];
+		zigzag |= (uint32_t) (byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	iter->value += (zigzag >> 1) ^ (uint32_t) (-(int32_t) (zigzag & 1));
+	return iter->value;
 }
 
 /* traverse binary tree to find a node */
@@ -295,7 +488,7 @@ static void cdg_insert(cdg_node_t ** root, cdg_node_t * new_node)
 	}
 }
 
-static void cdg_node_dealloc(cdg_node_t * node)
+static void cdg_node_dealloc(cdg_arena_t * arena, cdg_node_t * node)
 {
 	cdg_link_t *link = node->linklist, *tmp = NULL;
 
@@ -304,15 +497,14 @@ static void cdg_node_dealloc(cdg_node_t * node)
 		tmp = link;
 		link = link->next;
 
-		if (tmp->num_pairs)
-			free(tmp->srcdest_pairs);
+		cdg_link_free_pairs(arena, tmp);
 		free(tmp);
 	}
 	/* dealloc node */
 	free(node);
 }
 
-static void cdg_dealloc(cdg_node_t ** root)
+static void cdg_dealloc(cdg_arena_t * arena, cdg_node_t ** root)
 {
 	cdg_node_t *current = *root;
 
@@ -323,17 +515,17 @@ static void cdg_dealloc(cdg_node_t ** root)
 			current = current->right;
 		} else {
 			if (current->parent == NULL) {
-				cdg_node_dealloc(current);
+				cdg_node_dealloc(arena, current);
 				*root = NULL;
 				break;
 			}
 			if (current->parent->left == current) {
 				current = current->parent;
-				cdg_node_dealloc(current->left);
+				cdg_node_dealloc(arena, current->left);
 				current->left = NULL;
 			} else if (current->parent->right == current) {
 				current = current->parent;
-				cdg_node_dealloc(current->right);
+				cdg_node_dealloc(arena, current->right);
 				current->right = NULL;
 			}
 		}
@@ -439,7 +631,8 @@ static cdg_node_t *get_next_cdg_node(cdg_node_t * root)
 }
 
 /* make a DFS on the cdg to check for a cycle */
-static cdg_node_t *search_cycle_in_channel_dep_graph(cdg_node_t * cdg,
+static cdg_node_t *search_cycle_in_channel_dep_graph(cdg_arena_t * arena,
+						     cdg_node_t * cdg,
 						     cdg_node_t * start_node)
 {
 	cdg_node_t *cycle = NULL;
@@ -471,11 +664,7 @@ static cdg_node_t *search_cycle_in_channel_dep_graph(cdg_node_t * cdg,
 			/* srcdest_pairs of this node aren't relevant, free the allocated memory */
 			link = current->linklist;
 			while (link) {
-				if (link->num_pairs)
-					free(link->srcdest_pairs);
-				link->srcdest_pairs = NULL;
-				link->num_pairs = 0;
-				link->removed = 0;
+				cdg_link_free_pairs(arena, link);
 				link = link->next;
 			}
 
@@ -499,7 +688,8 @@ Exit:
 /* calculate the path from source to destination port;
    new channels are added directly to the cdg
 */
-static int update_channel_dep_graph(cdg_node_t ** cdg_root,
+static int update_channel_dep_graph(cdg_arena_t * arena,
+				    cdg_node_t ** cdg_root,
 				    osm_port_t * src_port, uint16_t slid,
 				    osm_port_t * dest_port, uint16_t dlid)
 {
@@ -561,8 +751,10 @@ static int update_channel_dep_graph(cdg_node_t ** cdg_root,
 			/* if there is no connection, add one */
 			if (linklist) {
 				if (linklist->node == channel) {
-					set_next_srcdest_pair(linklist,
-							      srcdest);
+					if (set_next_srcdest_pair(arena,
+								  linklist,
+								  srcdest))
+						goto ERROR;
 				} else {
 					linklist->next =
 					    (cdg_link_t *)
@@ -570,12 +762,12 @@ static int update_channel_dep_graph(cdg_node_t ** cdg_root,
 					if (!linklist->next)
 						goto ERROR;
 					linklist = linklist->next;
+					set_default_cdg_link(linklist);
 					linklist->node = channel;
-					linklist->num_pairs = 0;
-					linklist->srcdest_pairs = NULL;
-					set_next_srcdest_pair(linklist,
-							      srcdest);
-					linklist->next = NULL;
+					if (set_next_srcdest_pair(arena,
+								  linklist,
+								  srcdest))
+						goto ERROR;
 				}
 			} else {
 				/* either this is the first channel of the path, or the last channel was a new channel, or last channel was a sink */
@@ -583,12 +775,12 @@ static int update_channel_dep_graph(cdg_node_t ** cdg_root,
 				    (cdg_link_t *) malloc(sizeof(cdg_link_t));
 				if (!last_channel->linklist)
 					goto ERROR;
+				set_default_cdg_link(last_channel->linklist);
 				last_channel->linklist->node = channel;
-				last_channel->linklist->num_pairs = 0;
-				last_channel->linklist->srcdest_pairs = NULL;
-				set_next_srcdest_pair(last_channel->linklist,
-						      srcdest);
-				last_channel->linklist->next = NULL;
+				if (set_next_srcdest_pair(arena,
+							  last_channel->linklist,
+							  srcdest))
+					goto ERROR;
 			}
 		} else {
 			/* create new channel */
@@ -610,31 +802,30 @@ static int update_channel_dep_graph(cdg_node_t ** cdg_root,
 				if (!linklist->next)
 					goto ERROR;
 				linklist = linklist->next;
+				set_default_cdg_link(linklist);
 				linklist->node = channel;
-				linklist->num_pairs = 0;
-				linklist->srcdest_pairs = NULL;
-				set_next_srcdest_pair(linklist, srcdest);
-				linklist->next = NULL;
+				if (set_next_srcdest_pair(arena, linklist,
+							  srcdest))
+					goto ERROR;
 			} else {
 				/* either this is the first channel of the path, or the last channel was a new channel, or last channel was a sink */
 				last_channel->linklist =
 				    (cdg_link_t *) malloc(sizeof(cdg_link_t));
 				if (!last_channel->linklist)
 					goto ERROR;
+				set_default_cdg_link(last_channel->linklist);
 				last_channel->linklist->node = channel;
-				last_channel->linklist->num_pairs = 0;
-				last_channel->linklist->srcdest_pairs = NULL;
-				set_next_srcdest_pair(last_channel->linklist,
-						      srcdest);
-				last_channel->linklist->next = NULL;
+				if (set_next_srcdest_pair(arena,
+							  last_channel->linklist,
+							  srcdest))
+					goto ERROR;
 			}
 		}
 		last_channel = channel;
 	}
 
 	if (channel_head->linklist) {
-		if (channel_head->linklist->srcdest_pairs)
-			free(channel_head->linklist->srcdest_pairs);
+		cdg_link_free_pairs(arena, channel_head->linklist);
 		free(channel_head->linklist);
 	}
 	free(channel_head);
@@ -644,8 +835,10 @@ static int update_channel_dep_graph(cdg_node_t ** cdg_root,
 ERROR:
 	/* cleanup data and exit */
 	if (channel_head) {
-		if (channel_head->linklist)
+		if (channel_head->linklist) {
+			cdg_link_free_pairs(arena, channel_head->linklist);
 			free(channel_head->linklist);
+		}
 		free(channel_head);
 	}
 
@@ -744,471 +937,1003 @@ ERROR:
 /**********************************************************************
  **********************************************************************/
 
-/************ helper functions to generate an ordered list of ports ***
- ************ (functions copied from osm_ucast_mgr.c and modified) ****
+/************ helper functions for the incremental channel dep. graph *
  **********************************************************************/
-void add_sw_endports_to_order_list(osm_switch_t * sw,
-					  osm_ucast_mgr_t * m,
-					  cl_qmap_t * guid_tbl,
-					  boolean_t add_guids)
+/* channels are indexed by (switch, port) and each VL keeps a topological
+   order of its (acyclic) channel dependency graph, which is maintained
+   with the dynamic topological sort of Pearce and Kelly while paths are
+   added; a path which would close a cycle is rejected and tried on the
+   next VL instead of breaking cycles afterwards
+*/
+typedef struct cdg_dag_node {
+	uint32_t *out;		/* successors of this channel */
+	uint32_t *in;		/* predecessors of this channel */
+	uint32_t num_out, max_out;
+	uint32_t num_in, max_in;
+} cdg_dag_node_t;
+
+typedef struct cdg_dag {
+	cdg_dag_node_t *nodes;
+	uint32_t *ord;		/* topological index of a channel */
+	uint32_t *node_at;	/* channel at a topological index */
+} cdg_dag_t;
+
+typedef struct cdg_engine {
+	uint32_t num_channels;
+	uint32_t num_dags;
+	cdg_dag_t *dags;	/* one graph per VL, allocated on first use */
+	uint32_t *port_offset;	/* first channel of a switch in adj_list */
+	uint32_t *sw_index;	/* base lid of a switch -> index in adj_list */
+	uint16_t max_sw_lid;
+	/* scratch space of the reordering step */
+	uint32_t *mark;
+	uint32_t stamp;
+	uint32_t *stack;
+	uint32_t *delta_f, *delta_b, *pool;
+	uint32_t num_f, num_b;
+} cdg_engine_t;
+
+static void cdg_dag_dealloc(cdg_dag_t * dag, uint32_t num_channels)
 {
-	osm_port_t *port;
-	ib_net64_t port_guid;
-	uint64_t sw_guid;
-	osm_physp_t *p;
-	int i;
-	boolean_t found;
+	uint32_t i = 0;
 
-	for (i = 1; i < sw->num_ports; i++) {
-		p = osm_node_get_physp_ptr(sw->p_node, i);
-		if (p && p->p_remote_physp && !p->p_remote_physp->p_node->sw) {
-			port_guid = p->p_remote_physp->port_guid;
-			/* check if link is healthy, otherwise ignore CA */
-			if (!osm_link_is_healthy(p)) {
-				sw_guid =
-				    cl_ntoh64(osm_node_get_node_guid
-					      (sw->p_node));
-				OSM_LOG(m->p_log, OSM_LOG_INFO,
-					"WRN AD40: ignoring CA due to unhealthy"
-					" link from switch 0x%016" PRIx64
-					" port %" PRIu8 " to CA 0x%016" PRIx64
-					"\n", sw_guid, i, cl_ntoh64(port_guid));
-			}
-			port = osm_get_port_by_guid(m->p_subn, port_guid);
-			if (!port)
-				continue;
-			if (!cl_is_qmap_empty(guid_tbl)) {
-				found = (cl_qmap_get(guid_tbl, port_guid)
-					 != cl_qmap_end(guid_tbl));
-				if ((add_guids && !found)
-				    || (!add_guids && found))
-					continue;
-			}
-			if (!cl_is_item_in_qlist(&m->port_order_list,
-						 &port->list_item))
-				cl_qlist_insert_tail(&m->port_order_list,
-						     &port->list_item);
-			else
-				OSM_LOG(m->p_log, OSM_LOG_INFO,
-					"WRN AD37: guid 0x%016" PRIx64
-					" already in list\n", port_guid);
+	if (dag->nodes) {
+		for (i = 0; i < num_channels; i++) {
+			free(dag->nodes[i].out);
+			free(dag->nodes[i].in);
 		}
+		free(dag->nodes);
 	}
+	free(dag->ord);
+	free(dag->node_at);
+	dag->nodes = NULL;
+	dag->ord = NULL;
+	dag->node_at = NULL;
 }
 
-void add_guid_to_order_list(uint64_t guid, osm_ucast_mgr_t * m)
+static int cdg_dag_alloc(cdg_dag_t * dag, uint32_t num_channels)
 {
-	osm_port_t *port = osm_get_port_by_guid(m->p_subn, cl_hton64(guid));
+	uint32_t i = 0;
 
-	if (!port) {
-		 OSM_LOG(m->p_log, OSM_LOG_DEBUG,
-			 "port guid not found: 0x%016" PRIx64 "\n", guid);
+	dag->nodes = (cdg_dag_node_t *) calloc(num_channels,
+					       sizeof(cdg_dag_node_t));
+	dag->ord = (uint32_t *) malloc(num_channels * sizeof(uint32_t));
+	dag->node_at = (uint32_t *) malloc(num_channels * sizeof(uint32_t));
+	if (!dag->nodes || !dag->ord || !dag->node_at) {
+		cdg_dag_dealloc(dag, num_channels);
+		return 1;
 	}
-
-	if (!cl_is_item_in_qlist(&m->port_order_list, &port->list_item))
-		cl_qlist_insert_tail(&m->port_order_list, &port->list_item);
-	else
-		OSM_LOG(m->p_log, OSM_LOG_INFO,
-			"WRN AD38: guid 0x%016" PRIx64 " already in list\n",
-			guid);
+	/* without edges every order is a topological order */
+	for (i = 0; i < num_channels; i++) {
+		dag->ord[i] = i;
+		dag->node_at[i] = i;
+	}
+	return 0;
 }
 
-/* compare function of #Hca attached to a switch for stdlib qsort */
-int cmp_num_hca(const void * l1, const void * l2)
+static void cdg_engine_dealloc(cdg_engine_t * engine)
 {
-	vertex_t *sw1 = *((vertex_t **) l1);
-	vertex_t *sw2 = *((vertex_t **) l2);
-	uint32_t num_hca1 = 0, num_hca2 = 0;
-
-	if (sw1)
-		num_hca1 = sw1->num_hca;
-	if (sw2)
-		num_hca2 = sw2->num_hca;
+	uint32_t i = 0;
 
-	if (num_hca1 > num_hca2)
-		return -1;
-	else if (num_hca1 < num_hca2)
-		return 1;
-	else
-		return 0;
+	if (engine->dags) {
+		for (i = 0; i < engine->num_dags; i++)
+			cdg_dag_dealloc(&engine->dags[i], engine->num_channels);
+		free(engine->dags);
+	}
+	free(engine->port_offset);
+	free(engine->sw_index);
+	free(engine->mark);
+	free(engine->stack);
+	free(engine->delta_f);
+	free(engine->delta_b);
+	free(engine->pool);
+	memset(engine, 0, sizeof(cdg_engine_t));
 }
 
-/**********************************************************************
- **********************************************************************/
-
-/************ helper functions to manage a map of CN and I/O guids ****
- **********************************************************************/
-int add_guid_to_map(void * cxt, uint64_t guid, char * p)
+static int cdg_engine_alloc(cdg_engine_t * engine, vertex_t * adj_list,
+			    uint32_t adj_list_size, uint32_t num_dags)
 {
-	cl_qmap_t *map = cxt;
-	name_map_item_t *item;
-	name_map_item_t *inserted_item;
+	uint32_t i = 0, n = 0;
 
-	item = malloc(sizeof(*item));
-	if (!item)
-		return -1;
+	memset(engine, 0, sizeof(cdg_engine_t));
+	engine->num_dags = num_dags;
 
-	item->guid = cl_hton64(guid);	/* internal: network byte order */
-	item->name = NULL;		/* name isn't needed */
-	inserted_item = (name_map_item_t *) cl_qmap_insert(map, item->guid, &item->item);
-	if (inserted_item != item)
-                free(item);
+	engine->port_offset =
+	    (uint32_t *) malloc((adj_list_size + 1) * sizeof(uint32_t));
+	if (!engine->port_offset)
+		goto ERROR;
+	engine->port_offset[0] = 0;
+	engine->port_offset[1] = 0;
+	for (i = 1; i < adj_list_size; i++) {
+		engine->port_offset[i + 1] =
+		    engine->port_offset[i] + adj_list[i].sw->num_ports;
+		if (adj_list[i].lid > engine->max_sw_lid)
+			engine->max_sw_lid = adj_list[i].lid;
+	}
+	n = engine->port_offset[adj_list_size];
+	engine->num_channels = n;
+
+	engine->sw_index =
+	    (uint32_t *) calloc(engine->max_sw_lid + 1, sizeof(uint32_t));
+	if (!engine->sw_index)
+		goto ERROR;
+	for (i = 1; i < adj_list_size; i++)
+		engine->sw_index[adj_list[i].lid] = i;
+
+	engine->dags = (cdg_dag_t *) calloc(num_dags, sizeof(cdg_dag_t));
+	engine->mark = (uint32_t *) calloc(n + 1, sizeof(uint32_t));
+	engine->stack = (uint32_t *) malloc((n + 1) * sizeof(uint32_t));
+	engine->delta_f = (uint32_t *) malloc((n + 1) * sizeof(uint32_t));
+	engine->delta_b = (uint32_t *) malloc((n + 1) * sizeof(uint32_t));
+	engine->pool = (uint32_t *) malloc((n + 1) * sizeof(uint32_t));
+	if (!engine->dags || !engine->mark || !engine->stack
+	    || !engine->delta_f || !engine->delta_b || !engine->pool)
+		goto ERROR;
 
 	return 0;
+
+ERROR:
+	cdg_engine_dealloc(engine);
+	return 1;
 }
 
-void destroy_guid_map(cl_qmap_t * guid_tbl)
+/* append a channel to a successor/predecessor array */
+static int cdg_dag_append(uint32_t ** array, uint32_t * num, uint32_t * max,
+			  uint32_t channel)
 {
-	name_map_item_t *p_guid = NULL, *p_next_guid = NULL;
+	uint32_t *tmp = NULL;
 
-	p_next_guid = (name_map_item_t *) cl_qmap_head(guid_tbl);
-	while (p_next_guid != (name_map_item_t *) cl_qmap_end(guid_tbl)) {
-		p_guid = p_next_guid;
-		p_next_guid = (name_map_item_t *) cl_qmap_next(&p_guid->item);
-		free(p_guid);
+	if (*num == *max) {
+		tmp = (uint32_t *) realloc(*array, (*max ? *max << 1 : 4) *
+					   sizeof(uint32_t));
+		if (!tmp)
+			return 1;
+		*array = tmp;
+		*max = *max ? *max << 1 : 4;
 	}
-	cl_qmap_remove_all(guid_tbl);
+	(*array)[(*num)++] = channel;
+	return 0;
 }
 
-/**********************************************************************
- **********************************************************************/
-
-void print_graph(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
-			       uint32_t size)
+static void cdg_dag_unlink(uint32_t * array, uint32_t * num, uint32_t channel)
 {
-	uint32_t i = 0, c = 0;
-	link_t *link = NULL;
-
-	/* index 0 is for the source in dijkstra -> ignore */
-	for (i = 1; i < size; i++) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG, "adj_list[%" PRIu32 "]:\n",
-			i);
-		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-			"   guid = 0x%" PRIx64 " lid = %" PRIu16 " (%s)\n",
-			adj_list[i].guid, adj_list[i].lid,
-			adj_list[i].sw->p_node->print_desc);
-		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-			"   num_hca = %" PRIu32 "\n", adj_list[i].num_hca);
+	uint32_t i = 0;
 
-		c = 1;
-		for (link = adj_list[i].links; link != NULL;
-		     link = link->next, c++) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"   link[%" PRIu32 "]:\n", c);
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"      to guid = 0x%" PRIx64 " (%s) port %"
-				PRIu8 "\n", link->guid,
-				adj_list[link->to].sw->p_node->print_desc,
-				link->to_port);
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"      weight on this link = %" PRIu64 "\n",
-				link->weight);
+	for (i = 0; i < *num; i++) {
+		if (array[i] == channel) {
+			array[i] = array[--(*num)];
+			return;
 		}
 	}
 }
 
-void print_routes(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
-			 uint32_t adj_list_size, osm_port_t * port)
+/* removing an edge never invalidates the topological order */
+static void cdg_dag_remove_edge(cdg_dag_t * dag, uint32_t from, uint32_t to)
 {
-	uint32_t i = 0, j = 0;
+	cdg_dag_unlink(dag->nodes[from].out, &dag->nodes[from].num_out, to);
+	cdg_dag_unlink(dag->nodes[to].in, &dag->nodes[to].num_in, from);
+}
 
-	for (i = 1; i < adj_list_size; i++) {
-		if (adj_list[i].state == DISCOVERED) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"Route from 0x%" PRIx64 " (%s) to 0x%" PRIx64
-				" (%s):\n", adj_list[i].guid,
-				adj_list[i].sw->p_node->print_desc,
-				cl_ntoh64(osm_node_get_node_guid(port->p_node)),
-				port->p_node->print_desc);
-			j = i;
-			while (adj_list[j].used_link) {
-				if (j > 0) {
-					OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-						"   0x%" PRIx64
-						" (%s) routes thru port %" PRIu8
-						"\n", adj_list[j].guid,
-						adj_list[j].sw->p_node->
-						print_desc,
-						adj_list[j].used_link->to_port);
-				} else {
-					OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-						"   0x%" PRIx64
-						" (%s) routes thru port %" PRIu8
-						"\n", adj_list[j].guid,
-						port->p_node->print_desc,
-						adj_list[j].used_link->to_port);
+static int cmp_uint32(const void *v1, const void *v2)
+{
+	uint32_t a = *(uint32_t *) v1, b = *(uint32_t *) v2;
+
+	return (a > b) - (a < b);
+}
+
+/* add the dependency from -> to to the graph;
+   return 1 if the edge was added, 0 if it existed before, -1 if it would
+   close a cycle (the graph is unchanged) and -2 if out of memory
+*/
+static int cdg_dag_add_edge(cdg_engine_t * engine, cdg_dag_t * dag,
+			    uint32_t from, uint32_t to)
+{
+	cdg_dag_node_t *nodes = dag->nodes;
+	uint32_t *ord = dag->ord;
+	uint32_t lb = ord[to], ub = ord[from];
+	uint32_t i = 0, depth = 0, node = 0, next = 0;
+
+	if (from == to)
+		return -1;
+	for (i = 0; i < nodes[from].num_out; i++)
+		if (nodes[from].out[i] == to)
+			return 0;
+
+	if (lb < ub) {
+		/* forward search from 'to' in the affected region; reaching
+		   'from' means the new edge closes a cycle
+		 */
+		if (++engine->stamp == 0) {
+			memset(engine->mark, 0,
+			       engine->num_channels * sizeof(uint32_t));
+			engine->stamp = 1;
+		}
+		engine->num_f = 0;
+		engine->mark[to] = engine->stamp;
+		engine->stack[depth++] = to;
+		while (depth) {
+			node = engine->stack[--depth];
+			engine->delta_f[engine->num_f++] = node;
+			for (i = 0; i < nodes[node].num_out; i++) {
+				next = nodes[node].out[i];
+				if (next == from)
+					return -1;
+				if (ord[next] < ub
+				    && engine->mark[next] != engine->stamp) {
+					engine->mark[next] = engine->stamp;
+					engine->stack[depth++] = next;
+				}
+			}
+		}
+		/* backward search from 'from' in the affected region */
+		engine->num_b = 0;
+		engine->mark[from] = engine->stamp;
+		engine->stack[depth++] = from;
+		while (depth) {
+			node = engine->stack[--depth];
+			engine->delta_b[engine->num_b++] = node;
+			for (i = 0; i < nodes[node].num_in; i++) {
+				next = nodes[node].in[i];
+				if (ord[next] > lb
+				    && engine->mark[next] != engine->stamp) {
+					engine->mark[next] = engine->stamp;
+					engine->stack[depth++] = next;
 				}
-				j = adj_list[j].used_link->from;
 			}
 		}
+		/* reuse the indices of both sets: first everything that
+		   reaches 'from', then everything reachable from 'to', each
+		   in its old relative order
+		 */
+		for (i = 0; i < engine->num_b; i++)
+			engine->delta_b[i] = ord[engine->delta_b[i]];
+		for (i = 0; i < engine->num_f; i++)
+			engine->delta_f[i] = ord[engine->delta_f[i]];
+		qsort(engine->delta_b, engine->num_b, sizeof(uint32_t),
+		      cmp_uint32);
+		qsort(engine->delta_f, engine->num_f, sizeof(uint32_t),
+		      cmp_uint32);
+		for (i = 0; i < engine->num_b; i++) {
+			engine->pool[i] = engine->delta_b[i];
+			engine->delta_b[i] = dag->node_at[engine->delta_b[i]];
+		}
+		for (i = 0; i < engine->num_f; i++) {
+			engine->pool[engine->num_b + i] = engine->delta_f[i];
+			engine->delta_f[i] = dag->node_at[engine->delta_f[i]];
+		}
+		qsort(engine->pool, engine->num_b + engine->num_f,
+		      sizeof(uint32_t), cmp_uint32);
+		for (i = 0; i < engine->num_b; i++) {
+			ord[engine->delta_b[i]] = engine->pool[i];
+			dag->node_at[engine->pool[i]] = engine->delta_b[i];
+		}
+		for (i = 0; i < engine->num_f; i++) {
+			ord[engine->delta_f[i]] = engine->pool[engine->num_b + i];
+			dag->node_at[engine->pool[engine->num_b + i]] =
+			    engine->delta_f[i];
+		}
 	}
-}
 
-/* predefine, to use this in next function */
-static void dfsssp_context_destroy(void *context);
-static int dijkstra(osm_ucast_mgr_t * p_mgr, cl_heap_t * p_heap,
-		    vertex_t * adj_list, uint32_t adj_list_size,
-		    osm_port_t * port, uint16_t lid);
+	if (cdg_dag_append(&nodes[from].out, &nodes[from].num_out,
+			   &nodes[from].max_out, to))
+		return -2;
+	if (cdg_dag_append(&nodes[to].in, &nodes[to].num_in,
+			   &nodes[to].max_in, from)) {
+		nodes[from].num_out--;
+		return -2;
+	}
+	return 1;
+}
 
-/* traverse subnet to gather information about the connected switches */
-static int dfsssp_build_graph(void *context)
+/* collect the channels between switches of the path to dlid, i.e. the
+   nodes of the cdg which are visited by this path (same walk as in
+   update_channel_dep_graph); return the number of channels or -1
+*/
+static int32_t cdg_get_path_channels(cdg_engine_t * engine,
+				     osm_port_t * src_port, uint16_t dlid,
+				     uint32_t * channels, uint32_t max_channels)
 {
-	dfsssp_context_t *dfsssp_ctx = (dfsssp_context_t *) context;
-	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) (dfsssp_ctx->p_mgr);
-	boolean_t has_fdr10 = (1 == p_mgr->p_subn->opt.fdr10) ? TRUE : FALSE;
-	cl_qmap_t *port_tbl = &p_mgr->p_subn->port_guid_tbl;	/* 1 management port per switch + 1 or 2 ports for each Hca */
-	osm_port_t *p_port = NULL;
-	cl_qmap_t *sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
-	cl_map_item_t *item = NULL;
-	osm_switch_t *sw = NULL;
-	osm_node_t *remote_node = NULL;
-	uint8_t port = 0, remote_port = 0;
-	uint32_t i = 0, j = 0, err = 0, undiscov = 0, max_num_undiscov = 0;
-	uint64_t total_num_hca = 0;
-	vertex_t *adj_list = NULL;
-	osm_physp_t *p_physp = NULL;
-	link_t *link = NULL, *head = NULL;
-	uint32_t num_sw = 0, adj_list_size = 0;
-	uint8_t lmc = 0;
-	uint16_t sm_lid = 0;
-	cl_heap_t heap;
-
-	OSM_LOG_ENTER(p_mgr->p_log);
-	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
-		"Building graph for df-/sssp routing\n");
+	osm_node_t *local_node = NULL, *remote_node = NULL;
+	uint8_t local_port = 0, remote_port = 0;
+	uint16_t local_lid = 0;
+	uint32_t num = 0;
 
-	/* if this pointer isn't NULL, this is a reroute step;
-	   old context will be destroyed (adj_list and srcdest2vl_table)
-	 */
-	if (dfsssp_ctx->adj_list)
-		dfsssp_context_destroy(context);
+	remote_node =
+	    osm_node_get_remote_node(src_port->p_node,
+				     src_port->p_physp->port_num, &remote_port);
 
-	/* construct the generic heap opject to use it in dijkstra */
-	cl_heap_construct(&heap);
+	while (remote_node && remote_node->sw) {
+		local_node = remote_node;
+		local_port = local_node->sw->new_lft[dlid];
+		if (local_port == OSM_NO_PATH)
+			return -1;
+		local_lid = cl_ntoh16(osm_node_get_base_lid(local_node, 0));
 
-	num_sw = cl_qmap_count(sw_tbl);
-	adj_list_size = num_sw + 1;
-	/* allocate an adjazenz list (array), 0. element is reserved for the source (Hca) in the routing algo, others are switches */
-	adj_list = (vertex_t *) malloc(adj_list_size * sizeof(vertex_t));
-	if (!adj_list) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD02: cannot allocate memory for adj_list\n");
-		goto ERROR;
+		remote_node =
+		    osm_node_get_remote_node(local_node, local_port,
+					     &remote_port);
+		if (!remote_node || !remote_node->sw)
+			break;
+		if (local_lid > engine->max_sw_lid
+		    || !engine->sw_index[local_lid] || num == max_channels)
+			return -1;
+		channels[num++] =
+		    engine->port_offset[engine->sw_index[local_lid]] +
+		    local_port;
 	}
-	for (i = 0; i < adj_list_size; i++)
-		set_default_vertex(&adj_list[i]);
+	return (int32_t) num;
+}
 
-	dfsssp_ctx->adj_list = adj_list;
-	dfsssp_ctx->adj_list_size = adj_list_size;
+/* add all dependencies of a path to the graph of a VL, or none of them;
+   return 0 if the path was added, 1 if it would close a cycle, -1 on error
+*/
+static int cdg_dag_add_path(cdg_engine_t * engine, uint32_t vl,
+			    uint32_t * channels, uint32_t num_channels,
+			    uint32_t * added)
+{
+	cdg_dag_t *dag = &engine->dags[vl];
+	uint32_t i = 0, num_added = 0;
+	int ret = 0;
 
-	/* count the total number of Hca / LIDs (for lmc>0) in the fabric;
-	   even include base/enhanced switch port 0; base SP0 will have lmc=0
-	 */
-	for (item = cl_qmap_head(port_tbl); item != cl_qmap_end(port_tbl);
-	     item = cl_qmap_next(item)) {
-		p_port = (osm_port_t *) item;
-		if (osm_node_get_type(p_port->p_node) == IB_NODE_TYPE_CA ||
-		    osm_node_get_type(p_port->p_node) == IB_NODE_TYPE_SWITCH) {
-			lmc = osm_port_get_lmc(p_port);
-			total_num_hca += (1 << lmc);
-		}
-	}
+	if (!dag->nodes && cdg_dag_alloc(dag, engine->num_channels))
+		return -1;
 
-	i = 1;			/* fill adj_list -> start with index 1 */
-	for (item = cl_qmap_head(sw_tbl); item != cl_qmap_end(sw_tbl);
-	     item = cl_qmap_next(item), i++) {
-		sw = (osm_switch_t *) item;
-		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-			"Processing switch with GUID 0x%" PRIx64 "\n",
-			cl_ntoh64(osm_node_get_node_guid(sw->p_node)));
+	for (i = 1; i < num_channels; i++) {
+		ret = cdg_dag_add_edge(engine, dag, channels[i - 1],
+				       channels[i]);
+		if (ret == 1)
+			added[num_added++] = i;
+		else if (ret < 0)
+			break;
+	}
+	if (ret >= 0)
+		return 0;
 
-		adj_list[i].guid =
-		    cl_ntoh64(osm_node_get_node_guid(sw->p_node));
-		adj_list[i].lid =
-		    cl_ntoh16(osm_node_get_base_lid(sw->p_node, 0));
-		adj_list[i].sw = sw;
+	/* roll back the dependencies which were new for this path */
+	while (num_added--)
+		cdg_dag_remove_edge(dag, channels[added[num_added] - 1],
+				    channels[added[num_added]]);
+	return (ret == -1) ? 1 : -1;
+}
 
-		link = (link_t *) malloc(sizeof(link_t));
-		if (!link) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-				"ERR AD03: cannot allocate memory for a link\n");
-			goto ERROR;
-		}
-		head = link;
-		head->next = NULL;
+/* assign each src/dest pair the first VL whose cdg stays acyclic with its
+   path; pairs which fit into none of the vl_avail VLs get VL vl_avail
+*/
+static int dfsssp_assign_vls_incremental(dfsssp_context_t * dfsssp_ctx,
+					 vltable_t * srcdest2vl_table,
+					 uint64_t * paths_per_vl,
+					 uint8_t vl_avail, uint8_t * vl_needed)
+{
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
+	cl_qlist_t *port_tbl = &p_mgr->port_order_list;
+	cl_list_item_t *item1 = NULL, *item2 = NULL;
+	osm_port_t *src_port = NULL, *dest_port = NULL;
+	osm_node_t *first_sw = NULL, *last_first_sw = NULL;
+	cdg_engine_t engine;
+	uint32_t *channels = NULL, *added = NULL;
+	uint32_t max_channels = dfsssp_ctx->adj_list_size + 1;
+	uint16_t slid = 0, dlid = 0, last_dlid = 0;
+	uint16_t min_lid_ho = 0, max_lid_ho = 0, min_lid_ho2 = 0, max_lid_ho2 = 0;
+	uint8_t ntype = 0, remote_port = 0, vl = 0, last_vl = 0;
+	int32_t num_channels = 0;
+	int ret = 0, err = 0;
+
+	if (cdg_engine_alloc(&engine, dfsssp_ctx->adj_list,
+			     dfsssp_ctx->adj_list_size, vl_avail)) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD17: cannot allocate memory for the incremental cdg\n");
+		return 1;
+	}
+	channels = (uint32_t *) malloc(max_channels * sizeof(uint32_t));
+	added = (uint32_t *) malloc(max_channels * sizeof(uint32_t));
+	if (!channels || !added) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD17: cannot allocate memory for the incremental cdg\n");
+		err = 1;
+		goto Exit;
+	}
 
-		/* add SP0 to number of CA connected to a switch */
-		lmc = osm_node_get_lmc(sw->p_node, 0);
-		adj_list[i].num_hca += (1 << lmc);
+	*vl_needed = 1;
+	for (item1 = cl_qlist_head(port_tbl); item1 != cl_qlist_end(port_tbl);
+	     item1 = cl_qlist_next(item1)) {
+		dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
+						      list_item);
+		ntype = osm_node_get_type(dest_port->p_node);
+		if ((ntype != IB_NODE_TYPE_CA && ntype != IB_NODE_TYPE_SWITCH)
+		    || !(dest_port->p_physp->port_info.capability_mask
+		    & IB_PORT_CAP_HAS_SL_MAP))
+			continue;
 
-		/* iterate over all ports in the switch, start with port 1 (port 0 is a management port) */
-		for (port = 1; port < sw->num_ports; port++) {
-			/* get the node behind the port */
-			remote_node =
-			    osm_node_get_remote_node(sw->p_node, port,
-						     &remote_port);
-			/* if there is no remote node on this port or it's the same switch -> try next port */
-			if (!remote_node || remote_node->sw == sw)
-				continue;
-			/* make sure the link is healthy */
-			p_physp = osm_node_get_physp_ptr(sw->p_node, port);
-			if (!p_physp || !osm_link_is_healthy(p_physp))
+		for (item2 = cl_qlist_head(port_tbl);
+		     item2 != cl_qlist_end(port_tbl);
+		     item2 = cl_qlist_next(item2)) {
+			src_port = (osm_port_t *)cl_item_obj(item2, src_port,
+							     list_item);
+			ntype = osm_node_get_type(src_port->p_node);
+			if ((ntype != IB_NODE_TYPE_CA
+			    && ntype != IB_NODE_TYPE_SWITCH)
+			    || !(src_port->p_physp->port_info.capability_mask
+			    & IB_PORT_CAP_HAS_SL_MAP))
 				continue;
-			/* if there is a Hca connected -> count and cycle */
-			if (!remote_node->sw) {
-				lmc = osm_node_get_lmc(remote_node, (uint32_t)remote_port);
-				adj_list[i].num_hca += (1 << lmc);
+			if (src_port == dest_port)
 				continue;
-			}
-			/* filter out throttled links to improve performance */
-			if (p_mgr->p_subn->opt.avoid_throttled_links &&
-			    osm_link_is_throttled(p_physp, has_fdr10)) {
-				OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-					"Detected and ignoring throttled link:"
-					" 0x%" PRIx64 "/P%" PRIu8
-					" <--> 0x%" PRIx64 "/P%" PRIu8 "\n",
-					cl_ntoh64(osm_node_get_node_guid(sw->p_node)),
-					port,
-					cl_ntoh64(osm_node_get_node_guid(remote_node)),
-					remote_port);
+			/* the path of a SP0 has no channels; with a per
+			   switch VL table its row is set by the Hcas behind
+			   the switch, which have the same path
+			 */
+			if (srcdest2vl_table->per_switch
+			    && ntype == IB_NODE_TYPE_SWITCH)
 				continue;
-			}
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"Node 0x%" PRIx64 ", remote node 0x%" PRIx64
-				", port %" PRIu8 ", remote port %" PRIu8 "\n",
-				cl_ntoh64(osm_node_get_node_guid(sw->p_node)),
-				cl_ntoh64(osm_node_get_node_guid(remote_node)),
-				port, remote_port);
 
-			link->next = (link_t *) malloc(sizeof(link_t));
-			if (!link->next) {
-				OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-					"ERR AD08: cannot allocate memory for a link\n");
-				while (head) {
-					link = head;
-					head = head->next;
-					free(link);
+			first_sw =
+			    osm_node_get_remote_node(src_port->p_node,
+						     src_port->p_physp->port_num,
+						     &remote_port);
+			osm_port_get_lid_range_ho(src_port, &min_lid_ho,
+						  &max_lid_ho);
+			osm_port_get_lid_range_ho(dest_port, &min_lid_ho2,
+						  &max_lid_ho2);
+			for (dlid = min_lid_ho2; dlid <= max_lid_ho2; dlid++) {
+				/* ports behind the same switch share the path
+				   and therefore the outcome for this dlid
+				 */
+				if (first_sw && first_sw == last_first_sw
+				    && dlid == last_dlid) {
+					vl = last_vl;
+				} else {
+					num_channels =
+					    cdg_get_path_channels(&engine,
+								  src_port,
+								  dlid,
+								  channels,
+								  max_channels);
+					if (num_channels < 0) {
+						OSM_LOG(p_mgr->p_log,
+							OSM_LOG_ERROR,
+							"ERR AD18: no valid path to dlid %"
+							PRIu16 " in the new LFTs\n",
+							dlid);
+						err = 1;
+						goto Exit;
+					}
+					for (vl = 0; vl < vl_avail; vl++) {
+						ret =
+						    cdg_dag_add_path(&engine,
+								     vl,
+								     channels,
+								     (uint32_t)
+								     num_channels,
+								     added);
+						if (ret < 0) {
+							OSM_LOG(p_mgr->p_log,
+								OSM_LOG_ERROR,
+								"ERR AD17: cannot allocate memory for the incremental cdg\n");
+							err = 1;
+							goto Exit;
+						}
+						if (!ret)
+							break;
+					}
+					last_first_sw = first_sw;
+					last_dlid = dlid;
+					last_vl = vl;
 				}
-				goto ERROR;
-			}
-			link = link->next;
-			set_default_link(link);
-			link->guid =
-			    cl_ntoh64(osm_node_get_node_guid(remote_node));
-			link->from = i;
-			link->from_port = port;
-			link->to_port = remote_port;
-			link->weight = total_num_hca * total_num_hca;	/* initialize with P^2 to force shortest paths */
-		}
+				if (vl + 1 > *vl_needed)
+					*vl_needed = vl + 1;
 
-		adj_list[i].links = head->next;
-		free(head);
-	}
-	/* connect the links with it's second adjacent node in the list */
-	for (i = 1; i < adj_list_size; i++) {
-		link = adj_list[i].links;
-		while (link) {
-			for (j = 1; j < adj_list_size; j++) {
-				if (link->guid == adj_list[j].guid) {
-					link->to = j;
-					break;
+				for (slid = min_lid_ho; slid <= max_lid_ho;
+				     slid++) {
+					vltable_insert(srcdest2vl_table,
+						       cl_hton16(slid),
+						       cl_hton16(dlid), vl);
+					paths_per_vl[vl]++;
 				}
 			}
-			link = link->next;
 		}
 	}
 
-	/* do one dry run to determine connectivity issues */
-	sm_lid = p_mgr->p_subn->master_sm_base_lid;
-	p_port = osm_get_port_by_lid(p_mgr->p_subn, sm_lid);
-	err = dijkstra(p_mgr, &heap, adj_list, adj_list_size, p_port, sm_lid);
-	if (err) {
-		goto ERROR;
-	} else {
-		/* if sm is running on a switch, then dijkstra doesn't
-		   initialize the used_link for this switch
-		 */
-		if (osm_node_get_type(p_port->p_node) != IB_NODE_TYPE_CA)
-			max_num_undiscov = 1;
-		for (i = 1; i < adj_list_size; i++) {
-            if(!adj_list[i].used_link) {
-                undiscov++;
-                OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG, 
-                        "Switch: 0x%" PRIx64 ", was not discovered by dijkstra\n", 
-				        cl_ntoh64(osm_node_get_node_guid(adj_list[i].sw->p_node)));
-            }
-        }
-		if (max_num_undiscov < undiscov) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-				"ERR AD0C: unsupported network state (detached"
-				" and inaccessible switches found; gracefully"
-				" shutdown this routing engine)\n");
-			goto ERROR;
+Exit:
+	free(channels);
+	free(added);
+	cdg_engine_dealloc(&engine);
+	return err;
+}
+
+/**********************************************************************
+ **********************************************************************/
+
+/************ helper functions to generate an ordered list of ports ***
+ ************ (functions copied from osm_ucast_mgr.c and modified) ****
+ **********************************************************************/
+void add_sw_endports_to_order_list(osm_switch_t * sw,
+					  osm_ucast_mgr_t * m,
+					  cl_qmap_t * guid_tbl,
+					  boolean_t add_guids)
+{
+	osm_port_t *port;
+	ib_net64_t port_guid;
+	uint64_t sw_guid;
+	osm_physp_t *p;
+	int i;
+	boolean_t found;
+
+	for (i = 1; i < sw->num_ports; i++) {
+		p = osm_node_get_physp_ptr(sw->p_node, i);
+		if (p && p->p_remote_physp && !p->p_remote_physp->p_node->sw) {
+			port_guid = p->p_remote_physp->port_guid;
+			/* check if link is healthy, otherwise ignore CA */
+			if (!osm_link_is_healthy(p)) {
+				sw_guid =
+				    cl_ntoh64(osm_node_get_node_guid
+					      (sw->p_node));
+				OSM_LOG(m->p_log, OSM_LOG_INFO,
+					"WRN AD40: ignoring CA due to unhealthy"
+					" link from switch 0x%016" PRIx64
+					" port %" PRIu8 " to CA 0x%016" PRIx64
+					"\n", sw_guid, i, cl_ntoh64(port_guid));
+			}
+			port = osm_get_port_by_guid(m->p_subn, port_guid);
+			if (!port)
+				continue;
+			if (!cl_is_qmap_empty(guid_tbl)) {
+				found = (cl_qmap_get(guid_tbl, port_guid)
+					 != cl_qmap_end(guid_tbl));
+				if ((add_guids && !found)
+				    || (!add_guids && found))
+					continue;
+			}
+			if (!cl_is_item_in_qlist(&m->port_order_list,
+						 &port->list_item))
+				cl_qlist_insert_tail(&m->port_order_list,
+						     &port->list_item);
+			else
+				OSM_LOG(m->p_log, OSM_LOG_INFO,
+					"WRN AD37: guid 0x%016" PRIx64
+					" already in list\n", port_guid);
 		}
 	}
-	/* delete the heap which is not needed anymore */
-	cl_heap_destroy(&heap);
+}
 
-	/* print the discovered graph */
-	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
-		print_graph(p_mgr, adj_list, adj_list_size);
+void add_guid_to_order_list(uint64_t guid, osm_ucast_mgr_t * m)
+{
+	osm_port_t *port = osm_get_port_by_guid(m->p_subn, cl_hton64(guid));
 
-	OSM_LOG_EXIT(p_mgr->p_log);
-	return 0;
+	if (!port) {
+		 OSM_LOG(m->p_log, OSM_LOG_DEBUG,
+			 "port guid not found: 0x%016" PRIx64 "\n", guid);
+	}
 
-ERROR:
-	if (cl_is_heap_inited(&heap))
-		cl_heap_destroy(&heap);
-	dfsssp_context_destroy(context);
-	return -1;
+	if (!cl_is_item_in_qlist(&m->port_order_list, &port->list_item))
+		cl_qlist_insert_tail(&m->port_order_list, &port->list_item);
+	else
+		OSM_LOG(m->p_log, OSM_LOG_INFO,
+			"WRN AD38: guid 0x%016" PRIx64 " already in list\n",
+			guid);
 }
 
-/* callback function for the cl_heap to update the index */
-static void apply_index_update(const void * context, const size_t new_index)
+/* compare function of #Hca attached to a switch for stdlib qsort */
+int cmp_num_hca(const void * l1, const void * l2)
 {
-	vertex_t *heap_elem = (vertex_t *) context;
-	if (heap_elem)
-		heap_elem->heap_index = new_index;
+	vertex_t *sw1 = *((vertex_t **) l1);
+	vertex_t *sw2 = *((vertex_t **) l2);
+	uint32_t num_hca1 = 0, num_hca2 = 0;
+
+	if (sw1)
+		num_hca1 = sw1->num_hca;
+	if (sw2)
+		num_hca2 = sw2->num_hca;
+
+	if (num_hca1 > num_hca2)
+		return -1;
+	else if (num_hca1 < num_hca2)
+		return 1;
+	else
+		return 0;
 }
 
-/* dijkstra step from one source to all switches in the df-/sssp graph */
-static int dijkstra(osm_ucast_mgr_t * p_mgr, cl_heap_t * p_heap,
-		    vertex_t * adj_list, uint32_t adj_list_size,
-		    osm_port_t * port, uint16_t lid)
+/**********************************************************************
+ **********************************************************************/
+
+/************ helper functions to manage a map of CN and I/O guids ****
+ **********************************************************************/
+int add_guid_to_map(void * cxt, uint64_t guid, char * p)
 {
-	uint32_t i = 0, j = 0, index = 0;
-	osm_node_t *remote_node = NULL;
-	uint8_t remote_port = 0;
-	vertex_t *current = NULL;
+	cl_qmap_t *map = cxt;
+	name_map_item_t *item;
+	name_map_item_t *inserted_item;
+
+	item = malloc(sizeof(*item));
+	if (!item)
+		return -1;
+
+	item->guid = cl_hton64(guid);	/* internal: network byte order */
+	item->name = NULL;		/* name isn't needed */
+	inserted_item = (name_map_item_t *) cl_qmap_insert(map, item->guid, &item->item);
+	if (inserted_item != item)
+                free(item);
+
+	return 0;
+}
+
+void destroy_guid_map(cl_qmap_t * guid_tbl)
+{
+	name_map_item_t *p_guid = NULL, *p_next_guid = NULL;
+
+	p_next_guid = (name_map_item_t *) cl_qmap_head(guid_tbl);
+	while (p_next_guid != (name_map_item_t *) cl_qmap_end(guid_tbl)) {
+		p_guid = p_next_guid;
+		p_next_guid = (name_map_item_t *) cl_qmap_next(&p_guid->item);
+		free(p_guid);
+	}
+	cl_qmap_remove_all(guid_tbl);
+}
+
+/**********************************************************************
+ **********************************************************************/
+
+void print_graph(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
+			       uint32_t size)
+{
+	uint32_t i = 0, c = 0;
 	link_t *link = NULL;
-	uint64_t guid = 0;
-	cl_status_t ret = CL_SUCCESS;
 
-	OSM_LOG_ENTER(p_mgr->p_log);
+	/* index 0 is for the source in dijkstra -> ignore */
+	for (i = 1; i < size; i++) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG, "adj_list[%" PRIu32 "]:\n",
+			i);
+		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+			"   guid = 0x%" PRIx64 " lid = %" PRIu16 " (%s)\n",
+			adj_list[i].guid, adj_list[i].lid,
+			adj_list[i].sw->p_node->print_desc);
+		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+			"   num_hca = %" PRIu32 "\n", adj_list[i].num_hca);
 
-	/* build an 4-ary heap to find the node with minimum distance */
-	if (!cl_is_heap_inited(p_heap))
-		ret = cl_heap_init(p_heap, adj_list_size, 4,
-				   &apply_index_update, NULL);
-	else
-		ret = cl_heap_resize(p_heap, adj_list_size);
-	if (ret != CL_SUCCESS) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD09: cannot allocate memory or resize heap\n");
-		return ret;
+		c = 1;
+		for (link = adj_list[i].links; link != NULL;
+		     link = link->next, c++) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+				"   link[%" PRIu32 "]:\n", c);
+			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+				"      to guid = 0x%" PRIx64 " (%s) port %"
+				PRIu8 "\n", link->guid,
+				adj_list[link->to].sw->p_node->print_desc,
+				link->to_port);
+			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+				"      weight on this link = %" PRIu64 "\n",
+				link->weight);
+		}
 	}
+}
+
+void print_routes(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
+			 uint32_t adj_list_size, osm_port_t * port)
+{
+	uint32_t i = 0, j = 0;
 
-	/* reset all switches for new round with a new source for dijkstra */
 	for (i = 1; i < adj_list_size; i++) {
-		adj_list[i].hops = 0;
-		adj_list[i].used_link = NULL;
-		adj_list[i].distance = INF;
-		adj_list[i].state = UNDISCOVERED;
-		ret = cl_heap_insert(p_heap, INF, &adj_list[i]);
-		if (ret != CL_SUCCESS) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-				"ERR AD11: cl_heap_insert failed\n");
-			return ret;
+		if (adj_list[i].state == DISCOVERED) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+				"Route from 0x%" PRIx64 " (%s) to 0x%" PRIx64
+				" (%s):\n", adj_list[i].guid,
+				adj_list[i].sw->p_node->print_desc,
+				cl_ntoh64(osm_node_get_node_guid(port->p_node)),
+				port->p_node->print_desc);
+			j = i;
+			while (adj_list[j].used_link) {
+				if (j > 0) {
+					OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+						"   0x%" PRIx64
+						" (%s) routes thru port %" PRIu8
+						"\n", adj_list[j].guid,
+						adj_list[j].sw->p_node->
+						print_desc,
+						adj_list[j].used_link->to_port);
+				} else {
+					OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+						"   0x%" PRIx64
+						" (%s) routes thru port %" PRIu8
+						"\n", adj_list[j].guid,
+						port->p_node->print_desc,
+						adj_list[j].used_link->to_port);
+				}
+				j = adj_list[j].used_link->from;
+			}
+		}
+	}
+}
+
+/* predefine, to use this in next function */
+static void dfsssp_context_destroy(void *context);
+static void free_adj_list(vertex_t * adj_list, uint32_t adj_list_size);
+static void dfsssp_drop_routing(dfsssp_context_t * dfsssp_ctx);
+static int dfsssp_diff_graphs(dfsssp_context_t * dfsssp_ctx,
+			      vertex_t * prev_adj_list,
+			      uint32_t prev_adj_list_size);
+static int dijkstra(osm_ucast_mgr_t * p_mgr, cl_heap_t * p_heap,
+		    vertex_t * adj_list, uint32_t adj_list_size,
+		    osm_port_t * port, uint16_t lid);
+
+/* traverse subnet to gather information about the connected switches */
+static int dfsssp_build_graph(void *context)
+{
+	dfsssp_context_t *dfsssp_ctx = (dfsssp_context_t *) context;
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) (dfsssp_ctx->p_mgr);
+	boolean_t has_fdr10 = (1 == p_mgr->p_subn->opt.fdr10) ? TRUE : FALSE;
+	cl_qmap_t *port_tbl = &p_mgr->p_subn->port_guid_tbl;	/* 1 management port per switch + 1 or 2 ports for each Hca */
+	osm_port_t *p_port = NULL;
+	cl_qmap_t *sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
+	cl_map_item_t *item = NULL;
+	osm_switch_t *sw = NULL;
+	osm_node_t *remote_node = NULL;
+	uint8_t port = 0, remote_port = 0;
+	uint32_t i = 0, j = 0, err = 0, undiscov = 0, max_num_undiscov = 0;
+	uint64_t total_num_hca = 0;
+	vertex_t *adj_list = NULL;
+	osm_physp_t *p_physp = NULL;
+	link_t *link = NULL, *head = NULL;
+	uint32_t num_sw = 0, adj_list_size = 0;
+	uint8_t lmc = 0;
+	uint16_t sm_lid = 0;
+	cl_heap_t heap;
+	vertex_t *prev_adj_list = NULL;
+	uint32_t prev_adj_list_size = 0;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Building graph for df-/sssp routing\n");
+
+	/* if this pointer isn't NULL, this is a reroute step;
+	   old context will be destroyed (adj_list and srcdest2vl_table),
+	   unless the last routing is kept to compare the graphs
+	 */
+	if (dfsssp_ctx->adj_list && dfsssp_ctx->routed_lft) {
+		prev_adj_list = dfsssp_ctx->adj_list;
+		prev_adj_list_size = dfsssp_ctx->adj_list_size;
+		dfsssp_ctx->adj_list = NULL;
+		dfsssp_ctx->adj_list_size = 0;
+	} else if (dfsssp_ctx->adj_list)
+		dfsssp_context_destroy(context);
+
+	/* construct the generic heap opject to use it in dijkstra */
+	cl_heap_construct(&heap);
+
+	num_sw = cl_qmap_count(sw_tbl);
+	adj_list_size = num_sw + 1;
+	/* allocate an adjazenz list (array), 0. element is reserved for the source (Hca) in the routing algo, others are switches */
+	adj_list = (vertex_t *) malloc(adj_list_size * sizeof(vertex_t));
+	if (!adj_list) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD02: cannot allocate memory for adj_list\n");
+		goto ERROR;
+	}
+	for (i = 0; i < adj_list_size; i++)
+		set_default_vertex(&adj_list[i]);
+
+	dfsssp_ctx->adj_list = adj_list;
+	dfsssp_ctx->adj_list_size = adj_list_size;
+
+	/* count the total number of Hca / LIDs (for lmc>0) in the fabric;
+	   even include base/enhanced switch port 0; base SP0 will have lmc=0
+	 */
+	for (item = cl_qmap_head(port_tbl); item != cl_qmap_end(port_tbl);
+	     item = cl_qmap_next(item)) {
+		p_port = (osm_port_t *) item;
+		if (osm_node_get_type(p_port->p_node) == IB_NODE_TYPE_CA ||
+		    osm_node_get_type(p_port->p_node) == IB_NODE_TYPE_SWITCH) {
+			lmc = osm_port_get_lmc(p_port);
+			total_num_hca += (1 << lmc);
+		}
+	}
+
+	i = 1;			/* fill adj_list -> start with index 1 */
+	for (item = cl_qmap_head(sw_tbl); item != cl_qmap_end(sw_tbl);
+	     item = cl_qmap_next(item), i++) {
+		sw = (osm_switch_t *) item;
+		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+			"Processing switch with GUID 0x%" PRIx64 "\n",
+			cl_ntoh64(osm_node_get_node_guid(sw->p_node)));
+
+		adj_list[i].guid =
+		    cl_ntoh64(osm_node_get_node_guid(sw->p_node));
+		adj_list[i].lid =
+		    cl_ntoh16(osm_node_get_base_lid(sw->p_node, 0));
+		adj_list[i].sw = sw;
+
+		link = (link_t *) malloc(sizeof(link_t));
+		if (!link) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD03: cannot allocate memory for a link\n");
+			goto ERROR;
+		}
+		head = link;
+		head->next = NULL;
+
+		/* add SP0 to number of CA connected to a switch */
+		lmc = osm_node_get_lmc(sw->p_node, 0);
+		adj_list[i].num_hca += (1 << lmc);
+
+		/* iterate over all ports in the switch, start with port 1 (port 0 is a management port) */
+		for (port = 1; port < sw->num_ports; port++) {
+			/* get the node behind the port */
+			remote_node =
+			    osm_node_get_remote_node(sw->p_node, port,
+						     &remote_port);
+			/* if there is no remote node on this port or it's the same switch -> try next port */
+			if (!remote_node || remote_node->sw == sw)
+				continue;
+			/* make sure the link is healthy */
+			p_physp = osm_node_get_physp_ptr(sw->p_node, port);
+			if (!p_physp || !osm_link_is_healthy(p_physp))
+				continue;
+			/* if there is a Hca connected -> count and cycle */
+			if (!remote_node->sw) {
+				lmc = osm_node_get_lmc(remote_node, (uint32_t)remote_port);
+				adj_list[i].num_hca += (1 << lmc);
+				continue;
+			}
+			/* filter out throttled links to improve performance */
+			if (p_mgr->p_subn->opt.avoid_throttled_links &&
+			    osm_link_is_throttled(p_physp, has_fdr10)) {
+				OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+					"Detected and ignoring throttled link:"
+					" 0x%" PRIx64 "/P%" PRIu8
+					" <--> 0x%" PRIx64 "/P%" PRIu8 "\n",
+					cl_ntoh64(osm_node_get_node_guid(sw->p_node)),
+					port,
+					cl_ntoh64(osm_node_get_node_guid(remote_node)),
+					remote_port);
+				continue;
+			}
+			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+				"Node 0x%" PRIx64 ", remote node 0x%" PRIx64
+				", port %" PRIu8 ", remote port %" PRIu8 "\n",
+				cl_ntoh64(osm_node_get_node_guid(sw->p_node)),
+				cl_ntoh64(osm_node_get_node_guid(remote_node)),
+				port, remote_port);
+
+			link->next = (link_t *) malloc(sizeof(link_t));
+			if (!link->next) {
+				OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+					"ERR AD08: cannot allocate memory for a link\n");
+				while (head) {
+					link = head;
+					head = head->next;
+					free(link);
+				}
+				goto ERROR;
+			}
+			link = link->next;
+			set_default_link(link);
+			link->guid =
+			    cl_ntoh64(osm_node_get_node_guid(remote_node));
+			link->from = i;
+			link->from_port = port;
+			link->to_port = remote_port;
+			link->weight = total_num_hca * total_num_hca;	/* initialize with P^2 to force shortest paths */
+		}
+
+		adj_list[i].links = head->next;
+		free(head);
+	}
+	/* connect the links with it's second adjacent node in the list */
+	for (i = 1; i < adj_list_size; i++) {
+		link = adj_list[i].links;
+		while (link) {
+			for (j = 1; j < adj_list_size; j++) {
+				if (link->guid == adj_list[j].guid) {
+					link->to = j;
+					break;
+				}
+			}
+			link = link->next;
+		}
+	}
+
+	/* do one dry run to determine connectivity issues */
+	sm_lid = p_mgr->p_subn->master_sm_base_lid;
+	p_port = osm_get_port_by_lid(p_mgr->p_subn, sm_lid);
+	err = dijkstra(p_mgr, &heap, adj_list, adj_list_size, p_port, sm_lid);
+	if (err) {
+		goto ERROR;
+	} else {
+		/* if sm is running on a switch, then dijkstra doesn't
+		   initialize the used_link for this switch
+		 */
+		if (osm_node_get_type(p_port->p_node) != IB_NODE_TYPE_CA)
+			max_num_undiscov = 1;
+		for (i = 1; i < adj_list_size; i++) {
+            if(!adj_list[i].used_link) {
+                undiscov++;
+                OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG, 
+                        "Switch: 0x%" PRIx64 ", was not discovered by dijkstra\n", 
+				        cl_ntoh64(osm_node_get_node_guid(adj_list[i].sw->p_node)));
+            }
+        }
+		if (max_num_undiscov < undiscov) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD0C: unsupported network state (detached"
+				" and inaccessible switches found; gracefully"
+				" shutdown this routing engine)\n");
+			goto ERROR;
+		}
+	}
+	/* delete the heap which is not needed anymore */
+	cl_heap_destroy(&heap);
+
+	/* reroute only the lids affected by changed links, if possible */
+	if (prev_adj_list) {
+		if (dfsssp_diff_graphs(dfsssp_ctx, prev_adj_list,
+				       prev_adj_list_size)) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+				"Subnet changed beyond links between switches;"
+				" routing all lids again\n");
+			dfsssp_drop_routing(dfsssp_ctx);
+		}
+		free_adj_list(prev_adj_list, prev_adj_list_size);
+	}
+
+	/* print the discovered graph */
+	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
+		print_graph(p_mgr, adj_list, adj_list_size);
+
+	OSM_LOG_EXIT(p_mgr->p_log);
+	return 0;
+
+ERROR:
+	if (cl_is_heap_inited(&heap))
+		cl_heap_destroy(&heap);
+	if (prev_adj_list)
+		free_adj_list(prev_adj_list, prev_adj_list_size);
+	dfsssp_context_destroy(context);
+	return -1;
+}
+
+/* callback function for the cl_heap to update the index */
+static void apply_index_update(const void * context, const size_t new_index)
+{
+	vertex_t *heap_elem = (vertex_t *) context;
+	if (heap_elem)
+		heap_elem->heap_index = new_index;
+}
+
+/* dijkstra step from one source to all switches in the df-/sssp graph */
+static int dijkstra(osm_ucast_mgr_t * p_mgr, cl_heap_t * p_heap,
+		    vertex_t * adj_list, uint32_t adj_list_size,
+		    osm_port_t * port, uint16_t lid)
+{
+	uint32_t i = 0, j = 0, index = 0;
+	osm_node_t *remote_node = NULL;
+	uint8_t remote_port = 0;
+	vertex_t *current = NULL;
+	link_t *link = NULL;
+	uint64_t guid = 0;
+	cl_status_t ret = CL_SUCCESS;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+
+	/* build an 4-ary heap to find the node with minimum distance */
+	if (!cl_is_heap_inited(p_heap))
+		ret = cl_heap_init(p_heap, adj_list_size, 4,
+				   &apply_index_update, NULL);
+	else
+		ret = cl_heap_resize(p_heap, adj_list_size);
+	if (ret != CL_SUCCESS) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD09: cannot allocate memory or resize heap\n");
+		return ret;
+	}
+
+	/* reset all switches for new round with a new source for dijkstra */
+	for (i = 1; i < adj_list_size; i++) {
+		adj_list[i].hops = 0;
+		adj_list[i].used_link = NULL;
+		adj_list[i].distance = INF;
+		adj_list[i].state = UNDISCOVERED;
+		ret = cl_heap_insert(p_heap, INF, &adj_list[i]);
+		if (ret != CL_SUCCESS) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD11: cl_heap_insert failed\n");
+			return ret;
 		}
 	}
 
@@ -1225,845 +1950,1922 @@ static int dijkstra(osm_ucast_mgr_t * p_mgr, cl_heap_t * p_heap,
 		/* write saved link back to new adj_list[0] */
 		adj_list[0].links = link;
 
-		/* initialize link to neighbor for adj_list[0];
-		   make sure the link is healthy
-		 */
-		if (port->p_physp && osm_link_is_healthy(port->p_physp)) {
-			remote_node =
-			    osm_node_get_remote_node(port->p_node,
-						     port->p_physp->port_num,
-						     &remote_port);
-			/* if there is no remote node on this port or it's the same Hca -> ignore */
-			if (remote_node
-			    && (osm_node_get_type(remote_node) ==
-				IB_NODE_TYPE_SWITCH)) {
-				if (!(adj_list[0].links)) {
-					adj_list[0].links =
-					    (link_t *) malloc(sizeof(link_t));
-					if (!(adj_list[0].links)) {
-						OSM_LOG(p_mgr->p_log,
-							OSM_LOG_ERROR,
-							"ERR AD07: cannot allocate memory for a link\n");
-						return 1;
+		/* initialize link to neighbor for adj_list[0];
+		   make sure the link is healthy
+		 */
+		if (port->p_physp && osm_link_is_healthy(port->p_physp)) {
+			remote_node =
+			    osm_node_get_remote_node(port->p_node,
+						     port->p_physp->port_num,
+						     &remote_port);
+			/* if there is no remote node on this port or it's the same Hca -> ignore */
+			if (remote_node
+			    && (osm_node_get_type(remote_node) ==
+				IB_NODE_TYPE_SWITCH)) {
+				if (!(adj_list[0].links)) {
+					adj_list[0].links =
+					    (link_t *) malloc(sizeof(link_t));
+					if (!(adj_list[0].links)) {
+						OSM_LOG(p_mgr->p_log,
+							OSM_LOG_ERROR,
+							"ERR AD07: cannot allocate memory for a link\n");
+						return 1;
+					}
+				}
+				set_default_link(adj_list[0].links);
+				adj_list[0].links->guid =
+				    cl_ntoh64(osm_node_get_node_guid
+					      (remote_node));
+				adj_list[0].links->from_port =
+				    port->p_physp->port_num;
+				adj_list[0].links->to_port = remote_port;
+				adj_list[0].links->weight = 1;
+				for (j = 1; j < adj_list_size; j++) {
+					if (adj_list[0].links->guid ==
+					    adj_list[j].guid) {
+						adj_list[0].links->to = j;
+						break;
+					}
+				}
+			}
+		} else {
+			/* if link is unhealthy then there's a severe issue */
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD0B: unsupported network state (CA with"
+				" unhealthy link state discovered; should have"
+				" been filtered out before already; gracefully"
+				" shutdown this routing engine)\n");
+			return 1;
+		}
+		ret = cl_heap_insert(p_heap, INF, &adj_list[0]);
+		if (ret != CL_SUCCESS) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD13: cl_heap_insert failed\n");
+			return ret;
+		}
+		/* if behind port is a switch -> search switch in adj_list */
+	} else {
+		/* reset adj_list[0], if links=NULL reset was done before, then skip */
+		if (adj_list[0].links) {
+			free(adj_list[0].links);
+			set_default_vertex(&adj_list[0]);
+		}
+		/* search for the switch which is the source in this round */
+		guid = cl_ntoh64(osm_node_get_node_guid(port->p_node));
+		for (i = 1; i < adj_list_size; i++) {
+			if (guid == adj_list[i].guid) {
+				index = i;
+				break;
+			}
+		}
+	}
+
+	/* source in dijkstra */
+	adj_list[index].distance = 0;
+	adj_list[index].state = DISCOVERED;
+	adj_list[index].hops = 0;	/* the source has hop count = 0 */
+	ret = cl_heap_modify_key(p_heap, adj_list[index].distance,
+				 adj_list[index].heap_index);
+	if (ret != CL_SUCCESS) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD10: index out of bounds in cl_heap_modify_key\n");
+		return ret;
+	}
+
+	current = (vertex_t *) cl_heap_extract_root(p_heap);
+	while (current) {
+		current->state = DISCOVERED;
+		if (current->used_link)	/* increment the number of hops to the source for each new node */
+			current->hops =
+			    adj_list[current->used_link->from].hops + 1;
+
+		/* add/update nodes which aren't discovered but accessible */
+		for (link = current->links; link != NULL; link = link->next) {
+			if ((adj_list[link->to].state != DISCOVERED)
+			    && (current->distance + link->weight <
+				adj_list[link->to].distance)) {
+				adj_list[link->to].used_link = link;
+				adj_list[link->to].distance =
+				    current->distance + link->weight;
+				ret = cl_heap_modify_key(p_heap,
+							 adj_list[link->to].distance,
+							 adj_list[link->to].heap_index);
+				if (ret != CL_SUCCESS) {
+					OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+						"ERR AD12: index out of bounds in cl_heap_modify_key\n");
+					return ret;
+				}
+			}
+		}
+
+		current = (vertex_t *) cl_heap_extract_root(p_heap);
+	}
+
+	OSM_LOG_EXIT(p_mgr->p_log);
+	return 0;
+}
+
+/* set the LFT entry and the hop count of a switch towards lid, and count
+   the path on the port unless it is ignored by the port profile
+*/
+static int set_lft_entry(osm_ucast_mgr_t * p_mgr, osm_switch_t * p_sw,
+			 osm_port_t * p_port, uint16_t lid, uint8_t port,
+			 uint8_t hops)
+{
+	boolean_t is_ignored_by_port_prof = FALSE;
+	osm_physp_t *p = NULL;
+	cl_status_t ret;
+
+	p = osm_node_get_physp_ptr(p_sw->p_node, port);
+	if (!p) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD0A: Physical port %d of Node GUID 0x%"
+			PRIx64 "not found\n", port,
+			cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)));
+		return 1;
+	}
+
+	/* we would like to optionally ignore this port in equalization
+	   as in the case of the Mellanox Anafa Internal PCI TCA port
+	 */
+	is_ignored_by_port_prof = p->is_prof_ignored;
+
+	/* We also would ignore this route if the target lid is of
+	   a switch and the port_profile_switch_node is not TRUE
+	 */
+	if (!p_mgr->p_subn->opt.port_profile_switch_nodes)
+		is_ignored_by_port_prof |=
+		    (osm_node_get_type(p_port->p_node) == IB_NODE_TYPE_SWITCH);
+
+	/* set port in LFT */
+	p_sw->new_lft[lid] = port;
+	if (!is_ignored_by_port_prof) {
+		/* update the number of path routing thru this port */
+		osm_switch_count_path(p_sw, port);
+	}
+	/* set the hop count from this switch to the lid */
+	ret = osm_switch_set_hops(p_sw, lid, port, hops);
+	if (ret != CL_SUCCESS)
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD05: cannot set hops for LID %" PRIu16
+			" at switch 0x%" PRIx64 "\n", lid,
+			cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)));
+	return 0;
+}
+
+/* update the linear forwarding tables of all switches with the informations
+   from the last dijsktra step
+*/
+static int update_lft(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
+		      uint32_t adj_list_size, osm_port_t * p_port, uint16_t lid)
+{
+	uint32_t i = 0;
+	uint8_t port = 0;
+	uint8_t hops = 0;
+	osm_switch_t *p_sw = NULL;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+
+	for (i = 1; i < adj_list_size; i++) {
+		/* if no route goes thru this switch -> cycle */
+		if (!(adj_list[i].used_link))
+			continue;
+
+		p_sw = adj_list[i].sw;
+		hops = adj_list[i].hops;
+		port = adj_list[i].used_link->to_port;
+		/* the used_link is the link that was used in dijkstra to reach this node,
+		   so the to_port is the local port on this node
+		 */
+
+		if (port == OSM_NO_PATH) {	/* if clause shouldn't be possible in this routing, but who cares */
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD06: No path to get to LID %" PRIu16
+				" from switch 0x%" PRIx64 "\n", lid,
+				cl_ntoh64(osm_node_get_node_guid
+					  (p_sw->p_node)));
+			return 1;
+		}
+		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+			"Routing LID %" PRIu16 " to port %" PRIu8
+			" for switch 0x%" PRIx64 "\n", lid, port,
+			cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)));
+
+		/* to support lmc > 0 the functions alloc_ports_priv, free_ports_priv, find_and_add_remote_sys
+		   from minhop aren't needed cause osm_switch_recommend_path is implicitly calculated
+		   for each LID pair thru dijkstra;
+		   for each port the dijkstra algorithm calculates (max_lid_ho - min_lid_ho)-times maybe
+		   disjoint routes to spread the bandwidth -> diffent routes for one port and lmc>0
+		 */
+		if (set_lft_entry(p_mgr, p_sw, p_port, lid, port, hops))
+			return 1;
+	}
+
+	OSM_LOG_EXIT(p_mgr->p_log);
+	return 0;
+}
+
+/* the function updates the multicast group membership information
+   similar to create_mgrp_switch_map (osm_mcast_mgr.c)
+   => with it we can identify if a switch needs to be processed
+   or not in update_mcft
+*/
+static void update_mgrp_membership(cl_qlist_t * port_list)
+{
+	osm_mcast_work_obj_t *wobj = NULL;
+	osm_port_t *port = NULL;
+	osm_switch_t *sw = NULL;
+	cl_list_item_t *i = NULL;
+
+	for (i = cl_qlist_head(port_list); i != cl_qlist_end(port_list);
+	     i = cl_qlist_next(i)) {
+		wobj = cl_item_obj(i, wobj, list_item);
+		port = wobj->p_port;
+		if (port->p_node->sw) {
+			sw = port->p_node->sw;
+			sw->is_mc_member = 1;
+		} else {
+			sw = port->p_physp->p_remote_physp->p_node->sw;
+			sw->num_of_mcm++;
+		}
+	}
+}
+
+/* reset is_mc_member and num_of_mcm for future computations */
+static void reset_mgrp_membership(vertex_t * adj_list, uint32_t adj_list_size)
+{
+	uint32_t i = 0;
+
+	for (i = 1; i < adj_list_size; i++) {
+		if (adj_list[i].dropped)
+			continue;
+
+		adj_list[i].sw->is_mc_member = 0;
+		adj_list[i].sw->num_of_mcm = 0;
+	}
+}
+
+/* update the multicast forwarding tables of all switches with the informations
+   from the previous dijsktra step for the current mlid
+*/
+static int update_mcft(osm_sm_t * p_sm, vertex_t * adj_list,
+		       uint32_t adj_list_size, uint16_t mlid_ho,
+		       cl_qmap_t * port_map, osm_switch_t * root_sw)
+{
+	uint32_t i = 0;
+	uint8_t port = 0, remote_port = 0;
+	uint8_t upstream_port = 0, downstream_port = 0;
+	ib_net64_t guid = 0;
+	osm_switch_t *p_sw = NULL;
+	osm_node_t *remote_node = NULL;
+	osm_physp_t *p_physp = NULL;
+	osm_mcast_tbl_t *p_tbl = NULL;
+	vertex_t *curr_adj = NULL;
+
+	OSM_LOG_ENTER(p_sm->p_log);
+
+	for (i = 1; i < adj_list_size; i++) {
+		if (adj_list[i].dropped)
+			continue;
+
+		p_sw = adj_list[i].sw;
+		OSM_LOG(p_sm->p_log, OSM_LOG_VERBOSE,
+			"Processing switch 0x%016" PRIx64
+			" (%s) for MLID 0x%X\n", cl_ntoh64(adj_list[i].guid),
+			p_sw->p_node->print_desc, mlid_ho);
+
+		/* if a) the switch does not support mcast  or
+		      b) no ports of this switch are part or the mcast group
+		   then cycle
+		 */
+		if (osm_switch_supports_mcast(p_sw) == FALSE ||
+		    (p_sw->num_of_mcm == 0 && !(p_sw->is_mc_member)))
+			continue;
+
+		p_tbl = osm_switch_get_mcast_tbl_ptr(p_sw);
+
+		/* add all ports of this sw to the mcast table,
+		   if they are part of the mcast grp
+		 */
+		if (p_sw->is_mc_member)
+			osm_mcast_tbl_set(p_tbl, mlid_ho, 0);
+		for (port = 1; port < p_sw->num_ports; port++) {
+			/* get the node behind the port */
+			remote_node =
+				osm_node_get_remote_node(p_sw->p_node, port,
+							 &remote_port);
+			/* check if connected and its not the same switch */
+			if (!remote_node || remote_node->sw == p_sw)
+				continue;
+			/* make sure the link is healthy */
+			p_physp = osm_node_get_physp_ptr(p_sw->p_node, port);
+			if (!p_physp || !osm_link_is_healthy(p_physp))
+				continue;
+			/* we don't add upstream ports in this step */
+			if (osm_node_get_type(remote_node) != IB_NODE_TYPE_CA)
+				continue;
+
+			guid = osm_physp_get_port_guid(osm_node_get_physp_ptr(
+						       remote_node,
+						       remote_port));
+			if (cl_qmap_get(port_map, guid)
+			    != cl_qmap_end(port_map))
+				osm_mcast_tbl_set(p_tbl, mlid_ho, port);
+		}
+
+		/* now we have to add the upstream port of 'this' switch and
+		   the downstream port of the next switch to the mcast table
+		   until we reach the root_sw
+		 */
+		curr_adj = &adj_list[i];
+		while (curr_adj->sw != root_sw) {
+			/* the used_link is the link that was used in dijkstra to reach this node,
+			   so the to_port is the local (upstream) port on curr_adj->sw
+			 */
+			upstream_port = curr_adj->used_link->to_port;
+			osm_mcast_tbl_set(p_tbl, mlid_ho, upstream_port);
+
+			/* now we go one step in direction root_sw and add the
+			   downstream port for the spanning tree
+			 */
+			downstream_port = curr_adj->used_link->from_port;
+			p_tbl = osm_switch_get_mcast_tbl_ptr(
+				adj_list[curr_adj->used_link->from].sw);
+			osm_mcast_tbl_set(p_tbl, mlid_ho, downstream_port);
+
+			curr_adj = &adj_list[curr_adj->used_link->from];
+		}
+	}
+
+	OSM_LOG_EXIT(p_sm->p_log);
+	return 0;
+}
+
+/* increment the edge weights of the df-/sssp graph which represent the number
+   of paths on this link
+*/
+static void update_weights(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
+			   uint32_t adj_list_size)
+{
+	uint32_t i = 0, j = 0;
+	uint32_t additional_weight = 0;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+
+	for (i = 1; i < adj_list_size; i++) {
+		/* if no route goes thru this switch -> cycle */
+		if (!(adj_list[i].used_link))
+			continue;
+		additional_weight = adj_list[i].num_hca;
+
+		j = i;
+		while (adj_list[j].used_link) {
+			/* update the link from pre to this node */
+			adj_list[j].used_link->weight += additional_weight;
+
+			j = adj_list[j].used_link->from;
+		}
+	}
+
+	OSM_LOG_EXIT(p_mgr->p_log);
+}
+
+/* get the largest number of virtual lanes which is supported by all switches
+   in the subnet
+*/
+uint8_t get_avail_vl_in_subn(osm_ucast_mgr_t * p_mgr)
+{
+	uint32_t i = 0;
+	uint8_t vls_avail = 0xFF, port_vls_avail = 0;
+	cl_qmap_t *sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
+	cl_map_item_t *item = NULL;
+	osm_switch_t *sw = NULL;
+
+	/* traverse all switches to get the number of available virtual lanes in the subnet */
+	for (item = cl_qmap_head(sw_tbl); item != cl_qmap_end(sw_tbl);
+	     item = cl_qmap_next(item)) {
+		sw = (osm_switch_t *) item;
+
+		/* ignore management port 0 */
+		for (i = 1; i < osm_node_get_num_physp(sw->p_node); i++) {
+			osm_physp_t *p_physp =
+			    osm_node_get_physp_ptr(sw->p_node, i);
+
+			if (p_physp && p_physp->p_remote_physp) {
+				port_vls_avail =
+				    ib_port_info_get_op_vls(&p_physp->
+							    port_info);
+				if (port_vls_avail
+				    && port_vls_avail < vls_avail)
+					vls_avail = port_vls_avail;
+			}
+		}
+	}
+
+	/* ib_port_info_get_op_vls gives values 1 ... 5 (s. IBAS 14.2.5.6) */
+	vls_avail = 1 << (vls_avail - 1);
+
+	/* set boundaries (s. IBAS 3.5.7) */
+	if (vls_avail > 15)
+		vls_avail = 15;
+	if (vls_avail < 1)
+		vls_avail = 1;
+
+	return vls_avail;
+}
+
+/* search for cycles in the channel dependency graph to identify possible
+   deadlocks in the network;
+   assign new virtual lanes to some paths to break the deadlocks
+*/
+int dfsssp_remove_deadlocks(dfsssp_context_t * dfsssp_ctx)
+{
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
+
+	cl_qlist_t *port_tbl = &p_mgr->port_order_list;	/* 1 management port per switch + 1 or 2 ports for each Hca */
+	cl_list_item_t *item1 = NULL, *item2 = NULL;
+	osm_port_t *src_port = NULL, *dest_port = NULL;
+
+	uint32_t i = 0, j = 0, err = 0, bound = 0;
+	uint8_t vl = 0, test_vl = 0, vl_avail = 0, vl_needed = 1, vl_buffer = 0;
+	double most_avg_paths = 0.0;
+	cdg_node_t **cdg = NULL, *start_here = NULL, *cycle = NULL;
+	cdg_link_t *weakest_link = NULL;
+	cdg_arena_t arena = { NULL, NULL, 0 };
+	cdg_pair_iter_t pair_iter;
+	uint32_t srcdest = 0;
+
+	vltable_t *srcdest2vl_table = NULL;
+	uint8_t lmc = 0;
+	uint16_t slid = 0, dlid = 0, min_lid_ho = 0, max_lid_ho =
+	    0, min_lid_ho2 = 0, max_lid_ho2 = 0;;
+	uint64_t *paths_per_vl = NULL;
+	uint64_t from = 0, to = 0, count = 0;
+	uint8_t *split_count = NULL;
+	uint8_t *on_lane = NULL;
+	uint32_t on_lane_len = 0;
+	uint8_t ntype = 0;
+
+	OSM_LOG_ENTER(p_mgr->p_log);
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Assign each src/dest pair a Virtual Lanes, to remove deadlocks in the routing\n");
+
+	vl_avail = get_avail_vl_in_subn(p_mgr);
+        if(dfsssp_ctx->max_vls > 0 && vl_avail > dfsssp_ctx->max_vls) {
+            vl_avail = dfsssp_ctx->max_vls;
+        }
+	vl_buffer = vl_avail+1;
+	OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+		"Virtual Lanes available: %" PRIu8 "\n", vl_avail);
+
+	paths_per_vl = (uint64_t *) malloc(vl_buffer * sizeof(uint64_t));
+	if (!paths_per_vl) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD22: cannot allocate memory for paths_per_vl\n");
+		return 1;
+	}
+	memset(paths_per_vl, 0, vl_buffer * sizeof(uint64_t));
+
+	cdg = (cdg_node_t **) malloc(vl_buffer * sizeof(cdg_node_t *));
+	if (!cdg) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD23: cannot allocate memory for cdg\n");
+		free(paths_per_vl);
+		return 1;
+	}
+	for (i = 0; i < vl_buffer; i++)
+		cdg[i] = NULL;
+
+	count = 0;
+	/* count all ports (also multiple LIDs) of type CA or SP0 for size of VL table */
+	for (item1 = cl_qlist_head(port_tbl); item1 != cl_qlist_end(port_tbl);
+	     item1 = cl_qlist_next(item1)) {
+		dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
+						      list_item);
+		ntype = osm_node_get_type(dest_port->p_node);
+		if (ntype == IB_NODE_TYPE_CA || ntype == IB_NODE_TYPE_SWITCH) {
+			/* only SP0 with SLtoVLMapping support will be processed */
+			if (ntype == IB_NODE_TYPE_SWITCH
+			    && !(dest_port->p_physp->port_info.capability_mask
+			    & IB_PORT_CAP_HAS_SL_MAP))
+				continue;
+
+			lmc = osm_port_get_lmc(dest_port);
+			count += (1 << lmc);
+		}
+	}
+	/* allocate VL table and indexing array */
+	err = vltable_alloc(&srcdest2vl_table, count,
+			    dfsssp_ctx->vltable_per_switch);
+	if (err) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD26: cannot allocate memory for srcdest2vl_table\n");
+		goto ERROR;
+	}
+
+	i = 0;
+	/* fill lids into indexing array */
+	for (item1 = cl_qlist_head(port_tbl); item1 != cl_qlist_end(port_tbl);
+	     item1 = cl_qlist_next(item1)) {
+		dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
+						      list_item);
+		ntype = osm_node_get_type(dest_port->p_node);
+		if (ntype == IB_NODE_TYPE_CA || ntype == IB_NODE_TYPE_SWITCH) {
+			/* only SP0 with SLtoVLMapping support will be processed */
+			if (ntype == IB_NODE_TYPE_SWITCH
+			    && !(dest_port->p_physp->port_info.capability_mask
+			    & IB_PORT_CAP_HAS_SL_MAP))
+				continue;
+
+			osm_port_get_lid_range_ho(dest_port, &min_lid_ho,
+						  &max_lid_ho);
+			for (dlid = min_lid_ho; dlid <= max_lid_ho; dlid++, i++)
+				srcdest2vl_table->lids[i] = cl_hton16(dlid);
+		}
+	}
+	/* sort lids */
+	vltable_sort_lids(srcdest2vl_table);
+	err = vltable_build_index(p_mgr, srcdest2vl_table);
+	if (err) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD26: cannot allocate memory for srcdest2vl_table\n");
+		goto ERROR;
+	}
+
+	if (dfsssp_ctx->incremental_cdg) {
+		/* add the paths to the cdgs one by one and keep them acyclic */
+		err = dfsssp_assign_vls_incremental(dfsssp_ctx, srcdest2vl_table,
+						    paths_per_vl, vl_avail,
+						    &vl_needed);
+		if (err)
+			goto ERROR;
+		dfsssp_ctx->srcdest2vl_table = srcdest2vl_table;
+	} else {
+		test_vl = 0;
+		/* fill cdg[0] with routes from each src/dest port combination for all Hca/SP0 in the subnet */
+		for (item1 = cl_qlist_head(port_tbl); item1 != cl_qlist_end(port_tbl);
+		     item1 = cl_qlist_next(item1)) {
+			dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
+							      list_item);
+			ntype = osm_node_get_type(dest_port->p_node);
+			if ((ntype != IB_NODE_TYPE_CA && ntype != IB_NODE_TYPE_SWITCH)
+			    || !(dest_port->p_physp->port_info.capability_mask
+			    & IB_PORT_CAP_HAS_SL_MAP))
+				continue;
+
+			for (item2 = cl_qlist_head(port_tbl);
+			     item2 != cl_qlist_end(port_tbl);
+			     item2 = cl_qlist_next(item2)) {
+				src_port = (osm_port_t *)cl_item_obj(item2, src_port,
+								     list_item);
+				ntype = osm_node_get_type(src_port->p_node);
+				if ((ntype != IB_NODE_TYPE_CA
+				    && ntype != IB_NODE_TYPE_SWITCH)
+				    || !(src_port->p_physp->port_info.capability_mask
+				    & IB_PORT_CAP_HAS_SL_MAP))
+					continue;
+
+				if (src_port != dest_port) {
+					/* iterate over LIDs of src and dest port */
+					osm_port_get_lid_range_ho(src_port, &min_lid_ho,
+								  &max_lid_ho);
+					for (slid = min_lid_ho; slid <= max_lid_ho;
+					     slid++) {
+						osm_port_get_lid_range_ho
+						    (dest_port, &min_lid_ho2,
+						     &max_lid_ho2);
+						for (dlid = min_lid_ho2;
+						     dlid <= max_lid_ho2;
+						     dlid++) {
+
+							/* try to add the path to cdg[0] */
+							err =
+							    update_channel_dep_graph
+							    (&arena, &(cdg[test_vl]),
+							     src_port, slid,
+							     dest_port, dlid);
+							if (err) {
+								OSM_LOG(p_mgr->
+									p_log,
+									OSM_LOG_ERROR,
+									"ERR AD14: cannot allocate memory for cdg node or link in update_channel_dep_graph(...)\n");
+								goto ERROR;
+							}
+							/* add the <s,d> combination / corresponding virtual lane to the VL table */
+							vltable_insert
+							    (srcdest2vl_table,
+							     cl_hton16(slid),
+							     cl_hton16(dlid),
+							     test_vl);
+							paths_per_vl[test_vl]++;
+
+						}
+
 					}
 				}
-				set_default_link(adj_list[0].links);
-				adj_list[0].links->guid =
-				    cl_ntoh64(osm_node_get_node_guid
-					      (remote_node));
-				adj_list[0].links->from_port =
-				    port->p_physp->port_num;
-				adj_list[0].links->to_port = remote_port;
-				adj_list[0].links->weight = 1;
-				for (j = 1; j < adj_list_size; j++) {
-					if (adj_list[0].links->guid ==
-					    adj_list[j].guid) {
-						adj_list[0].links->to = j;
-						break;
+
+			}
+		}
+		dfsssp_ctx->srcdest2vl_table = srcdest2vl_table;
+
+		/* test all cdg for cycles and break the cycles by moving paths on the weakest link to the next cdg */
+		for (test_vl = 0; test_vl < vl_buffer - 1; test_vl++) {
+			start_here = cdg[test_vl];
+			while (start_here) {
+				cycle =
+				    search_cycle_in_channel_dep_graph(&arena,
+								      cdg[test_vl],
+								      start_here);
+
+				if (cycle) {
+					vl_needed = test_vl + 2;
+
+					/* calc weakest link n cycle */
+					weakest_link = get_weakest_link_in_cycle(cycle);
+					if (!weakest_link) {
+						OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+							"ERR AD27: something went wrong in get_weakest_link_in_cycle(...)\n");
+						err = 1;
+						goto ERROR;
+					}
+
+					paths_per_vl[test_vl] -=
+					    weakest_link->num_pairs;
+					paths_per_vl[test_vl + 1] +=
+					    weakest_link->num_pairs;
+
+					/* decide upfront which pairs are still on this
+					   lane; with a per switch VL table moving one
+					   pair also moves the pairs of its switch
+					 */
+					if (weakest_link->num_pairs > on_lane_len) {
+						free(on_lane);
+						on_lane_len = weakest_link->num_pairs;
+						on_lane = (uint8_t *) malloc(on_lane_len);
+						if (!on_lane) {
+							OSM_LOG(p_mgr->p_log,
+								OSM_LOG_ERROR,
+								"ERR AD15: cannot allocate memory for on_lane\n");
+							err = 1;
+							goto ERROR;
+						}
+					}
+					cdg_pair_iter_init(&pair_iter, weakest_link);
+					for (i = 0; i < weakest_link->num_pairs; i++) {
+						srcdest =
+						    get_next_srcdest_pair(&pair_iter);
+						on_lane[i] = (test_vl ==
+						    (uint8_t)
+						    vltable_get_vl(srcdest2vl_table,
+								   cl_hton16((uint16_t)
+									     (srcdest >> 16)),
+								   cl_hton16((uint16_t)
+									     srcdest)));
+					}
+
+					/* move all <s,d> paths on this link to the next cdg */
+					cdg_pair_iter_init(&pair_iter, weakest_link);
+					for (i = 0; i < weakest_link->num_pairs; i++) {
+						srcdest =
+						    get_next_srcdest_pair(&pair_iter);
+						slid = (uint16_t) (srcdest >> 16);
+						dlid =
+						    (uint16_t) ((srcdest << 16) >> 16);
+
+						/* only move if not moved in a previous step */
+						if (!on_lane[i]) {
+							/* this path has been moved
+							   before -> don't count
+							 */
+							paths_per_vl[test_vl]++;
+							paths_per_vl[test_vl + 1]--;
+							continue;
+						}
+
+						src_port =
+						    osm_get_port_by_lid(p_mgr->p_subn,
+									cl_hton16
+									(slid));
+						dest_port =
+						    osm_get_port_by_lid(p_mgr->p_subn,
+									cl_hton16
+									(dlid));
+
+						/* remove path from current cdg / vl */
+						err =
+						    remove_path_from_cdg(&
+									 (cdg[test_vl]),
+									 src_port, slid,
+									 dest_port,
+									 dlid);
+						if (err) {
+							OSM_LOG(p_mgr->p_log,
+								OSM_LOG_ERROR,
+								"ERR AD44: something went wrong in remove_path_from_cdg(...)\n");
+							goto ERROR;
+						}
+
+						/* add path to next cdg / vl */
+						err =
+						    update_channel_dep_graph(&arena,
+									     &(cdg
+									      [test_vl +
+									       1]),
+									     src_port,
+									     slid,
+									     dest_port,
+									     dlid);
+						if (err) {
+							OSM_LOG(p_mgr->p_log,
+								OSM_LOG_ERROR,
+								"ERR AD14: cannot allocate memory for cdg node or link in update_channel_dep_graph(...)\n");
+							goto ERROR;
+						}
+						vltable_insert(srcdest2vl_table,
+							       cl_hton16(slid),
+							       cl_hton16(dlid),
+							       test_vl + 1);
 					}
+
+					cdg_link_free_pairs(&arena, weakest_link);
+					free(weakest_link);
 				}
+
+				start_here = cycle;
 			}
-		} else {
-			/* if link is unhealthy then there's a severe issue */
-			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-				"ERR AD0B: unsupported network state (CA with"
-				" unhealthy link state discovered; should have"
-				" been filtered out before already; gracefully"
-				" shutdown this routing engine)\n");
-			return 1;
 		}
-		ret = cl_heap_insert(p_heap, INF, &adj_list[0]);
-		if (ret != CL_SUCCESS) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-				"ERR AD13: cl_heap_insert failed\n");
-			return ret;
+
+		/* test the last avail cdg for a cycle;
+		   if there is one, than vl_needed > vl_avail
+		 */
+		start_here = cdg[vl_avail - 1];
+		/*if (start_here) {
+			cycle =
+			    search_cycle_in_channel_dep_graph(cdg[vl_avail - 1],
+							      start_here);
+			if (cycle) {
+				vl_needed = vl_avail + 1;
+			}
+		}*/
+	}
+
+	OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+		"Virtual Lanes needed: %" PRIu8 "\n", vl_needed);
+	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_INFO)) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+			"Paths per VL (before balancing):\n");
+		for (i = 0; i < vl_buffer; i++)
+			OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+				"   %" PRIu32 ". lane: %" PRIu64 "\n", i,
+				paths_per_vl[i]);
+	}
+
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Balancing the paths on the available Virtual Lanes\n");
+
+	/* optimal balancing virtual lanes, under condition: no additional cycle checks;
+	   sl/vl != 0 might be assigned to loopback packets (i.e. slid/dlid on the
+	   same port for lmc>0), but thats no problem, see IBAS 10.2.2.3
+	 */
+	split_count = (uint8_t *) calloc(vl_buffer, sizeof(uint8_t));
+	if (!split_count) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD24: cannot allocate memory for split_count, skip balancing\n");
+		err = 1;
+		goto ERROR;
+	}
+	/* initial state: paths for VLs won't be separated */
+	for (i = 0; i < ((vl_needed < vl_avail) ? vl_needed : vl_buffer); i++)
+		split_count[i] = 1;
+	dfsssp_ctx->vl_split_count = split_count;
+	/* balancing is necessary if we have empty VLs */
+	if (vl_needed < vl_avail) {
+		/* split paths of VLs until we find an equal distribution */
+		for (i = vl_needed; i < vl_avail; i++) {
+			/* find VL with most paths in it */
+			vl = 0;
+			most_avg_paths = 0.0;
+			for (test_vl = 0; test_vl < vl_needed; test_vl++) {
+				if (most_avg_paths <
+				    ((double)paths_per_vl[test_vl] /
+				    split_count[test_vl])) {
+					vl = test_vl;
+					most_avg_paths =
+						(double)paths_per_vl[test_vl] /
+						split_count[test_vl];
+				}
+			}
+			split_count[vl]++;
 		}
-		/* if behind port is a switch -> search switch in adj_list */
-	} else {
-		/* reset adj_list[0], if links=NULL reset was done before, then skip */
-		if (adj_list[0].links) {
-			free(adj_list[0].links);
-			set_default_vertex(&adj_list[0]);
+		/* change the VL assignment depending on split_count for
+		   all VLs except VL 0
+		 */
+		for (from = vl_needed - 1; from > 0; from--) {
+			/* how much space needed for others? */
+			to = 0;
+			for (i = 0; i < from; i++)
+				to += split_count[i];
+			/* move all entries of the lane: with a per switch
+			   VL table the row weights (which include the lid of
+			   the switch) don't add up to paths_per_vl[from]
+			 */
+			vltable_change_vl(srcdest2vl_table, from, to,
+					  UINT64_MAX);
+			/* change also the information within the split_count
+			   array; this is important for fast calculation later
+			 */
+			split_count[to] = split_count[from];
+			split_count[from] = 0;
+			paths_per_vl[to] = paths_per_vl[from];
+			paths_per_vl[from] = 0;
 		}
-		/* search for the switch which is the source in this round */
-		guid = cl_ntoh64(osm_node_get_node_guid(port->p_node));
-		for (i = 1; i < adj_list_size; i++) {
-			if (guid == adj_list[i].guid) {
-				index = i;
+	} else if (!dfsssp_ctx->only_best_effort && vl_needed > vl_avail) {
+		/* routing not possible, a further development would be the LASH-TOR approach (update: LASH-TOR isn't possible, there is a mistake in the theory) */
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD25: Not enough VLs available (avail=%d, needed=%d); Stopping dfsssp routing!\n",
+			vl_avail, vl_needed);
+		err = 1;
+		goto ERROR;
+	} else if (dfsssp_ctx->only_best_effort && vl_needed > vl_avail) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+			"Not enough VLs available (avail=%d, needed=%d); Best effort deadlock removal only, spreading additional ones across remaining layers\n",
+			vl_avail, vl_needed);
+		from = vl_buffer - 1;
+		bound = paths_per_vl[from];
+		for(i = 0; i <= bound; i++) {
+			to = rand() % vl_avail;	
+			count = vltable_change_vl(srcdest2vl_table, from, to, 1);
+			if(!count)
 				break;
-			}
+			if(count > paths_per_vl[from])
+				count = paths_per_vl[from];
+			paths_per_vl[from] -= count;
+			paths_per_vl[to] += count;
 		}
 	}
+	/* else { no balancing } */
 
-	/* source in dijkstra */
-	adj_list[index].distance = 0;
-	adj_list[index].state = DISCOVERED;
-	adj_list[index].hops = 0;	/* the source has hop count = 0 */
-	ret = cl_heap_modify_key(p_heap, adj_list[index].distance,
-				 adj_list[index].heap_index);
-	if (ret != CL_SUCCESS) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD10: index out of bounds in cl_heap_modify_key\n");
-		return ret;
+	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG)) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+			"Virtual Lanes per src/dest combination after balancing:\n");
+		vltable_print(p_mgr, srcdest2vl_table);
+	}
+	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_INFO)) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+			"Approx. #paths per VL (after balancing):\n");
+		j = 0;
+		count = 1; /* to prevent div. by 0 */
+		for (i = 0; i < vl_buffer; i++) {
+			if (split_count[i] > 0) {
+				j = i;
+				count = split_count[i];
+			}
+			OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+				"   %" PRIu32 ". lane: %" PRIu64 "\n", i,
+				paths_per_vl[j] / count);
+		}
 	}
 
-	current = (vertex_t *) cl_heap_extract_root(p_heap);
-	while (current) {
-		current->state = DISCOVERED;
-		if (current->used_link)	/* increment the number of hops to the source for each new node */
-			current->hops =
-			    adj_list[current->used_link->from].hops + 1;
+	/* only VLs with acyclic cdgs can be kept for an incremental rerouting */
+	dfsssp_ctx->vl_split_size = vl_buffer;
+	dfsssp_ctx->vls_deadlock_free = (vl_needed <= vl_avail);
 
-		/* add/update nodes which aren't discovered but accessible */
-		for (link = current->links; link != NULL; link = link->next) {
-			if ((adj_list[link->to].state != DISCOVERED)
-			    && (current->distance + link->weight <
-				adj_list[link->to].distance)) {
-				adj_list[link->to].used_link = link;
-				adj_list[link->to].distance =
-				    current->distance + link->weight;
-				ret = cl_heap_modify_key(p_heap,
-							 adj_list[link->to].distance,
-							 adj_list[link->to].heap_index);
-				if (ret != CL_SUCCESS) {
-					OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-						"ERR AD12: index out of bounds in cl_heap_modify_key\n");
-					return ret;
-				}
+	free(paths_per_vl);
+	free(on_lane);
+
+	/* deallocate channel dependency graphs */
+	for (i = 0; i < vl_avail; i++)
+		cdg_dealloc(&arena, &cdg[i]);
+	free(cdg);
+	cdg_arena_destroy(&arena);
+
+	OSM_LOG_EXIT(p_mgr->p_log);
+	return 0;
+
+ERROR:
+	free(paths_per_vl);
+	free(on_lane);
+
+	for (i = 0; i < vl_avail; i++)
+		cdg_dealloc(&arena, &cdg[i]);
+	free(cdg);
+	cdg_arena_destroy(&arena);
+
+	vltable_dealloc(&srcdest2vl_table);
+	dfsssp_ctx->srcdest2vl_table = NULL;
+
+	return err;
+}
+
+/************ helper functions for the parallel dijkstra routing ******
+ **********************************************************************/
+/* one dijkstra step (one destination LID) of a batch; the result is kept
+   until the batch is committed to the LFTs and the link weights
+*/
+typedef struct dijkstra_task {
+	osm_port_t *port;
+	uint16_t lid;
+	link_t **used_link;	/* per switch: link used to reach the switch */
+	uint8_t *hops;		/* per switch: hops to the destination */
+	link_t hca_link;	/* copy of the link of a Hca destination */
+} dijkstra_task_t;
+
+typedef struct dijkstra_worker {
+	cl_thread_t thread;
+	osm_ucast_mgr_t *p_mgr;
+	vertex_t *adj_list;	/* private copy of the vertex state */
+	uint32_t adj_list_size;
+	cl_heap_t heap;
+	dijkstra_task_t *tasks;
+	uint32_t num_tasks;
+	uint32_t offset;
+	uint32_t stride;
+	int err;
+} dijkstra_worker_t;
+
+static int dijkstra_worker_init(dijkstra_worker_t * worker,
+				osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
+				uint32_t adj_list_size)
+{
+	worker->p_mgr = p_mgr;
+	worker->adj_list_size = adj_list_size;
+	cl_heap_construct(&worker->heap);
+	cl_thread_construct(&worker->thread);
+
+	/* the links (and their weights) are shared, the vertex state is not */
+	worker->adj_list = (vertex_t *) malloc(adj_list_size * sizeof(vertex_t));
+	if (!worker->adj_list)
+		return 1;
+	memcpy(worker->adj_list, adj_list, adj_list_size * sizeof(vertex_t));
+	set_default_vertex(&worker->adj_list[0]);
+
+	return 0;
+}
+
+static void dijkstra_worker_destroy(dijkstra_worker_t * worker)
+{
+	if (worker->adj_list) {
+		if (worker->adj_list[0].links)
+			free(worker->adj_list[0].links);
+		free(worker->adj_list);
+		worker->adj_list = NULL;
+	}
+	if (cl_is_heap_inited(&worker->heap))
+		cl_heap_destroy(&worker->heap);
+}
+
+static void dijkstra_worker_run(void *context)
+{
+	dijkstra_worker_t *worker = (dijkstra_worker_t *) context;
+	vertex_t *adj_list = worker->adj_list;
+	dijkstra_task_t *task = NULL;
+	link_t *link = NULL;
+	uint32_t i = 0, j = 0;
+
+	for (i = worker->offset; i < worker->num_tasks && !worker->err;
+	     i += worker->stride) {
+		task = &worker->tasks[i];
+		if (dijkstra(worker->p_mgr, &worker->heap, adj_list,
+			     worker->adj_list_size, task->port, task->lid)) {
+			worker->err = 1;
+			break;
+		}
+		for (j = 1; j < worker->adj_list_size; j++) {
+			link = adj_list[j].used_link;
+			/* the link of adj_list[0] is reused by the next task */
+			if (link && link == adj_list[0].links) {
+				task->hca_link = *link;
+				link = &task->hca_link;
 			}
+			task->used_link[j] = link;
+			task->hops[j] = adj_list[j].hops;
 		}
-
-		current = (vertex_t *) cl_heap_extract_root(p_heap);
 	}
+}
 
-	OSM_LOG_EXIT(p_mgr->p_log);
-	return 0;
+/* run the dijkstra steps of a batch concurrently; the link weights are
+   not modified until all workers are joined again
+*/
+static int dijkstra_run_batch(dijkstra_worker_t * workers,
+			      uint32_t num_workers, dijkstra_task_t * tasks,
+			      uint32_t num_tasks)
+{
+	uint32_t t = 0;
+	int err = 0;
+
+	for (t = 0; t < num_workers; t++) {
+		workers[t].tasks = tasks;
+		workers[t].num_tasks = num_tasks;
+		workers[t].offset = t;
+		workers[t].stride = num_workers;
+		workers[t].err = 0;
+		cl_thread_construct(&workers[t].thread);
+	}
+	/* the calling thread is worker 0; if a thread cannot be created,
+	   its share is computed here as well
+	 */
+	for (t = 1; t < num_workers; t++) {
+		if (cl_thread_init(&workers[t].thread, dijkstra_worker_run,
+				   &workers[t], "dfsssp worker") != CL_SUCCESS)
+			dijkstra_worker_run(&workers[t]);
+	}
+	dijkstra_worker_run(&workers[0]);
+	for (t = 0; t < num_workers; t++) {
+		cl_thread_destroy(&workers[t].thread);
+		err |= workers[t].err;
+	}
+	return err;
 }
 
-/* update the linear forwarding tables of all switches with the informations
-   from the last dijsktra step
+/* write the routes of a task into the LFTs and add its weights; tasks are
+   committed in the order of the port_order_list, so the result does not
+   depend on the number of threads
 */
-static int update_lft(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
-		      uint32_t adj_list_size, osm_port_t * p_port, uint16_t lid)
+static int dijkstra_commit_task(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
+				uint32_t adj_list_size, dijkstra_task_t * task)
 {
-	uint32_t i = 0;
-	uint8_t port = 0;
-	uint8_t hops = 0;
-	osm_switch_t *p_sw = NULL;
-	boolean_t is_ignored_by_port_prof = FALSE;
-	osm_physp_t *p = NULL;
-	cl_status_t ret;
+	uint32_t j = 0;
+	int err = 0;
 
-	OSM_LOG_ENTER(p_mgr->p_log);
+	adj_list[0].used_link = NULL;
+	for (j = 1; j < adj_list_size; j++) {
+		adj_list[j].used_link = task->used_link[j];
+		adj_list[j].hops = task->hops[j];
+	}
 
-	for (i = 1; i < adj_list_size; i++) {
-		/* if no route goes thru this switch -> cycle */
-		if (!(adj_list[i].used_link))
-			continue;
+	err = update_lft(p_mgr, adj_list, adj_list_size, task->port, task->lid);
+	if (err)
+		return err;
 
-		p_sw = adj_list[i].sw;
-		hops = adj_list[i].hops;
-		port = adj_list[i].used_link->to_port;
-		/* the used_link is the link that was used in dijkstra to reach this node,
-		   so the to_port is the local port on this node
-		 */
+	update_weights(p_mgr, adj_list, adj_list_size);
 
-		if (port == OSM_NO_PATH) {	/* if clause shouldn't be possible in this routing, but who cares */
-			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-				"ERR AD06: No path to get to LID %" PRIu16
-				" from switch 0x%" PRIx64 "\n", lid,
-				cl_ntoh64(osm_node_get_node_guid
-					  (p_sw->p_node)));
+	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
+		print_graph(p_mgr, adj_list, adj_list_size);
 
-			/* do not try to overwrite the ppro of non existing port ... */
-			is_ignored_by_port_prof = TRUE;
-			return 1;
-		} else {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"Routing LID %" PRIu16 " to port %" PRIu8
-				" for switch 0x%" PRIx64 "\n", lid, port,
-				cl_ntoh64(osm_node_get_node_guid
-					  (p_sw->p_node)));
+	return 0;
+}
 
-			p = osm_node_get_physp_ptr(p_sw->p_node, port);
-			if (!p) {
-				OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-					"ERR AD0A: Physical port %d of Node GUID 0x%"
-					PRIx64 "not found\n", port,
-					cl_ntoh64(osm_node_get_node_guid(p_sw->p_node)));
-				return 1;
-			}
+/* parallel variant of the dijkstra loop in dfsssp_do_dijkstra_routing:
+   batches of destinations are routed concurrently with the weights of the
+   previous batch; batch_size == 1 gives the same result as the serial loop
+*/
+static int dfsssp_parallel_dijkstra(dfsssp_context_t * dfsssp_ctx,
+				    cl_qlist_t * qlist)
+{
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
+	vertex_t *adj_list = (vertex_t *) dfsssp_ctx->adj_list;
+	uint32_t adj_list_size = dfsssp_ctx->adj_list_size;
+	cl_list_item_t *qlist_item = NULL;
+	osm_port_t *port = NULL;
+	dijkstra_task_t *tasks = NULL;
+	dijkstra_worker_t *workers = NULL;
+	link_t **used_links = NULL;
+	uint8_t *hops = NULL;
+	uint32_t num_tasks = 0, batch_size = 0, num_workers = 0;
+	uint32_t i = 0, k = 0, start = 0, n = 0;
+	uint16_t lid = 0, min_lid_ho = 0, max_lid_ho = 0;
+	uint8_t ntype = 0;
+	int err = 0;
 
-			/* we would like to optionally ignore this port in equalization
-			   as in the case of the Mellanox Anafa Internal PCI TCA port
-			 */
-			is_ignored_by_port_prof = p->is_prof_ignored;
+	/* one task per destination LID, in the order of the serial loop */
+	for (qlist_item = cl_qlist_head(qlist);
+	     qlist_item != cl_qlist_end(qlist);
+	     qlist_item = cl_qlist_next(qlist_item)) {
+		port = (osm_port_t *)cl_item_obj(qlist_item, port, list_item);
+		ntype = osm_node_get_type(port->p_node);
+		if (ntype != IB_NODE_TYPE_CA && ntype != IB_NODE_TYPE_SWITCH)
+			continue;
+		osm_port_get_lid_range_ho(port, &min_lid_ho, &max_lid_ho);
+		num_tasks += max_lid_ho - min_lid_ho + 1;
+	}
 
-			/* We also would ignore this route if the target lid is of
-			   a switch and the port_profile_switch_node is not TRUE
-			 */
-			if (!p_mgr->p_subn->opt.port_profile_switch_nodes)
-				is_ignored_by_port_prof |=
-				    (osm_node_get_type(p_port->p_node) ==
-				     IB_NODE_TYPE_SWITCH);
+	batch_size = dfsssp_ctx->batch_size ? dfsssp_ctx->batch_size :
+	    dfsssp_ctx->num_threads;
+	if (batch_size > num_tasks)
+		batch_size = num_tasks ? num_tasks : 1;
+	num_workers = (dfsssp_ctx->num_threads < batch_size) ?
+	    dfsssp_ctx->num_threads : batch_size;
+
+	tasks = (dijkstra_task_t *) calloc(num_tasks + 1,
+					   sizeof(dijkstra_task_t));
+	used_links = (link_t **) malloc((uint64_t) batch_size * adj_list_size *
+					sizeof(link_t *));
+	hops = (uint8_t *) malloc((uint64_t) batch_size * adj_list_size *
+				  sizeof(uint8_t));
+	workers = (dijkstra_worker_t *) calloc(num_workers,
+					       sizeof(dijkstra_worker_t));
+	if (!tasks || !used_links || !hops || !workers) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD16: cannot allocate memory for the parallel dijkstra\n");
+		err = 1;
+		goto Exit;
+	}
+	for (k = 0; k < num_workers; k++) {
+		if (dijkstra_worker_init(&workers[k], p_mgr, adj_list,
+					 adj_list_size)) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD16: cannot allocate memory for the parallel dijkstra\n");
+			err = 1;
+			goto Exit;
 		}
+	}
 
-		/* to support lmc > 0 the functions alloc_ports_priv, free_ports_priv, find_and_add_remote_sys
-		   from minhop aren't needed cause osm_switch_recommend_path is implicitly calculated
-		   for each LID pair thru dijkstra;
-		   for each port the dijkstra algorithm calculates (max_lid_ho - min_lid_ho)-times maybe
-		   disjoint routes to spread the bandwidth -> diffent routes for one port and lmc>0
-		 */
+	i = 0;
+	for (qlist_item = cl_qlist_head(qlist);
+	     qlist_item != cl_qlist_end(qlist);
+	     qlist_item = cl_qlist_next(qlist_item)) {
+		port = (osm_port_t *)cl_item_obj(qlist_item, port, list_item);
+		ntype = osm_node_get_type(port->p_node);
+		if (ntype != IB_NODE_TYPE_CA && ntype != IB_NODE_TYPE_SWITCH)
+			continue;
+		osm_port_get_lid_range_ho(port, &min_lid_ho, &max_lid_ho);
+		for (lid = min_lid_ho; lid <= max_lid_ho; lid++, i++) {
+			tasks[i].port = port;
+			tasks[i].lid = lid;
+		}
+	}
 
-		/* set port in LFT */
-		p_sw->new_lft[lid] = port;
-		if (!is_ignored_by_port_prof) {
-			/* update the number of path routing thru this port */
-			osm_switch_count_path(p_sw, port);
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Routing %" PRIu32 " destination LIDs with %" PRIu32
+		" threads in batches of %" PRIu32 "\n", num_tasks,
+		num_workers, batch_size);
+
+	for (start = 0; start < num_tasks; start += n) {
+		n = (num_tasks - start < batch_size) ?
+		    num_tasks - start : batch_size;
+		for (k = 0; k < n; k++) {
+			tasks[start + k].used_link =
+			    &used_links[(uint64_t) k * adj_list_size];
+			tasks[start + k].hops =
+			    &hops[(uint64_t) k * adj_list_size];
+		}
+
+		err = dijkstra_run_batch(workers, num_workers, &tasks[start], n);
+		if (err)
+			goto Exit;
+
+		/* deterministic reduction of the batch into LFTs and weights */
+		for (k = 0; k < n; k++) {
+			err = dijkstra_commit_task(p_mgr, adj_list,
+						   adj_list_size,
+						   &tasks[start + k]);
+			if (err)
+				goto Exit;
 		}
-		/* set the hop count from this switch to the lid */
-		ret = osm_switch_set_hops(p_sw, lid, port, hops);
-		if (ret != CL_SUCCESS)
-			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-				"ERR AD05: cannot set hops for LID %" PRIu16
-				" at switch 0x%" PRIx64 "\n", lid,
-				cl_ntoh64(osm_node_get_node_guid
-					  (p_sw->p_node)));
 	}
 
-	OSM_LOG_EXIT(p_mgr->p_log);
-	return 0;
+Exit:
+	if (workers) {
+		for (k = 0; k < num_workers; k++)
+			dijkstra_worker_destroy(&workers[k]);
+		free(workers);
+	}
+	free(tasks);
+	free(used_links);
+	free(hops);
+	return err;
 }
 
-/* the function updates the multicast group membership information
-   similar to create_mgrp_switch_map (osm_mcast_mgr.c)
-   => with it we can identify if a switch needs to be processed
-   or not in update_mcft
+/************ helper functions for the incremental rerouting **********
+ **********************************************************************/
+/* with incremental_reroute the LFTs of the last routing are kept; if the
+   next routing sees the same switches and lids, and only links between
+   switches changed, the lids whose paths used a failed link (or which
+   get a shorter path thru a new link) are routed again, while the other
+   lids keep their paths, their share of the link weights and their VLs
 */
-static void update_mgrp_membership(cl_qlist_t * port_list)
+
+#define ROUTED_HOPS_UNKNOWN	0xFFFF
+#define ROUTED_HOPS_VISITING	0xFFFE
+#define ROUTED_HOPS_NO_PATH	0xFFFD
+
+static void free_adj_list(vertex_t * adj_list, uint32_t adj_list_size)
 {
-	osm_mcast_work_obj_t *wobj = NULL;
-	osm_port_t *port = NULL;
-	osm_switch_t *sw = NULL;
-	cl_list_item_t *i = NULL;
+	uint32_t i = 0;
+	link_t *link = NULL, *tmp = NULL;
 
-	for (i = cl_qlist_head(port_list); i != cl_qlist_end(port_list);
-	     i = cl_qlist_next(i)) {
-		wobj = cl_item_obj(i, wobj, list_item);
-		port = wobj->p_port;
-		if (port->p_node->sw) {
-			sw = port->p_node->sw;
-			sw->is_mc_member = 1;
-		} else {
-			sw = port->p_physp->p_remote_physp->p_node->sw;
-			sw->num_of_mcm++;
+	for (i = 0; i < adj_list_size; i++) {
+		link = adj_list[i].links;
+		while (link) {
+			tmp = link;
+			link = link->next;
+			free(tmp);
 		}
 	}
+	free(adj_list);
 }
 
-/* reset is_mc_member and num_of_mcm for future computations */
-static void reset_mgrp_membership(vertex_t * adj_list, uint32_t adj_list_size)
+static void free_routed_lfts(dfsssp_context_t * dfsssp_ctx)
 {
 	uint32_t i = 0;
 
-	for (i = 1; i < adj_list_size; i++) {
-		if (adj_list[i].dropped)
-			continue;
-
-		adj_list[i].sw->is_mc_member = 0;
-		adj_list[i].sw->num_of_mcm = 0;
+	if (dfsssp_ctx->routed_lft) {
+		for (i = 0; i < dfsssp_ctx->routed_num_sw; i++)
+			free(dfsssp_ctx->routed_lft[i]);
+		free(dfsssp_ctx->routed_lft);
+		dfsssp_ctx->routed_lft = NULL;
 	}
+	free(dfsssp_ctx->routed_lids);
+	dfsssp_ctx->routed_lids = NULL;
+	dfsssp_ctx->routed_num_sw = 0;
+	dfsssp_ctx->routed_max_lid = 0;
 }
 
-/* update the multicast forwarding tables of all switches with the informations
-   from the previous dijsktra step for the current mlid
-*/
-static int update_mcft(osm_sm_t * p_sm, vertex_t * adj_list,
-		       uint32_t adj_list_size, uint16_t mlid_ho,
-		       cl_qmap_t * port_map, osm_switch_t * root_sw)
+/* forget the link changes once the rerouting is done */
+static void dfsssp_reroute_done(dfsssp_context_t * dfsssp_ctx)
 {
-	uint32_t i = 0;
-	uint8_t port = 0, remote_port = 0;
-	uint8_t upstream_port = 0, downstream_port = 0;
-	ib_net64_t guid = 0;
-	osm_switch_t *p_sw = NULL;
-	osm_node_t *remote_node = NULL;
-	osm_physp_t *p_physp = NULL;
-	osm_mcast_tbl_t *p_tbl = NULL;
-	vertex_t *curr_adj = NULL;
-
-	OSM_LOG_ENTER(p_sm->p_log);
-
-	for (i = 1; i < adj_list_size; i++) {
-		if (adj_list[i].dropped)
-			continue;
-
-		p_sw = adj_list[i].sw;
-		OSM_LOG(p_sm->p_log, OSM_LOG_VERBOSE,
-			"Processing switch 0x%016" PRIx64
-			" (%s) for MLID 0x%X\n", cl_ntoh64(adj_list[i].guid),
-			p_sw->p_node->print_desc, mlid_ho);
-
-		/* if a) the switch does not support mcast  or
-		      b) no ports of this switch are part or the mcast group
-		   then cycle
-		 */
-		if (osm_switch_supports_mcast(p_sw) == FALSE ||
-		    (p_sw->num_of_mcm == 0 && !(p_sw->is_mc_member)))
-			continue;
-
-		p_tbl = osm_switch_get_mcast_tbl_ptr(p_sw);
+	free(dfsssp_ctx->changes);
+	dfsssp_ctx->changes = NULL;
+	dfsssp_ctx->num_changes = 0;
+	free(dfsssp_ctx->peer);
+	dfsssp_ctx->peer = NULL;
+	free(dfsssp_ctx->peer_offset);
+	dfsssp_ctx->peer_offset = NULL;
+	dfsssp_ctx->reroute = FALSE;
+}
 
-		/* add all ports of this sw to the mcast table,
-		   if they are part of the mcast grp
-		 */
-		if (p_sw->is_mc_member)
-			osm_mcast_tbl_set(p_tbl, mlid_ho, 0);
-		for (port = 1; port < p_sw->num_ports; port++) {
-			/* get the node behind the port */
-			remote_node =
-				osm_node_get_remote_node(p_sw->p_node, port,
-							 &remote_port);
-			/* check if connected and its not the same switch */
-			if (!remote_node || remote_node->sw == p_sw)
-				continue;
-			/* make sure the link is healthy */
-			p_physp = osm_node_get_physp_ptr(p_sw->p_node, port);
-			if (!p_physp || !osm_link_is_healthy(p_physp))
-				continue;
-			/* we don't add upstream ports in this step */
-			if (osm_node_get_type(remote_node) != IB_NODE_TYPE_CA)
-				continue;
+static void dfsssp_drop_vls(dfsssp_context_t * dfsssp_ctx)
+{
+	vltable_dealloc(&(dfsssp_ctx->srcdest2vl_table));
+	dfsssp_ctx->srcdest2vl_table = NULL;
 
-			guid = osm_physp_get_port_guid(osm_node_get_physp_ptr(
-						       remote_node,
-						       remote_port));
-			if (cl_qmap_get(port_map, guid)
-			    != cl_qmap_end(port_map))
-				osm_mcast_tbl_set(p_tbl, mlid_ho, port);
-		}
+	if (dfsssp_ctx->vl_split_count) {
+		free(dfsssp_ctx->vl_split_count);
+		dfsssp_ctx->vl_split_count = NULL;
+	}
+	dfsssp_ctx->vl_split_size = 0;
+	dfsssp_ctx->vls_deadlock_free = FALSE;
+}
 
-		/* now we have to add the upstream port of 'this' switch and
-		   the downstream port of the next switch to the mcast table
-		   until we reach the root_sw
-		 */
-		curr_adj = &adj_list[i];
-		while (curr_adj->sw != root_sw) {
-			/* the used_link is the link that was used in dijkstra to reach this node,
-			   so the to_port is the local (upstream) port on curr_adj->sw
-			 */
-			upstream_port = curr_adj->used_link->to_port;
-			osm_mcast_tbl_set(p_tbl, mlid_ho, upstream_port);
+/* drop everything kept from the last routing, except for the graph */
+static void dfsssp_drop_routing(dfsssp_context_t * dfsssp_ctx)
+{
+	free_routed_lfts(dfsssp_ctx);
+	dfsssp_reroute_done(dfsssp_ctx);
+	dfsssp_drop_vls(dfsssp_ctx);
+}
 
-			/* now we go one step in direction root_sw and add the
-			   downstream port for the spanning tree
-			 */
-			downstream_port = curr_adj->used_link->from_port;
-			p_tbl = osm_switch_get_mcast_tbl_ptr(
-				adj_list[curr_adj->used_link->from].sw);
-			osm_mcast_tbl_set(p_tbl, mlid_ho, downstream_port);
+/* what a lid is attached to: the port, and its switch (port) */
+static void get_routed_lid(osm_ucast_mgr_t * p_mgr, uint16_t lid,
+			   routed_lid_t * routed)
+{
+	osm_port_t *port = osm_get_port_by_lid_ho(p_mgr->p_subn, lid);
+	osm_node_t *remote_node = NULL;
+	uint8_t remote_port = 0;
 
-			curr_adj = &adj_list[curr_adj->used_link->from];
-		}
+	memset(routed, 0, sizeof(routed_lid_t));
+	if (!port)
+		return;
+	routed->port_guid = cl_ntoh64(port->guid);
+	if (port->p_node->sw) {
+		routed->sw_guid =
+		    cl_ntoh64(osm_node_get_node_guid(port->p_node));
+		return;
 	}
+	if (!port->p_physp)
+		return;
+	remote_node = osm_node_get_remote_node(port->p_node,
+					       port->p_physp->port_num,
+					       &remote_port);
+	if (remote_node && remote_node->sw) {
+		routed->sw_guid =
+		    cl_ntoh64(osm_node_get_node_guid(remote_node));
+		routed->sw_port = remote_port;
+	}
+}
 
-	OSM_LOG_EXIT(p_sm->p_log);
+static int add_link_change(dfsssp_context_t * dfsssp_ctx, uint32_t * max,
+			   link_t * link, boolean_t added)
+{
+	link_change_t *changes = NULL;
+
+	if (dfsssp_ctx->num_changes == *max) {
+		*max = (*max) ? 2 * (*max) : 16;
+		changes = (link_change_t *) realloc(dfsssp_ctx->changes,
+						    *max *
+						    sizeof(link_change_t));
+		if (!changes)
+			return 1;
+		dfsssp_ctx->changes = changes;
+	}
+	changes = &dfsssp_ctx->changes[dfsssp_ctx->num_changes++];
+	changes->from = link->from;
+	changes->from_port = link->from_port;
+	changes->to = link->to;
+	changes->added = added;
 	return 0;
 }
 
-/* increment the edge weights of the df-/sssp graph which represent the number
-   of paths on this link
+/* compare the new graph with the graph of the last routing; if only links
+   between switches differ, take over the weights of the remaining links,
+   record the changed links and set reroute; return 1 otherwise
 */
-static void update_weights(osm_ucast_mgr_t * p_mgr, vertex_t * adj_list,
-			   uint32_t adj_list_size)
+static int dfsssp_diff_graphs(dfsssp_context_t * dfsssp_ctx,
+			      vertex_t * prev_adj_list,
+			      uint32_t prev_adj_list_size)
 {
-	uint32_t i = 0, j = 0;
-	uint32_t additional_weight = 0;
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
+	vertex_t *adj_list = dfsssp_ctx->adj_list;
+	uint32_t adj_list_size = dfsssp_ctx->adj_list_size;
+	link_t *link = NULL, *prev_link = NULL;
+	uint32_t i = 0, max_changes = 0;
+	uint32_t *peer_offset = NULL;
+	routed_lid_t routed;
+	uint16_t lid = 0;
+
+	if (adj_list_size != prev_adj_list_size
+	    || adj_list_size - 1 != dfsssp_ctx->routed_num_sw)
+		return 1;
+	for (i = 1; i < adj_list_size; i++)
+		if (adj_list[i].guid != prev_adj_list[i].guid
+		    || adj_list[i].lid != prev_adj_list[i].lid
+		    || adj_list[i].num_hca != prev_adj_list[i].num_hca
+		    || adj_list[i].sw->max_lid_ho != dfsssp_ctx->routed_max_lid)
+			return 1;
+	for (lid = 1; lid <= dfsssp_ctx->routed_max_lid; lid++) {
+		get_routed_lid(p_mgr, lid, &routed);
+		if (routed.port_guid != dfsssp_ctx->routed_lids[lid].port_guid
+		    || routed.sw_guid != dfsssp_ctx->routed_lids[lid].sw_guid
+		    || routed.sw_port != dfsssp_ctx->routed_lids[lid].sw_port)
+			return 1;
+	}
 
-	OSM_LOG_ENTER(p_mgr->p_log);
+	/* the switch behind each port in the last routing */
+	peer_offset = (uint32_t *) malloc((adj_list_size + 1) *
+					  sizeof(uint32_t));
+	if (!peer_offset)
+		goto ERROR;
+	dfsssp_ctx->peer_offset = peer_offset;
+	peer_offset[0] = 0;
+	peer_offset[1] = 0;
+	for (i = 1; i < adj_list_size; i++)
+		peer_offset[i + 1] = peer_offset[i] + adj_list[i].sw->num_ports;
+	dfsssp_ctx->peer = (uint32_t *) calloc(peer_offset[adj_list_size] + 1,
+					       sizeof(uint32_t));
+	if (!dfsssp_ctx->peer)
+		goto ERROR;
+	for (i = 1; i < adj_list_size; i++)
+		for (link = prev_adj_list[i].links; link; link = link->next)
+			dfsssp_ctx->peer[peer_offset[i] + link->from_port] =
+			    link->to;
 
 	for (i = 1; i < adj_list_size; i++) {
-		/* if no route goes thru this switch -> cycle */
-		if (!(adj_list[i].used_link))
-			continue;
-		additional_weight = adj_list[i].num_hca;
-
-		j = i;
-		while (adj_list[j].used_link) {
-			/* update the link from pre to this node */
-			adj_list[j].used_link->weight += additional_weight;
-
-			j = adj_list[j].used_link->from;
+		for (link = adj_list[i].links; link; link = link->next) {
+			for (prev_link = prev_adj_list[i].links; prev_link;
+			     prev_link = prev_link->next)
+				if (prev_link->from_port == link->from_port
+				    && prev_link->to == link->to
+				    && prev_link->to_port == link->to_port)
+					break;
+			if (prev_link)
+				link->weight = prev_link->weight;
+			else if (add_link_change(dfsssp_ctx, &max_changes,
+						 link, TRUE))
+				goto ERROR;
+		}
+		for (prev_link = prev_adj_list[i].links; prev_link;
+		     prev_link = prev_link->next) {
+			for (link = adj_list[i].links; link; link = link->next)
+				if (prev_link->from_port == link->from_port
+				    && prev_link->to == link->to
+				    && prev_link->to_port == link->to_port)
+					break;
+			if (!link && add_link_change(dfsssp_ctx, &max_changes,
+						     prev_link, FALSE))
+				goto ERROR;
 		}
 	}
 
-	OSM_LOG_EXIT(p_mgr->p_log);
+	dfsssp_ctx->reroute = TRUE;
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"%" PRIu32 " links between switches changed since the last"
+		" routing\n", dfsssp_ctx->num_changes);
+	return 0;
+
+ERROR:
+	OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+		"ERR AD19: cannot allocate memory to compare the graph with"
+		" the last routing\n");
+	dfsssp_reroute_done(dfsssp_ctx);
+	return 1;
 }
 
-/* get the largest number of virtual lanes which is supported by all switches
-   in the subnet
-*/
-uint8_t get_avail_vl_in_subn(osm_ucast_mgr_t * p_mgr)
+/* keep the LFTs of this routing for the next one */
+static void dfsssp_save_routing(dfsssp_context_t * dfsssp_ctx)
 {
-	uint32_t i = 0;
-	uint8_t vls_avail = 0xFF, port_vls_avail = 0;
-	cl_qmap_t *sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
-	cl_map_item_t *item = NULL;
-	osm_switch_t *sw = NULL;
-
-	/* traverse all switches to get the number of available virtual lanes in the subnet */
-	for (item = cl_qmap_head(sw_tbl); item != cl_qmap_end(sw_tbl);
-	     item = cl_qmap_next(item)) {
-		sw = (osm_switch_t *) item;
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
+	vertex_t *adj_list = dfsssp_ctx->adj_list;
+	uint32_t adj_list_size = dfsssp_ctx->adj_list_size;
+	uint32_t i = 0, num_sw = adj_list_size - 1;
+	uint16_t lid = 0, max_lid = 0;
 
-		/* ignore management port 0 */
-		for (i = 1; i < osm_node_get_num_physp(sw->p_node); i++) {
-			osm_physp_t *p_physp =
-			    osm_node_get_physp_ptr(sw->p_node, i);
+	if (!num_sw)
+		return;
+	max_lid = adj_list[1].sw->max_lid_ho;
+	for (i = 2; i < adj_list_size; i++)
+		if (adj_list[i].sw->max_lid_ho != max_lid) {
+			free_routed_lfts(dfsssp_ctx);
+			return;
+		}
 
-			if (p_physp && p_physp->p_remote_physp) {
-				port_vls_avail =
-				    ib_port_info_get_op_vls(&p_physp->
-							    port_info);
-				if (port_vls_avail
-				    && port_vls_avail < vls_avail)
-					vls_avail = port_vls_avail;
-			}
+	if (dfsssp_ctx->routed_lft && (dfsssp_ctx->routed_num_sw != num_sw
+				       || dfsssp_ctx->routed_max_lid != max_lid))
+		free_routed_lfts(dfsssp_ctx);
+	if (!dfsssp_ctx->routed_lft) {
+		dfsssp_ctx->routed_lft =
+		    (uint8_t **) calloc(num_sw, sizeof(uint8_t *));
+		if (!dfsssp_ctx->routed_lft)
+			goto ERROR;
+		dfsssp_ctx->routed_num_sw = num_sw;
+		dfsssp_ctx->routed_max_lid = max_lid;
+		for (i = 0; i < num_sw; i++) {
+			dfsssp_ctx->routed_lft[i] =
+			    (uint8_t *) malloc(max_lid + 1);
+			if (!dfsssp_ctx->routed_lft[i])
+				goto ERROR;
 		}
+		dfsssp_ctx->routed_lids =
+		    (routed_lid_t *) malloc((max_lid + 1) *
+					    sizeof(routed_lid_t));
+		if (!dfsssp_ctx->routed_lids)
+			goto ERROR;
 	}
 
-	/* ib_port_info_get_op_vls gives values 1 ... 5 (s. IBAS 14.2.5.6) */
-	vls_avail = 1 << (vls_avail - 1);
-
-	/* set boundaries (s. IBAS 3.5.7) */
-	if (vls_avail > 15)
-		vls_avail = 15;
-	if (vls_avail < 1)
-		vls_avail = 1;
+	for (i = 1; i < adj_list_size; i++)
+		memcpy(dfsssp_ctx->routed_lft[i - 1], adj_list[i].sw->new_lft,
+		       max_lid + 1);
+	for (lid = 0; lid <= max_lid; lid++)
+		get_routed_lid(p_mgr, lid, &dfsssp_ctx->routed_lids[lid]);
+	return;
 
-	return vls_avail;
+ERROR:
+	OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+		"ERR AD20: cannot allocate memory to keep the routing;"
+		" the next routing will be a full one\n");
+	free_routed_lfts(dfsssp_ctx);
 }
 
-/* search for cycles in the channel dependency graph to identify possible
-   deadlocks in the network;
-   assign new virtual lanes to some paths to break the deadlocks
+/* hop count of each switch towards lid in the last routing, following the
+   kept LFTs; ROUTED_HOPS_NO_PATH for switches without (loop free) path
 */
-int dfsssp_remove_deadlocks(dfsssp_context_t * dfsssp_ctx)
+static void get_routed_hops(dfsssp_context_t * dfsssp_ctx, uint16_t lid,
+			    uint16_t * hops, uint32_t * stack)
 {
-	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
-
-	cl_qlist_t *port_tbl = &p_mgr->port_order_list;	/* 1 management port per switch + 1 or 2 ports for each Hca */
-	cl_list_item_t *item1 = NULL, *item2 = NULL;
-	osm_port_t *src_port = NULL, *dest_port = NULL;
-
-	uint32_t i = 0, j = 0, err = 0, bound = 0;
-	uint8_t vl = 0, test_vl = 0, vl_avail = 0, vl_needed = 1, vl_buffer = 0;
-	double most_avg_paths = 0.0;
-	cdg_node_t **cdg = NULL, *start_here = NULL, *cycle = NULL;
-	cdg_link_t *weakest_link = NULL;
-	uint32_t srcdest = 0;
-
-	vltable_t *srcdest2vl_table = NULL;
-	uint8_t lmc = 0;
-	uint16_t slid = 0, dlid = 0, min_lid_ho = 0, max_lid_ho =
-	    0, min_lid_ho2 = 0, max_lid_ho2 = 0;;
-	uint64_t *paths_per_vl = NULL;
-	uint64_t from = 0, to = 0, count = 0;
-	uint8_t *split_count = NULL;
-	uint8_t ntype = 0;
+	uint32_t num_sw = dfsssp_ctx->routed_num_sw;
+	uint32_t *peer_offset = dfsssp_ctx->peer_offset;
+	uint32_t i = 0, sw = 0, depth = 0;
+	uint16_t base = 0;
+	uint8_t port = 0;
 
-	OSM_LOG_ENTER(p_mgr->p_log);
-	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
-		"Assign each src/dest pair a Virtual Lanes, to remove deadlocks in the routing\n");
+	for (i = 1; i <= num_sw; i++)
+		hops[i] = ROUTED_HOPS_UNKNOWN;
+
+	for (i = 1; i <= num_sw; i++) {
+		sw = i;
+		depth = 0;
+		/* walk along the path until a switch with known hops */
+		for (;;) {
+			if (hops[sw] != ROUTED_HOPS_UNKNOWN) {
+				base = (hops[sw] == ROUTED_HOPS_VISITING) ?
+				    ROUTED_HOPS_NO_PATH : hops[sw];
+				break;
+			}
+			hops[sw] = ROUTED_HOPS_VISITING;
+			stack[depth++] = sw;
+			port = dfsssp_ctx->routed_lft[sw - 1][lid];
+			if (port == 0) {
+				base = 0;
+			} else if (port == OSM_NO_PATH
+				   || peer_offset[sw] + port >=
+				   peer_offset[sw + 1]) {
+				base = ROUTED_HOPS_NO_PATH;
+			} else if (!dfsssp_ctx->peer[peer_offset[sw] + port]) {
+				/* the Hca with this lid is behind the port */
+				base = 1;
+			} else {
+				sw = dfsssp_ctx->peer[peer_offset[sw] + port];
+				continue;
+			}
+			hops[stack[--depth]] = base;
+			break;
+		}
+		while (depth) {
+			if (base != ROUTED_HOPS_NO_PATH)
+				base++;
+			hops[stack[--depth]] = base;
+		}
+	}
+}
 
-	vl_avail = get_avail_vl_in_subn(p_mgr);
-        if(dfsssp_ctx->max_vls > 0 && vl_avail > dfsssp_ctx->max_vls) {
-            vl_avail = dfsssp_ctx->max_vls;
-        }
-	vl_buffer = vl_avail+1;
-	OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-		"Virtual Lanes available: %" PRIu8 "\n", vl_avail);
+/* check whether a link change affects the path towards lid */
+static boolean_t is_lid_affected(dfsssp_context_t * dfsssp_ctx,
+				 uint16_t lid, uint16_t * hops)
+{
+	link_change_t *change = NULL;
+	uint32_t i = 0;
 
-	paths_per_vl = (uint64_t *) malloc(vl_buffer * sizeof(uint64_t));
-	if (!paths_per_vl) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD22: cannot allocate memory for paths_per_vl\n");
-		return 1;
+	for (i = 0; i < dfsssp_ctx->num_changes; i++) {
+		change = &dfsssp_ctx->changes[i];
+		if (!change->added) {
+			if (dfsssp_ctx->routed_lft[change->from - 1][lid] ==
+			    change->from_port)
+				return TRUE;
+		} else if (hops[change->to] != ROUTED_HOPS_NO_PATH
+			   && (hops[change->from] == ROUTED_HOPS_NO_PATH
+			       || hops[change->from] > hops[change->to] + 1)) {
+			return TRUE;
+		}
 	}
-	memset(paths_per_vl, 0, vl_buffer * sizeof(uint64_t));
+	return FALSE;
+}
 
-	cdg = (cdg_node_t **) malloc(vl_buffer * sizeof(cdg_node_t *));
-	if (!cdg) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD23: cannot allocate memory for cdg\n");
-		free(paths_per_vl);
-		return 1;
-	}
-	for (i = 0; i < vl_buffer; i++)
-		cdg[i] = NULL;
+/* take the weights, which the paths towards lid added in the last routing,
+   off the links again (the reverse of update_weights)
+*/
+static void remove_routed_weights(dfsssp_context_t * dfsssp_ctx,
+				  uint16_t lid, uint16_t * hops,
+				  uint64_t * acc)
+{
+	vertex_t *adj_list = dfsssp_ctx->adj_list;
+	uint32_t num_sw = dfsssp_ctx->routed_num_sw;
+	uint32_t i = 0, next = 0;
+	uint16_t h = 0, max_hops = 0;
+	link_t *link = NULL;
+	uint8_t port = 0;
 
-	count = 0;
-	/* count all ports (also multiple LIDs) of type CA or SP0 for size of VL table */
-	for (item1 = cl_qlist_head(port_tbl); item1 != cl_qlist_end(port_tbl);
-	     item1 = cl_qlist_next(item1)) {
-		dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
-						      list_item);
-		ntype = osm_node_get_type(dest_port->p_node);
-		if (ntype == IB_NODE_TYPE_CA || ntype == IB_NODE_TYPE_SWITCH) {
-			/* only SP0 with SLtoVLMapping support will be processed */
-			if (ntype == IB_NODE_TYPE_SWITCH
-			    && !(dest_port->p_physp->port_info.capability_mask
-			    & IB_PORT_CAP_HAS_SL_MAP))
+	for (i = 1; i <= num_sw; i++) {
+		acc[i] = 0;
+		if (hops[i] != ROUTED_HOPS_NO_PATH && hops[i] > max_hops)
+			max_hops = hops[i];
+	}
+	/* each switch adds its paths and the ones thru it to its link */
+	for (h = max_hops; h > 0; h--) {
+		for (i = 1; i <= num_sw; i++) {
+			if (hops[i] != h)
 				continue;
-
-			lmc = osm_port_get_lmc(dest_port);
-			count += (1 << lmc);
+			acc[i] += adj_list[i].num_hca;
+			port = dfsssp_ctx->routed_lft[i - 1][lid];
+			next = dfsssp_ctx->peer[dfsssp_ctx->peer_offset[i] +
+						port];
+			if (!next)
+				continue;
+			for (link = adj_list[next].links; link;
+			     link = link->next)
+				if (link->to == i && link->to_port == port)
+					break;
+			if (link)
+				link->weight -= (link->weight > acc[i]) ?
+				    acc[i] : link->weight;
+			acc[next] += acc[i];
 		}
 	}
-	/* allocate VL table and indexing array */
-	err = vltable_alloc(&srcdest2vl_table, count);
-	if (err) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD26: cannot allocate memory for srcdest2vl_table\n");
-		goto ERROR;
-	}
+}
 
-	i = 0;
-	/* fill lids into indexing array */
-	for (item1 = cl_qlist_head(port_tbl); item1 != cl_qlist_end(port_tbl);
-	     item1 = cl_qlist_next(item1)) {
-		dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
-						      list_item);
-		ntype = osm_node_get_type(dest_port->p_node);
-		if (ntype == IB_NODE_TYPE_CA || ntype == IB_NODE_TYPE_SWITCH) {
-			/* only SP0 with SLtoVLMapping support will be processed */
-			if (ntype == IB_NODE_TYPE_SWITCH
-			    && !(dest_port->p_physp->port_info.capability_mask
-			    & IB_PORT_CAP_HAS_SL_MAP))
-				continue;
+/* restore the paths towards the lids which aren't affected by the link
+   changes, and route the affected lids again in the order of the
+   port_order_list
+*/
+static int dfsssp_reroute(dfsssp_context_t * dfsssp_ctx, cl_heap_t * p_heap,
+			  cl_qlist_t * qlist, uint8_t * affected)
+{
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
+	vertex_t *adj_list = dfsssp_ctx->adj_list;
+	uint32_t adj_list_size = dfsssp_ctx->adj_list_size;
+	cl_list_item_t *qlist_item = NULL;
+	osm_port_t *port = NULL;
+	uint16_t *hops = NULL;
+	uint32_t *stack = NULL;
+	uint64_t *acc = NULL;
+	uint32_t i = 0, num_lids = 0, num_affected = 0;
+	uint16_t lid = 0, min_lid_ho = 0, max_lid_ho = 0;
+	uint8_t out_port = 0;
+	int err = 0;
 
-			osm_port_get_lid_range_ho(dest_port, &min_lid_ho,
-						  &max_lid_ho);
-			for (dlid = min_lid_ho; dlid <= max_lid_ho; dlid++, i++)
-				srcdest2vl_table->lids[i] = cl_hton16(dlid);
-		}
+	hops = (uint16_t *) malloc(adj_list_size * sizeof(uint16_t));
+	stack = (uint32_t *) malloc(adj_list_size * sizeof(uint32_t));
+	acc = (uint64_t *) malloc(adj_list_size * sizeof(uint64_t));
+	if (!hops || !stack || !acc) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+			"ERR AD21: cannot allocate memory for the rerouting\n");
+		err = 1;
+		goto Exit;
 	}
-	/* sort lids */
-	vltable_sort_lids(srcdest2vl_table);
 
-	test_vl = 0;
-	/* fill cdg[0] with routes from each src/dest port combination for all Hca/SP0 in the subnet */
-	for (item1 = cl_qlist_head(port_tbl); item1 != cl_qlist_end(port_tbl);
-	     item1 = cl_qlist_next(item1)) {
-		dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
-						      list_item);
-		ntype = osm_node_get_type(dest_port->p_node);
-		if ((ntype != IB_NODE_TYPE_CA && ntype != IB_NODE_TYPE_SWITCH)
-		    || !(dest_port->p_physp->port_info.capability_mask
-		    & IB_PORT_CAP_HAS_SL_MAP))
+	for (qlist_item = cl_qlist_head(qlist);
+	     qlist_item != cl_qlist_end(qlist);
+	     qlist_item = cl_qlist_next(qlist_item)) {
+		port = (osm_port_t *)cl_item_obj(qlist_item, port, list_item);
+		if (osm_node_get_type(port->p_node) != IB_NODE_TYPE_CA
+		    && osm_node_get_type(port->p_node) != IB_NODE_TYPE_SWITCH)
 			continue;
 
-		for (item2 = cl_qlist_head(port_tbl);
-		     item2 != cl_qlist_end(port_tbl);
-		     item2 = cl_qlist_next(item2)) {
-			src_port = (osm_port_t *)cl_item_obj(item2, src_port,
-							     list_item);
-			ntype = osm_node_get_type(src_port->p_node);
-			if ((ntype != IB_NODE_TYPE_CA
-			    && ntype != IB_NODE_TYPE_SWITCH)
-			    || !(src_port->p_physp->port_info.capability_mask
-			    & IB_PORT_CAP_HAS_SL_MAP))
+		osm_port_get_lid_range_ho(port, &min_lid_ho, &max_lid_ho);
+		for (lid = min_lid_ho; lid <= max_lid_ho; lid++) {
+			num_lids++;
+			get_routed_hops(dfsssp_ctx, lid, hops, stack);
+			if (is_lid_affected(dfsssp_ctx, lid, hops)) {
+				affected[lid] = 1;
+				num_affected++;
+				remove_routed_weights(dfsssp_ctx, lid, hops,
+						      acc);
 				continue;
-
-			if (src_port != dest_port) {
-				/* iterate over LIDs of src and dest port */
-				osm_port_get_lid_range_ho(src_port, &min_lid_ho,
-							  &max_lid_ho);
-				for (slid = min_lid_ho; slid <= max_lid_ho;
-				     slid++) {
-					osm_port_get_lid_range_ho
-					    (dest_port, &min_lid_ho2,
-					     &max_lid_ho2);
-					for (dlid = min_lid_ho2;
-					     dlid <= max_lid_ho2;
-					     dlid++) {
-
-						/* try to add the path to cdg[0] */
-						err =
-						    update_channel_dep_graph
-						    (&(cdg[test_vl]),
-						     src_port, slid,
-						     dest_port, dlid);
-						if (err) {
-							OSM_LOG(p_mgr->
-								p_log,
-								OSM_LOG_ERROR,
-								"ERR AD14: cannot allocate memory for cdg node or link in update_channel_dep_graph(...)\n");
-							goto ERROR;
-						}
-						/* add the <s,d> combination / corresponding virtual lane to the VL table */
-						vltable_insert
-						    (srcdest2vl_table,
-						     cl_hton16(slid),
-						     cl_hton16(dlid),
-						     test_vl);
-						paths_per_vl[test_vl]++;
-
-					}
-
-				}
 			}
+			/* the own lids of the switches were set before */
+			for (i = 1; i < adj_list_size; i++) {
+				out_port = dfsssp_ctx->routed_lft[i - 1][lid];
+				if (out_port == 0 || out_port == OSM_NO_PATH
+				    || hops[i] == ROUTED_HOPS_NO_PATH)
+					continue;
+				err = set_lft_entry(p_mgr, adj_list[i].sw,
+						    port, lid, out_port,
+						    (uint8_t) hops[i]);
+				if (err)
+					goto Exit;
+			}
+		}
+	}
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Rerouting %" PRIu32 " of %" PRIu32 " lids affected by %"
+		PRIu32 " changed links\n", num_affected, num_lids,
+		dfsssp_ctx->num_changes);
+
+	for (qlist_item = cl_qlist_head(qlist);
+	     num_affected && qlist_item != cl_qlist_end(qlist);
+	     qlist_item = cl_qlist_next(qlist_item)) {
+		port = (osm_port_t *)cl_item_obj(qlist_item, port, list_item);
+		if (osm_node_get_type(port->p_node) != IB_NODE_TYPE_CA
+		    && osm_node_get_type(port->p_node) != IB_NODE_TYPE_SWITCH)
+			continue;
 
+		osm_port_get_lid_range_ho(port, &min_lid_ho, &max_lid_ho);
+		for (lid = min_lid_ho; lid <= max_lid_ho; lid++) {
+			if (!affected[lid])
+				continue;
+			err = dijkstra(p_mgr, p_heap, adj_list, adj_list_size,
+				       port, lid);
+			if (err)
+				goto Exit;
+			err = update_lft(p_mgr, adj_list, adj_list_size, port,
+					 lid);
+			if (err)
+				goto Exit;
+			update_weights(p_mgr, adj_list, adj_list_size);
 		}
 	}
-	dfsssp_ctx->srcdest2vl_table = srcdest2vl_table;
-
-	/* test all cdg for cycles and break the cycles by moving paths on the weakest link to the next cdg */
-	for (test_vl = 0; test_vl < vl_buffer - 1; test_vl++) {
-		start_here = cdg[test_vl];
-		while (start_here) {
-			cycle =
-			    search_cycle_in_channel_dep_graph(cdg[test_vl],
-							      start_here);
 
-			if (cycle) {
-				vl_needed = test_vl + 2;
+Exit:
+	free(hops);
+	free(stack);
+	free(acc);
+	return err;
+}
 
-				/* calc weakest link n cycle */
-				weakest_link = get_weakest_link_in_cycle(cycle);
-				if (!weakest_link) {
-					OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-						"ERR AD27: something went wrong in get_weakest_link_in_cycle(...)\n");
-					err = 1;
-					goto ERROR;
-				}
+/* add a path to the cdg of a VL: a kept path to its old VL, a rerouted one
+   to its old VL or else to the first marked VL which stays acyclic;
+   return the VL, or -1 if there is none
+*/
+static int32_t update_vls_add_path(cdg_engine_t * engine, uint32_t * channels,
+				   uint32_t num_channels, uint32_t * added,
+				   const uint8_t * mark, uint8_t num_vls,
+				   int32_t old_vl, boolean_t rerouted)
+{
+	int32_t vl = 0;
 
-				paths_per_vl[test_vl] -=
-				    weakest_link->num_pairs;
-				paths_per_vl[test_vl + 1] +=
-				    weakest_link->num_pairs;
-
-				/* move all <s,d> paths on this link to the next cdg */
-				for (i = 0; i < weakest_link->num_pairs; i++) {
-					srcdest =
-					    get_next_srcdest_pair(weakest_link,
-								  i);
-					slid = (uint16_t) (srcdest >> 16);
-					dlid =
-					    (uint16_t) ((srcdest << 16) >> 16);
-
-					/* only move if not moved in a previous step */
-					if (test_vl !=
-					    (uint8_t)
-					    vltable_get_vl(srcdest2vl_table,
-							   cl_hton16(slid),
-							   cl_hton16(dlid))) {
-						/* this path has been moved
-						   before -> don't count
-						 */
-						paths_per_vl[test_vl]++;
-						paths_per_vl[test_vl + 1]--;
-						continue;
-					}
+	if (old_vl >= 0 && old_vl < num_vls && mark[old_vl]
+	    && !cdg_dag_add_path(engine, (uint32_t) old_vl, channels,
+				 num_channels, added))
+		return old_vl;
+	if (!rerouted)
+		return -1;
+	for (vl = 0; vl < num_vls; vl++)
+		if (mark[vl] && vl != old_vl
+		    && !cdg_dag_add_path(engine, (uint32_t) vl, channels,
+					 num_channels, added))
+			return vl;
+	return -1;
+}
 
-					src_port =
-					    osm_get_port_by_lid(p_mgr->p_subn,
-								cl_hton16
-								(slid));
-					dest_port =
-					    osm_get_port_by_lid(p_mgr->p_subn,
-								cl_hton16
-								(dlid));
-
-					/* remove path from current cdg / vl */
-					err =
-					    remove_path_from_cdg(&
-								 (cdg[test_vl]),
-								 src_port, slid,
-								 dest_port,
-								 dlid);
-					if (err) {
-						OSM_LOG(p_mgr->p_log,
-							OSM_LOG_ERROR,
-							"ERR AD44: something went wrong in remove_path_from_cdg(...)\n");
-						goto ERROR;
-					}
+/* take the last VL of the largest group of VLs (set up by the balancing)
+   as a new group for rerouted paths which fit into none of the rebuilt
+   VLs; return the VL, or -1 if all groups consist of a single VL
+*/
+static int32_t update_vls_split_group(dfsssp_context_t * dfsssp_ctx,
+				      uint8_t * mark)
+{
+	uint8_t *split_count = dfsssp_ctx->vl_split_count;
+	uint8_t vl = 0, largest = 0;
 
-					/* add path to next cdg / vl */
-					err =
-					    update_channel_dep_graph(&
-								     (cdg
-								      [test_vl +
-								       1]),
-								     src_port,
-								     slid,
-								     dest_port,
-								     dlid);
-					if (err) {
-						OSM_LOG(p_mgr->p_log,
-							OSM_LOG_ERROR,
-							"ERR AD14: cannot allocate memory for cdg node or link in update_channel_dep_graph(...)\n");
-						goto ERROR;
-					}
-					vltable_insert(srcdest2vl_table,
-						       cl_hton16(slid),
-						       cl_hton16(dlid),
-						       test_vl + 1);
-				}
+	for (vl = 1; vl < dfsssp_ctx->vl_split_size; vl++)
+		if (split_count[vl] > split_count[largest])
+			largest = vl;
+	if (split_count[largest] < 2)
+		return -1;
 
-				if (weakest_link->num_pairs)
-					free(weakest_link->srcdest_pairs);
-				if (weakest_link)
-					free(weakest_link);
-			}
+	split_count[largest]--;
+	vl = largest + split_count[largest];
+	split_count[vl] = 1;
+	mark[vl] = 1;
+	return vl;
+}
 
-			start_here = cycle;
-		}
-	}
+/* give the paths towards the rerouted lids a VL again: the cdgs of the VLs
+   which held such a path are rebuilt from their other paths, and each new
+   path goes to the first of these VLs (starting with its old one) which
+   stays acyclic, or to a VL split off a group; return 1 if the VLs of the
+   last routing can't be kept
+*/
+static int dfsssp_update_vls(dfsssp_context_t * dfsssp_ctx,
+			     const uint8_t * affected)
+{
+	osm_ucast_mgr_t *p_mgr = (osm_ucast_mgr_t *) dfsssp_ctx->p_mgr;
+	vltable_t *vltable = dfsssp_ctx->srcdest2vl_table;
+	uint8_t num_vls = dfsssp_ctx->vl_split_size;
+	cl_qlist_t *port_tbl = &p_mgr->port_order_list;
+	cl_list_item_t *item1 = NULL, *item2 = NULL;
+	osm_port_t *src_port = NULL, *dest_port = NULL;
+	osm_node_t *first_sw = NULL, *last_first_sw = NULL;
+	cdg_engine_t engine;
+	uint32_t *channels = NULL, *added = NULL;
+	uint32_t max_channels = dfsssp_ctx->adj_list_size + 1;
+	uint64_t ind1 = 0, ind2 = 0;
+	uint16_t slid = 0, dlid = 0, last_dlid = 0;
+	uint16_t min_lid_ho = 0, max_lid_ho = 0, min_lid_ho2 = 0, max_lid_ho2 = 0;
+	uint8_t ntype = 0, remote_port = 0, vl_avail = 0;
+	uint8_t mark[IB_MAX_NUM_VLS + 1];
+	int32_t num_channels = 0, old_vl = 0, vl = 0, last_vl = -1;
+	boolean_t rerouted = FALSE;
+	int pass = 0, err = 1;
+
+	if (!vltable || !dfsssp_ctx->vl_split_count
+	    || !dfsssp_ctx->vls_deadlock_free)
+		return 1;
+	vl_avail = get_avail_vl_in_subn(p_mgr);
+	if (dfsssp_ctx->max_vls > 0 && vl_avail > dfsssp_ctx->max_vls)
+		vl_avail = dfsssp_ctx->max_vls;
+	if (vl_avail + 1 != num_vls || num_vls > IB_MAX_NUM_VLS + 1)
+		return 1;
 
-	/* test the last avail cdg for a cycle;
-	   if there is one, than vl_needed > vl_avail
-	 */
-	start_here = cdg[vl_avail - 1];
-	/*if (start_here) {
-		cycle =
-		    search_cycle_in_channel_dep_graph(cdg[vl_avail - 1],
-						      start_here);
-		if (cycle) {
-			vl_needed = vl_avail + 1;
+	/* the VLs which held a path towards a rerouted lid */
+	memset(mark, 0, sizeof(mark));
+	for (ind2 = 0; ind2 < vltable->num_lids; ind2++) {
+		dlid = cl_ntoh16(vltable->lids[ind2]);
+		if (dlid > dfsssp_ctx->routed_max_lid || !affected[dlid])
+			continue;
+		for (ind1 = 0; ind1 < vltable->num_srcs; ind1++) {
+			if (!vltable->per_switch && ind1 == ind2)
+				continue;
+			vl = vltable->vls[ind1 + ind2 * vltable->num_srcs];
+			if (vl < num_vls && dfsssp_ctx->vl_split_count[vl])
+				mark[vl] = 1;
 		}
-	}*/
-
-	OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-		"Virtual Lanes needed: %" PRIu8 "\n", vl_needed);
-	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_INFO)) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-			"Paths per VL (before balancing):\n");
-		for (i = 0; i < vl_buffer; i++)
-			OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-				"   %" PRIu32 ". lane: %" PRIu64 "\n", i,
-				paths_per_vl[i]);
 	}
 
-	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
-		"Balancing the paths on the available Virtual Lanes\n");
-
-	/* optimal balancing virtual lanes, under condition: no additional cycle checks;
-	   sl/vl != 0 might be assigned to loopback packets (i.e. slid/dlid on the
-	   same port for lmc>0), but thats no problem, see IBAS 10.2.2.3
-	 */
-	split_count = (uint8_t *) calloc(vl_buffer, sizeof(uint8_t));
-	if (!split_count) {
+	if (cdg_engine_alloc(&engine, dfsssp_ctx->adj_list,
+			     dfsssp_ctx->adj_list_size, num_vls)) {
 		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD24: cannot allocate memory for split_count, skip balancing\n");
-		err = 1;
-		goto ERROR;
+			"ERR AD45: cannot allocate memory for the incremental cdg\n");
+		return 1;
 	}
-	/* initial state: paths for VLs won't be separated */
-	for (i = 0; i < ((vl_needed < vl_avail) ? vl_needed : vl_buffer); i++)
-		split_count[i] = 1;
-	dfsssp_ctx->vl_split_count = split_count;
-	/* balancing is necessary if we have empty VLs */
-	if (vl_needed < vl_avail) {
-		/* split paths of VLs until we find an equal distribution */
-		for (i = vl_needed; i < vl_avail; i++) {
-			/* find VL with most paths in it */
-			vl = 0;
-			most_avg_paths = 0.0;
-			for (test_vl = 0; test_vl < vl_needed; test_vl++) {
-				if (most_avg_paths <
-				    ((double)paths_per_vl[test_vl] /
-				    split_count[test_vl])) {
-					vl = test_vl;
-					most_avg_paths =
-						(double)paths_per_vl[test_vl] /
-						split_count[test_vl];
-				}
-			}
-			split_count[vl]++;
-		}
-		/* change the VL assignment depending on split_count for
-		   all VLs except VL 0
-		 */
-		for (from = vl_needed - 1; from > 0; from--) {
-			/* how much space needed for others? */
-			to = 0;
-			for (i = 0; i < from; i++)
-				to += split_count[i];
-			count = paths_per_vl[from];
-			vltable_change_vl(srcdest2vl_table, from, to, count);
-			/* change also the information within the split_count
-			   array; this is important for fast calculation later
-			 */
-			split_count[to] = split_count[from];
-			split_count[from] = 0;
-			paths_per_vl[to] = paths_per_vl[from];
-			paths_per_vl[from] = 0;
-		}
-	} else if (!dfsssp_ctx->only_best_effort && vl_needed > vl_avail) {
-		/* routing not possible, a further development would be the LASH-TOR approach (update: LASH-TOR isn't possible, there is a mistake in the theory) */
+	channels = (uint32_t *) malloc(max_channels * sizeof(uint32_t));
+	added = (uint32_t *) malloc(max_channels * sizeof(uint32_t));
+	if (!channels || !added) {
 		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-			"ERR AD25: Not enough VLs available (avail=%d, needed=%d); Stopping dfsssp routing!\n",
-			vl_avail, vl_needed);
-		err = 1;
-		goto ERROR;
-	} else if (dfsssp_ctx->only_best_effort && vl_needed > vl_avail) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-			"Not enough VLs available (avail=%d, needed=%d); Best effort deadlock removal only, spreading additional ones across remaining layers\n",
-			vl_avail, vl_needed);
-		from = vl_buffer - 1;
-		bound = paths_per_vl[from];
-		for(i = 0; i <= bound; i++) {
-			to = rand() % vl_avail;	
-			if(vltable_change_vl(srcdest2vl_table, from, to, 1))
-				break;
-			paths_per_vl[from]--;
-			paths_per_vl[to]++;
-		}
+			"ERR AD45: cannot allocate memory for the incremental cdg\n");
+		goto Exit;
 	}
-	/* else { no balancing } */
 
-	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG)) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-			"Virtual Lanes per src/dest combination after balancing:\n");
-		vltable_print(p_mgr, srcdest2vl_table);
-	}
-	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_INFO)) {
-		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-			"Approx. #paths per VL (after balancing):\n");
-		j = 0;
-		count = 1; /* to prevent div. by 0 */
-		for (i = 0; i < vl_buffer; i++) {
-			if (split_count[i] > 0) {
-				j = i;
-				count = split_count[i];
+	/* first add the paths which were kept, then the rerouted ones */
+	for (pass = 0; pass < 2; pass++) {
+		rerouted = (pass == 1);
+		last_first_sw = NULL;
+		for (item1 = cl_qlist_head(port_tbl);
+		     item1 != cl_qlist_end(port_tbl);
+		     item1 = cl_qlist_next(item1)) {
+			dest_port = (osm_port_t *)cl_item_obj(item1, dest_port,
+							      list_item);
+			ntype = osm_node_get_type(dest_port->p_node);
+			if ((ntype != IB_NODE_TYPE_CA
+			    && ntype != IB_NODE_TYPE_SWITCH)
+			    || !(dest_port->p_physp->port_info.capability_mask
+			    & IB_PORT_CAP_HAS_SL_MAP))
+				continue;
+			osm_port_get_lid_range_ho(dest_port, &min_lid_ho2,
+						  &max_lid_ho2);
+
+			for (item2 = cl_qlist_head(port_tbl);
+			     item2 != cl_qlist_end(port_tbl);
+			     item2 = cl_qlist_next(item2)) {
+				src_port = (osm_port_t *)cl_item_obj(item2,
+								     src_port,
+								     list_item);
+				ntype = osm_node_get_type(src_port->p_node);
+				if ((ntype != IB_NODE_TYPE_CA
+				    && ntype != IB_NODE_TYPE_SWITCH)
+				    || !(src_port->p_physp->port_info.
+				    capability_mask & IB_PORT_CAP_HAS_SL_MAP))
+					continue;
+				if (src_port == dest_port)
+					continue;
+				/* see dfsssp_assign_vls_incremental */
+				if (vltable->per_switch
+				    && ntype == IB_NODE_TYPE_SWITCH)
+					continue;
+
+				first_sw =
+				    osm_node_get_remote_node(src_port->p_node,
+							     src_port->p_physp->
+							     port_num,
+							     &remote_port);
+				osm_port_get_lid_range_ho(src_port, &min_lid_ho,
+							  &max_lid_ho);
+				for (dlid = min_lid_ho2; dlid <= max_lid_ho2;
+				     dlid++) {
+					if (rerouted !=
+					    (dlid <= dfsssp_ctx->routed_max_lid
+					     && affected[dlid]))
+						continue;
+					/* ports behind the same switch share
+					   the path towards dlid
+					 */
+					if (!first_sw || first_sw != last_first_sw
+					    || dlid != last_dlid) {
+						num_channels =
+						    cdg_get_path_channels
+						    (&engine, src_port, dlid,
+						     channels, max_channels);
+						if (num_channels < 0) {
+							OSM_LOG(p_mgr->p_log,
+								OSM_LOG_ERROR,
+								"ERR AD18: no valid path to dlid %"
+								PRIu16
+								" in the new LFTs\n",
+								dlid);
+							goto Exit;
+						}
+						last_first_sw = first_sw;
+						last_dlid = dlid;
+						last_vl = -1;
+					}
+					for (slid = min_lid_ho;
+					     slid <= max_lid_ho; slid++) {
+						old_vl = vltable_get_vl(vltable,
+									cl_hton16(slid),
+									cl_hton16(dlid));
+						/* a kept path only matters for
+						   a marked VL, once per VL
+						 */
+						if (!rerouted
+						    && (old_vl < 0
+							|| old_vl >= num_vls
+							|| !mark[old_vl]
+							|| old_vl == last_vl))
+							continue;
+						if (rerouted && last_vl >= 0) {
+							vltable_insert(vltable,
+								       cl_hton16(slid),
+								       cl_hton16(dlid),
+								       (uint8_t) last_vl);
+							continue;
+						}
+						vl = update_vls_add_path(&engine,
+									 channels,
+									 (uint32_t) num_channels,
+									 added, mark,
+									 num_vls, old_vl,
+									 rerouted);
+						if (vl < 0 && rerouted) {
+							vl = update_vls_split_group(dfsssp_ctx,
+										    mark);
+							if (vl >= 0
+							    && cdg_dag_add_path(&engine,
+										(uint32_t) vl,
+										channels,
+										(uint32_t) num_channels,
+										added))
+								vl = -1;
+						}
+						if (vl < 0)
+							goto Exit;
+						last_vl = vl;
+						if (rerouted)
+							vltable_insert(vltable,
+								       cl_hton16(slid),
+								       cl_hton16(dlid),
+								       (uint8_t) vl);
+					}
+				}
 			}
-			OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-				"   %" PRIu32 ". lane: %" PRIu64 "\n", i,
-				paths_per_vl[j] / count);
 		}
 	}
+	err = 0;
 
-	free(paths_per_vl);
-
-	/* deallocate channel dependency graphs */
-	for (i = 0; i < vl_avail; i++)
-		cdg_dealloc(&cdg[i]);
-	free(cdg);
-
-	OSM_LOG_EXIT(p_mgr->p_log);
-	return 0;
-
-ERROR:
-	free(paths_per_vl);
-
-	for (i = 0; i < vl_avail; i++)
-		cdg_dealloc(&cdg[i]);
-	free(cdg);
-
-	vltable_dealloc(&srcdest2vl_table);
-	dfsssp_ctx->srcdest2vl_table = NULL;
-
+Exit:
+	if (err)
+		OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+			"Cannot keep the VLs of the last routing\n");
+	free(channels);
+	free(added);
+	cdg_engine_dealloc(&engine);
 	return err;
 }
 
@@ -2093,6 +3895,7 @@ static int dfsssp_do_dijkstra_routing(void *context)
 	uint16_t lid = 0, min_lid_ho = 0, max_lid_ho = 0;
 	uint8_t lmc = 0;
 	boolean_t cn_nodes_provided = FALSE, io_nodes_provided = FALSE;
+	uint8_t *affected = NULL;
 
 	OSM_LOG_ENTER(p_mgr->p_log);
 	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
@@ -2260,65 +4063,89 @@ static int dfsssp_do_dijkstra_routing(void *context)
 	   in the subnet (to add the routes to base/enhanced SP0)
 	 */
 	qlist = &p_mgr->port_order_list;
-	for (qlist_item = cl_qlist_head(qlist);
-	     qlist_item != cl_qlist_end(qlist);
-	     qlist_item = cl_qlist_next(qlist_item)) {
-		port = (osm_port_t *)cl_item_obj(qlist_item, port, list_item);
-
-		/* calculate shortest path with dijkstra from node to all switches/Hca */
-		if (osm_node_get_type(port->p_node) == IB_NODE_TYPE_CA) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"Processing Hca with GUID 0x%" PRIx64 "\n",
-				cl_ntoh64(osm_node_get_node_guid
-					  (port->p_node)));
-		} else if (osm_node_get_type(port->p_node) == IB_NODE_TYPE_SWITCH) {
-			OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-				"Processing switch with GUID 0x%" PRIx64 "\n",
-				cl_ntoh64(osm_node_get_node_guid
-					  (port->p_node)));
-		} else {
-			/* we don't handle routers, in case they show up */
-			continue;
+	if (dfsssp_ctx->reroute) {
+		affected = (uint8_t *) calloc(dfsssp_ctx->routed_max_lid + 1,
+					      sizeof(uint8_t));
+		if (!affected) {
+			OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+				"ERR AD21: cannot allocate memory for the rerouting\n");
+			goto ERROR;
 		}
+		err = dfsssp_reroute(dfsssp_ctx, &heap, qlist, affected);
+		if (err)
+			goto ERROR;
+	} else if (dfsssp_ctx->num_threads > 1 || dfsssp_ctx->batch_size > 1) {
+		err = dfsssp_parallel_dijkstra(dfsssp_ctx, qlist);
+		if (err)
+			goto ERROR;
+	} else {
+		for (qlist_item = cl_qlist_head(qlist);
+		     qlist_item != cl_qlist_end(qlist);
+		     qlist_item = cl_qlist_next(qlist_item)) {
+			port = (osm_port_t *)cl_item_obj(qlist_item, port, list_item);
 
-		/* distribute the LID range across the ports that can reach those LIDs
-		   to have disjoint paths for one destination port with lmc>0;
-		   for switches with bsp0: min=max; with esp0: max>min if lmc>0
-		 */
-		osm_port_get_lid_range_ho(port, &min_lid_ho,
-					  &max_lid_ho);
-		for (lid = min_lid_ho; lid <= max_lid_ho; lid++) {
-			/* do dijkstra from this Hca/LID/SP0 to each switch */
-			err =
-			    dijkstra(p_mgr, &heap, adj_list, adj_list_size,
-				     port, lid);
-			if (err)
-				goto ERROR;
-			if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
-				print_routes(p_mgr, adj_list, adj_list_size,
-					     port);
+			/* calculate shortest path with dijkstra from node to all switches/Hca */
+			if (osm_node_get_type(port->p_node) == IB_NODE_TYPE_CA) {
+				OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+					"Processing Hca with GUID 0x%" PRIx64 "\n",
+					cl_ntoh64(osm_node_get_node_guid
+						  (port->p_node)));
+			} else if (osm_node_get_type(port->p_node) == IB_NODE_TYPE_SWITCH) {
+				OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+					"Processing switch with GUID 0x%" PRIx64 "\n",
+					cl_ntoh64(osm_node_get_node_guid
+						  (port->p_node)));
+			} else {
+				/* we don't handle routers, in case they show up */
+				continue;
+			}
 
-			/* make an update for the linear forwarding tables of the switches */
-			err =
-			    update_lft(p_mgr, adj_list, adj_list_size, port, lid);
-			if (err)
-				goto ERROR;
+			/* distribute the LID range across the ports that can reach those LIDs
+			   to have disjoint paths for one destination port with lmc>0;
+			   for switches with bsp0: min=max; with esp0: max>min if lmc>0
+			 */
+			osm_port_get_lid_range_ho(port, &min_lid_ho,
+						  &max_lid_ho);
+			for (lid = min_lid_ho; lid <= max_lid_ho; lid++) {
+				/* do dijkstra from this Hca/LID/SP0 to each switch */
+				err =
+				    dijkstra(p_mgr, &heap, adj_list, adj_list_size,
+					     port, lid);
+				if (err)
+					goto ERROR;
+				if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
+					print_routes(p_mgr, adj_list, adj_list_size,
+						     port);
+
+				/* make an update for the linear forwarding tables of the switches */
+				err =
+				    update_lft(p_mgr, adj_list, adj_list_size, port, lid);
+				if (err)
+					goto ERROR;
 
-			/* add weights for calculated routes to adjust the weights for the next cycle */
-			update_weights(p_mgr, adj_list, adj_list_size);
+				/* add weights for calculated routes to adjust the weights for the next cycle */
+				update_weights(p_mgr, adj_list, adj_list_size);
 
-			if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
-				print_graph(p_mgr, adj_list,
-						   adj_list_size);
+				if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
+					print_graph(p_mgr, adj_list,
+							   adj_list_size);
+			}
 		}
 	}
 
 	/* try deadlock removal only for the dfsssp routing (not for the sssp case, which is a subset of the dfsssp algorithm) */
 	if (dfsssp_ctx->routing_type == OSM_ROUTING_ENGINE_TYPE_DFSSSP) {
-		/* remove potential deadlocks by assigning different virtual lanes to src/dest paths and balance the lanes */
-		err = dfsssp_remove_deadlocks(dfsssp_ctx);
-		if (err)
-			goto ERROR;
+		/* keep the VLs of the paths which weren't rerouted, if the VLs
+		   of the rerouted ones stay acyclic
+		 */
+		if (!dfsssp_ctx->reroute
+		    || dfsssp_update_vls(dfsssp_ctx, affected)) {
+			dfsssp_drop_vls(dfsssp_ctx);
+			/* remove potential deadlocks by assigning different virtual lanes to src/dest paths and balance the lanes */
+			err = dfsssp_remove_deadlocks(dfsssp_ctx);
+			if (err)
+				goto ERROR;
+		}
 	} else if (dfsssp_ctx->routing_type == OSM_ROUTING_ENGINE_TYPE_SSSP) {
 		OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
 			"SSSP routing specified -> skipping deadlock removal thru dfsssp_remove_deadlocks(...)\n");
@@ -2334,6 +4161,12 @@ static int dfsssp_do_dijkstra_routing(void *context)
 	/* delete the heap which is not needed anymore */
 	cl_heap_destroy(&heap);
 
+	/* keep this routing to reroute only affected lids the next time */
+	free(affected);
+	dfsssp_reroute_done(dfsssp_ctx);
+	if (dfsssp_ctx->incremental_reroute)
+		dfsssp_save_routing(dfsssp_ctx);
+
 	/* print the new_lft for each switch after routing is done */
 	if (OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG)) {
 		for (item = cl_qmap_head(sw_tbl); item != cl_qmap_end(sw_tbl);
@@ -2368,6 +4201,9 @@ ERROR:
 		free(sw_list);
 	if (cl_is_heap_inited(&heap))
 		cl_heap_destroy(&heap);
+	free(affected);
+	free_routed_lfts(dfsssp_ctx);
+	dfsssp_reroute_done(dfsssp_ctx);
 	return -1;
 }
 
@@ -2592,6 +4428,29 @@ static dfsssp_context_t *dfsssp_context_create(osm_opensm_t * p_osm,
 		dfsssp_ctx->vl_split_count = NULL;
                 dfsssp_ctx->max_vls = dfsssp_ctx->p_mgr->p_subn->opt.dfsssp_max_vls;
         dfsssp_ctx->only_best_effort = dfsssp_ctx->p_mgr->p_subn->opt.dfsssp_best_effort;
+		dfsssp_ctx->vltable_per_switch =
+		    dfsssp_ctx->p_mgr->p_subn->opt.dfsssp_vltable_per_switch;
+		dfsssp_ctx->num_threads =
+		    dfsssp_ctx->p_mgr->p_subn->opt.dfsssp_num_threads;
+		if (!dfsssp_ctx->num_threads)
+			dfsssp_ctx->num_threads = cl_proc_count();
+		dfsssp_ctx->batch_size =
+		    dfsssp_ctx->p_mgr->p_subn->opt.dfsssp_batch_size;
+		dfsssp_ctx->incremental_cdg =
+		    dfsssp_ctx->p_mgr->p_subn->opt.dfsssp_incremental_cdg;
+		dfsssp_ctx->incremental_reroute =
+		    dfsssp_ctx->p_mgr->p_subn->opt.dfsssp_incremental_reroute;
+		dfsssp_ctx->vls_deadlock_free = FALSE;
+		dfsssp_ctx->vl_split_size = 0;
+		dfsssp_ctx->routed_max_lid = 0;
+		dfsssp_ctx->routed_num_sw = 0;
+		dfsssp_ctx->routed_lft = NULL;
+		dfsssp_ctx->routed_lids = NULL;
+		dfsssp_ctx->peer_offset = NULL;
+		dfsssp_ctx->peer = NULL;
+		dfsssp_ctx->changes = NULL;
+		dfsssp_ctx->num_changes = 0;
+		dfsssp_ctx->reroute = FALSE;
 	} else {
 		OSM_LOG(p_osm->sm.ucast_mgr.p_log, OSM_LOG_ERROR,
 			"ERR AD04: cannot allocate memory for dfsssp_ctx in dfsssp_context_create\n");
@@ -2604,34 +4463,17 @@ static dfsssp_context_t *dfsssp_context_create(osm_opensm_t * p_osm,
 static void dfsssp_context_destroy(void *context)
 {
 	dfsssp_context_t *dfsssp_ctx = (dfsssp_context_t *) context;
-	vertex_t *adj_list = (vertex_t *) (dfsssp_ctx->adj_list);
-	uint32_t i = 0;
-	link_t *link = NULL, *tmp = NULL;
 
 	/* free adj_list */
-	for (i = 0; i < dfsssp_ctx->adj_list_size; i++) {
-		link = adj_list[i].links;
-		while (link) {
-			tmp = link;
-			link = link->next;
-			free(tmp);
-		}
-	}
-	free(adj_list);
+	free_adj_list(dfsssp_ctx->adj_list, dfsssp_ctx->adj_list_size);
 	dfsssp_ctx->adj_list = NULL;
 	dfsssp_ctx->adj_list_size = 0;
 
 	/* free srcdest2vl table and the split count information table
 	   (can be done, because dfsssp_context_destroy is called after
-	    osm_get_dfsssp_sl)
+	    osm_get_dfsssp_sl), and the kept LFTs of the last routing
 	 */
-	vltable_dealloc(&(dfsssp_ctx->srcdest2vl_table));
-	dfsssp_ctx->srcdest2vl_table = NULL;
-
-	if (dfsssp_ctx->vl_split_count) {
-		free(dfsssp_ctx->vl_split_count);
-		dfsssp_ctx->vl_split_count = NULL;
-	}
+	dfsssp_drop_routing(dfsssp_ctx);
 }
 
 static void delete(void *context)
@@ -38,6 +38,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <complib/cl_heap.h>
+#include <complib/cl_thread.h>
 
 #include <opensm/osm_file_ids.h>
 #define FILE_ID OSM_FILE_UCAST_LNMP_C
@@ -54,6 +55,10 @@
 #define max(x,y) ((x) >= (y)) ? (x) : (y)
 #define min(x,y) ((x) <= (y)) ? (x) : (y)
 
+/* number of switch/endnode pairs each worker searches speculatively
+   before the results of a batch are committed in pair order */
+#define LNMP_PAIRS_PER_WORKER 64
+
 typedef struct layer_entry {
     uint8_t port;
     uint8_t hops; // number of hops to destination switch
@@ -101,6 +106,25 @@ typedef struct lnmp_context {
     uint8_t max_length;
     layer_t *layers;
     boolean_t apply_dfsssp;
+    uint8_t num_threads;
+    /* links of all switches in compressed sparse row form, in the order of
+       their link lists: the links of switch i are link_offset[i] to
+       link_offset[i+1]-1; parallel links share one edge, which indexes the
+       layer weights */
+    uint32_t *link_offset;
+    uint32_t *link_to;
+    uint32_t *link_edge;
+    uint32_t number_of_edges;
+    /* SL answered by path_sl for each (ingress switch, dlid), stored as
+       sl_cache[dlid * sl_cache_size + switch index]; it survives re-routing,
+       sl_cache_lft and sl_cache_colors hold the LFTs and colors it was
+       computed from, so only destinations with changed routes are updated */
+    uint8_t *sl_cache;
+    uint8_t *sl_cache_lft;
+    uint8_t *sl_cache_colors;
+    uint64_t *sl_cache_guids;
+    uint32_t sl_cache_size;
+    uint16_t sl_cache_max_lid;
 } lnmp_context_t;
 
 typedef struct node {
@@ -115,6 +139,46 @@ typedef struct sd_pair {
     uint16_t priority_level;
 } sd_pair_t;
 
+/*
+ * label of the hop-bounded path search: best walk from the source which
+ * reaches a switch after exactly hops hops
+ */
+typedef struct path_label {
+    uint64_t weight; // weight of the walk
+    uint32_t parent; // switch reached after hops-1 hops on the walk
+    uint32_t stamp; // the label is only valid if it equals the stamp of the current search
+    uint16_t link_pos; // position of the link from parent in its link list, orders the walks like the enumeration does
+} path_label_t;
+
+typedef struct path_search {
+    uint32_t adj_list_size;
+    uint8_t max_hops;
+    path_label_t *labels; // indexed by hops * adj_list_size + switch
+    uint32_t *reached; // switches labeled after hops hops, adj_list_size entries per hops
+    uint32_t *number_reached; // indexed by hops
+    uint32_t stamp;
+} path_search_t;
+
+/* result of a speculative path search for one switch/endnode pair */
+typedef struct path_candidate {
+    uint32_t *path; // best path found on the snapshot, NULL if there is none
+    uint64_t weight; // weight of this path on the snapshot
+} path_candidate_t;
+
+typedef struct path_worker {
+    cl_thread_t thread;
+    path_search_t search;
+    lnmp_context_t *lnmp_context;
+    layer_t *layer;
+    uint32_t *weights;
+    uint64_t *pairs; // first pair of the current batch
+    path_candidate_t *candidates; // one candidate per pair of the batch
+    uint32_t number_of_pairs;
+    uint32_t offset; // pairs offset, offset + stride, ... belong to this worker
+    uint32_t stride;
+    int err;
+} path_worker_t;
+
 /*
  * ---------------------------------------------------
  * AVL Tree Implementation
@@ -276,10 +340,14 @@ static void add_from_offset(node_t *root, uint32_t *index, uint64_t *array, bool
 /**********************************************************************
  **********************************************************************/
 
-void print_weights(osm_ucast_mgr_t *p_mgr, vertex_t *adj_list, uint32_t **weights, uint32_t adj_list_size)
+void print_weights(lnmp_context_t *lnmp_context, osm_ucast_mgr_t *p_mgr, uint32_t *weights)
 {
-    uint32_t i = 0, j = 0;
-    for(i = 1; i < adj_list_size; i++) {
+    vertex_t *adj_list = lnmp_context->adj_list;
+    uint32_t i = 0, k = 0;
+
+    if (!OSM_LOG_IS_ACTIVE_V2(p_mgr->p_log, OSM_LOG_DEBUG))
+        return;
+    for(i = 1; i < lnmp_context->adj_list_size; i++) {
 		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG, "adj_list[%" PRIu32 "]:\n",
 			i);
 		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
@@ -289,13 +357,94 @@ void print_weights(osm_ucast_mgr_t *p_mgr, vertex_t *adj_list, uint32_t **weight
 		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
 			"   num_hca = %" PRIu32 "\n", adj_list[i].num_hca);
         OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
-                "Weights to reach these switches:\n");
-        for(j = 1; j < adj_list_size; j++) {
+                "Weights to reach the neighbor switches:\n");
+        for(k = lnmp_context->link_offset[i]; k < lnmp_context->link_offset[i+1]; k++) {
             OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
                     "    lid: %" PRIu16 " weight: %" PRIu32 "\n",
-                    adj_list[j].lid, weights[i-1][j-1]);
+                    adj_list[lnmp_context->link_to[k]].lid, weights[lnmp_context->link_edge[k]]);
+        }
+    }
+}
+
+/*
+ * Returns the edge between two adjacent switches, which indexes the layer weights
+ */
+static inline uint32_t get_edge(lnmp_context_t *lnmp_context, uint32_t src_sw_index, uint32_t dst_sw_index)
+{
+    uint32_t k = 0;
+
+    for(k = lnmp_context->link_offset[src_sw_index]; k < lnmp_context->link_offset[src_sw_index+1]; k++) {
+        if(lnmp_context->link_to[k] == dst_sw_index)
+            return lnmp_context->link_edge[k];
+    }
+    return lnmp_context->number_of_edges;
+}
+
+static void free_link_index(lnmp_context_t *lnmp_context)
+{
+    free(lnmp_context->link_offset);
+    free(lnmp_context->link_to);
+    free(lnmp_context->link_edge);
+    lnmp_context->link_offset = NULL;
+    lnmp_context->link_to = NULL;
+    lnmp_context->link_edge = NULL;
+    lnmp_context->number_of_edges = 0;
+}
+
+static void free_sl_cache(lnmp_context_t *lnmp_context)
+{
+    free(lnmp_context->sl_cache);
+    free(lnmp_context->sl_cache_lft);
+    free(lnmp_context->sl_cache_colors);
+    free(lnmp_context->sl_cache_guids);
+    lnmp_context->sl_cache = NULL;
+    lnmp_context->sl_cache_lft = NULL;
+    lnmp_context->sl_cache_colors = NULL;
+    lnmp_context->sl_cache_guids = NULL;
+    lnmp_context->sl_cache_size = 0;
+    lnmp_context->sl_cache_max_lid = 0;
+}
+
+/*
+ * Builds the compressed sparse row form of the links in adj_list, parallel
+ * links between two switches get the same edge
+ */
+static int build_link_index(lnmp_context_t *lnmp_context)
+{
+    vertex_t *adj_list = lnmp_context->adj_list;
+    uint32_t adj_list_size = lnmp_context->adj_list_size;
+    uint32_t number_of_links = 0, i = 0, k = 0, l = 0;
+    link_t *link = NULL;
+
+    for(i = 1; i < adj_list_size; i++) {
+        for(link = adj_list[i].links; link != NULL; link = link->next)
+            number_of_links++;
+    }
+
+    lnmp_context->link_offset = (uint32_t *) malloc((adj_list_size + 1) * sizeof(uint32_t));
+    lnmp_context->link_to = (uint32_t *) malloc((number_of_links + 1) * sizeof(uint32_t));
+    lnmp_context->link_edge = (uint32_t *) malloc((number_of_links + 1) * sizeof(uint32_t));
+    if(!lnmp_context->link_offset || !lnmp_context->link_to || !lnmp_context->link_edge) {
+        free_link_index(lnmp_context);
+        return -1;
+    }
+
+    lnmp_context->number_of_edges = 0;
+    lnmp_context->link_offset[0] = 0;
+    lnmp_context->link_offset[1] = 0;
+    for(i = 1; i < adj_list_size; i++) {
+        k = lnmp_context->link_offset[i];
+        for(link = adj_list[i].links; link != NULL; link = link->next, k++) {
+            lnmp_context->link_to[k] = link->to;
+            for(l = lnmp_context->link_offset[i]; l < k; l++) {
+                if(lnmp_context->link_to[l] == link->to)
+                    break;
+            }
+            lnmp_context->link_edge[k] = (l < k) ? lnmp_context->link_edge[l] : lnmp_context->number_of_edges++;
         }
+        lnmp_context->link_offset[i+1] = k;
     }
+    return 0;
 }
 
 static link_t *get_link(lnmp_context_t *lnmp_context, layer_t *layer, vertex_t *adj_list, uint32_t src_sw_index, uint32_t dst_sw_index, uint32_t dst_lid)
@@ -405,7 +554,22 @@ static lnmp_context_t *lnmp_context_create(osm_opensm_t *p_osm, osm_routing_engi
         lnmp_context->min_length = lnmp_context->p_mgr->p_subn->opt.lnmp_min_path_len;
         lnmp_context->max_length = lnmp_context->p_mgr->p_subn->opt.lnmp_max_path_len;
         lnmp_context->apply_dfsssp = lnmp_context->p_mgr->p_subn->opt.layers_remove_deadlocks;
+        lnmp_context->num_threads = lnmp_context->p_mgr->p_subn->opt.lnmp_num_threads;
+        if (!lnmp_context->num_threads) {
+            int procs = cl_proc_count();
+            lnmp_context->num_threads = (procs > 255) ? 255 : (uint8_t) procs;
+        }
         lnmp_context->layers = NULL;
+        lnmp_context->link_offset = NULL;
+        lnmp_context->link_to = NULL;
+        lnmp_context->link_edge = NULL;
+        lnmp_context->number_of_edges = 0;
+        lnmp_context->sl_cache = NULL;
+        lnmp_context->sl_cache_lft = NULL;
+        lnmp_context->sl_cache_colors = NULL;
+        lnmp_context->sl_cache_guids = NULL;
+        lnmp_context->sl_cache_size = 0;
+        lnmp_context->sl_cache_max_lid = 0;
     } else {
         OSM_LOG(p_osm->sm.ucast_mgr.p_log, OSM_LOG_ERROR,
                 "ERR AD04: cannot allocate memory for lnmp_context in lnmp_context_create\n");
@@ -452,6 +616,7 @@ static void lnmp_context_destroy(void *context)
     vertex_t *adj_list = (vertex_t *) (lnmp_context->adj_list);
     uint32_t j = 0;
     free_adj_list(&adj_list, lnmp_context->adj_list_size);
+    free_link_index(lnmp_context);
     layer_t *layer = NULL;
     lnmp_context->adj_list = NULL;
     if (lnmp_context->layers) {
@@ -492,6 +657,7 @@ static void delete(void *context)
     if(!context)
         return;
     lnmp_context_destroy(context);
+    free_sl_cache((lnmp_context_t *) context);
 
     free(context);
 }
@@ -942,6 +1108,12 @@ static int lnmp_build_graph(void *context)
             link = link->next;
         }
     }
+    if(build_link_index(lnmp_context)) {
+        OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+                "ERR AD02: cannot allocate memory for the link index\n");
+        goto ERROR;
+    }
+
     /* assign colors to every switch using the adj_list */
     uint8_t colors[13]; // only 0 -> 12 as we will shift this by 2 with the SL mapping (SL 0, 1 and 15 reserved)
 
@@ -1195,19 +1367,19 @@ static void copy_path(uint32_t *src_path, uint32_t *dest_path, uint8_t length)
     }
 }
 
-static uint64_t get_path_weight(uint32_t *path, uint8_t path_length, uint32_t **weights)
+static uint64_t get_path_weight(lnmp_context_t *lnmp_context, uint32_t *path, uint8_t path_length, uint32_t *weights)
 {
     uint64_t weight = 0;
     uint8_t i = 0;
     for(i = 0; i < path_length -1; i++) {
         if(!path[i+1])
             break;
-        weight += weights[path[i]-1][path[i+1]-1];
+        weight += weights[get_edge(lnmp_context, path[i], path[i+1])];
     }
     return weight;
 }
 
-static void update_layer_weights(lnmp_context_t *lnmp_context, layer_t *layer, vertex_t *adj_list, uint32_t *path, uint32_t dst_lid, uint32_t **weights, uint8_t path_length)
+static void update_layer_weights(lnmp_context_t *lnmp_context, layer_t *layer, vertex_t *adj_list, uint32_t *path, uint32_t dst_lid, uint32_t *weights, uint8_t path_length)
 {
     uint8_t i = 0, j = 0;
     uint32_t last = 0, additional_weight = 0;
@@ -1218,15 +1390,39 @@ static void update_layer_weights(lnmp_context_t *lnmp_context, layer_t *layer, v
     for(j = 0; j < i; j++) {
         if(!get_link(lnmp_context, layer, adj_list, path[j], last, dst_lid))
             additional_weight += adj_list[path[j]].num_hca;
-        weights[path[j]-1][path[j+1]-1] += additional_weight;
+        weights[get_edge(lnmp_context, path[j], path[j+1])] += additional_weight;
     }
 }
         
 /*
- * *best_path should point to NULL
- * src is the lid of a switch and dst is the lid of either an endnode or a switch
+ * Returns the index in adj_list of the switch behind dst_lid,
+ * zero if there is none
  */
-static int find_path(layer_t *layer, lnmp_context_t *lnmp_context, uint32_t **weights, uint32_t **best_path, uint32_t src_lid, uint32_t dst_lid)
+static uint32_t get_dst_switch(lnmp_context_t *lnmp_context, uint32_t dst_lid)
+{
+    port_index_t *lid_port_map = lnmp_context->lid_port_map; 
+    uint32_t dst_switch = lid_port_map[dst_lid].switch_index;
+    osm_node_t *remote_node = NULL;
+    osm_port_t *port = lid_port_map[dst_lid].port;
+    uint8_t remote_port = 0;
+
+    if (!dst_switch && osm_node_get_type(port->p_node) == IB_NODE_TYPE_CA) {
+        if(port->p_physp && osm_link_is_healthy(port->p_physp)) {
+            remote_node = osm_node_get_remote_node(port->p_node, port->p_physp->port_num, &remote_port);
+            if (remote_node && (osm_node_get_type(remote_node) == IB_NODE_TYPE_SWITCH)) {
+                dst_switch = lid_port_map[get_lid(remote_node)].switch_index;
+            }
+        }
+    }
+    return dst_switch;
+}
+
+/*
+ * Enumerates every simple path from src_switch to dst_switch in breadth-first
+ * order and keeps the first one of minimal weight;
+ * only used by find_path if the best walk found by the label search is not simple
+ */
+static int enumerate_paths(layer_t *layer, lnmp_context_t *lnmp_context, uint32_t *weights, uint32_t **best_path, uint64_t *best_weight, uint32_t src_switch, uint32_t dst_switch, uint32_t dst_lid)
 {
     cl_list_t paths;
     // We always initialize paths of max length and try to reuse paths in order to reduce the number of callocs
@@ -1240,32 +1436,15 @@ static int find_path(layer_t *layer, lnmp_context_t *lnmp_context, uint32_t **we
     uint32_t *current_path, *temp_path;
     uint32_t last = 0;
     link_t * forced_next = NULL;
-    uint8_t i = 0, remote_port = 0;
+    uint8_t i = 0;
     vertex_t *current;
     link_t *link;
     clean_path(*best_path, max_path_length); 
-    port_index_t *lid_port_map = lnmp_context->lid_port_map; 
-    osm_node_t *remote_node = NULL;
-    osm_port_t *port = NULL;
 
     allocate_new_path(&current_path, max_path_length);
     if(!current_path)
         goto ERROR;
 
-    uint32_t src_switch = lid_port_map[src_lid].switch_index;
-    uint32_t dst_switch = lid_port_map[dst_lid].switch_index;
-    port = lid_port_map[dst_lid].port;
-    if (!dst_switch && osm_node_get_type(port->p_node) == IB_NODE_TYPE_CA) {
-        if(port->p_physp && osm_link_is_healthy(port->p_physp)) {
-            remote_node = osm_node_get_remote_node(port->p_node, port->p_physp->port_num, &remote_port);
-            if (remote_node && (osm_node_get_type(remote_node) == IB_NODE_TYPE_SWITCH)) {
-                dst_switch = lid_port_map[get_lid(remote_node)].switch_index;
-            }
-        }
-    }
-    if (!dst_switch || !src_switch)
-        goto ERROR;
-
     current_path[0] = src_switch;
     if(cl_list_insert_tail(&paths, current_path) != CL_SUCCESS)
         goto ERROR;
@@ -1276,7 +1455,7 @@ static int find_path(layer_t *layer, lnmp_context_t *lnmp_context, uint32_t **we
                 break;
         }
 
-        current_path_weight = get_path_weight(current_path, max_path_length, weights);
+        current_path_weight = get_path_weight(lnmp_context, current_path, max_path_length, weights);
         if(last == dst_switch) {
             if(i+1 >= min_path_length && current_path_weight < best_path_weight) {
                 best_path_weight = current_path_weight;
@@ -1297,7 +1476,7 @@ static int find_path(layer_t *layer, lnmp_context_t *lnmp_context, uint32_t **we
                 forced_next = get_link(lnmp_context, layer, lnmp_context->adj_list, last, dst_switch, dst_lid);
 
                 for(link = (forced_next) ? forced_next : current->links; link != NULL; link = link->next) {
-                    if(!path_contains(current_path, max_path_length, link->to) && current_path_weight + weights[last - 1][link->to - 1] < best_path_weight) {
+                    if(!path_contains(current_path, max_path_length, link->to) && current_path_weight + weights[get_edge(lnmp_context, last, link->to)] < best_path_weight) {
                         temp_path = (uint32_t *) cl_list_remove_head(&path_pool);
                         if(!temp_path)
                             allocate_new_path(&temp_path, max_path_length);
@@ -1320,9 +1499,7 @@ static int find_path(layer_t *layer, lnmp_context_t *lnmp_context, uint32_t **we
         }
     }
     
-    /* TODO review if not updating the weights for switch to switch paths makes sense */
-    if(*best_path && (*best_path)[0] && dst_lid != lnmp_context->adj_list[dst_switch].lid)
-        update_layer_weights(lnmp_context, layer, lnmp_context->adj_list, *best_path, dst_lid, weights, max_path_length);
+    *best_weight = best_path_weight;
 
     /* At this point current_path is equal to NULL and paths is empty, so only need to drain path_pool */
     while((current_path = (uint32_t *) cl_list_remove_head(&path_pool))) {
@@ -1342,17 +1519,331 @@ ERROR:
     return -1;
 }
 
-static void increase_link_weights(lnmp_context_t *lnmp_context, uint32_t **weights) 
+static void path_search_destroy(path_search_t *search)
+{
+    free(search->labels);
+    free(search->reached);
+    free(search->number_reached);
+    search->labels = NULL;
+    search->reached = NULL;
+    search->number_reached = NULL;
+}
+
+static int path_search_init(path_search_t *search, lnmp_context_t *lnmp_context)
+{
+    size_t number_of_labels = (size_t) (lnmp_context->max_length + 1) * lnmp_context->adj_list_size;
+
+    search->adj_list_size = lnmp_context->adj_list_size;
+    search->max_hops = lnmp_context->max_length;
+    search->stamp = 0;
+    search->labels = (path_label_t *) calloc(number_of_labels, sizeof(path_label_t));
+    search->reached = (uint32_t *) malloc(number_of_labels * sizeof(uint32_t));
+    search->number_reached = (uint32_t *) calloc(search->max_hops + 1, sizeof(uint32_t));
+    if(!search->labels || !search->reached || !search->number_reached) {
+        path_search_destroy(search);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * TRUE if the walk reaching a switch after hops hops through (parent_a, pos_a)
+ * comes before the one through (parent_b, pos_b) in breadth-first order, i.e.
+ * its sequence of link positions is lexicographically smaller; walks back until
+ * both share the same prefix, the difference closest to the source decides
+ */
+static boolean_t walk_precedes(path_search_t *search, uint8_t hops, uint32_t parent_a, uint16_t pos_a, uint32_t parent_b, uint16_t pos_b)
+{
+    path_label_t *label_a = NULL, *label_b = NULL;
+    int cmp = (pos_a < pos_b) ? -1 : ((pos_a > pos_b) ? 1 : 0);
+
+    while(hops > 1 && parent_a != parent_b) {
+        hops--;
+        label_a = &search->labels[hops * search->adj_list_size + parent_a];
+        label_b = &search->labels[hops * search->adj_list_size + parent_b];
+        if(label_a->link_pos != label_b->link_pos)
+            cmp = (label_a->link_pos < label_b->link_pos) ? -1 : 1;
+        parent_a = label_a->parent;
+        parent_b = label_b->parent;
+    }
+    return cmp < 0;
+}
+
+/*
+ * Hop-bounded shortest walk search with the semantics of enumerate_paths:
+ * walks follow forced next hops of the layer, end at the first visit of
+ * dst_switch and have between min_length and max_length hops; the lightest
+ * walk wins, ties go to the shorter and then to the earlier walk in
+ * breadth-first order. Labels are indexed by (hops, switch), so only the best
+ * walk per state is kept and the weight is carried along incrementally;
+ * labels which cannot beat the best walk found so far are pruned.
+ * Returns TRUE if a walk was found, it can be read backwards from the labels.
+ */
+static boolean_t search_best_walk(path_search_t *search, layer_t *layer, lnmp_context_t *lnmp_context, uint32_t *weights, uint32_t src_switch, uint32_t dst_switch, uint32_t dst_lid, uint8_t *best_hops, uint64_t *best_weight)
+{
+    vertex_t *adj_list = lnmp_context->adj_list;
+    uint32_t adj_list_size = search->adj_list_size;
+    uint8_t max_hops = lnmp_context->max_length;
+    uint8_t min_hops = lnmp_context->min_length;
+    path_label_t *labels = search->labels, *label = NULL;
+    uint32_t *reached = NULL, *next_reached = NULL;
+    uint64_t weight = 0, current_weight = 0;
+    uint32_t i = 0, current = 0;
+    link_t *link = NULL, *forced_next = NULL;
+    uint16_t pos = 0;
+    uint8_t hops = 0;
+    boolean_t found = FALSE;
+
+    if(++search->stamp == 0) {
+        for(i = 0; i < (uint32_t) (max_hops + 1) * adj_list_size; i++)
+            labels[i].stamp = 0;
+        search->stamp = 1;
+    }
+    *best_weight = 0xffffffff;
+
+    label = &labels[src_switch];
+    label->weight = 0;
+    label->parent = 0;
+    label->link_pos = 0;
+    label->stamp = search->stamp;
+    search->reached[0] = src_switch;
+    search->number_reached[0] = 1;
+
+    /* a walk is never continued after reaching the destination switch */
+    if(src_switch == dst_switch) {
+        if(min_hops == 0) {
+            *best_weight = 0;
+            *best_hops = 0;
+            found = TRUE;
+        }
+        return found;
+    }
+
+    for(hops = 1; hops <= max_hops; hops++) {
+        reached = &search->reached[(hops - 1) * adj_list_size];
+        next_reached = &search->reached[hops * adj_list_size];
+        search->number_reached[hops] = 0;
+        for(i = 0; i < search->number_reached[hops - 1]; i++) {
+            current = reached[i];
+            if(current == dst_switch)
+                continue;
+            current_weight = labels[(hops - 1) * adj_list_size + current].weight;
+            if(current_weight >= *best_weight)
+                continue;
+            forced_next = get_link(lnmp_context, layer, adj_list, current, dst_switch, dst_lid);
+            for(link = adj_list[current].links, pos = 0; link != NULL; link = link->next, pos++) {
+                if(forced_next && link != forced_next)
+                    continue;
+                /* the last hop has to reach the destination and the destination must not be reached too early */
+                if((hops == max_hops && link->to != dst_switch) || (hops < min_hops && link->to == dst_switch))
+                    continue;
+                weight = current_weight + weights[lnmp_context->link_edge[lnmp_context->link_offset[current] + pos]];
+                if(weight >= *best_weight)
+                    continue;
+                label = &labels[hops * adj_list_size + link->to];
+                if(label->stamp != search->stamp) {
+                    label->stamp = search->stamp;
+                    next_reached[search->number_reached[hops]++] = link->to;
+                } else if(weight > label->weight || (weight == label->weight &&
+                        !walk_precedes(search, hops, current, pos, label->parent, label->link_pos))) {
+                    continue;
+                }
+                label->weight = weight;
+                label->parent = current;
+                label->link_pos = pos;
+            }
+        }
+        label = &labels[hops * adj_list_size + dst_switch];
+        if(label->stamp == search->stamp && label->weight < *best_weight) {
+            *best_weight = label->weight;
+            *best_hops = hops;
+            found = TRUE;
+        }
+    }
+    return found;
+}
+
+/*
+ * *best_path should point to NULL
+ * src is the lid of a switch and dst is the lid of either an endnode or a switch
+ * only reads layer and weights, so it can run concurrently on a snapshot of them;
+ * the weight of the best path is returned in *best_weight
+ */
+static int find_path(path_search_t *search, layer_t *layer, lnmp_context_t *lnmp_context, uint32_t *weights, uint32_t **best_path, uint64_t *best_weight, uint32_t src_lid, uint32_t dst_lid)
+{
+    uint8_t max_path_length = lnmp_context->max_length +1;
+    uint32_t src_switch = lnmp_context->lid_port_map[src_lid].switch_index;
+    uint32_t dst_switch = get_dst_switch(lnmp_context, dst_lid);
+    uint32_t *path = NULL;
+    uint32_t sw = 0;
+    uint8_t hops = 0, i = 0, j = 0;
+
+    if (!dst_switch || !src_switch)
+        return -1;
+
+    if(!search_best_walk(search, layer, lnmp_context, weights, src_switch, dst_switch, dst_lid, &hops, best_weight))
+        return 0;
+
+    allocate_new_path(&path, max_path_length);
+    if(!path)
+        return -1;
+    sw = dst_switch;
+    for(i = hops; i > 0; i--) {
+        path[i] = sw;
+        sw = search->labels[i * search->adj_list_size + sw].parent;
+    }
+    path[0] = sw;
+
+    /* the best walk may only visit a switch twice if it has to make a detour
+     * to reach the minimum length; then the simple paths are enumerated */
+    for(i = 0; i < hops; i++) {
+        for(j = i + 1; j <= hops; j++) {
+            if(path[i] == path[j]) {
+                free_path(&path);
+                return enumerate_paths(layer, lnmp_context, weights, best_path, best_weight, src_switch, dst_switch, dst_lid);
+            }
+        }
+    }
+    *best_path = path;
+    return 0;
+}
+
+/*
+ * A path found on an older snapshot of the layer and the weights is still the
+ * path find_path returns now, if its weight is unchanged and no entry added
+ * since then forces another next hop on it: while a layer is generated weights
+ * only grow and entries are only added, so every other path got heavier or
+ * unusable, and ties are still broken in the same search order.
+ */
+static boolean_t candidate_is_valid(lnmp_context_t *lnmp_context, layer_t *layer, uint32_t *weights, path_candidate_t *candidate, uint32_t dst_lid)
+{
+    uint8_t max_path_length = lnmp_context->max_length +1;
+    uint32_t *path = candidate->path;
+    link_t *link = NULL;
+    uint8_t i = 0;
+
+    if(!path)
+        return TRUE;
+    if(get_path_weight(lnmp_context, path, max_path_length, weights) != candidate->weight)
+        return FALSE;
+    for(i = 0; i < max_path_length - 1 && path[i+1]; i++) {
+        link = get_link(lnmp_context, layer, lnmp_context->adj_list, path[i], 0, dst_lid);
+        if(link && link->to != path[i+1])
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Add the path found for pair to the layer: update the weights, lower the
+ * priority of the pairs which got a non-minimal path and fix the forwarding
+ * entries along the path
+ */
+static void commit_path(lnmp_context_t *lnmp_context, layer_t *layer, node_t **sdp_priority_queue, uint32_t *weights, uint32_t *path, uint64_t pair, uint64_t *path_length_distribution)
+{
+    vertex_t *adj_list = lnmp_context->adj_list;
+    uint8_t number_of_levels = lnmp_context->number_of_layers +1;
+    uint8_t max_path_length = lnmp_context->max_length +1;
+    uint8_t min_path_length = lnmp_context->min_length +1;
+    uint32_t dst_lid = (uint32_t) (pair & 0xffffffff);
+    link_t *link = NULL;
+    uint8_t i = 0, last = 0;
+
+    for(i = max_path_length - 1; i >= 0; i--) {
+        if(path[i])
+            break;
+    }
+    last = i;
+
+    /* TODO review if not updating the weights for switch to switch paths makes sense */
+    if(dst_lid != adj_list[path[last]].lid)
+        update_layer_weights(lnmp_context, layer, adj_list, path, dst_lid, weights, max_path_length);
+
+    path_length_distribution[last]++;
+
+    for(i = 0; i <= last+1 - min_path_length; i++) {
+    // decrease priority of all pairs that have a new non-minimal path, including the original
+        if(get_link(lnmp_context, layer, adj_list, path[i], path[last], dst_lid))
+            break;
+        decrease_priority(sdp_priority_queue, number_of_levels, ((uint64_t) adj_list[path[i]].lid << 32) + (pair & 0xffffffff));
+    }
+
+    for(i = 0; i < last; i++) {
+    // add to forwarding table all fixed pairs from the given path
+        link = adj_list[path[i]].links;
+        while(link != NULL) {
+            if(link->to == path[i+1])
+                break;
+            link = link->next;
+        }
+
+        layer->entries[lnmp_context->lid_port_map[adj_list[path[i]].lid].layer_index][lnmp_context->lid_port_map[dst_lid].layer_index].port = link->from_port;
+        layer->entries[lnmp_context->lid_port_map[adj_list[path[i]].lid].layer_index][lnmp_context->lid_port_map[dst_lid].layer_index].hops = last - i;
+    }
+}
+
+static void find_paths_worker(void *context)
+{
+    path_worker_t *worker = (path_worker_t *) context;
+    path_candidate_t *candidate = NULL;
+    uint64_t pair;
+    uint32_t i = 0;
+
+    for(i = worker->offset; i < worker->number_of_pairs && !worker->err; i += worker->stride) {
+        pair = worker->pairs[i];
+        candidate = &worker->candidates[i];
+        if(find_path(&worker->search, worker->layer, worker->lnmp_context, worker->weights, &candidate->path, &candidate->weight, (uint32_t) (pair >> 32), (uint32_t) (pair & 0xffffffff)))
+            worker->err = 1;
+    }
+}
+
+/*
+ * Search the paths of a batch of pairs concurrently; the layer and the weights
+ * are not modified until all workers are joined again
+ */
+static int find_paths_in_parallel(lnmp_context_t *lnmp_context, path_worker_t *workers, layer_t *layer, uint32_t *weights, uint64_t *pairs, path_candidate_t *candidates, uint32_t number_of_pairs)
+{
+    uint8_t number_of_workers = lnmp_context->num_threads;
+    uint8_t t = 0;
+    int err = 0;
+
+    for(t = 0; t < number_of_workers; t++) {
+        workers[t].lnmp_context = lnmp_context;
+        workers[t].layer = layer;
+        workers[t].weights = weights;
+        workers[t].pairs = pairs;
+        workers[t].candidates = candidates;
+        workers[t].number_of_pairs = number_of_pairs;
+        workers[t].offset = t;
+        workers[t].stride = number_of_workers;
+        workers[t].err = 0;
+        cl_thread_construct(&workers[t].thread);
+    }
+    /* the calling thread is worker 0; if a thread cannot be created its share is searched here as well */
+    for(t = 1; t < number_of_workers; t++) {
+        if(cl_thread_init(&workers[t].thread, find_paths_worker, &workers[t], "lnmp worker") != CL_SUCCESS)
+            find_paths_worker(&workers[t]);
+    }
+    find_paths_worker(&workers[0]);
+    for(t = 0; t < number_of_workers; t++) {
+        cl_thread_destroy(&workers[t].thread);
+        err |= workers[t].err;
+    }
+    return err;
+}
+
+static void increase_link_weights(lnmp_context_t *lnmp_context, uint32_t *weights) 
 {
 	vertex_t *adj_list = (vertex_t *) lnmp_context->adj_list;
 	uint32_t adj_list_size = lnmp_context->adj_list_size;
     link_t *link;
-    uint32_t i = 0;
+    uint32_t i = 0, k = 0;
 
     for(i = 1; i < adj_list_size; i++) {
         link = adj_list[i].links;
+        k = lnmp_context->link_offset[i];
         while(link) {
-            link->weight += weights[i - 1][link->to - 1];
+            link->weight += weights[lnmp_context->link_edge[k++]];
             link = link->next;
         }
     }
@@ -1673,23 +2164,24 @@ ERROR:
     return -1;
 }
 
-static int lnmp_generate_layer(lnmp_context_t *lnmp_context, osm_ucast_mgr_t *p_mgr, uint8_t layer_number, node_t **sdp_priority_queue, uint32_t **weights)
+static int lnmp_generate_layer(lnmp_context_t *lnmp_context, osm_ucast_mgr_t *p_mgr, uint8_t layer_number, node_t **sdp_priority_queue, uint32_t *weights)
 {
     layer_t *layer = &(lnmp_context->layers[layer_number]);
-    uint8_t number_of_levels = lnmp_context->number_of_layers +1;
     uint32_t adj_list_size = lnmp_context->adj_list_size;
     uint16_t number_of_endnodes_and_switches = lnmp_context->number_of_endnodes_and_switches;
-    vertex_t *adj_list = lnmp_context->adj_list;
     uint64_t pair;
     uint64_t *switch_endnode_pairs;
     uint32_t switch_endnode_pairs_size = (adj_list_size - 1) * (number_of_endnodes_and_switches - 1), added_paths = 0;
     uint32_t current_switch_pair = 0;
-    uint8_t i = 0;
     uint32_t *path = NULL;
-    uint32_t last;
-    uint8_t max_path_length = lnmp_context->max_length +1;
-    uint8_t min_path_length = lnmp_context->min_length +1;
-    link_t *link = NULL;
+    uint64_t path_weight = 0;
+    path_search_t search = { .labels = NULL, .reached = NULL, .number_reached = NULL };
+    path_worker_t *workers = NULL;
+    path_candidate_t *candidates = NULL;
+    uint32_t batch_size = 0, number_of_pairs = 0, k = 0;
+    uint32_t speculative_paths = 0, researched_paths = 0;
+    uint64_t path_length_distribution[256] = {0};
+    uint8_t t = 0;
 
     switch_endnode_pairs = (uint64_t *) calloc(switch_endnode_pairs_size, sizeof(uint64_t));
     if (!switch_endnode_pairs) {
@@ -1699,72 +2191,101 @@ static int lnmp_generate_layer(lnmp_context_t *lnmp_context, osm_ucast_mgr_t *p_
     if(generate_pairs_list(lnmp_context, switch_endnode_pairs_size, sdp_priority_queue, switch_endnode_pairs))
         goto ERROR;
     
-    uint64_t path_length_distribution[6] = {0,0,0,0,0,0};
+    if(path_search_init(&search, lnmp_context)) {
+        OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+                "ERR AD02: cannot allocate memory for the path search\n");
+        goto ERROR;
+    }
 
-    while(current_switch_pair < switch_endnode_pairs_size && added_paths < lnmp_context->maximum_number_of_paths) {
-        pair = switch_endnode_pairs[current_switch_pair++]; 
-        if(find_path(layer, lnmp_context, weights, &path, (uint32_t) (pair >> 32), (uint32_t) (pair & 0xffffffff)))
+    /* in parallel mode the paths of a batch of pairs are searched on the
+     * current layer and weights, and committed afterwards in pair order;
+     * a speculative path which is invalidated by an earlier commit of the
+     * same batch is searched again, so the layer is the same as in serial mode
+     */
+    if(lnmp_context->num_threads > 1) {
+        batch_size = lnmp_context->num_threads * LNMP_PAIRS_PER_WORKER;
+        workers = (path_worker_t *) calloc(lnmp_context->num_threads, sizeof(path_worker_t));
+        candidates = (path_candidate_t *) calloc(batch_size, sizeof(path_candidate_t));
+        if(!workers || !candidates) {
+            OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+                    "ERR AD02: cannot allocate memory for the path search workers\n");
             goto ERROR;
-        
-        if(!path)
-            continue;
-        
-        added_paths++;
-        
-        for(i = max_path_length - 1; i >= 0; i--) {
-            if(path[i])
-                break;
         }
-        last = i;
-
-	path_length_distribution[last]++;	
+        for(t = 0; t < lnmp_context->num_threads; t++) {
+            if(path_search_init(&workers[t].search, lnmp_context)) {
+                OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+                        "ERR AD02: cannot allocate memory for the path search workers\n");
+                goto ERROR;
+            }
+        }
+    }
 
-        for(i = 0; i <= last+1 - min_path_length; i++) {
-        // decrease priority of all pairs that have a new non-minimal path, including the original
-            if(get_link(lnmp_context, layer, adj_list, path[i], path[last], (uint32_t) (pair & 0xffffffff)))
-                break;
-            decrease_priority(sdp_priority_queue, number_of_levels, ((uint64_t) adj_list[path[i]].lid << 32) + (pair & 0xffffffff));
+    while(current_switch_pair < switch_endnode_pairs_size && added_paths < lnmp_context->maximum_number_of_paths) {
+        if(!candidates) {
+            pair = switch_endnode_pairs[current_switch_pair++]; 
+            if(find_path(&search, layer, lnmp_context, weights, &path, &path_weight, (uint32_t) (pair >> 32), (uint32_t) (pair & 0xffffffff)))
+                goto ERROR;
+            
+            if(!path)
+                continue;
+            
+            added_paths++;
+            commit_path(lnmp_context, layer, sdp_priority_queue, weights, path, pair, path_length_distribution);
+            free_path(&path);
+            continue;
         }
 
-        for(i = 0; i < last; i++) {
-        // add to forwarding table all fixed pairs from the given path
-            link = adj_list[path[i]].links;
-            while(link != NULL) {
-                if(link->to == path[i+1])
-                    break;
-                link = link->next;
+        number_of_pairs = min(batch_size, switch_endnode_pairs_size - current_switch_pair);
+        if(find_paths_in_parallel(lnmp_context, workers, layer, weights, &switch_endnode_pairs[current_switch_pair], candidates, number_of_pairs))
+            goto ERROR;
+
+        for(k = 0; k < number_of_pairs && added_paths < lnmp_context->maximum_number_of_paths; k++) {
+            pair = switch_endnode_pairs[current_switch_pair + k];
+            speculative_paths++;
+            if(!candidate_is_valid(lnmp_context, layer, weights, &candidates[k], (uint32_t) (pair & 0xffffffff))) {
+                researched_paths++;
+                if(candidates[k].path)
+                    free_path(&candidates[k].path);
+                if(find_path(&search, layer, lnmp_context, weights, &candidates[k].path, &candidates[k].weight, (uint32_t) (pair >> 32), (uint32_t) (pair & 0xffffffff)))
+                    goto ERROR;
             }
 
-            layer->entries[lnmp_context->lid_port_map[adj_list[path[i]].lid].layer_index][lnmp_context->lid_port_map[(pair & 0xffffffff)].layer_index].port = link->from_port;
-            layer->entries[lnmp_context->lid_port_map[adj_list[path[i]].lid].layer_index][lnmp_context->lid_port_map[(pair & 0xffffffff)].layer_index].hops = last - i;
-        }
+            if(!candidates[k].path)
+                continue;
 
-        // add edges to graph needed to fill remaining forwarding entries; FOR NOW USE FULL GRAPH TO ADD REMAINING EGDES AS WE USUALLY ADD ALL OF THEM ANYWAYS
-        if(path)
-            free_path(&path);
+            added_paths++;
+            commit_path(lnmp_context, layer, sdp_priority_queue, weights, candidates[k].path, pair, path_length_distribution);
+        }
+        for(k = 0; k < number_of_pairs; k++) {
+            if(candidates[k].path)
+                free_path(&candidates[k].path);
+        }
+        current_switch_pair += number_of_pairs;
+    }
+    if(candidates) {
+        OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+        "   Layer = %" PRIu8 " searched %" PRIu32 " of %" PRIu32 " speculative paths again\n",
+        layer_number, researched_paths, speculative_paths);
     }
     if(added_paths >= lnmp_context->maximum_number_of_paths) {
         OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
         "   Layer = %" PRIu16 " hit the maximum number of possible paths\n",
         layer_number);
     }
-    OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-    "   Layer = %" PRIu16 " found %" PRIu16 " paths of length 1\n",
-    layer_number, path_length_distribution[1]);
-    OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-    "   Layer = %" PRIu16 " found %" PRIu16 " paths of length 2\n",
-    layer_number, path_length_distribution[2]);
-    OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-    "   Layer = %" PRIu16 " found %" PRIu16 " paths of length 3\n",
-    layer_number, path_length_distribution[3]);
-    OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-    "   Layer = %" PRIu16 " found %" PRIu16 " paths of length 4\n",
-    layer_number, path_length_distribution[4]);
-    OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
-    "   Layer = %" PRIu16 " found %" PRIu16 " paths of length 5\n",
-    layer_number, path_length_distribution[5]);
+    for(k = 1; k <= lnmp_context->max_length; k++) {
+        OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
+        "   Layer = %" PRIu8 " found %" PRIu64 " paths of length %" PRIu32 "\n",
+        layer_number, path_length_distribution[k], k);
+    }
 
     free(switch_endnode_pairs);
+    free(candidates);
+    if(workers) {
+        for(t = 0; t < lnmp_context->num_threads; t++)
+            path_search_destroy(&workers[t].search);
+        free(workers);
+    }
+    path_search_destroy(&search);
 
     // insert all entries into the new_lft table
     insert_layer_entries(lnmp_context, p_mgr, layer_number);
@@ -1773,11 +2294,202 @@ static int lnmp_generate_layer(lnmp_context_t *lnmp_context, osm_ucast_mgr_t *p_
 ERROR:
     if(path)
         free_path(&path);
+    if(candidates) {
+        for(k = 0; k < batch_size; k++) {
+            if(candidates[k].path)
+                free_path(&candidates[k].path);
+        }
+        free(candidates);
+    }
+    if(workers) {
+        for(t = 0; t < lnmp_context->num_threads; t++)
+            path_search_destroy(&workers[t].search);
+        free(workers);
+    }
+    path_search_destroy(&search);
     if(switch_endnode_pairs)
         free(switch_endnode_pairs);
     return 1;
 }
 
+#define LNMP_SL_INVALID 0xFF
+#define LNMP_PATH_ON_STACK 0xFE
+
+/*
+ * Computes the column of the SL cache for dlid: the number of switches on the
+ * path from every switch to dlid and the switch of its second hop, following
+ * the new LFTs; path_length, next_switch and stack hold adj_list_size entries
+ */
+static uint32_t update_sl_cache_column(lnmp_context_t *lnmp_context, uint16_t dlid, uint8_t *path_length,
+                                       uint32_t *next_switch, uint32_t *stack)
+{
+    vertex_t *adj_list = lnmp_context->adj_list;
+    uint32_t size = lnmp_context->adj_list_size;
+    uint8_t *column = &lnmp_context->sl_cache[(uint64_t) dlid * size];
+    osm_node_t *remote_node = NULL;
+    uint8_t port = 0, remote_port = 0, length = 0;
+    uint32_t i = 0, j = 0, depth = 0, too_long = 0;
+
+    memset(path_length, 0, size * sizeof(uint8_t));
+    for(i = 1; i < size; i++) {
+        /* follow the LFTs until a switch with known length, the destination or a dead end */
+        depth = 0;
+        j = i;
+        while(1) {
+            if(path_length[j] == LNMP_PATH_ON_STACK) {
+                length = LNMP_SL_INVALID;
+                break;
+            } else if(path_length[j]) {
+                length = path_length[j];
+                break;
+            }
+            path_length[j] = LNMP_PATH_ON_STACK;
+            next_switch[j] = 0;
+            stack[depth++] = j;
+
+            port = osm_switch_get_port_by_lid(adj_list[j].sw, dlid, OSM_NEW_LFT);
+            if(port == OSM_NO_PATH) {
+                length = LNMP_SL_INVALID;
+                break;
+            } else if(port == 0) {
+                length = 0;
+                break;
+            }
+            remote_node = osm_node_get_remote_node(adj_list[j].sw->p_node, port, &remote_port);
+            if(!remote_node) {
+                length = LNMP_SL_INVALID;
+                break;
+            } else if(osm_node_get_type(remote_node) == IB_NODE_TYPE_CA) {
+                length = 0;
+                break;
+            } else if(osm_node_get_type(remote_node) != IB_NODE_TYPE_SWITCH) {
+                length = LNMP_SL_INVALID;
+                break;
+            }
+            next_switch[j] = lnmp_context->lid_port_map[get_lid(remote_node)].switch_index;
+            if(!next_switch[j]) {
+                length = LNMP_SL_INVALID;
+                break;
+            }
+            j = next_switch[j];
+        }
+        while(depth) {
+            if(length != LNMP_SL_INVALID)
+                length = (length + 1 < LNMP_PATH_ON_STACK) ? length + 1 : LNMP_SL_INVALID;
+            path_length[stack[--depth]] = length;
+        }
+    }
+
+    /* same SLs as the hop by hop walk: two hop paths (at most three switches)
+       use SL 1, three hop paths the color of their second switch */
+    for(i = 1; i < size; i++) {
+        if(path_length[i] >= 1 && path_length[i] <= 3) {
+            column[i] = 1;
+        } else if(path_length[i] == 4) {
+            column[i] = lnmp_context->switch_colors[next_switch[i]] + 2;
+        } else {
+            column[i] = LNMP_SL_INVALID;
+            if(path_length[i] != LNMP_SL_INVALID)
+                too_long++;
+        }
+    }
+    return too_long;
+}
+
+/*
+ * Brings the SL cache in line with the new LFTs; if the switches, their colors
+ * and the LID range are the same as for the last routing, only the columns
+ * of destinations whose route changed on any switch are recomputed
+ */
+static int build_sl_cache(lnmp_context_t *lnmp_context)
+{
+    osm_ucast_mgr_t *p_mgr = lnmp_context->p_mgr;
+    vertex_t *adj_list = lnmp_context->adj_list;
+    uint32_t size = lnmp_context->adj_list_size;
+    uint16_t max_lid = p_mgr->p_subn->max_ucast_lid_ho;
+    uint8_t *dirty = NULL, *path_length = NULL, *row = NULL;
+    uint32_t *next_switch = NULL, *stack = NULL;
+    uint32_t i = 0, updated = 0, too_long = 0;
+    boolean_t reuse = FALSE;
+    uint16_t dlid = 0;
+    uint8_t port = 0;
+
+    if(lnmp_context->sl_cache && lnmp_context->sl_cache_size == size && lnmp_context->sl_cache_max_lid == max_lid) {
+        reuse = TRUE;
+        for(i = 1; i < size && reuse; i++) {
+            if(lnmp_context->sl_cache_guids[i] != adj_list[i].guid ||
+               lnmp_context->sl_cache_colors[i] != lnmp_context->switch_colors[i])
+                reuse = FALSE;
+        }
+    }
+
+    if(!reuse) {
+        free_sl_cache(lnmp_context);
+        lnmp_context->sl_cache = (uint8_t *) malloc((uint64_t) (max_lid + 1) * size * sizeof(uint8_t));
+        lnmp_context->sl_cache_lft = (uint8_t *) malloc((uint64_t) (max_lid + 1) * size * sizeof(uint8_t));
+        lnmp_context->sl_cache_colors = (uint8_t *) malloc(size * sizeof(uint8_t));
+        lnmp_context->sl_cache_guids = (uint64_t *) malloc(size * sizeof(uint64_t));
+        if(!lnmp_context->sl_cache || !lnmp_context->sl_cache_lft || !lnmp_context->sl_cache_colors ||
+           !lnmp_context->sl_cache_guids)
+            goto ERROR;
+        memset(lnmp_context->sl_cache, LNMP_SL_INVALID, (uint64_t) (max_lid + 1) * size);
+        memset(lnmp_context->sl_cache_lft, OSM_NO_PATH, (uint64_t) (max_lid + 1) * size);
+        for(i = 0; i < size; i++) {
+            lnmp_context->sl_cache_guids[i] = adj_list[i].guid;
+            lnmp_context->sl_cache_colors[i] = lnmp_context->switch_colors[i];
+        }
+        lnmp_context->sl_cache_size = size;
+        lnmp_context->sl_cache_max_lid = max_lid;
+    }
+
+    dirty = (uint8_t *) calloc(max_lid + 1, sizeof(uint8_t));
+    path_length = (uint8_t *) malloc(size * sizeof(uint8_t));
+    next_switch = (uint32_t *) malloc(size * sizeof(uint32_t));
+    stack = (uint32_t *) malloc(size * sizeof(uint32_t));
+    if(!dirty || !path_length || !next_switch || !stack)
+        goto ERROR;
+
+    for(i = 1; i < size; i++) {
+        row = &lnmp_context->sl_cache_lft[(uint64_t) i * (max_lid + 1)];
+        for(dlid = 1; dlid <= max_lid; dlid++) {
+            port = osm_switch_get_port_by_lid(adj_list[i].sw, dlid, OSM_NEW_LFT);
+            if(!reuse || row[dlid] != port) {
+                row[dlid] = port;
+                dirty[dlid] = 1;
+            }
+        }
+    }
+
+    for(dlid = 1; dlid <= max_lid; dlid++) {
+        if(!dirty[dlid])
+            continue;
+        too_long += update_sl_cache_column(lnmp_context, dlid, path_length, next_switch, stack);
+        updated++;
+    }
+
+    OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+            "SL cache: updated %" PRIu32 " of %" PRIu16 " destinations\n", updated, max_lid);
+    if(too_long)
+        OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+                "ERR AD0D: %" PRIu32 " switch to destination paths are longer than 3 hops\n", too_long);
+
+    free(dirty);
+    free(path_length);
+    free(next_switch);
+    free(stack);
+    return 0;
+
+ERROR:
+    OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
+            "ERR AD0E: cannot allocate memory for the SL cache, path_sl walks the LFTs instead\n");
+    free_sl_cache(lnmp_context);
+    free(dirty);
+    free(path_length);
+    free(next_switch);
+    free(stack);
+    return -1;
+}
+
 static int lnmp_perform_routing(void *context)
 {
     lnmp_context_t *lnmp_context = (lnmp_context_t *) context;
@@ -1786,7 +2498,7 @@ static int lnmp_perform_routing(void *context)
     layer_t *layer = NULL;
 	vertex_t *adj_list = (vertex_t *) lnmp_context->adj_list;
     uint32_t adj_list_size = lnmp_context->adj_list_size, sw_list_size = 0;
-    uint32_t **weights = NULL;
+    uint32_t *weights = NULL;
     uint32_t i = 0, j = 0;
     uint8_t layer_number = 0, lmc = 0;
     uint16_t min_lid_ho = 0;
@@ -1976,30 +2688,20 @@ static int lnmp_perform_routing(void *context)
                 "ERR AD02: cannot allocate memory for priority queue switch pairs\n");
         goto ERROR;
     }
-    /* allocate weight_matrix and initialize to zero, remember that the first position in adj_list is reserved */
-
-    weights = (uint32_t **) malloc((adj_list_size-1) * sizeof(uint32_t *));
+    /* the weights of the layers are kept per edge between two switches and initialized to zero */
+    weights = (uint32_t *) calloc(lnmp_context->number_of_edges + 1, sizeof(uint32_t));
     if(!weights) {
         OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-                "ERR AD02: cannot allocate memory for weight matrix\n");
+                "ERR AD02: cannot allocate memory for the link weights\n");
         goto ERROR;
     }
 
-    for(i = 0; i < adj_list_size -1; i++) {
-        weights[i] = (uint32_t *) calloc((size_t) (adj_list_size - 1), sizeof(uint32_t));
-        if(!weights[i]) {
-            OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
-                    "ERR AD02: cannot allocate memory for column in weight matrix\n");
-            goto ERROR;
-        }
-    }
-
     /* generate layers */
 
     for(layer_number = 1; layer_number < lnmp_context->number_of_layers; layer_number++) {
         if(lnmp_generate_layer(lnmp_context, p_mgr, layer_number, sdp_priority_queue, weights))
 	    goto ERROR;
-        print_weights(p_mgr, adj_list, weights, adj_list_size);
+        print_weights(lnmp_context, p_mgr, weights);
         print_layer(lnmp_context, p_mgr, layer_number);
     }
 
@@ -2012,10 +2714,7 @@ static int lnmp_perform_routing(void *context)
 
     increase_link_weights(lnmp_context, weights);
 
-    /* dealloc weights matrix, no longer needed */
-    for(i = 0; i < adj_list_size -1; i++) {
-        free(weights[i]);
-    }
+    /* dealloc weights, no longer needed */
     free(weights);
     weights = NULL;
 
@@ -2033,7 +2732,9 @@ static int lnmp_perform_routing(void *context)
     // create temporary dfsssp_context to remove deadlocks
     dfsssp_context_t dfsssp_ctx = { .routing_type = OSM_ROUTING_ENGINE_TYPE_DFSSSP, .p_mgr = p_mgr,
         .adj_list = lnmp_context->adj_list, .adj_list_size = lnmp_context->adj_list_size, .srcdest2vl_table = NULL, 
-        .vl_split_count = NULL, .max_vls = p_mgr->p_subn->opt.dfsssp_max_vls, .only_best_effort = p_mgr->p_subn->opt.dfsssp_best_effort};
+        .vl_split_count = NULL, .max_vls = p_mgr->p_subn->opt.dfsssp_max_vls, .only_best_effort = p_mgr->p_subn->opt.dfsssp_best_effort,
+        .vltable_per_switch = p_mgr->p_subn->opt.dfsssp_vltable_per_switch,
+        .incremental_cdg = p_mgr->p_subn->opt.dfsssp_incremental_cdg};
     
     if(lnmp_context->apply_dfsssp) {
         OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
@@ -2046,6 +2747,7 @@ static int lnmp_perform_routing(void *context)
     } else {
         OSM_LOG(p_mgr->p_log, OSM_LOG_INFO,
         "Not performing deadlock removal through dfsssp_remove_deadlocks(...) but instead using new algorithm\n");
+        build_sl_cache(lnmp_context);
     }
 	/* list not needed after the dijkstra steps and deadlock removal */
 	cl_qlist_remove_all(&p_mgr->port_order_list);
@@ -2066,13 +2768,8 @@ ERROR:
         }
         free(sdp_priority_queue);
     }
-    if (weights) {
-        for(i = 0; i < adj_list_size -1; i++) {
-            if(weights[i])
-                free(weights[i]);
-        }
+    if (weights)
         free(weights);
-    }
     return -1;
 }
 
@@ -2278,7 +2975,8 @@ static uint8_t get_lnmp_sl(void *context, uint8_t hint_for_default_sl, const ib_
 	osm_port_t *src_port, *dest_port;
 	osm_node_t *first_sw_node = NULL;
 	osm_ucast_mgr_t *p_mgr = lnmp_context->p_mgr;
-	uint8_t path_length = 0, color = 0;
+	uint8_t path_length = 0, color = 0, sl = 0;
+	uint32_t switch_idx = 0;
 
 	uint16_t slid_ho = cl_ntoh16(slid);
 	uint16_t dlid_ho = cl_ntoh16(dlid);
@@ -2308,6 +3006,19 @@ static uint8_t get_lnmp_sl(void *context, uint8_t hint_for_default_sl, const ib_
 		first_sw_node = src_port->p_node;
 	}
 
+	switch_idx = lnmp_context->lid_port_map ? lnmp_context->lid_port_map[get_lid(first_sw_node)].switch_index : 0;
+	if (lnmp_context->sl_cache && switch_idx && switch_idx < lnmp_context->sl_cache_size
+	    && dlid_ho <= lnmp_context->sl_cache_max_lid
+	    && lnmp_context->sl_cache_guids[switch_idx] == cl_ntoh64(osm_node_get_node_guid(first_sw_node))) {
+		sl = lnmp_context->sl_cache[(uint64_t) dlid_ho * lnmp_context->sl_cache_size + switch_idx];
+		if (sl == LNMP_SL_INVALID)
+			return hint_for_default_sl;
+		OSM_LOG(p_mgr->p_log, OSM_LOG_DEBUG,
+		" Called LNMP get SL for src_lid = %" PRIu16 " and dst_lid = %" PRIu16 " and returned cached SL: %" PRIu8 "\n",
+		slid_ho, dlid_ho, sl);
+		return sl;
+	}
+
 	path_length = get_path_length(lnmp_context, first_sw_node, dlid_ho, &color, 1);
 	uint8_t res = hint_for_default_sl;
 	if (path_length == 1) {
@@ -2339,7 +3050,8 @@ static ib_api_status_t lnmp_do_mcast_routing(void *context, osm_mgrp_box_t *mbox
     // create temporary dfsssp_context to call dfsssp's mcast routing
     dfsssp_context_t dfsssp_ctx = { .routing_type = OSM_ROUTING_ENGINE_TYPE_DFSSSP, .p_mgr = lnmp_context->p_mgr,
         .adj_list = lnmp_context->adj_list, .adj_list_size = lnmp_context->adj_list_size, 
-        .srcdest2vl_table = lnmp_context->srcdest2vl_table, .vl_split_count = lnmp_context->vl_split_count, .max_vls = lnmp_context->p_mgr->p_subn->opt.dfsssp_max_vls, .only_best_effort = lnmp_context->p_mgr->p_subn->opt.dfsssp_best_effort};
+        .srcdest2vl_table = lnmp_context->srcdest2vl_table, .vl_split_count = lnmp_context->vl_split_count, .max_vls = lnmp_context->p_mgr->p_subn->opt.dfsssp_max_vls, .only_best_effort = lnmp_context->p_mgr->p_subn->opt.dfsssp_best_effort,
+        .vltable_per_switch = lnmp_context->p_mgr->p_subn->opt.dfsssp_vltable_per_switch};
 
     return dfsssp_do_mcast_routing(&dfsssp_ctx, mbox);
 }
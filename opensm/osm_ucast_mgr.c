@@ -51,9 +51,11 @@
 #include <complib/cl_qmap.h>
 #include <complib/cl_debug.h>
 #include <complib/cl_qlist.h>
+#include <complib/cl_thread.h>
 #include <opensm/osm_file_ids.h>
 #define FILE_ID OSM_FILE_UCAST_MGR_C
 #include <opensm/osm_ucast_mgr.h>
+#include <opensm/osm_ucast_backup.h>
 #include <opensm/osm_sm.h>
 #include <opensm/osm_log.h>
 #include <opensm/osm_node.h>
@@ -75,6 +77,7 @@ void osm_ucast_mgr_destroy(IN osm_ucast_mgr_t * p_mgr)
 
 	if (p_mgr->cache_valid)
 		osm_ucast_cache_invalidate(p_mgr);
+	osm_ucast_backup_destroy(p_mgr);
 
 	OSM_LOG_EXIT(p_mgr->p_log);
 }
@@ -201,6 +204,7 @@ static struct osm_remote_node *find_and_add_remote_sys(osm_switch_t * sw,
 static void ucast_mgr_process_port(IN osm_ucast_mgr_t * p_mgr,
 				   IN osm_switch_t * p_sw,
 				   IN osm_port_t * p_port,
+				   IN struct osm_remote_guids_count *r,
 				   IN unsigned lid_offset)
 {
 	uint16_t min_lid_ho;
@@ -255,7 +259,7 @@ static void ucast_mgr_process_port(IN osm_ucast_mgr_t * p_mgr,
 	   how best to distribute the LID range across the ports
 	   that can reach those LIDs.
 	 */
-	port = osm_switch_recommend_path(p_sw, p_port, lid_ho, start_from,
+	port = osm_switch_recommend_path(p_sw, p_port, r, lid_ho, start_from,
 					 p_mgr->p_subn->ignore_existing_lfts,
 					 p_mgr->p_subn->opt.lmc,
 					 p_mgr->is_dor,
@@ -303,10 +307,9 @@ static void ucast_mgr_process_port(IN osm_ucast_mgr_t * p_mgr,
 	if (!is_ignored_by_port_prof) {
 		struct osm_remote_node *rem_node_used;
 		osm_switch_count_path(p_sw, port);
-		if (port > 0 && p_port->priv &&
+		if (port > 0 &&
 		    (rem_node_used = find_and_add_remote_sys(p_sw, port,
-							     p_mgr->is_dor,
-							     p_port->priv)))
+							     p_mgr->is_dor, r)))
 			rem_node_used->forwarded_to++;
 	}
 
@@ -314,52 +317,70 @@ Exit:
 	OSM_LOG_EXIT(p_mgr->p_log);
 }
 
-static void alloc_ports_priv(osm_ucast_mgr_t * mgr)
+/*
+ * The LFTs of the switches are built concurrently.  The only state shared
+ * between the switches are the per port arrays tracking the remote
+ * systems used for the LIDs of the port (LMC > 0); they are reset for
+ * each switch, so each worker has its own.  The result does not depend
+ * on the number of workers.
+ */
+typedef struct lft_worker {
+	cl_thread_t thread;
+	osm_ucast_mgr_t *p_mgr;
+	osm_switch_t **switches;
+	uint32_t num_switches;
+	atomic32_t *p_next_switch;
+	osm_port_t **ports;
+	uint32_t num_ports;
+	struct osm_remote_guids_count **remote_guids;
+	void *remote_guids_buf;
+} lft_worker_t;
+
+static int alloc_ports_priv(lft_worker_t * w)
 {
-	cl_qmap_t *port_tbl = &mgr->p_subn->port_guid_tbl;
 	struct osm_remote_guids_count *r;
-	osm_port_t *port;
-	cl_map_item_t *item;
+	size_t size = 0;
+	uint8_t *buf;
 	unsigned lmc;
+	uint32_t i;
 
-	for (item = cl_qmap_head(port_tbl); item != cl_qmap_end(port_tbl);
-	     item = cl_qmap_next(item)) {
-		port = (osm_port_t *) item;
-		lmc = ib_port_info_get_lmc(&port->p_physp->port_info);
-		r = malloc(sizeof(*r) + sizeof(r->guids[0]) * (1 << lmc));
-		if (!r) {
-			OSM_LOG(mgr->p_log, OSM_LOG_ERROR, "ERR 3A09: "
-				"cannot allocate memory to track remote"
-				" systems for lmc > 0\n");
-			port->priv = NULL;
-			continue;
-		}
-		memset(r, 0, sizeof(*r) + sizeof(r->guids[0]) * (1 << lmc));
-		port->priv = r;
+	for (i = 0; i < w->num_ports; i++) {
+		lmc = ib_port_info_get_lmc(&w->ports[i]->p_physp->port_info);
+		size += sizeof(*r) + sizeof(r->guids[0]) * (1 << lmc);
 	}
+
+	w->remote_guids = malloc(w->num_ports * sizeof(*w->remote_guids));
+	w->remote_guids_buf = malloc(size);
+	if (!w->remote_guids || !w->remote_guids_buf) {
+		OSM_LOG(w->p_mgr->p_log, OSM_LOG_ERROR, "ERR 3A09: "
+			"cannot allocate memory to track remote"
+			" systems for lmc > 0\n");
+		return -1;
+	}
+
+	buf = w->remote_guids_buf;
+	for (i = 0; i < w->num_ports; i++) {
+		lmc = ib_port_info_get_lmc(&w->ports[i]->p_physp->port_info);
+		w->remote_guids[i] = (struct osm_remote_guids_count *)buf;
+		buf += sizeof(*r) + sizeof(r->guids[0]) * (1 << lmc);
+	}
+
+	return 0;
 }
 
-static void free_ports_priv(osm_ucast_mgr_t * mgr)
+static void free_ports_priv(lft_worker_t * w)
 {
-	cl_qmap_t *port_tbl = &mgr->p_subn->port_guid_tbl;
-	osm_port_t *port;
-	cl_map_item_t *item;
-	for (item = cl_qmap_head(port_tbl); item != cl_qmap_end(port_tbl);
-	     item = cl_qmap_next(item)) {
-		port = (osm_port_t *) item;
-		if (port->priv) {
-			free(port->priv);
-			port->priv = NULL;
-		}
-	}
+	free(w->remote_guids);
+	free(w->remote_guids_buf);
+	w->remote_guids = NULL;
+	w->remote_guids_buf = NULL;
 }
 
-static void ucast_mgr_process_tbl(IN cl_map_item_t * p_map_item,
-				  IN void *context)
+static void ucast_mgr_process_tbl(IN lft_worker_t * w, IN osm_switch_t * p_sw)
 {
-	osm_ucast_mgr_t *p_mgr = context;
-	osm_switch_t * p_sw = (osm_switch_t *) p_map_item;
+	osm_ucast_mgr_t *p_mgr = w->p_mgr;
 	unsigned i, lids_per_port;
+	uint32_t j;
 
 	OSM_LOG_ENTER(p_mgr->p_log);
 
@@ -372,26 +393,116 @@ static void ucast_mgr_process_tbl(IN cl_map_item_t * p_map_item,
 	/* Initialize LIDs in buffer to invalid port number. */
 	memset(p_sw->new_lft, OSM_NO_PATH, p_sw->max_lid_ho + 1);
 
-	alloc_ports_priv(p_mgr);
+	for (j = 0; j < w->num_ports; j++)
+		w->remote_guids[j]->count = 0;
 
 	/*
 	   Iterate through every port setting LID routes for each
 	   port based on base LID and LMC value.
 	 */
 	lids_per_port = 1 << p_mgr->p_subn->opt.lmc;
-	for (i = 0; i < lids_per_port; i++) {
-		cl_qlist_t *list = &p_mgr->port_order_list;
-		cl_list_item_t *item;
-		for (item = cl_qlist_head(list); item != cl_qlist_end(list);
-		     item = cl_qlist_next(item)) {
-			osm_port_t *port = cl_item_obj(item, port, list_item);
-			ucast_mgr_process_port(p_mgr, p_sw, port, i);
-		}
+	for (i = 0; i < lids_per_port; i++)
+		for (j = 0; j < w->num_ports; j++)
+			ucast_mgr_process_port(p_mgr, p_sw, w->ports[j],
+					       w->remote_guids[j], i);
+
+	OSM_LOG_EXIT(p_mgr->p_log);
+}
+
+static void lft_worker_run(void *context)
+{
+	lft_worker_t *w = context;
+	uint32_t i;
+
+	while ((i = (uint32_t) cl_atomic_inc(w->p_next_switch) - 1) <
+	       w->num_switches)
+		ucast_mgr_process_tbl(w, w->switches[i]);
+}
+
+static int ucast_mgr_process_tbls(IN osm_ucast_mgr_t * p_mgr)
+{
+	cl_qmap_t *p_sw_tbl = &p_mgr->p_subn->sw_guid_tbl;
+	cl_qlist_t *list = &p_mgr->port_order_list;
+	osm_switch_t **switches = NULL;
+	osm_port_t **ports = NULL;
+	osm_port_t *port;
+	lft_worker_t *workers = NULL;
+	cl_map_item_t *item;
+	cl_list_item_t *list_item;
+	atomic32_t next_switch = 0;
+	uint32_t num_switches, num_ports, num_workers, i;
+	int ret = -1;
+
+	num_switches = cl_qmap_count(p_sw_tbl);
+	num_ports = cl_qlist_count(list);
+	if (!num_switches)
+		return 0;
+
+	num_workers = p_mgr->p_subn->opt.lft_num_threads;
+	if (!num_workers)
+		num_workers = cl_proc_count();
+	/* the port selection of scatter_ports uses the global random() */
+	if (p_mgr->p_subn->opt.scatter_ports || !num_workers)
+		num_workers = 1;
+	if (num_workers > num_switches)
+		num_workers = num_switches;
+
+	switches = malloc(num_switches * sizeof(*switches));
+	ports = malloc((num_ports ? num_ports : 1) * sizeof(*ports));
+	workers = calloc(num_workers, sizeof(*workers));
+	if (!switches || !ports || !workers) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR, "ERR 3A12: "
+			"cannot allocate memory to build the LFTs\n");
+		goto Exit;
 	}
 
-	free_ports_priv(p_mgr);
+	i = 0;
+	for (item = cl_qmap_head(p_sw_tbl); item != cl_qmap_end(p_sw_tbl);
+	     item = cl_qmap_next(item))
+		switches[i++] = (osm_switch_t *) item;
 
-	OSM_LOG_EXIT(p_mgr->p_log);
+	i = 0;
+	for (list_item = cl_qlist_head(list); list_item != cl_qlist_end(list);
+	     list_item = cl_qlist_next(list_item)) {
+		port = cl_item_obj(list_item, port, list_item);
+		ports[i++] = port;
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		workers[i].p_mgr = p_mgr;
+		workers[i].switches = switches;
+		workers[i].num_switches = num_switches;
+		workers[i].p_next_switch = &next_switch;
+		workers[i].ports = ports;
+		workers[i].num_ports = num_ports;
+		cl_thread_construct(&workers[i].thread);
+		if (alloc_ports_priv(&workers[i]))
+			goto Exit;
+	}
+
+	if (num_workers > 1)
+		OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+			"Building the LFTs of %u switches with %u threads\n",
+			num_switches, num_workers);
+
+	/* the calling thread is worker 0; if a thread cannot be created,
+	   the other workers take its share */
+	for (i = 1; i < num_workers; i++)
+		cl_thread_init(&workers[i].thread, lft_worker_run,
+			       &workers[i], "lft worker");
+	lft_worker_run(&workers[0]);
+	for (i = 1; i < num_workers; i++)
+		cl_thread_destroy(&workers[i].thread);
+
+	ret = 0;
+Exit:
+	if (workers)
+		for (i = 0; i < num_workers; i++)
+			free_ports_priv(&workers[i]);
+	free(workers);
+	free(ports);
+	free(switches);
+	return ret;
 }
 
 static void ucast_mgr_process_neighbors(IN cl_map_item_t * p_map_item,
@@ -859,6 +970,8 @@ static void sort_ports_by_switch_load(osm_ucast_mgr_t * m)
 
 static int ucast_mgr_build_lfts(osm_ucast_mgr_t * p_mgr)
 {
+	int ret;
+
 	cl_qlist_init(&p_mgr->port_order_list);
 
 	if (p_mgr->p_subn->opt.guid_routing_order_file) {
@@ -888,12 +1001,11 @@ static int ucast_mgr_build_lfts(osm_ucast_mgr_t * p_mgr)
 	cl_qmap_apply_func(&p_mgr->p_subn->port_guid_tbl,
 			   add_port_to_order_list, p_mgr);
 
-	cl_qmap_apply_func(&p_mgr->p_subn->sw_guid_tbl, ucast_mgr_process_tbl,
-			   p_mgr);
+	ret = ucast_mgr_process_tbls(p_mgr);
 
 	cl_qlist_remove_all(&p_mgr->port_order_list);
 
-	return 0;
+	return ret;
 }
 
 static void ucast_mgr_set_fwd_top(IN cl_map_item_t * p_map_item,
@@ -971,25 +1083,14 @@ static void ucast_mgr_set_fwd_top(IN cl_map_item_t * p_map_item,
 	OSM_LOG_EXIT(p_mgr->p_log);
 }
 
-static int set_lft_block(IN osm_switch_t *p_sw, IN osm_ucast_mgr_t *p_mgr,
-			 IN uint16_t block_id_ho)
+int osm_ucast_mgr_send_lft_block(IN osm_ucast_mgr_t * p_mgr,
+				 IN osm_switch_t * p_sw, IN uint16_t block_id_ho,
+				 IN const uint8_t * p_block)
 {
 	osm_madw_context_t context;
 	osm_dr_path_t *p_path;
 	osm_physp_t *p_physp;
-	ib_api_status_t status;
-
-	/*
-	   Send linear forwarding table blocks to the switch
-	   as long as the switch indicates it has blocks needing
-	   configuration.
-	 */
-	if (!p_sw->new_lft) {
-		/* any routing should provide the new_lft */
-		CL_ASSERT(p_mgr->p_subn->opt.use_ucast_cache &&
-			  p_mgr->cache_valid && !p_sw->need_update);
-		return -1;
-	}
+	osm_madw_t *p_madw;
 
 	p_physp = osm_node_get_physp_ptr(p_sw->p_node, 0);
 	if (!p_physp)
@@ -1000,11 +1101,8 @@ static int set_lft_block(IN osm_switch_t *p_sw, IN osm_ucast_mgr_t *p_mgr,
 	context.lft_context.node_guid = osm_node_get_node_guid(p_sw->p_node);
 	context.lft_context.set_method = TRUE;
 
-	if (!p_sw->need_update && !p_mgr->p_subn->need_update &&
-	    !memcmp(p_sw->new_lft + block_id_ho * IB_SMP_DATA_SIZE,
-		    p_sw->lft + block_id_ho * IB_SMP_DATA_SIZE,
-		    IB_SMP_DATA_SIZE))
-		return 0;
+	/* the block is resent in the next sweep if the MAD fails */
+	osm_switch_set_lft_block_dirty(p_sw, block_id_ho, FALSE);
 
 	/*
 	 * Zero the stored LFT block, so in case the MAD will end up
@@ -1017,34 +1115,212 @@ static int set_lft_block(IN osm_switch_t *p_sw, IN osm_ucast_mgr_t *p_mgr,
 		"Writing FT block %u to switch 0x%" PRIx64 "\n", block_id_ho,
 		cl_ntoh64(context.lft_context.node_guid));
 
-	status = osm_req_set(p_mgr->sm, p_path,
-			     p_sw->new_lft + block_id_ho * IB_SMP_DATA_SIZE,
-			     IB_SMP_DATA_SIZE, IB_MAD_ATTR_LIN_FWD_TBL,
-			     cl_hton32(block_id_ho), FALSE,
-			     ib_port_info_get_m_key(&p_physp->port_info),
-			     0, CL_DISP_MSGID_NONE, &context);
+	p_madw = osm_prepare_req_set(p_mgr->sm, p_path, p_block,
+				     IB_SMP_DATA_SIZE, IB_MAD_ATTR_LIN_FWD_TBL,
+				     cl_hton32(block_id_ho), FALSE,
+				     ib_port_info_get_m_key(&p_physp->port_info),
+				     0, CL_DISP_MSGID_NONE, &context);
 
-	if (status != IB_SUCCESS) {
+	if (p_madw == NULL) {
 		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR, "ERR 3A10: "
 			"Sending linear fwd. tbl. block failed (%s)\n",
-			ib_get_err_str(status));
+			ib_get_err_str(IB_INSUFFICIENT_RESOURCES));
 		return -1;
 	}
 
+	osm_req_route_by_lid(p_mgr->sm, p_madw, p_physp);
+	osm_send_req_mad(p_mgr->sm, p_madw);
+
 	return 0;
 }
 
+static int set_lft_block(IN osm_switch_t *p_sw, IN osm_ucast_mgr_t *p_mgr,
+			 IN uint16_t block_id_ho)
+{
+	/*
+	   Send linear forwarding table blocks to the switch
+	   as long as the switch indicates it has blocks needing
+	   configuration.
+	 */
+	if (!p_sw->new_lft) {
+		/* any routing should provide the new_lft */
+		CL_ASSERT(p_mgr->p_subn->opt.use_ucast_cache &&
+			  p_mgr->cache_valid && !p_sw->need_update);
+		return -1;
+	}
+
+	return osm_ucast_mgr_send_lft_block(p_mgr, p_sw, block_id_ho,
+					    p_sw->new_lft +
+					    block_id_ho * IB_SMP_DATA_SIZE);
+}
+
+/*
+ * Marks the LFT blocks of a switch which differ from what the switch
+ * holds and returns their number.  One pass over the contiguous tables
+ * per switch, instead of a switch table walk per block.
+ */
+static unsigned ucast_mgr_mark_dirty_blocks(IN osm_ucast_mgr_t * p_mgr,
+					    IN osm_switch_t * p_sw,
+					    IN uint16_t max_block)
+{
+	boolean_t all = p_sw->need_update || p_mgr->p_subn->need_update;
+	unsigned num_dirty = 0;
+	uint16_t block, num_blocks;
+	boolean_t dirty;
+
+	memset(p_sw->lft_dirty, 0, sizeof(p_sw->lft_dirty));
+	if (!p_sw->new_lft)
+		return 0;
+
+	num_blocks = p_sw->lft_size / IB_SMP_DATA_SIZE;
+	if (num_blocks > max_block)
+		num_blocks = max_block;
+	for (block = 0; block < num_blocks; block++) {
+		dirty = all ||
+		    memcmp(p_sw->new_lft + block * IB_SMP_DATA_SIZE,
+			   p_sw->lft + block * IB_SMP_DATA_SIZE,
+			   IB_SMP_DATA_SIZE);
+		if (dirty) {
+			osm_switch_set_lft_block_dirty(p_sw, block, TRUE);
+			num_dirty++;
+		}
+	}
+
+	return num_dirty;
+}
+
+static uint16_t next_dirty_block(IN const osm_switch_t * p_sw,
+				 IN uint16_t block, IN uint16_t max_block)
+{
+	while (block < max_block) {
+		if (!p_sw->lft_dirty[block / 8]) {
+			block = (block / 8 + 1) * 8;
+			continue;
+		}
+		if (osm_switch_is_lft_block_dirty(p_sw, block))
+			break;
+		block++;
+	}
+	return block;
+}
+
+/*
+ * Drops the SA PathRecord cache entries of the LIDs whose forwarding
+ * entry changes on some switch, changed being the union of the dirty
+ * LFT blocks of all switches.
+ */
+static void ucast_mgr_invalidate_pr_cache(IN osm_ucast_mgr_t * p_mgr,
+					  IN const uint8_t * changed,
+					  IN uint16_t max_block)
+{
+	osm_sa_t *sa = &p_mgr->p_subn->p_osm->sa;
+	uint16_t block = 0, first;
+
+	while (block < max_block) {
+		if (!((changed[block / 8] >> (block % 8)) & 1)) {
+			block++;
+			continue;
+		}
+		for (first = block; block < max_block &&
+		     ((changed[block / 8] >> (block % 8)) & 1); block++) ;
+		osm_sa_pr_cache_invalidate(sa, first * IB_SMP_DATA_SIZE,
+					   block * IB_SMP_DATA_SIZE - 1);
+	}
+}
+
+/*
+ * Sends the dirty LFT blocks only.  The switches take turns, one block
+ * each, so the wire SMP window is filled with MADs for many switches
+ * rather than a long run for a single one.
+ */
 static void ucast_mgr_pipeline_fwd_tbl(osm_ucast_mgr_t * p_mgr)
 {
 	cl_qmap_t *tbl;
 	cl_map_item_t *item;
-	unsigned i, max_block = p_mgr->max_lid / IB_SMP_DATA_SIZE + 1;
+	osm_switch_t **sws;
+	uint16_t *next;
+	uint16_t max_block = p_mgr->max_lid / IB_SMP_DATA_SIZE + 1;
+	uint8_t changed[OSM_SW_LFT_MAX_BLOCKS / 8];
+	unsigned i, num_sws = 0, active, num_dirty = 0;
+
+	if (max_block > OSM_SW_LFT_MAX_BLOCKS)
+		max_block = OSM_SW_LFT_MAX_BLOCKS;
 
 	tbl = &p_mgr->p_subn->sw_guid_tbl;
-	for (i = 0; i < max_block; i++)
+	if (!cl_qmap_count(tbl))
+		return;
+	memset(changed, 0, sizeof(changed));
+	sws = malloc(cl_qmap_count(tbl) * sizeof(*sws));
+	next = malloc(cl_qmap_count(tbl) * sizeof(*next));
+	if (!sws || !next) {
+		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR, "ERR 3A11: "
+			"cannot allocate memory, sending LFT blocks switch "
+			"by switch\n");
 		for (item = cl_qmap_head(tbl); item != cl_qmap_end(tbl);
-		     item = cl_qmap_next(item))
-			set_lft_block((osm_switch_t *)item, p_mgr, i);
+		     item = cl_qmap_next(item)) {
+			osm_switch_t *p_sw = (osm_switch_t *) item;
+
+			ucast_mgr_mark_dirty_blocks(p_mgr, p_sw, max_block);
+			for (i = 0; i < sizeof(changed); i++)
+				changed[i] |= p_sw->lft_dirty[i];
+		}
+		ucast_mgr_invalidate_pr_cache(p_mgr, changed, max_block);
+		for (item = cl_qmap_head(tbl); item != cl_qmap_end(tbl);
+		     item = cl_qmap_next(item)) {
+			osm_switch_t *p_sw = (osm_switch_t *) item;
+			uint16_t block;
+
+			for (block = next_dirty_block(p_sw, 0, max_block);
+			     block < max_block;
+			     block = next_dirty_block(p_sw, block + 1,
+						      max_block))
+				set_lft_block(p_sw, p_mgr, block);
+		}
+		goto Exit;
+	}
+
+	for (item = cl_qmap_head(tbl); item != cl_qmap_end(tbl);
+	     item = cl_qmap_next(item)) {
+		osm_switch_t *p_sw = (osm_switch_t *) item;
+		unsigned dirty = ucast_mgr_mark_dirty_blocks(p_mgr, p_sw,
+							     max_block);
+
+		if (!dirty)
+			continue;
+		for (i = 0; i < sizeof(changed); i++)
+			changed[i] |= p_sw->lft_dirty[i];
+		num_dirty += dirty;
+		sws[num_sws] = p_sw;
+		next[num_sws] = next_dirty_block(p_sw, 0, max_block);
+		num_sws++;
+	}
+
+	OSM_LOG(p_mgr->p_log, OSM_LOG_VERBOSE,
+		"Sending %u LFT blocks to %u of %u switches\n", num_dirty,
+		num_sws, cl_qmap_count(tbl));
+	ucast_mgr_invalidate_pr_cache(p_mgr, changed, max_block);
+
+	for (active = num_sws; active;) {
+		for (i = 0; i < active;) {
+			set_lft_block(sws[i], p_mgr, next[i]);
+			next[i] = next_dirty_block(sws[i], next[i] + 1,
+						   max_block);
+			if (next[i] < max_block) {
+				i++;
+				continue;
+			}
+			/* keep the order of the remaining switches */
+			active--;
+			memmove(&sws[i], &sws[i + 1],
+				(active - i) * sizeof(*sws));
+			memmove(&next[i], &next[i + 1],
+				(active - i) * sizeof(*next));
+		}
+	}
+
+Exit:
+	free(sws);
+	free(next);
 }
 
 void osm_ucast_mgr_set_fwd_tables(osm_ucast_mgr_t * p_mgr)
@@ -1068,6 +1344,8 @@ static int ucast_mgr_route(struct osm_routing_engine *r, osm_opensm_t * osm)
 	if (osm->subn.opt.scatter_ports)
 		srandom(osm->subn.opt.scatter_ports);
 
+	osm_sweep_prof_phase(&osm->sm.sweep_prof,
+			     OSM_SWEEP_PHASE_BUILD_LID_MATRICES);
 	if (!r->build_lid_matrices ||
 	    (ret = r->build_lid_matrices(r->context)) > 0)
 		ret = osm_ucast_mgr_build_lid_matrices(&osm->sm.ucast_mgr);
@@ -1078,6 +1356,8 @@ static int ucast_mgr_route(struct osm_routing_engine *r, osm_opensm_t * osm)
 		return ret;
 	}
 
+	osm_sweep_prof_phase(&osm->sm.sweep_prof,
+			     OSM_SWEEP_PHASE_BUILD_FWD_TABLES);
 	if (!r->ucast_build_fwd_tables ||
 	    (ret = r->ucast_build_fwd_tables(r->context)) > 0)
 		ret = ucast_mgr_build_lfts(&osm->sm.ucast_mgr);
@@ -1090,8 +1370,13 @@ static int ucast_mgr_route(struct osm_routing_engine *r, osm_opensm_t * osm)
 
 	osm->routing_engine_used = r;
 
+	osm_sweep_prof_phase(&osm->sm.sweep_prof,
+			     OSM_SWEEP_PHASE_SET_FWD_TABLES);
 	osm_ucast_mgr_set_fwd_tables(&osm->sm.ucast_mgr);
 
+	/* computed from the copy once the sweep has released the lock */
+	osm_ucast_backup_prepare(&osm->sm.ucast_mgr);
+
 	return 0;
 }
 
@@ -1142,9 +1427,13 @@ int osm_ucast_mgr_process(IN osm_ucast_mgr_t * p_mgr)
 			p_mgr->cache_valid = TRUE;
 	} else {
 		p_mgr->p_subn->subnet_initialization_error = TRUE;
+		osm_ucast_backup_clear(p_mgr);
+		osm_ucast_backup_destroy(p_mgr);
 		OSM_LOG(p_mgr->p_log, OSM_LOG_ERROR,
 			"No routing engine able to successfully configure "
 			" switch tables on current fabric\n");
+		/* the new LFTs are not sent, so not compared either */
+		osm_sa_pr_cache_flush(&p_osm->sa);
 	}
 Exit:
 	CL_PLOCK_RELEASE(p_mgr->p_lock);
@@ -1152,6 +1441,11 @@ Exit:
 	return failed;
 }
 
+int osm_ucast_mgr_build_lfts(IN osm_ucast_mgr_t * p_mgr)
+{
+	return ucast_mgr_build_lfts(p_mgr);
+}
+
 static int ucast_build_lid_matrices(void *context)
 {
 	return osm_ucast_mgr_build_lid_matrices(context);
@@ -61,6 +61,7 @@
 #include <string.h>
 #include <search.h>
 #include <complib/cl_heap.h>
+#include <complib/cl_thread.h>
 #include <opensm/osm_file_ids.h>
 #define FILE_ID OSM_FILE_UCAST_NUE_C
 #include <opensm/osm_ucast_mgr.h>
@@ -232,6 +233,21 @@ typedef struct nue_context {
 	uint8_t *dlid_to_vl_mapping;	/*!< Store VLs to serve path_sl requ. */
 } nue_context_t;
 
+/*! \struct nue_vl_worker
+ *  \brief Thread routing virtual layers on its own network and cCDG copies.
+ */
+typedef struct nue_vl_worker {
+	cl_thread_t thread;	/*!< Thread object (unused by worker 0). */
+	nue_context_t *nue_ctx;	/*!< Shared context (destinations, etc). */
+	network_t network;	/*!< Private copy of the network. */
+	ccdg_t ccdg;		/*!< Private copy of the complete CDG. */
+	uint64_t *weight_delta;	/*!< Link weights added by the routed VLs. */
+	atomic32_t *next_vl;	/*!< Shared counter handing out the VLs. */
+	boolean_t include_switches;	/*!< Route towards switches as well. */
+	cl_spinlock_t *lft_lock;	/*!< Serializes the updates of the LFTs. */
+	int err;		/*!< Unequal to 0 if routing a VL failed. */
+} nue_vl_worker_t;
+
 #if defined (ENABLE_METIS_FOR_NUE)
 /*! \struct metis_context
  *  \brief Complete information about fabric graph to perform partitioning.
@@ -585,6 +601,29 @@ construct_network(network_t *);
 static inline void
 construct_network_node(network_node_t *);
 
+/*! \fn copy_network_and_ccdg(const osm_ucast_mgr_t *,
+ *                            const network_t *,
+ *                            const ccdg_t *,
+ *                            network_t *,
+ *                            ccdg_t *)
+ *  \brief Copy the network and the complete CDG, so that the links and edges
+ *         of the copies point into the copies; scratch state is not copied.
+ *
+ *  \param[in]  mgr         The management object of OpenSM.
+ *  \param[in]  in_network  Nue's network object storing the subnet.
+ *  \param[in]  in_ccdg     Nue's internal object storing the complete CDG.
+ *  \param[out] out_network Copy of the network.
+ *  \param[out] out_ccdg    Copy of the complete CDG.
+ *  \return Integer 0 if the copy was created sucessfully, or any integer
+ *          unequal to 0 otherwise.
+ */
+static int
+copy_network_and_ccdg(const osm_ucast_mgr_t *,
+		      const network_t *,
+		      const ccdg_t *,
+		      network_t *,
+		      ccdg_t *);
+
 /*! \fn create_context(nue_context_t *)
  *  \brief This fn calls the constructors for the network and ccdg structs, as
  *         well as allocates arrays to store destinations and VL mappings.
@@ -1349,6 +1388,16 @@ nue_get_vl_for_path(void *,
 		    const ib_net16_t,
 		    const ib_net16_t);
 
+/*! \fn nue_vl_worker_run(void *)
+ *  \brief Thread fn routing the virtual layers handed out by the shared
+ *         counter, until all are taken or an error occurred.
+ *
+ *  \param[in,out] context Pointer to a worker object (nue_vl_worker_t).
+ *  \return NONE
+ */
+static void
+nue_vl_worker_run(void *);
+
 /*! \fn osm_ucast_nue_setup(struct osm_routing_engine *,
  *                          osm_opensm_t *)
  *  \brief Interface fn exposed to OpenSM to initialize the Nue routing engine.
@@ -1644,6 +1693,49 @@ route_via_modified_dijkstra_on_ccdg(const osm_ucast_mgr_t *,
 				    const int32_t,
 				    boolean_t *);
 
+/*! \fn route_virtual_layer(const nue_context_t *,
+ *                          network_t *,
+ *                          ccdg_t *,
+ *                          const uint8_t,
+ *                          const boolean_t,
+ *                          cl_spinlock_t *)
+ *  \brief Calculates the escape paths and the deadlock-free paths towards all
+ *         destinations of one virtual layer, and stores them in the LFTs.
+ *
+ *  \param[in]     nue_ctx          Nue's context storing destinations, etc.
+ *  \param[in,out] network          Nue's network object storing the subnet.
+ *  \param[in,out] ccdg             Nue's internal object storing the cCDG.
+ *  \param[in]     vl               The virtual layer to route.
+ *  \param[in]     include_switches Route towards switches as well.
+ *  \param[in]     lft_lock         Lock serializing the LFT updates, or NULL.
+ *  \return Integer 0 if the virtual layer was routed sucessfully, or any
+ *          integer unequal to 0 otherwise.
+ */
+static int
+route_virtual_layer(const nue_context_t *,
+		    network_t *,
+		    ccdg_t *,
+		    const uint8_t,
+		    const boolean_t,
+		    cl_spinlock_t *);
+
+/*! \fn route_virtual_layers_concurrently(nue_context_t *,
+ *                                        const boolean_t,
+ *                                        const uint32_t)
+ *  \brief Routes the virtual layers with several threads, each on its own
+ *         copy of the network and the cCDG, and adds up the link weights.
+ *
+ *  \param[in,out] nue_ctx          Nue's context storing graph, cCDG, etc.
+ *  \param[in]     include_switches Route towards switches as well.
+ *  \param[in]     num_workers      Number of threads (incl. the caller).
+ *  \return Integer 0 if all virtual layers were routed sucessfully, or any
+ *          integer unequal to 0 otherwise.
+ */
+static int
+route_virtual_layers_concurrently(nue_context_t *,
+				  const boolean_t,
+				  const uint32_t);
+
 /*! \fn set_ccdg_edge_into_blocked_state(const ccdg_t *,
  *                                       ccdg_edge_t *)
  *  \brief Change a cCDG edge to set the color ID/Ptr into the BLOCKED state,
@@ -2130,6 +2222,129 @@ static inline void destroy_ccdg(ccdg_t * ccdg)
 		cl_heap_destroy(&(ccdg->heap));
 }
 
+static int copy_network_and_ccdg(const osm_ucast_mgr_t * mgr,
+				 const network_t * in_network,
+				 const ccdg_t * in_ccdg,
+				 network_t * out_network, ccdg_t * out_ccdg)
+{
+	network_node_t *in_netw_node = NULL, *out_netw_node = NULL;
+	network_link_t *in_netw_link = NULL, *out_netw_link = NULL;
+	ccdg_node_t *in_ccdg_node = NULL, *out_ccdg_node = NULL;
+	ccdg_edge_t *out_ccdg_edge = NULL;
+	uint32_t i = 0, j = 0;
+
+	CL_ASSERT(mgr && in_network && in_ccdg && out_network && out_ccdg);
+	OSM_LOG_ENTER(mgr->p_log);
+
+	construct_network(out_network);
+	construct_ccdg(out_ccdg);
+
+	out_network->nodes =
+	    (network_node_t *) calloc(in_network->num_nodes,
+				      sizeof(network_node_t));
+	out_ccdg->nodes =
+	    (ccdg_node_t *) calloc(in_ccdg->num_nodes, sizeof(ccdg_node_t));
+	if ((in_network->num_nodes && !out_network->nodes)
+	    || (in_ccdg->num_nodes && !out_ccdg->nodes))
+		goto ERROR;
+	out_network->num_nodes = in_network->num_nodes;
+	out_ccdg->num_nodes = in_ccdg->num_nodes;
+
+	/* the scratch pointers of the nodes are reset by the algorithms, so
+	   only the links and edges have to be redirected into the copies
+	 */
+	for (i = 0, in_netw_node = in_network->nodes,
+	     out_netw_node = out_network->nodes; i < in_network->num_nodes;
+	     i++, in_netw_node++, out_netw_node++) {
+		*out_netw_node = *in_netw_node;
+		out_netw_node->links = NULL;
+		out_netw_node->used_link = NULL;
+		out_netw_node->escape_path = NULL;
+		out_netw_node->stack_used_links = NULL;
+		out_netw_node->Ps = NULL;
+	}
+	for (i = 0, in_ccdg_node = in_ccdg->nodes,
+	     out_ccdg_node = out_ccdg->nodes; i < in_ccdg->num_nodes;
+	     i++, in_ccdg_node++, out_ccdg_node++) {
+		*out_ccdg_node = *in_ccdg_node;
+		out_ccdg_node->edges = NULL;
+		out_ccdg_node->corresponding_netw_link = NULL;
+		out_ccdg_node->color = NULL;
+		out_ccdg_node->pre = NULL;
+	}
+
+	for (i = 0, in_netw_node = in_network->nodes,
+	     out_netw_node = out_network->nodes; i < in_network->num_nodes;
+	     i++, in_netw_node++, out_netw_node++) {
+		if (!in_netw_node->num_links)
+			continue;
+		out_netw_node->links =
+		    (network_link_t *) malloc(in_netw_node->num_links *
+					      sizeof(network_link_t));
+		out_netw_node->stack_used_links =
+		    (network_link_t **) malloc(in_netw_node->num_links *
+					       sizeof(network_link_t *));
+		if (!out_netw_node->links || !out_netw_node->stack_used_links)
+			goto ERROR;
+
+		for (j = 0, in_netw_link = in_netw_node->links,
+		     out_netw_link = out_netw_node->links;
+		     j < in_netw_node->num_links;
+		     j++, in_netw_link++, out_netw_link++) {
+			*out_netw_link = *in_netw_link;
+			if (in_netw_link->to_network_node)
+				out_netw_link->to_network_node =
+				    out_network->nodes +
+				    (in_netw_link->to_network_node -
+				     in_network->nodes);
+			if (in_netw_link->corresponding_ccdg_node) {
+				out_netw_link->corresponding_ccdg_node =
+				    out_ccdg->nodes +
+				    (in_netw_link->corresponding_ccdg_node -
+				     in_ccdg->nodes);
+				out_netw_link->corresponding_ccdg_node->
+				    corresponding_netw_link = out_netw_link;
+			}
+		}
+	}
+
+	for (i = 0, in_ccdg_node = in_ccdg->nodes,
+	     out_ccdg_node = out_ccdg->nodes; i < in_ccdg->num_nodes;
+	     i++, in_ccdg_node++, out_ccdg_node++) {
+		if (!in_ccdg_node->num_edges)
+			continue;
+		out_ccdg_node->edges =
+		    (ccdg_edge_t *) malloc(in_ccdg_node->num_edges *
+					   sizeof(ccdg_edge_t));
+		if (!out_ccdg_node->edges)
+			goto ERROR;
+		memcpy(out_ccdg_node->edges, in_ccdg_node->edges,
+		       in_ccdg_node->num_edges * sizeof(ccdg_edge_t));
+
+		for (j = 0, out_ccdg_edge = out_ccdg_node->edges;
+		     j < in_ccdg_node->num_edges; j++, out_ccdg_edge++) {
+			out_ccdg_edge->color = NULL;
+			if (out_ccdg_edge->to_ccdg_node)
+				out_ccdg_edge->to_ccdg_node =
+				    out_ccdg->nodes +
+				    (out_ccdg_edge->to_ccdg_node -
+				     in_ccdg->nodes);
+		}
+	}
+
+	OSM_LOG_EXIT(mgr->p_log);
+	return 0;
+
+ERROR:
+	OSM_LOG(mgr->p_log, OSM_LOG_ERROR,
+		"ERR NUE49: cannot allocate memory for a copy of the network"
+		" and the complete CDG\n");
+	destroy_network(out_network);
+	destroy_ccdg(out_ccdg);
+	OSM_LOG_EXIT(mgr->p_log);
+	return -1;
+}
+
 #if defined (ENABLE_METIS_FOR_NUE)
 static inline void construct_metis_context(metis_context_t * metis_ctx)
 {
@@ -6028,26 +6243,356 @@ static inline void update_dlid_to_vl_mapping(uint8_t * dlid_to_vl_mapping,
 	dlid_to_vl_mapping[cl_ntoh16(dlid)] = virtual_layer;
 }
 
-static int nue_do_ucast_routing(void *context)
+/* route all destinations of one virtual layer; with an lft_lock, several
+   virtual layers are routed concurrently, each on its own copy of the
+   network and the cCDG, and only the updates of the LFTs are serialized
+*/
+static int route_virtual_layer(const nue_context_t * nue_ctx,
+			       network_t * network, ccdg_t * ccdg,
+			       const uint8_t vl,
+			       const boolean_t include_switches,
+			       cl_spinlock_t * lft_lock)
 {
-	nue_context_t *nue_ctx = (nue_context_t *) context;
-	osm_ucast_mgr_t *mgr = NULL;
+	osm_ucast_mgr_t *mgr = nue_ctx->mgr;
 	osm_port_t *dest_port = NULL;
-	boolean_t include_switches = FALSE;
 	ib_net16_t *dlid_iter = NULL;
 	uint16_t lid = 0, min_lid_ho = 0, max_lid_ho = 0;
 	uint16_t i = 0;
-	uint8_t vl = 0;
 	uint8_t ntype = 0;
 	int err = 0;
 	int32_t color = 0;
 	boolean_t process_sw = FALSE, fallback_to_escape_paths = FALSE;
-	network_node_t *netw_node_iter = NULL;
 #if defined (_DEBUG_)
 	ccdg_t verify_ccdg = {.num_nodes = 0, .nodes = NULL, .num_colors = 0,
 			      .color_array = NULL};
 #endif
 
+	CL_ASSERT(nue_ctx && network && ccdg);
+	OSM_LOG_ENTER(mgr->p_log);
+	OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
+		"Processing virtual layer %" PRIu8 "\n", vl);
+
+	if (!nue_ctx->num_destinations[vl]) {
+		OSM_LOG(mgr->p_log, OSM_LOG_INFO,
+			"WRN NUE43: no desti in this VL; skipping\n");
+		OSM_LOG_EXIT(mgr->p_log);
+		return 0;
+	}
+
+	color = ESCAPEPATHCOLOR + 1;
+	err = reset_ccdg_color_array(mgr, ccdg, nue_ctx->num_destinations,
+				     nue_ctx->max_vl, nue_ctx->max_lmc);
+	if (err)
+		return -1;
+	init_ccdg_colors(ccdg);
+
+	err = mark_escape_paths(mgr, network, ccdg, nue_ctx->destinations[vl],
+				nue_ctx->num_destinations[vl],
+				(0 == vl) ? TRUE : FALSE);
+	if (err)
+		return -1;
+	if (OSM_LOG_IS_ACTIVE_V2(mgr->p_log, OSM_LOG_DEBUG)) {
+		OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
+			"Complete CDG including escape paths for"
+			" virtual layer %" PRIu8 "\n", vl);
+		print_ccdg(mgr, ccdg, TRUE);
+	}
+
+	/* in the debug mode we monitor the correctness more closely */
+	CL_ASSERT(deep_cpy_ccdg(mgr, ccdg, &verify_ccdg));
+
+	process_sw = FALSE;
+	do {
+		dlid_iter = (ib_net16_t *) nue_ctx->destinations[vl];
+		for (i = 0; i < nue_ctx->num_destinations[vl];
+		     i++, dlid_iter++) {
+			dest_port = osm_get_port_by_lid(mgr->p_subn, *dlid_iter);
+			ntype = osm_node_get_type(dest_port->p_node);
+			if (ntype == IB_NODE_TYPE_CA) {
+				if (process_sw)
+					continue;
+				OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
+					"Processing Hca with GUID"
+					" 0x%016" PRIx64 "\n",
+					cl_ntoh64(osm_node_get_node_guid
+						  (dest_port->p_node)));
+			} else if (ntype == IB_NODE_TYPE_SWITCH) {
+				if (!process_sw)
+					continue;
+				OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
+					"Processing switch with GUID"
+					" 0x%016" PRIx64 "\n",
+					cl_ntoh64(osm_node_get_node_guid
+						  (dest_port->p_node)));
+			}
+
+			/* distribute the LID range across the ports that can
+			   reach those LIDs to have disjoint paths for one
+			   destination port with lmc>0; for switches with bsp0:
+			   min=max; with esp0: max>min if lmc>0
+			 */
+			osm_port_get_lid_range_ho(dest_port, &min_lid_ho,
+						  &max_lid_ho);
+			for (lid = min_lid_ho; lid <= max_lid_ho; lid++) {
+				/* search a path from all nodes to dlid
+				   without closing a cycle in the ccdg
+				 */
+				err =
+				    route_via_modified_dijkstra_on_ccdg(mgr,
+									network,
+									ccdg,
+									dest_port,
+									cl_hton16
+									(lid),
+									color++,
+									&fallback_to_escape_paths);
+				if (err)
+					return -1;
+				/* check intermediate steps for cycles
+				   in the complete cdg
+				 */
+				CL_ASSERT(add_paths_to_verify_ccdg
+					  (mgr, network,
+					   get_switch_lid(mgr, cl_hton16(lid)),
+					   ccdg, &verify_ccdg,
+					   fallback_to_escape_paths));
+				CL_ASSERT(is_ccdg_cycle_free
+					  (mgr, &verify_ccdg));
+				/* print the updated complete cdg after
+				   the routing for this desti is done
+				 */
+				if (OSM_LOG_IS_ACTIVE_V2
+				    (mgr->p_log, OSM_LOG_DEBUG)) {
+					OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
+						"Complete CDG after routing destination LID %"
+						PRIu16 " for virtual layer %"
+						PRIu8 "\n", lid, vl);
+					print_ccdg(mgr, ccdg, TRUE);
+				}
+
+				/* and print the calculated routes */
+				if (OSM_LOG_IS_ACTIVE_V2
+				    (mgr->p_log, OSM_LOG_DEBUG)) {
+					OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
+						"Calculated paths towards destination LID %"
+						PRIu16 "\n", lid);
+					print_routes(mgr, network, dest_port,
+						     cl_hton16(lid));
+				}
+
+				/* update linear forwarding tables of
+				   all switches towards this desti
+				 */
+				if (lft_lock)
+					cl_spinlock_acquire(lft_lock);
+				update_linear_forwarding_tables(mgr, network,
+								dest_port,
+								cl_hton16
+								(lid));
+				if (lft_lock)
+					cl_spinlock_release(lft_lock);
+
+				/* traverse the calculated paths and
+				   update link weights for the next
+				   step to increase the path balancing
+				 */
+				update_network_link_weights(mgr, network,
+							    get_switch_lid
+							    (mgr,
+							     cl_hton16(lid)));
+
+				/* and finally update the mapping of
+				   'destination to virtual layer'
+				 */
+				update_dlid_to_vl_mapping(nue_ctx->
+							  dlid_to_vl_mapping,
+							  cl_hton16(lid), vl);
+			}
+		}
+		if (!process_sw && include_switches)
+			process_sw = TRUE;
+		else
+			break;
+	} while (TRUE);
+
+	/* do a final check if ccdg is acyclic after processing all */
+	CL_ASSERT(is_ccdg_cycle_free(mgr, &verify_ccdg));
+#if defined (_DEBUG_)
+	destroy_ccdg(&verify_ccdg);
+#endif
+
+	OSM_LOG_EXIT(mgr->p_log);
+	return 0;
+}
+
+/* route the virtual layers handed out by next_vl; the link weights of the
+   copied network start from the original ones for each virtual layer, and
+   what a virtual layer adds to them is collected in weight_delta
+*/
+static void nue_vl_worker_run(void *context)
+{
+	nue_vl_worker_t *worker = (nue_vl_worker_t *) context;
+	const network_t *network = &(worker->nue_ctx->network);
+	network_node_t *netw_node_iter = NULL, *copy_node_iter = NULL;
+	uint64_t *delta = NULL;
+	uint32_t vl = 0;
+	uint16_t i = 0;
+	uint8_t j = 0;
+
+	while (!worker->err &&
+	       (vl = (uint32_t) cl_atomic_inc(worker->next_vl) - 1) <
+	       worker->nue_ctx->max_vl) {
+		for (i = 0, netw_node_iter = network->nodes,
+		     copy_node_iter = worker->network.nodes;
+		     i < network->num_nodes;
+		     i++, netw_node_iter++, copy_node_iter++)
+			for (j = 0; j < netw_node_iter->num_links; j++)
+				copy_node_iter->links[j].weight =
+				    netw_node_iter->links[j].weight;
+
+		worker->err =
+		    route_virtual_layer(worker->nue_ctx, &(worker->network),
+					&(worker->ccdg), (uint8_t) vl,
+					worker->include_switches,
+					worker->lft_lock);
+
+		delta = worker->weight_delta;
+		for (i = 0, netw_node_iter = network->nodes,
+		     copy_node_iter = worker->network.nodes;
+		     i < network->num_nodes;
+		     i++, netw_node_iter++, copy_node_iter++)
+			for (j = 0; j < netw_node_iter->num_links; j++)
+				*delta++ += copy_node_iter->links[j].weight -
+				    netw_node_iter->links[j].weight;
+	}
+}
+
+/* route the virtual layers with several threads; the LFTs only differ from
+   the ones of the sequential routing in the path balancing, since the link
+   weights are not carried over from one virtual layer to the next
+*/
+static int route_virtual_layers_concurrently(nue_context_t * nue_ctx,
+					     const boolean_t include_switches,
+					     const uint32_t num_workers)
+{
+	osm_ucast_mgr_t *mgr = nue_ctx->mgr;
+	network_t *network = &(nue_ctx->network);
+	nue_vl_worker_t *workers = NULL;
+	network_node_t *netw_node_iter = NULL;
+	cl_spinlock_t lft_lock;
+	atomic32_t next_vl = 0;
+	uint64_t *delta = NULL;
+	uint32_t num_links = 0, t = 0;
+	uint16_t i = 0;
+	uint8_t j = 0;
+	int err = 0;
+
+	OSM_LOG_ENTER(mgr->p_log);
+	OSM_LOG(mgr->p_log, OSM_LOG_VERBOSE,
+		"Routing %" PRIu8 " virtual layers with %u threads\n",
+		nue_ctx->max_vl, num_workers);
+
+	for (i = 0, netw_node_iter = network->nodes; i < network->num_nodes;
+	     i++, netw_node_iter++)
+		num_links += netw_node_iter->num_links;
+
+	cl_spinlock_construct(&lft_lock);
+	if (cl_spinlock_init(&lft_lock) != CL_SUCCESS) {
+		OSM_LOG(mgr->p_log, OSM_LOG_ERROR,
+			"ERR NUE50: cannot initialize the LFT lock\n");
+		return -1;
+	}
+
+	workers = (nue_vl_worker_t *) calloc(num_workers,
+					     sizeof(nue_vl_worker_t));
+	if (!workers) {
+		OSM_LOG(mgr->p_log, OSM_LOG_ERROR,
+			"ERR NUE51: cannot allocate memory for the workers\n");
+		cl_spinlock_destroy(&lft_lock);
+		return -1;
+	}
+
+	for (t = 0; t < num_workers; t++) {
+		cl_thread_construct(&workers[t].thread);
+		construct_network(&workers[t].network);
+		construct_ccdg(&workers[t].ccdg);
+		workers[t].nue_ctx = nue_ctx;
+		workers[t].next_vl = &next_vl;
+		workers[t].include_switches = include_switches;
+		workers[t].lft_lock = &lft_lock;
+	}
+
+	/* each worker routes on its own copy of the network and the cCDG */
+	for (t = 0; t < num_workers; t++) {
+		workers[t].weight_delta =
+		    (uint64_t *) calloc(num_links ? num_links : 1,
+					sizeof(uint64_t));
+		if (!workers[t].weight_delta) {
+			OSM_LOG(mgr->p_log, OSM_LOG_ERROR,
+				"ERR NUE51: cannot allocate memory for the"
+				" workers\n");
+			err = -1;
+			goto Exit;
+		}
+		err = copy_network_and_ccdg(mgr, network, &(nue_ctx->ccdg),
+					    &workers[t].network,
+					    &workers[t].ccdg);
+		if (err)
+			goto Exit;
+	}
+
+	/* the calling thread is worker 0; if a thread cannot be created,
+	   the other workers take over its virtual layers
+	 */
+	for (t = 1; t < num_workers; t++)
+		cl_thread_init(&workers[t].thread, nue_vl_worker_run,
+			       &workers[t], "nue worker");
+	nue_vl_worker_run(&workers[0]);
+	for (t = 0; t < num_workers; t++) {
+		cl_thread_destroy(&workers[t].thread);
+		err |= workers[t].err;
+	}
+	if (err)
+		goto Exit;
+
+	/* add the weights of all virtual layers to the original network,
+	   which is used for the switch-to-switch paths and multicast
+	 */
+	for (t = 0; t < num_workers; t++) {
+		delta = workers[t].weight_delta;
+		for (i = 0, netw_node_iter = network->nodes;
+		     i < network->num_nodes; i++, netw_node_iter++)
+			for (j = 0; j < netw_node_iter->num_links; j++)
+				netw_node_iter->links[j].weight += *delta++;
+	}
+
+Exit:
+	for (t = 0; t < num_workers; t++) {
+		destroy_network(&workers[t].network);
+		destroy_ccdg(&workers[t].ccdg);
+		free(workers[t].weight_delta);
+	}
+	free(workers);
+	cl_spinlock_destroy(&lft_lock);
+
+	OSM_LOG_EXIT(mgr->p_log);
+	return err;
+}
+
+
+static int nue_do_ucast_routing(void *context)
+{
+	nue_context_t *nue_ctx = (nue_context_t *) context;
+	osm_ucast_mgr_t *mgr = NULL;
+	osm_port_t *dest_port = NULL;
+	boolean_t include_switches = FALSE;
+	uint16_t lid = 0, min_lid_ho = 0, max_lid_ho = 0;
+	uint16_t i = 0;
+	uint32_t num_threads = 0;
+	uint8_t vl = 0;
+	int err = 0;
+	network_node_t *netw_node_iter = NULL;
+
 	if (nue_ctx)
 		mgr = (osm_ucast_mgr_t *) nue_ctx->mgr;
 	else
@@ -6074,180 +6619,27 @@ static int nue_do_ucast_routing(void *context)
 		print_destination_distribution(mgr, nue_ctx->destinations,
 					       nue_ctx->num_destinations);
 
-	for (vl = 0; vl < nue_ctx->max_vl; vl++) {
-		OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
-			"Processing virtual layer %" PRIu8 "\n", vl);
-
-		if (!nue_ctx->num_destinations[vl]) {
-			OSM_LOG(mgr->p_log, OSM_LOG_INFO,
-				"WRN NUE43: no desti in this VL; skipping\n");
-			continue;
-		}
-
-		color = ESCAPEPATHCOLOR + 1;
-		err =
-		    reset_ccdg_color_array(mgr, &(nue_ctx->ccdg),
-					   nue_ctx->num_destinations,
-					   nue_ctx->max_vl, nue_ctx->max_lmc);
-		if (err) {
-			destroy_context(nue_ctx);
-			return -1;
-		}
-		init_ccdg_colors(&(nue_ctx->ccdg));
-
-		err =
-		    mark_escape_paths(mgr, &(nue_ctx->network),
-				      &(nue_ctx->ccdg),
-				      nue_ctx->destinations[vl],
-				      nue_ctx->num_destinations[vl],
-				      (0 == vl) ? TRUE : FALSE);
-		if (err) {
-			destroy_context(nue_ctx);
-			return -1;
-		}
-		if (OSM_LOG_IS_ACTIVE_V2(mgr->p_log, OSM_LOG_DEBUG)) {
-			OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
-				"Complete CDG including escape paths for"
-				" virtual layer %" PRIu8 "\n", vl);
-			print_ccdg(mgr, &(nue_ctx->ccdg), TRUE);
-		}
-
-		/* in the debug mode we monitor the correctness more closely */
-		CL_ASSERT(deep_cpy_ccdg(mgr, &(nue_ctx->ccdg), &verify_ccdg));
-
-		process_sw = FALSE;
-		do {
-			dlid_iter = (ib_net16_t *) nue_ctx->destinations[vl];
-			for (i = 0; i < nue_ctx->num_destinations[vl];
-			     i++, dlid_iter++) {
-				dest_port =
-				    osm_get_port_by_lid(mgr->p_subn,
-							*dlid_iter);
-				ntype = osm_node_get_type(dest_port->p_node);
-				if (ntype == IB_NODE_TYPE_CA) {
-					if (process_sw)
-						continue;
-					OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
-						"Processing Hca with GUID"
-						" 0x%016" PRIx64 "\n",
-						cl_ntoh64(osm_node_get_node_guid
-							  (dest_port->p_node)));
-				} else if (ntype == IB_NODE_TYPE_SWITCH) {
-					if (!process_sw)
-						continue;
-					OSM_LOG(mgr->p_log, OSM_LOG_DEBUG,
-						"Processing switch with GUID"
-						" 0x%016" PRIx64 "\n",
-						cl_ntoh64(osm_node_get_node_guid
-							  (dest_port->p_node)));
-				}
-
-				/* distribute the LID range across the ports
-				   that can reach those LIDs to have disjoint
-				   paths for one destination port with lmc>0;
-				   for switches with bsp0: min=max; with esp0:
-				   max>min if lmc>0
-				 */
-				osm_port_get_lid_range_ho(dest_port,
-							  &min_lid_ho,
-							  &max_lid_ho);
-				for (lid = min_lid_ho; lid <= max_lid_ho; lid++) {
-					/* search a path from all nodes to dlid
-					   without closing a cycle in the ccdg
-					 */
-					err =
-					    route_via_modified_dijkstra_on_ccdg
-					    (mgr, &(nue_ctx->network),
-					     &(nue_ctx->ccdg), dest_port,
-					     cl_hton16(lid), color++,
-					     &fallback_to_escape_paths);
-					if (err) {
-						destroy_context(nue_ctx);
-						return -1;
-					}
-					/* check intermediate steps for cycles
-					   in the complete cdg
-					 */
-					CL_ASSERT(add_paths_to_verify_ccdg
-						  (mgr, &(nue_ctx->network),
-						   get_switch_lid(mgr,
-								  cl_hton16
-								  (lid)),
-						   &(nue_ctx->ccdg),
-						   &verify_ccdg,
-						   fallback_to_escape_paths));
-					CL_ASSERT(is_ccdg_cycle_free
-						  (mgr, &verify_ccdg));
-					/* print the updated complete cdg after
-					   the routing for this desti is done
-					 */
-					if (OSM_LOG_IS_ACTIVE_V2
-					    (mgr->p_log, OSM_LOG_DEBUG)) {
-						OSM_LOG(mgr->p_log,
-							OSM_LOG_DEBUG,
-							"Complete CDG after routing destination LID %"
-							PRIu16
-							" for virtual layer %"
-							PRIu8 "\n", lid, vl);
-						print_ccdg(mgr,
-							   &(nue_ctx->ccdg),
-							   TRUE);
-					}
-
-					/* and print the calculated routes */
-					if (OSM_LOG_IS_ACTIVE_V2
-					    (mgr->p_log, OSM_LOG_DEBUG)) {
-						OSM_LOG(mgr->p_log,
-							OSM_LOG_DEBUG,
-							"Calculated paths towards destination LID %"
-							PRIu16 "\n", lid);
-						print_routes(mgr,
-							     &(nue_ctx->
-							       network),
-							     dest_port,
-							     cl_hton16(lid));
-					}
-
-					/* update linear forwarding tables of
-					   all switches towards this desti
-					 */
-					update_linear_forwarding_tables(mgr,
-									&
-									(nue_ctx->
-									 network),
-									dest_port,
-									cl_hton16
-									(lid));
-
-					/* traverse the calculated paths and
-					   update link weights for the next
-					   step to increase the path balancing
-					 */
-					update_network_link_weights(mgr,
-								    &(nue_ctx->
-								      network),
-								    get_switch_lid
-								    (mgr,
-								     cl_hton16
-								     (lid)));
-
-					/* and finally update the mapping of
-					   'destination to virtual layer'
-					 */
-					update_dlid_to_vl_mapping(nue_ctx->
-								  dlid_to_vl_mapping,
-								  cl_hton16
-								  (lid), vl);
-				}
-			}
-			if (!process_sw && include_switches)
-				process_sw = TRUE;
-			else
-				break;
-		} while (TRUE);
-
-		/* do a final check if ccdg is acyclic after processing all */
-		CL_ASSERT(is_ccdg_cycle_free(mgr, &verify_ccdg));
+	/* the virtual layers are independent of each other, besides the link
+	   weights used for the path balancing, and can be routed in parallel
+	 */
+	num_threads = mgr->p_subn->opt.nue_num_threads;
+	if (!num_threads)
+		num_threads = cl_proc_count();
+	if (num_threads > nue_ctx->max_vl)
+		num_threads = nue_ctx->max_vl;
+
+	if (num_threads > 1)
+		err = route_virtual_layers_concurrently(nue_ctx,
+							include_switches,
+							num_threads);
+	else
+		for (vl = 0; vl < nue_ctx->max_vl && !err; vl++)
+			err = route_virtual_layer(nue_ctx, &(nue_ctx->network),
+						  &(nue_ctx->ccdg), vl,
+						  include_switches, NULL);
+	if (err) {
+		destroy_context(nue_ctx);
+		return -1;
 	}
 
 	/* if switches haven't been included in the original destinations set
@@ -45,9 +45,11 @@
 #  include <config.h>
 #endif				/* HAVE_CONFIG_H */
 
+#include <stdlib.h>
 #include <string.h>
 #include <iba/ib_types.h>
 #include <complib/cl_thread.h>
+#include <complib/cl_timer.h>
 #include <opensm/osm_file_ids.h>
 #define FILE_ID OSM_FILE_VL15INTF_C
 #include <vendor/osm_vendor_api.h>
@@ -56,6 +58,148 @@
 #include <opensm/osm_log.h>
 #include <opensm/osm_helper.h>
 
+#define VL15_KEY_LID	(1ULL << 32)
+#define VL15_KEY_DR	(1ULL << 63)
+
+/*
+   The window is shrunk when the smoothed response latency of a
+   destination grows to this many times the lowest one seen for it.
+ */
+#define VL15_SLOW_FACTOR	2
+
+static uint64_t vl15_dest_key(IN const osm_madw_t * p_madw)
+{
+	const ib_smp_t *p_smp = osm_madw_get_smp_ptr(p_madw);
+	uint64_t key = 14695981039346656037ULL;
+	uint16_t lid = cl_ntoh16(p_madw->mad_addr.dest_lid);
+	uint8_t i;
+
+	if (p_smp->mgmt_class != IB_MCLASS_SUBN_DIR)
+		return VL15_KEY_LID | lid;
+
+	/*
+	   A directed route SMP is addressed by the LID it is sent to
+	   and by its initial path from there.
+	 */
+	key = (key ^ (lid >> 8)) * 1099511628211ULL;
+	key = (key ^ (lid & 0xff)) * 1099511628211ULL;
+	for (i = 1; i <= p_smp->hop_count && i < IB_SUBNET_PATH_HOPS_MAX; i++)
+		key = (key ^ p_smp->initial_path[i]) * 1099511628211ULL;
+
+	return VL15_KEY_DR | key;
+}
+
+/*
+   Puts the destination in the ready list if it has MADs to send
+   and room on the wire, or frees it once it is idle.
+   Called with the lock held.
+ */
+static void vl15_dest_update(IN osm_vl15_t * p_vl,
+			     IN osm_vl15_dest_t * p_dest)
+{
+	if (cl_is_qlist_empty(&p_dest->fifo)) {
+		CL_ASSERT(!p_dest->ready);
+		if (!p_dest->on_wire) {
+			cl_qmap_remove_item(&p_vl->dests, &p_dest->map_item);
+			free(p_dest);
+		}
+		return;
+	}
+
+	if (!p_dest->ready && (!p_vl->max_wire_smps_per_dest ||
+			       p_dest->on_wire < p_vl->max_wire_smps_per_dest)) {
+		cl_qlist_insert_tail(&p_vl->ready, &p_dest->list_item);
+		p_dest->ready = TRUE;
+	}
+}
+
+/*
+   Takes the next request MAD from the destination at the head of the
+   ready list, and moves that destination to the tail.
+   Called with the lock held.
+ */
+static osm_madw_t *vl15_get_request(IN osm_vl15_t * p_vl)
+{
+	cl_list_item_t *p_item;
+	osm_vl15_dest_t *p_dest;
+	osm_madw_t *p_madw;
+
+	p_item = cl_qlist_remove_head(&p_vl->ready);
+	if (p_item == cl_qlist_end(&p_vl->ready))
+		return NULL;
+
+	p_dest = PARENT_STRUCT(p_item, osm_vl15_dest_t, list_item);
+	p_dest->ready = FALSE;
+
+	p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_dest->fifo);
+	p_madw->send_time = cl_get_time_stamp();
+	p_dest->on_wire++;
+
+	vl15_dest_update(p_vl, p_dest);
+
+	return p_madw;
+}
+
+/*
+   AIMD window: grows by one MAD per window of timely responses,
+   and is halved at most once per window when a request times out
+   or the responses of a destination slow down.  Destinations are
+   compared with themselves, since switches further away answer
+   later even on an idle fabric.
+   Called with the lock held.
+ */
+static void vl15_update_window(IN osm_vl15_t * p_vl,
+			       IN osm_vl15_dest_t * p_dest,
+			       IN uint64_t latency, IN boolean_t timed_out)
+{
+	uint32_t max_window = p_vl->max_wire_smps2 > p_vl->max_wire_smps ?
+	    p_vl->max_wire_smps2 : p_vl->max_wire_smps;
+	boolean_t slow = timed_out;
+
+	if (!timed_out) {
+		if (!latency)
+			latency = 1;
+		if (p_vl->srtt)
+			p_vl->srtt += ((int64_t) latency -
+				       (int64_t) p_vl->srtt) / 8;
+		else
+			p_vl->srtt = latency;
+
+		if (p_dest->srtt)
+			p_dest->srtt += ((int64_t) latency -
+					 (int64_t) p_dest->srtt) / 4;
+		else
+			p_dest->srtt = latency;
+		if (!p_dest->base_rtt || p_dest->srtt < p_dest->base_rtt)
+			p_dest->base_rtt = p_dest->srtt;
+
+		slow = p_dest->srtt > VL15_SLOW_FACTOR * p_dest->base_rtt;
+	}
+
+	p_vl->window_epoch++;
+
+	if (slow) {
+		if (p_vl->window_epoch < p_vl->window)
+			return;
+		p_vl->window_epoch = 0;
+		p_vl->window_acked = 0;
+		if (p_vl->window > 1) {
+			p_vl->window /= 2;
+			OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
+				"%s, window shrunk to %u SMPs\n",
+				timed_out ? "SMP timed out" : "SMP latency grew",
+				p_vl->window);
+		}
+		return;
+	}
+
+	if (++p_vl->window_acked >= p_vl->window) {
+		p_vl->window_acked = 0;
+		if (p_vl->window < max_window)
+			p_vl->window++;
+	}
+}
+
 static void vl15_send_mad(osm_vl15_t * p_vl, osm_madw_t * p_madw)
 {
 	ib_api_status_t status;
@@ -133,7 +277,6 @@ static void vl15_poller(IN void *p_ptr)
 	ib_api_status_t status;
 	osm_madw_t *p_madw;
 	osm_vl15_t *p_vl = p_ptr;
-	cl_qlist_t *p_fifo;
 	int32_t max_smps = p_vl->max_wire_smps;
 	int32_t max_smps2 = p_vl->max_wire_smps2;
 
@@ -149,20 +292,19 @@ static void vl15_poller(IN void *p_ptr)
 		   There are lots of corner cases here so tread carefully.
 
 		   The unicast FIFO has priority, since somebody is waiting
-		   for a timely response.
+		   for a timely response.  Request MADs are then taken from
+		   the destinations that may send, in turn.
 		 */
 		cl_spinlock_acquire(&p_vl->lock);
 
 		if (cl_qlist_count(&p_vl->ufifo) != 0)
-			p_fifo = &p_vl->ufifo;
+			p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->ufifo);
 		else
-			p_fifo = &p_vl->rfifo;
-
-		p_madw = (osm_madw_t *) cl_qlist_remove_head(p_fifo);
+			p_madw = vl15_get_request(p_vl);
 
 		cl_spinlock_release(&p_vl->lock);
 
-		if (p_madw != (osm_madw_t *) cl_qlist_end(p_fifo)) {
+		if (p_madw) {
 			OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
 				"Servicing p_madw = %p\n", p_madw);
 			if (OSM_LOG_IS_ACTIVE_V2(p_vl->p_log, OSM_LOG_FRAMES))
@@ -173,11 +315,30 @@ static void vl15_poller(IN void *p_ptr)
 			vl15_send_mad(p_vl, p_madw);
 		} else
 			/*
-			   The VL15 FIFO is empty, so we have nothing left to do.
+			   The VL15 FIFO is empty, or all destinations with
+			   queued MADs are at their limit, so we have nothing
+			   left to do.
 			 */
 			status = cl_event_wait_on(&p_vl->signal,
 						  EVENT_NO_TIMEOUT, TRUE);
 
+		if (p_vl->adaptive_window) {
+			while (p_vl->p_stats->qp0_mads_outstanding_on_wire >=
+			       (int32_t) p_vl->window &&
+			       p_vl->thread_state == OSM_THREAD_STATE_RUN) {
+				status = cl_event_wait_on(&p_vl->signal,
+							  EVENT_NO_TIMEOUT,
+							  TRUE);
+				if (status != CL_SUCCESS) {
+					OSM_LOG(p_vl->p_log, OSM_LOG_ERROR,
+						"ERR 3E02: Event wait failed (%s)\n",
+						CL_STATUS_MSG(status));
+					break;
+				}
+			}
+			continue;
+		}
+
 		while (p_vl->p_stats->qp0_mads_outstanding_on_wire >= max_smps &&
 		       p_vl->thread_state == OSM_THREAD_STATE_RUN) {
 			status = cl_event_wait_on(&p_vl->signal,
@@ -213,13 +374,15 @@ void osm_vl15_construct(IN osm_vl15_t * p_vl)
 	p_vl->thread_state = OSM_THREAD_STATE_NONE;
 	cl_event_construct(&p_vl->signal);
 	cl_spinlock_construct(&p_vl->lock);
-	cl_qlist_init(&p_vl->rfifo);
+	cl_qmap_init(&p_vl->dests);
+	cl_qlist_init(&p_vl->ready);
 	cl_qlist_init(&p_vl->ufifo);
 	cl_thread_construct(&p_vl->poller);
 }
 
 void osm_vl15_destroy(IN osm_vl15_t * p_vl, IN struct osm_mad_pool *p_pool)
 {
+	osm_vl15_dest_t *p_dest;
 	osm_madw_t *p_madw;
 
 	OSM_LOG_ENTER(p_vl->p_log);
@@ -244,10 +407,17 @@ void osm_vl15_destroy(IN osm_vl15_t * p_vl, IN struct osm_mad_pool *p_pool)
 
 	cl_spinlock_acquire(&p_vl->lock);
 
-	while (!cl_is_qlist_empty(&p_vl->rfifo)) {
-		p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->rfifo);
-		osm_mad_pool_put(p_pool, p_madw);
+	while (cl_qmap_count(&p_vl->dests)) {
+		p_dest = (osm_vl15_dest_t *) cl_qmap_head(&p_vl->dests);
+		while (!cl_is_qlist_empty(&p_dest->fifo)) {
+			p_madw = (osm_madw_t *)
+			    cl_qlist_remove_head(&p_dest->fifo);
+			osm_mad_pool_put(p_pool, p_madw);
+		}
+		cl_qmap_remove_item(&p_vl->dests, &p_dest->map_item);
+		free(p_dest);
 	}
+	cl_qlist_init(&p_vl->ready);
 	while (!cl_is_qlist_empty(&p_vl->ufifo)) {
 		p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->ufifo);
 		osm_mad_pool_put(p_pool, p_madw);
@@ -267,7 +437,9 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl, IN osm_vendor_t * p_vend,
 			      IN osm_subn_t * p_subn,
 			      IN int32_t max_wire_smps,
 			      IN int32_t max_wire_smps2,
-			      IN uint32_t max_smps_timeout)
+			      IN uint32_t max_smps_timeout,
+			      IN uint32_t max_wire_smps_per_dest,
+			      IN boolean_t adaptive_window)
 {
 	ib_api_status_t status = IB_SUCCESS;
 
@@ -281,6 +453,9 @@ ib_api_status_t osm_vl15_init(IN osm_vl15_t * p_vl, IN osm_vendor_t * p_vend,
 	p_vl->max_wire_smps2 = max_wire_smps2;
 	p_vl->max_smps_timeout = max_wire_smps < max_wire_smps2 ?
 				 max_smps_timeout : EVENT_NO_TIMEOUT;
+	p_vl->max_wire_smps_per_dest = max_wire_smps_per_dest;
+	p_vl->adaptive_window = adaptive_window;
+	p_vl->window = max_wire_smps;
 
 	status = cl_event_init(&p_vl->signal, FALSE);
 	if (status != IB_SUCCESS)
@@ -319,7 +494,8 @@ void osm_vl15_poll(IN osm_vl15_t * p_vl)
 	   thread checks for a spurious wake-up.
 	 */
 	if (p_vl->p_stats->qp0_mads_outstanding_on_wire <
-	    (int32_t) p_vl->max_wire_smps) {
+	    (int32_t) (p_vl->adaptive_window ? p_vl->window :
+		       p_vl->max_wire_smps)) {
 		OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
 			"Signalling poller thread\n");
 		cl_event_signal(&p_vl->signal);
@@ -330,18 +506,46 @@ void osm_vl15_poll(IN osm_vl15_t * p_vl)
 
 void osm_vl15_post(IN osm_vl15_t * p_vl, IN osm_madw_t * p_madw)
 {
+	cl_map_item_t *p_item;
+	osm_vl15_dest_t *p_dest;
+
 	OSM_LOG_ENTER(p_vl->p_log);
 
 	CL_ASSERT(p_vl->state == OSM_VL15_STATE_READY);
 
 	OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG, "Posting p_madw = %p\n", p_madw);
 
+	if (p_madw->resp_expected == TRUE)
+		p_madw->vl15_key = vl15_dest_key(p_madw);
+
 	/*
 	   Determine in which fifo to place the pending madw.
 	 */
 	cl_spinlock_acquire(&p_vl->lock);
 	if (p_madw->resp_expected == TRUE) {
-		cl_qlist_insert_tail(&p_vl->rfifo, &p_madw->list_item);
+		p_item = cl_qmap_get(&p_vl->dests, p_madw->vl15_key);
+		if (p_item == cl_qmap_end(&p_vl->dests)) {
+			p_dest = malloc(sizeof(*p_dest));
+			if (p_dest) {
+				memset(p_dest, 0, sizeof(*p_dest));
+				cl_qlist_init(&p_dest->fifo);
+				cl_qmap_insert(&p_vl->dests, p_madw->vl15_key,
+					       &p_dest->map_item);
+			}
+		} else
+			p_dest = (osm_vl15_dest_t *) p_item;
+
+		if (p_dest) {
+			cl_qlist_insert_tail(&p_dest->fifo,
+					     &p_madw->list_item);
+			vl15_dest_update(p_vl, p_dest);
+		} else {
+			OSM_LOG(p_vl->p_log, OSM_LOG_ERROR, "ERR 3E05: "
+				"Failed to allocate destination queue, "
+				"sending without per destination limit\n");
+			p_madw->vl15_key = 0;
+			cl_qlist_insert_tail(&p_vl->ufifo, &p_madw->list_item);
+		}
 		osm_stats_inc_qp0_outstanding(p_vl->p_stats);
 	} else
 		cl_qlist_insert_tail(&p_vl->ufifo, &p_madw->list_item);
@@ -357,8 +561,40 @@ void osm_vl15_post(IN osm_vl15_t * p_vl, IN osm_madw_t * p_madw)
 	OSM_LOG_EXIT(p_vl->p_log);
 }
 
+void osm_vl15_complete(IN osm_vl15_t * p_vl, IN const osm_madw_t * p_madw,
+		       IN ib_api_status_t status)
+{
+	cl_map_item_t *p_item;
+	osm_vl15_dest_t *p_dest;
+
+	if (!p_madw || !p_madw->vl15_key || !p_madw->send_time)
+		return;
+
+	cl_spinlock_acquire(&p_vl->lock);
+
+	p_item = cl_qmap_get(&p_vl->dests, p_madw->vl15_key);
+	if (p_item != cl_qmap_end(&p_vl->dests)) {
+		p_dest = (osm_vl15_dest_t *) p_item;
+
+		/* only responses and timeouts tell about the fabric */
+		if (p_vl->adaptive_window &&
+		    (status == IB_SUCCESS || status == IB_TIMEOUT))
+			vl15_update_window(p_vl, p_dest, cl_get_time_stamp() -
+					   p_madw->send_time,
+					   status == IB_TIMEOUT);
+
+		CL_ASSERT(p_dest->on_wire);
+		p_dest->on_wire--;
+		vl15_dest_update(p_vl, p_dest);
+	}
+
+	cl_spinlock_release(&p_vl->lock);
+}
+
 void osm_vl15_shutdown(IN osm_vl15_t * p_vl, IN osm_mad_pool_t * p_mad_pool)
 {
+	cl_map_item_t *p_item;
+	osm_vl15_dest_t *p_dest;
 	osm_madw_t *p_madw;
 
 	OSM_LOG_ENTER(p_vl->p_log);
@@ -383,16 +619,28 @@ void osm_vl15_shutdown(IN osm_vl15_t * p_vl, IN osm_mad_pool_t * p_mad_pool)
 	}
 
 	/* Request MADs we send out */
-	p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->rfifo);
-	while (p_madw != (osm_madw_t *) cl_qlist_end(&p_vl->rfifo)) {
-		OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
-			"Releasing Request p_madw = %p\n", p_madw);
+	p_item = cl_qmap_head(&p_vl->dests);
+	while (p_item != cl_qmap_end(&p_vl->dests)) {
+		p_dest = (osm_vl15_dest_t *) p_item;
+		p_item = cl_qmap_next(p_item);
 
-		osm_mad_pool_put(p_mad_pool, p_madw);
-		osm_stats_dec_qp0_outstanding(p_vl->p_stats);
+		p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_dest->fifo);
+		while (p_madw != (osm_madw_t *) cl_qlist_end(&p_dest->fifo)) {
+			OSM_LOG(p_vl->p_log, OSM_LOG_DEBUG,
+				"Releasing Request p_madw = %p\n", p_madw);
+
+			osm_mad_pool_put(p_mad_pool, p_madw);
+			osm_stats_dec_qp0_outstanding(p_vl->p_stats);
+
+			p_madw = (osm_madw_t *)
+			    cl_qlist_remove_head(&p_dest->fifo);
+		}
 
-		p_madw = (osm_madw_t *) cl_qlist_remove_head(&p_vl->rfifo);
+		/* keep the destinations with MADs still on the wire */
+		p_dest->ready = FALSE;
+		vl15_dest_update(p_vl, p_dest);
 	}
+	cl_qlist_init(&p_vl->ready);
 
 	/* free the lock */
 	cl_spinlock_release(&p_vl->lock);
@@ -169,6 +169,34 @@ static void handle_lft_change_event(_log_events_t *log,
 		lft_change->flags, lft_change->lft_top, lft_change->block_num);
 }
 
+/** =========================================================================
+ */
+static void handle_sweep_profile_event(_log_events_t *log,
+				       osm_sweep_prof_rec_t *p_rec)
+{
+	int i;
+
+	fprintf(log->log_file,
+		"Sweep %u (%s): %" PRIu64 " usec wall, %" PRIu64 " usec CPU, "
+		"%u MADs sent, %u received, %u failed, %u resent\n",
+		p_rec->sweep_num, osm_sweep_prof_type_str(p_rec),
+		p_rec->total.wall_usec, p_rec->total.cpu_usec,
+		p_rec->total.mads_sent, p_rec->total.mads_rcvd,
+		p_rec->total.mads_failed, p_rec->total.mads_resent);
+	for (i = 0; i < OSM_SWEEP_PHASE_MAX; i++) {
+		if (!p_rec->phase[i].count)
+			continue;
+		fprintf(log->log_file,
+			"   %s: %" PRIu64 " usec wall, %" PRIu64 " usec CPU, "
+			"%u MADs sent, %u received, %u failed, %u resent\n",
+			osm_sweep_phase_str(i),
+			p_rec->phase[i].wall_usec, p_rec->phase[i].cpu_usec,
+			p_rec->phase[i].mads_sent, p_rec->phase[i].mads_rcvd,
+			p_rec->phase[i].mads_failed,
+			p_rec->phase[i].mads_resent);
+	}
+}
+
 /** =========================================================================
  */
 static void report(void *_log, osm_epi_event_id_t event_id, void *event_data)
@@ -210,6 +238,9 @@ static void report(void *_log, osm_epi_event_id_t event_id, void *event_data)
 	case OSM_EVENT_ID_LFT_CHANGE:
 		handle_lft_change_event(log, (osm_epi_lft_change_event_t *) event_data);
 		break;
+	case OSM_EVENT_ID_SWEEP_PROFILE:
+		handle_sweep_profile_event(log, (osm_sweep_prof_rec_t *) event_data);
+		break;
 	case OSM_EVENT_ID_MAX:
 	default:
 		osm_log(log->osmlog, OSM_LOG_ERROR,